@@ -0,0 +1,16 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <string>
+#include <iostream>
+
+// Assemble one of cgc's programs into a .vpo or .fpo image; verbose dumps the microcode to stderr:
+int compileVP(const std::string & prg,std::string & binary,int optimize,int verbose);
+int compileFP(const std::string & prg,std::string & binary,int optimize,int verbose);
+
+// Compile every program listed in a manifest on jobs threads, and write them to out as an archive
+// (rsxProgramArchive). manifest_filename locates the sources, and may be 0 for a manifest read from
+// stdin:
+int compileBatch(const char * manifest_filename,std::istream & manifest,std::ostream & out,int optimize,int jobs,const char * cgc);
+
+#endif
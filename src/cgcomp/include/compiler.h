@@ -21,6 +21,7 @@ public:
 	virtual ~CCompiler();
 
 	void Compile(CParser *pParser);
+	void Optimize();
 
 	int GetInputMask() const {return m_nInputMask;}
 	int GetOutputMask() const {return m_nOutputMask;}
@@ -22,6 +22,7 @@ public:
 	virtual ~CCompilerFP();
 
 	void Compile(CParser *pParser);
+	void Optimize();
 
 	int GetNumRegs() const { return m_nNumRegs; }
 	int GetFPControl() const { return m_nFPControl; }
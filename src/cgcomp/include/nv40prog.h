@@ -113,6 +113,25 @@ typedef struct rsx_attrib
   uint8_t _pad0[2];
 } rsxProgramAttrib;
 
+/*! \brief Program archive data structure.
+
+This data structure is written by nv40asm -b, which compiles the programs listed in a manifest. Entries are in the manifest's order; entries that compiled to the same program share one copy of it. */
+typedef struct rsx_archive
+{
+  uint32_t magic;		/*!< \brief magic identifier, 'RSXA' */
+  uint32_t num_entries;		/*!< \brief number of entries */
+  uint32_t entry_off;		/*!< \brief offset to the entry table */
+  uint32_t num_programs;	/*!< \brief number of distinct programs */
+} rsxProgramArchive;
+
+/*! \brief Program archive entry. */
+typedef struct rsx_archive_entry
+{
+  uint32_t name_off;		/*!< \brief offset of the entry's name: its source file and definitions, as in the manifest */
+  uint32_t program_off;		/*!< \brief offset of the rsxVertexProgram or rsxFragmentProgram, aligned to 16 bytes */
+  uint32_t program_size;	/*!< \brief size of the program, in bytes */
+} rsxProgramArchiveEntry;
+
 /*! \brief Get Ucode from RSX vertex program.
 \param vp Pointer the to vertex program structure.
 \return Pointer to the ucode.
@@ -7,6 +7,10 @@
 #include <string>
 #include <sstream>
 
+#if defined(_MSC_VER)
+#define strtok_r strtok_s
+#endif
+
 #include "nv30_vertprog.h"
 #include "nv40_vertprog.h"
 #include "nv30-40_3d.xml.h"
@@ -138,6 +142,13 @@ protected:
 	bool isDigit(int c);
 	bool isWhitespace(int c);
 
+	// strtok(), with the state kept here, so that programs can be parsed on
+	// several threads at once (nv40asm -b):
+	inline char* Tokenize(char *str,const char *delim)
+	{
+		return strtok_r(str,delim,&m_pTokenState);
+	}
+
 	inline char* SkipSpaces(char *ptr)
 	{
 		while(ptr && *ptr==' ') {
@@ -146,6 +157,8 @@ protected:
 		return ptr;
 	}
 
+	char *m_pTokenState;
+
 	int m_nOption;
 	int m_nInstructions;
 	struct nvfx_insn *m_pInstructions;
@@ -0,0 +1,315 @@
+// Batch mode, nv40asm -b: compiles every program listed in a manifest, on several threads, into
+// one archive that the library loads with glShaderBinary(..., GL_PROGRAM_ARCHIVE_RSX, ...).
+//
+// Each line of the manifest is a profile (vp40 or fp40), a source file, and any number of
+// preprocessor definitions for cgc (NAME or NAME=VALUE):
+//
+// fp40 shaders/lighting.frag FOG=1 SHADOWS
+//
+// Blank lines, and lines starting with #, are skipped. Sources are relative to the manifest. A
+// source that's already cgc's output (it starts with "!!VP" or "!!FP") is assembled as it is;
+// anything else is run through cgc first, as GLSL if it ends in .glsl, .vert or .frag (as nv40c
+// decides). Entries that compile to the same program are stored once.
+
+#include <unistd.h>
+#include <pthread.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <iterator>
+
+#include "types.h"
+#include "nv40prog.h"
+#include "batch.h"
+
+struct batch_entry {
+  int line;
+  int type;
+  std::string source;
+  std::vector< std::string > defines;
+  std::string name;
+
+  // Results:
+  std::string binary;
+  std::string error;
+  u64 hash;
+};
+
+struct batch_state {
+  std::vector< batch_entry > * entries;
+  const char * cgc;
+  int optimize;
+
+  pthread_mutex_t mutex;
+  size_t next;
+};
+
+static std::string shellquote(const std::string & s)
+{
+  std::string result("'");
+  for(size_t i = 0;i < s.length();++i) {
+    if(s[i] == '\'') result += "'\\''";
+    else result += s[i];
+  }
+  return result + "'";
+}
+
+static bool hassuffix(const std::string & s,const char * suffix)
+{
+  const size_t n = strlen(suffix);
+  return s.length() > n && s.compare(s.length() - n,n,suffix) == 0;
+}
+
+// FNV-1a:
+static u64 hashbinary(const std::string & binary)
+{
+  u64 hash = 14695981039346656037ULL;
+  for(size_t i = 0;i < binary.length();++i) {
+    hash ^= (u8)binary[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static void compileEntry(batch_entry & entry,const char * cgc,int optimize)
+{
+  std::ifstream file(entry.source.c_str(),std::ios::in | std::ios::binary);
+  if(!file.is_open()) {
+    entry.error = "failed to open " + entry.source;
+    return;
+  }
+
+  std::string prg((std::istreambuf_iterator< char >(file)),std::istreambuf_iterator< char >());
+
+  if(prg.compare(0,2,"!!") != 0) {
+    std::string command = shellquote(cgc) + ((entry.type == 'v') ? " -profile vp40" : " -profile fp40");
+    if(hassuffix(entry.source,".glsl") || hassuffix(entry.source,".vert") || hassuffix(entry.source,".frag")) {
+      command += " -oglsl";
+    }
+    for(std::vector< std::string >::const_iterator it = entry.defines.begin();it != entry.defines.end();++it) {
+      command += " " + shellquote("-D" + *it);
+    }
+    command += " " + shellquote(entry.source);
+
+    FILE * pipe = popen(command.c_str(),"r");
+    if(pipe == 0) {
+      entry.error = "failed to run " + command;
+      return;
+    }
+
+    prg.clear();
+    char buffer[4096];
+    size_t n = 0;
+    while((n = fread(buffer,1,sizeof(buffer),pipe)) > 0) {
+      prg.append(buffer,n);
+    }
+
+    if(pclose(pipe) != 0) {
+      entry.error = "cgc failed on " + entry.source;
+      return;
+    }
+  }
+
+  if(prg.compare(0,4,(entry.type == 'v') ? "!!VP" : "!!FP") != 0) {
+    entry.error = entry.source + " isn't a " + ((entry.type == 'v') ? "vertex" : "fragment") + " program";
+    return;
+  }
+
+  const int result = (entry.type == 'v') ?
+    compileVP(prg,entry.binary,optimize,0) :
+    compileFP(prg,entry.binary,optimize,0);
+  if(result != EXIT_SUCCESS) {
+    entry.error = "failed to assemble " + entry.source;
+    return;
+  }
+
+  entry.hash = hashbinary(entry.binary);
+}
+
+static void * compileThread(void * arg)
+{
+  batch_state * state = (batch_state *)arg;
+
+  while(1) {
+    pthread_mutex_lock(&state -> mutex);
+    const size_t i = state -> next++;
+    pthread_mutex_unlock(&state -> mutex);
+
+    if(i >= state -> entries -> size()) break;
+
+    compileEntry((*state -> entries)[i],state -> cgc,state -> optimize);
+  }
+
+  return 0;
+}
+
+static bool parseManifest(std::istream & in,const std::string & directory,std::vector< batch_entry > & entries)
+{
+  std::string line;
+  int number = 0;
+
+  while(std::getline(in,line)) {
+    ++number;
+
+    std::istringstream words(line);
+    std::string profile, source;
+    if(!(words >> profile) || profile[0] == '#') continue;
+
+    batch_entry entry;
+    entry.line = number;
+    entry.hash = 0;
+
+    if(profile == "vp40") {
+      entry.type = 'v';
+    }
+    else if(profile == "fp40") {
+      entry.type = 'f';
+    }
+    else {
+      std::cerr << "manifest:" << number << ": unknown profile " << profile << "; must be either vp40 or fp40" << std::endl;
+      return false;
+    }
+
+    if(!(words >> source)) {
+      std::cerr << "manifest:" << number << ": no source file" << std::endl;
+      return false;
+    }
+
+    entry.name = source;
+    entry.source = (source[0] == '/' || directory.empty()) ? source : (directory + "/" + source);
+
+    std::string define;
+    while(words >> define) {
+      entry.defines.push_back(define);
+      entry.name += " " + define;
+    }
+
+    entries.push_back(entry);
+  }
+
+  return true;
+}
+
+static void put32(std::string & out,u32 v)
+{
+  out += (char)(v >> 24);
+  out += (char)(v >> 16);
+  out += (char)(v >> 8);
+  out += (char)v;
+}
+
+static void align(std::string & out,size_t alignment)
+{
+  while(out.length() & (alignment - 1)) out += '\0';
+}
+
+int compileBatch(const char * manifest_filename,std::istream & manifest,std::ostream & out,int optimize,int jobs,const char * cgc)
+{
+  std::string directory;
+  if(manifest_filename != 0) {
+    directory = manifest_filename;
+    const size_t slash = directory.rfind('/');
+    directory = (slash == std::string::npos) ? std::string() : directory.substr(0,slash);
+  }
+
+  std::vector< batch_entry > entries;
+  if(!parseManifest(manifest,directory,entries)) {
+    return EXIT_FAILURE;
+  }
+
+  // Compile:
+  batch_state state;
+  state.entries = &entries;
+  state.cgc = cgc;
+  state.optimize = optimize;
+  state.next = 0;
+  pthread_mutex_init(&state.mutex,0);
+
+  if(jobs < 1) jobs = 1;
+  if((size_t)jobs > entries.size()) jobs = entries.size();
+
+  std::vector< pthread_t > threads(jobs);
+  int nthreads = 0;
+  for(int i = 0;i < jobs;++i) {
+    if(pthread_create(&threads[nthreads],0,compileThread,&state) == 0) ++nthreads;
+  }
+  // Threads couldn't be had, so work here:
+  if(nthreads == 0) compileThread(&state);
+  for(int i = 0;i < nthreads;++i) {
+    pthread_join(threads[i],0);
+  }
+
+  pthread_mutex_destroy(&state.mutex);
+
+  int errors = 0;
+  for(std::vector< batch_entry >::const_iterator it = entries.begin();it != entries.end();++it) {
+    if(!it -> error.empty()) {
+      std::cerr << (manifest_filename ? manifest_filename : "manifest") << ":" << it -> line << ": " << it -> error << std::endl;
+      ++errors;
+    }
+  }
+  if(errors > 0) {
+    return EXIT_FAILURE;
+  }
+
+  // Find the distinct programs; the hash only finds candidates, which are compared in full:
+  std::vector< size_t > program(entries.size());
+  std::vector< size_t > programs;
+  std::multimap< u64, size_t > byhash;
+  for(size_t i = 0;i < entries.size();++i) {
+    program[i] = programs.size();
+    std::pair< std::multimap< u64, size_t >::const_iterator, std::multimap< u64, size_t >::const_iterator > range = byhash.equal_range(entries[i].hash);
+    for(std::multimap< u64, size_t >::const_iterator it = range.first;it != range.second;++it) {
+      if(entries[programs[it -> second]].binary == entries[i].binary) {
+	program[i] = it -> second;
+	break;
+      }
+    }
+    if(program[i] == programs.size()) {
+      byhash.insert(std::make_pair(entries[i].hash,programs.size()));
+      programs.push_back(i);
+    }
+  }
+
+  // Header, entries and names:
+  std::string archive;
+  put32(archive,('R'<<24)|('S'<<16)|('X'<<8)|'A');
+  put32(archive,entries.size());
+  put32(archive,sizeof(rsxProgramArchive));
+  put32(archive,programs.size());
+
+  const size_t entry_off = archive.length();
+  archive.resize(entry_off + entries.size() * sizeof(rsxProgramArchiveEntry));
+
+  std::vector< u32 > name_off(entries.size());
+  for(size_t i = 0;i < entries.size();++i) {
+    name_off[i] = archive.length();
+    archive += entries[i].name;
+    archive += '\0';
+  }
+
+  // Programs:
+  std::vector< u32 > program_off(programs.size());
+  for(size_t i = 0;i < programs.size();++i) {
+    align(archive,16);
+    program_off[i] = archive.length();
+    archive += entries[programs[i]].binary;
+  }
+
+  std::string table;
+  for(size_t i = 0;i < entries.size();++i) {
+    put32(table,name_off[i]);
+    put32(table,program_off[program[i]]);
+    put32(table,entries[i].binary.length());
+  }
+  archive.replace(entry_off,table.length(),table);
+
+  out.write(archive.data(),archive.length());
+
+  std::cerr << entries.size() << " programs, " << programs.size() << " distinct, " << archive.length() << " bytes" << std::endl;
+
+  return out.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
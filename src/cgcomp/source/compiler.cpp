@@ -2,6 +2,7 @@
 
 #include "parser.h"
 #include "compiler.h"
+#include "nvfx_optimize.h"
 
 #define gen_op(o,t) \
 	((NVFX_VP_INST_SLOT_##t<<7)|NVFX_VP_INST_##t##_OP_##o)
@@ -270,6 +271,39 @@ void CCompiler::Compile(CParser *pParser)
 	}
 }
 
+void CCompiler::Optimize()
+{
+	if(!m_nInstructions || !m_lBranchRelocation.empty()) return;
+
+	// only one constant can be read per instruction
+	std::vector<int> consts(m_nInstructions,-1);
+	std::vector<unsigned> remap(m_nInstructions);
+	for(std::list<struct nvfx_relocation>::iterator it = m_lConstRelocation.begin();it!=m_lConstRelocation.end();it++)
+		consts[it->location] = it->target;
+
+	struct nvfx_vp_opt opt;
+	memset(&opt,0,sizeof(opt));
+	opt.insn = m_pInstructions[0].data;
+	opt.nr_insns = m_nInstructions;
+	opt.consts = &consts[0];
+	opt.remap = &remap[0];
+
+	if(!nvfx_vp_optimize(&opt,NVFX_OPT_ALL)) return;
+
+	m_nInstructions = opt.nr_insns;
+	m_nCurInstruction = m_nInstructions - 1;
+
+	m_lConstRelocation.clear();
+	for(int i=0;i<m_nInstructions;i++) {
+		if(consts[i]<0) continue;
+
+		struct nvfx_relocation reloc;
+		reloc.location = i;
+		reloc.target = consts[i];
+		m_lConstRelocation.push_back(reloc);
+	}
+}
+
 static const char * reg_types[] = {
   "NONE",
   "OUT ",
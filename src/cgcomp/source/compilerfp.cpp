@@ -2,6 +2,7 @@
 
 #include "parser.h"
 #include "compilerfp.h"
+#include "nvfx_optimize.h"
 
 #define arith(s,d,m,s0,s1,s2) \
 	nvfx_insn((s),0,-1,(d),(m),(s0),(s1),(s2))
@@ -223,6 +224,40 @@ void CCompilerFP::Compile(CParser *pParser)
 	}
 }
 
+void CCompilerFP::Optimize()
+{
+	if(!m_nInstructions) return;
+
+	// offsets are kept in instructions, the optimizer's in words
+	std::vector<unsigned> patched, remap(m_nInstructions*4);
+	for(std::list<struct fragment_program_data>::iterator it = m_lConstData.begin();it!=m_lConstData.end();it++)
+		patched.push_back(it->offset*4);
+
+	struct nvfx_fp_opt opt;
+	memset(&opt,0,sizeof(opt));
+	opt.insn = m_pInstructions[0].data;
+	opt.insn_len = m_nInstructions*4;
+	opt.live_out = (m_nFPControl&0xe) ? 0x3 : 0x1; // colour is left in R0, depth in R1
+	opt.patched = patched.empty() ? NULL : &patched[0];
+	opt.nr_patched = patched.size();
+	opt.remap = &remap[0];
+
+	if(!nvfx_fp_optimize(&opt,NVFX_OPT_ALL)) return;
+
+	std::list<struct fragment_program_data>::iterator it = m_lConstData.begin();
+	while(it!=m_lConstData.end()) {
+		if(remap[it->offset*4]==NVFX_OPT_REMOVED)
+			it = m_lConstData.erase(it);
+		else {
+			it->offset = remap[it->offset*4]/4;
+			it++;
+		}
+	}
+
+	m_nInstructions = opt.insn_len/4;
+	m_nCurInstruction = opt.last/4;
+}
+
 void CCompilerFP::emit_insn(u8 op,struct nvfx_insn *insn)
 {
 	u32 *hw;
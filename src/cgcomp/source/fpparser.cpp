@@ -217,15 +217,15 @@ int CFPParser::Parse(const char *str)
 			}
 
 			if(valid) {
-				label = strtok(ptr,":\x20");
+				label = Tokenize(ptr,":\x20");
 				ptr = col_ptr + 1;
 			}
 		}
 
-		opcode = strtok(ptr," ");
+		opcode = Tokenize(ptr," ");
 
 		if(opcode) {
-			char *param_str = SkipSpaces(strtok(NULL,"\0"));
+			char *param_str = SkipSpaces(Tokenize(NULL,"\0"));
 			if(strcasecmp(opcode,"OPTION")==0) {
 				if(strncasecmp(param_str,"NV_fragment_program2",20)==0)
 					m_nOption |= NV_OPTION_FP2;
@@ -259,7 +259,7 @@ int CFPParser::Parse(const char *str)
 
 void CFPParser::ParseInstruction(struct nvfx_insn *insn,opcode *opc,const char *param_str)
 {
-	char *token = SkipSpaces(strtok((char*)param_str,","));
+	char *token = SkipSpaces(Tokenize((char*)param_str,","));
 
 	insn->precision = opc->suffixes&(_R|_H|_X);
 	insn->sat = ((opc->suffixes&_S) ? TRUE : FALSE);
@@ -270,7 +270,7 @@ void CFPParser::ParseInstruction(struct nvfx_insn *insn,opcode *opc,const char *
 	}
 
 	if(opc->outputs!=OUTPUT_NONE && opc->inputs!=INPUT_NONE) {
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 	}
 
 	if(opc->inputs==INPUT_1V) {
@@ -278,32 +278,32 @@ void CFPParser::ParseInstruction(struct nvfx_insn *insn,opcode *opc,const char *
 	} else if(opc->inputs==INPUT_2V) {
 		ParseVectorSrc(token,&insn->src[0]);
 
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseVectorSrc(token,&insn->src[1]);
 	} else if(opc->inputs==INPUT_3V) {
 		ParseVectorSrc(token,&insn->src[0]);
 
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseVectorSrc(token,&insn->src[1]);
 
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseVectorSrc(token,&insn->src[2]);
 	} else if(opc->inputs==INPUT_1S) {
 		ParseScalarSrc(token,&insn->src[0]);
 	} else if(opc->inputs==INPUT_2S) {
 		ParseScalarSrc(token,&insn->src[0]);
 
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseScalarSrc(token,&insn->src[1]);
 	} else if(opc->inputs==INPUT_1V_T) {
 		u8 unit,target;
 
 		ParseVectorSrc(token,&insn->src[0]);
 
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseTextureUnit(token,&unit);
 
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseTextureTarget(token,&target);
 
 		insn->unit = unit;
@@ -312,16 +312,16 @@ void CFPParser::ParseInstruction(struct nvfx_insn *insn,opcode *opc,const char *
 
 		ParseVectorSrc(token,&insn->src[0]);
 
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseVectorSrc(token,&insn->src[1]);
 
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseVectorSrc(token,&insn->src[2]);
 
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseTextureUnit(token,&unit);
 
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseTextureTarget(token,&target);
 
 		insn->unit = unit;
@@ -420,8 +420,8 @@ void CFPParser::ParseOutput(const char *param_str)
 {
 	oparam p;
 	s32 reg = -1;
-	char *token = SkipSpaces(strtok((char*)param_str," ="));
-	char *name = SkipSpaces(strtok(NULL,"=\0"));
+	char *token = SkipSpaces(Tokenize((char*)param_str," ="));
+	char *name = SkipSpaces(Tokenize(NULL,"=\0"));
 
 	ParseOutputReg(name,&reg);
 
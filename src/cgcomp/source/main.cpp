@@ -8,6 +8,7 @@
 #include "vpparser.h"
 #include "compiler.h"
 #include "compilerfp.h"
+#include "batch.h"
 
 #if !defined(WIN32)
 #include <dlfcn.h>
@@ -39,6 +40,10 @@ void usage()
   std::cerr << "\t-f\t\tInput is fragment program\n" << std::endl;
   std::cerr << "\t-v\t\tInput is vertex program\n" << std::endl;
   std::cerr << "\t-o <filename>\tWrite output to <filename> instead of to stdout\n" << std::endl;
+  std::cerr << "\t-O <level>\tOptimize the microcode (1, the default) or not (0)\n" << std::endl;
+  std::cerr << "\t-b\t\tInput is a manifest of programs to compile into an archive\n" << std::endl;
+  std::cerr << "\t-j <jobs>\tCompile a manifest's programs on <jobs> threads (default: one per processor)\n" << std::endl;
+  std::cerr << "\t-c <cgc>\tRun <cgc> to compile a manifest's programs (default: $CGC, or cgc)\n" << std::endl;
 }
 
 std::string
@@ -69,16 +74,15 @@ readinput(std::istream & in)
 }
 
 
-int compileVP(std::istream & in,std::ostream & out)
+int compileVP(const std::string & prg,std::string & binary,int optimize,int verbose)
 {
-  std::string prg = readinput(in);
-
   if(prg.length() > 0) {
     CVPParser parser;
     CCompiler compiler;
     
     parser.Parse(prg.c_str());
     compiler.Compile(&parser);
+    if(optimize) compiler.Optimize();
     
     struct vertex_program_exec *vpi = compiler.GetInstructions();
     std::list<struct nvfx_relocation> branch_reloc = compiler.GetBranchRelocations();
@@ -199,36 +203,33 @@ int compileVP(std::istream & in,std::ostream & out)
       dstcodeptr[n+2] = SWAP32(vpi[i].data[2]);
       dstcodeptr[n+3] = SWAP32(vpi[i].data[3]);
 
-      fprintf(stderr,"%04u: %08x %08x %08x %08x\n",i,
-	      SWAP32(dstcodeptr[n + 0]),SWAP32(dstcodeptr[n + 1]),SWAP32(dstcodeptr[n + 2]),SWAP32(dstcodeptr[n + 3]));
+      if(verbose) {
+	fprintf(stderr,"%04u: %08x %08x %08x %08x\n",i,
+		SWAP32(dstcodeptr[n + 0]),SWAP32(dstcodeptr[n + 1]),SWAP32(dstcodeptr[n + 2]),SWAP32(dstcodeptr[n + 3]));
+      }
 
       const uint32_t opcode = (vpi[i].data[1] & NV40_VP_INST_VEC_OPCODE_MASK) >> NV40_VP_INST_VEC_OPCODE_SHIFT;
     }
 
-    out.write((const char *)vertexprogram,lastoff);
+    binary.assign((const char *)vertexprogram,lastoff);
+    free(vertexprogram);
 
-    if(out.good()) {
-      return EXIT_SUCCESS;
-    }
-    else {
-      return EXIT_FAILURE;
-    }
+    return EXIT_SUCCESS;
   }
   else {
     return EXIT_FAILURE;
   }
 }
 
-int compileFP(std::istream & in,std::ostream & out)
+int compileFP(const std::string & prg,std::string & binary,int optimize,int verbose)
 {
-  std::string prg = readinput(in);
-
   if(prg.length() > 0) {
     CFPParser parser;
     CCompilerFP compiler;
     
     parser.Parse(prg.c_str());
     compiler.Compile(&parser);
+    if(optimize) compiler.Optimize();
     
     int n,i;
     u16 magic = ('F'<<8)|'P';
@@ -365,8 +366,10 @@ int compileFP(std::istream & in,std::ostream & out)
       dstcodeptr[n+2] = endian_fp((SWAP32(fpi[i].data[2])));
       dstcodeptr[n+3] = endian_fp((SWAP32(fpi[i].data[3])));
 
-      fprintf(stderr,"%04u: %08x %08x %08x %08x\n",i,
-	      SWAP32(dstcodeptr[n + 0]),SWAP32(dstcodeptr[n + 1]),SWAP32(dstcodeptr[n + 2]),SWAP32(dstcodeptr[n + 3]));
+      if(verbose) {
+	fprintf(stderr,"%04u: %08x %08x %08x %08x\n",i,
+		SWAP32(dstcodeptr[n + 0]),SWAP32(dstcodeptr[n + 1]),SWAP32(dstcodeptr[n + 2]),SWAP32(dstcodeptr[n + 3]));
+      }
       
       const uint32_t opcode = (fpi[i].data[0] & NVFX_FP_OP_OPCODE_MASK) >> NVFX_FP_OP_OPCODE_SHIFT;
       const uint32_t outreg = (fpi[i].data[0] & NVFX_FP_OP_OUT_REG_MASK) >> NVFX_FP_OP_OUT_REG_SHIFT;
@@ -379,15 +382,9 @@ int compileFP(std::istream & in,std::ostream & out)
       };
     }
     
-    out.write((const char *)fragmentprogram,lastoff);
+    binary.assign((const char *)fragmentprogram,lastoff);
+    free(fragmentprogram);
 
-    if(out.good()) {
-      return EXIT_SUCCESS;
-    }
-    else {
-      return EXIT_FAILURE;
-    }
-    
     return EXIT_SUCCESS;
   }
   return EXIT_FAILURE;
@@ -401,15 +398,34 @@ int main(int argc,char * const argv[])
 
   const char * output_filename = 0;
 
-  while((opt = getopt(argc,argv,"vfo:h")) != -1) {
-    // set the program type:
-    if(opt == 'v' || opt == 'f') {
+  int optimize = 1;
+
+  int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+  const char * cgc = getenv("CGC");
+  if(cgc == 0) cgc = "cgc";
+
+  while((opt = getopt(argc,argv,"vfbo:O:j:c:h")) != -1) {
+    // set the program type, or batch mode:
+    if(opt == 'v' || opt == 'f' || opt == 'b') {
       type = opt;
     }
     // write output to a file, instead of to stdout:
     else if(opt == 'o') {
       output_filename = optarg;
     }
+    // optimization level:
+    else if(opt == 'O') {
+      optimize = atoi(optarg);
+    }
+    // threads for batch mode:
+    else if(opt == 'j') {
+      jobs = atoi(optarg);
+    }
+    // cgc for batch mode:
+    else if(opt == 'c') {
+      cgc = optarg;
+    }
     else if(opt == 'h') {
       usage();
       return 0;
@@ -440,17 +456,28 @@ int main(int argc,char * const argv[])
     }
   }
 
+  std::istream & in = (argc > 0) ? input_file : std::cin;
+  std::ostream & out = (output_filename != 0) ? output_file : std::cout;
+
+  if(type == 'b') {
+    return compileBatch((argc > 0) ? *argv : 0,in,out,optimize,jobs,cgc);
+  }
+
+  std::string prg = readinput(in);
+  std::string binary;
+  int result = EXIT_FAILURE;
+
   if(type == 'v') {
-    return compileVP((argc > 0) ? input_file : std::cin,
-		     (output_filename != 0) ? output_file : std::cout);
+    result = compileVP(prg,binary,optimize,1);
   }
   else if(type == 'f') {
-    return compileFP((argc > 0) ? input_file : std::cin,
-		     (output_filename != 0) ? output_file : std::cout);
+    result = compileFP(prg,binary,optimize,1);
   }
-  else {
-    return EXIT_FAILURE;
+
+  if(result == EXIT_SUCCESS) {
+    out.write(binary.data(),binary.length());
+    if(!out.good()) result = EXIT_FAILURE;
   }
 
-  return 0;
+  return result;
 }
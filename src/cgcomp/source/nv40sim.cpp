@@ -0,0 +1,331 @@
+// nv40sim: disassembles a program written by nv40asm, estimates what it costs and, optionally,
+// runs it once on the host. For example:
+//
+// nv40sim program.fpo
+// nv40sim -x -s color=1,0.5,0.25,1 -s tint=0.5,0.5,0.5,1 program.fpo
+// nv40sim -x -s position=1,2,3,1 -s modelview=1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1 program.vpo
+//
+// Values set with -s go to the attribute or constant of that name; more than four values fill
+// consecutive elements of an array or matrix. Everything else is 0, or the constant's default.
+
+#include <unistd.h>
+#include <stddef.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <iterator>
+
+#include "types.h"
+#include "nv40prog.h"
+#include "nvfx_interp.h"
+
+struct setting {
+  std::string name;
+  std::vector< float > values;
+};
+
+void usage()
+{
+  std::cerr << "Usage: nv40sim [options] [input]\n" << std::endl;
+  std::cerr << "Options\n" << std::endl;
+  std::cerr << "\t-x\t\tExecute the program once\n" << std::endl;
+  std::cerr << "\t-s <name>=<x>,...\tSet an attribute or constant, for -x\n" << std::endl;
+  std::cerr << "\t-q\t\tDon't print the disassembly\n" << std::endl;
+}
+
+// Programs are big endian:
+static u16 read16(const std::vector< u8 > & data,u32 off)
+{
+  return (off + 2 <= data.size()) ? ((data[off] << 8) | data[off + 1]) : 0;
+}
+
+static u32 read32(const std::vector< u8 > & data,u32 off)
+{
+  return (off + 4 <= data.size()) ? ((data[off] << 24) | (data[off + 1] << 16) | (data[off + 2] << 8) | data[off + 3]) : 0;
+}
+
+static float readfloat(const std::vector< u8 > & data,u32 off)
+{
+  ieee32_t v;
+  v.u = read32(data,off);
+  return v.f;
+}
+
+static std::string readname(const std::vector< u8 > & data,u32 off)
+{
+  std::string result;
+  if(off == 0) return result;
+  while(off < data.size() && data[off] != 0) result += (char)data[off++];
+  return result;
+}
+
+// nv40asm swaps the halves of each fragment program word, as the hardware expects:
+static u32 endian_fp(u32 v)
+{
+  return ( ( ( v >> 16 ) & 0xffff ) << 0 ) |
+         ( ( ( v >> 0 ) & 0xffff ) << 16 );
+}
+
+static bool parsesetting(const char * arg,setting & s)
+{
+  const char * eq = strchr(arg,'=');
+  if(eq == 0 || eq == arg) return false;
+
+  s.name = std::string(arg,eq - arg);
+  s.values.clear();
+
+  const char * p = eq + 1;
+  while(*p) {
+    char * end = 0;
+    const float f = strtof(p,&end);
+    if(end == p) return false;
+    s.values.push_back(f);
+    p = end;
+    if(*p == ',') ++p;
+    else if(*p) return false;
+  }
+  return !s.values.empty();
+}
+
+static void printvector(const char * name,const float v[4])
+{
+  printf("%s = { %g, %g, %g, %g }\n",name,v[0],v[1],v[2],v[3]);
+}
+
+// Finds the attribute or constant entry named (name_off is first in both); returns its offset, or 0:
+static u32 findentry(const std::vector< u8 > & data,u32 off,u32 count,u32 size,const std::string & name)
+{
+  for(u32 i = 0;i < count;++i,off += size) {
+    if(readname(data,read32(data,off + offsetof(rsxProgramAttrib,name_off))) == name) return off;
+  }
+  return 0;
+}
+
+int simulateVP(const std::vector< u8 > & data,const std::list< setting > & settings,int disassemble,int execute)
+{
+  const u32 ucode_off = read32(data,offsetof(rsxVertexProgram,ucode_off));
+  const u32 num_insn = read16(data,offsetof(rsxVertexProgram,num_insn));
+  if(ucode_off + num_insn * 16 > data.size()) {
+    std::cerr << "Truncated vertex program" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector< uint32_t > insn(num_insn * 4);
+  for(u32 i = 0;i < num_insn * 4;++i) insn[i] = read32(data,ucode_off + i * 4);
+
+  if(disassemble) nvfx_vp_disassemble(stdout,&insn[0],num_insn);
+
+  struct nvfx_vp_cost cost;
+  nvfx_vp_cost(&insn[0],num_insn,&cost);
+  printf("# %u instructions (%u vector, %u scalar, %u co-issued), %u texture, %u special, %u branches; %u temporaries; ~%u cycles\n",
+	 cost.insns,cost.vec,cost.sca,cost.coissued,cost.tex,cost.special,cost.branches,cost.temps,cost.cycles);
+
+  if(!execute) return EXIT_SUCCESS;
+
+  struct nvfx_vp_machine * m = (struct nvfx_vp_machine *)calloc(1,sizeof(struct nvfx_vp_machine));
+  m -> base = read16(data,offsetof(rsxVertexProgram,start_insn));
+
+  // Constants' defaults:
+  const u32 const_off = read32(data,offsetof(rsxVertexProgram,const_off));
+  const u32 num_const = read16(data,offsetof(rsxVertexProgram,num_const));
+  for(u32 i = 0,off = const_off;i < num_const;++i,off += sizeof(rsxProgramConst)) {
+    const u32 index = read32(data,off + offsetof(rsxProgramConst,index));
+    if(index >= NVFX_INTERP_VP_CONSTS) continue;
+    for(u32 j = 0;j < 4;++j) m -> consts[index][j] = readfloat(data,off + offsetof(rsxProgramConst,values) + j * 4);
+  }
+
+  const u32 attrib_off = read32(data,offsetof(rsxVertexProgram,attrib_off));
+  const u32 num_attrib = read16(data,offsetof(rsxVertexProgram,num_attrib));
+  for(std::list< setting >::const_iterator it = settings.begin();it != settings.end();++it) {
+    const u32 nvectors = (it -> values.size() + 3) / 4;
+    u32 off = findentry(data,attrib_off,num_attrib,sizeof(rsxProgramAttrib),it -> name);
+    if(off != 0 && !data[off + offsetof(rsxProgramAttrib,is_output)]) {
+      const u32 index = read32(data,off + offsetof(rsxProgramAttrib,index));
+      for(u32 j = 0;j < 4 && j < it -> values.size() && index < NVFX_INTERP_VP_INPUTS;++j) m -> inputs[index][j] = it -> values[j];
+      continue;
+    }
+    off = findentry(data,const_off,num_const,sizeof(rsxProgramConst),it -> name);
+    if(off != 0) {
+      for(u32 k = 0;k < nvectors;++k,off += sizeof(rsxProgramConst)) {
+	const u32 index = read32(data,off + offsetof(rsxProgramConst,index));
+	for(u32 j = 0;j < 4 && (k * 4 + j) < it -> values.size() && index < NVFX_INTERP_VP_CONSTS;++j) m -> consts[index][j] = it -> values[k * 4 + j];
+      }
+      continue;
+    }
+    std::cerr << "No attribute or constant named " << it -> name << std::endl;
+    free(m);
+    return EXIT_FAILURE;
+  }
+
+  const int result = nvfx_vp_execute(m,&insn[0],num_insn);
+  if(result == 0) {
+    printf("# executed %u instructions, ~%u cycles\n",m -> executed,m -> cycles);
+    for(u32 i = 0;i < NVFX_INTERP_VP_OUTPUTS;++i) {
+      if(!(m -> written & (1 << i))) continue;
+      char name[16];
+      snprintf(name,sizeof(name),"o[%u]",i);
+      printvector(name,m -> outputs[i]);
+    }
+  }
+  else {
+    std::cerr << "Execution failed after " << m -> executed << " instructions" << std::endl;
+  }
+
+  free(m);
+  return (result == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int simulateFP(const std::vector< u8 > & data,const std::list< setting > & settings,int disassemble,int execute)
+{
+  const u32 ucode_off = read32(data,offsetof(rsxFragmentProgram,ucode_off));
+  const u32 num_insn = read16(data,offsetof(rsxFragmentProgram,num_insn));
+  if(ucode_off + num_insn * 16 > data.size()) {
+    std::cerr << "Truncated fragment program" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector< uint32_t > insn(num_insn * 4);
+  for(u32 i = 0;i < num_insn * 4;++i) insn[i] = endian_fp(read32(data,ucode_off + i * 4));
+
+  // Uniforms are patched into the inline constants they're used by, through offset tables:
+  const u32 const_off = read32(data,offsetof(rsxFragmentProgram,const_off));
+  const u32 num_const = read16(data,offsetof(rsxFragmentProgram,num_const));
+  const u32 attrib_off = read32(data,offsetof(rsxFragmentProgram,attrib_off));
+  const u32 num_attrib = read16(data,offsetof(rsxFragmentProgram,num_attrib));
+  const u32 fp_control = read32(data,offsetof(rsxFragmentProgram,fp_control));
+
+  float inputs[NVFX_INTERP_FP_INPUTS][4];
+  memset(inputs,0,sizeof(inputs));
+
+  for(std::list< setting >::const_iterator it = settings.begin();it != settings.end();++it) {
+    const u32 nvectors = (it -> values.size() + 3) / 4;
+    u32 off = findentry(data,attrib_off,num_attrib,sizeof(rsxProgramAttrib),it -> name);
+    if(off != 0 && !data[off + offsetof(rsxProgramAttrib,is_output)]) {
+      const u32 index = read32(data,off + offsetof(rsxProgramAttrib,index));
+      for(u32 j = 0;j < 4 && j < it -> values.size() && index < NVFX_INTERP_FP_INPUTS;++j) inputs[index][j] = it -> values[j];
+      continue;
+    }
+    off = findentry(data,const_off,num_const,sizeof(rsxProgramConst),it -> name);
+    if(off != 0) {
+      for(u32 k = 0;k < nvectors;++k,off += sizeof(rsxProgramConst)) {
+	const u32 table_off = read32(data,off + offsetof(rsxProgramConst,index));
+	const u32 n = read32(data,table_off);
+	for(u32 t = 0;t < n;++t) {
+	  const u32 word = read32(data,table_off + 4 + t * 4) / 4;
+	  for(u32 j = 0;j < 4 && (k * 4 + j) < it -> values.size() && (word + j) < insn.size();++j) {
+	    ieee32_t v;
+	    v.f = it -> values[k * 4 + j];
+	    insn[word + j] = v.u;
+	  }
+	}
+      }
+      continue;
+    }
+    std::cerr << "No attribute or constant named " << it -> name << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if(disassemble) nvfx_fp_disassemble(stdout,&insn[0],insn.size());
+
+  struct nvfx_fp_cost cost;
+  nvfx_fp_cost(&insn[0],insn.size(),&cost);
+  printf("# %u instructions, %u inline constants, %u texture, %u special, %u reduced precision, %u branches; %u registers; ~%u cycles\n",
+	 cost.insns,cost.consts,cost.tex,cost.special,cost.half,cost.branches,cost.regs,cost.cycles);
+
+  if(!execute) return EXIT_SUCCESS;
+
+  struct nvfx_fp_machine m;
+  memset(&m,0,sizeof(m));
+  memcpy(m.inputs,inputs,sizeof(inputs));
+
+  const int result = nvfx_fp_execute(&m,&insn[0],insn.size());
+  if(result == 0) {
+    printf("# executed %u instructions, ~%u cycles\n",m.executed,m.cycles);
+    if(m.killed) {
+      printf("killed\n");
+    }
+    else {
+      // The colour is R0, or H0 if the program was written to use half precision:
+      float v[4];
+      nvfx_fp_read_reg(&m,0,0,v);
+      printvector("R0",v);
+      nvfx_fp_read_reg(&m,0,1,v);
+      printvector("H0",v);
+      if(fp_control & 0xe) {
+	nvfx_fp_read_reg(&m,1,0,v);
+	printf("depth = %g\n",v[2]);
+      }
+    }
+  }
+  else {
+    std::cerr << "Execution failed after " << m.executed << " instructions" << std::endl;
+  }
+
+  return (result == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc,char * const argv[])
+{
+  int opt = -1;
+
+  int execute = 0, disassemble = 1;
+
+  std::list< setting > settings;
+
+  while((opt = getopt(argc,argv,"xs:qh")) != -1) {
+    if(opt == 'x') {
+      execute = 1;
+    }
+    else if(opt == 's') {
+      setting s;
+      if(!parsesetting(optarg,s)) {
+	std::cerr << "Can't parse " << optarg << std::endl;
+	return EXIT_FAILURE;
+      }
+      settings.push_back(s);
+    }
+    else if(opt == 'q') {
+      disassemble = 0;
+    }
+    else if(opt == 'h') {
+      usage();
+      return 0;
+    }
+    else {
+      usage();
+      return EXIT_FAILURE;
+    }
+  };
+
+  argc -= optind;
+  argv += optind;
+
+  std::ifstream input_file;
+  if(argc > 0) {
+    input_file.open(*argv,std::ios::in | std::ios::binary);
+    if(!input_file.is_open()) {
+      std::cerr << "Failed to open file " << *argv << " for reading" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::istream & in = (argc > 0) ? input_file : std::cin;
+  std::vector< u8 > data((std::istreambuf_iterator< char >(in)),std::istreambuf_iterator< char >());
+
+  // The type of program is in its magic number:
+  const u16 magic = read16(data,0);
+  if(magic == (('V'<<8)|'P')) {
+    return simulateVP(data,settings,disassemble,execute);
+  }
+  else if(magic == (('F'<<8)|'P')) {
+    return simulateFP(data,settings,disassemble,execute);
+  }
+  else {
+    std::cerr << "Not a program written by nv40asm" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
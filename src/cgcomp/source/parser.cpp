@@ -22,6 +22,7 @@ static const u32 PARAM_TYPE_CNT = sizeof(paramtypes)/sizeof(struct _paramtype);
 
 CParser::CParser()
 {
+	m_pTokenState = NULL;
 	m_nOption = 0;
 	m_nInstructions = 0;
 }
@@ -40,34 +41,34 @@ void CParser::ParseComment(const char *line)
 	line++;
 
 	if(strncasecmp(line,"var",3)==0) {
-		char *token = SkipSpaces(strtok((char*)(line+3)," :"));
+		char *token = SkipSpaces(Tokenize((char*)(line+3)," :"));
 		p.type = GetParamType(token);
 		p.is_const = 0;
 		p.is_internal = 0;
 		p.is_output = 0;
 		p.count = 1;
-		p.name = SkipSpaces(strtok(NULL," :"));
+		p.name = SkipSpaces(Tokenize(NULL," :"));
 
-		token = SkipSpaces(strtok(NULL," :"));
+		token = SkipSpaces(Tokenize(NULL," :"));
 		if(strstr(token,"$vin")) {
-			token = SkipSpaces(strtok(NULL," :"));
+			token = SkipSpaces(Tokenize(NULL," :"));
 			if(strncasecmp(token,"ATTR",4)==0)
 				p.index = atoi(token+4);
 			else
 				p.index = ConvertInputReg(token);
 		} else if(strstr(token,"texunit")) {
-			token = SkipSpaces(strtok(NULL," :"));
+			token = SkipSpaces(Tokenize(NULL," :"));
 			p.index = atoi(token);
 		} else if(token[0]=='c') {
 			p.is_const = 1;
 			p.index = atoi(token+2);
 
-			token = strtok(NULL," ,");
+			token = Tokenize(NULL," ,");
 			if(isdigit(*token)) p.count = atoi(token);
 		} else if(strstr(token,"$vout")) {
 		  p.is_output = 1;
 
-		  token = SkipSpaces(strtok(NULL," :"));
+		  token = SkipSpaces(Tokenize(NULL," :"));
 		  s32 idx = -1;
 
 		  if(strncasecmp(token,"ATTR",4)==0)
@@ -82,7 +83,7 @@ void CParser::ParseComment(const char *line)
 
 		m_lParameters.push_back(p);
 	} else if(strncasecmp(line,"const",5)==0) {
-		char  *token = SkipSpaces(strtok((char*)(line+5)," "));
+		char  *token = SkipSpaces(Tokenize((char*)(line+5)," "));
 
 		p.is_const = 1;
 		p.is_internal = 1;
@@ -97,7 +98,7 @@ void CParser::ParseComment(const char *line)
 
 			p.index = atoi(token+2);
 			for(i=0;i<4;i++) {
-				token = strtok(NULL," =");
+				token = Tokenize(NULL," =");
 				if(token)
 					pVal[i] = (f32)atof(token);
 				else
@@ -199,12 +199,12 @@ int CVPParser::Parse(const char *str)
 			}
 
 			if(valid) {
-				label = strtok(ptr,":\x20");
+				label = Tokenize(ptr,":\x20");
 				ptr = col_ptr + 1;
 			}
 		}
 
-		opcode = strtok(ptr," ");
+		opcode = Tokenize(ptr," ");
 
 		if(label) {
 			jmpdst d;
@@ -215,7 +215,7 @@ int CVPParser::Parse(const char *str)
 		}
 
 		if(opcode) {
-			char *param_str = SkipSpaces(strtok(NULL,"\0"));
+			char *param_str = SkipSpaces(Tokenize(NULL,"\0"));
 			if(strcasecmp(opcode,"OPTION")==0) {
 				if(strncasecmp(param_str,"NV_vertex_program3",18)==0)
 					m_nOption |= NV_OPTION_VP3;
@@ -288,7 +288,7 @@ int CVPParser::Parse(const char *str)
 void CVPParser::ParseInstruction(struct nvfx_insn *insn,opcode *opc,const char *param_str)
 {
 	u32 i;
-	char *token = SkipSpaces(strtok((char*)param_str,","));
+	char *token = SkipSpaces(Tokenize((char*)param_str,","));
 
 	if(opc->is_imm)
 		ParseMaskedDstAddr(token,insn);
@@ -296,17 +296,17 @@ void CVPParser::ParseInstruction(struct nvfx_insn *insn,opcode *opc,const char *
 		ParseMaskedDstReg(token,insn);
 
 	for(i=0;i<opc->nr_src;i++) {
-		token = SkipSpaces(strtok(NULL,","));
+		token = SkipSpaces(Tokenize(NULL,","));
 		ParseSwizzledSrcReg(token,&insn->src[opc->src_slots[i]]);
 	}
 
 	if(opc->opcode == OPCODE_TEX) {
 	  uint8_t unit = ~0, target = ~0;
 
-	  token = SkipSpaces(strtok(NULL,","));
+	  token = SkipSpaces(Tokenize(NULL,","));
 	  ParseTextureUnit(token,&unit);
 	  
-	  token = SkipSpaces(strtok(NULL,","));
+	  token = SkipSpaces(Tokenize(NULL,","));
 	  ParseTextureTarget(token,&target);
 
 	  insn->src[1] = nvfx_src(nvfx_reg(NVFXSR_VPTEXINPUT,unit));
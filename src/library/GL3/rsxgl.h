@@ -24,6 +24,11 @@ struct rsxgl_init_parameters_t {
   uint32_t max_swap_wait_iterations;
   useconds_t swap_wait_interval;
   uint32_t rsx_mspace_offset, rsx_mspace_size;
+  /* Number of segments that the command buffer is divided into; 1 leaves the command buffer to libgcm: */
+  uint32_t command_buffer_segments;
+  /* Kick the GPU once this many words have been added to the command buffer, or this many draw calls
+     made, since the last kick. 0 disables either: */
+  uint32_t kick_words, kick_draws;
 };
 
 /*! \brief Customize the resources that RSXGL allocates upon initialization. Call this, optionally, before
@@ -33,6 +38,106 @@ struct rsxgl_init_parameters_t {
 */
 void rsxglConfigure(struct rsxgl_init_parameters_t const * parameters);
 
+/* Counters kept by the command buffer manager: */
+struct rsxgl_fifo_statistics_t {
+  /* Times a command buffer segment filled up, and times the CPU then had to wait for the GPU: */
+  uint32_t reserve_callbacks, segment_waits;
+  /* Times the GPU was kicked, and how many of those were due to kick_words or kick_draws: */
+  uint32_t kicks, threshold_kicks;
+  /* Words that the GPU has been kicked with: */
+  uint64_t words_kicked;
+};
+
+/*! \brief Retrieve the command buffer manager's counters.
+
+  \param statistics Pointer to a structure that receives the counters.
+  \param reset If non-zero, the counters are set to 0 afterwards.
+*/
+void rsxglGetFifoStatistics(struct rsxgl_fifo_statistics_t * statistics,int reset);
+
+/* Counters kept by the current context's glUniform*() functions: */
+struct rsxgl_uniform_statistics_t {
+  /* Calls that changed a uniform's value, and calls that didn't (which upload nothing): */
+  uint32_t updates, redundant_updates;
+  /* Uniforms sent to the GPU by draw calls: */
+  uint32_t uploads;
+  /* Uniform blocks sent to the vertex program by calling a uniform buffer's pre-formatted upload: */
+  uint32_t block_calls;
+  /* Specialized fragment programs compiled (GL_RSX_program_specialization), and times draws
+     changed between a program's microcode images: */
+  uint32_t fp_variant_compiles, fp_variant_switches;
+};
+
+/*! \brief Retrieve the current context's uniform counters. Calling this once per frame, with
+  reset set, gives per-frame counts.
+
+  \param statistics Pointer to a structure that receives the counters.
+  \param reset If non-zero, the counters are set to 0 afterwards.
+*/
+void rsxglGetUniformStatistics(struct rsxgl_uniform_statistics_t * statistics,int reset);
+
+/* Counters kept by the queue of memory that's freed once the GPU is done with it (old buffer &
+   renderbuffer storage, texture levels that have been migrated, and replaced specialized
+   fragment programs): */
+struct rsxgl_deferred_free_statistics_t {
+  /* Allocations in the queue, and their total size in bytes: */
+  uint32_t pending, pending_bytes;
+  /* Most bytes that have been in the queue at once: */
+  uint32_t high_water_bytes;
+  /* Allocations freed from the queue, and times an allocation failed & the CPU waited for the GPU to free them: */
+  uint32_t freed, reclaim_waits;
+};
+
+/*! \brief Retrieve the current context's deferred free counters.
+
+  \param statistics Pointer to a structure that receives the counters.
+  \param reset If non-zero, the counters are set to 0 afterwards, and the high-water mark to the number of bytes still pending.
+*/
+void rsxglGetDeferredFreeStatistics(struct rsxgl_deferred_free_statistics_t * statistics,int reset);
+
+/* Subsystems whose FIFO words are counted separately, as they're validated by draw calls: */
+#define RSXGL_PERF_STATE 0
+#define RSXGL_PERF_PROGRAM 1
+#define RSXGL_PERF_UNIFORMS 2
+#define RSXGL_PERF_ATTRIBS 3
+#define RSXGL_PERF_TEXTURES 4
+#define RSXGL_PERF_FRAMEBUFFER 5
+#define RSXGL_PERF_SUBSYSTEMS 6
+
+/* Counters kept by the current context, if the library was configured with
+   --enable-perf-counters; otherwise they're always 0: */
+struct rsxgl_perf_counters_t {
+  uint32_t draws;
+  /* FIFO words emitted for each subsystem (indexed by RSXGL_PERF_STATE, etc.): */
+  uint32_t words[RSXGL_PERF_SUBSYSTEMS];
+  /* Times a command buffer segment filled up while this context was drawing: */
+  uint32_t reserve_callbacks;
+  /* Times the CPU waited for the GPU to reach a timestamp, and the microseconds spent doing so: */
+  uint32_t timestamp_waits;
+  uint64_t timestamp_wait_time;
+  /* Bytes written to the vertex migration & texture staging rings: */
+  uint64_t migrate_bytes;
+  /* Texture images uploaded in a format other than the one they're stored in: */
+  uint32_t texture_conversions;
+  /* State changes (glEnable(), glViewport(), glUseProgram(), etc.) that set what was already set: */
+  uint32_t redundant_state_calls;
+};
+
+/*! \brief Retrieve the current context's counters, as they've accumulated since the context was
+  created or last reset.
+
+  \param counters Pointer to a structure that receives the counters.
+  \param reset If non-zero, the counters are set to 0 afterwards.
+*/
+void rsxglGetPerfCounters(struct rsxgl_perf_counters_t * counters,int reset);
+
+/*! \brief Retrieve the counts made by the current context during the last frame, i.e., between
+  the last two calls to eglSwapBuffers().
+
+  \param counters Pointer to a structure that receives the counters.
+*/
+void rsxglGetFramePerfCounters(struct rsxgl_perf_counters_t * counters);
+
 #if 0
 /* The following functions are for compatibility with librsx - where librsx is
    used to do the setup that EGL usually performs.
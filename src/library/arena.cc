@@ -30,7 +30,7 @@ memory_arena_t::storage_type & memory_arena_t::storage()
 memory_t
 rsxgl_arena_allocate(memory_arena_t & arena,rsx_size_t align,rsx_size_t size,void * * address)
 {
-  void * addr = mspace_memalign(arena.space,align,size);
+  void * addr = rsxgl_heap_memalign(arena.heap,align,size);
 
   if(addr == 0) {
     return memory_t();
@@ -44,7 +44,7 @@ rsxgl_arena_allocate(memory_arena_t & arena,rsx_size_t align,rsx_size_t size,voi
 void
 rsxgl_arena_free(struct memory_arena_t & arena,const struct memory_t & memory)
 {
-  mspace_free(arena.space,rsxgl_arena_address(arena,memory));
+  rsxgl_heap_free(arena.heap,rsxgl_arena_address(arena,memory));
 }
 
 static inline size_t
@@ -64,6 +64,8 @@ rsxgl_memory_location(GLenum location)
 GLAPI GLuint APIENTRY
 glCreateMemoryArenaRSX(GLenum location,GLsizei align,GLsizei size)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_location = rsxgl_memory_location(location);
   if(rsx_location == ~0U) RSXGL_ERROR(GL_INVALID_ENUM,0);
 
@@ -91,7 +93,7 @@ glCreateMemoryArenaRSX(GLenum location,GLsizei align,GLsizei size)
   arena.memory.location = rsx_location;
   arena.memory.offset = offset;
   arena.size = size;
-  arena.space = create_mspace_with_base(arena.address,arena.size,0);
+  arena.heap = rsxgl_heap_create(arena.address,arena.size);
 
   RSXGL_NOERROR(name);
 }
@@ -99,7 +101,7 @@ glCreateMemoryArenaRSX(GLenum location,GLsizei align,GLsizei size)
 void
 memory_arena_t::destroy()
 {
-  destroy_mspace(space);
+  rsxgl_heap_destroy(heap);
 
   if(memory.location == RSXGL_MEMORY_LOCATION_LOCAL) {
     rsxgl_rsx_free(address);
@@ -112,10 +114,15 @@ memory_arena_t::destroy()
 GLAPI void APIENTRY
 glDeleteMemoryArenaRSX(GLuint name)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!memory_arena_t::storage().is_object(name)) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
+  // Memory that's waiting to be freed goes away with the arena:
+  rsxgl_deferred_free_forget_arena(current_ctx(),name);
+
   memory_arena_t::storage().destroy(name);
 
   RSXGL_NOERROR_();
@@ -141,6 +148,8 @@ rsxgl_arena_target(GLenum target)
 GLAPI void APIENTRY
 glUseMemoryArenaRSX(GLenum target,GLuint name)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   uint32_t rsx_target = rsxgl_arena_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -157,6 +166,8 @@ glUseMemoryArenaRSX(GLenum target,GLuint name)
 GLAPI void APIENTRY
 glGetMemoryArenaParameterivRSX(GLenum target,GLenum pname,GLint * params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_target = rsxgl_arena_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -180,6 +191,18 @@ glGetMemoryArenaParameterivRSX(GLenum target,GLenum pname,GLint * params)
       RSXGL_ERROR_(GL_INVALID_ENUM);
     }
   }
+  else if(pname == GL_ARENA_FREE_RSX || pname == GL_ARENA_LARGEST_FREE_BLOCK_RSX || pname == GL_ARENA_FREE_BLOCKS_RSX || pname == GL_ARENA_ALLOCATIONS_RSX) {
+    // Fragmentation of the arena may be gauged by comparing the largest free block with the
+    // total free:
+    struct rsxgl_heap_statistics_t statistics;
+    rsxgl_heap_get_statistics(arena.heap,&statistics);
+
+    *params =
+      (pname == GL_ARENA_FREE_RSX) ? statistics.free :
+      (pname == GL_ARENA_LARGEST_FREE_BLOCK_RSX) ? statistics.largest_free :
+      (pname == GL_ARENA_FREE_BLOCKS_RSX) ? statistics.free_blocks :
+      statistics.allocations;
+  }
   else {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
@@ -190,6 +213,8 @@ glGetMemoryArenaParameterivRSX(GLenum target,GLenum pname,GLint * params)
 GLAPI void APIENTRY
 glGetMemoryArenaPointervRSX(GLenum target,GLenum pname,GLvoid ** params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_target = rsxgl_arena_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -78,12 +78,12 @@ struct memory_arena_t {
   binding_bitfield_type binding_bitfield;
 
   void * address;
-  mspace space;
+  struct rsxgl_heap_t * heap;
   memory_t memory;
   rsx_size_t size;
 
   memory_arena_t()
-    : address(0), space(0), size(0) {
+    : address(0), heap(0), size(0) {
   }
 
   void destroy();
@@ -10,6 +10,7 @@
 #include "arena.h"
 #include "buffer.h"
 #include "attribs.h"
+#include "perf_counters.h"
 
 #include <GL3/gl3.h>
 #include "error.h"
@@ -108,7 +109,7 @@ attribs_t::~attribs_t()
 GLAPI void APIENTRY
 glBindVertexArray (GLuint attribs_name)
 {
-  if(!(attribs_name == 0 || attribs_t::storage().is_name(attribs_name))) {
+  if(RSXGL_CHECK_ERRORS() && !(attribs_name == 0 || attribs_t::storage().is_name(attribs_name))) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -118,6 +119,8 @@ glBindVertexArray (GLuint attribs_name)
     attribs_t::storage().create_object(attribs_name);
   }
 
+  RSXGL_PERF_REDUNDANT(ctx,ctx -> attribs_binding.names[0] == attribs_name);
+
   ctx -> attribs_binding.bind(0,attribs_name);
   ctx -> invalid_attribs.set();
   
@@ -127,6 +130,8 @@ glBindVertexArray (GLuint attribs_name)
 GLAPI void APIENTRY
 glDeleteVertexArrays (GLsizei n, const GLuint *arrays)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   struct rsxgl_context_t * ctx = current_ctx();
 
   for(GLsizei i = 0;i < n;++i,++arrays) {
@@ -788,6 +793,8 @@ rsxgl_vertex_attrib_pointer(rsxgl_context_t * ctx,uint32_t rsx_type,GLuint index
 GLAPI void APIENTRY
 glVertexAttribPointer (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   uint32_t rsx_type = rsxgl_vertex_buffer_type(type,normalized);
   if(rsx_type == 0) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -799,6 +806,8 @@ glVertexAttribPointer (GLuint index, GLint size, GLenum type, GLboolean normaliz
 GLAPI void APIENTRY
 glVertexAttribIPointer (GLuint index, GLint size, GLenum type, GLsizei stride, const GLvoid *pointer)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   uint32_t rsx_type = rsxgl_vertex_buffer_type(type,GL_FALSE);
   if(rsx_type == 0 || !(rsx_type == RSXGL_VERTEX_U8_NR || rsx_type == RSXGL_VERTEX_S16_NR)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -1004,3 +1013,41 @@ rsxgl_attribs_validate(rsxgl_context_t * ctx,program_t & program,const uint32_t
   ctx -> invalid_attribs &= ~program_attribs;
 #endif
 }
+
+void
+rsxgl_attribs_rebase(rsxgl_context_t * ctx,program_t & program,const uint32_t first)
+{
+  gcmContextData * context = ctx -> base.gcm_context;
+
+  const program_t::attribs_bitfield_type
+    attribs_enabled = program.attribs_enabled;
+  const program_t::attrib_assignments_type
+    attrib_assignments = program.attrib_assignments;
+
+  program_t::attribs_bitfield_type::const_iterator
+    enabled_it = attribs_enabled.begin();
+  program_t::attrib_assignments_type::const_iterator
+    assignment_it = attrib_assignments.begin();
+
+  attribs_t & attribs = ctx -> attribs_binding[0];
+  const bit_set< RSXGL_MAX_VERTEX_ATTRIBS > enabled_attrib_pointers = attribs.enabled;
+
+  for(program_t::attrib_size_type index = 0;index < RSXGL_MAX_VERTEX_ATTRIBS;++index,enabled_it.next(attribs_enabled),assignment_it.next(attrib_assignments)) {
+    if(!enabled_it.test()) continue;
+
+    const program_t::attrib_size_type api_index = assignment_it.value();
+
+    if(!enabled_attrib_pointers.test(api_index) || attribs.buffers.names[api_index] == 0 || !attribs.buffers[api_index].memory) continue;
+
+    const memory_t memory = attribs.buffers[api_index].memory + attribs.offset[api_index] + (first * attribs.stride[api_index]);
+
+    uint32_t * buffer = gcm_reserve(context,2);
+
+    gcm_emit_method_at(buffer,0,NV30_3D_VTXBUF(index),1);
+    gcm_emit_at(buffer,1,memory.offset | ((uint32_t)memory.location << 31));
+
+    gcm_finish_n_commands(context,2);
+
+    ctx -> invalid_attribs.set(api_index);
+  }
+}
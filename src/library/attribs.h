@@ -74,4 +74,9 @@ struct rsxgl_context_t;
 
 void rsxgl_attribs_validate(rsxgl_context_t *,program_t &,const uint32_t,const uint32_t,const uint32_t);
 
+// Point the program's buffer-backed attribs at the given element of their arrays, so that vertex
+// 0 fetches it. Called after rsxgl_attribs_validate(); the attribs are marked invalid, so that
+// the next draw points them back:
+void rsxgl_attribs_rebase(rsxgl_context_t *,program_t &,const uint32_t);
+
 #endif
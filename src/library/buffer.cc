@@ -10,6 +10,7 @@
 #include "buffer.h"
 #include "timestamp.h"
 #include "attribs.h"
+#include "uniform_buffer.h"
 
 #include <GL3/gl3.h>
 #include "error.h"
@@ -35,11 +36,15 @@ buffer_t::~buffer_t()
   if(memory.offset != 0) {
     rsxgl_arena_free(memory_arena_t::storage().at(arena),memory);
   }
+
+  delete uniforms;
 }
 
 GLAPI void APIENTRY
 glGenBuffers (GLsizei n, GLuint* buffers)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   GLsizei count = buffer_t::storage().create_names(n,buffers);
 
   if(count != n) {
@@ -52,12 +57,16 @@ glGenBuffers (GLsizei n, GLuint* buffers)
 GLAPI GLboolean APIENTRY
 glIsBuffer (GLuint buffer)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   return buffer_t::storage().is_object(buffer);
 }
 
 GLAPI void APIENTRY
 glDeleteBuffers (GLsizei n, const GLuint* buffers)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   struct rsxgl_context_t * ctx = current_ctx();
 
   for(GLsizei i = 0;i < n;++i,++buffers) {
@@ -76,6 +85,9 @@ glDeleteBuffers (GLsizei n, const GLuint* buffers)
 	buffer.timestamp = 0;
       }
 
+      // Draws call the uniform streams without stamping the buffer itself:
+      rsxgl_uniform_buffer_release(ctx,buffer);
+
       // 
       buffer_t::gl_object_type::maybe_delete(buffer_name);
     }
@@ -171,12 +183,14 @@ rsxgl_buffer_valid_range(const struct buffer_t & buffer,uint32_t offset,uint32_t
 GLAPI void APIENTRY
 glBindBuffer (GLenum target, GLuint buffer_name)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_target = rsxgl_buffer_target(target);
-  if(rsx_target == ~0U) {
+  if(RSXGL_CHECK_ERRORS() && rsx_target == ~0U) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  if(!(buffer_name == 0 || buffer_t::storage().is_name(buffer_name))) {
+  if(RSXGL_CHECK_ERRORS() && !(buffer_name == 0 || buffer_t::storage().is_name(buffer_name))) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -240,18 +254,50 @@ rsxgl_bind_buffer_range(GLenum target, GLuint index, GLuint buffer_name, rsx_siz
 GLAPI void APIENTRY
 glBindBufferRange (GLenum target, GLuint index, GLuint buffer_name, GLintptr offset, GLsizeiptr size)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   rsxgl_bind_buffer_range(target,index,buffer_name,offset,size);
 }
 
 GLAPI void APIENTRY
 glBindBufferBase (GLenum target, GLuint index, GLuint buffer_name)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   rsxgl_bind_buffer_range(target,index,buffer_name,0,~0);
 }
 
+// Free a buffer's storage once pending GPU operations are done with it:
+static inline void
+rsxgl_buffer_free_storage(rsxgl_context_t * ctx,buffer_t & buffer)
+{
+  if(buffer.memory.offset != 0) {
+    rsxgl_deferred_free_arena(ctx,buffer.timestamp,buffer.arena,buffer.memory,buffer.size);
+    buffer.memory = memory_t();
+    buffer.size = 0;
+  }
+  buffer.timestamp = 0;
+}
+
+// A buffer is referenced while the object context is unlocked, in case another thread deletes it
+// meanwhile. Returns false if one did, and the buffer is gone:
+static inline bool
+rsxgl_buffer_unref(const buffer_t::name_type name)
+{
+  const buffer_t & buffer = buffer_t::storage().at(name);
+  const bool destroyed = buffer.deleted && buffer.ref_count == 1;
+
+  buffer_t::gl_object_type::unref_and_maybe_delete(name);
+
+  return !destroyed;
+}
+
 GLAPI void APIENTRY
 glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
   if(size < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
@@ -261,8 +307,6 @@ glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-
   if(ctx -> buffer_binding.names[rsx_target] == 0) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
@@ -276,11 +320,52 @@ glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  buffer_t * buffer = &ctx -> buffer_binding[rsx_target];
+  const buffer_t::name_type name = ctx -> buffer_binding.names[rsx_target];
+  const memory_arena_t::name_type arena = ctx -> arena_binding.names[RSXGL_BUFFER_ARENA];
+
+  // Allocate new storage for the data, and copy it there without the lock - no other object can
+  // get at the storage yet:
+  memory_t memory;
+  void * address = 0;
+
+  if(size > 0) {
+    memory = rsxgl_arena_allocate(memory_arena_t::storage().at(arena),128,size,&address);
+    if(!memory) {
+      // The old storage is going to be freed anyway, so let go of it before trying again:
+      rsxgl_buffer_free_storage(ctx,buffer_t::storage().at(name));
+      memory = rsxgl_arena_allocate(memory_arena_t::storage().at(arena),128,size,&address);
+      if(!memory && rsxgl_deferred_free_reclaim(ctx)) {
+	memory = rsxgl_arena_allocate(memory_arena_t::storage().at(arena),128,size,&address);
+      }
+    }
+
+    if(!memory) RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+  }
+
+  if(address != 0 && data != 0) {
+    buffer_t::gl_object_type::ref(name);
+    lock.unlock();
+
+    memcpy(address,data,size);
+
+    lock.relock(ctx);
+    if(!rsxgl_buffer_unref(name)) {
+      rsxgl_arena_free(memory_arena_t::storage().at(arena),memory);
+      RSXGL_NOERROR_();
+    }
+
+    // Another thread mapped it in the meantime:
+    if(buffer_t::storage().at(name).mapped != 0) {
+      rsxgl_arena_free(memory_arena_t::storage().at(arena),memory);
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+  }
+
+  buffer_t * buffer = &buffer_t::storage().at(name);
 
 #if 0
   // If a pending GPU operation uses this buffer, then orphan it:
-  if((buffer -> timestamp != 0) && (!rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,buffer -> timestamp))) {
+  if((buffer -> timestamp != 0) && (!rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,ctx -> next_timestamp,buffer -> timestamp))) {
     buffer_t::storage().orphan(ctx -> buffer_binding.names[rsx_target]);
 
     buffer -> timestamp = 0;
@@ -294,37 +379,18 @@ glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
     buffer -> mapped_size = 0;
   }
 #else
-  if(buffer -> timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,buffer -> timestamp);
-    buffer -> timestamp = 0;
-  }
-
-  // Free the old buffer:
-  if(buffer -> memory.offset != 0) {
-    rsxgl_arena_free(memory_arena_t::storage().at(buffer -> arena),buffer -> memory);
-    buffer -> memory = memory_t();
-  }
+  rsxgl_buffer_free_storage(ctx,*buffer);
 #endif
 
-  // If a buffer is actually being requested, then allocate memory for it:
-  void * address = 0;
-  
   if(size > 0) {
     buffer -> invalid = 1;
     buffer -> usage = rsx_usage;
-    buffer -> arena = ctx -> arena_binding.names[RSXGL_BUFFER_ARENA];
-    buffer -> memory = rsxgl_arena_allocate(memory_arena_t::storage().at(buffer -> arena),128,size,&address);
-    
-    if(!buffer -> memory) RSXGL_ERROR_(GL_OUT_OF_MEMORY);
-    
+    buffer -> arena = arena;
+    buffer -> memory = memory;
     buffer -> size = size;
   }
 
-  if(address != 0 && data != 0 && buffer -> size > 0) {
-    memcpy(address,data,buffer -> size);
-  }
-
-  const buffer_t::name_type name = ctx -> buffer_binding.names[rsx_target];
+  rsxgl_uniform_buffer_data(*buffer,0,buffer -> size,data);
 
   // See if the buffer is attached to the current vertex array object; if so, invalidate:
   attribs_t & attribs = ctx -> attribs_binding[0];
@@ -337,44 +403,88 @@ glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
   RSXGL_NOERROR_();
 }
 
+// Error raised by glBufferSubData(); checked again if the buffer was unlocked before the copy:
+static inline GLenum
+rsxgl_buffer_subdata_error(const buffer_t & buffer,GLintptr offset,GLsizeiptr size)
+{
+  if(buffer.mapped != 0) {
+    return GL_INVALID_OPERATION;
+  }
+
+  if(offset < 0 || size < 0) {
+    return GL_INVALID_VALUE;
+  }
+  if(!rsxgl_buffer_valid_range(buffer,offset,size)) {
+    return GL_INVALID_VALUE;
+  }
+
+  return GL_NO_ERROR;
+}
+
 GLAPI void APIENTRY
 glBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
   const size_t rsx_target = rsxgl_buffer_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-
   if(ctx -> buffer_binding.names[rsx_target] == 0) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
-  buffer_t & buffer = ctx -> buffer_binding[rsx_target];
-  
-  if(buffer.mapped != 0) {
-    RSXGL_ERROR_(GL_INVALID_OPERATION);
-  }
 
-  if(offset < 0 || size < 0) {
-    RSXGL_ERROR_(GL_INVALID_VALUE);
+  const buffer_t::name_type name = ctx -> buffer_binding.names[rsx_target];
+
+  GLenum error = rsxgl_buffer_subdata_error(buffer_t::storage().at(name),offset,size);
+  if(error != GL_NO_ERROR) {
+    RSXGL_ERROR_(error);
   }
-  if(!rsxgl_buffer_valid_range(buffer,offset,size)) {
-    RSXGL_ERROR_(GL_INVALID_VALUE);
+
+  if(data == 0 || size == 0) {
+    RSXGL_NOERROR_();
   }
 
-  void * address = rsxgl_arena_address(memory_arena_t::storage().at(buffer.arena),buffer.memory);
+  // Neither the wait for the GPU nor the copy need the lock:
+  buffer_t::gl_object_type::ref(name);
 
-  if(address != 0 && data != 0 && size > 0) {
-    // TODO - if a pending operation depends upon this buffer, wait for that operation to finish:
-    // TODO - replace this with something smarter that doesn't conservatively decide to block on the GPU:
-    if(buffer.timestamp > 0) {
-      rsxgl_timestamp_wait(ctx,buffer.timestamp);
+  // TODO - replace this with something smarter that doesn't conservatively decide to block on the GPU:
+  const uint32_t timestamp = buffer_t::storage().at(name).timestamp;
+  if(timestamp > 0) {
+    rsxgl_timestamp_wait(ctx,lock,timestamp);
+
+    buffer_t & buffer = buffer_t::storage().at(name);
+    if(buffer.timestamp == timestamp) {
       buffer.timestamp = 0;
     }
-    
-    // Copy the data:
+
+    // Another thread may have mapped or respecified it in the meantime:
+    error = rsxgl_buffer_subdata_error(buffer,offset,size);
+  }
+
+  void * address = (error == GL_NO_ERROR) ?
+    rsxgl_arena_address(memory_arena_t::storage().at(buffer_t::storage().at(name).arena),buffer_t::storage().at(name).memory) :
+    0;
+
+  if(address != 0) {
+    // The buffer's storage isn't freed during the copy, even if it's respecified:
+    rsxgl_deferred_free_hold(ctx);
+    lock.unlock();
+
     memcpy((uint8_t *)address + offset,data,size);
+
+    lock.relock(ctx);
+    rsxgl_deferred_free_unhold(ctx);
+
+    rsxgl_uniform_buffer_data(buffer_t::storage().at(name),offset,size,data);
+  }
+
+  rsxgl_buffer_unref(name);
+
+  if(error != GL_NO_ERROR) {
+    RSXGL_ERROR_(error);
   }
 
   RSXGL_NOERROR_();
@@ -383,6 +493,8 @@ glBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid*
 GLAPI void APIENTRY
 glGetBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, GLvoid *data)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_target = rsxgl_buffer_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -458,6 +570,8 @@ rsxgl_map_buffer_range(rsxgl_context_t * ctx,const buffer_t::name_type buffer_na
 GLAPI void* APIENTRY
 glMapBuffer (GLenum target, GLenum access)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_target = rsxgl_buffer_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR(GL_INVALID_ENUM,0);
@@ -475,6 +589,8 @@ glMapBuffer (GLenum target, GLenum access)
 GLAPI GLvoid* APIENTRY
 glMapBufferRange (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_target = rsxgl_buffer_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR(GL_INVALID_ENUM,0);
@@ -492,6 +608,8 @@ glMapBufferRange (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield
 GLAPI void APIENTRY
 glFlushMappedBufferRange (GLenum target, GLintptr offset, GLsizeiptr length)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_target = rsxgl_buffer_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -523,6 +641,8 @@ glFlushMappedBufferRange (GLenum target, GLintptr offset, GLsizeiptr length)
 GLAPI GLboolean APIENTRY
 glUnmapBuffer (GLenum target)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_target = rsxgl_buffer_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR(GL_INVALID_ENUM,GL_FALSE);
@@ -539,6 +659,10 @@ glUnmapBuffer (GLenum target)
     RSXGL_ERROR(GL_INVALID_OPERATION,GL_FALSE);
   }
 
+  if(buffer.mapped & RSXGL_WRITE_ONLY) {
+    rsxgl_uniform_buffer_invalidate(buffer);
+  }
+
   buffer.mapped = 0;
   buffer.mapped_offset = 0;
   buffer.mapped_size = 0;
@@ -549,6 +673,8 @@ glUnmapBuffer (GLenum target)
 GLAPI void APIENTRY
 glGetBufferParameteriv (GLenum target, GLenum pname, GLint *params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_target = rsxgl_buffer_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -629,6 +755,8 @@ glGetBufferParameteriv (GLenum target, GLenum pname, GLint *params)
 GLAPI void APIENTRY
 glGetBufferPointerv (GLenum target, GLenum pname, GLvoid** params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const size_t rsx_target = rsxgl_buffer_target(target);
   if(rsx_target == ~0U) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -659,6 +787,8 @@ glGetBufferPointerv (GLenum target, GLenum pname, GLvoid** params)
 GLAPI void APIENTRY
 glCopyBufferSubData (GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(readOffset < 0 || writeOffset < 0 || size < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
@@ -689,6 +819,21 @@ glCopyBufferSubData (GLenum readTarget, GLenum writeTarget, GLintptr readOffset,
      (writeOffset + size) > write_buffer.size) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
+
+  // A context that can't send commands to the GPU copies with the CPU, once the GPU is done with
+  // both buffers:
+  if(!ctx -> can_emit()) {
+    if(read_buffer.timestamp != 0) rsxgl_timestamp_wait(ctx,read_buffer.timestamp);
+    if(write_buffer.timestamp != 0) rsxgl_timestamp_wait(ctx,write_buffer.timestamp);
+
+    const uint8_t * src = (const uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(read_buffer.arena),srcmem);
+    uint8_t * dst = (uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(write_buffer.arena),dstmem);
+    memmove(dst + writeOffset,src + readOffset,size);
+
+    rsxgl_uniform_buffer_invalidate(write_buffer);
+
+    RSXGL_NOERROR_();
+  }
   
   const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
 
@@ -714,19 +859,18 @@ glCopyBufferSubData (GLenum readTarget, GLenum writeTarget, GLintptr readOffset,
 
   rsxgl_timestamp_post(ctx,timestamp);
 
-  rsxgl_assert(timestamp >= ctx -> buffer_binding[iread].timestamp);
-  rsxgl_assert(timestamp >= ctx -> buffer_binding[iwrite].timestamp);
 
   ctx -> buffer_binding[iread].timestamp = timestamp;
   ctx -> buffer_binding[iwrite].timestamp = timestamp;
 
+  rsxgl_uniform_buffer_invalidate(write_buffer);
+
   RSXGL_NOERROR_();
 }
 
 void
 rsxgl_buffer_validate(rsxgl_context_t *,buffer_t & buffer,const uint32_t start,const uint32_t length,const uint32_t timestamp)
 {
-  rsxgl_assert(timestamp >= buffer.timestamp);
   buffer.timestamp = timestamp;
 
   if(buffer.invalid) {
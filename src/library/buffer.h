@@ -52,6 +52,8 @@ enum rsxgl_buffer_usage {
   RSXGL_DYNAMIC_COPY = 8
 };
 
+struct uniform_buffer_t;
+
 struct buffer_t {
   typedef bindable_gl_object< buffer_t, RSXGL_MAX_BUFFERS, RSXGL_MAX_BUFFER_TARGETS > gl_object_type;
   typedef typename gl_object_type::name_type name_type;
@@ -74,8 +76,11 @@ struct buffer_t {
 
   rsx_size_t mapped_offset, mapped_size;
 
+  // Set once the buffer has been read by a uniform block; see uniform_buffer.h:
+  uniform_buffer_t * uniforms;
+
   buffer_t()
-    : deleted(0), timestamp(0), ref_count(0), invalid(0), usage(0), mapped(0), arena(0), size(0), mapped_offset(0), mapped_size(0) {
+    : deleted(0), timestamp(0), ref_count(0), invalid(0), usage(0), mapped(0), arena(0), size(0), mapped_offset(0), mapped_size(0), uniforms(0) {
   }
 
   ~buffer_t();
@@ -92,11 +92,17 @@ glClearStencil (GLint s)
 GLAPI void APIENTRY
 glClear(GLbitfield mask)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(mask & ~(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT)) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
   struct rsxgl_context_t * ctx = current_ctx();
+
+  if(!ctx -> can_emit()) {
+    RSXGL_ERROR_(GL_INVALID_FRAMEBUFFER_OPERATION);
+  }
   
   const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
   rsxgl_draw_framebuffer_validate(ctx,timestamp);
@@ -0,0 +1,442 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// command_list.cc - Pre-recorded command lists (GL_RSX_command_list).
+
+#include "rsxgl_context.h"
+#include "command_list.h"
+#include "timestamp.h"
+
+#include "rsxgl_config.h"
+#include "debug.h"
+#include "rsxgl_assert.h"
+#include "rsxgl_limits.h"
+#include "mem.h"
+
+#include <GL3/gl3.h>
+#include "GL3/rsxgl3ext.h"
+#include "error.h"
+
+#include <rsx/gcm_sys.h>
+
+#include <malloc.h>
+#include <algorithm>
+
+#if defined(GLAPI)
+#undef GLAPI
+#endif
+#define GLAPI extern "C"
+
+// Memory that command lists are recorded into. It's mapped into the RSX's address space, so that
+// it can be the target of FIFO "call" & "jump" commands:
+static uint32_t rsxgl_command_list_buffer_size = RSXGL_CONFIG_command_list_buffer_size, rsxgl_command_list_buffer_align = RSXGL_COMMAND_LIST_BUFFER_ALIGN;
+
+static void * _rsxgl_command_list_buffer = 0;
+static struct rsxgl_heap_t * rsxgl_command_list_buffer_heap = 0;
+
+static inline
+void * rsxgl_command_list_buffer()
+{
+  if(_rsxgl_command_list_buffer == 0) {
+    _rsxgl_command_list_buffer = memalign(rsxgl_command_list_buffer_align,rsxgl_command_list_buffer_size);
+    if(_rsxgl_command_list_buffer == 0) {
+      __rsxgl_assert_func(__FILE__,__LINE__,__PRETTY_FUNCTION__,"failed to allocate command list buffer in main memory");
+    }
+
+    uint32_t offset = 0;
+    int32_t s = gcmMapMainMemory(_rsxgl_command_list_buffer,rsxgl_command_list_buffer_size,&offset);
+    if(s != 0) {
+      __rsxgl_assert_func(__FILE__,__LINE__,__PRETTY_FUNCTION__,"failed to map command list buffer into RSX memory");
+    }
+
+    rsxgl_command_list_buffer_heap = rsxgl_heap_create(_rsxgl_command_list_buffer,rsxgl_command_list_buffer_size);
+  }
+
+  return _rsxgl_command_list_buffer;
+}
+
+uint32_t *
+rsxgl_command_buffer_allocate(const uint32_t nwords)
+{
+  rsxgl_command_list_buffer();
+  return (uint32_t *)rsxgl_heap_memalign(rsxgl_command_list_buffer_heap,RSXGL_CACHE_LINE_SIZE,nwords * sizeof(uint32_t));
+}
+
+void
+rsxgl_command_buffer_free(uint32_t * address)
+{
+  rsxgl_heap_free(rsxgl_command_list_buffer_heap,address);
+}
+
+// Allocate a segment that can hold at least length words, plus the "jump" or "return" command
+// that ends it. The segment is added to the command list, and the recording context is pointed at it:
+static bool
+rsxgl_command_list_segment_new(rsxgl_command_list_recorder_t * recorder,command_list_t & command_list,const uint32_t length)
+{
+  const uint32_t nwords = std::max((uint32_t)(RSXGL_COMMAND_LIST_SEGMENT_SIZE / sizeof(uint32_t)),length + 1);
+
+  rsxgl_command_list_buffer();
+  uint32_t * segment = (uint32_t *)rsxgl_heap_memalign(rsxgl_command_list_buffer_heap,RSXGL_CACHE_LINE_SIZE,nwords * sizeof(uint32_t));
+  if(segment == 0) {
+    return false;
+  }
+
+  command_list.segments.push_back(segment);
+
+  recorder -> context.begin = segment;
+  recorder -> context.current = segment;
+  recorder -> context.end = segment + nwords - 1;
+
+  return true;
+}
+
+static void
+rsxgl_command_list_segments_free(command_list_t & command_list)
+{
+  for(void * segment : command_list.segments) {
+    rsxgl_heap_free(rsxgl_command_list_buffer_heap,segment);
+  }
+  command_list.segments.clear();
+  command_list.offset = 0;
+}
+
+extern "C" int32_t
+rsxgl_command_list_reserve_callback(gcmContextData * context,uint32_t length)
+{
+  rsxgl_command_list_recorder_t * recorder = (rsxgl_command_list_recorder_t *)context;
+  rsxgl_assert(&recorder -> context == context);
+
+  command_list_t & command_list = command_list_t::storage().at(recorder -> name);
+
+  uint32_t * jump = context -> current;
+
+  if(!recorder -> out_of_memory && rsxgl_command_list_segment_new(recorder,command_list,length)) {
+    // Chain the new segment onto the previous one. The segment's last word was kept free for this:
+    uint32_t offset = 0;
+    int32_t s = gcmAddressToOffset(context -> begin,&offset);
+    rsxgl_assert(s == 0);
+
+    gcm_emit_at(jump,0,gcm_jump_cmd(offset));
+  }
+  else {
+    // Out of memory - keep recording into host memory, the contents of which will be thrown away
+    // by glEndCommandListRSX(). The segments recorded so far are useless now, so give them back:
+    if(!recorder -> out_of_memory) {
+      recorder -> out_of_memory = 1;
+      rsxgl_command_list_segments_free(command_list);
+    }
+
+    if(recorder -> discard.size() < (length + 1)) {
+      recorder -> discard.resize(std::max((size_t)(RSXGL_COMMAND_LIST_SEGMENT_SIZE / sizeof(uint32_t)),(size_t)length + 1));
+    }
+
+    uint32_t * segment = recorder -> discard.data();
+    context -> begin = segment;
+    context -> current = segment;
+    context -> end = segment + recorder -> discard.size() - 1;
+  }
+
+  return 0;
+}
+
+//
+command_list_t::storage_type & command_list_t::storage()
+{
+  return current_object_ctx() -> command_list_storage();
+}
+
+command_list_t::~command_list_t()
+{
+}
+
+// The commands in a list leave the GPU in whatever state the list was recorded with, which
+// need not match what the context thinks it has told the GPU:
+static inline void
+rsxgl_command_list_invalidate_state(rsxgl_context_t * ctx)
+{
+  ctx -> state.invalid.all = ~0;
+  ctx -> invalid.all = ~0;
+
+  ctx -> invalid_attribs.set();
+  ctx -> invalid_textures.set();
+  ctx -> invalid_samplers.set();
+  ctx -> texture_unit_registers_valid.reset();
+  ctx -> invalid_attrib_assignments.set();
+  ctx -> invalid_texture_assignments.set();
+}
+
+// Drop the command list's commands & object references:
+static void
+rsxgl_command_list_clear(rsxgl_context_t * ctx,command_list_t & command_list)
+{
+  if(command_list.timestamp > 0) {
+    rsxgl_timestamp_wait(ctx,command_list.timestamp);
+    command_list.timestamp = 0;
+  }
+
+  rsxgl_command_list_segments_free(command_list);
+
+  for(buffer_t::name_type name : command_list.buffers) {
+    buffer_t::gl_object_type::unref_and_maybe_delete(name);
+  }
+  command_list.buffers.clear();
+
+  for(texture_t::name_type name : command_list.textures) {
+    texture_t::gl_object_type::unref_and_maybe_delete(name);
+  }
+  command_list.textures.clear();
+}
+
+template< typename Object >
+static inline void
+rsxgl_command_list_capture(std::vector< typename Object::name_type > & names,const typename Object::name_type name)
+{
+  if(name != 0 && std::find(names.begin(),names.end(),name) == names.end()) {
+    Object::gl_object_type::ref(name);
+    names.push_back(name);
+  }
+}
+
+void
+rsxgl_command_list_capture_draw(rsxgl_context_t * ctx,program_t & program,const uint32_t timestamp)
+{
+  rsxgl_assert(ctx -> command_list_recorder != 0);
+
+  command_list_t & command_list = command_list_t::storage().at(ctx -> command_list_recorder -> name);
+
+  // Vertex buffers:
+  {
+    attribs_t & attribs = ctx -> attribs_binding[0];
+
+    const program_t::attribs_bitfield_type attribs_enabled = program.attribs_enabled;
+    const program_t::attrib_assignments_type attrib_assignments = program.attrib_assignments;
+
+    program_t::attribs_bitfield_type::const_iterator enabled_it = attribs_enabled.begin();
+    program_t::attrib_assignments_type::const_iterator assignment_it = attrib_assignments.begin();
+
+    for(program_t::attrib_size_type index = 0;index < RSXGL_MAX_VERTEX_ATTRIBS;++index,enabled_it.next(attribs_enabled),assignment_it.next(attrib_assignments)) {
+      if(!enabled_it.test()) continue;
+
+      const program_t::attrib_size_type api_index = assignment_it.value();
+      if(attribs.enabled.test(api_index)) {
+	rsxgl_command_list_capture< buffer_t >(command_list.buffers,attribs.buffers.names[api_index]);
+      }
+    }
+  }
+
+  // Index buffer:
+  rsxgl_command_list_capture< buffer_t >(command_list.buffers,ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER]);
+
+  // Textures. Any that need to be migrated are migrated now, with the list detached: what's
+  // recorded only executes when the list is replayed, long after the levels that a migration
+  // copies from have been freed, and every replay would repeat it:
+  {
+    rsxgl_command_list_recorder_t * recorder = ctx -> command_list_recorder;
+    ctx -> base.gcm_context = recorder -> fifo;
+
+    const program_t::textures_bitfield_type textures_enabled = program.textures_enabled;
+    const program_t::texture_assignments_type texture_assignments = program.texture_assignments;
+
+    program_t::textures_bitfield_type::const_iterator enabled_it = textures_enabled.begin();
+    program_t::texture_assignments_type::const_iterator assignment_it = texture_assignments.begin();
+
+    for(program_t::texture_size_type index = 0;index < RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;++index,enabled_it.next(textures_enabled),assignment_it.next(texture_assignments)) {
+      if(!enabled_it.test()) continue;
+
+      const texture_t::name_type name = ctx -> texture_binding.names[assignment_it.value()];
+      if(name == 0) continue;
+
+      rsxgl_command_list_capture< texture_t >(command_list.textures,name);
+      rsxgl_texture_validate(ctx,texture_t::storage().at(name),timestamp);
+    }
+
+    ctx -> base.gcm_context = &recorder -> context;
+  }
+}
+
+GLAPI void APIENTRY
+glGenCommandListsRSX (GLsizei n, GLuint *lists)
+{
+  if(n < 0) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  GLsizei count = command_list_t::storage().create_names(n,lists);
+
+  if(count != n) {
+    RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+  }
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glDeleteCommandListsRSX (GLsizei n, const GLuint *lists)
+{
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
+  struct rsxgl_context_t * ctx = current_ctx();
+
+  if(n < 0) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  for(GLsizei i = 0;i < n;++i,++lists) {
+    const GLuint list_name = *lists;
+
+    if(list_name == 0) continue;
+
+    // The list being recorded can't be deleted:
+    if(ctx -> command_list_recorder != 0 && ctx -> command_list_recorder -> name == list_name) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    // Free resources used by this object:
+    if(command_list_t::storage().is_object(list_name)) {
+      rsxgl_command_list_clear(ctx,command_list_t::storage().at(list_name));
+      command_list_t::storage().destroy(list_name);
+    }
+    // It was just a name:
+    else if(command_list_t::storage().is_name(list_name)) {
+      command_list_t::storage().destroy(list_name);
+    }
+  }
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI GLboolean APIENTRY
+glIsCommandListRSX (GLuint list)
+{
+  return command_list_t::storage().is_object(list);
+}
+
+GLAPI void APIENTRY
+glBeginCommandListRSX (GLuint list)
+{
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
+  struct rsxgl_context_t * ctx = current_ctx();
+
+  // Timestamps posted while recording go to the FIFO, which only a context with a surface writes to:
+  if(ctx -> command_list_recorder != 0 || !ctx -> can_emit()) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  if(list == 0 || !command_list_t::storage().is_name(list)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+  else if(!command_list_t::storage().is_object(list)) {
+    command_list_t::storage().create_object(list);
+  }
+
+  command_list_t & command_list = command_list_t::storage().at(list);
+
+  // Re-recording a list replaces its contents:
+  rsxgl_command_list_clear(ctx,command_list);
+
+  rsxgl_command_list_recorder_t * recorder = new rsxgl_command_list_recorder_t;
+  recorder -> context.callback = 0;
+  recorder -> fifo = ctx -> base.gcm_context;
+  recorder -> name = list;
+  recorder -> out_of_memory = 0;
+
+  if(!rsxgl_command_list_segment_new(recorder,command_list,0)) {
+    delete recorder;
+    RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+  }
+
+  uint32_t offset = 0;
+  int32_t s = gcmAddressToOffset(recorder -> context.begin,&offset);
+  rsxgl_assert(s == 0);
+  command_list.offset = offset;
+
+  ctx -> command_list_recorder = recorder;
+  ctx -> base.gcm_context = &recorder -> context;
+
+  // Make the list self-contained - everything it depends upon gets validated into it:
+  rsxgl_command_list_invalidate_state(ctx);
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glEndCommandListRSX (void)
+{
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
+  struct rsxgl_context_t * ctx = current_ctx();
+
+  rsxgl_command_list_recorder_t * recorder = ctx -> command_list_recorder;
+
+  if(recorder == 0) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  command_list_t & command_list = command_list_t::storage().at(recorder -> name);
+
+  // The segment's last word was kept free for this:
+  gcm_emit_at(recorder -> context.current,0,gcm_return_cmd());
+
+  ctx -> base.gcm_context = recorder -> fifo;
+  ctx -> command_list_recorder = 0;
+
+  const bool out_of_memory = recorder -> out_of_memory;
+  delete recorder;
+
+  // What was validated went into the list, not the FIFO:
+  rsxgl_command_list_invalidate_state(ctx);
+
+  if(out_of_memory) {
+    rsxgl_command_list_clear(ctx,command_list);
+    RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+  }
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glCallCommandListRSX (GLuint list)
+{
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
+  struct rsxgl_context_t * ctx = current_ctx();
+
+  // The RSX can't nest "call" commands; nor can a context without a surface send one:
+  if(ctx -> command_list_recorder != 0 || !ctx -> can_emit()) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  if(!command_list_t::storage().is_object(list)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  command_list_t & command_list = command_list_t::storage().at(list);
+
+  if(command_list.segments.empty()) {
+    RSXGL_NOERROR_();
+  }
+
+  const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+
+  gcmContextData * context = ctx -> gcm_context();
+  uint32_t * buffer = gcm_reserve(context,1);
+  gcm_emit_at(buffer,0,gcm_call_cmd(command_list.offset));
+  gcm_finish_n_commands(context,1);
+
+  // Objects used by the list are busy until the GPU returns from it:
+  for(buffer_t::name_type name : command_list.buffers) {
+    buffer_t::storage().at(name).timestamp = timestamp;
+  }
+  for(texture_t::name_type name : command_list.textures) {
+    texture_t::storage().at(name).timestamp = timestamp;
+  }
+  command_list.timestamp = timestamp;
+
+  rsxgl_timestamp_post(ctx,timestamp);
+
+  rsxgl_command_list_invalidate_state(ctx);
+
+  RSXGL_NOERROR_();
+}
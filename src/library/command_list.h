@@ -0,0 +1,88 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// command_list.h - Pre-recorded command lists (GL_RSX_command_list).
+//
+// A command list is a sequence of RSX commands, recorded once by glBeginCommandListRSX() &
+// glEndCommandListRSX() into GPU-visible memory, and replayed by glCallCommandListRSX() with
+// a single FIFO "call" command. The buffers & textures that the recorded draw calls use are
+// captured, so that they can be timestamped each time the list is replayed.
+
+#ifndef rsxgl_command_list_H
+#define rsxgl_command_list_H
+
+#include "gl_constants.h"
+#include "rsxgl_limits.h"
+#include "gl_object.h"
+#include "gl_fifo.h"
+#include "buffer.h"
+#include "textures.h"
+
+#include <vector>
+
+struct command_list_t {
+  typedef gl_object< command_list_t, RSXGL_MAX_COMMAND_LISTS > gl_object_type;
+  typedef typename gl_object_type::name_type name_type;
+  typedef typename gl_object_type::storage_type storage_type;
+
+  static storage_type & storage();
+
+  /// \brief Timestamp of the most recent replay:
+  uint32_t timestamp;
+
+  /// \brief RSX offset of the first command - the target of the "call" command:
+  uint32_t offset;
+
+  /// \brief Blocks of GPU-visible memory that hold the commands, linked by "jump" commands:
+  std::vector< void * > segments;
+
+  /// \brief Objects used by the recorded commands; each holds a reference:
+  std::vector< buffer_t::name_type > buffers;
+  std::vector< texture_t::name_type > textures;
+
+  command_list_t()
+    : timestamp(0), offset(0) {
+  }
+
+  command_list_t(command_list_t &&) = default;
+  ~command_list_t();
+};
+
+template<>
+struct striped_object_relocate< command_list_t > : public striped_object_move_relocate< command_list_t > {
+};
+
+// State kept while a command list is being recorded. The context's gcmContextData is replaced
+// by recorder.context, which has no PRX callback - running out of room calls
+// rsxgl_command_list_reserve_callback() instead, which chains another segment onto the list:
+struct rsxgl_command_list_recorder_t {
+  gcmContextData context;
+
+  /// \brief The context's actual FIFO:
+  gcmContextData * fifo;
+
+  command_list_t::name_type name;
+
+  /// \brief Set if a segment couldn't be allocated; the list is discarded by glEndCommandListRSX():
+  uint8_t out_of_memory:1;
+
+  /// \brief Where commands go once out_of_memory is set. It's never executed, so it needn't be
+  /// in RSX-mapped memory, and it grows to fit whatever is reserved:
+  std::vector< uint32_t > discard;
+};
+
+struct rsxgl_context_t;
+struct program_t;
+
+// Memory in the command list buffer, for other pre-formatted commands that are reached by a FIFO
+// "call" command (e.g., uniform buffer constant uploads). Returns 0 if there's no room:
+uint32_t * rsxgl_command_buffer_allocate(const uint32_t);
+void rsxgl_command_buffer_free(uint32_t *);
+
+// Add the buffers & textures that a draw call would use to the command list being recorded, and
+// migrate the textures into the context's FIFO. Called before the draw is validated into the list:
+void rsxgl_command_list_capture_draw(rsxgl_context_t *,program_t &,const uint32_t);
+
+#endif
@@ -0,0 +1,285 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// deferred_free.cc - Memory that's released once the GPU is done with it.
+
+#include "rsxgl_context.h"
+#include "deferred_free.h"
+#include "texture_migrate.h"
+#include "program.h"
+#include "command_list.h"
+#include "timestamp.h"
+#include "rsxgl_assert.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+rsxgl_deferred_free_queue_t::rsxgl_deferred_free_queue_t()
+  : holds(0)
+{
+  memset(&statistics,0,sizeof(statistics));
+}
+
+static inline void
+rsxgl_deferred_free_release(memory_arena_t::storage_type & arena_storage,const rsxgl_deferred_free_queue_t::entry_t & entry)
+{
+  switch(entry.kind) {
+  case rsxgl_deferred_free_queue_t::kind_arena:
+    rsxgl_arena_free(arena_storage.at(entry.arena),entry.memory);
+    break;
+  case rsxgl_deferred_free_queue_t::kind_migrate:
+    rsxgl_texture_migrate_free(entry.address);
+    break;
+  case rsxgl_deferred_free_queue_t::kind_migrate_buffer:
+    rsxgl_texture_migrate_buffer_free(entry.address);
+    break;
+  case rsxgl_deferred_free_queue_t::kind_ucode:
+    rsxgl_rsx_ucode_free(entry.address);
+    break;
+  case rsxgl_deferred_free_queue_t::kind_command_buffer:
+    rsxgl_command_buffer_free((uint32_t *)entry.address);
+    break;
+  default:
+    rsxgl_assert(0);
+  }
+}
+
+static inline void
+rsxgl_deferred_free_retired(rsxgl_deferred_free_queue_t & queue,const rsxgl_deferred_free_queue_t::entry_t & entry)
+{
+  rsxgl_assert(queue.statistics.pending > 0);
+  rsxgl_assert(queue.statistics.pending_bytes >= entry.size);
+
+  --queue.statistics.pending;
+  queue.statistics.pending_bytes -= entry.size;
+  ++queue.statistics.freed;
+}
+
+static void
+rsxgl_deferred_free_push(rsxgl_context_t * ctx,const rsxgl_deferred_free_queue_t::entry_t & entry)
+{
+  rsxgl_object_context_t * object_ctx = ctx -> object_context();
+  rsxgl_deferred_free_queue_t & queue = object_ctx -> deferred_free;
+
+  // The GPU is already done with it:
+  if(queue.holds == 0 && rsxgl_timestamp_passed_conservative(object_ctx -> cached_timestamp,object_ctx -> next_timestamp,entry.timestamp)) {
+    rsxgl_deferred_free_release(object_ctx -> arena_storage(),entry);
+    return;
+  }
+
+  queue.entries.push_back(entry);
+  queue.entries.back().held = (queue.holds > 0);
+
+  ++queue.statistics.pending;
+  queue.statistics.pending_bytes += entry.size;
+  queue.statistics.high_water_bytes = std::max(queue.statistics.high_water_bytes,queue.statistics.pending_bytes);
+}
+
+void
+rsxgl_deferred_free_arena(rsxgl_context_t * ctx,const uint32_t timestamp,const memory_arena_t::name_type arena,const memory_t & memory,const rsx_size_t size)
+{
+  rsxgl_assert(memory);
+
+  rsxgl_deferred_free_queue_t::entry_t entry;
+  entry.timestamp = timestamp;
+  entry.kind = rsxgl_deferred_free_queue_t::kind_arena;
+  entry.arena = arena;
+  entry.memory = memory;
+  entry.address = 0;
+  entry.size = size;
+
+  rsxgl_deferred_free_push(ctx,entry);
+}
+
+void
+rsxgl_deferred_free_migrate(rsxgl_context_t * ctx,const uint32_t timestamp,void * address,const rsx_size_t size)
+{
+  rsxgl_assert(address != 0);
+
+  rsxgl_deferred_free_queue_t::entry_t entry;
+  entry.timestamp = timestamp;
+  entry.kind = rsxgl_deferred_free_queue_t::kind_migrate;
+  entry.arena = 0;
+  entry.address = address;
+  entry.size = size;
+
+  rsxgl_deferred_free_push(ctx,entry);
+}
+
+void
+rsxgl_deferred_free_migrate_buffer(rsxgl_context_t * ctx,const uint32_t timestamp,void * address,const rsx_size_t size)
+{
+  rsxgl_assert(address != 0);
+
+  rsxgl_deferred_free_queue_t::entry_t entry;
+  entry.timestamp = timestamp;
+  entry.kind = rsxgl_deferred_free_queue_t::kind_migrate_buffer;
+  entry.arena = 0;
+  entry.address = address;
+  entry.size = size;
+
+  rsxgl_deferred_free_push(ctx,entry);
+}
+
+void
+rsxgl_deferred_free_ucode(rsxgl_context_t * ctx,const uint32_t timestamp,void * address,const rsx_size_t size)
+{
+  rsxgl_assert(address != 0);
+
+  rsxgl_deferred_free_queue_t::entry_t entry;
+  entry.timestamp = timestamp;
+  entry.kind = rsxgl_deferred_free_queue_t::kind_ucode;
+  entry.arena = 0;
+  entry.address = address;
+  entry.size = size;
+
+  rsxgl_deferred_free_push(ctx,entry);
+}
+
+void
+rsxgl_deferred_free_command_buffer(rsxgl_context_t * ctx,const uint32_t timestamp,uint32_t * address,const rsx_size_t size)
+{
+  rsxgl_assert(address != 0);
+
+  rsxgl_deferred_free_queue_t::entry_t entry;
+  entry.timestamp = timestamp;
+  entry.kind = rsxgl_deferred_free_queue_t::kind_command_buffer;
+  entry.arena = 0;
+  entry.address = address;
+  entry.size = size;
+
+  rsxgl_deferred_free_push(ctx,entry);
+}
+
+void
+rsxgl_deferred_free_collect(rsxgl_context_t * ctx,const bool refresh)
+{
+  rsxgl_object_context_t * object_ctx = ctx -> object_context();
+  rsxgl_deferred_free_queue_t & queue = object_ctx -> deferred_free;
+
+  if(queue.entries.empty()) return;
+
+  if(refresh) {
+    object_ctx -> cached_timestamp = rsxgl_sync_value(object_ctx -> timestamp_sync);
+  }
+
+  const uint32_t cached_timestamp = object_ctx -> cached_timestamp, next_timestamp = object_ctx -> next_timestamp;
+
+  // Entries aren't necessarily queued in timestamp order, so look at all of them:
+  std::deque< rsxgl_deferred_free_queue_t::entry_t >::iterator it = queue.entries.begin(), it_out = it, it_end = queue.entries.end();
+  for(;it != it_end;++it) {
+    if(!(it -> held && queue.holds > 0) && rsxgl_timestamp_passed_conservative(cached_timestamp,next_timestamp,it -> timestamp)) {
+      rsxgl_deferred_free_release(object_ctx -> arena_storage(),*it);
+      rsxgl_deferred_free_retired(queue,*it);
+    }
+    else {
+      *it_out++ = *it;
+    }
+  }
+  queue.entries.erase(it_out,it_end);
+}
+
+bool
+rsxgl_deferred_free_reclaim(rsxgl_context_t * ctx)
+{
+  rsxgl_object_context_t * object_ctx = ctx -> object_context();
+  rsxgl_deferred_free_queue_t & queue = object_ctx -> deferred_free;
+
+  if(queue.entries.empty()) return false;
+
+  ++queue.statistics.reclaim_waits;
+
+  bool freed = false;
+
+  // Held entries can't be freed, however long this waits:
+  std::deque< rsxgl_deferred_free_queue_t::entry_t >::iterator it = queue.entries.begin(), it_out = it, it_end = queue.entries.end();
+  for(;it != it_end;++it) {
+    if(!(it -> held && queue.holds > 0)) {
+      rsxgl_timestamp_wait(ctx,it -> timestamp);
+      rsxgl_deferred_free_release(object_ctx -> arena_storage(),*it);
+      rsxgl_deferred_free_retired(queue,*it);
+      freed = true;
+    }
+    else {
+      *it_out++ = *it;
+    }
+  }
+  queue.entries.erase(it_out,it_end);
+
+  return freed;
+}
+
+void
+rsxgl_deferred_free_hold(rsxgl_context_t * ctx)
+{
+  ++ctx -> object_context() -> deferred_free.holds;
+}
+
+void
+rsxgl_deferred_free_unhold(rsxgl_context_t * ctx)
+{
+  rsxgl_deferred_free_queue_t & queue = ctx -> object_context() -> deferred_free;
+
+  rsxgl_assert(queue.holds > 0);
+  if(--queue.holds > 0) return;
+
+  for(std::deque< rsxgl_deferred_free_queue_t::entry_t >::iterator it = queue.entries.begin(),it_end = queue.entries.end();it != it_end;++it) {
+    it -> held = 0;
+  }
+
+  // Free what was only kept for the sake of the writes:
+  rsxgl_deferred_free_collect(ctx,false);
+}
+
+void
+rsxgl_deferred_free_forget_arena(rsxgl_context_t * ctx,const memory_arena_t::name_type arena)
+{
+  rsxgl_deferred_free_queue_t & queue = ctx -> object_context() -> deferred_free;
+
+  std::deque< rsxgl_deferred_free_queue_t::entry_t >::iterator it = queue.entries.begin(), it_out = it, it_end = queue.entries.end();
+  for(;it != it_end;++it) {
+    if(it -> kind == rsxgl_deferred_free_queue_t::kind_arena && it -> arena == arena) {
+      --queue.statistics.pending;
+      queue.statistics.pending_bytes -= it -> size;
+    }
+    else {
+      *it_out++ = *it;
+    }
+  }
+  queue.entries.erase(it_out,it_end);
+}
+
+void
+rsxgl_deferred_free_clear(rsxgl_object_context_t & object_ctx)
+{
+  rsxgl_deferred_free_queue_t & queue = object_ctx.deferred_free;
+
+  for(std::deque< rsxgl_deferred_free_queue_t::entry_t >::const_iterator it = queue.entries.begin(),it_end = queue.entries.end();it != it_end;++it) {
+    rsxgl_deferred_free_release(object_ctx.arena_storage(),*it);
+  }
+  queue.entries.clear();
+
+  queue.statistics.pending = 0;
+  queue.statistics.pending_bytes = 0;
+}
+
+extern "C" void
+rsxglGetDeferredFreeStatistics(struct rsxgl_deferred_free_statistics_t * statistics,int reset)
+{
+  rsxgl_context_t * ctx = current_ctx();
+  RSXGL_LOCK_SHARED_OBJECTS(ctx);
+
+  rsxgl_deferred_free_queue_t & queue = ctx -> object_context() -> deferred_free;
+
+  if(statistics != 0) {
+    *statistics = queue.statistics;
+  }
+
+  if(reset) {
+    queue.statistics.high_water_bytes = queue.statistics.pending_bytes;
+    queue.statistics.freed = 0;
+    queue.statistics.reclaim_waits = 0;
+  }
+}
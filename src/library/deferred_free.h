@@ -0,0 +1,99 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// deferred_free.h - Memory that's released once the GPU is done with it.
+//
+// When a buffer or renderbuffer is given new storage, a texture's levels are migrated into the
+// texture's own storage, a specialized fragment program is replaced, or a uniform buffer's
+// streams are dropped, the old memory may still
+// be used by commands that the GPU hasn't executed yet. Rather than wait, it's queued along with
+// the timestamp that marks the last of those commands, and freed once the GPU passes it. The queue is checked at every draw (against
+// the cached timestamp, so that the GPU isn't consulted) and at every swap; if an allocation
+// fails, the caller can wait for everything in the queue to be freed, then try again.
+//
+// A thread that writes to an object's storage with the object context unlocked holds the queue
+// while it does so. Memory that's freed in the meantime stays queued, whatever the GPU has done
+// with it, so that another thread that respecifies or migrates the object can't free the storage
+// from under the write.
+
+#ifndef rsxgl_deferred_free_H
+#define rsxgl_deferred_free_H
+
+#include "GL3/rsxgl.h"
+#include "arena.h"
+
+#include <deque>
+
+struct rsxgl_context_t;
+struct rsxgl_object_context_t;
+
+struct rsxgl_deferred_free_queue_t {
+  enum kind_type {
+    // Memory from one of the object context's arenas:
+    kind_arena = 0,
+    // Memory from the texture migration buffer's heap:
+    kind_migrate = 1,
+    // A separately allocated migration buffer; see rsxgl_texture_migrate_buffer_new():
+    kind_migrate_buffer = 2,
+    // Fragment program microcode; see rsxgl_rsx_ucode_free():
+    kind_ucode = 3,
+    // Commands that the FIFO calls into; see rsxgl_command_buffer_free():
+    kind_command_buffer = 4
+  };
+
+  struct entry_t {
+    uint32_t timestamp;
+    uint8_t kind, held;
+    memory_arena_t::name_type arena;
+    memory_t memory;
+    void * address;
+    rsx_size_t size;
+  };
+
+  std::deque< entry_t > entries;
+
+  // Number of threads writing to storage with the object context unlocked:
+  uint32_t holds;
+
+  struct rsxgl_deferred_free_statistics_t statistics;
+
+  rsxgl_deferred_free_queue_t();
+};
+
+// Free arena memory once the GPU passes timestamp; size is only used for the statistics:
+void rsxgl_deferred_free_arena(rsxgl_context_t *,const uint32_t,const memory_arena_t::name_type,const memory_t &,const rsx_size_t);
+
+// Free memory allocated by rsxgl_texture_migrate_memalign() once the GPU passes timestamp:
+void rsxgl_deferred_free_migrate(rsxgl_context_t *,const uint32_t,void *,const rsx_size_t);
+
+// Free a buffer allocated by rsxgl_texture_migrate_buffer_new() once the GPU passes timestamp:
+void rsxgl_deferred_free_migrate_buffer(rsxgl_context_t *,const uint32_t,void *,const rsx_size_t);
+
+// Free fragment program microcode once the GPU passes timestamp:
+void rsxgl_deferred_free_ucode(rsxgl_context_t *,const uint32_t,void *,const rsx_size_t);
+
+// Free memory allocated by rsxgl_command_buffer_allocate() once the GPU passes timestamp:
+void rsxgl_deferred_free_command_buffer(rsxgl_context_t *,const uint32_t,uint32_t *,const rsx_size_t);
+
+// Free whatever the GPU is done with. If refresh is false, only the cached timestamp is
+// consulted; otherwise it's read from the GPU first:
+void rsxgl_deferred_free_collect(rsxgl_context_t *,const bool);
+
+// Wait for the GPU to finish with everything in the queue, and free it. Returns true if anything
+// was freed (so that a failed allocation is worth retrying):
+bool rsxgl_deferred_free_reclaim(rsxgl_context_t *);
+
+// Hold & release the queue around a write made with the object context unlocked. Both are
+// called with it locked:
+void rsxgl_deferred_free_hold(rsxgl_context_t *);
+void rsxgl_deferred_free_unhold(rsxgl_context_t *);
+
+// Drop entries that belong to an arena that's being destroyed, without freeing them:
+void rsxgl_deferred_free_forget_arena(rsxgl_context_t *,const memory_arena_t::name_type);
+
+// Free everything in the queue without waiting; called when the object context is destroyed:
+void rsxgl_deferred_free_clear(rsxgl_object_context_t &);
+
+#endif
@@ -15,6 +15,10 @@
 #include "sync.h"
 #include "timestamp.h"
 #include "draw.h"
+#include "draw_batch.h"
+#include "feedback.h"
+#include "profiler.h"
+#include "perf_counters.h"
 
 #include <GL3/gl3.h>
 #include "GL3/rsxgl3ext.h"
@@ -26,6 +30,7 @@
 #include "debug.h"
 #include "rsxgl_assert.h"
 #include "migrate.h"
+#include "fifo.h"
 
 #include <string.h>
 #include <boost/integer/static_log2.hpp>
@@ -127,13 +132,15 @@ rsxgl_check_draw_arrays(rsxgl_context_t * ctx,GLenum mode)
     return ~0U;
   }
 
-  // see if bound attributes are mapped - if they are, "throw" GL_INVALID_OPERATION:
-  rsxgl_check_unmapped_arrays(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].attribs_enabled);
-  RSXGL_FORWARD_ERROR(~0);
+  if(RSXGL_CHECK_ERRORS()) {
+    // see if bound attributes are mapped - if they are, "throw" GL_INVALID_OPERATION:
+    rsxgl_check_unmapped_arrays(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].attribs_enabled);
+    RSXGL_FORWARD_ERROR(~0);
 
-  // Check for compatibility with transform feedback settings:
-  rsxgl_check_transform_feedback(ctx,rsx_primitive_type);
-  RSXGL_FORWARD_ERROR(~0);
+    // Check for compatibility with transform feedback settings:
+    rsxgl_check_transform_feedback(ctx,rsx_primitive_type);
+    RSXGL_FORWARD_ERROR(~0);
+  }
 
   return rsx_primitive_type;
 }
@@ -156,377 +163,26 @@ rsxgl_check_draw_elements(rsxgl_context_t * ctx,GLenum mode,GLenum type)
   }
 
   // see if bound attributes are mapped - if they are, "throw" GL_INVALID_OPERATION:
-  rsxgl_check_unmapped_arrays(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].attribs_enabled);
-  RSXGL_FORWARD_ERROR(std::make_pair(~0U, RSXGL_MAX_ELEMENT_TYPES));
-
-  // Check for compatibility with transform feedback settings:
-  rsxgl_check_transform_feedback(ctx,rsx_primitive_type);
-  RSXGL_FORWARD_ERROR(std::make_pair(~0U, RSXGL_MAX_ELEMENT_TYPES));
-
-  return std::make_pair(rsx_primitive_type,rsx_element_type);
-}
-
-// This function is designed to split an iteration into groups (RSX method invocations) & batches
-// as required by the hardware. max_method_args is the total number of arguments accepted by a
-// single "method" - this should pretty much be set to 2047. batch_size can vary depending upon
-// the purpose that this function is put to. Drawing vertices & indices that have been loaded
-// into arrays on the GPU, for instance, are split into batches of 256 indices; sending indices
-// from client memory, over the fifo, would have a batch_size of 1.
-struct rsxgl_process_batch_work_t {
-  uint32_t nvertices, nbatch, nbatchremainder;
-
-  rsxgl_process_batch_work_t(const uint32_t _nvertices, const uint32_t _nbatch, const uint32_t _nbatchremainder)
-    : nvertices(_nvertices), nbatch(_nbatch), nbatchremainder(_nbatchremainder) {
+  if(RSXGL_CHECK_ERRORS()) {
+    rsxgl_check_unmapped_arrays(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].attribs_enabled);
+    RSXGL_FORWARD_ERROR(std::make_pair(~0U, RSXGL_MAX_ELEMENT_TYPES));
   }
-};
-
-template< uint32_t max_method_args, typename Operations >
-uint32_t rsxgl_count_batch(const uint32_t n)
-{
-  const uint32_t batch_size = Operations::batch_size;
-  const rsxgl_process_batch_work_t info = Operations::work_info(n);
-  const uint32_t ninvoc = info.nbatch / max_method_args;
-  const uint32_t ninvocremainder = info.nbatch % max_method_args;
 
-  return Operations::count(ninvoc,ninvocremainder,info.nbatchremainder);
-}
-
-template< uint32_t max_method_args, typename Operations >
-void rsxgl_process_batch(gcmContextData * context,const uint32_t n,const Operations & operations)
-{
-  const uint32_t batch_size = Operations::batch_size;
-
-  const rsxgl_process_batch_work_t info = Operations::work_info(n);
-
-  uint32_t ninvoc = info.nbatch / max_method_args;
-  const uint32_t ninvocremainder = info.nbatch % max_method_args;
-
-  operations.begin(context,ninvoc,ninvocremainder,info.nbatchremainder);
-
-  operations.begin_group(1);
-  operations.n_batch(0,info.nbatchremainder);
-  operations.end_group(1);
-
-  for(;ninvoc > 0;--ninvoc) {
-    operations.begin_group(max_method_args);
-    for(size_t i = 0;i < max_method_args;++i) {
-      operations.full_batch(i);
-    }
-    operations.end_group(max_method_args);
+  // Client-side indices are migrated to transient memory, which a command list can't refer to:
+  if(ctx -> command_list_recorder != 0 && ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] == 0) {
+    RSXGL_ERROR(GL_INVALID_OPERATION,std::make_pair(~0U,RSXGL_MAX_ELEMENT_TYPES));
   }
 
-  if(ninvocremainder > 0) {
-    operations.begin_group(ninvocremainder);
-    for(size_t i = 0;i < ninvocremainder;++i) {
-      operations.full_batch(i);
-    }
-    operations.end_group(ninvocremainder);
+  // Check for compatibility with transform feedback settings:
+  if(RSXGL_CHECK_ERRORS()) {
+    rsxgl_check_transform_feedback(ctx,rsx_primitive_type);
+    RSXGL_FORWARD_ERROR(std::make_pair(~0U, RSXGL_MAX_ELEMENT_TYPES));
   }
 
-  operations.end();
+  return std::make_pair(rsx_primitive_type,rsx_element_type);
 }
 
-// You are supposed to be able to pass up to 2047 bundles of 256 batches of
-// vertices to each NV30_3D_VB_VERTEX_BATCH method. Testing revealed that this number
-// is apparently the much lower number of 3, and for a decent-sized mesh, it really
-// ought to be one so that cache invalidation instructions can be submitted for each
-// batch.
-// TODO: Investigate this further.
-#define RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS 1
-//#define RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS 3
-//#define RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS 2047
-
-template< uint32_t max_batch_size >
-struct rsxgl_draw_points {
-  static const uint32_t batch_size_bits = boost::static_log2< max_batch_size >::value;
-  
-  struct traits {
-    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_POINTS;
-    static const uint32_t batch_size = max_batch_size;
-
-    // Will have these also:
-    // - repeat_offset is the amount to subtract from the start vertex index for each batch, due to 
-    //   a primitive being split across the batch_size boundary (line strip, line loop, triangle strip, triangle fan, quad strip, maybe polygon, need this, potentially)
-    // - repeat_first says that each batch iteration will begin by repeating the first vertex in the primitive (triangle fan, polygon need this)
-    // - close_first says that the first vertex of the primitive will be repeated at the end of the entire iteration (line_loop needs this)
-    // static const uint32_t repeat_offset, repeat_first, close_first;
-    static const uint32_t repeat_offset = 0;
-
-    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
-      return rsxgl_process_batch_work_t(count,count >> batch_size_bits,count & (batch_size - 1));
-    }
-  };
-};
-
-template< uint32_t max_batch_size >
-struct rsxgl_draw_lines {
-  static const uint32_t batch_size_bits = boost::static_log2< max_batch_size >::value;
-  
-  struct traits {
-    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_LINES;
-    static const uint32_t batch_size = max_batch_size & ~1;
-
-    static const uint32_t repeat_offset = 0;
-
-    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
-      const uint32_t _count = count & ~1;
-      return rsxgl_process_batch_work_t(_count,_count >> batch_size_bits,_count & (batch_size - 1));
-    }
-  };
-};
-
-template< uint32_t max_batch_size >
-struct rsxgl_draw_line_strip {
-  struct traits {
-    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP;
-    // batch_size had better be pot:
-    static const uint32_t batch_size = max_batch_size;
-    static const uint32_t batch_size_bits = boost::static_log2< max_batch_size >::value;
-
-    static const uint32_t repeat_offset = 1;
-
-    static const uint32_t batch_size_minus_repeat = batch_size - repeat_offset;
-
-    // actual number of vertices, nbatch, natch remainder:
-    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
-      uint32_t _count = count;
-
-      if(_count > batch_size) {
-	const uint32_t tmp = _count - batch_size;
-	_count = _count + (tmp / batch_size_minus_repeat * repeat_offset) + ((tmp % batch_size_minus_repeat) ? repeat_offset : 0);
-      }
-
-      return rsxgl_process_batch_work_t(batch_size,_count >> batch_size_bits,_count & (batch_size - 1));      
-    }
-  };
-};
-
-template< uint32_t max_batch_size >
-struct rsxgl_draw_triangles {
-  struct traits {
-    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_TRIANGLES;
-    static const uint32_t batch_size = max_batch_size - (max_batch_size % 3);
-
-    static const uint32_t repeat_offset = 0;
-
-    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
-      const uint32_t count_for_triangles = count - (count % 3);
-      return rsxgl_process_batch_work_t(count_for_triangles,count_for_triangles / batch_size,count_for_triangles % batch_size);
-    }
-  };
-};
-
-template< uint32_t max_batch_size >
-struct rsxgl_draw_triangle_strip {
-  struct traits {
-    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP;
-    // batch_size had better be pot:
-    static const uint32_t batch_size = max_batch_size;
-    static const uint32_t batch_size_bits = boost::static_log2< max_batch_size >::value;
-
-    static const uint32_t repeat_offset = 2;
-
-    static const uint32_t batch_size_minus_repeat = batch_size - repeat_offset;
-
-    // actual number of vertices, nbatch, natch remainder:
-    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
-      uint32_t _count = count;
-
-      if(_count > batch_size) {
-	const uint32_t tmp = _count - batch_size;
-	_count = _count + (tmp / batch_size_minus_repeat * repeat_offset) + ((tmp % batch_size_minus_repeat) ? repeat_offset : 0);
-      }
-
-      return rsxgl_process_batch_work_t(batch_size,_count >> batch_size_bits,_count & (batch_size - 1));      
-    }
-  };
-};
-
-template< uint32_t max_batch_size, template< uint32_t > class primitive_traits >
-struct rsxgl_draw_array_operations {
-  typedef typename primitive_traits< max_batch_size >::traits primitive_traits_type;
-  static const uint32_t rsx_primitive_type = primitive_traits_type::rsx_primitive_type;
-  static const uint32_t batch_size = primitive_traits_type::batch_size;
-  static const uint32_t repeat_offset = primitive_traits_type::repeat_offset;
-  
-  mutable uint32_t * buffer;
-  mutable uint32_t first, current;
-  
-  rsxgl_draw_array_operations(const uint32_t first)
-    : buffer(0), first(first), current(0) {
-  }
-
-  static inline rsxgl_process_batch_work_t
-  work_info(const uint32_t count) {
-    return primitive_traits_type::work_info(count);
-  }
-
-  static inline uint32_t
-  count(const uint32_t ninvoc,const uint32_t ninvocremainder,const uint32_t nbatchremainder) {
-    const uint32_t nmethods = 1 + ninvoc + (ninvocremainder ? 1 : 0);
-    const uint32_t nargs = 1 + (ninvoc * RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS) + ninvocremainder;
-    const uint32_t nwords = nmethods + nargs + 4 + 6;
-
-    return nwords;
-  }
-  
-  // ninvoc - number of full draw method invocations (2047 * 256 vertices)
-  // ninvocremainder - number of vertex batches for an additional draw method invocation (ninvocremainder * 256 vertices)
-  // nbatchremainder - size of one additional vertex batch (nbatchremainder vertices)
-  inline void
-  begin(gcmContextData * context,const uint32_t ninvoc,const uint32_t ninvocremainder,const uint32_t nbatchremainder) const {
-    buffer = gcm_reserve(context,count(ninvoc,ninvocremainder,nbatchremainder));
-
-    current = 0;
-
-    gcm_emit_method_at(buffer,0,NV40_3D_VTX_CACHE_INVALIDATE,1);
-    gcm_emit_at(buffer,1,0);
-    
-    gcm_emit_method_at(buffer,2,NV40_3D_VTX_CACHE_INVALIDATE,1);
-    gcm_emit_at(buffer,3,0);
-    
-    gcm_emit_method_at(buffer,4,NV40_3D_VTX_CACHE_INVALIDATE,1);
-    gcm_emit_at(buffer,5,0);
-    
-    gcm_emit_method_at(buffer,6,NV30_3D_VERTEX_BEGIN_END,1);
-    gcm_emit_at(buffer,7,rsx_primitive_type);
-
-    buffer += 8;
-  }
-  
-  // n is number of arguments to this method:
-  inline void
-  begin_group(const uint32_t n) const {
-    gcm_emit_method_at(buffer,0,NV30_3D_VB_VERTEX_BATCH,n);
-    ++buffer;
-  }
-  
-  // n is the size of this batch (the number of vertices in this batch):
-  inline void
-  n_batch(const uint32_t igroup,const uint32_t n) const {
-    gcm_emit_at(buffer,igroup,((n - 1) << NV30_3D_VB_VERTEX_BATCH_COUNT__SHIFT) | first + current);
-    current += n - repeat_offset;
-  }
-
-  // here the size of the batch is assumed to be primitive_traits::batch_size,
-  // which oughta be a constant:
-  inline void
-  full_batch(const uint32_t igroup) const {
-    gcm_emit_at(buffer,igroup,((batch_size - 1) << NV30_3D_VB_VERTEX_BATCH_COUNT__SHIFT) | first + current);
-    current += batch_size - repeat_offset;
-  }
-  
-  inline void
-  end_group(const uint32_t n) const {
-    buffer += n;
-  }
-  
-  inline void
-  end() const {
-    gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
-    gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
-    
-    buffer += 2;
-  }
-};
-
-#define RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS 1
-
-// Operations performed by rsxgl_process_batch (a local class passed as a template argument is a C++0x feature):
-template< uint32_t max_batch_size, template< uint32_t > class primitive_traits >
-struct rsxgl_draw_array_elements_operations {
-  typedef typename primitive_traits< max_batch_size >::traits primitive_traits_type;
-  static const uint32_t rsx_primitive_type = primitive_traits_type::rsx_primitive_type;
-  static const uint32_t batch_size = primitive_traits_type::batch_size;
-  static const uint32_t repeat_offset = primitive_traits_type::repeat_offset;
-  
-  mutable uint32_t * buffer;
-  mutable uint32_t current;
-  
-  rsxgl_draw_array_elements_operations()
-    : buffer(0), current(0) {
-  }
-
-  static inline rsxgl_process_batch_work_t
-  work_info(const uint32_t count) {
-    return primitive_traits_type::work_info(count);
-  }
-
-  static inline uint32_t
-  count(const uint32_t ninvoc,const uint32_t ninvocremainder,const uint32_t nbatchremainder) {
-    const uint32_t nmethods = 1 + ninvoc + (ninvocremainder ? 1 : 0);
-    const uint32_t nargs = 1 + (ninvoc * RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS) + ninvocremainder;
-    const uint32_t nwords = nmethods + nargs + 4;
-
-    return nwords;
-  }
-  
-  inline void
-  begin(gcmContextData * context,const uint32_t ninvoc,const uint32_t ninvocremainder,const uint32_t nbatchremainder) const {
-    buffer = gcm_reserve(context,count(ninvoc,ninvocremainder,nbatchremainder));
-
-    gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
-    gcm_emit_at(buffer,1,rsx_primitive_type);
-
-    buffer += 2;
-  }
-  
-  // n is number of arguments to this method:
-  inline void
-  begin_group(const uint32_t n) const {
-    gcm_emit_method_at(buffer,0,NV30_3D_VB_INDEX_BATCH,n);
-    ++buffer;
-  }
-
-  // n is the size of this batch:
-  inline void
-  n_batch(const uint32_t igroup,const uint32_t n) const {
-    gcm_emit_at(buffer,igroup,((n - 1) << NV30_3D_VB_INDEX_BATCH_COUNT__SHIFT) | current);
-    current += n - repeat_offset;
-  }
-  
-  // here the size of the batch is assumed to be primitive_traits::batch_size,
-  // which oughta be a constant:
-  inline void
-  full_batch(const uint32_t igroup) const {
-    gcm_emit_at(buffer,igroup,((batch_size - 1) << NV30_3D_VB_INDEX_BATCH_COUNT__SHIFT) | current);
-    current += batch_size - repeat_offset;
-  }
-  
-  inline void
-  end_group(const uint32_t n) const {
-    buffer += n;
-  }
-  
-  inline void
-  end() const {
-    gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
-    gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
-    
-    buffer += 2;
-  }
-};
-
 namespace {
-  union _ieee32_t {
-    float f;
-    uint32_t u;
-    struct {
-      uint16_t a[2];
-    } h;
-    struct {
-      uint8_t a[4];
-    } b;
-    
-    _ieee32_t(uint32_t value)
-      : u(value) {
-    }
-    
-    _ieee32_t(float value)
-    : f(value) {
-    }
-  };
-
   template< typename ElementRangePolicy, typename IterationPolicy, typename DrawPolicy >
   void rsxgl_draw(rsxgl_context_t * ctx,const ElementRangePolicy & elementRangePolicy,const IterationPolicy & iterationPolicy,const DrawPolicy & drawPolicy)
   {
@@ -534,6 +190,17 @@ namespace {
     rsxgl_debug_printf("%s\n",__PRETTY_FUNCTION__);
 #endif
 
+    // Only the context that's current with a surface draws; see rsxgl_context_t::can_emit():
+    if(!ctx -> can_emit()) {
+      RSXGL_ERROR_(GL_INVALID_FRAMEBUFFER_OPERATION);
+    }
+
+    // Buffers & textures are validated, migrated and timestamped here:
+    RSXGL_LOCK_SHARED_OBJECTS(ctx);
+
+    // Free memory that the GPU is known to be done with (without asking the GPU):
+    rsxgl_deferred_free_collect(ctx,false);
+
     // Compute the range of array elements used by this draw call:
     const std::pair< uint32_t, uint32_t > index_range = elementRangePolicy.range();
 
@@ -545,13 +212,25 @@ namespace {
     uint32_t timestamp = rsxgl_timestamp_create(ctx,timestampCount);
     const uint32_t lastTimestamp = timestamp + timestampCount - 1;
 
+    // Remember what a command list being recorded uses, and migrate it outside of the list:
+    if(ctx -> command_list_recorder != 0) {
+      rsxgl_command_list_capture_draw(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM],lastTimestamp);
+    }
+
     // Validate state:
+    RSXGL_PERF_WORDS_BEGIN(ctx);
     rsxgl_draw_framebuffer_validate(ctx,lastTimestamp);
+    RSXGL_PERF_WORDS(ctx,RSXGL_PERF_FRAMEBUFFER);
     rsxgl_state_validate(ctx);
+    RSXGL_PERF_WORDS(ctx,RSXGL_PERF_STATE);
     rsxgl_program_validate(ctx,lastTimestamp);
+    RSXGL_PERF_WORDS(ctx,RSXGL_PERF_PROGRAM);
     rsxgl_attribs_validate(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM],index_range.first,index_range.second,lastTimestamp);
-    rsxgl_uniforms_validate(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM]);
+    RSXGL_PERF_WORDS(ctx,RSXGL_PERF_ATTRIBS);
+    rsxgl_uniforms_validate(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM],lastTimestamp);
+    RSXGL_PERF_WORDS(ctx,RSXGL_PERF_UNIFORMS);
     rsxgl_textures_validate(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM],lastTimestamp);
+    RSXGL_PERF_WORDS(ctx,RSXGL_PERF_TEXTURES);
 
     // Draw functions:
     gcmContextData * gcm_context = ctx -> gcm_context();
@@ -565,157 +244,18 @@ namespace {
       drawPolicy.end(gcm_context,timestamp);
     }
 
-    // Transform feedback:
-    if(ctx -> state.enable.transform_feedback_mode != 0) {
-      rsxgl_assert(ctx -> state.enable.transform_feedback_program);
-
-      const uint32_t count = 16;
-      if(rsxgl_feedback_framebuffer_check(ctx,0,count)) {
-	const uint16_t w = RSXGL_MAX_RENDERBUFFER_SIZE, h = RSXGL_MAX_RENDERBUFFER_SIZE;
-
-	const uint32_t vertexid_index = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].streamvp_vertexid_index;
-
-	rsxgl_feedback_framebuffer_validate(ctx,0,count,lastTimestamp);
-
-	// set feedback "viewport":
-	{
-	  uint32_t * buffer = gcm_reserve(gcm_context,17);
-
-	  gcm_emit_method(&buffer,NV30_3D_VIEWPORT_HORIZ,2);
-	  gcm_emit(&buffer,((uint32_t)w << 16));
-	  gcm_emit(&buffer,((uint32_t)h << 16));
-	  
-	  gcm_emit_method(&buffer,NV30_3D_DEPTH_RANGE_NEAR,2);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(1.0f).u);
-	  
-	  gcm_emit_method(&buffer,NV30_3D_VIEWPORT_TRANSLATE,8);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(0.5f).u);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(1.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(1.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  
-	  gcm_emit_method(&buffer,NV30_3D_DEPTH_CONTROL,1);
-	  gcm_emit(&buffer,((uint32_t)0));
-	  
-	  gcm_finish_commands(gcm_context,&buffer);
-	}
-
-	// disable depth test:
-	{
-	  uint32_t * buffer = gcm_reserve(gcm_context,2);
-
-	  gcm_emit_method_at(buffer,0,NV30_3D_DEPTH_TEST_ENABLE,1);
-	  gcm_emit_at(buffer,1,0);
-	  
-	  gcm_finish_n_commands(gcm_context,2);
-	}
-
-	// point size:
-	{
-	  uint32_t * buffer = gcm_reserve(gcm_context,2);
-	  
-	  gcm_emit_method_at(buffer,0,NV30_3D_POINT_SIZE,1);
-	  gcm_emit_at(buffer,1,_ieee32_t(1.0f).u);
-	  
-	  gcm_finish_n_commands(gcm_context,2);
-	}
-
-	rsxgl_feedback_program_validate(ctx,lastTimestamp);
-
-	// invalidate vertex cache
-	{
-	  uint32_t * buffer = gcm_reserve(gcm_context,8);
-    
-	  gcm_emit_method_at(buffer,0,0x1710,1);
-	  gcm_emit_at(buffer,1,0);
-
-	  gcm_emit_method_at(buffer,2,NV40_3D_VTX_CACHE_INVALIDATE,1);
-	  gcm_emit_at(buffer,3,0);
-	  
-	  gcm_emit_method_at(buffer,4,NV40_3D_VTX_CACHE_INVALIDATE,1);
-	  gcm_emit_at(buffer,5,0);
-	  
-	  gcm_emit_method_at(buffer,6,NV40_3D_VTX_CACHE_INVALIDATE,1);
-	  gcm_emit_at(buffer,7,0);
-	  
-	  gcm_finish_n_commands(gcm_context,8);
-	}
-
-	// disable buffer reads for the vertexid_index
-	{
-	  uint32_t * buffer = gcm_reserve(gcm_context,4);
-
-	  gcm_emit_method_at(buffer,0,NV30_3D_VTXBUF(vertexid_index),1);
-	  gcm_emit_at(buffer,1,0);
-	  gcm_emit_method_at(buffer,2,NV30_3D_VTXFMT(vertexid_index),1);
-	  gcm_emit_at(buffer,3,
-		      0 |
-		      0 |
-		      ((uint32_t)RSXGL_VERTEX_S16_UN & 0x7));
-	  
-	  gcm_finish_n_commands(gcm_context,4);
-	}
-
-	// Draw this stuff:
-	{
-	  const uint32_t ncommands = (2 + 2) + (2 * count * 2);
-
-	  uint32_t * buffer = gcm_reserve(gcm_context,ncommands);
-	  uint32_t * buffer_start = buffer;
-
-	  gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
-	  gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_POINTS);
-	  buffer += 2;
-
-	  const uint32_t cmd = NV30_3D_VTX_ATTR_2I(vertexid_index);
-
-	  uint16_t y = 1, x = 0;
-	  uint32_t idx = 0;
-
-	  for(uint16_t div = count / RSXGL_MAX_RENDERBUFFER_SIZE;div > 0;--div,++y) {
-	    for(x = 0;x < RSXGL_MAX_RENDERBUFFER_SIZE;++x,++idx) {
-	      gcm_emit_method_at(buffer,0,cmd,1);
-	      gcm_emit_at(buffer,1,((y) << NV30_3D_VTX_ATTR_2I_Y__SHIFT) | ((x) << NV30_3D_VTX_ATTR_2I_X__SHIFT));
-
-	      gcm_emit_method_at(buffer,2,NV30_3D_VB_ELEMENT_U32,1);
-	      gcm_emit_at(buffer,3,idx);
-
-	      buffer += 4;
-	    }
-	  }
-
-	  x = 0;
-	  for(uint16_t mod = count % RSXGL_MAX_RENDERBUFFER_SIZE;mod > 0;--mod,++x,++idx) {
-	    gcm_emit_method_at(buffer,0,cmd,1);
-	    gcm_emit_at(buffer,1,((y) << NV30_3D_VTX_ATTR_2I_Y__SHIFT) | ((x) << NV30_3D_VTX_ATTR_2I_X__SHIFT));
-
-	    gcm_emit_method_at(buffer,2,NV30_3D_VB_ELEMENT_U32,1);
-	    gcm_emit_at(buffer,3,idx);
-
-	    buffer += 4;
-	  }
+    // Transform feedback, and counting primitives for queries:
+    if(ctx -> state.enable.transform_feedback_mode != 0 || ctx -> query_binding.is_anything_bound(RSXGL_QUERY_PRIMITIVES_GENERATED)) {
+      rsxgl_feedback_t feedback(ctx,lastTimestamp);
+      drawPolicy.feedback(feedback);
+      feedback.finish();
+    }
 
-	  gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
-	  gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
-	  buffer += 2;
+    rsxgl_profiler_draw(ctx -> profiler);
+    RSXGL_PERF_COUNT(ctx,draws,1);
 
-	  gcm_finish_n_commands(gcm_context,ncommands);
-	}
-	
-	// For the next draw invocation:
-	ctx -> invalid.parts.draw_framebuffer = 1;
-	ctx -> state.invalid.parts.draw_framebuffer = 1;
-	ctx -> state.invalid.parts.point_size = 1;
-	ctx -> invalid.parts.program = 1;
-	ctx -> state.invalid.parts.viewport = 1;
-	ctx -> invalid_attribs.set(vertexid_index);
-      }
-    }
+    // Get the GPU started if enough work has accumulated:
+    rsxgl_fifo_draw(gcm_context);
   }
 
   struct ignore_element_range_policy {
@@ -763,55 +303,96 @@ namespace {
   };
 
   struct array_draw_policy {
-    const uint32_t rsx_primitive_type;
+    const uint32_t rsx_primitive_type, max_method_args;
     
-    array_draw_policy(uint32_t _rsx_primitive_type)
-      : rsx_primitive_type(_rsx_primitive_type) {}
+    array_draw_policy(const rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type)
+      : rsx_primitive_type(_rsx_primitive_type),
+	max_method_args(_ctx -> state.enable.bulk_draw_batch ? RSXGL_VERTEX_BATCH_BULK_MAX_FIFO_METHOD_ARGS : RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS) {}
     
   protected:
     void emitDrawCommands(gcmContextData * gcm_context,uint32_t first,uint32_t count) const {
       if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_POINTS) {
 	rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_points > op(first);
-	rsxgl_process_batch< RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS > (gcm_context,count,op);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
 	gcm_context -> current = op.buffer;
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINES) {
 	rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_lines > op(first);
-	rsxgl_process_batch< RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS > (gcm_context,count,op);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
+	gcm_context -> current = op.buffer;
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINE_LOOP) {
+	rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_loop > op(first);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
 	gcm_context -> current = op.buffer;
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINE_STRIP) {
 	rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_strip > op(first);
-	rsxgl_process_batch< RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS > (gcm_context,count,op);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
 	gcm_context -> current = op.buffer;
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLES) {
 	rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangles > op(first);
-	rsxgl_process_batch< RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS > (gcm_context,count,op);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
 	gcm_context -> current = op.buffer;
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP) {
 	rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangle_strip > op(first);
-	rsxgl_process_batch< RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS > (gcm_context,count,op);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
+	gcm_context -> current = op.buffer;
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLE_FAN) {
+	rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangle_fan > op(first);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
+	gcm_context -> current = op.buffer;
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_QUADS) {
+	rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_quads > op(first);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
+	gcm_context -> current = op.buffer;
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_QUAD_STRIP) {
+	rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_quad_strip > op(first);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
+	gcm_context -> current = op.buffer;
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_POLYGON) {
+	rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_polygon > op(first);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
 	gcm_context -> current = op.buffer;
       }
     }
 
     uint32_t countDrawCommands(uint32_t count) const {
       if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_POINTS) {
-	return rsxgl_count_batch< RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS, rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_points > > (count);
+	return rsxgl_count_batch< rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_points > > (max_method_args,count);
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINES) {
-	return rsxgl_count_batch< RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS, rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_strip > > (count);
+	return rsxgl_count_batch< rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_lines > > (max_method_args,count);
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINE_LOOP) {
+	return rsxgl_count_batch< rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_loop > > (max_method_args,count);
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINE_STRIP) {
-	return rsxgl_count_batch< RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS, rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_strip > > (count);
+	return rsxgl_count_batch< rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_strip > > (max_method_args,count);
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLES) {
-	return rsxgl_count_batch< RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS, rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangles > > (count);
+	return rsxgl_count_batch< rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangles > > (max_method_args,count);
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP) {
-	return rsxgl_count_batch< RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS, rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangle_strip > > (count);
+	return rsxgl_count_batch< rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangle_strip > > (max_method_args,count);
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLE_FAN) {
+	return rsxgl_count_batch< rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangle_fan > > (max_method_args,count);
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_QUADS) {
+	return rsxgl_count_batch< rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_quads > > (max_method_args,count);
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_QUAD_STRIP) {
+	return rsxgl_count_batch< rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_quad_strip > > (max_method_args,count);
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_POLYGON) {
+	return rsxgl_count_batch< rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_polygon > > (max_method_args,count);
       }
       else {
 	return 0;
@@ -837,12 +418,13 @@ namespace {
 
   struct element_draw_policy {
     rsxgl_context_t * ctx;
-    const uint32_t rsx_primitive_type, rsx_element_type;
+    const uint32_t rsx_primitive_type, rsx_element_type, max_method_args;
 
     const bool client_indices;
 
     element_draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type)
       : ctx(_ctx), rsx_primitive_type(_rsx_primitive_type), rsx_element_type(_rsx_element_type),
+	max_method_args(_ctx -> state.enable.bulk_draw_batch ? RSXGL_INDEX_BATCH_BULK_MAX_FIFO_METHOD_ARGS : RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS),
 
 	client_indices(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] == 0),
 	migrate_buffer(0), migrate_buffer_size(0) {}
@@ -866,6 +448,7 @@ namespace {
       if(client_indices) {
 	migrate_buffer_size = (uint32_t)rsxgl_element_type_bytes[rsx_element_type] * std::accumulate(count,count + primcount,0);
 	migrate_buffer = rsxgl_vertex_migrate_memalign(context,16,migrate_buffer_size);
+	RSXGL_PERF_COUNT(current_ctx(),migrate_bytes,migrate_buffer_size);
 
 	uint8_t * pmigrate_buffer = (uint8_t *)migrate_buffer;
 	uint32_t offset = 0;
@@ -930,27 +513,52 @@ namespace {
     void emitDrawCommands(gcmContextData * gcm_context,uint32_t count) const {
       if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_POINTS) {
 	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_points > op;
-	rsxgl_process_batch< RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS > (gcm_context,count,op);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
 	gcm_context -> current = op.buffer;
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINES) {
-	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_strip > op;
-	rsxgl_process_batch< RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS > (gcm_context,count,op);
+	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_lines > op;
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
+	gcm_context -> current = op.buffer;
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINE_LOOP) {
+	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_loop > op;
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
 	gcm_context -> current = op.buffer;
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINE_STRIP) {
 	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_strip > op;
-	rsxgl_process_batch< RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS > (gcm_context,count,op);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
 	gcm_context -> current = op.buffer;
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLES) {
 	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangles > op;
-	rsxgl_process_batch< RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS > (gcm_context,count,op);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
 	gcm_context -> current = op.buffer;
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP) {
 	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangle_strip > op;
-	rsxgl_process_batch< RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS > (gcm_context,count,op);
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
+	gcm_context -> current = op.buffer;
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLE_FAN) {
+	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangle_fan > op;
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
+	gcm_context -> current = op.buffer;
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_QUADS) {
+	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_quads > op;
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
+	gcm_context -> current = op.buffer;
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_QUAD_STRIP) {
+	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_quad_strip > op;
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
+	gcm_context -> current = op.buffer;
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_POLYGON) {
+	rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_polygon > op;
+	rsxgl_process_batch(gcm_context,max_method_args,count,op);
 	gcm_context -> current = op.buffer;
       }
     }
@@ -962,21 +570,46 @@ namespace {
       }
     }
 
+    // Where the CPU can read indices from, for transform feedback:
+    const void * indexAddress(const GLvoid * indices) const {
+      if(client_indices) {
+	return indices;
+      }
+
+      const buffer_t & index_buffer = ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER];
+      return (const uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(index_buffer.arena),index_buffer.memory) + (uint32_t)((uint64_t)indices);
+    }
+
     uint32_t countDrawCommands(uint32_t count) const {
       if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_POINTS) {
-	return rsxgl_count_batch< RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS, rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_points > > (count);
+	return rsxgl_count_batch< rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_points > > (max_method_args,count);
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINES) {
-	return rsxgl_count_batch< RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS, rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_strip > > (count);
+	return rsxgl_count_batch< rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_lines > > (max_method_args,count);
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINE_LOOP) {
+	return rsxgl_count_batch< rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_loop > > (max_method_args,count);
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINE_STRIP) {
-	return rsxgl_count_batch< RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS, rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_strip > > (count);
+	return rsxgl_count_batch< rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_line_strip > > (max_method_args,count);
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLES) {
-	return rsxgl_count_batch< RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS, rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangles > > (count);
+	return rsxgl_count_batch< rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangles > > (max_method_args,count);
       }
       else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP) {
-	return rsxgl_count_batch< RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS, rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangle_strip > > (count);
+	return rsxgl_count_batch< rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangle_strip > > (max_method_args,count);
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLE_FAN) {
+	return rsxgl_count_batch< rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_triangle_fan > > (max_method_args,count);
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_QUADS) {
+	return rsxgl_count_batch< rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_quads > > (max_method_args,count);
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_QUAD_STRIP) {
+	return rsxgl_count_batch< rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_quad_strip > > (max_method_args,count);
+      }
+      else if(rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_POLYGON) {
+	return rsxgl_count_batch< rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_polygon > > (max_method_args,count);
       }
       else {
 	return 0;
@@ -1069,8 +702,8 @@ namespace {
     const GLint first;
     const GLsizei count;
     
-    draw_arrays_policy(uint32_t _rsx_primitive_type,GLint _first,GLint _count)
-      : array_draw_policy(_rsx_primitive_type), first(_first), count(_count) {
+    draw_arrays_policy(const rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,GLint _first,GLint _count)
+      : array_draw_policy(_ctx,_rsx_primitive_type), first(_first), count(_count) {
     }
     
     void begin(gcmContextData * context,uint32_t) const {}
@@ -1079,6 +712,10 @@ namespace {
     void draw(gcmContextData * gcm_context,uint32_t,unsigned int) const {
       array_draw_policy::emitDrawCommands(gcm_context,first,count);
     }
+
+    void feedback(rsxgl_feedback_t & feedback) const {
+      feedback.arrays(rsx_primitive_type,first,count);
+    }
   };
 }
 
@@ -1092,12 +729,12 @@ glDrawArrays (GLenum mode, GLint first, GLsizei count)
   const uint32_t rsx_primitive_type = rsxgl_check_draw_arrays(ctx,mode);
   RSXGL_FORWARD_ERROR_END();
 
-  if(count < 0) {
+  if(RSXGL_CHECK_ERRORS() && count < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
   if(rsx_primitive_type != ~0 && ctx -> state.enable.conditional_render_status != RSXGL_CONDITIONAL_RENDER_ACTIVE_WAIT_FAIL) {    
-    rsxgl_draw(ctx,arrays_element_range_policy(first,count),single_iteration_policy(),draw_arrays_policy(rsx_primitive_type,first,count));
+    rsxgl_draw(ctx,arrays_element_range_policy(first,count),single_iteration_policy(),draw_arrays_policy(ctx,rsx_primitive_type,first,count));
   }
 
   RSXGL_NOERROR_();
@@ -1112,7 +749,7 @@ glMultiDrawArrays (GLenum mode, const GLint *first, const GLsizei *count, const
   const uint32_t rsx_primitive_type = rsxgl_check_draw_arrays(ctx,mode);
   RSXGL_FORWARD_ERROR_END();
 
-  if(primcount < 0) {
+  if(RSXGL_CHECK_ERRORS() && primcount < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
@@ -1140,9 +777,10 @@ glMultiDrawArrays (GLenum mode, const GLint *first, const GLsizei *count, const
     struct draw_policy : public array_draw_policy, public multi_draw_policy {
       const GLint * first;
       const GLsizei * count;
+      const GLsizei primcount;
 
-      draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,const GLint * _first,const GLint * _count)
-	: array_draw_policy(_rsx_primitive_type), multi_draw_policy(_ctx), first(_first), count(_count) {
+      draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,const GLint * _first,const GLint * _count,GLsizei _primcount)
+	: array_draw_policy(_ctx,_rsx_primitive_type), multi_draw_policy(_ctx), first(_first), count(_count), primcount(_primcount) {
       }
 
       void begin(gcmContextData * context,uint32_t) const {}
@@ -1152,9 +790,15 @@ glMultiDrawArrays (GLenum mode, const GLint *first, const GLsizei *count, const
 	array_draw_policy::emitDrawCommands(gcm_context,first[i],count[i]);
 	multi_draw_policy::draw(gcm_context);
       }
+
+      void feedback(rsxgl_feedback_t & feedback) const {
+	for(GLsizei i = 0;i < primcount;++i) {
+	  feedback.arrays(rsx_primitive_type,first[i],count[i]);
+	}
+      }
     };
 
-    rsxgl_draw(ctx,element_range_policy(first,count,primcount),multi_iteration_policy(primcount),draw_policy(ctx,rsx_primitive_type,first,count));
+    rsxgl_draw(ctx,element_range_policy(first,count,primcount),multi_iteration_policy(primcount),draw_policy(ctx,rsx_primitive_type,first,count,primcount));
   }
 }
 
@@ -1179,6 +823,10 @@ namespace {
     void end(gcmContextData * gcm_context,uint32_t) const {
       element_draw_policy::end(gcm_context);
     }
+
+    void feedback(rsxgl_feedback_t & feedback) const {
+      feedback.elements(rsx_primitive_type,rsx_element_type,element_draw_policy::indexAddress(indices),count,0);
+    }
   };
 }
 
@@ -1193,15 +841,15 @@ glDrawElements (GLenum mode, GLsizei count, GLenum type, const GLvoid* indices)
   std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type);
   RSXGL_FORWARD_ERROR_END();
 
-  if(!(type == GL_UNSIGNED_BYTE || type == GL_UNSIGNED_SHORT || type == GL_UNSIGNED_INT)) {
+  if(RSXGL_CHECK_ERRORS() && !(type == GL_UNSIGNED_BYTE || type == GL_UNSIGNED_SHORT || type == GL_UNSIGNED_INT)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  if(count < 0) {
+  if(RSXGL_CHECK_ERRORS() && count < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(RSXGL_CHECK_ERRORS() && ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1222,15 +870,15 @@ glDrawRangeElements (GLenum mode, GLuint start, GLuint end, GLsizei count, GLenu
   std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type);
   RSXGL_FORWARD_ERROR_END();
 
-  if(count < 0) {
+  if(RSXGL_CHECK_ERRORS() && count < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(end < start) {
+  if(RSXGL_CHECK_ERRORS() && end < start) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(RSXGL_CHECK_ERRORS() && ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1265,6 +913,10 @@ namespace {
       element_draw_policy::end(gcm_context);
       base_element_draw_policy::end(gcm_context);
     }
+
+    void feedback(rsxgl_feedback_t & feedback) const {
+      feedback.elements(rsx_primitive_type,rsx_element_type,element_draw_policy::indexAddress(indices),count,basevertex);
+    }
   };
 }
 
@@ -1278,11 +930,11 @@ glDrawElementsBaseVertex (GLenum mode, GLsizei count, GLenum type, const GLvoid
   std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type);
   RSXGL_FORWARD_ERROR_END();
 
-  if(count < 0) {
+  if(RSXGL_CHECK_ERRORS() && count < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(RSXGL_CHECK_ERRORS() && ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1303,15 +955,15 @@ glDrawRangeElementsBaseVertex (GLenum mode, GLuint start, GLuint end, GLsizei co
   std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type);
   RSXGL_FORWARD_ERROR_END();
 
-  if(count < 0) {
+  if(RSXGL_CHECK_ERRORS() && count < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(end < start) {
+  if(RSXGL_CHECK_ERRORS() && end < start) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(RSXGL_CHECK_ERRORS() && ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1332,11 +984,11 @@ glMultiDrawElements (const GLenum mode, const GLsizei *count, GLenum type, const
   std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type);
   RSXGL_FORWARD_ERROR_END();
 
-  if(primcount < 0) {
+  if(RSXGL_CHECK_ERRORS() && primcount < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(RSXGL_CHECK_ERRORS() && ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1364,6 +1016,12 @@ glMultiDrawElements (const GLenum mode, const GLsizei *count, GLenum type, const
       void end(gcmContextData * gcm_context,uint32_t) const {
 	element_draw_policy::end(gcm_context);
       }
+
+      void feedback(rsxgl_feedback_t & feedback) const {
+	for(GLsizei i = 0;i < primcount;++i) {
+	  feedback.elements(rsx_primitive_type,rsx_element_type,element_draw_policy::indexAddress(indices[i]),count[i],0);
+	}
+      }
     };
 
     rsxgl_draw(ctx,ignore_element_range_policy(),multi_iteration_policy(primcount),draw_policy(ctx,rsx_primitive_type,rsx_element_type,count,indices,primcount));
@@ -1382,11 +1040,11 @@ glMultiDrawElementsBaseVertex (GLenum mode, const GLsizei *count, GLenum type, c
   std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type);
   RSXGL_FORWARD_ERROR_END();
 
-  if(primcount < 0) {
+  if(RSXGL_CHECK_ERRORS() && primcount < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(RSXGL_CHECK_ERRORS() && ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1416,6 +1074,12 @@ glMultiDrawElementsBaseVertex (GLenum mode, const GLsizei *count, GLenum type, c
 	element_draw_policy::end(gcm_context);
 	base_element_draw_policy::end(gcm_context);
       }
+
+      void feedback(rsxgl_feedback_t & feedback) const {
+	for(GLsizei i = 0;i < primcount;++i) {
+	  feedback.elements(rsx_primitive_type,rsx_element_type,element_draw_policy::indexAddress(indices[i]),count[i],basevertex[i]);
+	}
+      }
     };
 
     rsxgl_draw(ctx,ignore_element_range_policy(),multi_iteration_policy(primcount),draw_policy(ctx,rsx_primitive_type,rsx_element_type,count,indices,primcount,basevertex));
@@ -1434,21 +1098,21 @@ glDrawArraysInstanced (GLenum mode, GLint first, GLsizei count, GLsizei primcoun
   const uint32_t rsx_primitive_type = rsxgl_check_draw_arrays(ctx,mode);
   RSXGL_FORWARD_ERROR_END();
 
-  if(count < 0) {
+  if(RSXGL_CHECK_ERRORS() && count < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(primcount < 0) {
+  if(RSXGL_CHECK_ERRORS() && primcount < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
   if(rsx_primitive_type != ~0 && ctx -> state.enable.conditional_render_status != RSXGL_CONDITIONAL_RENDER_ACTIVE_WAIT_FAIL) {
     struct draw_policy : public array_draw_policy, public instanced_draw_policy {
       const GLint first;
-      const GLsizei count;
+      const GLsizei count, primcount;
 
-      draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,const GLsizei _first,const GLsizei _count)
-	: array_draw_policy(_rsx_primitive_type), instanced_draw_policy(_ctx), first(_first), count(_count) {}
+      draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,const GLsizei _first,const GLsizei _count,const GLsizei _primcount)
+	: array_draw_policy(_ctx,_rsx_primitive_type), instanced_draw_policy(_ctx), first(_first), count(_count), primcount(_primcount) {}
 
       void begin(gcmContextData * gcm_context,uint32_t) const {
 	instanced_draw_policy::beginInstance(gcm_context,array_draw_policy::countDrawCommands(count));
@@ -1461,13 +1125,25 @@ glDrawArraysInstanced (GLenum mode, GLint first, GLsizei count, GLsizei primcoun
       }
 
       void end(gcmContextData * gcm_context,uint32_t) const {}
+
+      void feedback(rsxgl_feedback_t & feedback) const {
+	for(GLsizei i = 0;i < primcount;++i) {
+	  feedback.instance(i);
+	  feedback.arrays(rsx_primitive_type,first,count);
+	}
+      }
     };
     
     if(ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].instanceid_index != ~0 && primcount > 1) {
-      rsxgl_draw(ctx,ignore_element_range_policy(),multi_iteration_policy(primcount),draw_policy(ctx,rsx_primitive_type,first,count));
+      // Instances are drawn by a "call" command, and those can't be nested inside of a command list:
+      if(ctx -> command_list_recorder != 0) {
+	RSXGL_ERROR_(GL_INVALID_OPERATION);
+      }
+
+      rsxgl_draw(ctx,ignore_element_range_policy(),multi_iteration_policy(primcount),draw_policy(ctx,rsx_primitive_type,first,count,primcount));
     }
     else {
-      rsxgl_draw(ctx,arrays_element_range_policy(first,count),single_iteration_policy(),draw_arrays_policy(rsx_primitive_type,first,count));
+      rsxgl_draw(ctx,arrays_element_range_policy(first,count),single_iteration_policy(),draw_arrays_policy(ctx,rsx_primitive_type,first,count));
     }
   }
 
@@ -1484,11 +1160,11 @@ glDrawElementsInstanced (const GLenum mode, const GLsizei count, const GLenum ty
   std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type);
   RSXGL_FORWARD_ERROR_END();
 
-  if(count < 0) {
+  if(RSXGL_CHECK_ERRORS() && count < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
   
-  if(primcount < 0) {
+  if(RSXGL_CHECK_ERRORS() && primcount < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
@@ -1496,11 +1172,12 @@ glDrawElementsInstanced (const GLenum mode, const GLsizei count, const GLenum ty
     struct draw_policy : public element_draw_policy, public instanced_draw_policy {
       const GLsizei count;
       const GLvoid * indices;
+      const GLsizei primcount;
 
       mutable uint32_t offset;
 
-      draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type,const GLsizei _count,const GLvoid * _indices)
-	: element_draw_policy(_ctx,_rsx_primitive_type,_rsx_element_type), instanced_draw_policy(_ctx), count(_count), indices(_indices) {}
+      draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type,const GLsizei _count,const GLvoid * _indices,const GLsizei _primcount)
+	: element_draw_policy(_ctx,_rsx_primitive_type,_rsx_element_type), instanced_draw_policy(_ctx), count(_count), indices(_indices), primcount(_primcount) {}
 
       void begin(gcmContextData * gcm_context,uint32_t timestamp) const {
 	element_draw_policy::begin(gcm_context,timestamp,&count,&indices,1,&offset);
@@ -1518,10 +1195,22 @@ glDrawElementsInstanced (const GLenum mode, const GLsizei count, const GLenum ty
       void end(gcmContextData * gcm_context,uint32_t) const {
 	element_draw_policy::end(gcm_context);
       }
+
+      void feedback(rsxgl_feedback_t & feedback) const {
+	for(GLsizei i = 0;i < primcount;++i) {
+	  feedback.instance(i);
+	  feedback.elements(rsx_primitive_type,rsx_element_type,element_draw_policy::indexAddress(indices),count,0);
+	}
+      }
     };
 
     if(ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].instanceid_index != ~0 && primcount > 1) {
-      rsxgl_draw(ctx,ignore_element_range_policy(),multi_iteration_policy(primcount),draw_policy(ctx,rsx_primitive_type,rsx_element_type,count,indices));
+      // Instances are drawn by a "call" command, and those can't be nested inside of a command list:
+      if(ctx -> command_list_recorder != 0) {
+	RSXGL_ERROR_(GL_INVALID_OPERATION);
+      }
+
+      rsxgl_draw(ctx,ignore_element_range_policy(),multi_iteration_policy(primcount),draw_policy(ctx,rsx_primitive_type,rsx_element_type,count,indices,primcount));
     }
     else {
       rsxgl_draw(ctx,ignore_element_range_policy(),single_iteration_policy(),draw_elements_policy(ctx,rsx_primitive_type,rsx_element_type,count,indices));
@@ -1541,11 +1230,11 @@ glDrawElementsInstancedBaseVertex (GLenum mode, GLsizei count, GLenum type, cons
   std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type);
   RSXGL_FORWARD_ERROR_END();
 
-  if(count < 0) {
+  if(RSXGL_CHECK_ERRORS() && count < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(primcount < 0) {
+  if(RSXGL_CHECK_ERRORS() && primcount < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
@@ -1554,11 +1243,12 @@ glDrawElementsInstancedBaseVertex (GLenum mode, GLsizei count, GLenum type, cons
       const GLsizei count;
       const GLvoid * indices;
       const GLint basevertex;
+      const GLsizei primcount;
 
       mutable uint32_t offset;
 
-      draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type,GLsizei _count,const GLvoid * _indices,GLint _basevertex)
-	: element_draw_policy(_ctx,_rsx_primitive_type,_rsx_element_type), instanced_draw_policy(_ctx), count(_count), indices(_indices), basevertex(_basevertex) {}
+      draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type,GLsizei _count,const GLvoid * _indices,GLint _basevertex,GLsizei _primcount)
+	: element_draw_policy(_ctx,_rsx_primitive_type,_rsx_element_type), instanced_draw_policy(_ctx), count(_count), indices(_indices), basevertex(_basevertex), primcount(_primcount) {}
 
       void begin(gcmContextData * gcm_context,uint32_t timestamp) const {
 	element_draw_policy::begin(gcm_context,timestamp,&count,&indices,1,&offset);
@@ -1576,11 +1266,24 @@ glDrawElementsInstancedBaseVertex (GLenum mode, GLsizei count, GLenum type, cons
 
       void end(gcmContextData * gcm_context,uint32_t) const {
 	element_draw_policy::end(gcm_context);
+	base_element_draw_policy::end(gcm_context);
+      }
+
+      void feedback(rsxgl_feedback_t & feedback) const {
+	for(GLsizei i = 0;i < primcount;++i) {
+	  feedback.instance(i);
+	  feedback.elements(rsx_primitive_type,rsx_element_type,element_draw_policy::indexAddress(indices),count,basevertex);
+	}
       }
     };
 
     if(ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].instanceid_index != ~0 && primcount > 1) {
-      rsxgl_draw(ctx,ignore_element_range_policy(),multi_iteration_policy(primcount),draw_policy(ctx,rsx_primitive_type,rsx_element_type,count,indices,basevertex));
+      // Instances are drawn by a "call" command, and those can't be nested inside of a command list:
+      if(ctx -> command_list_recorder != 0) {
+	RSXGL_ERROR_(GL_INVALID_OPERATION);
+      }
+
+      rsxgl_draw(ctx,ignore_element_range_policy(),multi_iteration_policy(primcount),draw_policy(ctx,rsx_primitive_type,rsx_element_type,count,indices,basevertex,primcount));
     }
     else {
       rsxgl_draw(ctx,ignore_element_range_policy(),single_iteration_policy(),draw_elements_base_policy(ctx,rsx_primitive_type,rsx_element_type,count,indices,basevertex));
@@ -1623,6 +1326,7 @@ glBeginTransformFeedback (GLenum primitiveMode)
   }
 
   ctx -> state.enable.transform_feedback_mode = rsx_primitive_type;
+  ctx -> transform_feedback_offset = 0;
 
   RSXGL_NOERROR_();
 }
@@ -0,0 +1,578 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// draw_batch.h - Split draw calls into the vertex & index batches accepted by the RSX.
+
+#ifndef rsxgl_draw_batch_H
+#define rsxgl_draw_batch_H
+
+#include "gl_fifo.h"
+#include "nv40.h"
+#include "rsxgl_limits.h"
+
+#include <stdint.h>
+#include <boost/integer/static_log2.hpp>
+
+// This function is designed to split an iteration into groups (RSX method invocations) & batches
+// as required by the hardware. max_method_args is the total number of arguments accepted by a
+// single "method" - this should pretty much be set to 2047. batch_size can vary depending upon
+// the purpose that this function is put to. Drawing vertices & indices that have been loaded
+// into arrays on the GPU, for instance, are split into batches of 256 indices; sending indices
+// from client memory, over the fifo, would have a batch_size of 1.
+struct rsxgl_process_batch_work_t {
+  uint32_t nvertices, nbatch, nbatchremainder;
+
+  rsxgl_process_batch_work_t(const uint32_t _nvertices, const uint32_t _nbatch, const uint32_t _nbatchremainder)
+    : nvertices(_nvertices), nbatch(_nbatch), nbatchremainder(_nbatchremainder) {
+  }
+};
+
+template< typename Operations >
+uint32_t rsxgl_count_batch(const uint32_t max_method_args,const uint32_t n)
+{
+  const rsxgl_process_batch_work_t info = Operations::work_info(n);
+  const uint32_t ninvoc = info.nbatch / max_method_args;
+  const uint32_t ninvocremainder = info.nbatch % max_method_args;
+
+  return Operations::count(max_method_args,ninvoc,ninvocremainder,info.nbatchremainder);
+}
+
+template< typename Operations >
+void rsxgl_process_batch(gcmContextData * context,const uint32_t max_method_args,const uint32_t n,const Operations & operations)
+{
+  const rsxgl_process_batch_work_t info = Operations::work_info(n);
+
+  uint32_t ninvoc = info.nbatch / max_method_args;
+  const uint32_t ninvocremainder = info.nbatch % max_method_args;
+
+  operations.begin(context,max_method_args,ninvoc,ninvocremainder,info.nbatchremainder);
+
+  if(info.nbatchremainder > 0) {
+    operations.begin_group(1);
+    operations.n_batch(0,info.nbatchremainder);
+    operations.end_group(1);
+  }
+
+  // Primitives that repeat their first vertex (triangle fans, polygons) restart the primitive
+  // for every batch, so each batch gets its own method invocation:
+  if(Operations::repeat_first) {
+    for(uint32_t i = 0,n = info.nbatch;i < n;++i) {
+      operations.begin_repeat_first();
+      operations.begin_group(1);
+      operations.full_batch(0);
+      operations.end_group(1);
+    }
+  }
+  else {
+    for(;ninvoc > 0;--ninvoc) {
+      operations.begin_group(max_method_args);
+      for(size_t i = 0;i < max_method_args;++i) {
+	operations.full_batch(i);
+      }
+      operations.end_group(max_method_args);
+    }
+    
+    if(ninvocremainder > 0) {
+      operations.begin_group(ninvocremainder);
+      for(size_t i = 0;i < ninvocremainder;++i) {
+	operations.full_batch(i);
+      }
+      operations.end_group(ninvocremainder);
+    }
+  }
+
+  operations.end();
+}
+
+// You are supposed to be able to pass up to 2047 bundles of 256 batches of
+// vertices to each NV30_3D_VB_VERTEX_BATCH method. Testing revealed that this number
+// is apparently the much lower number of 3, and for a decent-sized mesh, it really
+// ought to be one so that cache invalidation instructions can be submitted for each
+// batch.
+//
+// That conservative setting remains the default. The vertex cache is only ever invalidated
+// once, before the first batch, so glEnable(GL_DRAW_BATCH_BULK_RSX) can select the "bulk"
+// setting at runtime, which packs as many batches into each method as testing found to work.
+#define RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS 1
+#define RSXGL_VERTEX_BATCH_BULK_MAX_FIFO_METHOD_ARGS 3
+
+template< uint32_t max_batch_size >
+struct rsxgl_draw_points {
+  static const uint32_t batch_size_bits = boost::static_log2< max_batch_size >::value;
+  
+  struct traits {
+    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_POINTS;
+    static const uint32_t batch_size = max_batch_size;
+
+    // - repeat_offset is the amount to subtract from the start vertex index for each batch, due to 
+    //   a primitive being split across the batch_size boundary (line strip, line loop, triangle strip, triangle fan, quad strip, polygon)
+    // - repeat_first says that each batch iteration will begin by repeating the first vertex in the primitive (triangle fan, polygon need this)
+    // - close_first says that the first vertex of the primitive will be repeated at the end of the entire iteration (line_loop needs this)
+    static const uint32_t repeat_offset = 0;
+    static const bool repeat_first = false, close_first = false;
+
+    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
+      return rsxgl_process_batch_work_t(count,count >> batch_size_bits,count & (batch_size - 1));
+    }
+  };
+};
+
+template< uint32_t max_batch_size >
+struct rsxgl_draw_lines {
+  static const uint32_t batch_size_bits = boost::static_log2< max_batch_size >::value;
+  
+  struct traits {
+    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_LINES;
+    static const uint32_t batch_size = max_batch_size & ~1;
+
+    static const uint32_t repeat_offset = 0;
+    static const bool repeat_first = false, close_first = false;
+
+    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
+      const uint32_t _count = count & ~1;
+      return rsxgl_process_batch_work_t(_count,_count >> batch_size_bits,_count & (batch_size - 1));
+    }
+  };
+};
+
+template< uint32_t max_batch_size >
+struct rsxgl_draw_line_strip {
+  struct traits {
+    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_LINE_STRIP;
+    // batch_size had better be pot:
+    static const uint32_t batch_size = max_batch_size;
+    static const uint32_t batch_size_bits = boost::static_log2< max_batch_size >::value;
+
+    static const uint32_t repeat_offset = 1;
+    static const bool repeat_first = false, close_first = false;
+
+    static const uint32_t batch_size_minus_repeat = batch_size - repeat_offset;
+
+    // actual number of vertices, nbatch, natch remainder:
+    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
+      uint32_t _count = count;
+
+      if(_count > batch_size) {
+	const uint32_t tmp = _count - batch_size;
+	_count = _count + (tmp / batch_size_minus_repeat * repeat_offset) + ((tmp % batch_size_minus_repeat) ? repeat_offset : 0);
+      }
+
+      return rsxgl_process_batch_work_t(batch_size,_count >> batch_size_bits,_count & (batch_size - 1));      
+    }
+  };
+};
+
+template< uint32_t max_batch_size >
+struct rsxgl_draw_triangles {
+  struct traits {
+    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_TRIANGLES;
+    static const uint32_t batch_size = max_batch_size - (max_batch_size % 3);
+
+    static const uint32_t repeat_offset = 0;
+    static const bool repeat_first = false, close_first = false;
+
+    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
+      const uint32_t count_for_triangles = count - (count % 3);
+      return rsxgl_process_batch_work_t(count_for_triangles,count_for_triangles / batch_size,count_for_triangles % batch_size);
+    }
+  };
+};
+
+template< uint32_t max_batch_size >
+struct rsxgl_draw_triangle_strip {
+  struct traits {
+    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP;
+    // batch_size had better be pot:
+    static const uint32_t batch_size = max_batch_size;
+    static const uint32_t batch_size_bits = boost::static_log2< max_batch_size >::value;
+
+    static const uint32_t repeat_offset = 2;
+    static const bool repeat_first = false, close_first = false;
+
+    static const uint32_t batch_size_minus_repeat = batch_size - repeat_offset;
+
+    // actual number of vertices, nbatch, natch remainder:
+    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
+      uint32_t _count = count;
+
+      if(_count > batch_size) {
+	const uint32_t tmp = _count - batch_size;
+	_count = _count + (tmp / batch_size_minus_repeat * repeat_offset) + ((tmp % batch_size_minus_repeat) ? repeat_offset : 0);
+      }
+
+      return rsxgl_process_batch_work_t(batch_size,_count >> batch_size_bits,_count & (batch_size - 1));      
+    }
+  };
+};
+
+// Line loops that fit within a single batch are drawn natively. Longer loops are drawn as a
+// line strip, split like rsxgl_draw_line_strip, and closed by a separate line segment that
+// joins the last vertex back to the first one.
+template< uint32_t max_batch_size >
+struct rsxgl_draw_line_loop {
+  struct traits {
+    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_LINE_LOOP;
+    // batch_size had better be pot:
+    static const uint32_t batch_size = max_batch_size;
+    static const uint32_t batch_size_bits = boost::static_log2< max_batch_size >::value;
+
+    static const uint32_t repeat_offset = 1;
+    static const bool repeat_first = false, close_first = true;
+
+    static const uint32_t batch_size_minus_repeat = batch_size - repeat_offset;
+
+    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
+      uint32_t _count = (count < 2) ? 0 : count;
+
+      if(_count > batch_size) {
+	const uint32_t tmp = _count - batch_size;
+	_count = _count + (tmp / batch_size_minus_repeat * repeat_offset) + ((tmp % batch_size_minus_repeat) ? repeat_offset : 0);
+      }
+
+      return rsxgl_process_batch_work_t(_count,_count >> batch_size_bits,_count & (batch_size - 1));
+    }
+  };
+};
+
+// Triangle fans (and polygons, which are convex & can be treated the same way) are split so that the
+// first batch is drawn normally, and every batch after it draws the first vertex of the primitive followed
+// by batch_size - 1 vertices, the first of which repeats the last vertex of the previous batch. Each batch
+// thus contributes batch_size - 2 new vertices.
+template< uint32_t max_batch_size, uint32_t _rsx_primitive_type >
+struct rsxgl_draw_fan_traits {
+  static const uint32_t rsx_primitive_type = _rsx_primitive_type;
+  static const uint32_t batch_size = max_batch_size;
+  
+  static const uint32_t repeat_offset = 1;
+  static const bool repeat_first = true, close_first = false;
+  
+  static const uint32_t batch_size_minus_repeat = batch_size - 2;
+  
+  // nbatchremainder is the size of the first batch, which includes the fan's first vertex;
+  // it is always at least 3, so that it forms a triangle:
+  static rsxgl_process_batch_work_t work_info(const uint32_t count) {
+    if(count < 3) {
+      return rsxgl_process_batch_work_t(0,0,0);
+    }
+    
+    const uint32_t nbatch = (count - 3) / batch_size_minus_repeat;
+    return rsxgl_process_batch_work_t(count,nbatch,count - (nbatch * batch_size_minus_repeat));
+  }
+};
+
+template< uint32_t max_batch_size >
+struct rsxgl_draw_triangle_fan {
+  typedef rsxgl_draw_fan_traits< max_batch_size, NV30_3D_VERTEX_BEGIN_END_TRIANGLE_FAN > traits;
+};
+
+template< uint32_t max_batch_size >
+struct rsxgl_draw_polygon {
+  typedef rsxgl_draw_fan_traits< max_batch_size, NV30_3D_VERTEX_BEGIN_END_POLYGON > traits;
+};
+
+template< uint32_t max_batch_size >
+struct rsxgl_draw_quads {
+  struct traits {
+    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_QUADS;
+    static const uint32_t batch_size = max_batch_size & ~3;
+
+    static const uint32_t repeat_offset = 0;
+    static const bool repeat_first = false, close_first = false;
+
+    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
+      const uint32_t count_for_quads = count & ~3;
+      return rsxgl_process_batch_work_t(count_for_quads,count_for_quads / batch_size,count_for_quads % batch_size);
+    }
+  };
+};
+
+template< uint32_t max_batch_size >
+struct rsxgl_draw_quad_strip {
+  struct traits {
+    static const uint32_t rsx_primitive_type = NV30_3D_VERTEX_BEGIN_END_QUAD_STRIP;
+    // batch_size had better be pot:
+    static const uint32_t batch_size = max_batch_size;
+    static const uint32_t batch_size_bits = boost::static_log2< max_batch_size >::value;
+
+    // Repeating an even number of vertices keeps the vertex pairs that make up each quad intact:
+    static const uint32_t repeat_offset = 2;
+    static const bool repeat_first = false, close_first = false;
+
+    static const uint32_t batch_size_minus_repeat = batch_size - repeat_offset;
+
+    static rsxgl_process_batch_work_t work_info(const uint32_t count) {
+      uint32_t _count = (count < 4) ? 0 : (count & ~1);
+
+      if(_count > batch_size) {
+	const uint32_t tmp = _count - batch_size;
+	_count = _count + (tmp / batch_size_minus_repeat * repeat_offset) + ((tmp % batch_size_minus_repeat) ? repeat_offset : 0);
+      }
+
+      return rsxgl_process_batch_work_t(_count,_count >> batch_size_bits,_count & (batch_size - 1));
+    }
+  };
+};
+
+template< uint32_t max_batch_size, template< uint32_t > class primitive_traits >
+struct rsxgl_draw_array_operations {
+  typedef typename primitive_traits< max_batch_size >::traits primitive_traits_type;
+  static const uint32_t rsx_primitive_type = primitive_traits_type::rsx_primitive_type;
+  static const uint32_t batch_size = primitive_traits_type::batch_size;
+  static const uint32_t repeat_offset = primitive_traits_type::repeat_offset;
+  static const bool repeat_first = primitive_traits_type::repeat_first;
+  static const bool close_first = primitive_traits_type::close_first;
+  
+  mutable uint32_t * buffer;
+  mutable uint32_t first, current;
+  mutable bool split;
+  
+  rsxgl_draw_array_operations(const uint32_t first)
+    : buffer(0), first(first), current(0), split(false) {
+  }
+
+  static inline rsxgl_process_batch_work_t
+  work_info(const uint32_t count) {
+    return primitive_traits_type::work_info(count);
+  }
+
+  static inline uint32_t
+  count(const uint32_t max_method_args,const uint32_t ninvoc,const uint32_t ninvocremainder,const uint32_t nbatchremainder) {
+    const uint32_t nbatch = (ninvoc * max_method_args) + ninvocremainder;
+    uint32_t nwords = (nbatchremainder ? 2 : 0) + 4 + 6;
+
+    if(repeat_first) {
+      nwords += nbatch * (6 + 2);
+    }
+    else {
+      nwords += ninvoc + (ninvocremainder ? 1 : 0) + nbatch;
+    }
+
+    if(close_first && (nbatch + (nbatchremainder ? 1 : 0)) > 1) {
+      nwords += 4 + 3;
+    }
+
+    return nwords;
+  }
+  
+  // max_method_args - number of batches passed to each full draw method invocation
+  // ninvoc - number of full draw method invocations (max_method_args * 256 vertices)
+  // ninvocremainder - number of vertex batches for an additional draw method invocation (ninvocremainder * 256 vertices)
+  // nbatchremainder - size of one additional vertex batch (nbatchremainder vertices)
+  inline void
+  begin(gcmContextData * context,const uint32_t max_method_args,const uint32_t ninvoc,const uint32_t ninvocremainder,const uint32_t nbatchremainder) const {
+    buffer = gcm_reserve(context,count(max_method_args,ninvoc,ninvocremainder,nbatchremainder));
+
+    current = 0;
+    split = close_first && ((ninvoc * max_method_args) + ninvocremainder + (nbatchremainder ? 1 : 0)) > 1;
+
+    gcm_emit_method_at(buffer,0,NV40_3D_VTX_CACHE_INVALIDATE,1);
+    gcm_emit_at(buffer,1,0);
+    
+    gcm_emit_method_at(buffer,2,NV40_3D_VTX_CACHE_INVALIDATE,1);
+    gcm_emit_at(buffer,3,0);
+    
+    gcm_emit_method_at(buffer,4,NV40_3D_VTX_CACHE_INVALIDATE,1);
+    gcm_emit_at(buffer,5,0);
+    
+    // A line loop that was split across batches is drawn as a line strip, & closed by end():
+    gcm_emit_method_at(buffer,6,NV30_3D_VERTEX_BEGIN_END,1);
+    gcm_emit_at(buffer,7,split ? NV30_3D_VERTEX_BEGIN_END_LINE_STRIP : rsx_primitive_type);
+
+    buffer += 8;
+  }
+
+  // Restart the primitive, and begin it with the first vertex of the iteration:
+  inline void
+  begin_repeat_first() const {
+    gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
+    gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
+
+    gcm_emit_method_at(buffer,2,NV30_3D_VERTEX_BEGIN_END,1);
+    gcm_emit_at(buffer,3,rsx_primitive_type);
+
+    gcm_emit_method_at(buffer,4,NV30_3D_VB_VERTEX_BATCH,1);
+    gcm_emit_at(buffer,5,(0 << NV30_3D_VB_VERTEX_BATCH_COUNT__SHIFT) | first);
+
+    buffer += 6;
+  }
+  
+  // n is number of arguments to this method:
+  inline void
+  begin_group(const uint32_t n) const {
+    gcm_emit_method_at(buffer,0,NV30_3D_VB_VERTEX_BATCH,n);
+    ++buffer;
+  }
+  
+  // n is the size of this batch (the number of vertices in this batch):
+  inline void
+  n_batch(const uint32_t igroup,const uint32_t n) const {
+    gcm_emit_at(buffer,igroup,((n - 1) << NV30_3D_VB_VERTEX_BATCH_COUNT__SHIFT) | first + current);
+    current += n - repeat_offset;
+  }
+
+  // here the size of the batch is assumed to be primitive_traits::batch_size,
+  // which oughta be a constant (less one vertex if begin_repeat_first() already supplied it):
+  inline void
+  full_batch(const uint32_t igroup) const {
+    const uint32_t n = batch_size - (repeat_first ? 1 : 0);
+    gcm_emit_at(buffer,igroup,((n - 1) << NV30_3D_VB_VERTEX_BATCH_COUNT__SHIFT) | first + current);
+    current += n - repeat_offset;
+  }
+  
+  inline void
+  end_group(const uint32_t n) const {
+    buffer += n;
+  }
+  
+  inline void
+  end() const {
+    // Close a split line loop with a segment from its last vertex (first + current, since
+    // repeat_offset is 1) back to its first vertex:
+    if(split) {
+      gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
+      gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
+
+      gcm_emit_method_at(buffer,2,NV30_3D_VERTEX_BEGIN_END,1);
+      gcm_emit_at(buffer,3,NV30_3D_VERTEX_BEGIN_END_LINES);
+
+      gcm_emit_method_at(buffer,4,NV30_3D_VB_VERTEX_BATCH,2);
+      gcm_emit_at(buffer,5,(0 << NV30_3D_VB_VERTEX_BATCH_COUNT__SHIFT) | first + current);
+      gcm_emit_at(buffer,6,(0 << NV30_3D_VB_VERTEX_BATCH_COUNT__SHIFT) | first);
+
+      buffer += 7;
+    }
+
+    gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
+    gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
+    
+    buffer += 2;
+  }
+};
+
+#define RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS 1
+#define RSXGL_INDEX_BATCH_BULK_MAX_FIFO_METHOD_ARGS 3
+
+// Operations performed by rsxgl_process_batch (a local class passed as a template argument is a C++0x feature):
+template< uint32_t max_batch_size, template< uint32_t > class primitive_traits >
+struct rsxgl_draw_array_elements_operations {
+  typedef typename primitive_traits< max_batch_size >::traits primitive_traits_type;
+  static const uint32_t rsx_primitive_type = primitive_traits_type::rsx_primitive_type;
+  static const uint32_t batch_size = primitive_traits_type::batch_size;
+  static const uint32_t repeat_offset = primitive_traits_type::repeat_offset;
+  static const bool repeat_first = primitive_traits_type::repeat_first;
+  static const bool close_first = primitive_traits_type::close_first;
+  
+  mutable uint32_t * buffer;
+  mutable uint32_t current;
+  mutable bool split;
+  
+  rsxgl_draw_array_elements_operations()
+    : buffer(0), current(0), split(false) {
+  }
+
+  static inline rsxgl_process_batch_work_t
+  work_info(const uint32_t count) {
+    return primitive_traits_type::work_info(count);
+  }
+
+  static inline uint32_t
+  count(const uint32_t max_method_args,const uint32_t ninvoc,const uint32_t ninvocremainder,const uint32_t nbatchremainder) {
+    const uint32_t nbatch = (ninvoc * max_method_args) + ninvocremainder;
+    uint32_t nwords = (nbatchremainder ? 2 : 0) + 4;
+
+    if(repeat_first) {
+      nwords += nbatch * (6 + 2);
+    }
+    else {
+      nwords += ninvoc + (ninvocremainder ? 1 : 0) + nbatch;
+    }
+
+    if(close_first && (nbatch + (nbatchremainder ? 1 : 0)) > 1) {
+      nwords += 4 + 3;
+    }
+
+    return nwords;
+  }
+  
+  inline void
+  begin(gcmContextData * context,const uint32_t max_method_args,const uint32_t ninvoc,const uint32_t ninvocremainder,const uint32_t nbatchremainder) const {
+    buffer = gcm_reserve(context,count(max_method_args,ninvoc,ninvocremainder,nbatchremainder));
+
+    split = close_first && ((ninvoc * max_method_args) + ninvocremainder + (nbatchremainder ? 1 : 0)) > 1;
+
+    gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
+    gcm_emit_at(buffer,1,split ? NV30_3D_VERTEX_BEGIN_END_LINE_STRIP : rsx_primitive_type);
+
+    buffer += 2;
+  }
+
+  // Restart the primitive, and begin it with the first index of the iteration:
+  inline void
+  begin_repeat_first() const {
+    gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
+    gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
+
+    gcm_emit_method_at(buffer,2,NV30_3D_VERTEX_BEGIN_END,1);
+    gcm_emit_at(buffer,3,rsx_primitive_type);
+
+    gcm_emit_method_at(buffer,4,NV30_3D_VB_INDEX_BATCH,1);
+    gcm_emit_at(buffer,5,(0 << NV30_3D_VB_INDEX_BATCH_COUNT__SHIFT) | 0);
+
+    buffer += 6;
+  }
+  
+  // n is number of arguments to this method:
+  inline void
+  begin_group(const uint32_t n) const {
+    gcm_emit_method_at(buffer,0,NV30_3D_VB_INDEX_BATCH,n);
+    ++buffer;
+  }
+
+  // n is the size of this batch:
+  inline void
+  n_batch(const uint32_t igroup,const uint32_t n) const {
+    gcm_emit_at(buffer,igroup,((n - 1) << NV30_3D_VB_INDEX_BATCH_COUNT__SHIFT) | current);
+    current += n - repeat_offset;
+  }
+  
+  // here the size of the batch is assumed to be primitive_traits::batch_size,
+  // which oughta be a constant (less one index if begin_repeat_first() already supplied it):
+  inline void
+  full_batch(const uint32_t igroup) const {
+    const uint32_t n = batch_size - (repeat_first ? 1 : 0);
+    gcm_emit_at(buffer,igroup,((n - 1) << NV30_3D_VB_INDEX_BATCH_COUNT__SHIFT) | current);
+    current += n - repeat_offset;
+  }
+  
+  inline void
+  end_group(const uint32_t n) const {
+    buffer += n;
+  }
+  
+  inline void
+  end() const {
+    // Close a split line loop:
+    if(split) {
+      gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
+      gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
+
+      gcm_emit_method_at(buffer,2,NV30_3D_VERTEX_BEGIN_END,1);
+      gcm_emit_at(buffer,3,NV30_3D_VERTEX_BEGIN_END_LINES);
+
+      gcm_emit_method_at(buffer,4,NV30_3D_VB_INDEX_BATCH,2);
+      gcm_emit_at(buffer,5,(0 << NV30_3D_VB_INDEX_BATCH_COUNT__SHIFT) | current);
+      gcm_emit_at(buffer,6,(0 << NV30_3D_VB_INDEX_BATCH_COUNT__SHIFT) | 0);
+
+      buffer += 7;
+    }
+
+    gcm_emit_method_at(buffer,0,NV30_3D_VERTEX_BEGIN_END,1);
+    gcm_emit_at(buffer,1,NV30_3D_VERTEX_BEGIN_END_STOP);
+    
+    buffer += 2;
+  }
+};
+
+#endif
@@ -0,0 +1,199 @@
+// "Unit testing" for the batch splitting performed by draw_batch.h. Meant to be built & run on
+// the host, e.g.:
+//
+// g++ -std=c++11 -I../../extsrc/boost draw_batch_unit_tests.cc -o draw_batch_unit_tests
+//
+// Each primitive type is drawn with a range of vertex counts, using both the conservative
+// (RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS) and "bulk" (GL_DRAW_BATCH_BULK_RSX) settings. The
+// emitted command streams are decoded into the primitives & vertices that the RSX would see;
+// these need to be identical for both settings, and each stream needs to be exactly as long as
+// rsxgl_count_batch() predicted (instanced draws rely upon this).
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <vector>
+
+#include <stdint.h>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+
+// Stand-ins for the parts of gl_fifo.h that draw_batch.h uses; the real header depends upon PSL1GHT:
+#define gl_fifo_H
+
+struct gcmContextData {
+  uint32_t * begin, * end, * current;
+};
+
+static inline uint32_t *
+gcm_reserve(gcmContextData * context,const uint32_t length)
+{
+  assert((context -> current + length) <= context -> end);
+  return context -> current;
+}
+
+static inline void
+gcm_emit_at(uint32_t * buffer,const uint32_t location,const uint32_t word)
+{
+  buffer[location] = word;
+}
+
+static inline void
+gcm_emit_method_at(uint32_t * buffer,const uint32_t location,const uint32_t method,const uint32_t n)
+{
+  gcm_emit_at(buffer,location,method | (n << 18));
+}
+
+#include "draw_batch.h"
+
+// A primitive as seen by the RSX - its type, and the vertex (or index) numbers that make it up:
+struct primitive {
+  uint32_t type;
+  std::vector< uint32_t > vertices;
+
+  bool operator ==(const primitive & rhs) const {
+    return type == rhs.type && vertices == rhs.vertices;
+  }
+};
+
+typedef std::vector< primitive > primitives;
+
+static primitives
+decode(const uint32_t * commands,const uint32_t n,const uint32_t batch_method)
+{
+  primitives result;
+
+  for(const uint32_t * p = commands, * p_end = commands + n;p < p_end;) {
+    const uint32_t method = *p & 0xffff, nargs = (*p >> 18) & 0x7ff;
+    ++p;
+    assert(nargs > 0 && nargs <= RSXGL_MAX_FIFO_METHOD_ARGS);
+
+    for(uint32_t i = 0;i < nargs;++i,++p) {
+      if(method == NV30_3D_VERTEX_BEGIN_END) {
+	if(*p != NV30_3D_VERTEX_BEGIN_END_STOP) {
+	  result.push_back(primitive());
+	  result.back().type = *p;
+	}
+      }
+      else if(method == batch_method) {
+	assert(!result.empty());
+	const uint32_t count = (*p >> 24) + 1, start = *p & 0x00ffffff;
+	for(uint32_t j = 0;j < count;++j) {
+	  result.back().vertices.push_back(start + j);
+	}
+      }
+    }
+  }
+
+  return result;
+}
+
+template< typename Operations >
+static uint32_t
+draw(const Operations & op,const uint32_t max_method_args,const uint32_t count,std::vector< uint32_t > & commands)
+{
+  commands.resize(rsxgl_count_batch< Operations >(max_method_args,count) + 1);
+
+  gcmContextData context;
+  context.begin = &commands[0];
+  context.end = context.begin + commands.size();
+  context.current = context.begin;
+
+  rsxgl_process_batch(&context,max_method_args,count,op);
+
+  const uint32_t n = op.buffer - context.begin;
+  assert(n == rsxgl_count_batch< Operations >(max_method_args,count));
+  return n;
+}
+
+static uint32_t total_words = 0, total_bulk_words = 0;
+
+template< template< uint32_t > class primitive_traits >
+static void
+compare(const std::string & name,const uint32_t first,const uint32_t count)
+{
+  std::vector< uint32_t > commands, bulk_commands;
+
+  // glDrawArrays:
+  {
+    typedef rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, primitive_traits > operations_type;
+
+    const uint32_t n = draw(operations_type(first),RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS,count,commands);
+    const uint32_t bulk_n = draw(operations_type(first),RSXGL_VERTEX_BATCH_BULK_MAX_FIFO_METHOD_ARGS,count,bulk_commands);
+
+    const primitives p = decode(&commands[0],n,NV30_3D_VB_VERTEX_BATCH), bulk_p = decode(&bulk_commands[0],bulk_n,NV30_3D_VB_VERTEX_BATCH);
+    assert(p == bulk_p);
+    assert(bulk_n <= n);
+
+    total_words += n;
+    total_bulk_words += bulk_n;
+  }
+
+  // glDrawElements:
+  {
+    typedef rsxgl_draw_array_elements_operations< RSXGL_MAX_DRAW_BATCH_SIZE, primitive_traits > operations_type;
+
+    const uint32_t n = draw(operations_type(),RSXGL_INDEX_BATCH_MAX_FIFO_METHOD_ARGS,count,commands);
+    const uint32_t bulk_n = draw(operations_type(),RSXGL_INDEX_BATCH_BULK_MAX_FIFO_METHOD_ARGS,count,bulk_commands);
+
+    const primitives p = decode(&commands[0],n,NV30_3D_VB_INDEX_BATCH), bulk_p = decode(&bulk_commands[0],bulk_n,NV30_3D_VB_INDEX_BATCH);
+    assert(p == bulk_p);
+    assert(bulk_n <= n);
+  }
+}
+
+template< template< uint32_t > class primitive_traits >
+static void
+compare_counts(const std::string & name)
+{
+  static const uint32_t counts[] = {
+    0, 1, 2, 3, 4, 5, 6, 255, 256, 257, 258, 259, 510, 511, 512, 513, 1000, 4096, 65535, 100000, 2047 * 256, 2047 * 256 + 1, 3 * 2047 * 256 + 17
+  };
+
+  for(size_t i = 0,n = sizeof(counts) / sizeof(counts[0]);i < n;++i) {
+    try {
+      compare< primitive_traits >(name,7,counts[i]);
+    }
+    catch(const assertion & a) {
+      std::stringstream s;
+      s << name << " count:" << counts[i] << ": " << a.what();
+      throw assertion(s.str());
+    }
+  }
+
+  std::cout << name << " done" << std::endl;
+}
+
+int
+main(int argc, char ** argv)
+{
+  try {
+    compare_counts< rsxgl_draw_points >("points");
+    compare_counts< rsxgl_draw_lines >("lines");
+    compare_counts< rsxgl_draw_line_strip >("line strip");
+    compare_counts< rsxgl_draw_line_loop >("line loop");
+    compare_counts< rsxgl_draw_triangles >("triangles");
+    compare_counts< rsxgl_draw_triangle_strip >("triangle strip");
+    compare_counts< rsxgl_draw_triangle_fan >("triangle fan");
+    compare_counts< rsxgl_draw_quads >("quads");
+    compare_counts< rsxgl_draw_quad_strip >("quad strip");
+    compare_counts< rsxgl_draw_polygon >("polygon");
+  }
+  catch(const assertion & a) {
+    std::cerr << "failed: " << a.what() << std::endl;
+    return 1;
+  }
+
+  std::cout << "glDrawArrays words: " << total_words << " bulk: " << total_bulk_words << std::endl;
+
+  return 0;
+}
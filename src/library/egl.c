@@ -14,6 +14,7 @@
 #include <assert.h>
 
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include "GL3/rsxgl.h"
 
 #include <sysutil/video.h>
@@ -32,7 +33,8 @@
 
 #endif
 
-static EGLint rsxegl_error = EGL_SUCCESS;
+// Errors, like the current context, are per-thread:
+static __thread EGLint rsxegl_error = EGL_SUCCESS;
 static int rsxegl_initialized = 0;
 
 EGLAPI EGLint EGLAPIENTRY
@@ -105,14 +107,17 @@ eglGetDisplay(EGLNativeDisplayType display_id)
 
 // RSX-specific initialization parameters: size of the shared memory buffer, and length of the command buffer:
 
-// Also read by mem.c:
+// Also read by mem.c & fifo.cc:
 struct rsxgl_init_parameters_t rsxgl_init_parameters = {
   .gcm_buffer_size = RSXGL_CONFIG_default_gcm_buffer_size,
   .command_buffer_length = RSXGL_CONFIG_default_command_buffer_length,
   .max_swap_wait_iterations = 100000,
   .swap_wait_interval = RSXGL_SYNC_SLEEP_INTERVAL,
   .rsx_mspace_offset = 0,
-  .rsx_mspace_size = 0
+  .rsx_mspace_size = 0,
+  .command_buffer_segments = RSXGL_CONFIG_default_command_buffer_segments,
+  .kick_words = RSXGL_CONFIG_default_kick_words,
+  .kick_draws = RSXGL_CONFIG_default_kick_draws
 };
 
 static void * rsx_shared_memory = 0;
@@ -132,6 +137,11 @@ rsxglConfigure(struct rsxgl_init_parameters_t const * parameters)
     RSXEGL_ERROR_(EGL_BAD_PARAMETER);
   }
 
+  // Command buffer needs to be divided into at least one segment:
+  if(parameters -> command_buffer_segments == 0) {
+    RSXEGL_ERROR_(EGL_BAD_PARAMETER);
+  }
+
   rsxgl_init_parameters = *parameters;
 }
 
@@ -217,7 +227,7 @@ eglQueryString(EGLDisplay dpy,EGLint name)
     return "OpenGL ES";
     break;
   case EGL_EXTENSIONS:
-    RSXEGL_NOERROR("");
+    RSXEGL_NOERROR("EGL_KHR_create_context EGL_KHR_create_context_no_error");
     break;
   case EGL_VENDOR:
     RSXEGL_NOERROR("Blackbird");
@@ -722,8 +732,14 @@ struct rsxgl_object_context_t;
 
 extern struct rsxegl_context_t * rsxgl_context_create(const struct rsxegl_config_t *,gcmContextData *,struct pipe_screen *,struct rsxgl_object_context_t *);
 extern struct rsxgl_object_context_t * rsxgl_object_context_create();
+extern struct rsxgl_object_context_t * rsxgl_object_context_share(struct rsxegl_context_t *);
+
+static __thread struct rsxegl_context_t * current_rsxgl_ctx = 0;
 
-static struct rsxegl_context_t * current_rsxgl_ctx = 0;
+// All contexts send commands to the same FIFO, so only one of them - the one that's current
+// with a surface - may draw at a time. Others can be made current on other threads without a
+// surface, to create & upload objects shared with it:
+static struct rsxegl_context_t * volatile rsxegl_drawing_ctx = 0;
 
 EGLAPI EGLContext EGLAPIENTRY
 eglCreateContext(EGLDisplay dpy,EGLConfig config,EGLContext share_context,const EGLint * attrib_list)
@@ -732,11 +748,74 @@ eglCreateContext(EGLDisplay dpy,EGLConfig config,EGLContext share_context,const
   RSXEGL_CHECK_INITIALIZED(EGL_NO_CONTEXT);
 
   struct rsxegl_context_t * ctx = 0;
+  uint8_t no_error = 0;
+  EGLint major_version = 1, minor_version = 0, flags = 0;
+
+  if(attrib_list != 0) {
+    const EGLint * pattrib = attrib_list;
+    while(*pattrib != EGL_NONE) {
+      const EGLint attrib = *pattrib++;
+      const EGLint value = *pattrib++;
+
+      switch(attrib) {
+      case EGL_CONTEXT_OPENGL_NO_ERROR_KHR:
+	no_error = (value == EGL_TRUE) ? 1 : 0;
+	break;
+
+      // Same as EGL_CONTEXT_CLIENT_VERSION:
+      case EGL_CONTEXT_MAJOR_VERSION_KHR:
+	major_version = value;
+	break;
+
+      case EGL_CONTEXT_MINOR_VERSION_KHR:
+	minor_version = value;
+	break;
+
+      // There's only one kind of context; debug, forward-compatible and robust contexts are
+      // the same as any other, as are the core and compatibility profiles:
+      case EGL_CONTEXT_FLAGS_KHR:
+	if((value & ~(EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR | EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE_BIT_KHR | EGL_CONTEXT_OPENGL_ROBUST_ACCESS_BIT_KHR)) != 0) {
+	  RSXEGL_ERROR(EGL_BAD_ATTRIBUTE,EGL_NO_CONTEXT);
+	}
+	flags = value;
+	break;
+
+      case EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR:
+	if((value & (EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR | EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT_KHR)) == 0) {
+	  RSXEGL_ERROR(EGL_BAD_MATCH,EGL_NO_CONTEXT);
+	}
+	break;
+
+      // The GPU can't be reset, so neither strategy makes a difference:
+      case EGL_CONTEXT_OPENGL_RESET_NOTIFICATION_STRATEGY_KHR:
+	if(value != EGL_NO_RESET_NOTIFICATION_KHR && value != EGL_LOSE_CONTEXT_ON_RESET_KHR) {
+	  RSXEGL_ERROR(EGL_BAD_ATTRIBUTE,EGL_NO_CONTEXT);
+	}
+	break;
+
+      default:
+	RSXEGL_ERROR(EGL_BAD_ATTRIBUTE,EGL_NO_CONTEXT);
+      };
+    }
+  }
+
+  // EGL_KHR_create_context_no_error - a context can't both skip error checking and be a debug
+  // or robust one, whichever order the attributes were given in:
+  if(no_error && (flags & (EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR | EGL_CONTEXT_OPENGL_ROBUST_ACCESS_BIT_KHR)) != 0) {
+    RSXEGL_ERROR(EGL_BAD_MATCH,EGL_NO_CONTEXT);
+  }
+
+  // The context implements OpenGL 3.1 (see glGetString(GL_VERSION)):
+  if(major_version < 1 || minor_version < 0 || major_version > 3 || (major_version == 3 && minor_version > 1)) {
+    RSXEGL_ERROR(EGL_BAD_MATCH,EGL_NO_CONTEXT);
+  }
 
   switch(rsxegl_api) {
   case EGL_OPENGL_API:
-    ctx = rsxgl_context_create(config,rsx_gcm_context,rsx_screen,rsxgl_object_context_create());
+    ctx = rsxgl_context_create(config,rsx_gcm_context,rsx_screen,
+			       (share_context != EGL_NO_CONTEXT) ? rsxgl_object_context_share((struct rsxegl_context_t *)share_context) : rsxgl_object_context_create());
     assert(ctx -> callback != 0);
+    ctx -> no_error = no_error;
     RSXEGL_NOERROR(ctx);
   default:
     RSXEGL_NOERROR(EGL_NO_CONTEXT);
@@ -773,25 +852,44 @@ eglMakeCurrent(EGLDisplay dpy,EGLSurface draw,EGLSurface read,EGLContext _ctx)
   RSXEGL_CHECK_INITIALIZED(EGL_FALSE);
 
   if(rsxegl_api == EGL_OPENGL_API) {
-    if(current_rsxgl_ctx != 0) {
-      current_rsxgl_ctx -> draw = 0;
-      current_rsxgl_ctx -> read = 0;
+    struct rsxegl_context_t * ctx = (struct rsxegl_context_t *)_ctx;
 
-      current_rsxgl_ctx = 0;
+    // Either both surfaces are given, or neither is; EGL_NO_CONTEXT releases the current context:
+    if((draw == EGL_NO_SURFACE) != (read == EGL_NO_SURFACE) || (ctx == 0 && draw != EGL_NO_SURFACE)) {
+      RSXEGL_ERROR(EGL_BAD_MATCH,EGL_FALSE);
     }
 
-    struct rsxegl_context_t * ctx = (struct rsxegl_context_t *)_ctx;
+    // A context can be current to only one thread:
+    if(ctx != 0 && ctx != current_rsxgl_ctx && !__sync_bool_compare_and_swap(&ctx -> current,0,1)) {
+      RSXEGL_ERROR(EGL_BAD_ACCESS,EGL_FALSE);
+    }
 
-    if(ctx == 0) {
-      RSXEGL_ERROR(EGL_BAD_CONTEXT,EGL_FALSE);
+    // Only one context at a time can be current with a surface:
+    struct rsxegl_context_t * drawing_ctx = (current_rsxgl_ctx != 0 && current_rsxgl_ctx -> draw != 0) ? current_rsxgl_ctx : 0;
+    struct rsxegl_context_t * next_drawing_ctx = (draw != EGL_NO_SURFACE) ? ctx : 0;
+
+    if(drawing_ctx != next_drawing_ctx && !__sync_bool_compare_and_swap(&rsxegl_drawing_ctx,drawing_ctx,next_drawing_ctx)) {
+      if(ctx != current_rsxgl_ctx) {
+	__sync_lock_release(&ctx -> current);
+      }
+      RSXEGL_ERROR(EGL_BAD_ACCESS,EGL_FALSE);
     }
-    else {
-      RSXEGL_CHECK_SURFACE(draw,EGL_FALSE);
-      RSXEGL_CHECK_SURFACE(read,EGL_FALSE);
+
+    if(current_rsxgl_ctx != 0 && current_rsxgl_ctx != ctx) {
+      (*current_rsxgl_ctx -> callback)(current_rsxgl_ctx,RSXEGL_RELEASE_CONTEXT);
+
+      current_rsxgl_ctx -> draw = 0;
+      current_rsxgl_ctx -> read = 0;
+
+      __sync_lock_release(&current_rsxgl_ctx -> current);
     }
 
     current_rsxgl_ctx = ctx;
 
+    if(ctx == 0) {
+      RSXEGL_NOERROR(EGL_TRUE);
+    }
+
     current_rsxgl_ctx -> draw = draw;
     current_rsxgl_ctx -> read = read;
 
@@ -58,7 +58,8 @@ enum rsxegl_context_callbacks {
   RSXEGL_MAKE_CONTEXT_CURRENT = 0,
   RSXEGL_POST_CPU_SWAP = 1,
   RSXEGL_POST_GPU_SWAP = 2,
-  RSXEGL_DESTROY_CONTEXT = 3
+  RSXEGL_DESTROY_CONTEXT = 3,
+  RSXEGL_RELEASE_CONTEXT = 4
 };
 
 struct rsxegl_context_t {
@@ -75,6 +76,12 @@ struct rsxegl_context_t {
 
   struct pipe_screen * screen;
   uint32_t sync_sleep_interval;
+
+  // Set by the EGL_CONTEXT_OPENGL_NO_ERROR_KHR attribute:
+  uint8_t no_error;
+
+  // Non-zero while the context is current to some thread:
+  uint32_t current;
 };
 
 #ifdef __cplusplus
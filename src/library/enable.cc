@@ -5,20 +5,54 @@
 // enable.c - glEnable and glDisable functions.
 
 #include <GL3/gl3.h>
+#include "GL3/rsxgl3ext.h"
 
 #include "rsxgl_context.h"
 #include "gl_constants.h"
 #include "error.h"
+#include "perf_counters.h"
 
 #if defined(GLAPI)
 #undef GLAPI
 #endif
 #define GLAPI extern "C"
 
+// 1 or 0 if cap is enabled or not, or -1 if it isn't a capability:
+static inline int
+rsxgl_is_enabled(const rsxgl_context_t * ctx,const GLenum cap)
+{
+  switch(cap) {
+  case GL_SCISSOR_TEST:
+    return ctx -> state.enable.scissor;
+  case GL_DEPTH_TEST:
+    return ctx -> state.enable.depth_test;
+  case GL_BLEND:
+    return ctx -> state.enable.blend;
+  case GL_CULL_FACE:
+    return ctx -> state.polygon.cullEnable;
+  case GL_STENCIL_TEST:
+    return ctx -> state.stencil.face[0].enable && ctx -> state.stencil.face[1].enable;
+  case GL_PRIMITIVE_RESTART:
+    return ctx -> state.enable.primitive_restart;
+  case GL_VERTEX_PROGRAM_POINT_SIZE:
+    return ctx -> state.enable.pointSize;
+  case GL_RASTERIZER_DISCARD:
+    return ctx -> state.enable.rasterizer_discard;
+  case GL_DRAW_BATCH_BULK_RSX:
+    return ctx -> state.enable.bulk_draw_batch;
+  case GL_PROGRAM_SPECIALIZATION_RSX:
+    return ctx -> state.enable.program_specialization;
+  default:
+    return -1;
+  };
+}
+
 GLAPI void APIENTRY
 glEnable (GLenum cap)
 {
   struct rsxgl_context_t * ctx = current_ctx();
+  RSXGL_PERF_REDUNDANT(ctx,rsxgl_is_enabled(ctx,cap) == 1);
+
   switch(cap) {
   case GL_SCISSOR_TEST:
     ctx -> state.enable.scissor = 1;
@@ -51,6 +85,12 @@ glEnable (GLenum cap)
   case GL_RASTERIZER_DISCARD:
     ctx -> state.enable.rasterizer_discard = 1;
     break;
+  case GL_DRAW_BATCH_BULK_RSX:
+    ctx -> state.enable.bulk_draw_batch = 1;
+    break;
+  case GL_PROGRAM_SPECIALIZATION_RSX:
+    ctx -> state.enable.program_specialization = 1;
+    break;
   default:
     RSXGL_ERROR_(GL_INVALID_ENUM);
   };
@@ -62,6 +102,8 @@ GLAPI void APIENTRY
 glDisable (GLenum cap)
 {
   struct rsxgl_context_t * ctx = current_ctx();
+  RSXGL_PERF_REDUNDANT(ctx,rsxgl_is_enabled(ctx,cap) == 0);
+
   switch(cap) {
   case GL_SCISSOR_TEST:
     ctx -> state.enable.scissor = 0;
@@ -94,6 +136,12 @@ glDisable (GLenum cap)
   case GL_RASTERIZER_DISCARD:
     ctx -> state.enable.rasterizer_discard = 0;
     break;
+  case GL_DRAW_BATCH_BULK_RSX:
+    ctx -> state.enable.bulk_draw_batch = 0;
+    break;
+  case GL_PROGRAM_SPECIALIZATION_RSX:
+    ctx -> state.enable.program_specialization = 0;
+    break;
   default:
     RSXGL_ERROR_(GL_INVALID_ENUM);
   };
@@ -105,34 +153,11 @@ GLAPI GLboolean APIENTRY
 glIsEnabled (GLenum cap)
 {
   struct rsxgl_context_t * ctx = current_ctx();
-  switch(cap) {
-  case GL_SCISSOR_TEST:
-    RSXGL_NOERROR(ctx -> state.enable.scissor);
-    break;
-  case GL_DEPTH_TEST:
-    RSXGL_NOERROR(ctx -> state.enable.depth_test);
-    break;
-  case GL_BLEND:
-    RSXGL_NOERROR(ctx -> state.enable.blend);
-    break;
-  case GL_CULL_FACE:
-    RSXGL_NOERROR(ctx -> state.polygon.cullEnable);
-    break;
-  case GL_STENCIL_TEST:
-    RSXGL_NOERROR(ctx -> state.stencil.face[0].enable && ctx -> state.stencil.face[1].enable);
-    break;
-  case GL_PRIMITIVE_RESTART:
-    RSXGL_NOERROR(ctx -> state.enable.primitive_restart);
-    break;
-  case GL_VERTEX_PROGRAM_POINT_SIZE:
-    RSXGL_NOERROR(ctx -> state.enable.pointSize);
-    break;
-  case GL_RASTERIZER_DISCARD:
-    RSXGL_NOERROR(ctx -> state.enable.rasterizer_discard);
-    break;
-  default:
+
+  const int enabled = rsxgl_is_enabled(ctx,cap);
+  if(enabled < 0) {
     RSXGL_ERROR(GL_INVALID_ENUM,GL_FALSE);
-  };
+  }
 
-  RSXGL_NOERROR(GL_FALSE);
+  RSXGL_NOERROR(enabled ? GL_TRUE : GL_FALSE);
 }
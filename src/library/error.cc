@@ -13,8 +13,11 @@
 #endif
 #define GLAPI extern "C"
 
-// Error stuff:
-GLenum rsxgl_error = GL_NO_ERROR;
+// Error stuff; like the current context, the error is per-thread:
+__thread GLenum rsxgl_error = GL_NO_ERROR;
+
+// Set from the current context's EGL_CONTEXT_OPENGL_NO_ERROR_KHR attribute:
+extern "C" __thread uint8_t rsxgl_no_error = 0;
 
 GLAPI GLenum APIENTRY
 glGetError (void)
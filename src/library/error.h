@@ -5,18 +5,31 @@
 extern "C" {
 #endif
 
-// TODO - Compile-time options to affect GL error detection behavior, with the aim
-// of creating a library that (optionally) doesn't perform GL error checking at all.
-// Making the RSXGL_*ERROR() macros no-op's could induce the compiler to eliminate
-// the code paths that check for & set these errors. Additionally, there ought to
-// be options to trace or assert when a GL error is detected, to assist in gradually
+#include "rsxgl_config.h"
+#include <stdint.h>
+
+// Validation of enums, ranges & object names on frequently-called entry points (binding objects,
+// setting uniforms, drawing) is wrapped in RSXGL_CHECK_ERRORS(). It can be removed altogether
+// by configuring with --disable-error-checking, or skipped for contexts created with the
+// EGL_CONTEXT_OPENGL_NO_ERROR_KHR attribute (rsxgl_no_error is set when such a context is made
+// current). As with KHR_no_error, a program that makes an error under either is undefined.
+//
+// TODO - Options to trace or assert when a GL error is detected, to assist in gradually
 // eliminating these from a client program so that GL error checking can safely
 // be removed. OpenGL also has the ARB_debug_output extension, apparently based
 // upon an AMD extension, which produces information about GL errors when they occur;
 // this might be nice to support as well.
 
+extern __thread uint8_t rsxgl_no_error;
+
+#if (RSXGL_CONFIG_error_checking == 1)
+#define RSXGL_CHECK_ERRORS() (rsxgl_no_error == 0)
+#else
+#define RSXGL_CHECK_ERRORS() (0)
+#endif
+
 // Macros for reporting errors & returning from a function:
-extern GLenum rsxgl_error;
+extern __thread GLenum rsxgl_error;
 
 static inline void
 rsxeglSetError(GLenum e)
@@ -0,0 +1,404 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// feedback.cc - Transform feedback capture.
+
+#include "rsxgl_context.h"
+#include "feedback.h"
+#include "program.h"
+#include "attribs.h"
+#include "framebuffer.h"
+#include "query.h"
+#include "draw.h"
+#include "draw_batch.h"
+#include "deferred_free.h"
+#include "ieee32_t.h"
+#include "rsxgl_assert.h"
+
+#include <rsx/gcm_sys.h>
+#include "nv40.h"
+#include "gl_fifo.h"
+
+#include <algorithm>
+
+// Vertices sent over the FIFO, by the CPU path, for each reservation:
+#define RSXGL_FEEDBACK_CPU_BATCH_SIZE 256
+
+static inline uint32_t
+rsxgl_feedback_float(const float f)
+{
+  ieee32_t tmp;
+  tmp.f = f;
+  return tmp.u;
+}
+
+// Make sure that the position table has at least n entries. The table is only ever grown, since
+// its entries don't change; the one it replaces is freed once the GPU is done drawing from it:
+static bool
+rsxgl_feedback_positions_validate(rsxgl_context_t * ctx,const uint32_t n,const uint32_t timestamp)
+{
+  rsxgl_object_context_t * object_ctx = ctx -> object_context();
+
+  if(object_ctx -> feedback_positions_capacity < n) {
+    uint32_t capacity = std::max(object_ctx -> feedback_positions_capacity,(uint32_t)RSXGL_FEEDBACK_MIN_POSITIONS);
+    while(capacity < n) {
+      capacity *= 2;
+    }
+
+    const rsx_size_t size = capacity * sizeof(int16_t) * 2;
+
+    void * address = 0;
+    memory_t memory = rsxgl_arena_allocate(memory_arena_t::storage().at(0),128,size,&address);
+    if(!memory && rsxgl_deferred_free_reclaim(ctx)) {
+      memory = rsxgl_arena_allocate(memory_arena_t::storage().at(0),128,size,&address);
+    }
+    if(!memory) {
+      return false;
+    }
+
+    int16_t * position = (int16_t *)address;
+    for(uint32_t i = 0;i < capacity;++i,position += 2) {
+      rsxgl_feedback_position(i,position);
+    }
+
+    if(object_ctx -> feedback_positions) {
+      rsxgl_deferred_free_arena(ctx,object_ctx -> feedback_positions_timestamp,0,object_ctx -> feedback_positions,object_ctx -> feedback_positions_capacity * sizeof(int16_t) * 2);
+    }
+
+    object_ctx -> feedback_positions = memory;
+    object_ctx -> feedback_positions_capacity = capacity;
+  }
+
+  object_ctx -> feedback_positions_timestamp = timestamp;
+
+  return true;
+}
+
+static inline void
+rsxgl_feedback_invalidate_vertex_cache(gcmContextData * context)
+{
+  uint32_t * buffer = gcm_reserve(context,8);
+
+  gcm_emit_method_at(buffer,0,0x1710,1);
+  gcm_emit_at(buffer,1,0);
+
+  gcm_emit_method_at(buffer,2,NV40_3D_VTX_CACHE_INVALIDATE,1);
+  gcm_emit_at(buffer,3,0);
+
+  gcm_emit_method_at(buffer,4,NV40_3D_VTX_CACHE_INVALIDATE,1);
+  gcm_emit_at(buffer,5,0);
+
+  gcm_emit_method_at(buffer,6,NV40_3D_VTX_CACHE_INVALIDATE,1);
+  gcm_emit_at(buffer,7,0);
+
+  gcm_finish_n_commands(context,8);
+}
+
+namespace {
+  struct array_index {
+    const uint32_t first;
+
+    array_index(const uint32_t _first) : first(_first) {}
+
+    uint32_t operator()(const uint32_t i) const {
+      return first + i;
+    }
+  };
+
+  template< typename Type >
+  struct element_index {
+    const Type * indices;
+    const int32_t basevertex;
+
+    element_index(const void * _indices,const int32_t _basevertex) : indices((const Type *)_indices), basevertex(_basevertex) {}
+
+    uint32_t operator()(const uint32_t i) const {
+      return (uint32_t)((int32_t)indices[i] + basevertex);
+    }
+  };
+}
+
+rsxgl_feedback_t::rsxgl_feedback_t(rsxgl_context_t * _ctx,const uint32_t _timestamp)
+  : ctx(_ctx), timestamp(_timestamp), num_outputs(0), outputs(0), capacity(0), written(0), primitives_generated(0), primitives_written(0), capture(0), interleaved(0), begun(0), rebased(0)
+{
+  const program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
+
+  if(ctx -> state.enable.transform_feedback_mode != 0 && program.streamfp_num_outputs > 0) {
+    rsxgl_assert(ctx -> state.enable.transform_feedback_program);
+
+    num_outputs = program.streamfp_num_outputs;
+    interleaved = program.streamfp_interleaved;
+    outputs = interleaved ? num_outputs : 1;
+
+    const uint32_t total = rsxgl_feedback_framebuffer_capacity(ctx);
+    capacity = (total > ctx -> transform_feedback_offset) ? (total - ctx -> transform_feedback_offset) : 0;
+
+    capture = 1;
+  }
+}
+
+// Set up the state that every block is drawn with:
+void
+rsxgl_feedback_t::begin()
+{
+  if(begun) return;
+  begun = 1;
+
+  gcmContextData * context = ctx -> gcm_context();
+
+  const uint16_t w = RSXGL_MAX_RENDERBUFFER_SIZE, h = RSXGL_MAX_RENDERBUFFER_SIZE;
+
+  // Raster positions map straight to pixels, which are written regardless of depth:
+  uint32_t * buffer = gcm_reserve(context,21);
+
+  gcm_emit_method(&buffer,NV30_3D_VIEWPORT_HORIZ,2);
+  gcm_emit(&buffer,((uint32_t)w << 16));
+  gcm_emit(&buffer,((uint32_t)h << 16));
+
+  gcm_emit_method(&buffer,NV30_3D_DEPTH_RANGE_NEAR,2);
+  gcm_emit(&buffer,rsxgl_feedback_float(0.0f));
+  gcm_emit(&buffer,rsxgl_feedback_float(1.0f));
+
+  gcm_emit_method(&buffer,NV30_3D_VIEWPORT_TRANSLATE,8);
+  gcm_emit(&buffer,rsxgl_feedback_float(0.0f));
+  gcm_emit(&buffer,rsxgl_feedback_float(0.0f));
+  gcm_emit(&buffer,rsxgl_feedback_float(0.5f));
+  gcm_emit(&buffer,rsxgl_feedback_float(0.0f));
+  gcm_emit(&buffer,rsxgl_feedback_float(1.0f));
+  gcm_emit(&buffer,rsxgl_feedback_float(1.0f));
+  gcm_emit(&buffer,rsxgl_feedback_float(0.0f));
+  gcm_emit(&buffer,rsxgl_feedback_float(0.0f));
+
+  gcm_emit_method(&buffer,NV30_3D_DEPTH_CONTROL,1);
+  gcm_emit(&buffer,0);
+
+  gcm_emit_method(&buffer,NV30_3D_DEPTH_TEST_ENABLE,1);
+  gcm_emit(&buffer,0);
+
+  gcm_emit_method(&buffer,NV30_3D_POINT_SIZE,1);
+  gcm_emit(&buffer,rsxgl_feedback_float(1.0f));
+
+  gcm_finish_commands(context,&buffer);
+
+  rsxgl_feedback_program_validate(ctx,timestamp);
+}
+
+uint32_t
+rsxgl_feedback_t::writable(const uint32_t nprimitives)
+{
+  const uint32_t size = rsxgl_feedback_primitive_size(ctx -> state.enable.transform_feedback_mode);
+  const uint32_t n = std::min(nprimitives,(capacity - written) / size);
+
+  primitives_written += n;
+  return n * size;
+}
+
+void
+rsxgl_feedback_t::instance(const uint32_t i)
+{
+  if(!capture) return;
+
+  const uint32_t instanceid_index = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].instanceid_index;
+  if(instanceid_index == ~0U) return;
+
+  begin();
+
+  gcmContextData * context = ctx -> gcm_context();
+  uint32_t * buffer = gcm_reserve(context,3);
+
+  gcm_emit_method_at(buffer,0,NV30_3D_VP_UPLOAD_CONST_ID,2);
+  gcm_emit_at(buffer,1,instanceid_index);
+  gcm_emit_at(buffer,2,rsxgl_feedback_float((float)i));
+
+  gcm_finish_n_commands(context,3);
+}
+
+bool
+rsxgl_feedback_t::capture_arrays(const uint32_t first,const uint32_t n)
+{
+  // Enough positions for the largest block, wherever it begins:
+  if(!rsxgl_feedback_positions_validate(ctx,3 + (std::min(n,(uint32_t)RSXGL_FEEDBACK_BLOCK_SIZE) * outputs),timestamp)) {
+    return false;
+  }
+
+  begin();
+
+  program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
+  const uint32_t vertexid_index = program.streamvp_vertexid_index;
+  const uint32_t max_method_args = ctx -> state.enable.bulk_draw_batch ? RSXGL_VERTEX_BATCH_BULK_MAX_FIFO_METHOD_ARGS : RSXGL_VERTEX_BATCH_MAX_FIFO_METHOD_ARGS;
+  const memory_t positions = ctx -> object_context() -> feedback_positions;
+
+  gcmContextData * context = ctx -> gcm_context();
+
+  for(uint32_t i = 0;i < n;) {
+    const uint32_t m = std::min(n - i,(uint32_t)RSXGL_FEEDBACK_BLOCK_SIZE);
+    const rsxgl_feedback_block_t block = rsxgl_feedback_block(ctx -> transform_feedback_offset + written,outputs);
+
+    rsxgl_feedback_framebuffer_validate(ctx,block.base,block.skew + (m * outputs),timestamp);
+
+    // The block's first vertex is drawn as vertex 0, so that its position is the table's first:
+    rsxgl_attribs_rebase(ctx,program,first + i);
+    rebased = 1;
+
+    {
+      const memory_t memory = positions + (block.skew * sizeof(int16_t) * 2);
+
+      uint32_t * buffer = gcm_reserve(context,4);
+
+      gcm_emit_method_at(buffer,0,NV30_3D_VTXBUF(vertexid_index),1);
+      gcm_emit_at(buffer,1,memory.offset | ((uint32_t)memory.location << 31));
+      gcm_emit_method_at(buffer,2,NV30_3D_VTXFMT(vertexid_index),1);
+      gcm_emit_at(buffer,3,
+		  ((uint32_t)(outputs * sizeof(int16_t) * 2) << NV30_3D_VTXFMT_STRIDE__SHIFT) |
+		  ((uint32_t)2 << NV30_3D_VTXFMT_SIZE__SHIFT) |
+		  ((uint32_t)RSXGL_VERTEX_S16_UN & 0x7));
+
+      gcm_finish_n_commands(context,4);
+    }
+
+    rsxgl_draw_array_operations< RSXGL_MAX_DRAW_BATCH_SIZE, rsxgl_draw_points > op(0);
+    rsxgl_process_batch(context,max_method_args,m,op);
+    context -> current = op.buffer;
+
+    i += m;
+    written += m;
+  }
+
+  return true;
+}
+
+template< typename Index >
+void
+rsxgl_feedback_t::capture_vertices(const uint32_t rsx_primitive_type,const uint32_t count,const uint32_t n,const Index & index)
+{
+  begin();
+
+  program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
+  const uint32_t vertexid_index = program.streamvp_vertexid_index;
+
+  gcmContextData * context = ctx -> gcm_context();
+
+  if(rebased) {
+    rsxgl_attribs_rebase(ctx,program,0);
+    rebased = 0;
+  }
+
+  // Positions are sent along with each vertex:
+  {
+    uint32_t * buffer = gcm_reserve(context,4);
+
+    gcm_emit_method_at(buffer,0,NV30_3D_VTXBUF(vertexid_index),1);
+    gcm_emit_at(buffer,1,0);
+    gcm_emit_method_at(buffer,2,NV30_3D_VTXFMT(vertexid_index),1);
+    gcm_emit_at(buffer,3,((uint32_t)RSXGL_VERTEX_S16_UN & 0x7));
+
+    gcm_finish_n_commands(context,4);
+  }
+
+  const uint32_t cmd = NV30_3D_VTX_ATTR_2I(vertexid_index);
+
+  for(uint32_t i = 0;i < n;) {
+    const uint32_t m = std::min(n - i,(uint32_t)RSXGL_FEEDBACK_BLOCK_SIZE);
+    const rsxgl_feedback_block_t block = rsxgl_feedback_block(ctx -> transform_feedback_offset + written,outputs);
+
+    rsxgl_feedback_framebuffer_validate(ctx,block.base,block.skew + (m * outputs),timestamp);
+    rsxgl_feedback_invalidate_vertex_cache(context);
+
+    for(uint32_t j = 0;j < m;) {
+      const uint32_t k = std::min(m - j,(uint32_t)RSXGL_FEEDBACK_CPU_BATCH_SIZE);
+      const uint32_t ncommands = 2 + (4 * k) + 2;
+
+      uint32_t * buffer = gcm_reserve(context,ncommands);
+      uint32_t * current = buffer;
+
+      gcm_emit_method_at(current,0,NV30_3D_VERTEX_BEGIN_END,1);
+      gcm_emit_at(current,1,NV30_3D_VERTEX_BEGIN_END_POINTS);
+      current += 2;
+
+      for(uint32_t l = 0;l < k;++l,current += 4) {
+	gcm_emit_method_at(current,0,cmd,1);
+	gcm_emit_at(current,1,rsxgl_feedback_position_2i(block.skew + ((j + l) * outputs)));
+
+	gcm_emit_method_at(current,2,NV30_3D_VB_ELEMENT_U32,1);
+	gcm_emit_at(current,3,index(rsxgl_feedback_vertex(rsx_primitive_type,count,i + j + l)));
+      }
+
+      gcm_emit_method_at(current,0,NV30_3D_VERTEX_BEGIN_END,1);
+      gcm_emit_at(current,1,NV30_3D_VERTEX_BEGIN_END_STOP);
+
+      gcm_finish_n_commands(context,ncommands);
+
+      j += k;
+    }
+
+    i += m;
+    written += m;
+  }
+}
+
+void
+rsxgl_feedback_t::arrays(const uint32_t rsx_primitive_type,const uint32_t first,const uint32_t count)
+{
+  const uint32_t nprimitives = rsxgl_feedback_primitive_count(rsx_primitive_type,count);
+  primitives_generated += nprimitives;
+
+  if(!capture) return;
+
+  const uint32_t n = writable(nprimitives);
+  if(n == 0) return;
+
+  if(rsxgl_feedback_primitive_is_list(rsx_primitive_type) && capture_arrays(first,n)) return;
+
+  capture_vertices(rsx_primitive_type,count,n,array_index(first));
+}
+
+void
+rsxgl_feedback_t::elements(const uint32_t rsx_primitive_type,const uint32_t rsx_element_type,const void * indices,const uint32_t count,const int32_t basevertex)
+{
+  const uint32_t nprimitives = rsxgl_feedback_primitive_count(rsx_primitive_type,count);
+  primitives_generated += nprimitives;
+
+  if(!capture) return;
+
+  const uint32_t n = writable(nprimitives);
+  if(n == 0) return;
+
+  switch(rsx_element_type) {
+  case RSXGL_ELEMENT_TYPE_UNSIGNED_INT:
+    capture_vertices(rsx_primitive_type,count,n,element_index< uint32_t >(indices,basevertex));
+    break;
+  case RSXGL_ELEMENT_TYPE_UNSIGNED_SHORT:
+    capture_vertices(rsx_primitive_type,count,n,element_index< uint16_t >(indices,basevertex));
+    break;
+  case RSXGL_ELEMENT_TYPE_UNSIGNED_BYTE:
+    capture_vertices(rsx_primitive_type,count,n,element_index< uint8_t >(indices,basevertex));
+    break;
+  default:
+    rsxgl_assert(0);
+  }
+}
+
+void
+rsxgl_feedback_t::finish()
+{
+  // For the next draw invocation:
+  if(begun) {
+    ctx -> invalid.parts.draw_framebuffer = 1;
+    ctx -> state.invalid.parts.draw_framebuffer = 1;
+    ctx -> state.invalid.parts.point_size = 1;
+    ctx -> invalid.parts.program = 1;
+    ctx -> state.invalid.parts.viewport = 1;
+    ctx -> invalid_attribs.set(ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].streamvp_vertexid_index);
+  }
+
+  ctx -> transform_feedback_offset += written;
+
+  if(ctx -> query_binding.is_anything_bound(RSXGL_QUERY_PRIMITIVES_GENERATED)) {
+    ctx -> query_binding[RSXGL_QUERY_PRIMITIVES_GENERATED].value += primitives_generated;
+  }
+
+  if(capture && ctx -> query_binding.is_anything_bound(RSXGL_QUERY_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN)) {
+    ctx -> query_binding[RSXGL_QUERY_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN].value += primitives_written;
+  }
+}
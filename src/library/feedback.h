@@ -0,0 +1,204 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// feedback.h - Transform feedback capture.
+//
+// The RSX can't write vertex program outputs to memory, so a program that captures varyings is
+// also translated into a "stream" program pair (see program.cc), which draws each vertex as a
+// point into a float render target that's RSXGL_MAX_RENDERBUFFER_SIZE pixels wide, with one
+// color target per captured varying. The render targets are the transform feedback buffers
+// themselves, so pixel n of the target is the n'th vertex captured. The pixel that a vertex
+// lands on comes from an extra vertex attrib - the "vertexid" - that holds its raster position.
+//
+// Vertices of independent primitives drawn from arrays are captured in the order in which
+// they're fetched; their positions come from a table, kept by the object context, that's read
+// like any other vertex array, so the capture is drawn with ordinary vertex batches. Anything
+// else - indexed draws, strips, loops & fans, whose primitives are captured as independent
+// primitives - has each vertex's position & index sent over the FIFO.
+//
+// The functions in this header don't depend upon the rest of the library, so that they can be
+// tested on the host.
+
+#ifndef rsxgl_feedback_H
+#define rsxgl_feedback_H
+
+#include "gl_constants.h"
+#include "nv40.h"
+
+#include <stdint.h>
+
+// Vertices captured (and drawn) at a time; each block of them sets up the render targets again,
+// at the point in the feedback buffers where it begins:
+#define RSXGL_FEEDBACK_BLOCK_SIZE 65536
+
+// Smallest number of entries that the position table is created with:
+#define RSXGL_FEEDBACK_MIN_POSITIONS 4096
+
+// Vertices that make up each primitive captured in a transform feedback mode (POINTS, LINES or
+// TRIANGLES):
+static inline uint32_t
+rsxgl_feedback_primitive_size(const uint32_t rsx_feedback_primitive_type)
+{
+  return
+    (rsx_feedback_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLES) ? 3 :
+    (rsx_feedback_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINES) ? 2 :
+    1;
+}
+
+// Primitives made by count vertices of rsx_primitive_type:
+static inline uint32_t
+rsxgl_feedback_primitive_count(const uint32_t rsx_primitive_type,const uint32_t count)
+{
+  switch(rsx_primitive_type) {
+  case NV30_3D_VERTEX_BEGIN_END_POINTS:
+    return count;
+  case NV30_3D_VERTEX_BEGIN_END_LINES:
+    return count / 2;
+  case NV30_3D_VERTEX_BEGIN_END_LINE_LOOP:
+    return (count >= 2) ? count : 0;
+  case NV30_3D_VERTEX_BEGIN_END_LINE_STRIP:
+    return (count >= 2) ? (count - 1) : 0;
+  case NV30_3D_VERTEX_BEGIN_END_TRIANGLES:
+    return count / 3;
+  case NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP:
+  case NV30_3D_VERTEX_BEGIN_END_TRIANGLE_FAN:
+    return (count >= 3) ? (count - 2) : 0;
+  case NV30_3D_VERTEX_BEGIN_END_QUADS:
+    return count / 4;
+  case NV30_3D_VERTEX_BEGIN_END_QUAD_STRIP:
+    return (count >= 4) ? ((count - 2) / 2) : 0;
+  case NV30_3D_VERTEX_BEGIN_END_POLYGON:
+    return (count >= 3) ? 1 : 0;
+  default:
+    return 0;
+  }
+}
+
+// Set if rsx_primitive_type's vertices are captured in the order that they're drawn in:
+static inline bool
+rsxgl_feedback_primitive_is_list(const uint32_t rsx_primitive_type)
+{
+  return
+    rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_POINTS ||
+    rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_LINES ||
+    rsx_primitive_type == NV30_3D_VERTEX_BEGIN_END_TRIANGLES;
+}
+
+// The vertex, counted from the first one drawn, that's captured i'th. Strips, loops & fans are
+// captured as independent primitives; triangle strips keep their winding:
+static inline uint32_t
+rsxgl_feedback_vertex(const uint32_t rsx_primitive_type,const uint32_t count,const uint32_t i)
+{
+  switch(rsx_primitive_type) {
+  case NV30_3D_VERTEX_BEGIN_END_LINE_STRIP:
+    return (i / 2) + (i % 2);
+  case NV30_3D_VERTEX_BEGIN_END_LINE_LOOP:
+    return ((i / 2) + (i % 2)) % count;
+  case NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP:
+    {
+      const uint32_t primitive = i / 3, vertex = i % 3;
+      if((primitive & 1) && vertex < 2) {
+	return primitive + (1 - vertex);
+      }
+      return primitive + vertex;
+    }
+  case NV30_3D_VERTEX_BEGIN_END_TRIANGLE_FAN:
+    {
+      const uint32_t primitive = i / 3, vertex = i % 3;
+      return (vertex == 0) ? 0 : (primitive + vertex);
+    }
+  default:
+    return i;
+  }
+}
+
+// Raster position of pixel n of the feedback render target. Its first row is at y = 1:
+static inline void
+rsxgl_feedback_position(const uint32_t n,int16_t * position)
+{
+  position[0] = (int16_t)(n % RSXGL_MAX_RENDERBUFFER_SIZE);
+  position[1] = (int16_t)((n / RSXGL_MAX_RENDERBUFFER_SIZE) + 1);
+}
+
+// The same, packed for NV30_3D_VTX_ATTR_2I:
+static inline uint32_t
+rsxgl_feedback_position_2i(const uint32_t n)
+{
+  return
+    ((((n / RSXGL_MAX_RENDERBUFFER_SIZE) + 1) << NV30_3D_VTX_ATTR_2I_Y__SHIFT) & NV30_3D_VTX_ATTR_2I_Y__MASK) |
+    (((n % RSXGL_MAX_RENDERBUFFER_SIZE) << NV30_3D_VTX_ATTR_2I_X__SHIFT) & NV30_3D_VTX_ATTR_2I_X__MASK);
+}
+
+// Where a block of vertices is captured. Vertex slot s (counted from the start of the bound
+// ranges) is stored at pixel s * outputs; outputs is 1 for separate attribs, since each
+// varying has its own buffer, or the number of varyings when they're interleaved. The render
+// targets begin at pixel base, which is kept aligned to 4 pixels (64 bytes), and the block's
+// first vertex lands on pixel base + skew:
+struct rsxgl_feedback_block_t {
+  uint32_t base, skew;
+};
+
+static inline rsxgl_feedback_block_t
+rsxgl_feedback_block(const uint32_t slot,const uint32_t outputs)
+{
+  const uint32_t pixel = slot * outputs;
+  rsxgl_feedback_block_t block;
+  block.base = pixel & ~3;
+  block.skew = pixel - block.base;
+  return block;
+}
+
+struct rsxgl_context_t;
+
+// Passed to a draw call's policy after it's drawn, which describes its vertices by calling
+// arrays() or elements() for each of its parts. Primitives are counted for the
+// PRIMITIVES_GENERATED & TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN queries, and captured if transform
+// feedback is active:
+struct rsxgl_feedback_t {
+  rsxgl_feedback_t(rsxgl_context_t *,const uint32_t);
+
+  // Sets the instance number for the vertices that follow:
+  void instance(const uint32_t);
+
+  // Points, lines & triangles are captured with vertex batches, from the position table. Strips,
+  // loops & fans are captured vertex by vertex, each one's position & index sent over the FIFO
+  // by the CPU, so capturing them costs CPU time in proportion to their vertex counts:
+  void arrays(const uint32_t rsx_primitive_type,const uint32_t first,const uint32_t count);
+
+  // indices is the CPU's address of the element array. Indexed draws are always captured vertex
+  // by vertex, the CPU reading each index, whatever their primitive type:
+  void elements(const uint32_t rsx_primitive_type,const uint32_t rsx_element_type,const void * indices,const uint32_t count,const int32_t basevertex);
+
+  // Updates queries, and marks the state that capture changed as invalid:
+  void finish();
+
+private:
+  rsxgl_context_t * ctx;
+  const uint32_t timestamp;
+
+  // Varyings captured, and vertex slots per vertex - see rsxgl_feedback_block_t:
+  uint32_t num_outputs, outputs;
+
+  // Vertices that there's room for, and that have been captured by this draw:
+  uint32_t capacity, written;
+
+  uint32_t primitives_generated, primitives_written;
+
+  // rebased is set while the program's attribs begin at some element other than their first:
+  uint8_t capture:1, interleaved:1, begun:1, rebased:1;
+
+  void begin();
+
+  // Clamps a draw's primitives to those that fit, returning the vertices to capture:
+  uint32_t writable(const uint32_t);
+
+  // Vertices of independent primitives, read from arrays; false if there's no position table:
+  bool capture_arrays(const uint32_t,const uint32_t);
+
+  template< typename Index >
+  void capture_vertices(const uint32_t,const uint32_t,const uint32_t,const Index &);
+};
+
+#endif
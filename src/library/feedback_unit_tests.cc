@@ -0,0 +1,139 @@
+// "Unit testing" for the transform feedback helpers in feedback.h. Meant to be built & run on
+// the host, e.g.:
+//
+// g++ -std=c++11 -I../../extsrc/boost feedback_unit_tests.cc -o feedback_unit_tests
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include <stdint.h>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+
+#include "feedback.h"
+
+static void
+test_primitive_count()
+{
+  assert(rsxgl_feedback_primitive_count(NV30_3D_VERTEX_BEGIN_END_POINTS,7) == 7);
+  assert(rsxgl_feedback_primitive_count(NV30_3D_VERTEX_BEGIN_END_LINES,7) == 3);
+  assert(rsxgl_feedback_primitive_count(NV30_3D_VERTEX_BEGIN_END_LINE_STRIP,7) == 6);
+  assert(rsxgl_feedback_primitive_count(NV30_3D_VERTEX_BEGIN_END_LINE_LOOP,7) == 7);
+  assert(rsxgl_feedback_primitive_count(NV30_3D_VERTEX_BEGIN_END_TRIANGLES,7) == 2);
+  assert(rsxgl_feedback_primitive_count(NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP,7) == 5);
+  assert(rsxgl_feedback_primitive_count(NV30_3D_VERTEX_BEGIN_END_TRIANGLE_FAN,7) == 5);
+
+  // Too few vertices for a single primitive:
+  assert(rsxgl_feedback_primitive_count(NV30_3D_VERTEX_BEGIN_END_LINE_STRIP,1) == 0);
+  assert(rsxgl_feedback_primitive_count(NV30_3D_VERTEX_BEGIN_END_LINE_LOOP,1) == 0);
+  assert(rsxgl_feedback_primitive_count(NV30_3D_VERTEX_BEGIN_END_TRIANGLE_FAN,2) == 0);
+
+  assert(rsxgl_feedback_primitive_size(NV30_3D_VERTEX_BEGIN_END_POINTS) == 1);
+  assert(rsxgl_feedback_primitive_size(NV30_3D_VERTEX_BEGIN_END_LINES) == 2);
+  assert(rsxgl_feedback_primitive_size(NV30_3D_VERTEX_BEGIN_END_TRIANGLES) == 3);
+}
+
+static void
+check_vertices(const uint32_t rsx_primitive_type,const uint32_t count,const uint32_t * expected,const uint32_t n)
+{
+  for(uint32_t i = 0;i < n;++i) {
+    assert(rsxgl_feedback_vertex(rsx_primitive_type,count,i) == expected[i]);
+  }
+}
+
+static void
+test_vertex_order()
+{
+  // Lists are captured as they're drawn:
+  for(uint32_t i = 0;i < 9;++i) {
+    assert(rsxgl_feedback_vertex(NV30_3D_VERTEX_BEGIN_END_TRIANGLES,9,i) == i);
+  }
+
+  static const uint32_t line_strip[] = { 0, 1, 1, 2, 2, 3 };
+  check_vertices(NV30_3D_VERTEX_BEGIN_END_LINE_STRIP,4,line_strip,6);
+
+  static const uint32_t line_loop[] = { 0, 1, 1, 2, 2, 0 };
+  check_vertices(NV30_3D_VERTEX_BEGIN_END_LINE_LOOP,3,line_loop,6);
+
+  // Every other triangle of a strip swaps its first two vertices, to keep the winding:
+  static const uint32_t triangle_strip[] = { 0, 1, 2, 2, 1, 3, 2, 3, 4, 4, 3, 5 };
+  check_vertices(NV30_3D_VERTEX_BEGIN_END_TRIANGLE_STRIP,6,triangle_strip,12);
+
+  static const uint32_t triangle_fan[] = { 0, 1, 2, 0, 2, 3, 0, 3, 4 };
+  check_vertices(NV30_3D_VERTEX_BEGIN_END_TRIANGLE_FAN,5,triangle_fan,9);
+}
+
+static void
+test_positions()
+{
+  int16_t position[2];
+
+  rsxgl_feedback_position(0,position);
+  assert(position[0] == 0 && position[1] == 1);
+
+  rsxgl_feedback_position(RSXGL_MAX_RENDERBUFFER_SIZE - 1,position);
+  assert(position[0] == RSXGL_MAX_RENDERBUFFER_SIZE - 1 && position[1] == 1);
+
+  rsxgl_feedback_position(RSXGL_MAX_RENDERBUFFER_SIZE + 5,position);
+  assert(position[0] == 5 && position[1] == 2);
+
+  // The packed form agrees with the table's:
+  for(uint32_t n = 0;n < RSXGL_MAX_RENDERBUFFER_SIZE * 3;n += 1001) {
+    rsxgl_feedback_position(n,position);
+
+    const uint32_t packed = rsxgl_feedback_position_2i(n);
+    assert(((packed & NV30_3D_VTX_ATTR_2I_X__MASK) >> NV30_3D_VTX_ATTR_2I_X__SHIFT) == (uint32_t)position[0]);
+    assert(((packed & NV30_3D_VTX_ATTR_2I_Y__MASK) >> NV30_3D_VTX_ATTR_2I_Y__SHIFT) == (uint32_t)position[1]);
+  }
+}
+
+static void
+test_blocks()
+{
+  rsxgl_feedback_block_t block = rsxgl_feedback_block(0,1);
+  assert(block.base == 0 && block.skew == 0);
+
+  block = rsxgl_feedback_block(7,1);
+  assert(block.base == 4 && block.skew == 3);
+
+  // Interleaved, 3 varyings per vertex:
+  block = rsxgl_feedback_block(5,3);
+  assert(block.base == 12 && block.skew == 3);
+
+  // Render targets always begin on a 64-byte boundary:
+  for(uint32_t slot = 0;slot < 100;++slot) {
+    for(uint32_t outputs = 1;outputs <= 4;++outputs) {
+      block = rsxgl_feedback_block(slot,outputs);
+      assert((block.base % 4) == 0);
+      assert(block.skew < 4);
+      assert(block.base + block.skew == slot * outputs);
+    }
+  }
+}
+
+int
+main(int argc,char ** argv)
+{
+  try {
+    test_primitive_count();
+    test_vertex_order();
+    test_positions();
+    test_blocks();
+
+    std::cout << "passed" << std::endl;
+  }
+  catch(const assertion & a) {
+    std::cerr << "failed: " << a.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
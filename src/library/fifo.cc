@@ -0,0 +1,229 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// fifo.cc - Manage the RSX command buffer.
+
+#include "fifo.h"
+#include "sync.h"
+#include "gl_fifo.h"
+#include "rsxgl_context.h"
+#include "perf_counters.h"
+
+#include "rsxgl_config.h"
+#include "rsxgl_limits.h"
+#include "gl_constants.h"
+#include "debug.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+extern "C" struct rsxgl_init_parameters_t rsxgl_init_parameters;
+
+// Words needed at the end of each segment for the label write & the jump:
+#define RSXGL_FIFO_SEGMENT_TAIL 5
+
+// Segments are made large enough for the largest reservation whose size is bounded - a vertex
+// program's upload (also larger than a method with GCM_MAX_METHOD_ARGS arguments, and than the
+// per-vertex transform feedback batches). Draw calls reserve space in proportion to their vertex
+// counts, without bound; a reservation larger than a segment spans several (see
+// rsxgl_fifo_span()):
+#define RSXGL_FIFO_MIN_SEGMENT_WORDS ((RSXGL__VERTEX__MAX_PROGRAM_INSTRUCTIONS * 5) + 7 + RSXGL_FIFO_SEGMENT_TAIL)
+
+rsxgl_fifo_t rsxgl_fifo = {
+  0,
+  0, 0, 0, 0,
+  0, 0,
+  0, 0,
+  0,
+  0, 0,
+  { 0, 0, 0, 0, 0 }
+};
+
+// The context's callback is called through a 32-bit function descriptor, as it would be for
+// a PRX callback:
+struct rsxgl_fifo_opd32_t {
+  uint32_t entry, toc;
+};
+
+static rsxgl_fifo_opd32_t rsxgl_fifo_callback_opd;
+
+static inline void
+rsxgl_fifo_segment_set(gcmContextData * context,const uint32_t segment)
+{
+  rsxgl_fifo.segment = segment;
+
+  uint32_t * begin = rsxgl_fifo.begin + segment * rsxgl_fifo.segment_words;
+  context -> end = begin + rsxgl_fifo.segment_words - RSXGL_FIFO_SEGMENT_TAIL;
+}
+
+// Wait for the GPU to finish everything that it's been sent:
+static inline void
+rsxgl_fifo_wait_idle()
+{
+  gcmControlRegister volatile *control = gcmGetControlRegister();
+  while(control -> get != control -> put) {
+    usleep(RSXGL_SYNC_SLEEP_INTERVAL);
+  }
+}
+
+// Make room for a reservation of count words, larger than a segment, by treating the first
+// nspan segments of the buffer as one. The GPU is sent back to the start of the buffer and
+// allowed to go idle, so that every segment is free. The span is closed like any other
+// segment, but its label write counts for all nspan of them:
+static int32_t
+rsxgl_fifo_span(gcmContextData * context,const uint32_t count)
+{
+  const uint32_t nspan = (count + RSXGL_FIFO_SEGMENT_TAIL + rsxgl_fifo.segment_words - 1) / rsxgl_fifo.segment_words;
+  if(nspan > rsxgl_fifo.nsegments) {
+    return -1;
+  }
+
+  ++rsxgl_fifo.statistics.segment_waits;
+
+  uint32_t begin_offset = 0;
+  int32_t s = gcmAddressToOffset(rsxgl_fifo.begin,&begin_offset);
+  rsxgl_assert(s == 0);
+
+  uint32_t * buffer = context -> current;
+  gcm_emit_at(buffer,0,gcm_jump_cmd(begin_offset));
+
+  rsxgl_fifo.statistics.words_kicked += (buffer + 1) - rsxgl_fifo.kicked;
+  rsxgl_fifo.words += (buffer + 1) - rsxgl_fifo.kicked;
+  rsxgl_fifo.kicked = rsxgl_fifo.begin;
+
+  context -> current = rsxgl_fifo.begin;
+  rsxgl_fifo_kick(context);
+  rsxgl_fifo_wait_idle();
+
+  // Segments are reused once the label passes the sequence number of the closing that left
+  // them; those of the span are left by the closing at sequence + nspan:
+  rsxgl_fifo.sequence += nspan - 1;
+
+  rsxgl_fifo.segment = nspan - 1;
+  context -> end = rsxgl_fifo.begin + (nspan * rsxgl_fifo.segment_words) - RSXGL_FIFO_SEGMENT_TAIL;
+
+  return 0;
+}
+
+extern "C" int32_t
+rsxgl_fifo_callback(gcmContextData * context,uint32_t count)
+{
+  rsxgl_assert(context == rsxgl_fifo.context);
+
+  ++rsxgl_fifo.statistics.reserve_callbacks;
+#if (RSXGL_CONFIG_perf_counters == 1)
+  if(rsxgl_ctx != 0) RSXGL_PERF_COUNT(rsxgl_ctx,reserve_callbacks,1);
+#endif
+
+  if((count + RSXGL_FIFO_SEGMENT_TAIL) > rsxgl_fifo.segment_words) {
+    return rsxgl_fifo_span(context,count);
+  }
+
+  const uint32_t next_segment = (rsxgl_fifo.segment + 1) % rsxgl_fifo.nsegments;
+  uint32_t * next = rsxgl_fifo.begin + next_segment * rsxgl_fifo.segment_words;
+
+  uint32_t next_offset = 0;
+  int32_t s = gcmAddressToOffset(next,&next_offset);
+  rsxgl_assert(s == 0);
+
+  // Close the current segment - the label tells the CPU that the GPU is finished with it:
+  const uint32_t sequence = ++rsxgl_fifo.sequence;
+
+  uint32_t * buffer = context -> current;
+  _rsxgl_emit_sync_gpu_signal_write(buffer,rsxgl_fifo.label,sequence);
+  gcm_emit_at(buffer,4,gcm_jump_cmd(next_offset));
+
+  rsxgl_fifo.statistics.words_kicked += (buffer + RSXGL_FIFO_SEGMENT_TAIL) - rsxgl_fifo.kicked;
+  rsxgl_fifo.words += (buffer + RSXGL_FIFO_SEGMENT_TAIL) - rsxgl_fifo.kicked;
+  rsxgl_fifo.kicked = next;
+
+  // Let the GPU run up to the start of the next segment:
+  context -> current = next;
+  rsxgl_fifo_segment_set(context,next_segment);
+  rsxgl_fifo_kick(context);
+
+  // The next segment was last left nsegments - 1 segments ago; wait for the GPU to get that far:
+  const int32_t required = (int32_t)(sequence + 1 - rsxgl_fifo.nsegments);
+  if(required > 0) {
+    volatile uint32_t * label = gcmGetLabelAddress(rsxgl_fifo.label);
+
+    if((int32_t)(*label - (uint32_t)required) < 0) {
+      ++rsxgl_fifo.statistics.segment_waits;
+
+      while((int32_t)(*label - (uint32_t)required) < 0) {
+	usleep(RSXGL_SYNC_SLEEP_INTERVAL);
+      }
+    }
+  }
+
+  return 0;
+}
+
+void
+rsxgl_fifo_init(gcmContextData * context)
+{
+  if(rsxgl_fifo.context != 0) return;
+
+  rsxgl_fifo.kick_words = rsxgl_init_parameters.kick_words;
+  rsxgl_fifo.kick_draws = rsxgl_init_parameters.kick_draws;
+  rsxgl_fifo.kicked = context -> current;
+
+  // Leave the command buffer to libgcm's callback; kick thresholds still apply. Fewer segments
+  // are used than asked for if they'd be too small:
+  const uint32_t nsegments = std::min(rsxgl_init_parameters.command_buffer_segments,(uint32_t)(context -> end - context -> begin) / RSXGL_FIFO_MIN_SEGMENT_WORDS);
+  if(nsegments < 2) {
+    rsxgl_fifo.context = context;
+    return;
+  }
+
+  const uint8_t label = rsxgl_sync_object_allocate();
+  rsxgl_assert(label != RSXGL_MAX_SYNC_OBJECTS);
+
+  // Jump back to the start of the command buffer, and wait for the GPU to be idle, so that
+  // every segment starts out free:
+  {
+    uint32_t begin_offset = 0;
+    int32_t s = gcmAddressToOffset(context -> begin,&begin_offset);
+    rsxgl_assert(s == 0);
+
+    uint32_t * buffer = gcm_reserve(context,1);
+    gcm_emit_at(buffer,0,gcm_jump_cmd(begin_offset));
+    context -> current = context -> begin;
+
+    rsxgl_fifo_kick(context);
+    rsxgl_fifo_wait_idle();
+  }
+
+  rsxgl_sync_cpu_signal(label,0);
+
+  rsxgl_fifo.begin = context -> begin;
+  rsxgl_fifo.nsegments = nsegments;
+  rsxgl_fifo.segment_words = (uint32_t)(context -> end - context -> begin) / nsegments;
+  rsxgl_fifo.label = label;
+  rsxgl_fifo.sequence = 0;
+  rsxgl_fifo.kicked = context -> current;
+
+  const uint64_t * opd = (const uint64_t *)(uintptr_t)rsxgl_fifo_callback;
+  rsxgl_fifo_callback_opd.entry = (uint32_t)opd[0];
+  rsxgl_fifo_callback_opd.toc = (uint32_t)opd[1];
+
+  rsxgl_fifo.context = context;
+  context -> callback = (gcmContextCallback)(uintptr_t)&rsxgl_fifo_callback_opd;
+
+  rsxgl_fifo_segment_set(context,0);
+}
+
+extern "C" void
+rsxglGetFifoStatistics(struct rsxgl_fifo_statistics_t * statistics,int reset)
+{
+  if(statistics != 0) {
+    *statistics = rsxgl_fifo.statistics;
+  }
+
+  if(reset) {
+    memset(&rsxgl_fifo.statistics,0,sizeof(rsxgl_fifo.statistics));
+  }
+}
@@ -0,0 +1,116 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// fifo.h - Manage the RSX command buffer.
+//
+// The command buffer set up by gcmInitBody() is divided into segments. When one fills up, a
+// label write & a jump to the next segment are appended to it; the CPU then only waits for the
+// GPU to finish the segment that's about to be reused, instead of for the GPU to catch up with
+// the whole buffer. The GPU is also "kicked" (its PUT pointer is advanced) after some number of
+// words or draw calls, so that it starts on a frame's work before glFlush() or a sync point.
+//
+// Segments are never smaller than the largest fixed-size reservation, a vertex program upload;
+// fewer segments are used than configured if need be, and libgcm's callback if fewer than two
+// would fit. A larger reservation (a draw call with many vertices) waits for the GPU to go idle,
+// then takes as many segments as it needs from the start of the buffer. Only a reservation
+// larger than the whole buffer fails.
+
+#ifndef rsxgl_fifo_H
+#define rsxgl_fifo_H
+
+#include <stdint.h>
+#include <ppu_intrinsics.h>
+#include <rsx/gcm_sys.h>
+
+#include <KHR/khrplatform.h>
+#include "GL3/rsxgl.h"
+#include "rsxgl_assert.h"
+
+struct rsxgl_fifo_t {
+  // The context whose command buffer is managed; 0 until rsxgl_fifo_init() is called:
+  gcmContextData * context;
+
+  uint32_t * begin;
+  uint32_t segment_words, nsegments, segment;
+
+  // Label written by the GPU upon leaving a segment, & the number of segments left so far:
+  uint8_t label;
+  uint32_t sequence;
+
+  // Position of the last kick, and the number of draws since:
+  uint32_t * kicked;
+  uint32_t draws;
+
+  // Words that the GPU has been kicked with; unlike the statistics, this is never reset:
+  uint64_t words;
+
+  // Kick thresholds - 0 disables either:
+  uint32_t kick_words, kick_draws;
+
+  struct rsxgl_fifo_statistics_t statistics;
+};
+
+extern rsxgl_fifo_t rsxgl_fifo;
+
+void rsxgl_fifo_init(gcmContextData *);
+
+// Advance the GPU's PUT pointer to the context's current position:
+static inline void
+rsxgl_fifo_kick(gcmContextData * context)
+{
+  rsxgl_assert(context -> callback != 0);
+
+  uint32_t offset;
+  gcmControlRegister volatile *control = gcmGetControlRegister();
+
+  __sync();
+
+  gcmAddressToOffset(context -> current, &offset);
+  control->put = offset;
+
+  if(context == rsxgl_fifo.context) {
+    // libgcm's callback may have wrapped around since the last kick:
+    if(context -> current >= rsxgl_fifo.kicked) {
+      rsxgl_fifo.statistics.words_kicked += context -> current - rsxgl_fifo.kicked;
+      rsxgl_fifo.words += context -> current - rsxgl_fifo.kicked;
+    }
+    ++rsxgl_fifo.statistics.kicks;
+    rsxgl_fifo.kicked = context -> current;
+    rsxgl_fifo.draws = 0;
+  }
+}
+
+// Kick the GPU, unless it's already been told about every command:
+static inline void
+rsxgl_fifo_kick_pending(gcmContextData * context)
+{
+  if(context == rsxgl_fifo.context && context -> current == rsxgl_fifo.kicked) return;
+
+  rsxgl_fifo_kick(context);
+}
+
+// Words added to the command buffer so far, whether or not the GPU has been kicked with them:
+static inline uint64_t
+rsxgl_fifo_words(gcmContextData * context)
+{
+  return rsxgl_fifo.words + ((context -> current >= rsxgl_fifo.kicked) ? (context -> current - rsxgl_fifo.kicked) : 0);
+}
+
+// Called after each draw call; kicks the GPU if either threshold has been crossed:
+static inline void
+rsxgl_fifo_draw(gcmContextData * context)
+{
+  if(context != rsxgl_fifo.context) return;
+
+  ++rsxgl_fifo.draws;
+
+  if((rsxgl_fifo.kick_draws != 0 && rsxgl_fifo.draws >= rsxgl_fifo.kick_draws) ||
+     (rsxgl_fifo.kick_words != 0 && (uint32_t)(context -> current - rsxgl_fifo.kicked) >= rsxgl_fifo.kick_words)) {
+    ++rsxgl_fifo.statistics.threshold_kicks;
+    rsxgl_fifo_kick(context);
+  }
+}
+
+#endif
@@ -21,6 +21,9 @@
 #include "pipe/p_screen.h"
 #include "util/u_format.h"
 
+#include <algorithm>
+#include <limits>
+
 extern "C" {
   enum pipe_format
   rsxgl_choose_format(struct pipe_screen *screen, GLenum internalFormat,
@@ -82,6 +85,8 @@ glGenRenderbuffers (GLsizei count, GLuint *renderbuffers)
 GLAPI void APIENTRY
 glDeleteRenderbuffers (GLsizei count, const GLuint *renderbuffers)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   struct rsxgl_context_t * ctx = current_ctx();
 
   for(GLsizei i = 0;i < count;++i,++renderbuffers) {
@@ -169,17 +174,14 @@ rsxgl_renderbuffer_storage(rsxgl_context_t * ctx,const renderbuffer_t::name_type
 
   renderbuffer_t & renderbuffer = renderbuffer_t::storage().at(renderbuffer_name);
 
-  // TODO - orphan instead of delete:
-  if(renderbuffer.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,renderbuffer.timestamp);
-    renderbuffer.timestamp = 0;
-  }
-
   surface_t & surface = renderbuffer.surface;
 
+  // Free the old storage once pending GPU operations are done with it:
   if(surface.memory.offset != 0) {
-    rsxgl_arena_free(memory_arena_t::storage().at(renderbuffer.arena),surface.memory);
+    rsxgl_deferred_free_arena(ctx,renderbuffer.timestamp,renderbuffer.arena,surface.memory,util_format_get_2d_size(renderbuffer.pformat,surface.pitch,renderbuffer.size[1]));
+    surface.memory = memory_t();
   }
+  renderbuffer.timestamp = 0;
 
   memory_arena_t::name_type arena = ctx -> arena_binding.names[RSXGL_RENDERBUFFER_ARENA];
 
@@ -187,10 +189,15 @@ rsxgl_renderbuffer_storage(rsxgl_context_t * ctx,const renderbuffer_t::name_type
   const uint32_t nbytes = util_format_get_2d_size(pformat,pitch,height);
 
   surface.memory = rsxgl_arena_allocate(memory_arena_t::storage().at(arena),128,nbytes);
+  if(surface.memory.offset == 0 && rsxgl_deferred_free_reclaim(ctx)) {
+    surface.memory = rsxgl_arena_allocate(memory_arena_t::storage().at(arena),128,nbytes);
+  }
   if(surface.memory.offset == 0) {
     RSXGL_ERROR_(GL_OUT_OF_MEMORY);
   }
 
+  renderbuffer.arena = arena;
+
   renderbuffer.glformat = glinternalformat;
   renderbuffer.pformat = pformat;
   renderbuffer.size[0] = width;
@@ -203,6 +210,8 @@ rsxgl_renderbuffer_storage(rsxgl_context_t * ctx,const renderbuffer_t::name_type
 GLAPI void APIENTRY
 glRenderbufferStorage (GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint32_t rsx_target = rsxgl_renderbuffer_target(target);
   if(rsx_target == RSXGL_MAX_RENDERBUFFER_TARGETS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -220,6 +229,8 @@ glRenderbufferStorage (GLenum target, GLenum internalformat, GLsizei width, GLsi
 GLAPI void APIENTRY
 glRenderbufferStorageMultisample (GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint32_t rsx_target = rsxgl_renderbuffer_target(target);
   if(rsx_target == RSXGL_MAX_RENDERBUFFER_TARGETS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -513,6 +524,8 @@ glGenFramebuffers (GLsizei n, GLuint *framebuffers)
 GLAPI void APIENTRY
 glDeleteFramebuffers (GLsizei n, const GLuint *framebuffers)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   struct rsxgl_context_t * ctx = current_ctx();
 
   for(GLsizei i = 0;i < n;++i,++framebuffers) {
@@ -571,6 +584,8 @@ glBindFramebuffer (GLenum target, GLuint framebuffer_name)
 GLAPI void APIENTRY
 glFramebufferTexture1D (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint32_t rsx_framebuffer_target = rsxgl_framebuffer_target(target);
   if(rsx_framebuffer_target == RSXGL_MAX_FRAMEBUFFER_TARGETS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -591,6 +606,8 @@ glFramebufferTexture1D (GLenum target, GLenum attachment, GLenum textarget, GLui
 GLAPI void APIENTRY
 glFramebufferTexture2D (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint32_t rsx_framebuffer_target = rsxgl_framebuffer_target(target);
   if(rsx_framebuffer_target == RSXGL_MAX_FRAMEBUFFER_TARGETS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -613,6 +630,8 @@ glFramebufferTexture2D (GLenum target, GLenum attachment, GLenum textarget, GLui
 GLAPI void APIENTRY
 glFramebufferTexture3D (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level, GLint zoffset)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint32_t rsx_framebuffer_target = rsxgl_framebuffer_target(target);
   if(rsx_framebuffer_target == RSXGL_MAX_FRAMEBUFFER_TARGETS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -633,6 +652,8 @@ glFramebufferTexture3D (GLenum target, GLenum attachment, GLenum textarget, GLui
 GLAPI void APIENTRY
 glFramebufferRenderbuffer (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint32_t rsx_framebuffer_target = rsxgl_framebuffer_target(target);
   if(rsx_framebuffer_target == RSXGL_MAX_FRAMEBUFFER_TARGETS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -762,6 +783,8 @@ rsxgl_get_framebuffer_attachment_parameteriv(rsxgl_context_t * ctx,const framebu
 GLAPI void APIENTRY
 glGetFramebufferAttachmentParameteriv (GLenum target, GLenum attachment, GLenum pname, GLint *params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint32_t rsx_framebuffer_target = rsxgl_framebuffer_target(target);
   if(rsx_framebuffer_target == RSXGL_MAX_FRAMEBUFFER_TARGETS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -790,6 +813,8 @@ glBlitFramebuffer (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dst
 GLAPI void APIENTRY
 glFramebufferTextureLayer (GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint32_t rsx_framebuffer_target = rsxgl_framebuffer_target(target);
   if(rsx_framebuffer_target == RSXGL_MAX_FRAMEBUFFER_TARGETS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -806,6 +831,8 @@ glFramebufferTextureLayer (GLenum target, GLenum attachment, GLuint texture, GLi
 GLAPI void APIENTRY
 glFramebufferTexture (GLenum target, GLenum attachment, GLuint texture, GLint level)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint32_t rsx_framebuffer_target = rsxgl_framebuffer_target(target);
   if(rsx_framebuffer_target == RSXGL_MAX_FRAMEBUFFER_TARGETS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -1058,6 +1085,7 @@ rsxgl_emit_surface(gcmContextData * context,const uint8_t which,surface_t const
 void
 rsxgl_renderbuffer_validate(rsxgl_context_t * ctx,renderbuffer_t & renderbuffer,uint32_t timestamp)
 {
+  renderbuffer.timestamp = timestamp;
 }
 
 static inline write_mask_t
@@ -1271,6 +1299,8 @@ rsxgl_framebuffer_validate_complete(rsxgl_context_t * ctx,framebuffer_t & frameb
 GLAPI GLenum APIENTRY
 glCheckFramebufferStatus (GLenum target)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint32_t rsx_framebuffer_target = rsxgl_framebuffer_target(target);
   if(rsx_framebuffer_target == RSXGL_MAX_FRAMEBUFFER_TARGETS) {
     RSXGL_ERROR(GL_INVALID_ENUM,0);
@@ -1296,6 +1326,8 @@ glCheckFramebufferStatus (GLenum target)
 GLAPI void APIENTRY
 glReadPixels (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid *pixels)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(width < 0 || height < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
@@ -1582,29 +1614,38 @@ rsxgl_draw_framebuffer_validate(rsxgl_context_t * ctx,uint32_t timestamp)
   }
 }
 
-bool
-rsxgl_feedback_framebuffer_check(rsxgl_context_t * ctx,uint32_t offset,uint32_t count)
+uint32_t
+rsxgl_feedback_framebuffer_capacity(rsxgl_context_t * ctx)
 {
   const program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
   rsxgl_assert(program.streamfp_num_outputs <= RSXGL_MAX_COLOR_ATTACHMENTS);
 
+  // Each varying is captured as a vec4; interleaved varyings share the first buffer:
   const uint32_t attrib_stride = sizeof(float) * 4;
-  const uint32_t length = attrib_stride * count;
+  const uint32_t vertex_stride = program.streamfp_interleaved ? (attrib_stride * program.streamfp_num_outputs) : attrib_stride;
+  const unsigned int num_buffers = program.streamfp_interleaved ? 1 : program.streamfp_num_outputs;
+
+  if(num_buffers == 0 || vertex_stride == 0) {
+    return 0;
+  }
+
+  uint32_t capacity = std::numeric_limits< uint32_t >::max();
 
   size_t binding = RSXGL_TRANSFORM_FEEDBACK_BUFFER0, range_binding = RSXGL_TRANSFORM_FEEDBACK_BUFFER_RANGE0;
-  for(unsigned int i = 0;i < program.streamfp_num_outputs;++i,++binding,++range_binding) {
+  for(unsigned int i = 0;i < num_buffers;++i,++binding,++range_binding) {
     if(ctx -> buffer_binding.names[binding] == 0 ||
-       (offset + length) > ctx -> buffer_binding_offset_size[range_binding].second ||
        ctx -> buffer_binding[binding].mapped) {
-      return false;
+      return 0;
     }
+
+    capacity = std::min(capacity,(uint32_t)(ctx -> buffer_binding_offset_size[range_binding].second / vertex_stride));
   }
 
-  return true;
+  return capacity;
 }
 
 void
-rsxgl_feedback_framebuffer_validate(rsxgl_context_t * ctx,uint32_t offset,uint32_t count,uint32_t timestamp)
+rsxgl_feedback_framebuffer_validate(rsxgl_context_t * ctx,uint32_t base,uint32_t count,uint32_t timestamp)
 {
   gcmContextData * context = ctx -> gcm_context();
 
@@ -1618,19 +1659,27 @@ rsxgl_feedback_framebuffer_validate(rsxgl_context_t * ctx,uint32_t offset,uint32
   const uint16_t depth_mask = 0;
 
   const uint32_t attrib_length = sizeof(float) * 4;
-  const uint32_t length = attrib_length * count;
+  const uint32_t offset = attrib_length * base;
   const uint32_t pitch = attrib_length * RSXGL_MAX_RENDERBUFFER_SIZE;
 
-  size_t binding = RSXGL_TRANSFORM_FEEDBACK_BUFFER0, range_binding = RSXGL_TRANSFORM_FEEDBACK_BUFFER_RANGE0, surface = RSXGL_FRAMEBUFFER_SURFACE_COLOR0;
-  for(unsigned int i = 0;i < program.streamfp_num_outputs;++i,++binding,++range_binding,++surface) {
-    rsxgl_assert(ctx -> buffer_binding.names[binding] != 0 && (offset + length) < ctx -> buffer_binding_offset_size[range_binding].second);
+  // Interleaved varyings each get a render target that begins one pixel after the previous one's:
+  size_t surface = RSXGL_FRAMEBUFFER_SURFACE_COLOR0;
+  for(unsigned int i = 0;i < program.streamfp_num_outputs;++i,++surface) {
+    const unsigned int buffer_index = program.streamfp_interleaved ? 0 : i;
+    const size_t binding = RSXGL_TRANSFORM_FEEDBACK_BUFFER0 + buffer_index, range_binding = RSXGL_TRANSFORM_FEEDBACK_BUFFER_RANGE0 + buffer_index;
+
+    rsxgl_assert(ctx -> buffer_binding.names[binding] != 0 && offset < ctx -> buffer_binding_offset_size[range_binding].second);
 
     buffer_t & buffer = ctx -> buffer_binding[binding];
     const uint32_t buffer_offset = ctx -> buffer_binding_offset_size[range_binding].first + offset;
 
-    rsxgl_buffer_validate(ctx,buffer,buffer_offset,length,timestamp);
+    if(!program.streamfp_interleaved || i == 0) {
+      const uint32_t length = std::min(attrib_length * count,(uint32_t)ctx -> buffer_binding_offset_size[range_binding].second - offset);
+      rsxgl_buffer_validate(ctx,buffer,buffer_offset,length,timestamp);
+    }
 
-    rsxgl_emit_surface(context,surface,surface_t(buffer.memory + buffer_offset,pitch));
+    const uint32_t surface_offset = program.streamfp_interleaved ? (buffer_offset + (attrib_length * i)) : buffer_offset;
+    rsxgl_emit_surface(context,surface,surface_t(buffer.memory + surface_offset,pitch));
 
     if(i == 0) {
       color_targets |= (NV30_3D_RT_ENABLE_COLOR0);
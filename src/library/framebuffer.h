@@ -152,7 +152,13 @@ struct rsxgl_context_t;
 void rsxgl_renderbuffer_validate(rsxgl_context_t *,renderbuffer_t &,uint32_t);
 void rsxgl_framebuffer_validate(rsxgl_context_t *,framebuffer_t &,uint32_t);
 void rsxgl_draw_framebuffer_validate(rsxgl_context_t *,uint32_t);
-bool rsxgl_feedback_framebuffer_check(rsxgl_context_t *,uint32_t,uint32_t);
+
+// Vertices that the transform feedback buffers bound for the active program's varyings can hold;
+// 0 if any of them is missing or mapped:
+uint32_t rsxgl_feedback_framebuffer_capacity(rsxgl_context_t *);
+
+// Render into the transform feedback buffers, starting at the given pixel (4-pixel aligned) and
+// covering the given number of pixels; see feedback.h:
 void rsxgl_feedback_framebuffer_validate(rsxgl_context_t *,uint32_t,uint32_t,uint32_t);
 
 #endif
@@ -5,6 +5,7 @@
 // get.cc - Implement glGet*() functions.
 
 #include <GL3/gl3.h>
+#include "GL3/gl3ext.h"
 
 #include "rsxgl_context.h"
 #include "error.h"
@@ -15,6 +16,20 @@
 #endif
 #define GLAPI extern "C"
 
+// Accepted by glCompressedTexImage*():
+static const GLenum rsxgl_compressed_texture_formats[] = {
+  GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+  GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+  GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,
+  GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+  GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,
+  GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT,
+  GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT,
+  GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT,
+  GL_COMPRESSED_RED_RGTC1,
+  GL_COMPRESSED_RG_RGTC2
+};
+
 template< typename T >
 static inline void
 rsxgl_get(rsxgl_context_t * ctx,const GLenum pname, T * params)
@@ -25,6 +40,14 @@ rsxgl_get(rsxgl_context_t * ctx,const GLenum pname, T * params)
   else if(pname == GL_MAX_TEXTURE_SIZE) {
     *params = RSXGL_MAX_TEXTURE_SIZE;
   }
+  else if(pname == GL_NUM_COMPRESSED_TEXTURE_FORMATS) {
+    *params = sizeof(rsxgl_compressed_texture_formats) / sizeof(GLenum);
+  }
+  else if(pname == GL_COMPRESSED_TEXTURE_FORMATS) {
+    for(size_t i = 0,n = sizeof(rsxgl_compressed_texture_formats) / sizeof(GLenum);i < n;++i) {
+      params[i] = rsxgl_compressed_texture_formats[i];
+    }
+  }
   else {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
@@ -72,7 +95,7 @@ glGetString (GLenum name)
     RSXGL_NOERROR((const GLubyte *)"1.30");
   }
   else if(name == GL_EXTENSIONS) {
-    RSXGL_NOERROR((const GLubyte *)"");
+    RSXGL_NOERROR((const GLubyte *)"GL_EXT_texture_compression_s3tc");
   }
   else {
     RSXGL_ERROR(GL_INVALID_ENUM,0);
@@ -12,14 +12,21 @@ extern "C" {
 
 int32_t __attribute__((noinline)) gcm_reserve_callback(gcmContextData *,uint32_t);
 
+// Called instead of gcm_reserve_callback for the gcmContextData used to record command lists,
+// which has no PRX callback (see command_list.h):
+int32_t rsxgl_command_list_reserve_callback(gcmContextData *,uint32_t);
+
 // TODO - Compile-time option to make the command buffer length checking in gcm_reserve
 // a no-op. The application would need to make sure that it creates an adequately-sized
 // command buffer that is flushed regularly.
+//
+// The callback always makes room for length words, spanning segments if it must (see fifo.h);
+// it fails only if the reservation is larger than the whole command buffer.
 static inline uint32_t *
 gcm_reserve(gcmContextData * context,const uint32_t length)
 {
   if((context -> current + length) > context -> end) {
-    int32_t r = gcm_reserve_callback(context,length);
+    int32_t r = (context -> callback != 0) ? gcm_reserve_callback(context,length) : rsxgl_command_list_reserve_callback(context,length);
     rsxgl_assert(r == 0);
   }
   return context -> current;
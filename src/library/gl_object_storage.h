@@ -14,7 +14,9 @@
 // themselves; these classes support that pattern.
 //
 // Objects are stored contigously in C-style arrays that grow as
-// new objects are added. Instances of the classes contained herein
+// new objects are added; arrays grow geometrically, so that creating
+// many objects in a row doesn't move them over & over again (see
+// striped_object_relocate for how they're moved). Instances of the classes contained herein
 // "own" the objects, handling their destruction when the objects are
 // destroyed or when the namespace array itself goes out of scope.
 //
@@ -69,7 +71,8 @@ public:
 
   typedef ObjectsT objects_type;
 
-  typedef striped_object_array< ObjectsT, name_type, ObjectAlign > contents_type;
+  // Sized by the namespace's size_type, which can hold MaxObjects itself:
+  typedef striped_object_array< ObjectsT, typename name_space_type::size_type, ObjectAlign > contents_type;
   typename contents_type::pointers_type m_contents, m_orphans;
 
   typedef typename contents_type::size_type size_type;
@@ -78,11 +81,40 @@ public:
   size_type m_contents_size;
   orphan_size_type m_orphans_size;
 
-  static const size_type m_contents_grow = 1;
-  static const size_type m_orphans_grow = 1;
-
   orphan_size_type m_num_orphans;
 
+  // Size to grow an array to so that it holds at least required elements:
+  static size_type grow_size(const size_type size,const size_type required) {
+    const size_t grown = std::max((size_t)required,(size_t)size * 2);
+    return (size_type)std::min(grown,(size_t)MaxObjects);
+  }
+
+  // Predicates that select the objects to keep when arrays are resized or destroyed:
+  struct created_predicate {
+    const name_space_type & name_space;
+
+    created_predicate(const name_space_type & _name_space)
+      : name_space(_name_space) {
+    }
+
+    // The contents array may have grown past the names created so far:
+    bool operator()(const size_type name) const {
+      return name < name_space.capacity() && name_space.template test_user_bit< 0 >(name);
+    }
+  };
+
+  struct orphan_predicate {
+    const orphan_size_type num_orphans;
+
+    orphan_predicate(const orphan_size_type _num_orphans)
+      : num_orphans(_num_orphans) {
+    }
+
+    bool operator()(const orphan_size_type i) const {
+      return i < num_orphans;
+    }
+  };
+
   //
   typename contents_type::type contents() {
     return typename contents_type::type(m_contents,m_contents_size);
@@ -114,8 +146,8 @@ public:
   striped_gl_object_storage(const name_type initial_size = 0,void (*init_default_object)(void *) = 0)
     : m_num_orphans(0)
   {
-    contents().allocate(std::max((name_type)1,initial_size));
-    orphans().allocate(std::max((typename contents_type::size_type)1,initial_size));
+    contents().allocate(std::max((size_type)1,(size_type)initial_size));
+    orphans().allocate(std::max((orphan_size_type)1,(orphan_size_type)initial_size));
 
     // create object name 0:
     name_type name = create_name();
@@ -130,20 +162,8 @@ public:
   }
 
   ~striped_gl_object_storage() {
-    struct created_predicate {
-      name_space_type & name_space;
-
-      created_predicate(name_space_type & _name_space)
-	: name_space(_name_space) {
-      }
-
-      bool operator()(const name_type name) const {
-	return name_space.template test_user_bit< 0 >(name);
-      }
-    } p(m_name_space);
-
-    contents().destruct(p);
-    orphans().destruct(p);
+    contents().destruct(created_predicate(m_name_space));
+    orphans().destruct(orphan_predicate(m_num_orphans));
   }
 
   name_type create_name() {
@@ -192,7 +212,7 @@ public:
     if(is_name(name) && is_constructed(name)) {
       // Make room for another orphan:
       if(m_num_orphans >= orphans().size) {
-	orphans().resize(m_num_orphans + m_orphans_grow);
+	orphans().resize(grow_size(orphans().size,m_num_orphans + 1),orphan_predicate(m_num_orphans));
       }
       contents_type::move_item(orphans(),m_num_orphans,contents(),name);
       m_name_space.destroy_name(name);
@@ -223,7 +243,7 @@ public:
 
     // Construct the object:
     if(name >= contents().size) {
-      contents().resize(name + m_contents_grow);
+      contents().resize(grow_size(contents().size,(size_type)name + 1),created_predicate(m_name_space));
     }
 
     contents().construct_item(name);
@@ -0,0 +1,177 @@
+// Microbenchmark for striped_gl_object_storage - creates & deletes 65535 objects, which is what
+// a level load that creates thousands of buffers & textures does. Meant to be built & run on the
+// host, e.g.:
+//
+// g++ -std=c++11 -O2 -I. -I../../extsrc/boost gl_object_storage_benchmark.cc -o gl_object_storage_benchmark
+//
+// Two object types are used: one that's moved bitwise when the storage grows, and one with
+// std::string & std::unique_ptr members that's move-constructed instead (see
+// striped_object_relocate). The contents of each object are checked after all of them have
+// been created, and after some of them have been orphaned.
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <memory>
+#include <chrono>
+
+#include <stdint.h>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+#define rsxgl_assert assert
+
+#include "gl_object_storage.h"
+
+static const size_t max_objects = (1 << 16);
+
+struct plain_object {
+  uint32_t name;
+  uint32_t contents[15];
+
+  plain_object() : name(0) {
+  }
+};
+
+struct string_object {
+  std::string name;
+  std::unique_ptr< uint32_t[] > contents;
+
+  string_object() : contents(new uint32_t[16]) {
+  }
+
+  string_object(string_object &&) = default;
+};
+
+template<>
+struct striped_object_relocate< string_object > : public striped_object_move_relocate< string_object > {
+};
+
+static std::string
+to_string(const uint32_t i)
+{
+  std::stringstream s;
+  s << "object " << i;
+  return s.str();
+}
+
+static void
+set(plain_object & object,const uint32_t i)
+{
+  object.name = i;
+}
+
+static bool
+check(const plain_object & object,const uint32_t i)
+{
+  return object.name == i;
+}
+
+static void
+set(string_object & object,const uint32_t i)
+{
+  object.name = to_string(i);
+  object.contents[0] = i;
+}
+
+static bool
+check(const string_object & object,const uint32_t i)
+{
+  return object.name == to_string(i) && object.contents[0] == i;
+}
+
+typedef std::chrono::high_resolution_clock clock_type;
+
+static double
+elapsed_ms(const clock_type::time_point & t0)
+{
+  return std::chrono::duration< double, std::milli >(clock_type::now() - t0).count();
+}
+
+template< typename Object >
+static void
+benchmark(const std::string & type_name)
+{
+  typedef gl_object_storage< Object, max_objects > storage_type;
+  typedef typename storage_type::name_type name_type;
+
+  storage_type storage;
+
+  const size_t n = max_objects - 1;
+  std::unique_ptr< name_type[] > names(new name_type[n]);
+
+  // Create every possible object:
+  size_t resizes = 0;
+  clock_type::time_point t0 = clock_type::now();
+  for(size_t i = 0;i < n;++i) {
+    const typename storage_type::size_type size = storage.contents_size();
+    names[i] = storage.create_name_and_object();
+    if(storage.contents_size() != size) ++resizes;
+  }
+  const double create_ms = elapsed_ms(t0);
+
+  for(size_t i = 0;i < n;++i) {
+    set(storage.at(names[i]),names[i]);
+  }
+
+  // Grow the storage some more, by orphaning objects:
+  const size_t norphans = n / 16;
+  for(size_t i = 0;i < norphans;++i) {
+    assert(storage.orphan(names[i]).second);
+  }
+
+  for(size_t i = 0;i < norphans;++i) {
+    assert(check(storage.orphan_at(i),names[i]));
+  }
+  for(size_t i = norphans;i < n;++i) {
+    assert(check(storage.at(names[i]),names[i]));
+  }
+
+  storage.destroy_orphans();
+
+  // Delete the rest:
+  t0 = clock_type::now();
+  for(size_t i = norphans;i < n;++i) {
+    storage.destroy(names[i]);
+  }
+  const double destroy_ms = elapsed_ms(t0);
+
+  // Create them all again - the storage doesn't need to grow this time:
+  t0 = clock_type::now();
+  for(size_t i = 0;i < n;++i) {
+    names[i] = storage.create_name_and_object();
+  }
+  const double recreate_ms = elapsed_ms(t0);
+
+  for(size_t i = 0;i < n;++i) {
+    storage.destroy(names[i]);
+  }
+
+  std::cout << type_name << ": " << n << " objects, "
+	    << "create: " << create_ms << "ms (" << resizes << " resizes) "
+	    << "destroy: " << destroy_ms << "ms "
+	    << "create again: " << recreate_ms << "ms" << std::endl;
+}
+
+int
+main(int argc, char ** argv)
+{
+  try {
+    benchmark< plain_object >("plain_object");
+    benchmark< string_object >("string_object");
+  }
+  catch(const assertion & a) {
+    std::cerr << "failed: " << a.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
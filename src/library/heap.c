@@ -0,0 +1,644 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// heap.c - Allocate GPU-visible memory, keeping the allocator's bookkeeping in main memory.
+
+#include "heap.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define RSXGL_HEAP_BINS 32
+#define RSXGL_HEAP_SLAB_MAX_SLOTS (RSXGL_HEAP_SLAB_PAGE_SIZE / RSXGL_HEAP_GRANULE)
+#define RSXGL_HEAP_SLAB_WORDS (RSXGL_HEAP_SLAB_MAX_SLOTS / 32)
+#define RSXGL_HEAP_TABLE_MIN_CAPACITY 256
+
+struct rsxgl_heap_slab_t;
+
+// Describes a contiguous range of the heap's memory, either free or allocated:
+struct rsxgl_heap_block_t {
+  uint32_t offset, size;
+
+  // Neighbours in address order:
+  struct rsxgl_heap_block_t * prev, * next;
+
+  // Neighbours in the block's bin, if it's free; spare descriptors are also linked by free_next:
+  struct rsxgl_heap_block_t * free_prev, * free_next;
+
+  // Set if the block is a slab page:
+  struct rsxgl_heap_slab_t * slab;
+
+  uint8_t free, bin;
+};
+
+// A page divided into equally-sized slots:
+struct rsxgl_heap_slab_t {
+  struct rsxgl_heap_block_t * block;
+
+  // Neighbours in its size class's list of slabs that have free slots:
+  struct rsxgl_heap_slab_t * prev, * next;
+
+  uint32_t used[RSXGL_HEAP_SLAB_WORDS];
+  uint16_t nused, nslots;
+  uint8_t size_class, partial;
+};
+
+struct rsxgl_heap_t {
+  uintptr_t base;
+  uint32_t size;
+
+  struct rsxgl_heap_block_t * first;
+
+  // Free blocks, binned by the floor of the log2 of their size; bit i of bins_bitmap is set if
+  // bin i is non-empty:
+  uint32_t bins_bitmap;
+  struct rsxgl_heap_block_t * bins[RSXGL_HEAP_BINS];
+
+  struct rsxgl_heap_block_t * spare;
+
+  // Allocated blocks, hashed by their offset (open addressing, linear probing):
+  struct rsxgl_heap_block_t ** table;
+  uint32_t table_capacity, table_count;
+
+  struct rsxgl_heap_slab_t * partial[RSXGL_HEAP_SLAB_CLASSES];
+  uint32_t nslabs[RSXGL_HEAP_SLAB_CLASSES];
+
+  uint32_t free, free_blocks, allocations, slab_pages;
+};
+
+static inline uint32_t
+rsxgl_heap_log2(uint32_t x)
+{
+  return 31 - __builtin_clz(x);
+}
+
+static inline uint32_t
+rsxgl_heap_round_size(uint32_t size)
+{
+  return (size == 0) ? RSXGL_HEAP_GRANULE : ((size + (RSXGL_HEAP_GRANULE - 1)) & ~(RSXGL_HEAP_GRANULE - 1));
+}
+
+//
+// Block descriptors:
+static struct rsxgl_heap_block_t *
+rsxgl_heap_block_new(struct rsxgl_heap_t * heap)
+{
+  struct rsxgl_heap_block_t * block = heap -> spare;
+  if(block != 0) {
+    heap -> spare = block -> free_next;
+  }
+  else {
+    block = (struct rsxgl_heap_block_t *)malloc(sizeof(struct rsxgl_heap_block_t));
+    if(block == 0) return 0;
+  }
+
+  memset(block,0,sizeof(struct rsxgl_heap_block_t));
+  return block;
+}
+
+static void
+rsxgl_heap_block_delete(struct rsxgl_heap_t * heap,struct rsxgl_heap_block_t * block)
+{
+  block -> free_next = heap -> spare;
+  heap -> spare = block;
+}
+
+//
+// Bins:
+static void
+rsxgl_heap_bin_insert(struct rsxgl_heap_t * heap,struct rsxgl_heap_block_t * block)
+{
+  const uint32_t bin = rsxgl_heap_log2(block -> size);
+
+  block -> free = 1;
+  block -> bin = bin;
+  block -> free_prev = 0;
+  block -> free_next = heap -> bins[bin];
+  if(block -> free_next != 0) block -> free_next -> free_prev = block;
+  heap -> bins[bin] = block;
+  heap -> bins_bitmap |= (1u << bin);
+
+  heap -> free += block -> size;
+  ++heap -> free_blocks;
+}
+
+static void
+rsxgl_heap_bin_remove(struct rsxgl_heap_t * heap,struct rsxgl_heap_block_t * block)
+{
+  assert(block -> free);
+
+  const uint32_t bin = block -> bin;
+
+  if(block -> free_prev != 0) block -> free_prev -> free_next = block -> free_next;
+  else heap -> bins[bin] = block -> free_next;
+  if(block -> free_next != 0) block -> free_next -> free_prev = block -> free_prev;
+  if(heap -> bins[bin] == 0) heap -> bins_bitmap &= ~(1u << bin);
+
+  block -> free = 0;
+  block -> free_prev = block -> free_next = 0;
+
+  heap -> free -= block -> size;
+  --heap -> free_blocks;
+}
+
+//
+// Table of allocated blocks:
+static inline uint32_t
+rsxgl_heap_hash(const struct rsxgl_heap_t * heap,uint32_t offset)
+{
+  return ((offset / RSXGL_HEAP_GRANULE) * 2654435761u) & (heap -> table_capacity - 1);
+}
+
+static void rsxgl_heap_table_insert(struct rsxgl_heap_t *,struct rsxgl_heap_block_t *);
+
+static int
+rsxgl_heap_table_grow(struct rsxgl_heap_t * heap)
+{
+  struct rsxgl_heap_block_t ** table = heap -> table;
+  const uint32_t capacity = heap -> table_capacity;
+
+  heap -> table_capacity = (capacity == 0) ? RSXGL_HEAP_TABLE_MIN_CAPACITY : capacity * 2;
+  heap -> table = (struct rsxgl_heap_block_t **)calloc(heap -> table_capacity,sizeof(struct rsxgl_heap_block_t *));
+  if(heap -> table == 0) {
+    heap -> table = table;
+    heap -> table_capacity = capacity;
+    return 0;
+  }
+
+  heap -> table_count = 0;
+  for(uint32_t i = 0;i < capacity;++i) {
+    if(table[i] != 0) rsxgl_heap_table_insert(heap,table[i]);
+  }
+  free(table);
+
+  return 1;
+}
+
+static void
+rsxgl_heap_table_insert(struct rsxgl_heap_t * heap,struct rsxgl_heap_block_t * block)
+{
+  const uint32_t mask = heap -> table_capacity - 1;
+  uint32_t i = rsxgl_heap_hash(heap,block -> offset);
+  while(heap -> table[i] != 0) {
+    i = (i + 1) & mask;
+  }
+  heap -> table[i] = block;
+  ++heap -> table_count;
+}
+
+static uint32_t
+rsxgl_heap_table_find(const struct rsxgl_heap_t * heap,uint32_t offset)
+{
+  const uint32_t mask = heap -> table_capacity - 1;
+  uint32_t i = rsxgl_heap_hash(heap,offset);
+  while(heap -> table[i] != 0) {
+    if(heap -> table[i] -> offset == offset) return i;
+    i = (i + 1) & mask;
+  }
+  return heap -> table_capacity;
+}
+
+static inline struct rsxgl_heap_block_t *
+rsxgl_heap_table_lookup(const struct rsxgl_heap_t * heap,uint32_t offset)
+{
+  const uint32_t i = rsxgl_heap_table_find(heap,offset);
+  return (i == heap -> table_capacity) ? 0 : heap -> table[i];
+}
+
+// Backward-shift deletion, so that lookups never need tombstones:
+static void
+rsxgl_heap_table_remove(struct rsxgl_heap_t * heap,struct rsxgl_heap_block_t * block)
+{
+  const uint32_t mask = heap -> table_capacity - 1;
+  uint32_t i = rsxgl_heap_table_find(heap,block -> offset);
+  assert(i != heap -> table_capacity);
+
+  uint32_t j = i;
+  for(;;) {
+    j = (j + 1) & mask;
+    if(heap -> table[j] == 0) break;
+
+    const uint32_t k = rsxgl_heap_hash(heap,heap -> table[j] -> offset);
+    if((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+      heap -> table[i] = heap -> table[j];
+      i = j;
+    }
+  }
+  heap -> table[i] = 0;
+  --heap -> table_count;
+}
+
+//
+// Blocks:
+static inline uint32_t
+rsxgl_heap_align_offset(const struct rsxgl_heap_t * heap,uint32_t offset,uint32_t align)
+{
+  return (uint32_t)(((heap -> base + offset + (align - 1)) & ~((uintptr_t)align - 1)) - heap -> base);
+}
+
+// Splits [offset,offset + size) out of the free block, which is returned as an allocated block:
+static struct rsxgl_heap_block_t *
+rsxgl_heap_block_take(struct rsxgl_heap_t * heap,struct rsxgl_heap_block_t * block,uint32_t offset,uint32_t size)
+{
+  struct rsxgl_heap_block_t * front = 0, * back = 0;
+
+  if(offset > block -> offset) {
+    front = rsxgl_heap_block_new(heap);
+    if(front == 0) return 0;
+  }
+  if((offset + size) < (block -> offset + block -> size)) {
+    back = rsxgl_heap_block_new(heap);
+    if(back == 0) {
+      if(front != 0) rsxgl_heap_block_delete(heap,front);
+      return 0;
+    }
+  }
+
+  rsxgl_heap_bin_remove(heap,block);
+
+  if(front != 0) {
+    front -> offset = block -> offset;
+    front -> size = offset - block -> offset;
+    front -> prev = block -> prev;
+    front -> next = block;
+    if(block -> prev != 0) block -> prev -> next = front;
+    else heap -> first = front;
+    block -> prev = front;
+    rsxgl_heap_bin_insert(heap,front);
+  }
+  if(back != 0) {
+    back -> offset = offset + size;
+    back -> size = (block -> offset + block -> size) - back -> offset;
+    back -> prev = block;
+    back -> next = block -> next;
+    if(block -> next != 0) block -> next -> prev = back;
+    block -> next = back;
+    rsxgl_heap_bin_insert(heap,back);
+  }
+
+  block -> offset = offset;
+  block -> size = size;
+  return block;
+}
+
+static struct rsxgl_heap_block_t *
+rsxgl_heap_block_allocate(struct rsxgl_heap_t * heap,uint32_t align,uint32_t size)
+{
+  if(heap -> table_count + 1 > heap -> table_capacity / 2) {
+    if(!rsxgl_heap_table_grow(heap)) return 0;
+  }
+
+  // Start with the bin that size falls into - it may contain blocks that are large enough -
+  // then move up to bins whose blocks all are:
+  uint32_t bins = heap -> bins_bitmap & ~((1u << rsxgl_heap_log2(size)) - 1);
+  while(bins != 0) {
+    const uint32_t bin = __builtin_ctz(bins);
+    bins &= ~(1u << bin);
+
+    for(struct rsxgl_heap_block_t * block = heap -> bins[bin];block != 0;block = block -> free_next) {
+      const uint32_t offset = rsxgl_heap_align_offset(heap,block -> offset,align);
+      if(offset + size <= block -> offset + block -> size) {
+	block = rsxgl_heap_block_take(heap,block,offset,size);
+	if(block == 0) return 0;
+
+	rsxgl_heap_table_insert(heap,block);
+	return block;
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Returns the block to the free bins, merging it with free neighbours:
+static void
+rsxgl_heap_block_release(struct rsxgl_heap_t * heap,struct rsxgl_heap_block_t * block)
+{
+  rsxgl_heap_table_remove(heap,block);
+  block -> slab = 0;
+
+  struct rsxgl_heap_block_t * prev = block -> prev, * next = block -> next;
+
+  if(next != 0 && next -> free) {
+    rsxgl_heap_bin_remove(heap,next);
+    block -> size += next -> size;
+    block -> next = next -> next;
+    if(next -> next != 0) next -> next -> prev = block;
+    rsxgl_heap_block_delete(heap,next);
+  }
+  if(prev != 0 && prev -> free) {
+    rsxgl_heap_bin_remove(heap,prev);
+    prev -> size += block -> size;
+    prev -> next = block -> next;
+    if(block -> next != 0) block -> next -> prev = prev;
+    rsxgl_heap_block_delete(heap,block);
+    block = prev;
+  }
+
+  rsxgl_heap_bin_insert(heap,block);
+}
+
+//
+// Slabs:
+static inline uint32_t
+rsxgl_heap_slab_slot_size(uint32_t size_class)
+{
+  return RSXGL_HEAP_GRANULE << size_class;
+}
+
+static void
+rsxgl_heap_slab_link(struct rsxgl_heap_t * heap,struct rsxgl_heap_slab_t * slab)
+{
+  slab -> partial = 1;
+  slab -> prev = 0;
+  slab -> next = heap -> partial[slab -> size_class];
+  if(slab -> next != 0) slab -> next -> prev = slab;
+  heap -> partial[slab -> size_class] = slab;
+}
+
+static void
+rsxgl_heap_slab_unlink(struct rsxgl_heap_t * heap,struct rsxgl_heap_slab_t * slab)
+{
+  if(slab -> prev != 0) slab -> prev -> next = slab -> next;
+  else heap -> partial[slab -> size_class] = slab -> next;
+  if(slab -> next != 0) slab -> next -> prev = slab -> prev;
+  slab -> partial = 0;
+  slab -> prev = slab -> next = 0;
+}
+
+static void *
+rsxgl_heap_slab_allocate(struct rsxgl_heap_t * heap,uint32_t size_class)
+{
+  struct rsxgl_heap_slab_t * slab = heap -> partial[size_class];
+
+  if(slab == 0) {
+    slab = (struct rsxgl_heap_slab_t *)calloc(1,sizeof(struct rsxgl_heap_slab_t));
+    if(slab == 0) return 0;
+
+    slab -> block = rsxgl_heap_block_allocate(heap,RSXGL_HEAP_SLAB_PAGE_SIZE,RSXGL_HEAP_SLAB_PAGE_SIZE);
+    if(slab -> block == 0) {
+      free(slab);
+      return 0;
+    }
+
+    slab -> block -> slab = slab;
+    slab -> size_class = size_class;
+    slab -> nslots = RSXGL_HEAP_SLAB_PAGE_SIZE / rsxgl_heap_slab_slot_size(size_class);
+    rsxgl_heap_slab_link(heap,slab);
+
+    ++heap -> nslabs[size_class];
+    ++heap -> slab_pages;
+  }
+
+  uint32_t slot = 0;
+  for(uint32_t i = 0;i < RSXGL_HEAP_SLAB_WORDS;++i) {
+    if(~slab -> used[i] != 0) {
+      slot = i * 32 + __builtin_ctz(~slab -> used[i]);
+      slab -> used[i] |= (1u << (slot & 31));
+      break;
+    }
+  }
+  assert(slot < slab -> nslots);
+
+  if(++slab -> nused == slab -> nslots) {
+    rsxgl_heap_slab_unlink(heap,slab);
+  }
+
+  return (void *)(heap -> base + slab -> block -> offset + slot * rsxgl_heap_slab_slot_size(size_class));
+}
+
+static void
+rsxgl_heap_slab_free(struct rsxgl_heap_t * heap,struct rsxgl_heap_slab_t * slab,uint32_t offset)
+{
+  const uint32_t slot = (offset - slab -> block -> offset) / rsxgl_heap_slab_slot_size(slab -> size_class);
+  assert(slot < slab -> nslots);
+  assert(slab -> used[slot / 32] & (1u << (slot & 31)));
+
+  slab -> used[slot / 32] &= ~(1u << (slot & 31));
+  --slab -> nused;
+
+  if(!slab -> partial) {
+    rsxgl_heap_slab_link(heap,slab);
+  }
+
+  // Keep one page of each size class around, so that a single allocation that's repeatedly
+  // made & freed doesn't keep creating & destroying a slab:
+  if(slab -> nused == 0 && heap -> nslabs[slab -> size_class] > 1) {
+    rsxgl_heap_slab_unlink(heap,slab);
+    --heap -> nslabs[slab -> size_class];
+    --heap -> slab_pages;
+
+    rsxgl_heap_block_release(heap,slab -> block);
+    free(slab);
+  }
+}
+
+static inline int
+rsxgl_heap_slab_class(uint32_t align,uint32_t size)
+{
+  const uint32_t n = (size > align) ? size : align;
+  if(n > RSXGL_HEAP_SLAB_MAX_SIZE) return -1;
+
+  const uint32_t size_class = rsxgl_heap_log2(n - 1) + 1;
+  return (size_class <= rsxgl_heap_log2(RSXGL_HEAP_GRANULE)) ? 0 : (int)(size_class - rsxgl_heap_log2(RSXGL_HEAP_GRANULE));
+}
+
+// Finds the slab that contains address, or else the block that starts at address:
+static struct rsxgl_heap_block_t *
+rsxgl_heap_find(const struct rsxgl_heap_t * heap,uintptr_t address)
+{
+  if(heap -> table_count == 0) return 0;
+
+  const uintptr_t page = address & ~((uintptr_t)RSXGL_HEAP_SLAB_PAGE_SIZE - 1);
+  if(page >= heap -> base) {
+    struct rsxgl_heap_block_t * block = rsxgl_heap_table_lookup(heap,(uint32_t)(page - heap -> base));
+    if(block != 0 && (block -> slab != 0 || page == address)) return block;
+  }
+
+  return rsxgl_heap_table_lookup(heap,(uint32_t)(address - heap -> base));
+}
+
+//
+// Public interface:
+struct rsxgl_heap_t *
+rsxgl_heap_create(void * base,uint32_t size)
+{
+  // Every block's offset is a multiple of RSXGL_HEAP_GRANULE from an aligned base:
+  const uintptr_t aligned_base = ((uintptr_t)base + (RSXGL_HEAP_GRANULE - 1)) & ~((uintptr_t)RSXGL_HEAP_GRANULE - 1);
+  const uint32_t skipped = (uint32_t)(aligned_base - (uintptr_t)base);
+  if(size <= skipped + RSXGL_HEAP_GRANULE) return 0;
+  size = (size - skipped) & ~(RSXGL_HEAP_GRANULE - 1);
+
+  struct rsxgl_heap_t * heap = (struct rsxgl_heap_t *)calloc(1,sizeof(struct rsxgl_heap_t));
+  if(heap == 0) return 0;
+
+  heap -> base = aligned_base;
+  heap -> size = size;
+
+  struct rsxgl_heap_block_t * block = rsxgl_heap_block_new(heap);
+  if(block == 0 || !rsxgl_heap_table_grow(heap)) {
+    free(block);
+    free(heap);
+    return 0;
+  }
+
+  block -> offset = 0;
+  block -> size = size;
+  heap -> first = block;
+  rsxgl_heap_bin_insert(heap,block);
+
+  return heap;
+}
+
+void
+rsxgl_heap_destroy(struct rsxgl_heap_t * heap)
+{
+  if(heap == 0) return;
+
+  struct rsxgl_heap_block_t * block = heap -> first;
+  while(block != 0) {
+    struct rsxgl_heap_block_t * next = block -> next;
+    free(block -> slab);
+    free(block);
+    block = next;
+  }
+
+  block = heap -> spare;
+  while(block != 0) {
+    struct rsxgl_heap_block_t * next = block -> free_next;
+    free(block);
+    block = next;
+  }
+
+  free(heap -> table);
+  free(heap);
+}
+
+void *
+rsxgl_heap_memalign(struct rsxgl_heap_t * heap,uint32_t align,uint32_t size)
+{
+  assert((align & (align - 1)) == 0);
+  if(align < RSXGL_HEAP_GRANULE) align = RSXGL_HEAP_GRANULE;
+  size = rsxgl_heap_round_size(size);
+
+  void * ptr = 0;
+
+  const int size_class = rsxgl_heap_slab_class(align,size);
+  if(size_class >= 0) {
+    ptr = rsxgl_heap_slab_allocate(heap,size_class);
+  }
+  else {
+    struct rsxgl_heap_block_t * block = rsxgl_heap_block_allocate(heap,align,size);
+    if(block != 0) ptr = (void *)(heap -> base + block -> offset);
+  }
+
+  if(ptr != 0) ++heap -> allocations;
+  return ptr;
+}
+
+void *
+rsxgl_heap_malloc(struct rsxgl_heap_t * heap,uint32_t size)
+{
+  return rsxgl_heap_memalign(heap,RSXGL_HEAP_GRANULE,size);
+}
+
+void
+rsxgl_heap_free(struct rsxgl_heap_t * heap,void * ptr)
+{
+  if(ptr == 0) return;
+
+  struct rsxgl_heap_block_t * block = rsxgl_heap_find(heap,(uintptr_t)ptr);
+  assert(block != 0 && !block -> free);
+  if(block == 0) return;
+
+  if(block -> slab != 0) {
+    rsxgl_heap_slab_free(heap,block -> slab,(uint32_t)((uintptr_t)ptr - heap -> base));
+  }
+  else {
+    rsxgl_heap_block_release(heap,block);
+  }
+
+  --heap -> allocations;
+}
+
+void *
+rsxgl_heap_realloc(struct rsxgl_heap_t * heap,void * ptr,uint32_t size)
+{
+  if(ptr == 0) return rsxgl_heap_malloc(heap,size);
+  if(size == 0) {
+    rsxgl_heap_free(heap,ptr);
+    return 0;
+  }
+
+  struct rsxgl_heap_block_t * block = rsxgl_heap_find(heap,(uintptr_t)ptr);
+  assert(block != 0 && !block -> free);
+  if(block == 0) return 0;
+
+  size = rsxgl_heap_round_size(size);
+
+  uint32_t old_size = 0;
+  if(block -> slab != 0) {
+    old_size = rsxgl_heap_slab_slot_size(block -> slab -> size_class);
+    if(size <= old_size) return ptr;
+  }
+  else {
+    old_size = block -> size;
+
+    // Shrink, or grow into the following free block, in place:
+    struct rsxgl_heap_block_t * next = block -> next;
+    const uint32_t available = old_size + ((next != 0 && next -> free) ? next -> size : 0);
+
+    if(size <= available && size > RSXGL_HEAP_SLAB_MAX_SIZE) {
+      if(next != 0 && next -> free) {
+	rsxgl_heap_bin_remove(heap,next);
+	block -> size += next -> size;
+	block -> next = next -> next;
+	if(next -> next != 0) next -> next -> prev = block;
+	rsxgl_heap_block_delete(heap,next);
+      }
+
+      if(block -> size > size) {
+	struct rsxgl_heap_block_t * back = rsxgl_heap_block_new(heap);
+	if(back != 0) {
+	  back -> offset = block -> offset + size;
+	  back -> size = block -> size - size;
+	  back -> prev = block;
+	  back -> next = block -> next;
+	  if(block -> next != 0) block -> next -> prev = back;
+	  block -> next = back;
+	  block -> size = size;
+	  rsxgl_heap_bin_insert(heap,back);
+	}
+      }
+
+      return ptr;
+    }
+  }
+
+  void * result = rsxgl_heap_malloc(heap,size);
+  if(result == 0) return 0;
+
+  memcpy(result,ptr,(size < old_size) ? size : old_size);
+  rsxgl_heap_free(heap,ptr);
+  return result;
+}
+
+void
+rsxgl_heap_get_statistics(const struct rsxgl_heap_t * heap,struct rsxgl_heap_statistics_t * statistics)
+{
+  statistics -> size = heap -> size;
+  statistics -> free = heap -> free;
+  statistics -> free_blocks = heap -> free_blocks;
+  statistics -> allocations = heap -> allocations;
+  statistics -> slab_pages = heap -> slab_pages;
+
+  statistics -> largest_free = 0;
+  if(heap -> bins_bitmap != 0) {
+    const uint32_t bin = rsxgl_heap_log2(heap -> bins_bitmap);
+    for(const struct rsxgl_heap_block_t * block = heap -> bins[bin];block != 0;block = block -> free_next) {
+      if(block -> size > statistics -> largest_free) statistics -> largest_free = block -> size;
+    }
+  }
+}
@@ -0,0 +1,63 @@
+//-*-C-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// heap.h - Allocate GPU-visible memory, keeping the allocator's bookkeeping in main memory.
+//
+// dlmalloc keeps its chunk headers & free lists inside the memory that it manages; when that's
+// RSX local memory, every allocation & free reads & writes it through the PPU's slow path, and
+// the headers get in the way of packing aligned allocations together. A heap instead describes
+// the memory it manages with blocks allocated from the PPU's own heap:
+//
+// - Large requests are served by a segregated-fit allocator - free blocks are binned by the
+//   power of two below their size, and adjacent free blocks are coalesced.
+// - Small requests (up to RSXGL_HEAP_SLAB_MAX_SIZE bytes) are served from slab pages, each
+//   divided into equally-sized slots.
+
+#ifndef rsxgl_heap_H
+#define rsxgl_heap_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Allocations are rounded up to, and aligned to at least, this many bytes:
+#define RSXGL_HEAP_GRANULE 16
+
+// Slab size classes are RSXGL_HEAP_GRANULE, 2 * RSXGL_HEAP_GRANULE, ... RSXGL_HEAP_SLAB_MAX_SIZE:
+#define RSXGL_HEAP_SLAB_CLASSES 5
+#define RSXGL_HEAP_SLAB_MAX_SIZE (RSXGL_HEAP_GRANULE << (RSXGL_HEAP_SLAB_CLASSES - 1))
+#define RSXGL_HEAP_SLAB_PAGE_SIZE 4096
+
+struct rsxgl_heap_t;
+
+struct rsxgl_heap_statistics_t {
+  // Bytes managed by the heap, and how many of them are free:
+  uint32_t size, free;
+
+  // Size of the largest free block, and the number of free blocks; 1 - (largest_free / free)
+  // is a measure of fragmentation:
+  uint32_t largest_free, free_blocks;
+
+  // Number of live allocations, and the number of slab pages that some of them occupy:
+  uint32_t allocations, slab_pages;
+};
+
+struct rsxgl_heap_t * rsxgl_heap_create(void * base,uint32_t size);
+void rsxgl_heap_destroy(struct rsxgl_heap_t * heap);
+
+void * rsxgl_heap_malloc(struct rsxgl_heap_t * heap,uint32_t size);
+void * rsxgl_heap_memalign(struct rsxgl_heap_t * heap,uint32_t align,uint32_t size);
+void * rsxgl_heap_realloc(struct rsxgl_heap_t * heap,void * ptr,uint32_t size);
+void rsxgl_heap_free(struct rsxgl_heap_t * heap,void * ptr);
+
+void rsxgl_heap_get_statistics(const struct rsxgl_heap_t * heap,struct rsxgl_heap_statistics_t * statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,153 @@
+// Microbenchmark comparing rsxgl_heap_t with the dlmalloc mspaces it replaces. A pool of
+// allocations of mixed sizes & alignments - small constant buffers, vertex buffers, textures -
+// is churned by repeatedly freeing a random allocation & replacing it. Meant to be built & run
+// on the host, e.g.:
+//
+// gcc -std=gnu99 -O2 -c heap.c -o heap.o
+// gcc -O2 -DMSPACES=1 -DONLY_MSPACES=1 -DHAVE_MMAP=0 -Dmalloc_getpagesize=4096 -c malloc.c -o malloc.o
+// g++ -std=c++11 -O2 -I. heap_benchmark.cc heap.o malloc.o -o heap_benchmark
+//
+// The host can't show what the heap saves on the PS3 - dlmalloc reading & writing its chunk
+// headers in RSX local memory - so the figures to compare are the time spent in the allocator
+// itself, the number of requests that couldn't be satisfied, and the fragmentation of what's
+// left free.
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include <stdint.h>
+
+#include "heap.h"
+
+#define MSPACES 1
+#define ONLY_MSPACES 1
+#define HAVE_MMAP 0
+#define malloc_getpagesize 4096
+#include "malloc-2.8.4.h"
+
+static const uint32_t heap_size = 128 << 20;
+static const uint32_t nslots = 1024;
+static const uint32_t niterations = 1000000;
+
+struct request {
+  uint32_t align, size;
+};
+
+static uint32_t seed = 1;
+
+static uint32_t
+random_uint32()
+{
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+static request
+random_request()
+{
+  const uint32_t r = random_uint32() % 100;
+  request q;
+
+  // Uniform blocks & small index buffers:
+  if(r < 60) {
+    q.align = 16;
+    q.size = 16 + (random_uint32() % 241);
+  }
+  // Vertex buffers:
+  else if(r < 90) {
+    q.align = 128;
+    q.size = 1024 + (random_uint32() % (63 * 1024));
+  }
+  // Textures:
+  else {
+    q.align = 4096;
+    q.size = (64 * 1024) + (random_uint32() % (960 * 1024));
+  }
+
+  return q;
+}
+
+struct heap_allocator {
+  rsxgl_heap_t * heap;
+
+  heap_allocator(void * base,uint32_t size) : heap(rsxgl_heap_create(base,size)) {}
+  ~heap_allocator() { rsxgl_heap_destroy(heap); }
+
+  void * memalign(uint32_t align,uint32_t size) { return rsxgl_heap_memalign(heap,align,size); }
+  void free(void * ptr) { rsxgl_heap_free(heap,ptr); }
+};
+
+struct mspace_allocator {
+  mspace space;
+
+  mspace_allocator(void * base,uint32_t size) : space(create_mspace_with_base(base,size,0)) {}
+  ~mspace_allocator() { destroy_mspace(space); }
+
+  void * memalign(uint32_t align,uint32_t size) { return mspace_memalign(space,align,size); }
+  void free(void * ptr) { mspace_free(space,ptr); }
+};
+
+typedef std::chrono::high_resolution_clock clock_type;
+
+template< typename Allocator >
+static void
+benchmark(const char * name,void * base,void (*report)(Allocator &))
+{
+  Allocator allocator(base,heap_size);
+  std::vector< void * > slots(nslots,(void *)0);
+
+  seed = 1;
+  uint32_t failures = 0;
+
+  clock_type::time_point t0 = clock_type::now();
+  for(uint32_t i = 0;i < niterations;++i) {
+    const uint32_t j = random_uint32() % nslots;
+    const request q = random_request();
+
+    allocator.free(slots[j]);
+    slots[j] = allocator.memalign(q.align,q.size);
+    if(slots[j] == 0) ++failures;
+  }
+  const double ms = std::chrono::duration< double, std::milli >(clock_type::now() - t0).count();
+
+  std::cout << name << ": " << niterations << " frees & allocations: " << ms << "ms ("
+	    << (ms * 1.0e6 / (double)niterations) << " ns/iteration), " << failures << " failed" << std::endl;
+  report(allocator);
+
+  for(uint32_t j = 0;j < nslots;++j) {
+    allocator.free(slots[j]);
+  }
+}
+
+static void
+report_heap(heap_allocator & allocator)
+{
+  rsxgl_heap_statistics_t statistics;
+  rsxgl_heap_get_statistics(allocator.heap,&statistics);
+
+  std::cout << "  free: " << statistics.free << " bytes in " << statistics.free_blocks << " blocks, largest: " << statistics.largest_free
+	    << " (fragmentation: " << (1.0 - ((double)statistics.largest_free / (double)statistics.free)) << "), "
+	    << statistics.allocations << " allocations, " << statistics.slab_pages << " slab pages" << std::endl;
+}
+
+// mspace_mallinfo() isn't usable here - glibc's <malloc.h> declares an incompatible struct
+// mallinfo - so only the footprint is reported:
+static void
+report_mspace(mspace_allocator & allocator)
+{
+  std::cout << "  footprint: " << mspace_footprint(allocator.space) << " bytes" << std::endl;
+}
+
+int
+main(int argc,char ** argv)
+{
+  void * base = std::malloc(heap_size);
+
+  benchmark< heap_allocator >("rsxgl_heap",base,report_heap);
+  benchmark< mspace_allocator >("mspace",base,report_mspace);
+
+  std::free(base);
+  return 0;
+}
@@ -5,28 +5,18 @@
 
 #include <rsx/gcm_sys.h>
 
-#define MSPACES 1
-#define ONLY_MSPACES 1
-#define HAVE_MMAP 0
-#define malloc_getpagesize 4096
-#include "malloc-2.8.4.h"
-#undef MSPACES
-#undef ONLY_MSPACES
-#undef HAVE_MMAP
-#undef malloc_getpagesize
-
 #include <assert.h>
 
 //uint32_t rsxgl_rsx_mspace_offset = 0, rsxgl_rsx_mspace_size = 0;
 
 extern struct rsxgl_init_parameters_t rsxgl_init_parameters;
 
-mspace
-rsxgl_rsx_mspace()
+struct rsxgl_heap_t *
+rsxgl_rsx_heap()
 {
-  static mspace _rsx_mspace = 0;
+  static struct rsxgl_heap_t * _rsx_heap = 0;
 
-  if(_rsx_mspace == 0) {
+  if(_rsx_heap == 0) {
     gcmConfiguration config;
     gcmGetConfiguration(&config);
 
@@ -38,34 +28,34 @@ rsxgl_rsx_mspace()
 		       __PRETTY_FUNCTION__,
 		       size,available,offset,(uint64_t)config.localAddress + offset);
 
-    _rsx_mspace = create_mspace_with_base((uint8_t *)config.localAddress + offset,size,0);
+    _rsx_heap = rsxgl_heap_create((uint8_t *)config.localAddress + offset,size);
   }
 
-  assert(_rsx_mspace != 0);
+  assert(_rsx_heap != 0);
 
-  return _rsx_mspace;
+  return _rsx_heap;
 }
 
 void *
 rsxgl_rsx_malloc(rsx_size_t size)
 {  
-  return mspace_malloc(rsxgl_rsx_mspace(),size);
+  return rsxgl_heap_malloc(rsxgl_rsx_heap(),size);
 }
 
 void *
 rsxgl_rsx_memalign(rsx_size_t alignment,rsx_size_t size)
 {
-  return mspace_memalign(rsxgl_rsx_mspace(),alignment,size);
+  return rsxgl_heap_memalign(rsxgl_rsx_heap(),alignment,size);
 }
 
 void *
 rsxgl_rsx_realloc(void * mem,rsx_size_t size)
 {
-  return mspace_realloc(rsxgl_rsx_mspace(),mem,size);
+  return rsxgl_heap_realloc(rsxgl_rsx_heap(),mem,size);
 }
 
 void
 rsxgl_rsx_free(void * mem)
 {
-  mspace_free(rsxgl_rsx_mspace(),mem);
+  rsxgl_heap_free(rsxgl_rsx_heap(),mem);
 }
@@ -13,12 +13,17 @@
 #undef HAVE_MMAP
 #undef malloc_getpagesize
 
+#include "heap.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef uint32_t rsx_size_t;
 
+// Heap that manages the RSX's local memory:
+struct rsxgl_heap_t * rsxgl_rsx_heap();
+
 void * rsxgl_rsx_malloc(rsx_size_t);
 void * rsxgl_rsx_memalign(rsx_size_t,rsx_size_t);
 void * rsxgl_rsx_realloc(void *,rsx_size_t);
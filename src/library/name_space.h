@@ -192,7 +192,6 @@ public:
       const size_t bitfield_size = location.index + 1;
       
       if(bitfield_size > bitfield().size) {
-	std::cout << "resizing bitfield array: " << bitfield_size << std::endl;
 	bitfield().resize(bitfield_size);
       }
       
@@ -225,8 +224,8 @@ public:
 
     if((bitfield()[location.index] & (bitfield_mask << location.position)) != 0) {
       if(m_name_queue.full()) {
-	const name_type name_queue_grow = std::max((name_type)(m_name_queue.size() / 2),(name_type)1);
-	const name_type name_queue_size = m_name_queue.size() + name_queue_grow;
+	const size_t name_queue_grow = std::max((size_t)(m_name_queue.size() / 2),(size_t)1);
+	const size_t name_queue_size = std::min((size_t)m_name_queue.size() + name_queue_grow,(size_t)MaxNames);
 
 	name_queue_type new_name_queue(name_queue_size);
 	std::copy(m_name_queue.begin(),m_name_queue.end(),std::back_inserter(new_name_queue));
@@ -0,0 +1,125 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// perf_counters.cc - Count what each context does (GL_RSX_perf_counters).
+
+#include "rsxgl_context.h"
+#include "perf_counters.h"
+
+#include <GL3/gl3.h>
+#include "GL3/rsxgl3ext.h"
+#include "error.h"
+
+#include <string.h>
+
+#if defined(GLAPI)
+#undef GLAPI
+#endif
+#define GLAPI extern "C"
+
+#if (RSXGL_CONFIG_perf_counters == 1)
+// difference = a - b, counter by counter:
+static void
+rsxgl_perf_counters_difference(const rsxgl_perf_counters_t & a,const rsxgl_perf_counters_t & b,rsxgl_perf_counters_t & difference)
+{
+  difference.draws = a.draws - b.draws;
+  for(uint32_t i = 0;i < RSXGL_PERF_SUBSYSTEMS;++i) {
+    difference.words[i] = a.words[i] - b.words[i];
+  }
+  difference.reserve_callbacks = a.reserve_callbacks - b.reserve_callbacks;
+  difference.timestamp_waits = a.timestamp_waits - b.timestamp_waits;
+  difference.timestamp_wait_time = a.timestamp_wait_time - b.timestamp_wait_time;
+  difference.migrate_bytes = a.migrate_bytes - b.migrate_bytes;
+  difference.texture_conversions = a.texture_conversions - b.texture_conversions;
+  difference.redundant_state_calls = a.redundant_state_calls - b.redundant_state_calls;
+}
+#endif
+
+void
+rsxgl_perf_counters_swap(rsxgl_context_t * ctx)
+{
+#if (RSXGL_CONFIG_perf_counters == 1)
+  rsxgl_perf_counters_difference(ctx -> perf_counters,ctx -> perf_counters_swap,ctx -> perf_counters_frame);
+  ctx -> perf_counters_swap = ctx -> perf_counters;
+#endif
+}
+
+extern "C" void
+rsxglGetPerfCounters(struct rsxgl_perf_counters_t * counters,int reset)
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(counters != 0) {
+    *counters = ctx -> perf_counters;
+  }
+
+  // The frame in progress starts over, too:
+  if(reset) {
+    memset(&ctx -> perf_counters,0,sizeof(ctx -> perf_counters));
+    memset(&ctx -> perf_counters_swap,0,sizeof(ctx -> perf_counters_swap));
+  }
+}
+
+extern "C" void
+rsxglGetFramePerfCounters(struct rsxgl_perf_counters_t * counters)
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(counters != 0) {
+    *counters = ctx -> perf_counters_frame;
+  }
+}
+
+// GL_RSX_perf_counters is only advertised when the counters are compiled in:
+#if (RSXGL_CONFIG_perf_counters == 1)
+GLAPI void APIENTRY
+glGetPerfCounteri64vRSX (GLenum target, GLenum pname, GLint64 *params)
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  const rsxgl_perf_counters_t * counters = 0;
+  if(target == GL_PERF_TOTALS_RSX) {
+    counters = &ctx -> perf_counters;
+  }
+  else if(target == GL_PERF_LAST_FRAME_RSX) {
+    counters = &ctx -> perf_counters_frame;
+  }
+  else {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  switch(pname) {
+  case GL_PERF_DRAWS_RSX:
+    *params = counters -> draws;
+    break;
+  case GL_PERF_FIFO_WORDS_RSX:
+    for(uint32_t i = 0;i < RSXGL_PERF_SUBSYSTEMS;++i) {
+      params[i] = counters -> words[i];
+    }
+    break;
+  case GL_PERF_RESERVE_CALLBACKS_RSX:
+    *params = counters -> reserve_callbacks;
+    break;
+  case GL_PERF_TIMESTAMP_WAITS_RSX:
+    *params = counters -> timestamp_waits;
+    break;
+  case GL_PERF_TIMESTAMP_WAIT_TIME_RSX:
+    *params = counters -> timestamp_wait_time;
+    break;
+  case GL_PERF_MIGRATE_BYTES_RSX:
+    *params = counters -> migrate_bytes;
+    break;
+  case GL_PERF_TEXTURE_CONVERSIONS_RSX:
+    *params = counters -> texture_conversions;
+    break;
+  case GL_PERF_REDUNDANT_STATE_CALLS_RSX:
+    *params = counters -> redundant_state_calls;
+    break;
+  default:
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  RSXGL_NOERROR_();
+}
+#endif
@@ -0,0 +1,78 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// perf_counters.h - Count what each context does (GL_RSX_perf_counters).
+//
+// The counters are only compiled in if the library is configured with --enable-perf-counters;
+// otherwise the macros below expand to nothing, and their arguments aren't evaluated. Each
+// context keeps a running total, and, at every buffer swap, works out what the frame that just
+// ended contributed to it.
+
+#ifndef rsxgl_perf_counters_H
+#define rsxgl_perf_counters_H
+
+#include "rsxgl_config.h"
+#include "GL3/rsxgl.h"
+#include "fifo.h"
+
+#include <sys/time.h>
+
+#if (RSXGL_CONFIG_perf_counters == 1)
+
+// Words added to the command buffer so far. Only the FIFO is counted - not command lists being
+// recorded, whose words are sent when they're called:
+static inline uint64_t
+rsxgl_perf_words(gcmContextData * context)
+{
+  return (context == rsxgl_fifo.context) ? rsxgl_fifo_words(context) : 0;
+}
+
+// Microseconds:
+static inline uint64_t
+rsxgl_perf_time()
+{
+  struct timeval tv;
+  gettimeofday(&tv,0);
+  return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
+}
+
+#define RSXGL_PERF_COUNT(CTX,COUNTER,N) ((CTX) -> perf_counters.COUNTER += (N))
+
+#define RSXGL_PERF_REDUNDANT(CTX,EXPR)				\
+  {if((EXPR)) ++(CTX) -> perf_counters.redundant_state_calls;}
+
+// Charges the words emitted since the last of these (or RSXGL_PERF_WORDS_BEGIN) to SUBSYSTEM:
+#define RSXGL_PERF_WORDS_BEGIN(CTX)					\
+  uint64_t _rsxgl_perf_words = rsxgl_perf_words((CTX) -> gcm_context())
+
+#define RSXGL_PERF_WORDS(CTX,SUBSYSTEM)					\
+  {const uint64_t words = rsxgl_perf_words((CTX) -> gcm_context());	\
+    (CTX) -> perf_counters.words[(SUBSYSTEM)] += (uint32_t)(words - _rsxgl_perf_words); \
+    _rsxgl_perf_words = words;}
+
+// Adds the microseconds spent between the two to COUNTER:
+#define RSXGL_PERF_TIME_BEGIN()				\
+  const uint64_t _rsxgl_perf_time = rsxgl_perf_time()
+
+#define RSXGL_PERF_TIME_END(CTX,COUNTER)				\
+  ((CTX) -> perf_counters.COUNTER += rsxgl_perf_time() - _rsxgl_perf_time)
+
+#else
+
+#define RSXGL_PERF_COUNT(CTX,COUNTER,N)
+#define RSXGL_PERF_REDUNDANT(CTX,EXPR)
+#define RSXGL_PERF_WORDS_BEGIN(CTX)
+#define RSXGL_PERF_WORDS(CTX,SUBSYSTEM)
+#define RSXGL_PERF_TIME_BEGIN()
+#define RSXGL_PERF_TIME_END(CTX,COUNTER)
+
+#endif
+
+struct rsxgl_context_t;
+
+// Called when buffers are swapped, to work out the counts made during the frame:
+void rsxgl_perf_counters_swap(rsxgl_context_t *);
+
+#endif
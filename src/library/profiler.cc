@@ -0,0 +1,327 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// profiler.cc - GPU frame profiler (GL_RSX_profiler).
+
+#include "rsxgl_context.h"
+#include "profiler.h"
+#include "query.h"
+#include "timestamp.h"
+#include "fifo.h"
+
+#include "debug.h"
+#include "rsxgl_assert.h"
+#include "rsxgl_limits.h"
+
+#include <GL3/gl3.h>
+#include "GL3/rsxgl3ext.h"
+#include "error.h"
+
+#include <sys/time.h>
+
+#if defined(GLAPI)
+#undef GLAPI
+#endif
+#define GLAPI extern "C"
+
+static inline uint64_t
+rsxgl_profiler_cpu_time()
+{
+  struct timeval tv;
+  gettimeofday(&tv,0);
+  return ((uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec) * 1000;
+}
+
+static inline uint32_t
+rsxgl_profiler_words()
+{
+  return (rsxgl_fifo.context != 0) ? (uint32_t)rsxgl_fifo_words(rsxgl_fifo.context) : 0;
+}
+
+// Timestamps posted by this context, and labels written as the FIFO moves between segments:
+static inline uint32_t
+rsxgl_profiler_semaphores(const rsxgl_profiler_t & profiler)
+{
+  return profiler.timestamps + rsxgl_fifo.sequence;
+}
+
+static void
+rsxgl_profiler_push(rsxgl_context_t * ctx,rsxgl_profiler_t & profiler,const char * name)
+{
+  rsxgl_assert(profiler.depth < RSXGL_MAX_PROFILER_DEPTH);
+
+  rsxgl_profiler_frame_t & frame = profiler.frames[profiler.frame];
+
+  if(frame.nmarkers == RSXGL_MAX_PROFILER_MARKERS) {
+    ++frame.dropped;
+    profiler.stack[profiler.depth++] = RSXGL_MAX_PROFILER_MARKERS;
+    return;
+  }
+
+  const uint32_t i = frame.nmarkers++;
+  rsxgl_profiler_marker_t & marker = frame.markers[i];
+
+  rsxgl_profiler_copy_name(marker.name,name);
+
+  marker.indices[0] = rsxgl_query_object_allocate();
+  marker.indices[1] = rsxgl_query_object_allocate();
+  if(marker.indices[0] == RSXGL_MAX_QUERY_OBJECTS || marker.indices[1] == RSXGL_MAX_QUERY_OBJECTS) {
+    rsxgl_query_object_free(marker.indices[0]);
+    rsxgl_query_object_free(marker.indices[1]);
+    marker.indices[0] = marker.indices[1] = RSXGL_MAX_QUERY_OBJECTS;
+  }
+  else {
+    rsxgl_query_object_set(ctx -> gcm_context(),marker.indices[0]);
+  }
+
+  marker.draws = profiler.draws;
+  marker.words = rsxgl_profiler_words();
+  marker.semaphores = rsxgl_profiler_semaphores(profiler);
+  marker.cpu[0] = rsxgl_profiler_cpu_time();
+
+  profiler.stack[profiler.depth++] = i;
+}
+
+static void
+rsxgl_profiler_pop(rsxgl_context_t * ctx,rsxgl_profiler_t & profiler)
+{
+  rsxgl_assert(profiler.depth > 0);
+
+  const uint32_t i = profiler.stack[--profiler.depth];
+  if(i == RSXGL_MAX_PROFILER_MARKERS) return;
+
+  rsxgl_profiler_marker_t & marker = profiler.frames[profiler.frame].markers[i];
+
+  marker.cpu[1] = rsxgl_profiler_cpu_time();
+
+  if(marker.indices[1] != RSXGL_MAX_QUERY_OBJECTS) {
+    rsxgl_query_object_set(ctx -> gcm_context(),marker.indices[1]);
+  }
+
+  marker.draws = profiler.draws - marker.draws;
+  marker.words = rsxgl_profiler_words() - marker.words;
+  marker.semaphores = rsxgl_profiler_semaphores(profiler) - marker.semaphores;
+}
+
+// Writes a resolved frame's markers out, and frees their reports:
+static void
+rsxgl_profiler_export(rsxgl_profiler_t & profiler,rsxgl_profiler_frame_t & frame)
+{
+  rsxgl_assert(frame.status == rsxgl_profiler_frame_t::status_pending);
+
+  char event[512];
+
+  for(uint32_t i = 0;i < frame.nmarkers;++i) {
+    rsxgl_profiler_marker_t & marker = frame.markers[i];
+
+    if(rsxgl_profiler_format_event(event,sizeof(event),marker.name,RSXGL_PROFILER_CPU_TID,marker.cpu[0],marker.cpu[1] - marker.cpu[0],
+				   frame.number,marker.draws,marker.words,marker.semaphores) > 0) {
+      rsxgl_debug_printf("%s",event);
+    }
+
+    if(marker.indices[0] != RSXGL_MAX_QUERY_OBJECTS) {
+      const uint64_t begin = rsxgl_query_object_get_timestamp(marker.indices[0]), end = rsxgl_query_object_get_timestamp(marker.indices[1]);
+
+      if(rsxgl_profiler_format_event(event,sizeof(event),marker.name,RSXGL_PROFILER_GPU_TID,(uint64_t)((int64_t)begin + profiler.gpu_offset),(end > begin) ? (end - begin) : 0,
+				     frame.number,marker.draws,marker.words,marker.semaphores) > 0) {
+	rsxgl_debug_printf("%s",event);
+      }
+
+      rsxgl_query_object_free(marker.indices[0]);
+      rsxgl_query_object_free(marker.indices[1]);
+    }
+  }
+
+  if(frame.dropped > 0) {
+    rsxgl_debug_printf("{\"name\":\"%u markers dropped\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%u,\"ts\":%llu.%03u},\n",
+		       frame.dropped,RSXGL_PROFILER_CPU_TID,
+		       (unsigned long long)(frame.markers[0].cpu[1] / 1000),(unsigned int)(frame.markers[0].cpu[1] % 1000));
+  }
+
+  frame.status = rsxgl_profiler_frame_t::status_free;
+}
+
+// Exports pending frames, oldest first. Unless wait is set, this stops at the first frame that the
+// GPU hasn't finished:
+static void
+rsxgl_profiler_resolve(rsxgl_context_t * ctx,rsxgl_profiler_t & profiler,const bool wait)
+{
+  // The frame after the one being recorded is the oldest:
+  for(uint32_t i = 0;i < RSXGL_PROFILER_FRAMES;++i) {
+    rsxgl_profiler_frame_t & frame = profiler.frames[(profiler.frame + i) % RSXGL_PROFILER_FRAMES];
+    if(frame.status != rsxgl_profiler_frame_t::status_pending) continue;
+
+    if(wait) {
+      rsxgl_timestamp_wait(ctx,frame.timestamp);
+    }
+    else if(!rsxgl_timestamp_poll(ctx,frame.timestamp)) {
+      break;
+    }
+
+    rsxgl_profiler_export(profiler,frame);
+  }
+}
+
+static void
+rsxgl_profiler_begin_frame(rsxgl_context_t * ctx,rsxgl_profiler_t & profiler)
+{
+  rsxgl_profiler_frame_t & frame = profiler.frames[profiler.frame];
+
+  // Only waits if the GPU is RSXGL_PROFILER_FRAMES frames behind:
+  if(frame.status == rsxgl_profiler_frame_t::status_pending) {
+    rsxgl_timestamp_wait(ctx,frame.timestamp);
+    rsxgl_profiler_export(profiler,frame);
+  }
+
+  frame.status = rsxgl_profiler_frame_t::status_recording;
+  frame.number = profiler.next_frame_number++;
+  frame.nmarkers = 0;
+  frame.dropped = 0;
+
+  rsxgl_profiler_push(ctx,profiler,"frame");
+}
+
+static void
+rsxgl_profiler_end_frame(rsxgl_context_t * ctx,rsxgl_profiler_t & profiler)
+{
+  // Markers don't span frames; any left open end here:
+  while(profiler.depth > 0) {
+    rsxgl_profiler_pop(ctx,profiler);
+  }
+
+  rsxgl_profiler_frame_t & frame = profiler.frames[profiler.frame];
+
+  frame.timestamp = rsxgl_timestamp_create(ctx,1);
+  rsxgl_timestamp_post(ctx,frame.timestamp);
+  frame.status = rsxgl_profiler_frame_t::status_pending;
+
+  profiler.frame = (profiler.frame + 1) % RSXGL_PROFILER_FRAMES;
+}
+
+void
+rsxgl_profiler_swap(rsxgl_context_t * ctx)
+{
+  rsxgl_assert(ctx -> profiler != 0);
+  rsxgl_profiler_t & profiler = *ctx -> profiler;
+
+  rsxgl_profiler_end_frame(ctx,profiler);
+  rsxgl_profiler_resolve(ctx,profiler,false);
+  rsxgl_profiler_begin_frame(ctx,profiler);
+}
+
+void
+rsxgl_profiler_destroy(rsxgl_context_t * ctx)
+{
+  if(ctx -> profiler == 0) return;
+
+  // The GPU writes & reads reports in command order, so the reports can be reused straight away:
+  for(uint32_t i = 0;i < RSXGL_PROFILER_FRAMES;++i) {
+    rsxgl_profiler_frame_t & frame = ctx -> profiler -> frames[i];
+    if(frame.status == rsxgl_profiler_frame_t::status_free) continue;
+
+    for(uint32_t j = 0;j < frame.nmarkers;++j) {
+      rsxgl_query_object_free(frame.markers[j].indices[0]);
+      rsxgl_query_object_free(frame.markers[j].indices[1]);
+    }
+  }
+
+  delete ctx -> profiler;
+  ctx -> profiler = 0;
+}
+
+// Relates the GPU's timer to the CPU's clock. Returns false if no report was available:
+static bool
+rsxgl_profiler_calibrate(rsxgl_context_t * ctx,rsxgl_profiler_t & profiler)
+{
+  const rsxgl_query_object_index_type index = rsxgl_query_object_allocate();
+  if(index == RSXGL_MAX_QUERY_OBJECTS) return false;
+
+  rsxgl_query_object_set(ctx -> gcm_context(),index);
+
+  const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+  rsxgl_timestamp_post(ctx,timestamp);
+  rsxgl_timestamp_wait(ctx,timestamp);
+
+  profiler.gpu_offset = (int64_t)rsxgl_profiler_cpu_time() - (int64_t)rsxgl_query_object_get_timestamp(index);
+
+  rsxgl_query_object_free(index);
+  return true;
+}
+
+GLAPI void APIENTRY
+glEnableProfilerRSX (GLboolean enable)
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(!ctx -> can_emit() || ctx -> command_list_recorder != 0) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  if(enable && ctx -> profiler == 0) {
+    rsxgl_profiler_t * profiler = new rsxgl_profiler_t();
+    if(!rsxgl_profiler_calibrate(ctx,*profiler)) {
+      delete profiler;
+      RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+    }
+
+    ctx -> profiler = profiler;
+
+    // Each time that the profiler is enabled starts a new trace - its opening bracket, and names
+    // for its threads:
+    rsxgl_debug_printf("[\n");
+    rsxgl_debug_printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"CPU\"}},\n",RSXGL_PROFILER_CPU_TID);
+    rsxgl_debug_printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"RSX\"}},\n",RSXGL_PROFILER_GPU_TID);
+
+    rsxgl_profiler_begin_frame(ctx,*profiler);
+  }
+  else if(!enable && ctx -> profiler != 0) {
+    rsxgl_profiler_end_frame(ctx,*ctx -> profiler);
+    rsxgl_profiler_resolve(ctx,*ctx -> profiler,true);
+    rsxgl_profiler_destroy(ctx);
+  }
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glPushProfileMarkerRSX (const GLchar * name)
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  // Markers cost nothing while the profiler is disabled:
+  if(ctx -> profiler == 0) {
+    RSXGL_NOERROR_();
+  }
+
+  if(name == 0) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  if(ctx -> command_list_recorder != 0 || ctx -> profiler -> depth == RSXGL_MAX_PROFILER_DEPTH) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  rsxgl_profiler_push(ctx,*ctx -> profiler,name);
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glPopProfileMarkerRSX (void)
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(ctx -> profiler == 0) {
+    RSXGL_NOERROR_();
+  }
+
+  // The frame's own marker can't be popped:
+  if(ctx -> command_list_recorder != 0 || ctx -> profiler -> depth <= 1) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  rsxgl_profiler_pop(ctx,*ctx -> profiler);
+
+  RSXGL_NOERROR_();
+}
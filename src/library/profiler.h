@@ -0,0 +1,159 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// profiler.h - GPU frame profiler (GL_RSX_profiler).
+//
+// While the profiler is enabled, glPushProfileMarkerRSX() & glPopProfileMarkerRSX() write an RSX
+// report at either end of a marker, whose timer says when the GPU got there. The CPU's time is
+// taken at the same points, along with the number of draw calls, FIFO words & semaphore writes
+// made so far. Each frame is itself a marker, ended by eglSwapBuffers(), which posts a timestamp
+// after the frame's last report. Frames are kept in a small ring, and resolved once the GPU
+// passes their timestamp - normally a frame or two later, without waiting for it. Their markers
+// are then written through glInitDebug()'s callback as Chrome trace events, one per line, so
+// that the callback's output can be loaded by chrome://tracing as it is.
+//
+// The GPU's timer has an origin of its own. It's related to the CPU's clock once, when the
+// profiler is enabled, by waiting for a report to be written; GPU events may appear late by as
+// much as the time it takes to notice that the wait is over.
+//
+// The functions in this header that don't take a context don't depend upon the rest of the
+// library, so that they can be tested on the host.
+
+#ifndef rsxgl_profiler_H
+#define rsxgl_profiler_H
+
+#include "rsxgl_limits.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Trace "threads" that the CPU's & the GPU's events are shown on:
+#define RSXGL_PROFILER_CPU_TID 0
+#define RSXGL_PROFILER_GPU_TID 1
+
+struct rsxgl_profiler_marker_t {
+  char name[RSXGL_PROFILER_NAME_LENGTH];
+
+  // Reports written at either end; RSXGL_MAX_QUERY_OBJECTS if none were available, in which
+  // case only the CPU's side is recorded:
+  uint32_t indices[2];
+
+  // CPU time, in nanoseconds, at either end:
+  uint64_t cpu[2];
+
+  // Counts at the push, replaced by the counts made inside of the marker once it's popped:
+  uint32_t draws, words, semaphores;
+};
+
+struct rsxgl_profiler_frame_t {
+  enum status_type {
+    status_free = 0,
+    status_recording = 1,
+    status_pending = 2
+  };
+
+  uint8_t status;
+
+  // Frames are numbered from 0 when the profiler is enabled:
+  uint32_t number;
+
+  // Posted once the frame's last report has been written:
+  uint32_t timestamp;
+
+  // Markers recorded, and those that didn't fit:
+  uint32_t nmarkers, dropped;
+  rsxgl_profiler_marker_t markers[RSXGL_MAX_PROFILER_MARKERS];
+};
+
+struct rsxgl_profiler_t {
+  rsxgl_profiler_frame_t frames[RSXGL_PROFILER_FRAMES];
+
+  // Frame being recorded, and the number that the next one is given:
+  uint32_t frame, next_frame_number;
+
+  // Markers that have been pushed but not popped, as indices into the frame's markers;
+  // RSXGL_MAX_PROFILER_MARKERS stands in for one that didn't fit. The frame's own marker is at
+  // the bottom:
+  uint32_t stack[RSXGL_MAX_PROFILER_DEPTH];
+  uint32_t depth;
+
+  // Counted by draw calls & timestamp posts while the profiler is enabled:
+  uint32_t draws, timestamps;
+
+  // Added to the GPU's timer to get the CPU's time:
+  int64_t gpu_offset;
+};
+
+// Called by draw calls and by rsxgl_timestamp_post(); profiler is 0 unless it's enabled:
+static inline void
+rsxgl_profiler_draw(rsxgl_profiler_t * profiler)
+{
+  if(profiler != 0) ++profiler -> draws;
+}
+
+static inline void
+rsxgl_profiler_timestamp(rsxgl_profiler_t * profiler)
+{
+  if(profiler != 0) ++profiler -> timestamps;
+}
+
+// Copies a marker's name, cutting it short if need be:
+static inline void
+rsxgl_profiler_copy_name(char * name,const char * src)
+{
+  size_t i = 0;
+  for(;i < (RSXGL_PROFILER_NAME_LENGTH - 1) && src[i] != 0;++i) {
+    name[i] = src[i];
+  }
+  name[i] = 0;
+}
+
+// Writes a complete ("X") trace event, terminated by ",\n" so that events can simply be
+// concatenated. Times are in nanoseconds; the trace's are in microseconds. Returns the length of
+// the event, or 0 if it doesn't fit in size bytes:
+static inline size_t
+rsxgl_profiler_format_event(char * buffer,const size_t size,
+			    const char * name,const uint32_t tid,const uint64_t ts,const uint64_t dur,
+			    const uint32_t frame,const uint32_t draws,const uint32_t words,const uint32_t semaphores)
+{
+  // Names are application strings, and need escaping for JSON:
+  char escaped[RSXGL_PROFILER_NAME_LENGTH * 6];
+  size_t n = 0;
+  for(const char * p = name;*p != 0;++p) {
+    const unsigned char c = (unsigned char)*p;
+    if(c == '"' || c == '\\') {
+      escaped[n++] = '\\';
+      escaped[n++] = c;
+    }
+    else if(c < 0x20) {
+      n += snprintf(escaped + n,sizeof(escaped) - n,"\\u%04x",c);
+    }
+    else {
+      escaped[n++] = c;
+    }
+  }
+  escaped[n] = 0;
+
+  const int length = snprintf(buffer,size,
+			      "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%llu.%03u,\"dur\":%llu.%03u,"
+			      "\"args\":{\"frame\":%u,\"draws\":%u,\"words\":%u,\"semaphores\":%u}},\n",
+			      escaped,tid,
+			      (unsigned long long)(ts / 1000),(unsigned int)(ts % 1000),
+			      (unsigned long long)(dur / 1000),(unsigned int)(dur % 1000),
+			      frame,draws,words,semaphores);
+
+  return (length > 0 && (size_t)length < size) ? (size_t)length : 0;
+}
+
+struct rsxgl_context_t;
+
+// Ends the frame being recorded, and starts the next one; called when buffers are swapped:
+void rsxgl_profiler_swap(rsxgl_context_t *);
+
+// Frees the profiler's reports without waiting for the GPU; called when a context is destroyed:
+void rsxgl_profiler_destroy(rsxgl_context_t *);
+
+#endif
@@ -0,0 +1,81 @@
+// "Unit testing" for the trace event formatting in profiler.h. Meant to be built & run on the
+// host, e.g.:
+//
+// g++ -std=c++11 profiler_unit_tests.cc -o profiler_unit_tests
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include <stdint.h>
+#include <string.h>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+
+#include "profiler.h"
+
+static void
+test_names()
+{
+  char name[RSXGL_PROFILER_NAME_LENGTH];
+
+  rsxgl_profiler_copy_name(name,"shadows");
+  assert(std::string(name) == "shadows");
+
+  // Long names are cut short, but still terminated:
+  const std::string long_name(RSXGL_PROFILER_NAME_LENGTH * 2,'x');
+  rsxgl_profiler_copy_name(name,long_name.c_str());
+  assert(strlen(name) == RSXGL_PROFILER_NAME_LENGTH - 1);
+}
+
+static void
+test_events()
+{
+  char event[512];
+
+  const size_t n = rsxgl_profiler_format_event(event,sizeof(event),"gbuffer",RSXGL_PROFILER_GPU_TID,1234567,8009,3,12,4096,13);
+  assert(n == strlen(event));
+  assert(std::string(event) ==
+	 "{\"name\":\"gbuffer\",\"ph\":\"X\",\"pid\":0,\"tid\":1,\"ts\":1234.567,\"dur\":8.009,"
+	 "\"args\":{\"frame\":3,\"draws\":12,\"words\":4096,\"semaphores\":13}},\n");
+
+  // Times that don't fit in 32 bits:
+  rsxgl_profiler_format_event(event,sizeof(event),"frame",RSXGL_PROFILER_CPU_TID,(uint64_t)5000000000000ULL,0,0,0,0,0);
+  assert(std::string(event).find("\"ts\":5000000000.000,\"dur\":0.000,") != std::string::npos);
+
+  // Names are escaped for JSON:
+  rsxgl_profiler_format_event(event,sizeof(event),"a\"b\\c\nd",RSXGL_PROFILER_CPU_TID,0,0,0,0,0,0);
+  assert(std::string(event).find("{\"name\":\"a\\\"b\\\\c\\u000ad\"") == 0);
+
+  // The worst case for escaping still fits:
+  char name[RSXGL_PROFILER_NAME_LENGTH];
+  rsxgl_profiler_copy_name(name,std::string(RSXGL_PROFILER_NAME_LENGTH,'\x01').c_str());
+  assert(rsxgl_profiler_format_event(event,sizeof(event),name,RSXGL_PROFILER_CPU_TID,0,0,0,0,0,0) > 0);
+
+  // Events that are cut short are reported as not fitting:
+  assert(rsxgl_profiler_format_event(event,32,"gbuffer",RSXGL_PROFILER_GPU_TID,0,0,0,0,0,0) == 0);
+}
+
+int
+main(int argc,char ** argv)
+{
+  try {
+    test_names();
+    test_events();
+
+    std::cout << "passed" << std::endl;
+  }
+  catch(const assertion & a) {
+    std::cerr << "failed: " << a.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
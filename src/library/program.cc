@@ -5,6 +5,7 @@
 // program.cc - Functions pertaining to creating, compiling, and linking shaders and programs.
 
 #include <GL3/gl3.h>
+#include "GL3/rsxgl3ext.h"
 
 #include "debug.h"
 #include "rsxgl_assert.h"
@@ -12,7 +13,11 @@
 #include "error.h"
 #include "gl_fifo.h"
 #include "program.h"
+#include "uniforms.h"
 #include "compiler_context.h"
+#include "perf_counters.h"
+#include "deferred_free.h"
+#include "program_archive.h"
 
 #include <rsx/gcm_sys.h>
 #include "nv40.h"
@@ -33,6 +38,7 @@
 extern "C" {
 #include <nvfx/nvfx_state.h>
 }
+#include <nvfx/nvfx_optimize.h>
 
 #include <malloc.h>
 #include <algorithm>
@@ -64,7 +70,7 @@ program_t::storage_type & program_t::storage()
 
 // Shader functions:
 shader_t::shader_t()
-  : type(RSXGL_MAX_SHADER_TYPES), compiled(GL_FALSE), deleted(GL_FALSE), ref_count(0), mesa_shader(0)
+  : type(RSXGL_MAX_SHADER_TYPES), compiled(GL_FALSE), deleted(GL_FALSE), ref_count(0), binary_size(0), binary_format(0), mesa_shader(0)
 {
 }
 
@@ -188,6 +194,55 @@ glGetShaderSource (GLuint shader_name, GLsizei bufSize, GLsizei *length, GLchar
   RSXGL_NOERROR_();
 }
 
+// Load programs from an archive written by nv40asm -b (see program_archive.h):
+static void
+rsxgl_shader_archive_binary(GLsizei n, const GLuint* shader_names, const GLvoid* binary, GLsizei length)
+{
+  const uint8_t * data = (const uint8_t *)binary;
+
+  const int64_t num_entries = rsxgl_program_archive_size(data,length);
+  if(num_entries < n) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  // Check everything before changing anything:
+  for(GLsizei i = 0;i < n;++i) {
+    if(!shader_t::storage().is_object(shader_names[i])) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    const uint8_t * program = 0;
+    uint32_t program_size = 0;
+    rsxgl_program_image_t image;
+    if(!rsxgl_program_archive_entry(data,length,i,&program,&program_size) ||
+       !rsxgl_program_image_parse(program,program_size,image)) {
+      RSXGL_ERROR_(GL_INVALID_VALUE);
+    }
+
+    const uint32_t type = (image.type == RSXGL_PROGRAM_IMAGE_VERTEX) ? RSXGL_VERTEX_SHADER : RSXGL_FRAGMENT_SHADER;
+    if(type != shader_t::storage().at(shader_names[i]).type) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+  }
+
+  for(GLsizei i = 0;i < n;++i) {
+    shader_t & shader = shader_t::storage().at(shader_names[i]);
+
+    const uint8_t * program = 0;
+    uint32_t program_size = 0;
+    rsxgl_program_archive_entry(data,length,i,&program,&program_size);
+
+    shader.binary.reset(new uint8_t[program_size]);
+    std::copy(program,program + program_size,shader.binary.get());
+    shader.binary_size = program_size;
+    shader.binary_format = GL_PROGRAM_ARCHIVE_RSX;
+    shader.compiled = GL_TRUE;
+    shader.info.clear();
+  }
+
+  RSXGL_NOERROR_();
+}
+
 GLAPI void APIENTRY
 glShaderBinary (GLsizei n, const GLuint* shader_names, GLenum binaryformat, const GLvoid* binary, GLsizei length)
 {
@@ -195,6 +250,11 @@ glShaderBinary (GLsizei n, const GLuint* shader_names, GLenum binaryformat, cons
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
+  if(binaryformat == GL_PROGRAM_ARCHIVE_RSX) {
+    rsxgl_shader_archive_binary(n,shader_names,binary,length);
+    return;
+  }
+
   for(GLsizei i = 0;i < n;++i,++shader_names) {
     if(!shader_t::storage().is_object(*shader_names)) {
       RSXGL_ERROR_(GL_INVALID_OPERATION);
@@ -205,10 +265,13 @@ glShaderBinary (GLsizei n, const GLuint* shader_names, GLenum binaryformat, cons
     if(binary != 0) {
       shader.binary.reset(new uint8_t[length]);
       std::copy((const uint8_t *)binary,(const uint8_t *)binary + length,shader.binary.get());
+      shader.binary_size = length;
     }
     else {
-      shader.binary.release();
+      shader.binary.reset();
+      shader.binary_size = 0;
     }
+    shader.binary_format = binaryformat;
 
     shader.info.clear();
   }
@@ -262,6 +325,11 @@ glCompileShader (GLuint shader_name)
   shader_t & shader = shader_t::storage().at(shader_name);
   shader.compiled = GL_FALSE;
 
+  // Compiled source replaces a program loaded from an archive:
+  shader.binary.reset();
+  shader.binary_size = 0;
+  shader.binary_format = 0;
+
   if(shader.source.empty()) {
     RSXGL_NOERROR_();
   }
@@ -289,16 +357,19 @@ glReleaseShaderCompiler (void)
 // Program functions:
 program_t::program_t()
   : deleted(0), timestamp(0),
-    linked(0), validated(0), invalid_uniforms(0), ref_count(0),
-    attrib_name_max_length(0), uniform_name_max_length(0),
+    linked(0), validated(0), invalid_uniforms(0), feedback_interleaved(0), ref_count(0),
+    attrib_name_max_length(0), uniform_name_max_length(0), uniform_block_name_max_length(0),
     mesa_program(0), nvfx_vp(0), nvfx_fp(0), nvfx_streamvp(0), nvfx_streamfp(0),
     vp_ucode_offset(~0), fp_ucode_offset(~0), vp_num_insn(0), fp_num_insn(0), 
     streamvp_ucode_offset(~0), streamfp_ucode_offset(~0), streamvp_num_insn(0), streamfp_num_insn(0), 
     vp_input_mask(0), vp_output_mask(0), vp_num_internal_const(0),
     fp_control(0),
     streamvp_input_mask(0), streamvp_output_mask(0), streamvp_num_internal_const(0),
-    streamfp_control(0), streamfp_num_outputs(0),
-    streamvp_vertexid_index(~0), instanceid_index(~0), point_sprite_control(0)
+    streamfp_control(0), streamfp_num_outputs(0), streamfp_interleaved(0),
+    streamvp_vertexid_index(~0), instanceid_index(~0), point_sprite_control(0),
+    num_dirty_uniforms(0), num_program_offsets(0),
+    fp_active_ucode_offset(~0), fp_active_variant(-1),
+    fp_draws(0), fp_serial(0), fp_last_choice(0), fp_variant_compiles(0), fp_generic_synced(0)
 {
 }
 
@@ -478,6 +549,22 @@ glGetProgramiv (GLuint program_name, GLenum pname, GLint *params)
       *params = 0;
     }
   }
+  else if(pname == GL_ACTIVE_UNIFORM_BLOCKS) {
+    if(program.linked) {
+      *params = program.uniform_blocks.size();
+    }
+    else {
+      *params = 0;
+    }
+  }
+  else if(pname == GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH) {
+    if(program.linked) {
+      *params = program.uniform_block_name_max_length + 1;
+    }
+    else {
+      *params = 0;
+    }
+  }
   else if(pname == GL_TRANSFORM_FEEDBACK_BUFFER_MODE) {
   }
   else if(pname == GL_TRANSFORM_FEEDBACK_VARYING_MAX_LENGTH) {
@@ -566,23 +653,336 @@ rsxgl_rsx_ucode_offset(const uint32_t * address)
   return ((uint8_t *)address - (uint8_t *)rsx_ucode_address) / (sizeof(uint32_t) * 4);
 }
 
-static mspace
-rsxgl_rsx_ucode_mspace()
+static struct rsxgl_heap_t *
+rsxgl_rsx_ucode_heap()
 {
   static const size_t size = 4 * 1024 * 1024;
-  static mspace space = 0;
+  static struct rsxgl_heap_t * heap = 0;
 
-  if(space == 0) {
+  if(heap == 0) {
     rsx_ucode_address = rsxgl_rsx_memalign(RSXGL_CACHE_LINE_SIZE,size);
     rsxgl_assert(rsx_ucode_address != 0);
 
     gcmAddressToOffset(rsx_ucode_address,&rsx_ucode_offset);
 
-    space = create_mspace_with_base(rsx_ucode_address,size,0);
-    rsxgl_assert(space != 0);
+    heap = rsxgl_heap_create(rsx_ucode_address,size);
+    rsxgl_assert(heap != 0);
   }
 
-  return space;
+  return heap;
+}
+
+void
+rsxgl_rsx_ucode_free(void * address)
+{
+  rsxgl_heap_free(rsxgl_rsx_ucode_heap(),address);
+}
+
+//
+// GL_RSX_program_specialization:
+//
+// Fragment program uniforms are constants in the program's microcode, so a uniform whose value
+// isn't going to change can be folded into a copy of the program, which is then optimized: IFs
+// that test it are resolved, and arithmetic on it is done ahead of time. A uniform is folded once
+// it has kept its value for RSXGL_FP_VARIANT_STABLE_DRAWS of the program's draws (if it hasn't
+// changed too often), or, as programs only have float uniforms, whenever it's a scalar that holds
+// a whole number no greater than RSXGL_FP_VARIANT_MAX_SWITCH, as a feature switch would.
+//
+// Each microcode image - the generic program's, and each variant's - is patched with uniform
+// values separately. Changes are numbered, and each image remembers the last that it holds; when
+// draws switch to an image, the uniforms that changed since are sent to it again.
+
+// Offset in a variant's program_offsets of a column that isn't in its microcode:
+static const program_t::instruction_size_type kFoldedOffset = ~0;
+
+// Free the variants, once the GPU is done with the program:
+static void
+rsxgl_program_fp_variants_clear(program_t & program)
+{
+  for(const auto & variant : program.fp_variants) {
+    if(variant.ucode_offset != ~0U) {
+      rsxgl_heap_free(rsxgl_rsx_ucode_heap(),rsxgl_rsx_ucode_address(variant.ucode_offset));
+    }
+  }
+  program.fp_variants.clear();
+  program.fp_uniform_history.reset();
+
+  program.fp_active_ucode_offset = ~0U;
+  program.fp_active_variant = -1;
+  program.fp_draws = 0;
+  program.fp_serial = 0;
+  program.fp_last_choice = 0;
+  program.fp_variant_compiles = 0;
+  program.fp_generic_synced = 0;
+}
+
+static inline bool
+rsxgl_fp_uniform_is_switch(const ieee32_t value)
+{
+  for(int i = 0;i <= RSXGL_FP_VARIANT_MAX_SWITCH;++i) {
+    if(value.f == (float)i) return true;
+  }
+  return false;
+}
+
+// Copy the fragment program, giving every uniform its current value, and optimize it. Only the
+// words of the uniforms that aren't in the variant's key are left to be patched:
+static void
+rsxgl_program_fp_variant_compile(program_t & program,program_t::fp_variant_t & variant)
+{
+  const struct nvfx_fragment_program * nvfx_fp = program.nvfx_fp;
+  const program_t::fp_uniform_history_t * history = program.fp_uniform_history.get();
+  const ieee32_t * values = program.uniform_values.get();
+  const unsigned int len = nvfx_fp -> insn_len;
+
+  variant.ucode_offset = ~0U;
+  variant.ucode_size = 0;
+  variant.program_offsets.clear();
+
+  std::vector< uint32_t > insn(nvfx_fp -> insn,nvfx_fp -> insn + len);
+  std::vector< unsigned int > patched, remap(len);
+
+  for(program_t::uniform_size_type i = 0,n = program.uniforms.size();i < n;++i) {
+    const program_t::uniform_t & uniform = program.uniforms[i].second;
+    if(!uniform.enabled.test(RSXGL_FRAGMENT_SHADER)) continue;
+
+    const program_t::uniform_size_type width = rsxgl_uniform_width(uniform.type);
+    const ieee32_t * pvalues = values + uniform.values_index;
+    const program_t::instruction_size_type * pfp_offsets = program.program_offsets.get() + uniform.program_offsets_index;
+
+    for(program_t::uniform_size_type j = 0;j < uniform.count;++j,pvalues += width) {
+      for(program_t::instruction_size_type offsets_count = *pfp_offsets++;offsets_count > 0;--offsets_count) {
+	const unsigned int offset = (unsigned int)*pfp_offsets++ * 4;
+
+	// As rsxgl_inline_transfer() would write them:
+	for(program_t::uniform_size_type k = 0;k < ((width + 1) & ~1);++k) {
+	  insn[offset + k] = (k < width) ? pvalues[k].u : 0;
+	}
+
+	if(!history[i].folded) {
+	  patched.push_back(offset);
+	}
+      }
+    }
+  }
+
+  struct nvfx_fp_opt opt;
+  memset(&opt,0,sizeof(opt));
+  opt.insn = insn.data();
+  opt.insn_len = len;
+  opt.live_out = nvfx_fp -> r_outputs;
+  opt.patched = patched.data();
+  opt.nr_patched = patched.size();
+  opt.remap = remap.data();
+
+  if(!nvfx_fp_optimize(&opt,NVFX_OPT_ALL | NVFX_OPT_ALGEBRAIC) || opt.insn_len >= len) {
+    return;
+  }
+
+  uint32_t * address = (uint32_t *)rsxgl_heap_memalign(rsxgl_rsx_ucode_heap(),RSXGL_CACHE_LINE_SIZE,opt.insn_len * sizeof(uint32_t));
+  if(address == 0) {
+    return;
+  }
+
+  for(unsigned int i = 0;i < opt.insn_len;++i) {
+    address[i] = endian_fp(insn[i]);
+  }
+
+  variant.ucode_offset = rsxgl_rsx_ucode_offset(address);
+  variant.ucode_size = opt.insn_len * sizeof(uint32_t);
+
+  // Move the uniforms' offsets along with their words:
+  variant.program_offsets.assign(program.program_offsets.get(),program.program_offsets.get() + program.num_program_offsets);
+
+  for(program_t::uniform_size_type i = 0,n = program.uniforms.size();i < n;++i) {
+    const program_t::uniform_t & uniform = program.uniforms[i].second;
+    if(!uniform.enabled.test(RSXGL_FRAGMENT_SHADER)) continue;
+
+    program_t::instruction_size_type * pfp_offsets = variant.program_offsets.data() + uniform.program_offsets_index;
+
+    for(program_t::uniform_size_type j = 0;j < uniform.count;++j) {
+      for(program_t::instruction_size_type offsets_count = *pfp_offsets++;offsets_count > 0;--offsets_count,++pfp_offsets) {
+	const unsigned int offset = remap[(unsigned int)*pfp_offsets * 4];
+	*pfp_offsets = (history[i].folded || offset == NVFX_OPT_REMOVED) ? kFoldedOffset : (offset / 4);
+      }
+    }
+  }
+}
+
+// Find, or compile, the variant for the uniforms' current values. Returns its index, or -1 if the
+// generic program is to be used:
+static int32_t
+rsxgl_program_fp_variant_choose(rsxgl_context_t * ctx,program_t & program,const uint32_t draw)
+{
+  program_t::fp_uniform_history_t * history = program.fp_uniform_history.get();
+  const ieee32_t * values = program.uniform_values.get();
+
+  std::vector< uint32_t > key;
+
+  for(program_t::uniform_size_type i = 0,n = program.uniforms.size();i < n;++i) {
+    const program_t::uniform_t & uniform = program.uniforms[i].second;
+    if(!uniform.enabled.test(RSXGL_FRAGMENT_SHADER)) continue;
+
+    const program_t::uniform_size_type num_values = rsxgl_uniform_width(uniform.type) * uniform.count;
+    const ieee32_t * pvalues = values + uniform.values_index;
+
+    const bool is_switch = (num_values == 1) && rsxgl_fp_uniform_is_switch(pvalues[0]);
+    const bool is_stable = ((draw - history[i].changed_draw) >= RSXGL_FP_VARIANT_STABLE_DRAWS) && (history[i].changes <= RSXGL_FP_VARIANT_MAX_CHANGES);
+    if(!is_switch && !is_stable) continue;
+
+    key.push_back(i);
+    for(program_t::uniform_size_type j = 0;j < num_values;++j) {
+      key.push_back(pvalues[j].u);
+    }
+  }
+
+  if(key.empty()) {
+    return -1;
+  }
+
+  for(size_t i = 0,n = program.fp_variants.size();i < n;++i) {
+    program_t::fp_variant_t & variant = program.fp_variants[i];
+    if(variant.key == key) {
+      variant.last_draw = draw;
+      return (variant.ucode_offset != ~0U) ? (int32_t)i : -1;
+    }
+  }
+
+  if(program.fp_variant_compiles >= RSXGL_MAX_FP_VARIANT_COMPILES) {
+    return -1;
+  }
+
+  // Make room by replacing the least recently used variant, which isn't the one in use:
+  size_t index = program.fp_variants.size();
+  if(index < RSXGL_MAX_FP_VARIANTS) {
+    program.fp_variants.resize(index + 1);
+  }
+  else {
+    index = (program.fp_active_variant == 0) ? 1 : 0;
+    for(size_t i = 0,n = program.fp_variants.size();i < n;++i) {
+      if((int32_t)i != program.fp_active_variant && program.fp_variants[i].last_draw < program.fp_variants[index].last_draw) {
+	index = i;
+      }
+    }
+
+    const program_t::fp_variant_t & evicted = program.fp_variants[index];
+    if(evicted.ucode_offset != ~0U) {
+      rsxgl_deferred_free_ucode(ctx,evicted.timestamp,rsxgl_rsx_ucode_address(evicted.ucode_offset),evicted.ucode_size);
+    }
+  }
+
+  // The folded flags say which uniforms go into the key while it's compiled; they're set to the
+  // active image's again by the caller:
+  for(program_t::uniform_size_type i = 0,n = program.uniforms.size();i < n;++i) {
+    history[i].folded = 0;
+  }
+  for(size_t i = 0,n = key.size();i < n;) {
+    const program_t::uniform_t & uniform = program.uniforms[key[i]].second;
+    history[key[i]].folded = 1;
+    i += 1 + rsxgl_uniform_width(uniform.type) * uniform.count;
+  }
+
+  program_t::fp_variant_t & variant = program.fp_variants[index];
+  variant.key.swap(key);
+  rsxgl_program_fp_variant_compile(program,variant);
+  variant.synced = program.fp_serial;
+  variant.last_draw = draw;
+  variant.timestamp = 0;
+
+  ++program.fp_variant_compiles;
+  ++ctx -> uniform_statistics.fp_variant_compiles;
+
+  return (variant.ucode_offset != ~0U) ? (int32_t)index : -1;
+}
+
+bool
+rsxgl_program_specialize(rsxgl_context_t * ctx,program_t & program,const uint32_t timestamp)
+{
+  if(!program.linked || program.nvfx_fp == 0 || program.fp_ucode_offset == ~0U) {
+    return false;
+  }
+
+  const program_t::uniform_size_type num_uniforms = program.uniforms.size();
+
+  if(!program.fp_uniform_history) {
+    program.fp_uniform_history.reset(new program_t::fp_uniform_history_t[num_uniforms]);
+    memset(program.fp_uniform_history.get(),0,sizeof(program_t::fp_uniform_history_t) * num_uniforms);
+  }
+
+  program_t::fp_uniform_history_t * history = program.fp_uniform_history.get();
+  const uint32_t draw = ++program.fp_draws;
+
+  // Number the uniforms that changed since the last draw. The variant is chosen again if one of
+  // them is folded into it, or may be a switch, and every so often in case others have settled:
+  bool choose = (draw - program.fp_last_choice) >= RSXGL_FP_VARIANT_STABLE_DRAWS;
+
+  for(program_t::uniform_size_type i = 0,n = program.num_dirty_uniforms;i < n;++i) {
+    const program_t::uniform_size_type location = program.dirty_uniforms[i];
+    const program_t::uniform_t & uniform = program.uniforms[location].second;
+    if(!uniform.invalid.test(RSXGL_FRAGMENT_SHADER)) continue;
+
+    program_t::fp_uniform_history_t & h = history[location];
+    h.changed_draw = draw;
+    h.changed_serial = ++program.fp_serial;
+    if(h.changes < 0xffff) ++h.changes;
+
+    choose = choose || h.folded || (uniform.type == RSXGL_DATA_TYPE_FLOAT && uniform.count == 1 && rsxgl_fp_uniform_is_switch(program.uniform_values[uniform.values_index]));
+  }
+
+  // Command lists keep to the generic program, as variants can be replaced before a list is called:
+  int32_t target = program.fp_active_variant;
+  if(!ctx -> state.enable.program_specialization || ctx -> command_list_recorder != 0) {
+    target = -1;
+  }
+  else if(choose) {
+    target = rsxgl_program_fp_variant_choose(ctx,program,draw);
+    program.fp_last_choice = draw;
+  }
+
+  bool switched = false;
+
+  if(target != program.fp_active_variant || choose) {
+    for(program_t::uniform_size_type i = 0;i < num_uniforms;++i) {
+      history[i].folded = 0;
+    }
+
+    if(target >= 0) {
+      const std::vector< uint32_t > & key = program.fp_variants[target].key;
+      for(size_t i = 0,n = key.size();i < n;) {
+	const program_t::uniform_t & uniform = program.uniforms[key[i]].second;
+	history[key[i]].folded = 1;
+	i += 1 + rsxgl_uniform_width(uniform.type) * uniform.count;
+      }
+    }
+  }
+
+  if(target != program.fp_active_variant) {
+    // Send the new image whatever it's missing:
+    const uint32_t synced = (target < 0) ? program.fp_generic_synced : program.fp_variants[target].synced;
+    for(program_t::uniform_size_type i = 0;i < num_uniforms;++i) {
+      if(!history[i].folded && history[i].changed_serial > synced) {
+	rsxgl_uniform_invalidate(program,i,RSXGL_FRAGMENT_SHADER);
+      }
+    }
+
+    program.fp_active_variant = target;
+    program.fp_active_ucode_offset = (target < 0) ? program.fp_ucode_offset : program.fp_variants[target].ucode_offset;
+    ++ctx -> uniform_statistics.fp_variant_switches;
+    switched = true;
+  }
+
+  // The changes, and the uniforms invalidated above, are about to be sent to the active image:
+  if(target < 0) {
+    program.fp_generic_synced = program.fp_serial;
+  }
+  else {
+    program_t::fp_variant_t & variant = program.fp_variants[target];
+    variant.synced = program.fp_serial;
+    variant.last_draw = draw;
+    variant.timestamp = timestamp;
+  }
+
+  return switched;
 }
 
 static inline uint8_t
@@ -611,20 +1011,608 @@ rsxgl_glsl_type_to_rsxgl_type(const glsl_type * type)
     if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_1D) {
       return RSXGL_DATA_TYPE_SAMPLER1D;
     }
-    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_2D) {
-      return RSXGL_DATA_TYPE_SAMPLER2D;
+    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_2D) {
+      return RSXGL_DATA_TYPE_SAMPLER2D;
+    }
+    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_3D) {
+      return RSXGL_DATA_TYPE_SAMPLER3D;
+    }
+    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_CUBE) {
+      return RSXGL_DATA_TYPE_SAMPLERCUBE;
+    }
+    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_RECT) {
+      return RSXGL_DATA_TYPE_SAMPLERRECT;
+    }
+  }
+  return RSXGL_DATA_TYPE_UNKNOWN;
+}
+
+struct rsxgl_cstr_less {
+  bool operator()(const char * lhs,const char * rhs) const {
+    return strcmp(lhs,rhs) < 0;
+  }
+};
+
+// Tables that glLinkProgram() accumulates, whether from Mesa's results or from program images,
+// before they're migrated into the program:
+struct rsxgl_program_link_tables_t {
+  typedef std::map< const char *, program_t::attrib_t, rsxgl_cstr_less > attrib_map_type;
+  typedef std::map< const char *, program_t::uniform_t, rsxgl_cstr_less > uniform_map_type;
+  typedef std::map< const char *, program_t::sampler_uniform_t, rsxgl_cstr_less > sampler_uniform_map_type;
+
+  std::deque< ieee32_t > uniform_values;
+  std::deque< uint32_t > program_offsets;
+
+  attrib_map_type attribs;
+  uniform_map_type uniforms;
+  sampler_uniform_map_type sampler_uniforms;
+  program_t::name_size_type names_size;
+
+  // Top-level struct uniforms, and the names of their members in declaration order:
+  std::map< std::string, std::deque< const char * > > uniform_blocks;
+
+  rsxgl_program_link_tables_t()
+    : names_size(0) {
+  }
+};
+
+// Members of a struct are named "block.member":
+static void
+rsxgl_program_link_block_member(rsxgl_program_link_tables_t & tables,const char * name)
+{
+  const char * dot = strchr(name,'.');
+  if(dot != 0 && memchr(name,'[',dot - name) == 0) {
+    const std::string block_name(name,dot - name);
+    auto it = tables.uniform_blocks.find(block_name);
+
+    if(it == tables.uniform_blocks.end() && tables.uniform_blocks.size() < RSXGL_MAX_PROGRAM_UNIFORM_BLOCKS) {
+      it = tables.uniform_blocks.insert(std::make_pair(block_name,std::deque< const char * >())).first;
+      tables.names_size += block_name.length() + 1;
+    }
+
+    if(it != tables.uniform_blocks.end()) {
+      it -> second.push_back(name);
+    }
+  }
+}
+
+// Build the program's attribute, uniform & texture tables:
+static void
+rsxgl_program_link_tables(program_t & program,rsxgl_program_link_tables_t & tables)
+{
+  const std::deque< ieee32_t > & uniform_values = tables.uniform_values;
+  const std::deque< uint32_t > & program_offsets = tables.program_offsets;
+  const rsxgl_program_link_tables_t::attrib_map_type & attribs = tables.attribs;
+  const rsxgl_program_link_tables_t::uniform_map_type & uniforms = tables.uniforms;
+  const rsxgl_program_link_tables_t::sampler_uniform_map_type & sampler_uniforms = tables.sampler_uniforms;
+  const program_t::name_size_type names_size = tables.names_size;
+  const std::map< std::string, std::deque< const char * > > & uniform_blocks = tables.uniform_blocks;
+
+  // Migrate uniform values array:
+  program.uniform_values.reset(new ieee32_t[uniform_values.size()]);
+  std::copy(uniform_values.begin(),uniform_values.end(),program.uniform_values.get());
+
+  // Migrate program offsets array:
+  program.program_offsets.reset(new program_t::instruction_size_type[program_offsets.size()]);
+  std::copy(program_offsets.begin(),program_offsets.end(),program.program_offsets.get());
+  program.num_program_offsets = program_offsets.size();
+
+  // Make space for attribute and uniform names:
+#if 0
+  rsxgl_debug_printf("names require %u bytes\n",(unsigned int)names_size);
+#endif
+  program.names.reset(new char[names_size]);
+  char * pnames = program.names.get();
+
+  auto push_name = [&program,&pnames](const char * name) -> program_t::name_size_type {
+    program_t::name_size_type result = pnames - program.names.get();
+    while(*name != 0) {
+      *pnames++ = *name++;
+    }
+    *pnames++ = 0;
+    return result;
+  };
+
+  // Migrate attributes table:
+  {
+#if 0
+    rsxgl_debug_printf("%u attribs\n",attribs.size());
+#endif
+
+    program.attribs.resize(attribs.size());
+    program.attribs_enabled.reset();
+
+    auto it = program.attribs.begin();
+    for(const auto & name_attrib : attribs) {
+#if 0
+      rsxgl_debug_printf(" %s: type:%u index:%u\n",
+			 jt -> first,
+			 (unsigned int)jt -> second.type,
+			 (unsigned int)jt -> second.index);
+#endif
+
+      *it++ = std::make_pair(push_name(name_attrib.first),name_attrib.second);
+
+      program.attribs_enabled.set(name_attrib.second.index);
+      program.attrib_assignments.set(name_attrib.second.index,name_attrib.second.location);
+    }
+  }
+
+  // Migrate uniforms table:
+  {
+#if 0
+    rsxgl_debug_printf("%u uniforms\n",uniforms.size());
+#endif
+
+    program.uniforms.resize(uniforms.size());
+
+    unsigned int i = 0;
+    auto it = program.uniforms.begin();
+    for(const auto & name_uniform : uniforms) {
+#if 0
+      rsxgl_debug_printf(" %s: type:%u count:%u values_index:%u vp_index:%u program_offsets_index:%u\n",
+			 value.first,
+			 (unsigned int)value.second.type,
+			 (unsigned int)value.second.count,
+			 (unsigned int)value.second.values_index,
+			 (unsigned int)value.second.vp_index,
+			 (unsigned int)value.second.program_offsets_index);
+#endif
+
+      *it++ = std::make_pair(push_name(name_uniform.first),name_uniform.second);
+    }
+
+    // Fragment program uniforms are patched into the program's microcode, which doesn't hold
+    // their values yet:
+    program.dirty_uniforms.reset(new program_t::uniform_size_type[uniforms.size()]);
+    program.num_dirty_uniforms = 0;
+    for(program_t::uniform_size_type i = 0,n = program.uniforms.size();i < n;++i) {
+      rsxgl_uniform_invalidate(program,i,RSXGL_FRAGMENT_SHADER);
+    }
+  }
+
+  // Migrate uniform blocks table:
+  {
+    size_t num_members = 0;
+    for(const auto & name_members : uniform_blocks) {
+      num_members += name_members.second.size();
+    }
+
+    program.uniform_blocks.resize(uniform_blocks.size());
+    program.uniform_block_members.reset(new program_t::uniform_size_type[num_members]);
+    program.uniform_block_name_max_length = 0;
+
+    program_t::uniform_size_type members_index = 0;
+    uint8_t block_index = 0;
+    auto it = program.uniform_blocks.begin();
+    for(const auto & name_members : uniform_blocks) {
+      program_t::uniform_block_t block;
+      block.binding = 0;
+      block.vp_contiguous = 1;
+      block.invalid = 1;
+      block.members_index = members_index;
+      block.num_members = name_members.second.size();
+      block.num_columns = 0;
+      block.vp_index = 0;
+      block.buffer = 0;
+      block.buffer_offset = 0;
+      block.generation = 0;
+
+      for(const char * member_name : name_members.second) {
+	auto jt = program_t::table_t< program_t::uniform_t >::find(program.names.get(),program.uniforms,member_name);
+	rsxgl_assert(jt.second);
+
+	program_t::uniform_t & uniform = jt.first -> second;
+	uniform.block = block_index;
+	uniform.block_column = block.num_columns;
+
+	if(block.num_columns == 0) {
+	  block.vp_index = uniform.vp_index;
+	}
+	if(!uniform.enabled.test(RSXGL_VERTEX_SHADER) || uniform.vp_index != (block.vp_index + block.num_columns)) {
+	  block.vp_contiguous = 0;
+	}
+
+	program.uniform_block_members[members_index++] = std::distance(program.uniforms.begin(),jt.first);
+	block.num_columns += uniform.count;
+      }
+
+      *it++ = std::make_pair(push_name(name_members.first.c_str()),block);
+
+      program.uniform_block_name_max_length = std::max(program.uniform_block_name_max_length,(program_t::name_size_type)name_members.first.length());
+      ++block_index;
+    }
+  }
+
+  // Migrate texture table:
+  program.fp_texcoords.reset();
+  program.fp_texcoord2D.reset();
+  program.fp_texcoord3D.reset();
+  program.textures_enabled.reset();
+
+  for(unsigned int i = 0;i < RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;++i) {
+    program.texture_assignments.set(i,0);
+  }
+
+  {
+#if 0
+    rsxgl_debug_printf("%u sampler uniforms\n",sampler_uniforms.size());
+#endif
+
+    program.sampler_uniforms.resize(sampler_uniforms.size());
+
+    auto it = program.sampler_uniforms.begin();
+    for(const auto & name_uniform : sampler_uniforms) {
+#if 0
+      rsxgl_debug_printf(" %s: type:%u vp_index:%u fp_index:%u\n",
+			 value.first,
+			 (unsigned int)value.second.type,
+			 (unsigned int)value.second.vp_index,
+			 (unsigned int)value.second.fp_index);
+#endif
+
+      *it++ = std::make_pair(push_name(name_uniform.first),name_uniform.second);
+
+      if(name_uniform.second.vp_index != RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
+	program.textures_enabled.set(name_uniform.second.vp_index);
+      }
+      if(name_uniform.second.fp_index != RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
+	program.fp_texcoords.set(name_uniform.second.fp_index);
+	if(name_uniform.second.type == RSXGL_DATA_TYPE_SAMPLER2D) {
+	  program.fp_texcoord2D.set(name_uniform.second.fp_index);
+	}
+	else if(name_uniform.second.type == RSXGL_DATA_TYPE_SAMPLER3D) {
+	  program.fp_texcoord3D.set(name_uniform.second.fp_index);
+	}
+	program.textures_enabled.set(RSXGL_MAX_VERTEX_TEXTURE_IMAGE_UNITS + name_uniform.second.fp_index);
+      }
+    }
+  }
+
+  {
+    //program_t::uniform_table_type::type table = program.uniform_table();
+    //const std::pair< bool, program_t::uniform_size_type > tmp = const_cast< const program_t & > (program).uniform_table().find(const_cast< const program_t & > (program).names(),"rsxgl_InstanceID");
+    auto tmp = program_t::table_t< program_t::uniform_t >::find(program.names.get(),program.uniforms,"rsxgl_InstanceID");
+    if(tmp.second) {
+      program.instanceid_index = tmp.first -> second.vp_index;
+    }
+    else {
+      program.instanceid_index = ~0;
+    }
+  }
+}
+
+// A program that captures no varyings has no stream programs:
+static void
+rsxgl_program_no_stream(program_t & program)
+{
+  program.nvfx_streamvp = 0;
+  program.nvfx_streamfp = 0;
+  program.streamvp_ucode_offset = ~0;
+  program.streamfp_ucode_offset = ~0;
+  program.streamvp_num_insn = 0;
+  program.streamfp_num_insn = 0;
+  program.streamvp_input_mask = 0;
+  program.streamvp_output_mask = 0;
+  program.streamvp_num_internal_const = 0;
+  program.streamfp_control = 0;
+  program.streamfp_num_outputs = 0;
+  program.streamfp_interleaved = 0;
+  program.streamvp_vertexid_index = ~0;
+}
+
+static inline bool
+rsxgl_program_image_sampler(const uint8_t type)
+{
+  return type >= RSXGL_DATA_TYPE_SAMPLER1D && type <= RSXGL_DATA_TYPE_SAMPLERRECT;
+}
+
+// A constant's columns each have an entry, the first of which holds the constant's count. Call f
+// with the first entry of each constant, and its count; stops at the first call that fails:
+template< typename Function >
+static bool
+rsxgl_program_image_for_each_constant(const rsxgl_program_image_t & image,Function f)
+{
+  for(uint32_t i = 0,n = image.constants.size();i < n;) {
+    const uint32_t count = std::max(image.constants[i].count,(uint8_t)1);
+    if(count > (n - i) || !f(&image.constants[i],count)) return false;
+    i += count;
+  }
+  return true;
+}
+
+// Link a program from the images that glShaderBinary() loaded into its shaders from an archive,
+// instead of by compiling GLSL (see program_archive.h). The images' attribute, constant & sampler
+// tables take the place of Mesa's; attributes are assigned the registers that nv40asm chose:
+static bool
+rsxgl_program_link_images(program_t & program,std::string & info)
+{
+  static const std::string kImagesFail("A program loaded from an archive needs one vertex and one fragment program");
+  static const std::string kImagesParseFail("Failed to parse program image");
+  static const std::string kImagesLimitFail("Program image exceeds the implementation's limits");
+  static const std::string kImagesConstFail("Vertex and fragment program constants of the same name have different types");
+  static const std::string kImagesFeedbackFail("Programs loaded from an archive can't capture transform feedback varyings");
+  static const std::string kVPUcodeAllocFail("Failed to allocate space for vertex program microcode");
+  static const std::string kFPUcodeAllocFail("Failed to allocate space for fragment program microcode");
+
+  const shader_t * shaders[RSXGL_MAX_SHADER_TYPES] = { 0, 0 };
+  for(shader_t::name_type name : program.attached_shaders) {
+    const shader_t & shader = shader_t::storage().at(name);
+    if(shader.type >= RSXGL_MAX_SHADER_TYPES || shaders[shader.type] != 0) {
+      info += kImagesFail;
+      return false;
+    }
+    shaders[shader.type] = &shader;
+  }
+
+  if(shaders[RSXGL_VERTEX_SHADER] == 0 || shaders[RSXGL_FRAGMENT_SHADER] == 0) {
+    info += kImagesFail;
+    return false;
+  }
+
+  rsxgl_program_image_t vp, fp;
+  if(!rsxgl_program_image_parse(shaders[RSXGL_VERTEX_SHADER] -> binary.get(),shaders[RSXGL_VERTEX_SHADER] -> binary_size,vp) ||
+     vp.type != RSXGL_PROGRAM_IMAGE_VERTEX ||
+     !rsxgl_program_image_parse(shaders[RSXGL_FRAGMENT_SHADER] -> binary.get(),shaders[RSXGL_FRAGMENT_SHADER] -> binary_size,fp) ||
+     fp.type != RSXGL_PROGRAM_IMAGE_FRAGMENT) {
+    info += kImagesParseFail;
+    return false;
+  }
+
+  if(program.mesa_program -> TransformFeedback.NumVarying > 0) {
+    info += kImagesFeedbackFail;
+    return false;
+  }
+
+  if(vp.num_insn == 0 || vp.num_insn > RSXGL__VERTEX__MAX_PROGRAM_INSTRUCTIONS ||
+     fp.num_insn == 0 || fp.num_insn > RSXGL__FRAGMENT__MAX_PROGRAM_INSTRUCTIONS) {
+    info += kImagesLimitFail;
+    return false;
+  }
+
+  for(const auto & attrib : vp.attribs) {
+    if(rsxgl_program_image_sampler(attrib.type) ? (attrib.index >= RSXGL_MAX_VERTEX_TEXTURE_IMAGE_UNITS) : (!attrib.is_output && attrib.index >= RSXGL_MAX_VERTEX_ATTRIBS)) {
+      info += kImagesLimitFail;
+      return false;
+    }
+  }
+
+  for(const auto & attrib : fp.attribs) {
+    if(rsxgl_program_image_sampler(attrib.type) && attrib.index >= RSXGL_MAX_TEXTURE_IMAGE_UNITS) {
+      info += kImagesLimitFail;
+      return false;
+    }
+  }
+
+  rsxgl_program_link_tables_t tables;
+
+  program.attrib_name_max_length = 0;
+  program.uniform_name_max_length = 0;
+
+  auto add_name = [&tables](program_t::name_size_type & max_length,const char * name) -> void {
+    const program_t::name_size_type name_length = strlen(name);
+    max_length = std::max(max_length,name_length);
+    tables.names_size += name_length + 1;
+  };
+
+  // Vertex program immediates; these are loaded with the program:
+  uint32_t vp_num_internal_const = 0;
+  bool result = rsxgl_program_image_for_each_constant(vp,[&tables,&vp_num_internal_const](const rsxgl_program_image_t::constant_t * constant,const uint32_t count) -> bool {
+      if(!constant -> is_internal) return true;
+
+      for(uint32_t j = 0;j < count;++j,++constant) {
+	if(constant -> index >= (RSXGL__VERTEX__MAX_PROGRAM_UNIFORM_COMPONENTS / 4)) return false;
+
+	tables.program_offsets.push_back(1);
+	tables.program_offsets.push_back(constant -> index);
+
+	for(unsigned int k = 0;k < 4;++k) {
+	  ieee32_t tmp;
+	  tmp.u = constant -> values[k];
+	  tables.uniform_values.push_back(tmp);
+	}
+
+	++vp_num_internal_const;
+      }
+      return true;
+    });
+
+  // Vertex program uniforms, whose columns are loaded at consecutive constant indices:
+  result = result && rsxgl_program_image_for_each_constant(vp,[&tables,&program,&add_name](const rsxgl_program_image_t::constant_t * constant,const uint32_t count) -> bool {
+      if(constant -> is_internal || constant -> name == 0 || constant -> type > RSXGL_DATA_TYPE_FLOAT4x4) return true;
+
+      program_t::uniform_t uniform;
+      uniform.type = constant -> type;
+      uniform.count = count;
+      uniform.values_index = tables.uniform_values.size();
+      uniform.vp_index = constant -> index;
+      uniform.program_offsets_index = 0;
+      uniform.block = RSXGL_MAX_PROGRAM_UNIFORM_BLOCKS;
+      uniform.block_column = 0;
+      uniform.listed = 0;
+      uniform.enabled.set(RSXGL_VERTEX_SHADER);
+
+      if(constant -> index + count > (RSXGL__VERTEX__MAX_PROGRAM_UNIFORM_COMPONENTS / 4)) return false;
+
+      const program_t::uniform_size_type width = rsxgl_uniform_width(uniform.type);
+      for(uint32_t j = 0;j < count;++j) {
+	if(constant[j].index != constant -> index + j) return false;
+
+	for(unsigned int k = 0;k < width;++k) {
+	  ieee32_t tmp;
+	  tmp.u = constant[j].values[k];
+	  tables.uniform_values.push_back(tmp);
+	}
+      }
+
+      if(tables.uniforms.insert(std::make_pair(constant -> name,uniform)).second) {
+	add_name(program.uniform_name_max_length,constant -> name);
+	rsxgl_program_link_block_member(tables,constant -> name);
+      }
+      return true;
+    });
+
+  if(!result) {
+    info += kImagesLimitFail;
+    return false;
+  }
+
+  // Fragment program uniforms, which are patched into the microcode. They're merged with the
+  // vertex program's uniforms of the same name:
+  result = rsxgl_program_image_for_each_constant(fp,[&tables,&program,&add_name](const rsxgl_program_image_t::constant_t * constant,const uint32_t count) -> bool {
+      if(constant -> is_internal || constant -> name == 0 || constant -> type > RSXGL_DATA_TYPE_FLOAT4x4) return true;
+
+      auto it = tables.uniforms.find(constant -> name);
+      if(it == tables.uniforms.end()) {
+	program_t::uniform_t uniform;
+	uniform.type = constant -> type;
+	uniform.count = count;
+	uniform.values_index = tables.uniform_values.size();
+	uniform.vp_index = 0;
+	uniform.program_offsets_index = 0;
+	uniform.block = RSXGL_MAX_PROGRAM_UNIFORM_BLOCKS;
+	uniform.block_column = 0;
+	uniform.listed = 0;
+
+	const program_t::uniform_size_type width = rsxgl_uniform_width(uniform.type);
+	for(uint32_t j = 0;j < count;++j) {
+	  for(unsigned int k = 0;k < width;++k) {
+	    ieee32_t tmp;
+	    tmp.u = constant[j].values[k];
+	    tables.uniform_values.push_back(tmp);
+	  }
+	}
+
+	it = tables.uniforms.insert(std::make_pair(constant -> name,uniform)).first;
+	add_name(program.uniform_name_max_length,constant -> name);
+	rsxgl_program_link_block_member(tables,constant -> name);
+      }
+      else if(it -> second.type != constant -> type || it -> second.count != count) {
+	return false;
+      }
+
+      program_t::uniform_t & uniform = it -> second;
+      const size_t program_offsets_index = tables.program_offsets.size();
+
+      for(uint32_t j = 0;j < count;++j) {
+	const std::vector< uint32_t > & offsets = constant[j].fp_offsets;
+	tables.program_offsets.push_back(offsets.size());
+	tables.program_offsets.insert(tables.program_offsets.end(),offsets.begin(),offsets.end());
+
+	if(!offsets.empty()) {
+	  uniform.enabled.set(RSXGL_FRAGMENT_SHADER);
+	}
+      }
+
+      if(uniform.enabled.test(RSXGL_FRAGMENT_SHADER)) {
+	uniform.program_offsets_index = program_offsets_index;
+      }
+      else {
+	tables.program_offsets.resize(program_offsets_index);
+      }
+      return true;
+    });
+
+  if(!result) {
+    info += kImagesConstFail;
+    return false;
+  }
+
+  // Vertex program inputs & samplers:
+  for(const auto & attrib : vp.attribs) {
+    if(attrib.name == 0) continue;
+
+    if(rsxgl_program_image_sampler(attrib.type)) {
+      auto it = tables.sampler_uniforms.find(attrib.name);
+      if(it == tables.sampler_uniforms.end()) {
+	program_t::sampler_uniform_t sampler_uniform;
+	sampler_uniform.type = attrib.type;
+	sampler_uniform.vp_index = RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;
+	sampler_uniform.fp_index = RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;
+	it = tables.sampler_uniforms.insert(std::make_pair(attrib.name,sampler_uniform)).first;
+	add_name(program.uniform_name_max_length,attrib.name);
+      }
+      it -> second.vp_index = attrib.index;
+    }
+    else if(!attrib.is_output) {
+      program_t::attrib_t program_attrib;
+      program_attrib.type = attrib.type;
+      program_attrib.index = attrib.index;
+      program_attrib.location = attrib.index;
+
+      if(tables.attribs.insert(std::make_pair(attrib.name,program_attrib)).second) {
+	add_name(program.attrib_name_max_length,attrib.name);
+      }
+    }
+  }
+
+  // Fragment program samplers:
+  for(const auto & attrib : fp.attribs) {
+    if(attrib.name == 0 || !rsxgl_program_image_sampler(attrib.type)) continue;
+
+    auto it = tables.sampler_uniforms.find(attrib.name);
+    if(it == tables.sampler_uniforms.end()) {
+      program_t::sampler_uniform_t sampler_uniform;
+      sampler_uniform.type = attrib.type;
+      sampler_uniform.vp_index = RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;
+      sampler_uniform.fp_index = RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;
+      it = tables.sampler_uniforms.insert(std::make_pair(attrib.name,sampler_uniform)).first;
+      add_name(program.uniform_name_max_length,attrib.name);
+    }
+    it -> second.fp_index = attrib.index;
+  }
+
+  // Copy the vertex program's microcode to cache-aligned memory:
+  {
+    struct nvfx_vertex_program_exec * address = (struct nvfx_vertex_program_exec *)mspace_memalign(rsxgl_main_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,vp.num_insn * sizeof(struct nvfx_vertex_program_exec));
+    if(address == 0) {
+      info += kVPUcodeAllocFail;
+      return false;
     }
-    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_3D) {
-      return RSXGL_DATA_TYPE_SAMPLER3D;
+
+    program.vp_ucode_offset = rsxgl_vp_ucode_offset(address);
+
+    for(uint32_t i = 0;i < vp.num_insn;++i) {
+      for(unsigned int j = 0;j < 4;++j) {
+	address[i].data[j] = rsxgl_program_image_read32(vp.ucode + (((i * 4) + j) * sizeof(uint32_t)));
+      }
     }
-    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_CUBE) {
-      return RSXGL_DATA_TYPE_SAMPLERCUBE;
+
+    program.vp_num_insn = vp.num_insn;
+    program.vp_input_mask = vp.input_mask;
+    program.vp_output_mask = vp.output_mask;
+    program.vp_num_internal_const = vp_num_internal_const;
+  }
+
+  // Copy the fragment program's microcode to RSX memory; nv40asm has already swapped it:
+  {
+    uint32_t * address = (uint32_t *)rsxgl_heap_memalign(rsxgl_rsx_ucode_heap(),RSXGL_CACHE_LINE_SIZE,fp.num_insn * 4 * sizeof(uint32_t));
+    if(address == 0) {
+      info += kFPUcodeAllocFail;
+      return false;
     }
-    else if(type -> sampler_dimensionality == GLSL_SAMPLER_DIM_RECT) {
-      return RSXGL_DATA_TYPE_SAMPLERRECT;
+
+    program.fp_ucode_offset = rsxgl_rsx_ucode_offset(address);
+
+    for(uint32_t i = 0,n = fp.num_insn * 4;i < n;++i) {
+      address[i] = rsxgl_program_image_read32(fp.ucode + (i * sizeof(uint32_t)));
     }
+
+    program.fp_num_insn = fp.num_insn;
+    program.fp_control = fp.fp_control;
+    program.fp_active_ucode_offset = program.fp_ucode_offset;
   }
-  return RSXGL_DATA_TYPE_UNKNOWN;
+
+  // There's no Mesa program to specialize, or to capture varyings with:
+  program.nvfx_vp = 0;
+  program.nvfx_fp = 0;
+
+  rsxgl_program_link_tables(program,tables);
+
+  program.point_sprite_control = 0;
+  rsxgl_program_no_stream(program);
+
+  return true;
 }
 
 GLAPI void APIENTRY
@@ -658,15 +1646,16 @@ glLinkProgram (GLuint program_name)
     program.vp_ucode_offset = ~0U;
   }
   if(program.fp_ucode_offset != ~0U) {
-    mspace_free(rsxgl_rsx_ucode_mspace(),rsxgl_rsx_ucode_address(program.fp_ucode_offset));
+    rsxgl_heap_free(rsxgl_rsx_ucode_heap(),rsxgl_rsx_ucode_address(program.fp_ucode_offset));
     program.fp_ucode_offset = ~0U;
   }
+  rsxgl_program_fp_variants_clear(program);
   if(program.streamvp_ucode_offset != ~0U) {
     mspace_free(rsxgl_main_ucode_mspace(),rsxgl_main_ucode_address(program.streamvp_ucode_offset));
     program.streamvp_ucode_offset = ~0U;
   }
   if(program.streamfp_ucode_offset != ~0U) {
-    mspace_free(rsxgl_rsx_ucode_mspace(),rsxgl_rsx_ucode_address(program.streamfp_ucode_offset));
+    rsxgl_heap_free(rsxgl_rsx_ucode_heap(),rsxgl_rsx_ucode_address(program.streamfp_ucode_offset));
     program.streamfp_ucode_offset = ~0U;
   }
   program.uniform_values.release();
@@ -678,6 +1667,27 @@ glLinkProgram (GLuint program_name)
   //
   std::string info;
 
+  // Shaders loaded from an archive are linked from their images, instead of by Mesa:
+  const size_t num_images = std::count_if(program.attached_shaders.begin(),program.attached_shaders.end(),[](const shader_t::name_type name) -> bool {
+      return shader_t::storage().at(name).binary_format == GL_PROGRAM_ARCHIVE_RSX;
+    });
+
+  if(num_images > 0) {
+    static const std::string kImagesMixedFail("Shaders loaded from an archive can't be linked with GLSL shaders");
+
+    if(num_images != program.attached_shaders.size()) {
+      info += kImagesMixedFail;
+    }
+    else if(rsxgl_program_link_images(program,info)) {
+      program.linked_shaders = program.attached_shaders;
+      program.attached_shaders.clear();
+      program.linked = GL_TRUE;
+    }
+
+    std::swap(program.info,info);
+    RSXGL_NOERROR_();
+  }
+
   compiler_context_t * cctx = ctx -> compiler_context();
 
   for(shader_t::name_type name : program.attached_shaders) {
@@ -703,7 +1713,23 @@ glLinkProgram (GLuint program_name)
 
   info += std::string(program.mesa_program -> InfoLog);
 
-  if(program.mesa_program -> LinkStatus) {
+  // Interleaved varyings are each captured as a vec4 (see rsxgl_feedback_framebuffer_validate()),
+  // so a record with anything smaller in it would be written with the wrong stride:
+  bool feedback_supported = true;
+  if(program.mesa_program -> LinkStatus && program.feedback_interleaved) {
+    static const std::string kFeedbackInterleavedFail("Interleaved transform feedback can only capture vec4 varyings");
+
+    const gl_transform_feedback_info & feedback_info = program.mesa_program -> LinkedTransformFeedback;
+    for(unsigned int i = 0;i < feedback_info.NumOutputs;++i) {
+      if(feedback_info.Outputs[i].NumComponents != 4) {
+	info += kFeedbackInterleavedFail;
+	feedback_supported = false;
+	break;
+      }
+    }
+  }
+
+  if(program.mesa_program -> LinkStatus && feedback_supported) {
     pipe_stream_output_info stream_info;
     tgsi_token * vp_tokens = 0;
 
@@ -745,7 +1771,7 @@ glLinkProgram (GLuint program_name)
       {
 	static const std::string kFPUcodeAllocFail("Failed to allocate space for fragment program microcode");
 	
-	uint32_t * address = (uint32_t *)mspace_memalign(rsxgl_rsx_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,program.nvfx_fp -> insn_len * sizeof(uint32_t));
+	uint32_t * address = (uint32_t *)rsxgl_heap_memalign(rsxgl_rsx_ucode_heap(),RSXGL_CACHE_LINE_SIZE,program.nvfx_fp -> insn_len * sizeof(uint32_t));
 	if(address == 0) {
 	  info += kFPUcodeAllocFail;
 	  //goto fail;
@@ -760,6 +1786,7 @@ glLinkProgram (GLuint program_name)
 	  
 	  program.fp_num_insn = program.nvfx_fp -> insn_len / 4;
 	  program.fp_control = program.nvfx_fp -> fp_control;
+	  program.fp_active_ucode_offset = program.fp_ucode_offset;
 	}
       }
 
@@ -775,19 +1802,14 @@ glLinkProgram (GLuint program_name)
     // sampler_uniforms - map from string's to sampler_uniform_t's
     // then iterate over attribs, uniforms, sampler uniforms, create names area
 
-    std::deque< ieee32_t > uniform_values;
-    std::deque< uint32_t > program_offsets;
-
-    struct cstr_less {
-      bool operator()(const char * lhs,const char * rhs) const {
-	return strcmp(lhs,rhs) < 0;
-      }
-    };
+    rsxgl_program_link_tables_t tables;
 
-    std::map< const char *, program_t::attrib_t, cstr_less > attribs;
-    std::map< const char *, program_t::uniform_t, cstr_less > uniforms;
-    std::map< const char *, program_t::sampler_uniform_t, cstr_less > sampler_uniforms;
-    program_t::name_size_type names_size = 0;
+    std::deque< ieee32_t > & uniform_values = tables.uniform_values;
+    std::deque< uint32_t > & program_offsets = tables.program_offsets;
+    rsxgl_program_link_tables_t::attrib_map_type & attribs = tables.attribs;
+    rsxgl_program_link_tables_t::uniform_map_type & uniforms = tables.uniforms;
+    rsxgl_program_link_tables_t::sampler_uniform_map_type & sampler_uniforms = tables.sampler_uniforms;
+    program_t::name_size_type & names_size = tables.names_size;
 
     //
     struct gl_shader * gl_vsh = program.mesa_program->_LinkedShaders[MESA_SHADER_VERTEX];
@@ -888,6 +1910,9 @@ glLinkProgram (GLuint program_name)
 	  program_t::uniform_t uniform;
 	  uniform.type = rsxgl_glsl_type_to_rsxgl_type(type);
 	  uniform.count = type -> matrix_columns;
+	  uniform.block = RSXGL_MAX_PROGRAM_UNIFORM_BLOCKS;
+	  uniform.block_column = 0;
+	  uniform.listed = 0;
 
 #if 0
 	  rsxgl_debug_printf("\t\ttype:%u count:%u\n",(unsigned int)uniform.type,(unsigned int)uniform.count);
@@ -916,16 +1941,23 @@ glLinkProgram (GLuint program_name)
 	  // for each in count:
 	  // - store an offset count n
 	  // - store n (offsets / 4)
+	  // A matrix's columns are consecutive parameters:
 	  uniform.program_offsets_index = 0;
 
 	  for(unsigned int i = 0,n = gl_fp -> Parameters -> NumParameters;i < n;++i) {
 	    gl_program_parameter * parameter = gl_fp -> Parameters -> Parameters + i;
 	    if(parameter -> Type == PROGRAM_UNIFORM && strcmp(parameter -> Name,uniform_storage -> name) == 0) {
-	      nvfx_fp_constant_map_t::const_iterator it = nvfx_fp_constant_map.find(i);
-	      if(it != nvfx_fp_constant_map.end()) {
+	      const size_t program_offsets_index = program_offsets.size();
+
+	      for(unsigned int j = 0;j < uniform.count;++j) {
+		nvfx_fp_constant_map_t::const_iterator it = nvfx_fp_constant_map.find(i + j);
+		if(it == nvfx_fp_constant_map.end()) {
+		  program_offsets.push_back(0);
+		  continue;
+		}
+
 		uniform.enabled.set(RSXGL_FRAGMENT_SHADER);
-		uniform.program_offsets_index = program_offsets.size();
-		
+
 		const std::deque< uint32_t > & offsets = it -> second;
 		program_offsets.push_back(offsets.size());
 
@@ -933,12 +1965,21 @@ glLinkProgram (GLuint program_name)
 		  program_offsets.push_back(*jt / 4);
 		}
 	      }
+
+	      if(uniform.enabled.test(RSXGL_FRAGMENT_SHADER)) {
+		uniform.program_offsets_index = program_offsets_index;
+	      }
+	      else {
+		program_offsets.resize(program_offsets_index);
+	      }
 	      break;
 	    }
 	  }
 
 	  uniforms.insert(std::make_pair(uniform_storage -> name,uniform));
 	  add_name = true;
+
+	  rsxgl_program_link_block_member(tables,uniform_storage -> name);
 	}
 	// Sampler:
 	else {
@@ -977,136 +2018,7 @@ glLinkProgram (GLuint program_name)
       }
     }
 
-    // Migrate uniform values array:
-    program.uniform_values.reset(new ieee32_t[uniform_values.size()]);
-    std::copy(uniform_values.begin(),uniform_values.end(),program.uniform_values.get());
-
-    // Migrate program offsets array:
-    program.program_offsets.reset(new program_t::instruction_size_type[program_offsets.size()]);
-    std::copy(program_offsets.begin(),program_offsets.end(),program.program_offsets.get());
-
-    // Make space for attribute and uniform names:
-#if 0
-    rsxgl_debug_printf("names require %u bytes\n",(unsigned int)names_size);
-#endif
-    program.names.reset(new char[names_size]);
-    char * pnames = program.names.get();
-
-    auto push_name = [&program,&pnames](const char * name) -> program_t::name_size_type {
-      program_t::name_size_type result = pnames - program.names.get();
-      while(*name != 0) {
-	*pnames++ = *name++;
-      }
-      *pnames++ = 0;
-      return result;
-    };
-
-    // Migrate attributes table:
-    {
-#if 0
-      rsxgl_debug_printf("%u attribs\n",attribs.size());
-#endif
-
-      program.attribs.resize(attribs.size());
-      program.attribs_enabled.reset();
-
-      auto it = program.attribs.begin();
-      for(const auto & name_attrib : attribs) {
-#if 0
-	rsxgl_debug_printf(" %s: type:%u index:%u\n",
-			   jt -> first,
-			   (unsigned int)jt -> second.type,
-			   (unsigned int)jt -> second.index);
-#endif
-
-	*it++ = std::make_pair(push_name(name_attrib.first),name_attrib.second);
-
-	program.attribs_enabled.set(name_attrib.second.index);
-	program.attrib_assignments.set(name_attrib.second.index,name_attrib.second.location);
-      }
-    }
-
-    // Migrate uniforms table:
-    {
-#if 0
-      rsxgl_debug_printf("%u uniforms\n",uniforms.size());
-#endif
-
-      program.uniforms.resize(uniforms.size());
-
-      unsigned int i = 0;
-      auto it = program.uniforms.begin();
-      for(const auto & name_uniform : uniforms) {
-#if 0
-	rsxgl_debug_printf(" %s: type:%u count:%u values_index:%u vp_index:%u program_offsets_index:%u\n",
-			   value.first,
-			   (unsigned int)value.second.type,
-			   (unsigned int)value.second.count,
-			   (unsigned int)value.second.values_index,
-			   (unsigned int)value.second.vp_index,
-			   (unsigned int)value.second.program_offsets_index);
-#endif
-
-	*it++ = std::make_pair(push_name(name_uniform.first),name_uniform.second);
-      }
-    }
-
-    // Migrate texture table:
-    program.fp_texcoords.reset();
-    program.fp_texcoord2D.reset();
-    program.fp_texcoord3D.reset();
-    program.textures_enabled.reset();
-
-    for(unsigned int i = 0;i < RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS;++i) {
-      program.texture_assignments.set(i,0);
-    }
-
-    {
-#if 0
-      rsxgl_debug_printf("%u sampler uniforms\n",sampler_uniforms.size());
-#endif
-
-      program.sampler_uniforms.resize(sampler_uniforms.size());
-
-      auto it = program.sampler_uniforms.begin();
-      for(const auto & name_uniform : sampler_uniforms) {
-#if 0
-	rsxgl_debug_printf(" %s: type:%u vp_index:%u fp_index:%u\n",
-			   value.first,
-			   (unsigned int)value.second.type,
-			   (unsigned int)value.second.vp_index,
-			   (unsigned int)value.second.fp_index);
-#endif
-
-	*it++ = std::make_pair(push_name(name_uniform.first),name_uniform.second);
-
-	if(name_uniform.second.vp_index != RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
-	  program.textures_enabled.set(name_uniform.second.vp_index);
-	}
-	if(name_uniform.second.fp_index != RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
-	  program.fp_texcoords.set(name_uniform.second.fp_index);
-	  if(name_uniform.second.type == RSXGL_DATA_TYPE_SAMPLER2D) {
-	    program.fp_texcoord2D.set(name_uniform.second.fp_index);
-	  }
-	  else if(name_uniform.second.type == RSXGL_DATA_TYPE_SAMPLER3D) {
-	    program.fp_texcoord3D.set(name_uniform.second.fp_index);
-	  }
-	  program.textures_enabled.set(RSXGL_MAX_VERTEX_TEXTURE_IMAGE_UNITS + name_uniform.second.fp_index);
-	}
-      }
-    }
-
-    {
-      //program_t::uniform_table_type::type table = program.uniform_table();
-      //const std::pair< bool, program_t::uniform_size_type > tmp = const_cast< const program_t & > (program).uniform_table().find(const_cast< const program_t & > (program).names(),"rsxgl_InstanceID");
-      auto tmp = program_t::table_t< program_t::uniform_t >::find(program.names.get(),program.uniforms,"rsxgl_InstanceID");
-      if(tmp.second) {
-	program.instanceid_index = tmp.first -> second.vp_index;
-      }
-      else {
-	program.instanceid_index = ~0;
-      }
-    }
+    rsxgl_program_link_tables(program,tables);
 
     // TODO: deal with this:
     program.point_sprite_control = 0;
@@ -1186,7 +2098,7 @@ glLinkProgram (GLuint program_name)
       {
 	static const std::string kFPUcodeAllocFail("Failed to allocate space for stream fragment program microcode");
 	
-	uint32_t * address = (uint32_t *)mspace_memalign(rsxgl_rsx_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,program.nvfx_streamfp -> insn_len * sizeof(uint32_t));
+	uint32_t * address = (uint32_t *)rsxgl_heap_memalign(rsxgl_rsx_ucode_heap(),RSXGL_CACHE_LINE_SIZE,program.nvfx_streamfp -> insn_len * sizeof(uint32_t));
 	if(address == 0) {
 	  info += kFPUcodeAllocFail;
 	  //goto fail;
@@ -1202,6 +2114,7 @@ glLinkProgram (GLuint program_name)
 	  program.streamfp_num_insn = program.nvfx_streamfp -> insn_len / 4;
 	  program.streamfp_control = program.nvfx_streamfp -> fp_control;
 	  program.streamfp_num_outputs = stream_info.num_outputs;
+	  program.streamfp_interleaved = program.feedback_interleaved;
 	}
       }
 
@@ -1209,18 +2122,7 @@ glLinkProgram (GLuint program_name)
       program.streamvp_vertexid_index = vertexid_index;
     }
     else {
-      program.nvfx_streamvp = 0;
-      program.nvfx_streamfp = 0;
-      program.streamvp_ucode_offset = ~0;
-      program.streamfp_ucode_offset = ~0;
-      program.streamvp_num_insn = 0;
-      program.streamfp_num_insn = 0;
-      program.streamvp_input_mask = 0;
-      program.streamvp_output_mask = 0;
-      program.streamvp_num_internal_const = 0;
-      program.streamfp_control = 0;
-      program.streamfp_num_outputs = 0;
-      program.streamvp_vertexid_index = ~0;
+      rsxgl_program_no_stream(program);
     }
 
     program.linked = GL_TRUE;
@@ -1259,14 +2161,16 @@ glUseProgram (GLuint program_name)
 {
   struct rsxgl_context_t * ctx = current_ctx();
 
-  if(program_name != 0 && !program_t::storage().is_object(program_name)) {
+  if(RSXGL_CHECK_ERRORS() && program_name != 0 && !program_t::storage().is_object(program_name)) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> state.enable.transform_feedback_mode != 0) {
+  if(RSXGL_CHECK_ERRORS() && ctx -> state.enable.transform_feedback_mode != 0) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
+  RSXGL_PERF_REDUNDANT(ctx,ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] == program_name);
+
   if(ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] != program_name) {
     const program_t::name_type prev_program_name = ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM];
     ctx -> program_binding.bind(RSXGL_ACTIVE_PROGRAM,program_name);
@@ -1550,6 +2454,264 @@ glGetUniformLocation (GLuint program_name, const GLchar* name)
   }
 }
 
+GLAPI void APIENTRY
+glGetUniformIndices (GLuint program_name, GLsizei uniformCount, const GLchar* *uniformNames, GLuint *uniformIndices)
+{
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  if(uniformCount < 0) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  const program_t & program = program_t::storage().at(program_name);
+
+  for(GLsizei i = 0;i < uniformCount;++i) {
+    uniformIndices[i] = GL_INVALID_INDEX;
+
+    if(!program.linked) continue;
+
+    auto tmp = program_t::table_t< program_t::uniform_t >::find(program.names.get(),program.uniforms,uniformNames[i]);
+    if(tmp.second) {
+      uniformIndices[i] = std::distance(program.uniforms.begin(),tmp.first);
+      continue;
+    }
+
+    auto tmp2 = program_t::table_t< program_t::sampler_uniform_t >::find(program.names.get(),program.sampler_uniforms,uniformNames[i]);
+    if(tmp2.second) {
+      uniformIndices[i] = program.uniforms.size() + std::distance(program.sampler_uniforms.begin(),tmp2.first);
+    }
+  }
+
+  RSXGL_NOERROR_();
+}
+
+static inline GLenum
+rsxgl_uniform_gl_type(const uint8_t type)
+{
+  switch(type) {
+  case RSXGL_DATA_TYPE_FLOAT:
+    return GL_FLOAT;
+  case RSXGL_DATA_TYPE_FLOAT2:
+    return GL_FLOAT_VEC2;
+  case RSXGL_DATA_TYPE_FLOAT3:
+    return GL_FLOAT_VEC3;
+  case RSXGL_DATA_TYPE_FLOAT4:
+    return GL_FLOAT_VEC4;
+  case RSXGL_DATA_TYPE_FLOAT4x4:
+    return GL_FLOAT_MAT4;
+  case RSXGL_DATA_TYPE_SAMPLER1D:
+    return GL_SAMPLER_1D;
+  case RSXGL_DATA_TYPE_SAMPLER2D:
+    return GL_SAMPLER_2D;
+  case RSXGL_DATA_TYPE_SAMPLER3D:
+    return GL_SAMPLER_3D;
+  case RSXGL_DATA_TYPE_SAMPLERCUBE:
+    return GL_SAMPLER_CUBE;
+  case RSXGL_DATA_TYPE_SAMPLERRECT:
+    return GL_SAMPLER_2D_RECT;
+  default:
+    return GL_NONE;
+  }
+}
+
+GLAPI void APIENTRY
+glGetActiveUniformsiv (GLuint program_name, GLsizei uniformCount, const GLuint *uniformIndices, GLenum pname, GLint *params)
+{
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  if(uniformCount < 0) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  const program_t & program = program_t::storage().at(program_name);
+
+  const size_t num_uniforms = program.linked ? (program.uniforms.size() + program.sampler_uniforms.size()) : 0;
+  for(GLsizei i = 0;i < uniformCount;++i) {
+    if(uniformIndices[i] >= num_uniforms) {
+      RSXGL_ERROR_(GL_INVALID_VALUE);
+    }
+  }
+
+  if(!(pname == GL_UNIFORM_TYPE || pname == GL_UNIFORM_SIZE || pname == GL_UNIFORM_NAME_LENGTH ||
+       pname == GL_UNIFORM_BLOCK_INDEX || pname == GL_UNIFORM_OFFSET || pname == GL_UNIFORM_ARRAY_STRIDE ||
+       pname == GL_UNIFORM_MATRIX_STRIDE || pname == GL_UNIFORM_IS_ROW_MAJOR)) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  for(GLsizei i = 0;i < uniformCount;++i) {
+    const GLuint index = uniformIndices[i];
+
+    // Samplers aren't members of blocks:
+    if(index >= program.uniforms.size()) {
+      const program_t::sampler_uniform_t & sampler_uniform = program.sampler_uniforms[index - program.uniforms.size()].second;
+
+      params[i] =
+	(pname == GL_UNIFORM_TYPE) ? (GLint)rsxgl_uniform_gl_type(sampler_uniform.type) :
+	(pname == GL_UNIFORM_SIZE) ? 1 :
+	(pname == GL_UNIFORM_NAME_LENGTH) ? (GLint)strlen(program.names.get() + program.sampler_uniforms[index - program.uniforms.size()].first) + 1 :
+	-1;
+      if(pname == GL_UNIFORM_IS_ROW_MAJOR) params[i] = GL_FALSE;
+      continue;
+    }
+
+    const program_t::uniform_t & uniform = program.uniforms[index].second;
+    const bool in_block = uniform.block < RSXGL_MAX_PROGRAM_UNIFORM_BLOCKS;
+
+    switch(pname) {
+    case GL_UNIFORM_TYPE:
+      params[i] = rsxgl_uniform_gl_type(uniform.type);
+      break;
+    case GL_UNIFORM_SIZE:
+      params[i] = 1;
+      break;
+    case GL_UNIFORM_NAME_LENGTH:
+      params[i] = strlen(program.names.get() + program.uniforms[index].first) + 1;
+      break;
+    case GL_UNIFORM_BLOCK_INDEX:
+      params[i] = in_block ? (GLint)uniform.block : -1;
+      break;
+    case GL_UNIFORM_OFFSET:
+      params[i] = in_block ? (GLint)(uniform.block_column * 4 * sizeof(float)) : -1;
+      break;
+    case GL_UNIFORM_ARRAY_STRIDE:
+      params[i] = in_block ? 0 : -1;
+      break;
+    case GL_UNIFORM_MATRIX_STRIDE:
+      params[i] = !in_block ? -1 : (uniform.count > 1) ? (GLint)(4 * sizeof(float)) : 0;
+      break;
+    case GL_UNIFORM_IS_ROW_MAJOR:
+      params[i] = GL_FALSE;
+      break;
+    };
+  }
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI GLuint APIENTRY
+glGetUniformBlockIndex (GLuint program_name, const GLchar *uniformBlockName)
+{
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR(GL_INVALID_VALUE,GL_INVALID_INDEX);
+  }
+
+  const program_t & program = program_t::storage().at(program_name);
+
+  if(!program.linked) {
+    RSXGL_NOERROR(GL_INVALID_INDEX);
+  }
+
+  auto tmp = program_t::table_t< program_t::uniform_block_t >::find(program.names.get(),program.uniform_blocks,uniformBlockName);
+
+  if(tmp.second) {
+    RSXGL_NOERROR(std::distance(program.uniform_blocks.begin(),tmp.first));
+  }
+  else {
+    RSXGL_NOERROR(GL_INVALID_INDEX);
+  }
+}
+
+GLAPI void APIENTRY
+glGetActiveUniformBlockiv (GLuint program_name, GLuint uniformBlockIndex, GLenum pname, GLint *params)
+{
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  const program_t & program = program_t::storage().at(program_name);
+
+  if(!program.linked || uniformBlockIndex >= program.uniform_blocks.size()) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  const program_t::uniform_block_t & block = program.uniform_blocks[uniformBlockIndex].second;
+  const program_t::uniform_size_type * members = program.uniform_block_members.get() + block.members_index;
+
+  if(pname == GL_UNIFORM_BLOCK_BINDING) {
+    *params = block.binding;
+  }
+  else if(pname == GL_UNIFORM_BLOCK_DATA_SIZE) {
+    *params = block.num_columns * 4 * sizeof(float);
+  }
+  else if(pname == GL_UNIFORM_BLOCK_NAME_LENGTH) {
+    *params = strlen(program.names.get() + program.uniform_blocks[uniformBlockIndex].first) + 1;
+  }
+  else if(pname == GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS) {
+    *params = block.num_members;
+  }
+  else if(pname == GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES) {
+    std::copy(members,members + block.num_members,params);
+  }
+  else if(pname == GL_UNIFORM_BLOCK_REFERENCED_BY_VERTEX_SHADER || pname == GL_UNIFORM_BLOCK_REFERENCED_BY_FRAGMENT_SHADER) {
+    const size_t shader = (pname == GL_UNIFORM_BLOCK_REFERENCED_BY_VERTEX_SHADER) ? RSXGL_VERTEX_SHADER : RSXGL_FRAGMENT_SHADER;
+    *params = GL_FALSE;
+    for(program_t::uniform_size_type i = 0;i < block.num_members;++i) {
+      if(program.uniforms[members[i]].second.enabled.test(shader)) *params = GL_TRUE;
+    }
+  }
+  else if(pname == GL_UNIFORM_BLOCK_REFERENCED_BY_GEOMETRY_SHADER) {
+    *params = GL_FALSE;
+  }
+  else {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glGetActiveUniformBlockName (GLuint program_name, GLuint uniformBlockIndex, GLsizei bufSize, GLsizei *length, GLchar *uniformBlockName)
+{
+  if(bufSize < 0) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  const program_t & program = program_t::storage().at(program_name);
+
+  if(!program.linked || uniformBlockIndex >= program.uniform_blocks.size()) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  const char * block_name = program.names.get() + program.uniform_blocks[uniformBlockIndex].first;
+
+  size_t n = 0;
+  if(bufSize > 0) {
+    n = std::min((size_t)bufSize - 1,strlen(block_name));
+    strncpy(uniformBlockName,block_name,n);
+    uniformBlockName[n] = 0;
+  }
+
+  if(length != 0) *length = n;
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glUniformBlockBinding (GLuint program_name, GLuint uniformBlockIndex, GLuint uniformBlockBinding)
+{
+  if(!program_t::storage().is_object(program_name)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  program_t & program = program_t::storage().at(program_name);
+
+  if(!program.linked || uniformBlockIndex >= program.uniform_blocks.size() || uniformBlockBinding >= RSXGL_MAX_UNIFORM_BUFFER_BINDINGS) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  program.uniform_blocks[uniformBlockIndex].second.binding = uniformBlockBinding;
+
+  RSXGL_NOERROR_();
+}
+
 GLAPI void APIENTRY
 glBindFragDataLocation (GLuint program_name, GLuint color, const GLchar *name)
 {
@@ -1598,6 +2760,7 @@ glTransformFeedbackVaryings (GLuint program_name, GLsizei count, const GLchar* *
 
   compiler_context_t * cctx = current_ctx() -> compiler_context();
   cctx -> transform_feedback_varyings(program.mesa_program,count,varyings,bufferMode);
+  program.feedback_interleaved = (bufferMode == GL_INTERLEAVED_ATTRIBS);
   
   RSXGL_NOERROR_();
 }
@@ -1621,7 +2784,6 @@ rsxgl_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
   if(ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] != 0) {
     program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
 
-    rsxgl_assert(timestamp >= program.timestamp);
     program.timestamp = timestamp;    
   }
 
@@ -1689,7 +2851,7 @@ rsxgl_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
 	  uint32_t * buffer = gcm_reserve(context,n);
 	  
 	  gcm_emit_method_at(buffer,i++,NV30_3D_FP_ACTIVE_PROGRAM,1);
-	  gcm_emit_at(buffer,i++,rsxgl_rsx_ucode_offset(program.fp_ucode_offset) | NV30_3D_FP_ACTIVE_PROGRAM_DMA0);
+	  gcm_emit_at(buffer,i++,rsxgl_rsx_ucode_offset(program.fp_active_ucode_offset) | NV30_3D_FP_ACTIVE_PROGRAM_DMA0);
 	  
 	  // Texcoord control:
 #define  NV40TCL_TEX_COORD_CONTROL(x)                                   (0x00000b40+((x)*4))
@@ -1745,13 +2907,11 @@ rsxgl_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
 	}
 	
 	// invalidate vertex program uniforms:
-	if(program.uniforms.size() > 0) {
-	  program.invalid_uniforms = 1;
-	  for(std::pair< program_t::name_size_type, program_t::uniform_t > & name_uniform : program.uniforms) {
-	    if(name_uniform.second.enabled.test(RSXGL_VERTEX_SHADER)) {
-	      name_uniform.second.invalid.set(RSXGL_VERTEX_SHADER);
-	    }
-	  }
+	for(program_t::uniform_size_type i = 0,n = program.uniforms.size();i < n;++i) {
+	  rsxgl_uniform_invalidate(program,i,RSXGL_VERTEX_SHADER);
+	}
+	for(auto & name_block : program.uniform_blocks) {
+	  name_block.second.invalid = 1;
 	}
 
 #if 0	
@@ -1823,7 +2983,6 @@ rsxgl_feedback_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
   if(ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] != 0) {
     program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
 
-    rsxgl_assert(timestamp >= program.timestamp);
     program.timestamp = timestamp;    
   }
 
@@ -12,8 +12,10 @@
 #include "gl_object_storage.h"
 #include "ieee32_t.h"
 #include "compiler_context.h"
+#include "buffer.h"
 
 #include <memory>
+#include <vector>
 #include <string>
 #include <cstddef>
 #include <cassert>
@@ -55,6 +57,7 @@ struct shader_t {
   static storage_type & storage();
 
   shader_t();
+  shader_t(shader_t &&) = default;
   ~shader_t();
 
   // --- cold:
@@ -62,11 +65,17 @@ struct shader_t {
 
   std::string source;
   std::unique_ptr< uint8_t[] > binary;
+  uint32_t binary_size, binary_format;
   std::string info;
 
   gl_shader * mesa_shader;
 };
 
+// std::string isn't safe to move bitwise:
+template<>
+struct striped_object_relocate< shader_t > : public striped_object_move_relocate< shader_t > {
+};
+
 struct program_t {
   typedef bindable_gl_object< program_t, RSXGL_MAX_PROGRAMS, RSXGL_MAX_PROGRAM_TARGETS > gl_object_type;
   typedef typename gl_object_type::name_type name_type;
@@ -78,13 +87,16 @@ struct program_t {
   static storage_type & storage();
 
   program_t();
+  program_t(program_t &&) = default;
   ~program_t();
 
   // --- cold:
   //
   uint32_t deleted:1,timestamp:31;
 
-  uint32_t linked:1,validated:1,invalid_uniforms:1,ref_count:28;
+  // feedback_interleaved is the buffer mode last given to glTransformFeedbackVaryings(); it takes
+  // effect when the program is linked:
+  uint32_t linked:1,validated:1,invalid_uniforms:1,feedback_interleaved:1,ref_count:28;
 
   boost::container::flat_set< shader_t::name_type > attached_shaders, linked_shaders;
 
@@ -141,6 +153,35 @@ struct program_t {
     uint8_t type;
     bit_set< RSXGL_MAX_SHADER_TYPES > invalid, enabled;
     uniform_size_type values_index, count, vp_index, program_offsets_index;
+
+    // Uniform block that this is a member of (RSXGL_MAX_PROGRAM_UNIFORM_BLOCKS if none), and
+    // the vec4 within the block where it starts:
+    uint8_t block;
+    uniform_size_type block_column;
+
+    // Set while the uniform is in the program's list of dirty uniforms:
+    uint8_t listed;
+  };
+
+  // A uniform block is a top-level struct uniform; its members are laid out in declaration
+  // order, one vec4 per column. When a buffer is bound to the block's binding point, the
+  // members take their values from it:
+  struct uniform_block_t {
+    uint8_t binding;
+
+    // Set if every member is used by the vertex program, at consecutive constants - the block
+    // can then be sent by calling a uniform buffer's pre-formatted stream:
+    uint8_t vp_contiguous:1;
+
+    // Set when the vertex program's constants need to be sent again:
+    uint8_t invalid:1;
+
+    uniform_size_type members_index, num_members, num_columns, vp_index;
+
+    // The buffer range & contents last sent:
+    buffer_t::name_type buffer;
+    rsx_size_t buffer_offset;
+    uint32_t generation;
   };
 
   struct sampler_uniform_t {
@@ -152,8 +193,9 @@ struct program_t {
   table_t< attrib_t >::type attribs;
   table_t< uniform_t >::type uniforms;
   table_t< sampler_uniform_t >::type sampler_uniforms;
+  table_t< uniform_block_t >::type uniform_blocks;
 
-  name_size_type attrib_name_max_length, uniform_name_max_length;
+  name_size_type attrib_name_max_length, uniform_name_max_length, uniform_block_name_max_length;
 
   gl_shader_program * mesa_program;
   nvfx_vertex_program * nvfx_vp, * nvfx_streamvp;
@@ -174,7 +216,7 @@ struct program_t {
   uint32_t vp_input_mask, vp_output_mask, vp_num_internal_const;
   uint32_t fp_control;
   uint32_t streamvp_input_mask, streamvp_output_mask, streamvp_num_internal_const;
-  uint32_t streamfp_control, streamfp_num_outputs;
+  uint32_t streamfp_control, streamfp_num_outputs, streamfp_interleaved;
   uint32_t streamvp_vertexid_index, instanceid_index, point_sprite_control;
   bit_set< RSXGL_MAX_TEXTURE_COORDS > fp_texcoords, fp_texcoord2D, fp_texcoord3D;
 
@@ -195,8 +237,58 @@ struct program_t {
   // Storage for uniform variable values:
   std::unique_ptr< ieee32_t[] > uniform_values;
 
+  // Indices of the uniforms that have invalid bits set, so that validation only visits those:
+  std::unique_ptr< uniform_size_type[] > dirty_uniforms;
+  uniform_size_type num_dirty_uniforms;
+
   // Storage for uniform and texture program offsets:
   std::unique_ptr< instruction_size_type[] > program_offsets;
+  uint32_t num_program_offsets;
+
+  // Indices of each uniform block's members, in declaration order:
+  std::unique_ptr< uniform_size_type[] > uniform_block_members;
+
+  // GL_RSX_program_specialization - copies of the fragment program with some uniforms' values
+  // folded into them; see rsxgl_program_specialize():
+  struct fp_variant_t {
+    // Locations of the folded uniforms, each followed by its values:
+    std::vector< uint32_t > key;
+
+    // ~0 if folding didn't make the program any shorter, in which case it isn't used:
+    ucode_offset_type ucode_offset;
+    uint32_t ucode_size;
+
+    // Laid out like program_offsets; the offsets of folded uniforms, and of any that the
+    // optimizer removed, are ~0:
+    std::vector< instruction_size_type > program_offsets;
+
+    // The microcode holds every uniform change up to this serial; it was last chosen at this draw,
+    // and the GPU is done with it after this timestamp:
+    uint32_t synced, last_draw, timestamp;
+  };
+
+  struct fp_uniform_history_t {
+    uint32_t changed_draw, changed_serial;
+    uint16_t changes;
+    uint8_t folded;
+  };
+
+  std::vector< fp_variant_t > fp_variants;
+
+  // Indexed by uniform location; allocated the first time that specialization is done:
+  std::unique_ptr< fp_uniform_history_t[] > fp_uniform_history;
+
+  // The microcode that draws use - the generic program's, or one of fp_variants:
+  ucode_offset_type fp_active_ucode_offset;
+  int32_t fp_active_variant;
+
+  // Draws & uniform changes seen, the draw that a variant was last chosen at, variants compiled,
+  // and the serial up to which the generic microcode holds every change:
+  uint32_t fp_draws, fp_serial, fp_last_choice, fp_variant_compiles, fp_generic_synced;
+};
+
+template<>
+struct striped_object_relocate< program_t > : public striped_object_move_relocate< program_t > {
 };
 
 struct rsxgl_context_t;
@@ -204,4 +296,12 @@ struct rsxgl_context_t;
 void rsxgl_program_validate(rsxgl_context_t *,const uint32_t);
 void rsxgl_feedback_program_validate(rsxgl_context_t *,const uint32_t);
 
+// Choose the fragment program microcode that the next draw uses, compiling a specialized copy of
+// it if GL_PROGRAM_SPECIALIZATION_RSX is enabled. Uniforms whose values that microcode doesn't
+// hold are invalidated. Returns true if the microcode changed, and needs to be made active:
+bool rsxgl_program_specialize(rsxgl_context_t *,program_t &,const uint32_t);
+
+// Release fragment program microcode:
+void rsxgl_rsx_ucode_free(void *);
+
 #endif
@@ -0,0 +1,189 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// program_archive.cc - Programs compiled ahead of time by nv40asm, and archives of them.
+
+#include "program_archive.h"
+
+#include <string.h>
+
+// Layouts of the structures in cgcomp's nv40prog.h. Offsets are in bytes:
+static const uint32_t RSXGL_PROGRAM_ARCHIVE_MAGIC = ('R' << 24) | ('S' << 16) | ('X' << 8) | 'A';
+static const uint32_t RSXGL_PROGRAM_ARCHIVE_SIZE = 16, RSXGL_PROGRAM_ARCHIVE_ENTRY_SIZE = 12;
+
+static const uint16_t RSXGL_VERTEX_PROGRAM_MAGIC = ('V' << 8) | 'P', RSXGL_FRAGMENT_PROGRAM_MAGIC = ('F' << 8) | 'P';
+static const uint32_t RSXGL_VERTEX_PROGRAM_SIZE = 32, RSXGL_FRAGMENT_PROGRAM_SIZE = 40;
+static const uint32_t RSXGL_PROGRAM_ATTRIB_SIZE = 12, RSXGL_PROGRAM_CONST_SIZE = 28;
+static const uint32_t RSXGL_PROGRAM_INSN_SIZE = 16;
+
+// rsxProgramConst::index for a fragment program constant that no instruction reads:
+static const uint32_t RSXGL_PROGRAM_CONST_UNUSED = ~0U;
+
+rsxgl_program_image_t::rsxgl_program_image_t()
+  : type(RSXGL_PROGRAM_IMAGE_INVALID), input_mask(0), output_mask(0), fp_control(0), num_insn(0), ucode(0)
+{
+}
+
+static inline uint16_t
+rsxgl_program_image_read16(const uint8_t * p)
+{
+  return ((uint16_t)p[0] << 8) | (uint16_t)p[1];
+}
+
+// Whether count items of size bytes, starting at offset, fit into an image of length bytes:
+static inline bool
+rsxgl_program_image_fits(const uint32_t length,const uint32_t offset,const uint32_t count,const uint32_t size)
+{
+  return offset <= length && (uint64_t)count * size <= (uint64_t)(length - offset);
+}
+
+// Names are NUL-terminated strings within the image; offset 0 (the magic number) means that
+// there is none:
+static inline bool
+rsxgl_program_image_name(const uint8_t * data,const uint32_t length,const uint32_t offset,const char ** name)
+{
+  if(offset == 0) {
+    *name = 0;
+    return true;
+  }
+
+  if(offset >= length || memchr(data + offset,0,length - offset) == 0) return false;
+
+  *name = (const char *)(data + offset);
+  return true;
+}
+
+uint8_t
+rsxgl_program_image_type(const uint8_t * data,const uint32_t length)
+{
+  if(data == 0 || length < sizeof(uint16_t)) return RSXGL_PROGRAM_IMAGE_INVALID;
+
+  const uint16_t magic = rsxgl_program_image_read16(data);
+  if(magic == RSXGL_VERTEX_PROGRAM_MAGIC && length >= RSXGL_VERTEX_PROGRAM_SIZE) {
+    return RSXGL_PROGRAM_IMAGE_VERTEX;
+  }
+  else if(magic == RSXGL_FRAGMENT_PROGRAM_MAGIC && length >= RSXGL_FRAGMENT_PROGRAM_SIZE) {
+    return RSXGL_PROGRAM_IMAGE_FRAGMENT;
+  }
+  else {
+    return RSXGL_PROGRAM_IMAGE_INVALID;
+  }
+}
+
+bool
+rsxgl_program_image_parse(const uint8_t * data,const uint32_t length,rsxgl_program_image_t & image)
+{
+  image = rsxgl_program_image_t();
+  image.type = rsxgl_program_image_type(data,length);
+
+  uint32_t num_attrib, attrib_off, num_const, const_off, ucode_off;
+
+  if(image.type == RSXGL_PROGRAM_IMAGE_VERTEX) {
+    num_attrib = rsxgl_program_image_read16(data + 2);
+    attrib_off = rsxgl_program_image_read32(data + 4);
+    image.input_mask = rsxgl_program_image_read32(data + 8);
+    image.output_mask = rsxgl_program_image_read32(data + 12);
+    num_const = rsxgl_program_image_read16(data + 18);
+    const_off = rsxgl_program_image_read32(data + 20);
+    image.num_insn = rsxgl_program_image_read16(data + 26);
+    ucode_off = rsxgl_program_image_read32(data + 28);
+  }
+  else if(image.type == RSXGL_PROGRAM_IMAGE_FRAGMENT) {
+    // NV40_3D_FP_CONTROL_TEMP_COUNT__SHIFT:
+    static const uint32_t temp_count_shift = 24;
+
+    num_attrib = rsxgl_program_image_read16(data + 2);
+    attrib_off = rsxgl_program_image_read32(data + 4);
+    image.fp_control = rsxgl_program_image_read32(data + 12) | (rsxgl_program_image_read32(data + 8) << temp_count_shift);
+    num_const = rsxgl_program_image_read16(data + 24);
+    const_off = rsxgl_program_image_read32(data + 28);
+    image.num_insn = rsxgl_program_image_read16(data + 32);
+    ucode_off = rsxgl_program_image_read32(data + 36);
+  }
+  else {
+    return false;
+  }
+
+  if(!rsxgl_program_image_fits(length,attrib_off,num_attrib,RSXGL_PROGRAM_ATTRIB_SIZE) ||
+     !rsxgl_program_image_fits(length,const_off,num_const,RSXGL_PROGRAM_CONST_SIZE) ||
+     !rsxgl_program_image_fits(length,ucode_off,image.num_insn,RSXGL_PROGRAM_INSN_SIZE)) {
+    return false;
+  }
+
+  image.ucode = data + ucode_off;
+
+  image.attribs.resize(num_attrib);
+  for(uint32_t i = 0;i < num_attrib;++i) {
+    const uint8_t * p = data + attrib_off + (i * RSXGL_PROGRAM_ATTRIB_SIZE);
+    rsxgl_program_image_t::attrib_t & attrib = image.attribs[i];
+
+    if(!rsxgl_program_image_name(data,length,rsxgl_program_image_read32(p),&attrib.name)) return false;
+    attrib.index = rsxgl_program_image_read32(p + 4);
+    attrib.type = p[8];
+    attrib.is_output = p[9];
+  }
+
+  image.constants.resize(num_const);
+  for(uint32_t i = 0;i < num_const;++i) {
+    const uint8_t * p = data + const_off + (i * RSXGL_PROGRAM_CONST_SIZE);
+    rsxgl_program_image_t::constant_t & constant = image.constants[i];
+
+    if(!rsxgl_program_image_name(data,length,rsxgl_program_image_read32(p),&constant.name)) return false;
+    constant.index = rsxgl_program_image_read32(p + 4);
+    constant.type = p[8];
+    constant.is_internal = p[9];
+    constant.count = p[10];
+    for(unsigned int j = 0;j < 4;++j) {
+      constant.values[j] = rsxgl_program_image_read32(p + 12 + (j * 4));
+    }
+
+    // A fragment program constant's index is the offset of an rsxConstOffsetTable, listing the
+    // byte offsets of the instructions that it's patched into:
+    if(image.type == RSXGL_PROGRAM_IMAGE_FRAGMENT && constant.index != RSXGL_PROGRAM_CONST_UNUSED) {
+      if(!rsxgl_program_image_fits(length,constant.index,1,sizeof(uint32_t))) return false;
+
+      const uint32_t num_offsets = rsxgl_program_image_read32(data + constant.index);
+      if(!rsxgl_program_image_fits(length,constant.index + sizeof(uint32_t),num_offsets,sizeof(uint32_t))) return false;
+
+      constant.fp_offsets.resize(num_offsets);
+      for(uint32_t j = 0;j < num_offsets;++j) {
+	const uint32_t offset = rsxgl_program_image_read32(data + constant.index + sizeof(uint32_t) * (j + 1));
+	if((offset % RSXGL_PROGRAM_INSN_SIZE) != 0 || (offset / RSXGL_PROGRAM_INSN_SIZE) >= image.num_insn) return false;
+
+	constant.fp_offsets[j] = offset / RSXGL_PROGRAM_INSN_SIZE;
+      }
+    }
+  }
+
+  return true;
+}
+
+int64_t
+rsxgl_program_archive_size(const uint8_t * data,const size_t length)
+{
+  if(data == 0 || length < RSXGL_PROGRAM_ARCHIVE_SIZE || length > 0xffffffffU ||
+     rsxgl_program_image_read32(data) != RSXGL_PROGRAM_ARCHIVE_MAGIC) {
+    return -1;
+  }
+
+  const uint32_t num_entries = rsxgl_program_image_read32(data + 4), entry_off = rsxgl_program_image_read32(data + 8);
+  if(!rsxgl_program_image_fits(length,entry_off,num_entries,RSXGL_PROGRAM_ARCHIVE_ENTRY_SIZE)) {
+    return -1;
+  }
+
+  return num_entries;
+}
+
+bool
+rsxgl_program_archive_entry(const uint8_t * data,const size_t length,const uint32_t i,const uint8_t ** program,uint32_t * program_size)
+{
+  const uint8_t * p = data + rsxgl_program_image_read32(data + 8) + (i * RSXGL_PROGRAM_ARCHIVE_ENTRY_SIZE);
+  const uint32_t program_off = rsxgl_program_image_read32(p + 4), size = rsxgl_program_image_read32(p + 8);
+
+  if(!rsxgl_program_image_fits(length,program_off,size,1)) return false;
+
+  *program = data + program_off;
+  *program_size = size;
+  return true;
+}
@@ -0,0 +1,95 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// program_archive.h - Programs compiled ahead of time by nv40asm, and archives of them.
+//
+// nv40asm writes a vertex or fragment program as an image - an rsxVertexProgram or
+// rsxFragmentProgram header, followed by tables of the program's attributes & constants, their
+// names, and its microcode (see cgcomp's nv40prog.h). nv40asm -b writes many of them into one
+// archive (rsxProgramArchive), with a table of entries in the order of its manifest. Every field
+// is big-endian, and is read a byte at a time, so that images needn't be aligned, and so that
+// they can be checked on the host.
+//
+// glShaderBinary() loads the archive's entries into shaders with GL_PROGRAM_ARCHIVE_RSX;
+// glLinkProgram() then builds the program from the images instead of from GLSL.
+
+#ifndef rsxgl_program_archive_H
+#define rsxgl_program_archive_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+enum rsxgl_program_image_types {
+  RSXGL_PROGRAM_IMAGE_VERTEX = 0,
+  RSXGL_PROGRAM_IMAGE_FRAGMENT = 1,
+  RSXGL_PROGRAM_IMAGE_INVALID = 2
+};
+
+// An image's tables, checked & decoded. Names point into the image, and are 0 if the image
+// doesn't name the entry:
+struct rsxgl_program_image_t {
+  uint8_t type;
+
+  // Vertex programs - masks of the attributes read & results written:
+  uint32_t input_mask, output_mask;
+
+  // Fragment programs - NV30_3D_FP_CONTROL, including the number of registers used:
+  uint32_t fp_control;
+
+  // Microcode; four big-endian words per instruction, already in the order that the GPU reads
+  // them in:
+  uint32_t num_insn;
+  const uint8_t * ucode;
+
+  // Inputs, outputs & samplers. index is the attribute's register, or a sampler's texture unit;
+  // type is one of rsx_param_types, which are numbered like rsxgl_data_types:
+  struct attrib_t {
+    const char * name;
+    uint32_t index;
+    uint8_t type, is_output;
+  };
+
+  // One per column of each constant; only the first column is named. count is the number of
+  // columns. A vertex program constant is loaded at index; a fragment program's is patched into
+  // its microcode, into each of the instructions listed in fp_offsets:
+  struct constant_t {
+    const char * name;
+    uint32_t index;
+    uint8_t type, is_internal, count;
+    uint32_t values[4];
+    std::vector< uint32_t > fp_offsets;
+  };
+
+  std::vector< attrib_t > attribs;
+  std::vector< constant_t > constants;
+
+  rsxgl_program_image_t();
+};
+
+// Reads a big-endian word:
+static inline uint32_t
+rsxgl_program_image_read32(const uint8_t * p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// The type of program in an image, going by its magic number; RSXGL_PROGRAM_IMAGE_INVALID if it
+// isn't an image:
+uint8_t rsxgl_program_image_type(const uint8_t *,const uint32_t);
+
+// Check that every table and name lies within the image, and decode them. Returns false if the
+// image is malformed:
+bool rsxgl_program_image_parse(const uint8_t *,const uint32_t,rsxgl_program_image_t &);
+
+// Number of entries in an archive, or -1 if it's malformed:
+int64_t rsxgl_program_archive_size(const uint8_t *,const size_t);
+
+// Locate entry i of an archive, whose size has already been checked. Returns false if the
+// entry lies outside of the archive:
+bool rsxgl_program_archive_entry(const uint8_t *,const size_t,const uint32_t,const uint8_t **,uint32_t *);
+
+#endif
@@ -0,0 +1,315 @@
+// "Unit testing" for the parsing of nv40asm's program images and archives. Meant to be built &
+// run on the host, e.g.:
+//
+// g++ -std=c++11 -I. program_archive_unit_tests.cc program_archive.cc -o program_archive_unit_tests
+//
+// Images are built here a byte at a time, big-endian, laid out like the rsxVertexProgram and
+// rsxFragmentProgram structures in cgcomp's nv40prog.h.
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+
+#include "program_archive.h"
+
+typedef std::vector< uint8_t > bytes_t;
+
+static void
+put16(bytes_t & data,const uint32_t offset,const uint16_t value)
+{
+  if(data.size() < offset + 2) data.resize(offset + 2,0);
+  data[offset] = value >> 8;
+  data[offset + 1] = value;
+}
+
+static void
+put32(bytes_t & data,const uint32_t offset,const uint32_t value)
+{
+  if(data.size() < offset + 4) data.resize(offset + 4,0);
+  data[offset] = value >> 24;
+  data[offset + 1] = value >> 16;
+  data[offset + 2] = value >> 8;
+  data[offset + 3] = value;
+}
+
+static uint32_t
+put_name(bytes_t & data,const char * name)
+{
+  const uint32_t offset = data.size();
+  data.insert(data.end(),name,name + strlen(name) + 1);
+  return offset;
+}
+
+static void
+put_attrib(bytes_t & data,const uint32_t offset,const uint32_t name_off,const uint32_t index,const uint8_t type,const uint8_t is_output)
+{
+  put32(data,offset,name_off);
+  put32(data,offset + 4,index);
+  data[offset + 8] = type;
+  data[offset + 9] = is_output;
+}
+
+static void
+put_const(bytes_t & data,const uint32_t offset,const uint32_t name_off,const uint32_t index,const uint8_t type,const uint8_t is_internal,const uint8_t count,const float x)
+{
+  union { float f; uint32_t u; } value;
+  value.f = x;
+
+  put32(data,offset,name_off);
+  put32(data,offset + 4,index);
+  put32(data,offset + 12,value.u);
+  put32(data,offset + 24,0);
+  data[offset + 8] = type;
+  data[offset + 9] = is_internal;
+  data[offset + 10] = count;
+}
+
+// A vertex program reading one attribute, with a 4x4 matrix uniform (a constant of 4 columns)
+// and an immediate:
+static bytes_t
+vertex_program()
+{
+  bytes_t data(32,0);
+  put16(data,0,('V' << 8) | 'P');
+
+  // Attributes:
+  put16(data,2,2);
+  put32(data,4,32);
+  put32(data,8,0x1);
+  put32(data,12,0x3);
+  data.resize(32 + 2 * 12,0);
+
+  // Constants:
+  const uint32_t const_off = data.size();
+  put16(data,18,6);
+  put32(data,20,const_off);
+  data.resize(const_off + 6 * 28,0);
+
+  const uint32_t position = put_name(data,"position"), out = put_name(data,"gl_Position"), mvp = put_name(data,"mvp");
+  put_attrib(data,32,position,0,3,0);
+  put_attrib(data,44,out,0,3,1);
+
+  put_const(data,const_off,mvp,4,4,0,4,1.0f);
+  for(uint32_t i = 1;i < 4;++i) {
+    put_const(data,const_off + i * 28,0,4 + i,0,0,0,0.0f);
+  }
+  put_const(data,const_off + 4 * 28,0,8,3,1,1,0.5f);
+  put_const(data,const_off + 5 * 28,0,9,3,1,1,2.0f);
+
+  // Microcode:
+  while(data.size() % 16) data.push_back(0);
+  const uint32_t ucode_off = data.size();
+  put16(data,26,2);
+  put32(data,28,ucode_off);
+  for(uint32_t i = 0;i < 8;++i) {
+    put32(data,ucode_off + i * 4,0x40000000 + i);
+  }
+
+  return data;
+}
+
+// A fragment program with a sampler, and a vec4 uniform that's patched into two instructions:
+static bytes_t
+fragment_program()
+{
+  bytes_t data(40,0);
+  put16(data,0,('F' << 8) | 'P');
+
+  put16(data,2,1);
+  put32(data,4,40);
+  put32(data,8,3);
+  put32(data,12,0x40);
+  data.resize(40 + 12,0);
+
+  // Constant offsets table - the const slots following instructions 0 and 2:
+  const uint32_t table_off = data.size();
+  put32(data,table_off,2);
+  put32(data,table_off + 4,1 * 16);
+  put32(data,table_off + 8,3 * 16);
+
+  const uint32_t const_off = data.size();
+  put16(data,24,2);
+  put32(data,28,const_off);
+  data.resize(const_off + 2 * 28,0);
+
+  const uint32_t texture = put_name(data,"texture"), color = put_name(data,"color"), unused = put_name(data,"unused");
+  put_attrib(data,40,texture,2,6,0);
+  put_const(data,const_off,color,table_off,3,0,1,0.25f);
+  put_const(data,const_off + 28,unused,~0U,3,0,1,0.0f);
+
+  while(data.size() % 16) data.push_back(0);
+  const uint32_t ucode_off = data.size();
+  put16(data,32,4);
+  put32(data,36,ucode_off);
+  data.resize(ucode_off + 4 * 16,0);
+
+  return data;
+}
+
+static bool
+parse(const bytes_t & data,rsxgl_program_image_t & image)
+{
+  return rsxgl_program_image_parse(data.data(),data.size(),image);
+}
+
+int
+main(int argc,char ** argv)
+{
+  try {
+    const bytes_t vp = vertex_program(), fp = fragment_program();
+
+    // Vertex program:
+    {
+      rsxgl_program_image_t image;
+      assert(rsxgl_program_image_type(vp.data(),vp.size()) == RSXGL_PROGRAM_IMAGE_VERTEX);
+      assert(parse(vp,image));
+      assert(image.type == RSXGL_PROGRAM_IMAGE_VERTEX);
+      assert(image.input_mask == 0x1 && image.output_mask == 0x3);
+      assert(image.num_insn == 2);
+      assert(rsxgl_program_image_read32(image.ucode + 4) == 0x40000001);
+
+      assert(image.attribs.size() == 2);
+      assert(strcmp(image.attribs[0].name,"position") == 0 && image.attribs[0].index == 0 && !image.attribs[0].is_output);
+      assert(image.attribs[1].is_output);
+
+      assert(image.constants.size() == 6);
+      assert(strcmp(image.constants[0].name,"mvp") == 0);
+      assert(image.constants[0].count == 4 && image.constants[0].type == 4 && image.constants[0].index == 4);
+      assert(image.constants[3].name == 0 && image.constants[3].index == 7);
+      assert(image.constants[4].is_internal && image.constants[4].index == 8);
+
+      union { float f; uint32_t u; } value;
+      value.u = image.constants[5].values[0];
+      assert(value.f == 2.0f);
+      assert(image.constants[0].fp_offsets.empty());
+    }
+
+    // Fragment program:
+    {
+      rsxgl_program_image_t image;
+      assert(parse(fp,image));
+      assert(image.type == RSXGL_PROGRAM_IMAGE_FRAGMENT);
+      assert(image.fp_control == (0x40 | (3 << 24)));
+      assert(image.num_insn == 4);
+
+      assert(image.attribs.size() == 1);
+      assert(strcmp(image.attribs[0].name,"texture") == 0 && image.attribs[0].index == 2 && image.attribs[0].type == 6);
+
+      assert(image.constants.size() == 2);
+      assert(strcmp(image.constants[0].name,"color") == 0);
+      assert(image.constants[0].fp_offsets.size() == 2);
+      assert(image.constants[0].fp_offsets[0] == 1 && image.constants[0].fp_offsets[1] == 3);
+      assert(image.constants[1].fp_offsets.empty());
+    }
+
+    // Truncated images are rejected, wherever they're cut:
+    for(size_t n = 0;n < vp.size();++n) {
+      rsxgl_program_image_t image;
+      assert(!rsxgl_program_image_parse(vp.data(),n,image));
+    }
+    for(size_t n = 0;n < fp.size();++n) {
+      rsxgl_program_image_t image;
+      assert(!rsxgl_program_image_parse(fp.data(),n,image));
+    }
+
+    // So are corrupt ones:
+    {
+      rsxgl_program_image_t image;
+
+      bytes_t data = vp;
+      data[0] = 'X';
+      assert(rsxgl_program_image_type(data.data(),data.size()) == RSXGL_PROGRAM_IMAGE_INVALID);
+      assert(!parse(data,image));
+
+      // An attribute table that runs past the end:
+      data = vp;
+      put16(data,2,0xffff);
+      assert(!parse(data,image));
+
+      // A name that isn't terminated:
+      data = vp;
+      data.back() = 'x';
+      put32(data,32,data.size() - 1);
+      assert(!parse(data,image));
+
+      // A constant patched into an instruction that isn't there, or into the middle of one:
+      data = fp;
+      const uint32_t table_off = rsxgl_program_image_read32(data.data() + rsxgl_program_image_read32(data.data() + 28) + 4);
+      put32(data,table_off + 8,4 * 16);
+      assert(!parse(data,image));
+      put32(data,table_off + 8,3 * 16 + 4);
+      assert(!parse(data,image));
+      put32(data,table_off + 8,3 * 16);
+      assert(parse(data,image));
+    }
+
+    // Archives:
+    {
+      bytes_t archive(16,0);
+      put32(archive,0,('R' << 24) | ('S' << 16) | ('X' << 8) | 'A');
+      put32(archive,4,2);
+      put32(archive,12,2);
+
+      const uint32_t vp_off = archive.size();
+      archive.insert(archive.end(),vp.begin(),vp.end());
+      const uint32_t fp_off = archive.size();
+      archive.insert(archive.end(),fp.begin(),fp.end());
+
+      const uint32_t entry_off = archive.size();
+      put32(archive,8,entry_off);
+      put32(archive,entry_off,0);
+      put32(archive,entry_off + 4,vp_off);
+      put32(archive,entry_off + 8,vp.size());
+      put32(archive,entry_off + 12,0);
+      put32(archive,entry_off + 16,fp_off);
+      put32(archive,entry_off + 20,fp.size());
+
+      assert(rsxgl_program_archive_size(archive.data(),archive.size()) == 2);
+
+      const uint8_t * program = 0;
+      uint32_t program_size = 0;
+      rsxgl_program_image_t image;
+
+      assert(rsxgl_program_archive_entry(archive.data(),archive.size(),0,&program,&program_size));
+      assert(program == archive.data() + vp_off && program_size == vp.size());
+      assert(rsxgl_program_image_parse(program,program_size,image) && image.type == RSXGL_PROGRAM_IMAGE_VERTEX);
+
+      assert(rsxgl_program_archive_entry(archive.data(),archive.size(),1,&program,&program_size));
+      assert(rsxgl_program_image_parse(program,program_size,image) && image.type == RSXGL_PROGRAM_IMAGE_FRAGMENT);
+
+      // The entry table must fit:
+      assert(rsxgl_program_archive_size(archive.data(),archive.size() - 1) == -1);
+
+      // An entry that runs past the end:
+      bytes_t data = archive;
+      put32(data,entry_off + 20,data.size() - fp_off + 1);
+      assert(!rsxgl_program_archive_entry(data.data(),data.size(),1,&program,&program_size));
+
+      data = archive;
+      data[0] = 'X';
+      assert(rsxgl_program_archive_size(data.data(),data.size()) == -1);
+      assert(rsxgl_program_archive_size(0,0) == -1);
+    }
+
+    std::cout << "passed" << std::endl;
+  }
+  catch(const assertion & a) {
+    std::cerr << "failed: " << a.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
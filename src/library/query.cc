@@ -17,33 +17,56 @@
 #endif
 #define GLAPI extern "C"
 
-// Manage the RSX report objects:
-typedef name_space< RSXGL_MAX_QUERY_OBJECTS, true > rsxgl_query_object_name_space_type;
+// Manage the RSX report objects. Free reports are kept in a ring, and handed out in the order in
+// which they were freed - which is the order in which the GPU was done with them, since queries
+// are finished in command order. The GPU writes & reads reports in command order too, so a
+// report can be reused as soon as the CPU no longer needs its value:
+namespace {
+  struct rsxgl_query_object_ring_t {
+    rsxgl_query_object_index_type indices[RSXGL_MAX_QUERY_OBJECTS];
+    uint32_t head, count;
+
+    rsxgl_query_object_ring_t()
+      : head(0), count(RSXGL_MAX_QUERY_OBJECTS) {
+      for(uint32_t i = 0;i < RSXGL_MAX_QUERY_OBJECTS;++i) {
+	indices[i] = i;
+      }
+    }
+  };
+}
 
-static rsxgl_query_object_name_space_type &
-rsxgl_query_object_name_space()
+static rsxgl_query_object_ring_t &
+rsxgl_query_object_ring()
 {
-  static rsxgl_query_object_name_space_type name_space;
-  return name_space;
+  static rsxgl_query_object_ring_t ring;
+  return ring;
 }
 
 rsxgl_query_object_index_type
 rsxgl_query_object_allocate()
 {
-  std::pair< rsxgl_query_object_name_space_type::name_type, bool > tmp = rsxgl_query_object_name_space().create_name();
-  if(tmp.second) {
-    return tmp.first;
-  }
-  else {
+  rsxgl_query_object_ring_t & ring = rsxgl_query_object_ring();
+
+  if(ring.count == 0) {
     return RSXGL_MAX_QUERY_OBJECTS;
   }
+
+  const rsxgl_query_object_index_type index = ring.indices[ring.head];
+  ring.head = (ring.head + 1) % RSXGL_MAX_QUERY_OBJECTS;
+  --ring.count;
+
+  return index;
 }
 
 void
 rsxgl_query_object_free(const rsxgl_query_object_index_type index)
 {
   if(index < RSXGL_MAX_QUERY_OBJECTS) {
-    rsxgl_query_object_name_space().destroy_name(index);
+    rsxgl_query_object_ring_t & ring = rsxgl_query_object_ring();
+    rsxgl_assert(ring.count < RSXGL_MAX_QUERY_OBJECTS);
+
+    ring.indices[(ring.head + ring.count) % RSXGL_MAX_QUERY_OBJECTS] = index;
+    ++ring.count;
   }
 }
 
@@ -149,7 +172,8 @@ glBeginQuery (GLenum target, GLuint id)
 
   rsxgl_context_t * ctx = current_ctx();
 
-  if(ctx -> query_binding.is_anything_bound(rsx_target)) {
+  // Query reports are written when the commands run, which for a command list could be any number of times:
+  if(ctx -> command_list_recorder != 0 || ctx -> query_binding.is_anything_bound(rsx_target)) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -205,6 +229,9 @@ glBeginQuery (GLenum target, GLuint id)
 
     rsxgl_query_object_set(context,query.indices[0]);
   }
+  else if(query.type == RSXGL_QUERY_PRIMITIVES_GENERATED || query.type == RSXGL_QUERY_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN) {
+    // Counted by draw calls as they're made; see feedback.h
+  }
   else {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
@@ -224,7 +251,7 @@ glEndQuery (GLenum target)
 
   rsxgl_context_t * ctx = current_ctx();
 
-  if(!ctx -> query_binding.is_anything_bound(rsx_target)) {
+  if(ctx -> command_list_recorder != 0 || !ctx -> query_binding.is_anything_bound(rsx_target)) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -234,8 +261,11 @@ glEndQuery (GLenum target)
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
-  query.status = RSXGL_QUERY_STATUS_PENDING;
-  rsxgl_assert(query.indices[0] != RSXGL_MAX_QUERY_OBJECTS);
+  // Primitive counts are already known:
+  const bool counted = (query.type == RSXGL_QUERY_PRIMITIVES_GENERATED || query.type == RSXGL_QUERY_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+
+  query.status = counted ? RSXGL_QUERY_STATUS_CACHED : RSXGL_QUERY_STATUS_PENDING;
+  rsxgl_assert(counted || query.indices[0] != RSXGL_MAX_QUERY_OBJECTS);
   query.timestamps[1] = rsxgl_timestamp_create(ctx,1);
 
   //
@@ -253,7 +283,7 @@ glEndQuery (GLenum target)
   else if(query.type == RSXGL_QUERY_TIME_ELAPSED) {
     rsxgl_query_object_set(context,query.indices[1]);
   }
-  else {
+  else if(!counted) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -272,6 +302,12 @@ glQueryCounter (GLuint id, GLenum target)
   }
   const uint8_t rsx_target = RSXGL_QUERY_TIMESTAMP;
 
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(ctx -> command_list_recorder != 0) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
   if(id == 0 || !query_t::storage().is_name(id)) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
@@ -282,8 +318,6 @@ glQueryCounter (GLuint id, GLenum target)
     rsxgl_free_query_object(id);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-
   query_t & query = query_t::storage().at(id);
 
   if(query.type == RSXGL_MAX_QUERY_TARGETS) {
@@ -296,12 +330,14 @@ glQueryCounter (GLuint id, GLenum target)
   query.status = RSXGL_QUERY_STATUS_PENDING;
   query.indices[0] = rsxgl_query_object_allocate();
   rsxgl_assert(query.indices[0] != RSXGL_MAX_QUERY_OBJECTS);
-  query.timestamps[0] = rsxgl_timestamp_create(ctx,1);
-  rsxgl_timestamp_post(ctx,query.timestamps[0]);
+
+  // The report is written before the timestamp that says that it's available:
+  query.timestamps[0] = query.timestamps[1] = rsxgl_timestamp_create(ctx,1);
 
   gcmContextData * context = ctx -> gcm_context();
 
   rsxgl_query_object_set(context,query.indices[0]);
+  rsxgl_timestamp_post(ctx,query.timestamps[0]);
 
   RSXGL_NOERROR_();
 }
@@ -344,13 +380,12 @@ rsxgl_get_query_object_value(rsxgl_context_t * ctx,query_t & query)
     else if(query.type == RSXGL_QUERY_ANY_SAMPLES_PASSED) {
       rsxgl_assert(query.indices[0] != RSXGL_MAX_QUERY_OBJECTS);
 
-      uint32_t samples = 0;
-      const uint32_t last_timestamp = query.timestamps[1];
-      for(uint32_t timestamp = query.timestamps[0];(timestamp <= last_timestamp) && (samples == 0);++timestamp) {
-	rsxgl_timestamp_wait(ctx,timestamp);
-	samples += rsxgl_query_object_get_value(query.indices[0]);
+      // The report holds the samples passed so far, each time that it's written. If it's already
+      // non-zero, there's no need to wait for the rest:
+      if(!(rsxgl_timestamp_poll(ctx,query.timestamps[0]) && rsxgl_query_object_get_value(query.indices[0]) != 0)) {
+	rsxgl_timestamp_wait(ctx,query.timestamps[1]);
       }
-      query.value = (samples > 0);
+      query.value = (rsxgl_query_object_get_value(query.indices[0]) != 0);
 
       rsxgl_query_object_free(query.indices[0]);
       query.indices[0] = RSXGL_MAX_QUERY_OBJECTS;
@@ -367,7 +402,7 @@ rsxgl_get_query_object_value(rsxgl_context_t * ctx,query_t & query)
       query.indices[1] = RSXGL_MAX_QUERY_OBJECTS;
     }
     else if(query.type == RSXGL_QUERY_TIMESTAMP) {
-      rsxgl_timestamp_wait(ctx,query.timestamps[0]);
+      rsxgl_timestamp_wait(ctx,query.timestamps[1]);
       query.value = rsxgl_query_object_get_timestamp(query.indices[0]);
 
       rsxgl_query_object_free(query.indices[0]);
@@ -396,8 +431,9 @@ rsxgl_get_query_object(const GLuint id, const GLenum pname, Type * params)
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
+  // Answered without waiting, and usually without asking the GPU:
   if(pname == GL_QUERY_RESULT_AVAILABLE) {
-    *params = (query.status == RSXGL_QUERY_STATUS_CACHED) || (rsxgl_timestamp_passed(ctx,query.timestamps[1]));
+    *params = (query.status == RSXGL_QUERY_STATUS_CACHED) || rsxgl_timestamp_poll(ctx,query.timestamps[1]);
   }
   else if(pname == GL_QUERY_RESULT) {
     *params = rsxgl_get_query_object_value< Type >(ctx,query);
@@ -459,18 +495,23 @@ glBeginConditionalRender (GLuint id, GLenum mode)
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
-  // 
-  if(query.status == RSXGL_QUERY_STATUS_CACHED || mode == GL_QUERY_WAIT || mode == GL_QUERY_BY_REGION_WAIT) {
+  // The result is known, or can be read without waiting for the GPU, so the CPU can skip draws:
+  if(query.status == RSXGL_QUERY_STATUS_CACHED || rsxgl_timestamp_poll(ctx,query.timestamps[1])) {
     ctx -> state.enable.conditional_render_status = rsxgl_get_query_object_value< uint32_t >(ctx,query) != 0 ? RSXGL_CONDITIONAL_RENDER_ACTIVE_WAIT_PASS : RSXGL_CONDITIONAL_RENDER_ACTIVE_WAIT_FAIL;
   }
-  else if(mode == GL_QUERY_NO_WAIT || mode == GL_QUERY_BY_REGION_NO_WAIT) {
-    ctx -> state.enable.conditional_render_status = RSXGL_CONDITIONAL_RENDER_ACTIVE_NO_WAIT;
+  // Otherwise the GPU reads the report itself, once it's been written, and draws only if it's
+  // non-zero. That's what the *_WAIT modes would've waited for, without the CPU waiting, so every
+  // mode is handled this way:
+  else {
+    rsxgl_assert(query.indices[0] != RSXGL_MAX_QUERY_OBJECTS);
+
+    ctx -> state.enable.conditional_render_status = RSXGL_CONDITIONAL_RENDER_ACTIVE_REPORT;
 
-    //
     gcmContextData * context = ctx -> gcm_context();
 
     uint32_t * buffer = gcm_reserve(context,4);
 
+    // Reports are written asynchronously:
     gcm_emit_wait_for_idle_at(buffer,0,1);
     gcm_emit_at(buffer,1,0);
     
@@ -492,8 +533,7 @@ glEndConditionalRender (void)
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
-  if(ctx -> state.enable.conditional_render_status == RSXGL_CONDITIONAL_RENDER_ACTIVE_NO_WAIT) {
-    //
+  if(ctx -> state.enable.conditional_render_status == RSXGL_CONDITIONAL_RENDER_ACTIVE_REPORT) {
     gcmContextData * context = ctx -> gcm_context();
 
     uint32_t * buffer = gcm_reserve(context,2);
@@ -5,11 +5,15 @@
 #include "migrate.h"
 #include "nv40.h"
 #include "timestamp.h"
+#include "fifo.h"
+#include "profiler.h"
+#include "perf_counters.h"
 #include "rsxgl_limits.h"
 #include "cxxutil.h"
 
 #include <GL3/gl3.h>
 #include "GL3/rsxgl.h"
+#include "error.h"
 
 #include <rsx/gcm_sys.h>
 
@@ -24,7 +28,7 @@ extern "C" {
 #include <stdint.h>
 #include <string.h>
 
-rsxgl_context_t * rsxgl_ctx = 0;
+__thread rsxgl_context_t * rsxgl_ctx = 0;
 
 extern "C"
 void *
@@ -41,8 +45,20 @@ rsxgl_object_context_create()
   return new rsxgl_object_context_t();
 }
 
+// Returns the objects used by an existing context, so that a new context can share them. Locking
+// starts here, so the new context should be created by the thread that the existing one is
+// current to, before another thread makes it current:
+extern "C"
+void *
+rsxgl_object_context_share(struct rsxegl_context_t * egl_ctx)
+{
+  rsxgl_object_context_t * object_context = ((rsxgl_context_t *)egl_ctx) -> object_context();
+  object_context -> m_shared = 1;
+  return object_context;
+}
+
 rsxgl_context_t::rsxgl_context_t(const struct rsxegl_config_t * config,gcmContextData * gcm_context,struct pipe_screen * screen,struct rsxgl_object_context_t * _object_context)
-  : m_object_context(_object_context), active_texture(0), any_samples_passed_query(RSXGL_MAX_QUERY_OBJECTS), ref(0), timestamp_sync(0), next_timestamp(1), last_timestamp(0), cached_timestamp(0), m_compiler_context(0)
+  : m_object_context(_object_context), active_texture(0), any_samples_passed_query(RSXGL_MAX_QUERY_OBJECTS), transform_feedback_offset(0), ref(0), timestamp_sync(_object_context -> timestamp_sync), next_timestamp(_object_context -> next_timestamp), last_timestamp(_object_context -> last_timestamp), cached_timestamp(_object_context -> cached_timestamp), command_list_recorder(0), profiler(0), m_compiler_context(0)
 {
   base.api = EGL_OPENGL_API;
   base.config = config;
@@ -53,25 +69,41 @@ rsxgl_context_t::rsxgl_context_t(const struct rsxegl_config_t * config,gcmContex
   base.callback = rsxgl_context_t::egl_callback;
   base.screen = screen;
   base.sync_sleep_interval = RSXGL_SYNC_SLEEP_INTERVAL;
+  base.no_error = 0;
+  base.current = 0;
+
+  rsxgl_fifo_init(gcm_context);
+
+  // Before the screen is asked which formats it supports:
+  rsxgl_texture_compression_init();
 
   m_pctx = nvfx_create(screen,0);
   rsxgl_debug_printf("m_pctx: %lx\n",(unsigned long)m_pctx);
 
-  ++m_object_context -> m_refCount;
-
-  timestamp_sync = rsxgl_sync_object_allocate();
-  rsxgl_assert(timestamp_sync != 0);
-  rsxgl_sync_cpu_signal(timestamp_sync,0);
+  {
+    RSXGL_LOCK_SHARED_OBJECTS(this);
+    ++m_object_context -> m_refCount;
+  }
 
   for(size_t i = 0,n = (RSXGL_MAX_TRANSFORM_FEEDBACK_BUFFER_BINDINGS + RSXGL_MAX_UNIFORM_BUFFER_BINDINGS);i < n;++i) {
     buffer_binding_offset_size[i] = std::make_pair(0,0);
   }
+
+  memset(&uniform_statistics,0,sizeof(uniform_statistics));
+  memset(&perf_counters,0,sizeof(perf_counters));
+  memset(&perf_counters_swap,0,sizeof(perf_counters_swap));
+  memset(&perf_counters_frame,0,sizeof(perf_counters_frame));
 }
 
 rsxgl_context_t::~rsxgl_context_t()
 {
-  --m_object_context -> m_refCount;
-  if(m_object_context -> m_refCount == 0) {
+  rsxgl_profiler_destroy(this);
+
+  m_object_context -> lock();
+  const uint32_t refCount = --m_object_context -> m_refCount;
+  m_object_context -> unlock();
+
+  if(refCount == 0) {
     delete m_object_context;
   }
 
@@ -85,6 +117,32 @@ rsxgl_context_t::egl_callback(struct rsxegl_context_t * egl_ctx,const uint8_t op
 {
   rsxgl_context_t * ctx = (rsxgl_context_t *)egl_ctx;
 
+  // Made current without a surface - there's no default framebuffer to set up:
+  if(op == RSXEGL_MAKE_CONTEXT_CURRENT && !ctx -> can_emit()) {
+    rsxgl_ctx = ctx;
+    rsxgl_no_error = ctx -> base.no_error;
+    return;
+  }
+  // Released by eglMakeCurrent():
+  else if(op == RSXEGL_RELEASE_CONTEXT) {
+    if(ctx -> can_emit()) {
+      rsxgl_gcm_flush(ctx -> fifo_context());
+    }
+    rsxgl_ctx = 0;
+    return;
+  }
+
+  if(op == RSXEGL_POST_CPU_SWAP) {
+    rsxgl_perf_counters_swap(ctx);
+    if(ctx -> profiler != 0) rsxgl_profiler_swap(ctx);
+    return;
+  }
+
+  if(op == RSXEGL_POST_GPU_SWAP) {
+    RSXGL_LOCK_SHARED_OBJECTS(ctx);
+    rsxgl_deferred_free_collect(ctx,true);
+  }
+
   if(op == RSXEGL_MAKE_CONTEXT_CURRENT || op == RSXEGL_POST_GPU_SWAP) {
     framebuffer_t & framebuffer = ctx -> object_context() -> framebuffer_storage().at(0);
 
@@ -102,6 +160,7 @@ rsxgl_context_t::egl_callback(struct rsxegl_context_t * egl_ctx,const uint8_t op
       }
 
       rsxgl_ctx = ctx;
+      rsxgl_no_error = ctx -> base.no_error;
     }
 
     //
@@ -114,6 +173,7 @@ rsxgl_context_t::egl_callback(struct rsxegl_context_t * egl_ctx,const uint8_t op
     ctx -> invalid_attribs.set();
     ctx -> invalid_textures.set();
     ctx -> invalid_samplers.set();
+    ctx -> texture_unit_registers_valid.reset();
   }
   else if(op == RSXEGL_DESTROY_CONTEXT) {
     ctx -> base.valid = 0;
@@ -123,46 +183,27 @@ rsxgl_context_t::egl_callback(struct rsxegl_context_t * egl_ctx,const uint8_t op
 uint32_t
 rsxgl_timestamp_create(rsxgl_context_t * ctx,const uint32_t count)
 {
-  const uint32_t max_timestamp = RSXGL_MAX_TIMESTAMP;
+  rsxgl_assert(count > 0 && count <= (RSXGL_MAX_TIMESTAMP >> 2));
 
-  const uint32_t current_timestamp = ctx -> next_timestamp;
-  rsxgl_assert(current_timestamp == (ctx -> last_timestamp + 1));
+  uint32_t current_timestamp = ctx -> next_timestamp;
+  rsxgl_assert(current_timestamp == rsxgl_timestamp_next(ctx -> last_timestamp));
 
-  const uint32_t next_timestamp = current_timestamp + count;
+  // Timestamps given out together are contiguous, so that callers can step through them - if
+  // they'd run past RSXGL_MAX_TIMESTAMP, start over at 1 instead. The values that were skipped
+  // are never posted, but the GPU is still considered to have passed them once it reaches 1:
+  if(count > (RSXGL_MAX_TIMESTAMP - current_timestamp + 1)) {
+    current_timestamp = 1;
+  }
 
-  // check for overflow:
-  if(next_timestamp > max_timestamp || next_timestamp < current_timestamp) {
-    // block until last_timestamp is reached:
-    rsxgl_timestamp_wait(ctx -> cached_timestamp,ctx -> timestamp_sync,ctx -> last_timestamp,ctx -> base.sync_sleep_interval);
+  ctx -> next_timestamp = rsxgl_timestamp_next(current_timestamp + count - 1);
 
-    // Buffers:
-    {
-      const buffer_t::name_type n = ctx -> object_context() -> buffer_storage().contents().size;
-      for(buffer_t::name_type i = 0;i < n;++i) {
-	if(!ctx -> object_context() -> buffer_storage().is_object(i)) continue;
-	ctx -> object_context() -> buffer_storage().at(i).timestamp = 0;
-      }
-    }
-    
-    // Textures:
-    {
-      const texture_t::name_type n = ctx -> object_context() -> texture_storage().contents().size;
-      for(texture_t::name_type i = 0;i < n;++i) {
-	if(!ctx -> object_context() -> texture_storage().is_object(i)) continue;
-	ctx -> object_context() -> texture_storage().at(i).timestamp = 0;
-      }
-    }
-
-    //
-    ctx -> cached_timestamp = 0;
-    ctx -> next_timestamp = 1 + count;
-    return 1;
-  }
-  //
-  else {
-    ctx -> next_timestamp = next_timestamp;
-    return current_timestamp;
+  // The cached timestamp is only refreshed when an object is checked; keep it close enough to
+  // the timestamps being given out that it's never mistaken for a newer one:
+  if(rsxgl_timestamp_distance(ctx -> next_timestamp,ctx -> cached_timestamp) > (RSXGL_MAX_TIMESTAMP >> 2)) {
+    ctx -> cached_timestamp = rsxgl_sync_value(ctx -> timestamp_sync);
   }
+
+  return current_timestamp;
 }
 
 void
@@ -170,8 +211,12 @@ rsxgl_timestamp_post(rsxgl_context_t * ctx,const uint32_t timestamp)
 {
   rsxgl_assert(ctx -> timestamp_sync != 0);
 
-  rsxgl_emit_sync_gpu_signal_write(ctx -> base.gcm_context,ctx -> timestamp_sync,timestamp);
+  // Timestamps given out while a command list is recorded are posted to the FIFO straight away,
+  // since the objects they mark aren't used by the GPU until the list is replayed (which
+  // posts a timestamp of its own):
+  rsxgl_emit_sync_gpu_signal_write(ctx -> fifo_context(),ctx -> timestamp_sync,timestamp);
   ctx -> last_timestamp = timestamp;
+  rsxgl_profiler_timestamp(ctx -> profiler);
 }
 
 void
@@ -179,8 +224,57 @@ rsxgl_timestamp_wait(rsxgl_context_t * ctx,const uint32_t timestamp)
 {
   rsxgl_assert(ctx -> timestamp_sync != 0);
 
-  rsxgl_gcm_flush(ctx -> gcm_context());
-  rsxgl_timestamp_wait(ctx -> cached_timestamp,ctx -> timestamp_sync,timestamp,ctx -> base.sync_sleep_interval);
+  RSXGL_PERF_COUNT(ctx,timestamp_waits,1);
+  RSXGL_PERF_TIME_BEGIN();
+
+  // A context that can't write to the FIFO relies upon the one that does to flush it:
+  if(ctx -> can_emit()) rsxgl_gcm_flush(ctx -> fifo_context());
+  rsxgl_timestamp_wait(ctx -> cached_timestamp,ctx -> timestamp_sync,ctx -> next_timestamp,timestamp,ctx -> base.sync_sleep_interval);
+
+  RSXGL_PERF_TIME_END(ctx,timestamp_wait_time);
+}
+
+void
+rsxgl_timestamp_wait(rsxgl_context_t * ctx,rsxgl_object_context_lock_t & lock,const uint32_t timestamp)
+{
+  if(!lock.m_locked) {
+    rsxgl_timestamp_wait(ctx,timestamp);
+    return;
+  }
+
+  rsxgl_assert(ctx -> timestamp_sync != 0);
+
+  const uint32_t cached_timestamp = ctx -> cached_timestamp;
+  if(!rsxgl_timestamp_pending(cached_timestamp,ctx -> next_timestamp,timestamp)) return;
+
+  RSXGL_PERF_COUNT(ctx,timestamp_waits,1);
+  RSXGL_PERF_TIME_BEGIN();
+
+  if(ctx -> can_emit()) rsxgl_gcm_flush(ctx -> fifo_context());
+
+  // Other threads go on giving out timestamps while the lock is released, so the poll can't
+  // compare against a copy of next_timestamp - once the GPU went past that copy, the timestamp
+  // would look pending forever. It only compares what the GPU reached against the timestamp:
+  volatile uint32_t * object = gcmGetLabelAddress(ctx -> timestamp_sync);
+  rsxgl_assert(object != 0);
+  const useconds_t timeout_interval = ctx -> base.sync_sleep_interval;
+
+  lock.unlock();
+
+  uint32_t reached = *object;
+  while(!rsxgl_timestamp_reached(reached,timestamp)) {
+    if(timeout_interval) usleep(timeout_interval);
+    reached = *object;
+  }
+
+  lock.relock(ctx);
+
+  // Keep the newer of the cached timestamp and the one that the poll saw:
+  if(rsxgl_timestamp_distance(reached,ctx -> cached_timestamp) <= (RSXGL_MAX_TIMESTAMP >> 1)) {
+    ctx -> cached_timestamp = reached;
+  }
+
+  RSXGL_PERF_TIME_END(ctx,timestamp_wait_time);
 }
 
 bool
@@ -188,8 +282,22 @@ rsxgl_timestamp_passed(rsxgl_context_t * ctx,const uint32_t timestamp)
 {
   rsxgl_assert(ctx -> timestamp_sync != 0);
 
-  rsxgl_gcm_flush(ctx -> gcm_context());
-  return rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,timestamp);
+  if(ctx -> can_emit()) rsxgl_gcm_flush(ctx -> fifo_context());
+  return rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,ctx -> next_timestamp,timestamp);
+}
+
+bool
+rsxgl_timestamp_poll(rsxgl_context_t * ctx,const uint32_t timestamp)
+{
+  rsxgl_assert(ctx -> timestamp_sync != 0);
+
+  if(rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,ctx -> next_timestamp,timestamp)) {
+    return true;
+  }
+
+  // So that the GPU eventually gets there, however long the poll goes on:
+  if(ctx -> can_emit()) rsxgl_fifo_kick_pending(ctx -> fifo_context());
+  return false;
 }
 
 #if 0
@@ -6,6 +6,7 @@
 #include <stddef.h>
 
 #include "egl_types.h"
+#include "GL3/rsxgl.h"
 #include "rsxgl_assert.h"
 #include "rsxgl_object_context.h"
 #include "arena.h"
@@ -19,6 +20,7 @@
 #include "framebuffer.h"
 #include "sync.h"
 #include "query.h"
+#include "command_list.h"
 
 #include "bit_set.h"
 
@@ -59,11 +61,19 @@ public:
   texture_t::binding_type texture_binding;
   sampler_t::binding_type sampler_binding;
 
+  // What the fragment texture units were last sent; units whose words match aren't sent again.
+  // Cleared whenever the GPU's state may not match what this context last sent it:
+  rsxgl_texture_unit_registers_t texture_unit_registers[RSXGL_MAX_TEXTURE_IMAGE_UNITS];
+  bit_set< RSXGL_MAX_TEXTURE_IMAGE_UNITS > texture_unit_registers_valid;
+
   renderbuffer_t::binding_type renderbuffer_binding;
   framebuffer_t::binding_type framebuffer_binding;
 
   query_t::binding_type query_binding;
   rsxgl_query_object_index_type any_samples_passed_query;
+
+  // Vertices captured into the transform feedback buffers since glBeginTransformFeedback():
+  uint32_t transform_feedback_offset;
   
   program_t::binding_type program_binding;
   program_t::attribs_bitfield_type invalid_attrib_assignments;
@@ -72,18 +82,32 @@ public:
   // Used by glFinish():
   uint32_t ref;
 
-  rsxgl_sync_object_index_type timestamp_sync;
+  // Timestamps belong to the object context, and are shared by every context that shares its
+  // objects; these refer to them:
+  rsxgl_sync_object_index_type & timestamp_sync;
 
-  // Next timestamp to be given out when draw functions are initiated.
-  // Should be initialized to 1:
-  uint32_t next_timestamp;
+  // Next timestamp to be given out when draw functions are initiated; see timestamp.h for how
+  // timestamps wrap around. Should be initialized to 1:
+  uint32_t & next_timestamp;
 
   // The last timestamp that was posted to the command stream:
-  uint32_t last_timestamp;
+  uint32_t & last_timestamp;
 
   // Cached copy of the current timestamp on the GPU.
   // Should be initialized to 0:
-  uint32_t cached_timestamp;
+  uint32_t & cached_timestamp;
+
+  // Non-zero while glBeginCommandListRSX() is in effect:
+  rsxgl_command_list_recorder_t * command_list_recorder;
+
+  struct rsxgl_uniform_statistics_t uniform_statistics;
+
+  // Running totals, their values at the last buffer swap, and the counts made during the last
+  // frame; see perf_counters.h:
+  struct rsxgl_perf_counters_t perf_counters, perf_counters_swap, perf_counters_frame;
+
+  // Non-zero while glEnableProfilerRSX() is in effect:
+  struct rsxgl_profiler_t * profiler;
 
   rsxgl_context_t(const struct rsxegl_config_t *,gcmContextData *,struct pipe_screen *,struct rsxgl_object_context_t *);
   ~rsxgl_context_t();
@@ -94,12 +118,28 @@ public:
     return base.gcm_context;
   }
 
+  // The context's FIFO. This differs from gcm_context() while a command list is being recorded;
+  // flushes, and commands that must execute immediately, go here:
+  inline
+  gcmContextData * fifo_context() {
+    return (command_list_recorder != 0) ? command_list_recorder -> fifo : gcm_context();
+  }
+
   inline
   rsxgl_object_context_t * object_context() {
     rsxgl_assert(m_object_context != 0);
     return m_object_context;
   }
 
+  // All contexts write to the same FIFO, so only one of them may - the one that's current with
+  // a surface. A context made current without one (by a loader thread) only creates & uploads
+  // objects, and relies upon the timestamps posted by the other to tell when the GPU is done
+  // with them:
+  inline
+  bool can_emit() const {
+    return base.draw != 0;
+  }
+
   inline
   struct pipe_screen * screen() {
     rsxgl_assert(base.screen != 0);
@@ -122,10 +162,10 @@ public:
   }
 
   static void egl_callback(rsxegl_context_t *,const uint8_t);
-  static void timestamp_overflow(void *);
 };
 
-extern rsxgl_context_t * rsxgl_ctx;
+// Each thread has its own current context:
+extern __thread rsxgl_context_t * rsxgl_ctx;
 
 static inline rsxgl_context_t *
 current_ctx()
@@ -141,9 +181,55 @@ current_object_ctx()
   return rsxgl_ctx -> object_context();
 }
 
+// Holds the current context's object context lock for the rest of the scope, if the objects are
+// shared with another context. A context that draws flushes its FIFO before it waits for the
+// lock, since the thread holding it may be waiting for the GPU to reach a timestamp that
+// hasn't been sent yet:
+struct rsxgl_object_context_lock_t {
+  rsxgl_object_context_t * m_object_context;
+  bool m_locked;
+
+  rsxgl_object_context_lock_t(rsxgl_context_t * ctx)
+    : m_object_context(ctx -> object_context() -> m_shared ? ctx -> object_context() : 0), m_locked(false) {
+    relock(ctx);
+  }
+
+  ~rsxgl_object_context_lock_t() {
+    unlock();
+  }
+
+  // The lock can be let go of part of the way through the scope, while the thread waits for the
+  // GPU or copies texels & data that no other object can get at. Objects have to be looked up
+  // again by name once it's retaken, since their storage may have moved:
+  void unlock() {
+    if(m_locked) {
+      m_object_context -> unlock();
+      m_locked = false;
+    }
+  }
+
+  void relock(rsxgl_context_t * ctx) {
+    if(m_object_context != 0 && !m_locked) {
+      if(!m_object_context -> try_lock()) {
+        if(ctx -> can_emit()) rsxgl_gcm_flush(ctx -> fifo_context());
+        m_object_context -> lock();
+      }
+      m_locked = true;
+    }
+  }
+};
+
+#define RSXGL_LOCK_SHARED_OBJECTS(CTX) rsxgl_object_context_lock_t _rsxgl_object_context_lock((CTX))
+
 uint32_t rsxgl_timestamp_create(rsxgl_context_t *,const uint32_t);
 void rsxgl_timestamp_wait(rsxgl_context_t *,const uint32_t);
+// Like the above, but the object context lock is let go of while waiting:
+void rsxgl_timestamp_wait(rsxgl_context_t *,rsxgl_object_context_lock_t &,const uint32_t);
 bool rsxgl_timestamp_passed(rsxgl_context_t *,const uint32_t);
+
+// Like rsxgl_timestamp_passed(), but the cached timestamp is consulted first, and the GPU is only
+// kicked if it hasn't been told about all of the commands so far - for answering polls:
+bool rsxgl_timestamp_poll(rsxgl_context_t *,const uint32_t);
 void rsxgl_timestamp_post(rsxgl_context_t *,const uint32_t);
 
 #endif
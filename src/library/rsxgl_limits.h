@@ -22,7 +22,8 @@
 #define RSXGL_MAX_QUERY_OBJECTS 2048
 
 #define RSXGL_MAX_TRANSFORM_FEEDBACK_SEPARATE_COMPONENTS 16
-#define RSXGL_MAX_TRANSFORM_FEEDBACK_INTERLEAVED_COMPONENTS 0
+// Interleaved varyings are captured into one render target apiece, like separate ones:
+#define RSXGL_MAX_TRANSFORM_FEEDBACK_INTERLEAVED_COMPONENTS 16
 
 // End hardware limits
 
@@ -46,6 +47,8 @@
 
 #define RSXGL_MAX_QUERIES 65536
 
+#define RSXGL_MAX_COMMAND_LISTS 4096
+
 // For glFinish, number of iterations to wait before giving up on the GPU.
 #define RSXGL_FINISH_SLEEP_ITERATIONS 100000
 
@@ -58,6 +61,40 @@
 #define RSXGL_TEXTURE_MIGRATE_BUFFER_ALIGN 1024 * 1024
 #define RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION 1
 
+// glTexSubImage*() on a texture that the GPU is still using writes into a ring of this size,
+// taken from the texture migration buffer, and the GPU copies it into the texture:
+#define RSXGL_TEXTURE_STAGING_RING_SIZE (2 * 1024 * 1024)
+// Uploads that can be in flight at once:
+#define RSXGL_MAX_TEXTURE_STAGING_UPLOADS 64
+
+// Command lists live in main memory that's mapped for the RSX; gcmMapMainMemory() needs 1MB alignment:
+#define RSXGL_COMMAND_LIST_BUFFER_ALIGN 1024 * 1024
+// Size, in bytes, of each block of memory allocated as a command list is recorded:
+#define RSXGL_COMMAND_LIST_SEGMENT_SIZE 16 * 1024
+
+// Struct uniforms that a program can source from uniform buffers:
+#define RSXGL_MAX_PROGRAM_UNIFORM_BLOCKS 16
+// Constant upload streams kept for each uniform buffer, one per (range, vertex program constant) pair:
+#define RSXGL_MAX_UNIFORM_BUFFER_STREAMS 4
+
+// GL_RSX_program_specialization: specialized copies kept of each program's fragment program (the
+// least recently used is replaced), and how many a program may compile in all; draws that a
+// uniform has to keep its value over to be folded, and how often it may have changed; and the
+// largest whole number that a float uniform is folded for as a switch:
+#define RSXGL_MAX_FP_VARIANTS 8
+#define RSXGL_MAX_FP_VARIANT_COMPILES 64
+#define RSXGL_FP_VARIANT_STABLE_DRAWS 32
+#define RSXGL_FP_VARIANT_MAX_CHANGES 16
+#define RSXGL_FP_VARIANT_MAX_SWITCH 8
+
+// GL_RSX_profiler: frames whose markers can be waiting for the GPU at once, markers per frame
+// (counting the frame itself), how deeply they may nest, and the length kept of their names.
+// Each marker takes two report objects:
+#define RSXGL_PROFILER_FRAMES 4
+#define RSXGL_MAX_PROFILER_MARKERS 128
+#define RSXGL_MAX_PROFILER_DEPTH 32
+#define RSXGL_PROFILER_NAME_LENGTH 32
+
 // Maximum value for a drawing timestamp. It's set this way so that GL objects
 // can have 1 bit for a deleted flag, and the remaining 31 bits for a timestamp.
 #define RSXGL_MAX_TIMESTAMP (((uint32_t)1 << 31) - 1)
@@ -1,6 +1,7 @@
 #include "rsxgl_object_context.h"
+#include "rsxgl_assert.h"
 
-extern "C" mspace rsxgl_rsx_mspace();
+#include <string.h>
 
 static void
 rsxgl_init_default_arena(void * ptr)
@@ -15,7 +16,7 @@ rsxgl_init_default_arena(void * ptr)
   memory_arena_t & arena = storage -> at(0);
   
   arena.address = config.localAddress;
-  arena.space = rsxgl_rsx_mspace();
+  arena.heap = rsxgl_rsx_heap();
   arena.memory.location = RSXGL_MEMORY_LOCATION_LOCAL;
   arena.memory.offset = offset;
   arena.size = config.localSize;
@@ -30,6 +31,50 @@ rsxgl_init_default_framebuffer(void * ptr)
 }
 
 rsxgl_object_context_t::rsxgl_object_context_t()
-  : m_refCount(0), m_arena_storage(0,rsxgl_init_default_arena), m_attribs_storage(0,0), m_sampler_storage(0,0), m_texture_storage(0,0), m_framebuffer_storage(0,rsxgl_init_default_framebuffer)
+  : m_refCount(0), m_shared(0), timestamp_sync(0), next_timestamp(1), last_timestamp(0), cached_timestamp(0), feedback_positions_capacity(0), feedback_positions_timestamp(0), m_arena_storage(0,rsxgl_init_default_arena), m_attribs_storage(0,0), m_sampler_storage(0,0), m_texture_storage(0,0), m_framebuffer_storage(0,rsxgl_init_default_framebuffer)
 {
+  sys_lwmutex_attr_t attr;
+  memset(&attr,0,sizeof(attr));
+  attr.attr_protocol = SYS_LWMUTEX_ATTR_PROTOCOL;
+  attr.attr_recursive = SYS_LWMUTEX_ATTR_RECURSIVE;
+  strncpy(attr.name,"rsxglobj",sizeof(attr.name));
+
+  int32_t s = sysLwMutexCreate(&m_mutex,&attr);
+  rsxgl_assert(s == 0);
+
+  timestamp_sync = rsxgl_sync_object_allocate();
+  rsxgl_assert(timestamp_sync != 0);
+  rsxgl_sync_cpu_signal(timestamp_sync,0);
+}
+
+rsxgl_object_context_t::~rsxgl_object_context_t()
+{
+  rsxgl_deferred_free_clear(*this);
+
+  if(feedback_positions) {
+    rsxgl_arena_free(m_arena_storage.at(0),feedback_positions);
+  }
+
+  rsxgl_sync_object_free(timestamp_sync);
+  sysLwMutexDestroy(&m_mutex);
+}
+
+bool
+rsxgl_object_context_t::try_lock()
+{
+  return sysLwMutexTryLock(&m_mutex) == 0;
+}
+
+void
+rsxgl_object_context_t::lock()
+{
+  int32_t s = sysLwMutexLock(&m_mutex,0);
+  rsxgl_assert(s == 0);
+}
+
+void
+rsxgl_object_context_t::unlock()
+{
+  int32_t s = sysLwMutexUnlock(&m_mutex);
+  rsxgl_assert(s == 0);
 }
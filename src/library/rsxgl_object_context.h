@@ -4,6 +4,8 @@
 #define rsxgl_object_context_H
 
 #include <stdint.h>
+#include <sys/mutex.h>
+
 #include "arena.h"
 #include "buffer.h"
 #include "attribs.h"
@@ -11,11 +13,42 @@
 #include "program.h"
 #include "framebuffer.h"
 #include "query.h"
-
+#include "command_list.h"
+#include "sync.h"
+#include "deferred_free.h"
+
+// Objects are shared by all of the contexts created with the same share_context. Those contexts
+// may be current on different threads - typically a context that draws, and a "surfaceless"
+// one that a loader thread uses to create & upload textures and buffers. Once a second context
+// shares the object context, entry points that create, modify, bind or delete buffers, textures,
+// samplers & memory arenas, and draw functions (which migrate & timestamp them), hold the object
+// context's lock; see rsxgl_object_context_lock_t in rsxgl_context.h.
 struct rsxgl_object_context_t {
   uint32_t m_refCount;
 
+  // Set once a second context shares these objects; locking is skipped until then:
+  uint8_t m_shared;
+
+  // Timestamps are shared as well, so that an object used by the GPU on behalf of one context
+  // can be waited upon or orphaned by another. See the corresponding members of rsxgl_context_t:
+  rsxgl_sync_object_index_type timestamp_sync;
+  uint32_t next_timestamp, last_timestamp, cached_timestamp;
+
+  // Memory waiting for the GPU to finish with it; see deferred_free.h:
+  rsxgl_deferred_free_queue_t deferred_free;
+
+  // Raster positions that transform feedback reads as a vertex array, from the default arena;
+  // entry n holds pixel n's x & y as 16-bit integers. See feedback.h:
+  memory_t feedback_positions;
+  uint32_t feedback_positions_capacity, feedback_positions_timestamp;
+
   rsxgl_object_context_t();
+  ~rsxgl_object_context_t();
+
+  // Recursive; returns false if the lock is held by another thread:
+  bool try_lock();
+  void lock();
+  void unlock();
 
   inline
   memory_arena_t::storage_type & arena_storage() {
@@ -67,8 +100,15 @@ struct rsxgl_object_context_t {
     return m_query_storage;
   }
 
+  inline
+  command_list_t::storage_type & command_list_storage() {
+    return m_command_list_storage;
+  }
+
 private:
 
+  sys_lwmutex_t m_mutex;
+
   memory_arena_t::storage_type m_arena_storage;
   buffer_t::storage_type m_buffer_storage;
   attribs_t::storage_type m_attribs_storage;
@@ -79,6 +119,7 @@ private:
   renderbuffer_t::storage_type m_renderbuffer_storage;
   framebuffer_t::storage_type m_framebuffer_storage;
   query_t::storage_type m_query_storage;
+  command_list_t::storage_type m_command_list_storage;
 };
 
 #endif
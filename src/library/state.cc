@@ -15,6 +15,7 @@
 
 #include <GL3/gl3.h>
 #include "error.h"
+#include "perf_counters.h"
 
 #include <rsx/gcm_sys.h>
 
@@ -111,6 +112,8 @@ state_t::state_t()
   enable.rasterizer_discard = 0;
   enable.transform_feedback_program = 0;
   enable.transform_feedback_mode = 0;
+  enable.bulk_draw_batch = 0;
+  enable.program_specialization = 0;
 }
 
 namespace {
@@ -576,6 +579,8 @@ glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
 {
   struct rsxgl_context_t * ctx = current_ctx();
 
+  RSXGL_PERF_REDUNDANT(ctx,ctx -> state.viewport.x == x && ctx -> state.viewport.y == y && ctx -> state.viewport.width == width && ctx -> state.viewport.height == height);
+
   ctx -> state.viewport.x = x;
   ctx -> state.viewport.y = y;
   ctx -> state.viewport.width = width;
@@ -633,6 +638,8 @@ glScissor (GLint x, GLint y, GLsizei width, GLsizei height)
 {
   struct rsxgl_context_t * ctx = current_ctx();
 
+  RSXGL_PERF_REDUNDANT(ctx,ctx -> state.scissor.x == x && ctx -> state.scissor.y == y && ctx -> state.scissor.width == width && ctx -> state.scissor.height == height);
+
   ctx -> state.scissor.x = x;
   ctx -> state.scissor.y = y;
   ctx -> state.scissor.width = width;
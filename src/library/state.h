@@ -76,11 +76,14 @@ enum face {
   RSXGL_FACE_CCW = 1
 };
 
+// The query's result was known when conditional rendering began (WAIT_PASS, WAIT_FAIL), so draws
+// are skipped by the CPU; or it wasn't, and the GPU skips them itself by reading the query's
+// report (ACTIVE_REPORT):
 enum conditional_render_status {
   RSXGL_CONDITIONAL_RENDER_INACTIVE = 0,
   RSXGL_CONDITIONAL_RENDER_ACTIVE_WAIT_PASS = 1,
   RSXGL_CONDITIONAL_RENDER_ACTIVE_WAIT_FAIL = 2,
-  RSXGL_CONDITIONAL_RENDER_ACTIVE_NO_WAIT = 3
+  RSXGL_CONDITIONAL_RENDER_ACTIVE_REPORT = 3
 };
 
 struct state_t {
@@ -109,7 +112,7 @@ struct state_t {
   } invalid;
 
   struct {
-    uint32_t blend:1, scissor:1, depth_test:1, primitive_restart:1, pointSize:1, conditional_render_status:2, rasterizer_discard:1, transform_feedback_program:1, transform_feedback_mode:4;
+    uint32_t blend:1, scissor:1, depth_test:1, primitive_restart:1, pointSize:1, conditional_render_status:2, rasterizer_discard:1, transform_feedback_program:1, transform_feedback_mode:4, bulk_draw_batch:1, program_specialization:1;
   } enable;
 
   struct {
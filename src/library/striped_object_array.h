@@ -8,6 +8,7 @@
 #endif
 
 #include <memory>
+#include <utility>
 #include <cstdlib>
 #include <cstring>
 #include <boost/mpl/transform.hpp>
@@ -27,6 +28,39 @@
 #define RSXGL_MEMALIGN(ALIGN,SIZE) memalign((ALIGN),(SIZE))
 #endif
 
+// Moves objects from one array to another when an array grows, or when an object is moved
+// between arrays. By default, objects are moved bitwise, without telling them - this is fine
+// for objects that don't point into themselves. Types for which it isn't (e.g., those with
+// std::string members) specialize this to derive from striped_object_move_relocate.
+template< typename Type >
+struct striped_object_relocate {
+  static void relocate(Type * lhs,Type * rhs) {
+    memcpy(lhs,rhs,sizeof(Type));
+  }
+
+  template< typename Predicate >
+  static void relocate_n(Type * lhs,Type * rhs,const size_t n,const Predicate &) {
+    memcpy(lhs,rhs,n * sizeof(Type));
+  }
+};
+
+// Move-construct the new object, then destroy the old one; Type's destructor must therefore
+// not release anything that its move constructor has taken:
+template< typename Type >
+struct striped_object_move_relocate {
+  static void relocate(Type * lhs,Type * rhs) {
+    new (lhs) Type(std::move(*rhs));
+    rhs -> ~Type();
+  }
+
+  template< typename Predicate >
+  static void relocate_n(Type * lhs,Type * rhs,const size_t n,const Predicate & p) {
+    for(size_t i = 0;i < n;++i) {
+      if(p(i)) relocate(lhs + i,rhs + i);
+    }
+  }
+};
+
 // Align must be a power of two.
 template< typename Types, typename SizeType, size_t Align >
 struct striped_object_array {
@@ -75,10 +109,13 @@ struct striped_object_array {
     }
   };
 
+  // Only those objects for which Predicate returns true are moved to the new array:
+  template< typename Predicate = default_predicate >
   struct resize_array {
     const size_type prev_size, new_size;
+    const Predicate & p;
     
-    resize_array(const size_type _prev_size,const size_type _new_size) : prev_size(_prev_size), new_size(_new_size) {
+    resize_array(const size_type _prev_size,const size_type _new_size,const Predicate & _p) : prev_size(_prev_size), new_size(_new_size), p(_p) {
     }
     
     template< typename Type >
@@ -90,9 +127,7 @@ struct striped_object_array {
       Type * tmp = (Type *)RSXGL_MEMALIGN(Align,new_aligned_size);
 
       if(array != 0) {
-	// Here we do something potentially dangerous, which is to move C++ objects without telling them.
-	// Yup, C++0x move constructors could be helpful here, so let's make that a TODO.
-	memcpy(tmp,array,std::min(prev_size,new_size) * sizeof(Type));
+	striped_object_relocate< Type >::relocate_n(tmp,array,std::min(prev_size,new_size),p);
 	free(array);
       }
 
@@ -151,7 +186,14 @@ struct striped_object_array {
     
     // 
     void resize(size_type _size) {
-      boost::fusion::for_each(values,resize_array(size,_size));
+      default_predicate p;
+      boost::fusion::for_each(values,resize_array< default_predicate >(size,_size,p));
+      size = _size;
+    }
+
+    template< typename Predicate >
+    void resize(size_type _size,const Predicate & p) {
+      boost::fusion::for_each(values,resize_array< Predicate >(size,_size,p));
       size = _size;
     }
     
@@ -197,15 +239,10 @@ struct striped_object_array {
       : lhs_i(_lhs_i), rhs_i(_rhs_i) {
     }
 
-    template< typename Type >
-    static void move_it(Type & lhs,Type const & rhs) {
-      memcpy(&lhs,&rhs,sizeof(Type));
-    }
-
     template< typename ArraysPair >
     void operator()(ArraysPair p) const {
-      //boost::fusion::at_c< 0 >(p)[lhs_i] = boost::fusion::at_c< 1 >(p)[rhs_i];
-      move_it(boost::fusion::at_c< 0 >(p)[lhs_i],boost::fusion::at_c< 1 >(p)[rhs_i]);
+      typedef typename boost::remove_pointer< typename boost::remove_reference< typename boost::fusion::result_of::at_c< ArraysPair, 0 >::type >::type >::type Type;
+      striped_object_relocate< Type >::relocate(boost::fusion::at_c< 0 >(p) + lhs_i,boost::fusion::at_c< 1 >(p) + rhs_i);
     }
   };
 
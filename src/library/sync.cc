@@ -23,10 +23,17 @@
 #endif
 #define GLAPI extern "C"
 
+// A context without a surface doesn't send anything to the GPU - its flush only needs to make
+// the objects that it's written visible to the context that does:
 static inline void
 rsxgl_flush(rsxgl_context_t * ctx)
 {
-  rsxgl_gcm_flush(ctx -> gcm_context());
+  if(ctx -> can_emit()) {
+    rsxgl_gcm_flush(ctx -> fifo_context());
+  }
+  else {
+    __sync();
+  }
 }
 
 GLAPI void APIENTRY
@@ -42,9 +49,14 @@ glFinish (void)
 {
   rsxgl_context_t * ctx = current_ctx();
 
+  if(!ctx -> can_emit()) {
+    rsxgl_flush(ctx);
+    RSXGL_NOERROR_();
+  }
+
   // TODO - Rumor has it that waiting on ctx -> ref is "slow". See if this is unacceptable, and see if a sync object is any better.
   const uint32_t ref = ctx -> ref++;
-  rsxgl_emit_set_ref(ctx -> gcm_context(),ref);
+  rsxgl_emit_set_ref(ctx -> fifo_context(),ref);
   rsxgl_flush(ctx);
 
   gcmControlRegister volatile *control = gcmGetControlRegister();
@@ -146,6 +158,8 @@ rsxgl_sync_token()
 GLAPI GLsync APIENTRY
 glFenceSync (GLenum condition, GLbitfield flags)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(condition != GL_SYNC_GPU_COMMANDS_COMPLETE) {
     RSXGL_ERROR(GL_INVALID_ENUM,0);
   }
@@ -156,6 +170,21 @@ glFenceSync (GLenum condition, GLbitfield flags)
 
   const rsxgl_sync_object_t::name_type name = rsxgl_sync_object_t::storage().create_name_and_object();
 
+  // A context without a surface has no commands for the GPU to complete - its fence is
+  // signaled once what it's written is visible to other contexts:
+  rsxgl_context_t * ctx = current_ctx();
+  if(!ctx -> can_emit()) {
+    rsxgl_flush(ctx);
+
+    rsxgl_sync_object_t * sync_object = &rsxgl_sync_object_t::storage().at(name);
+    sync_object -> name = name;
+    sync_object -> status = 1;
+    sync_object -> index = RSXGL_MAX_SYNC_OBJECTS;
+    sync_object -> value = 0;
+
+    RSXGL_NOERROR((GLsync)sync_object);
+  }
+
   const rsxgl_sync_object_index_type index = rsxgl_sync_object_allocate();
   const uint32_t token = rsxgl_sync_token();
 
@@ -167,7 +196,7 @@ glFenceSync (GLenum condition, GLbitfield flags)
     sync_object -> value = token;
   
     rsxgl_sync_cpu_signal(index,RSXGL_SYNC_UNSIGNALED_TOKEN);
-    rsxgl_emit_sync_gpu_signal_read(current_ctx() -> base.gcm_context,sync_object -> index,token);
+    rsxgl_emit_sync_gpu_signal_read(ctx -> base.gcm_context,sync_object -> index,token);
 
     RSXGL_NOERROR((GLsync)sync_object);
   }
@@ -179,12 +208,16 @@ glFenceSync (GLenum condition, GLbitfield flags)
 GLAPI GLboolean APIENTRY
 glIsSync (GLsync sync)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   return (sync != 0) && (rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name));
 }
 
 GLAPI void APIENTRY
 glDeleteSync (GLsync sync)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(sync == 0 || !rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name)) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
@@ -201,8 +234,13 @@ glDeleteSync (GLsync sync)
 GLAPI GLenum APIENTRY
 glClientWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
 {
-  if(sync == 0 || !rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name)) {
-    RSXGL_ERROR(GL_INVALID_VALUE,GL_WAIT_FAILED);
+  // The lock isn't held while waiting, since the context that would signal the sync may need it:
+  {
+    RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
+    if(sync == 0 || !rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name)) {
+      RSXGL_ERROR(GL_INVALID_VALUE,GL_WAIT_FAILED);
+    }
   }
 
   static const GLbitfield valid_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
@@ -241,6 +279,8 @@ glClientWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
 GLAPI void APIENTRY
 glWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(sync == 0 || !rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name)) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
@@ -257,6 +297,8 @@ glWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
 GLAPI void APIENTRY
 glGetSynciv (GLsync sync, GLenum pname, GLsizei bufSize, GLsizei *length, GLint *values)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(sync == 0 || !rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name)) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
@@ -20,6 +20,7 @@
 
 #include "nv40.h"
 #include "gl_fifo.h"
+#include "fifo.h"
 #include "rsxgl_assert.h"
 #include "rsxgl_limits.h"
 
@@ -27,13 +28,7 @@
 static inline void
 rsxgl_gcm_flush(gcmContextData * context)
 {
-  uint32_t offset;
-  gcmControlRegister volatile *control = gcmGetControlRegister();
-
-  __sync();
-  
-  gcmAddressToOffset(context -> current, &offset);
-  control->put = offset;
+  rsxgl_fifo_kick(context);
 }
 
 // Insert a command to set the RSX's reference register to something:
@@ -0,0 +1,111 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// texture_compression.cc - CPU decoding of compressed textures.
+
+#include "textures.h"
+#include "texture_compression.h"
+#include "rsxgl_assert.h"
+
+#include "util/u_format.h"
+
+extern "C" {
+#include "util/u_format_s3tc.h"
+}
+
+#include <algorithm>
+
+static inline rsxgl_compressed_block_type
+rsxgl_texture_block_type(const pipe_format pformat)
+{
+  switch(pformat) {
+  case PIPE_FORMAT_DXT1_RGB:
+  case PIPE_FORMAT_DXT1_SRGB:
+    return RSXGL_COMPRESSED_BLOCK_DXT1_RGB;
+  case PIPE_FORMAT_DXT1_RGBA:
+  case PIPE_FORMAT_DXT1_SRGBA:
+    return RSXGL_COMPRESSED_BLOCK_DXT1_RGBA;
+  case PIPE_FORMAT_DXT3_RGBA:
+  case PIPE_FORMAT_DXT3_SRGBA:
+    return RSXGL_COMPRESSED_BLOCK_DXT3;
+  case PIPE_FORMAT_DXT5_RGBA:
+  case PIPE_FORMAT_DXT5_SRGBA:
+    return RSXGL_COMPRESSED_BLOCK_DXT5;
+  case PIPE_FORMAT_RGTC1_UNORM:
+    return RSXGL_COMPRESSED_BLOCK_RGTC1;
+  case PIPE_FORMAT_RGTC2_UNORM:
+    return RSXGL_COMPRESSED_BLOCK_RGTC2;
+  default:
+    return RSXGL_COMPRESSED_BLOCK_NONE;
+  }
+}
+
+// Gallium reads S3TC texels through these; src_stride is the image's width in texels:
+template< rsxgl_compressed_block_type type >
+static void
+rsxgl_compressed_fetch(int src_stride,const uint8_t * src,int col,int row,uint8_t * dst)
+{
+  const uint8_t * block = src + ((((src_stride + 3) / 4) * (row / 4)) + (col / 4)) * rsxgl_compressed_block_size(type);
+
+  uint8_t texels[16][4];
+  rsxgl_decode_compressed_block(type,block,texels);
+
+  const uint8_t * texel = texels[((row % 4) * 4) + (col % 4)];
+  dst[0] = texel[0];
+  dst[1] = texel[1];
+  dst[2] = texel[2];
+  dst[3] = texel[3];
+}
+
+void
+rsxgl_texture_compression_init()
+{
+  if(util_format_s3tc_enabled) return;
+
+  util_format_dxt1_rgb_fetch = rsxgl_compressed_fetch< RSXGL_COMPRESSED_BLOCK_DXT1_RGB >;
+  util_format_dxt1_rgba_fetch = rsxgl_compressed_fetch< RSXGL_COMPRESSED_BLOCK_DXT1_RGBA >;
+  util_format_dxt3_rgba_fetch = rsxgl_compressed_fetch< RSXGL_COMPRESSED_BLOCK_DXT3 >;
+  util_format_dxt5_rgba_fetch = rsxgl_compressed_fetch< RSXGL_COMPRESSED_BLOCK_DXT5 >;
+
+  // There's still no compressor - images are only ever uploaded already compressed:
+  util_format_s3tc_enabled = TRUE;
+}
+
+bool
+rsxgl_texture_decode_supported(const pipe_format pformat)
+{
+  return rsxgl_texture_block_type(pformat) != RSXGL_COMPRESSED_BLOCK_NONE;
+}
+
+void
+rsxgl_texture_decode(const pipe_format dstformat,void * dstaddress,const uint32_t dstpitch,const uint32_t dstx,const uint32_t dsty,
+		     const pipe_format srcformat,const void * srcaddress,const uint32_t srcpitch,
+		     const uint32_t width,const uint32_t height)
+{
+  const rsxgl_compressed_block_type type = rsxgl_texture_block_type(srcformat);
+  rsxgl_assert(type != RSXGL_COMPRESSED_BLOCK_NONE);
+  rsxgl_assert(!util_format_is_compressed(dstformat));
+
+  // Decoded sRGB texels are still sRGB-encoded; store them without conversion:
+  const struct util_format_description * desc = util_format_description(util_format_is_srgb(srcformat) ? util_format_linear(dstformat) : dstformat);
+  const uint32_t texelsize = util_format_get_blocksize(dstformat), blocksize = rsxgl_compressed_block_size(type);
+
+  const uint8_t * srcrow = (const uint8_t *)srcaddress;
+  uint8_t * dstrow = (uint8_t *)dstaddress + (dsty * dstpitch) + (dstx * texelsize);
+
+  // Blocks along the right & bottom edges may be partly outside of the image:
+  for(uint32_t y = 0;y < height;y += 4,srcrow += srcpitch,dstrow += dstpitch * 4) {
+    const uint8_t * block = srcrow;
+    const uint32_t h = std::min(height - y,(uint32_t)4);
+
+    for(uint32_t x = 0;x < width;x += 4,block += blocksize) {
+      const uint32_t w = std::min(width - x,(uint32_t)4);
+
+      uint8_t texels[16][4];
+      rsxgl_decode_compressed_block(type,block,texels);
+
+      desc -> pack_rgba_8unorm(dstrow + (x * texelsize),dstpitch,texels[0],4 * 4,w,h);
+    }
+  }
+}
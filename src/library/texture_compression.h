@@ -0,0 +1,176 @@
+//-*-C-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// texture_compression.h - Decoding of S3TC (DXT1/3/5) & RGTC texel blocks on the CPU.
+//
+// The RSX samples DXT1/3/5 textures itself, so compressed images are normally uploaded as-is.
+// These decoders cover the rest - formats that it can't sample (RGTC), textures that it can't
+// sample compressed (3D), and reading texels back. A block holds 4x4 texels; multi-byte fields
+// are little-endian regardless of the host's byte order. Texels are decoded to RGBA, 8 bits per
+// component, row by row.
+
+#ifndef rsxgl_texture_compression_H
+#define rsxgl_texture_compression_H
+
+#include <stdint.h>
+
+enum rsxgl_compressed_block_type {
+  RSXGL_COMPRESSED_BLOCK_NONE = 0,
+  RSXGL_COMPRESSED_BLOCK_DXT1_RGB,
+  RSXGL_COMPRESSED_BLOCK_DXT1_RGBA,
+  RSXGL_COMPRESSED_BLOCK_DXT3,
+  RSXGL_COMPRESSED_BLOCK_DXT5,
+  RSXGL_COMPRESSED_BLOCK_RGTC1,
+  RSXGL_COMPRESSED_BLOCK_RGTC2
+};
+
+// Bytes per 4x4 block:
+static inline unsigned
+rsxgl_compressed_block_size(const enum rsxgl_compressed_block_type type)
+{
+  return (type == RSXGL_COMPRESSED_BLOCK_DXT1_RGB || type == RSXGL_COMPRESSED_BLOCK_DXT1_RGBA || type == RSXGL_COMPRESSED_BLOCK_RGTC1) ? 8 : 16;
+}
+
+static inline uint32_t
+rsxgl_compressed_read16(const uint8_t * p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static inline uint32_t
+rsxgl_compressed_read32(const uint8_t * p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// 8-byte color block used by the DXT formats. DXT1 blocks whose first color isn't greater than
+// the second have three colors and transparent black; DXT3 & DXT5 always have four colors:
+static inline void
+rsxgl_decode_dxt_color_block(const uint8_t * block,const int dxt1,const int dxt1_alpha,uint8_t texels[16][4])
+{
+  const uint32_t c0 = rsxgl_compressed_read16(block), c1 = rsxgl_compressed_read16(block + 2);
+  const uint32_t indices = rsxgl_compressed_read32(block + 4);
+
+  uint8_t colors[4][4];
+  for(int i = 0;i < 2;++i) {
+    const uint32_t c = (i == 0) ? c0 : c1;
+    const uint32_t r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    colors[i][0] = (uint8_t)((r << 3) | (r >> 2));
+    colors[i][1] = (uint8_t)((g << 2) | (g >> 4));
+    colors[i][2] = (uint8_t)((b << 3) | (b >> 2));
+    colors[i][3] = 0xff;
+  }
+
+  if(!dxt1 || c0 > c1) {
+    for(int j = 0;j < 3;++j) {
+      colors[2][j] = (uint8_t)((2 * (uint32_t)colors[0][j] + (uint32_t)colors[1][j]) / 3);
+      colors[3][j] = (uint8_t)(((uint32_t)colors[0][j] + 2 * (uint32_t)colors[1][j]) / 3);
+    }
+    colors[2][3] = colors[3][3] = 0xff;
+  }
+  else {
+    for(int j = 0;j < 3;++j) {
+      colors[2][j] = (uint8_t)(((uint32_t)colors[0][j] + (uint32_t)colors[1][j]) / 2);
+      colors[3][j] = 0;
+    }
+    colors[2][3] = 0xff;
+    colors[3][3] = dxt1_alpha ? 0 : 0xff;
+  }
+
+  for(int i = 0;i < 16;++i) {
+    const uint8_t * color = colors[(indices >> (i * 2)) & 0x3];
+    texels[i][0] = color[0];
+    texels[i][1] = color[1];
+    texels[i][2] = color[2];
+    texels[i][3] = color[3];
+  }
+}
+
+// 8-byte block of interpolated values, used for DXT5 alpha & for RGTC channels:
+static inline void
+rsxgl_decode_dxt_value_block(const uint8_t * block,uint8_t values[16])
+{
+  const uint32_t a0 = block[0], a1 = block[1];
+
+  uint8_t palette[8];
+  palette[0] = (uint8_t)a0;
+  palette[1] = (uint8_t)a1;
+  if(a0 > a1) {
+    for(uint32_t i = 1;i < 7;++i) {
+      palette[i + 1] = (uint8_t)(((7 - i) * a0 + i * a1) / 7);
+    }
+  }
+  else {
+    for(uint32_t i = 1;i < 5;++i) {
+      palette[i + 1] = (uint8_t)(((5 - i) * a0 + i * a1) / 5);
+    }
+    palette[6] = 0;
+    palette[7] = 0xff;
+  }
+
+  // 16 3-bit indices:
+  const uint64_t indices = (uint64_t)rsxgl_compressed_read16(block + 2) | ((uint64_t)rsxgl_compressed_read32(block + 4) << 16);
+  for(int i = 0;i < 16;++i) {
+    values[i] = palette[(indices >> (i * 3)) & 0x7];
+  }
+}
+
+static inline void
+rsxgl_decode_compressed_block(const enum rsxgl_compressed_block_type type,const uint8_t * block,uint8_t texels[16][4])
+{
+  uint8_t values[16];
+
+  switch(type) {
+  case RSXGL_COMPRESSED_BLOCK_DXT1_RGB:
+    rsxgl_decode_dxt_color_block(block,1,0,texels);
+    break;
+  case RSXGL_COMPRESSED_BLOCK_DXT1_RGBA:
+    rsxgl_decode_dxt_color_block(block,1,1,texels);
+    break;
+  case RSXGL_COMPRESSED_BLOCK_DXT3:
+    rsxgl_decode_dxt_color_block(block + 8,0,0,texels);
+    for(int i = 0;i < 16;++i) {
+      const uint32_t a = (block[i / 2] >> ((i % 2) * 4)) & 0xf;
+      texels[i][3] = (uint8_t)(a * 17);
+    }
+    break;
+  case RSXGL_COMPRESSED_BLOCK_DXT5:
+    rsxgl_decode_dxt_color_block(block + 8,0,0,texels);
+    rsxgl_decode_dxt_value_block(block,values);
+    for(int i = 0;i < 16;++i) {
+      texels[i][3] = values[i];
+    }
+    break;
+  case RSXGL_COMPRESSED_BLOCK_RGTC1:
+    rsxgl_decode_dxt_value_block(block,values);
+    for(int i = 0;i < 16;++i) {
+      texels[i][0] = values[i];
+      texels[i][1] = 0;
+      texels[i][2] = 0;
+      texels[i][3] = 0xff;
+    }
+    break;
+  case RSXGL_COMPRESSED_BLOCK_RGTC2:
+    rsxgl_decode_dxt_value_block(block,values);
+    for(int i = 0;i < 16;++i) {
+      texels[i][0] = values[i];
+      texels[i][2] = 0;
+      texels[i][3] = 0xff;
+    }
+    rsxgl_decode_dxt_value_block(block + 8,values);
+    for(int i = 0;i < 16;++i) {
+      texels[i][1] = values[i];
+    }
+    break;
+  default:
+    for(int i = 0;i < 16;++i) {
+      texels[i][0] = texels[i][1] = texels[i][2] = 0;
+      texels[i][3] = 0xff;
+    }
+    break;
+  }
+}
+
+#endif
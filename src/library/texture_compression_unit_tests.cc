@@ -0,0 +1,210 @@
+// "Unit testing" for the compressed texel block decoders in texture_compression.h. Meant to be
+// built & run on the host, e.g.:
+//
+// g++ -std=c++11 texture_compression_unit_tests.cc -o texture_compression_unit_tests
+//
+// Blocks are assembled byte by byte, so that the decoders are also checked for reading
+// multi-byte fields as little-endian.
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include <stdint.h>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+
+#include "texture_compression.h"
+
+static void
+put16(uint8_t * p,uint32_t value)
+{
+  p[0] = value & 0xff;
+  p[1] = (value >> 8) & 0xff;
+}
+
+static void
+put32(uint8_t * p,uint32_t value)
+{
+  put16(p,value & 0xffff);
+  put16(p + 2,value >> 16);
+}
+
+// 2-bit color indices; texel i uses index (i % 4):
+static const uint32_t color_indices = 0xe4e4e4e4;
+
+// 3-bit value indices; texel i uses index (i % 8):
+static void
+put_value_indices(uint8_t * p)
+{
+  uint64_t indices = 0;
+  for(int i = 0;i < 16;++i) {
+    indices |= (uint64_t)(i % 8) << (i * 3);
+  }
+  for(int i = 0;i < 6;++i) {
+    p[i] = (indices >> (i * 8)) & 0xff;
+  }
+}
+
+static void
+check_texel(const uint8_t texel[4],int r,int g,int b,int a)
+{
+  assert(texel[0] == r);
+  assert(texel[1] == g);
+  assert(texel[2] == b);
+  assert(texel[3] == a);
+}
+
+static void
+test_dxt1()
+{
+  uint8_t block[8], texels[16][4];
+
+  // Four colors, red to blue:
+  put16(block,0xf800);
+  put16(block + 2,0x001f);
+  put32(block + 4,color_indices);
+
+  rsxgl_decode_compressed_block(RSXGL_COMPRESSED_BLOCK_DXT1_RGBA,block,texels);
+  for(int i = 0;i < 16;i += 4) {
+    check_texel(texels[i],255,0,0,255);
+    check_texel(texels[i + 1],0,0,255,255);
+    check_texel(texels[i + 2],170,0,85,255);
+    check_texel(texels[i + 3],85,0,170,255);
+  }
+
+  // Three colors & transparent black:
+  put16(block,0x001f);
+  put16(block + 2,0xf800);
+
+  rsxgl_decode_compressed_block(RSXGL_COMPRESSED_BLOCK_DXT1_RGBA,block,texels);
+  check_texel(texels[0],0,0,255,255);
+  check_texel(texels[1],255,0,0,255);
+  check_texel(texels[2],127,0,127,255);
+  check_texel(texels[3],0,0,0,0);
+
+  // Without alpha, the fourth color is opaque:
+  rsxgl_decode_compressed_block(RSXGL_COMPRESSED_BLOCK_DXT1_RGB,block,texels);
+  check_texel(texels[3],0,0,0,255);
+
+  // Endpoint expansion replicates the high bits:
+  put16(block,0x8410);
+  put16(block + 2,0x0000);
+  put32(block + 4,0);
+
+  rsxgl_decode_compressed_block(RSXGL_COMPRESSED_BLOCK_DXT1_RGB,block,texels);
+  check_texel(texels[15],132,130,132,255);
+}
+
+static void
+test_dxt3()
+{
+  uint8_t block[16], texels[16][4];
+
+  // Explicit alpha, 4 bits per texel:
+  for(int i = 0;i < 8;++i) {
+    block[i] = (uint8_t)(((i * 2 + 1) << 4) | (i * 2));
+  }
+
+  // DXT3 always has four colors, even when the first isn't greater:
+  put16(block + 8,0x001f);
+  put16(block + 10,0xf800);
+  put32(block + 12,color_indices);
+
+  rsxgl_decode_compressed_block(RSXGL_COMPRESSED_BLOCK_DXT3,block,texels);
+  for(int i = 0;i < 16;++i) {
+    assert(texels[i][3] == i * 17);
+  }
+  check_texel(texels[2],85,0,170,34);
+  check_texel(texels[3],170,0,85,51);
+}
+
+static void
+test_dxt5()
+{
+  uint8_t block[16], texels[16][4];
+
+  // Eight alpha values:
+  block[0] = 255;
+  block[1] = 0;
+  put_value_indices(block + 2);
+
+  put16(block + 8,0xffff);
+  put16(block + 10,0xffff);
+  put32(block + 12,0);
+
+  rsxgl_decode_compressed_block(RSXGL_COMPRESSED_BLOCK_DXT5,block,texels);
+  static const int eight[8] = { 255, 0, 218, 182, 145, 109, 72, 36 };
+  for(int i = 0;i < 16;++i) {
+    check_texel(texels[i],255,255,255,eight[i % 8]);
+  }
+
+  // Six alpha values, then 0 & 255:
+  block[0] = 0;
+  block[1] = 255;
+
+  rsxgl_decode_compressed_block(RSXGL_COMPRESSED_BLOCK_DXT5,block,texels);
+  static const int six[8] = { 0, 255, 51, 102, 153, 204, 0, 255 };
+  for(int i = 0;i < 16;++i) {
+    assert(texels[i][3] == six[i % 8]);
+  }
+}
+
+static void
+test_rgtc()
+{
+  uint8_t block[16], texels[16][4];
+
+  block[0] = 200;
+  block[1] = 60;
+  put_value_indices(block + 2);
+
+  rsxgl_decode_compressed_block(RSXGL_COMPRESSED_BLOCK_RGTC1,block,texels);
+  static const int red[8] = { 200, 60, 180, 160, 140, 120, 100, 80 };
+  for(int i = 0;i < 16;++i) {
+    check_texel(texels[i],red[i % 8],0,0,255);
+  }
+
+  // The second channel has its own endpoints:
+  block[8] = 10;
+  block[9] = 20;
+  for(int i = 10;i < 16;++i) {
+    block[i] = 0;
+  }
+
+  rsxgl_decode_compressed_block(RSXGL_COMPRESSED_BLOCK_RGTC2,block,texels);
+  for(int i = 0;i < 16;++i) {
+    check_texel(texels[i],red[i % 8],10,0,255);
+  }
+}
+
+int
+main(int argc,char ** argv)
+{
+  try {
+    assert(rsxgl_compressed_block_size(RSXGL_COMPRESSED_BLOCK_DXT1_RGB) == 8);
+    assert(rsxgl_compressed_block_size(RSXGL_COMPRESSED_BLOCK_DXT5) == 16);
+    assert(rsxgl_compressed_block_size(RSXGL_COMPRESSED_BLOCK_RGTC1) == 8);
+    assert(rsxgl_compressed_block_size(RSXGL_COMPRESSED_BLOCK_RGTC2) == 16);
+
+    test_dxt1();
+    test_dxt3();
+    test_dxt5();
+    test_rgtc();
+
+    std::cout << "passed" << std::endl;
+  }
+  catch(const assertion & a) {
+    std::cerr << "failed: " << a.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
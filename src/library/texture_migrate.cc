@@ -21,7 +21,7 @@ static uint32_t rsxgl_texture_migrate_size = RSXGL_CONFIG_texture_migrate_buffer
 // 
 static void * _rsxgl_texture_migrate_buffer = 0;
 static uint32_t rsxgl_texture_migrate_buffer_offset = 0;
-static mspace rsxgl_texture_migrate_buffer_space = 0;
+static struct rsxgl_heap_t * rsxgl_texture_migrate_buffer_heap = 0;
 
 void *
 rsxgl_texture_migrate_buffer_new(const rsx_size_t align,const rsx_size_t size, uint32_t *offset)
@@ -76,7 +76,7 @@ void * rsxgl_texture_migrate_buffer()
 
     rsxgl_assert(_rsxgl_texture_migrate_buffer != 0);
 
-    rsxgl_texture_migrate_buffer_space = create_mspace_with_base(_rsxgl_texture_migrate_buffer,rsxgl_texture_migrate_size,0);
+    rsxgl_texture_migrate_buffer_heap = rsxgl_heap_create(_rsxgl_texture_migrate_buffer,rsxgl_texture_migrate_size);
   }
 
   return _rsxgl_texture_migrate_buffer;
@@ -89,7 +89,7 @@ rsxgl_texture_migrate_memalign(const rsx_size_t align,const rsx_size_t size)
 
   rsxgl_assert(buffer != 0);
 
-  return mspace_memalign(rsxgl_texture_migrate_buffer_space,align,size);
+  return rsxgl_heap_memalign(rsxgl_texture_migrate_buffer_heap,align,size);
 }
 
 void
@@ -97,7 +97,7 @@ rsxgl_texture_migrate_free(void * ptr)
 {
   rsxgl_assert(_rsxgl_texture_migrate_buffer != 0);
 
-  mspace_free(rsxgl_texture_migrate_buffer_space,ptr);
+  rsxgl_heap_free(rsxgl_texture_migrate_buffer_heap,ptr);
 }
 
 void
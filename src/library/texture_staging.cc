@@ -0,0 +1,117 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// texture_staging.cc - Ring of GPU-visible memory that texture updates are written into.
+
+#include "rsxgl_context.h"
+#include "texture_staging.h"
+#include "texture_migrate.h"
+#include "rsxgl_limits.h"
+#include "rsxgl_assert.h"
+#include "perf_counters.h"
+
+// Uploads start on this boundary:
+static const rsx_size_t rsxgl_texture_staging_align = 128;
+
+static uint8_t * rsxgl_texture_staging_ring = 0;
+
+// Where the next upload goes:
+static rsx_size_t rsxgl_texture_staging_head = 0;
+
+// Uploads that the GPU may not have copied yet, oldest first:
+static struct {
+  rsx_size_t start;
+  uint32_t timestamp;
+} rsxgl_texture_staging_uploads[RSXGL_MAX_TEXTURE_STAGING_UPLOADS];
+
+static uint32_t rsxgl_texture_staging_first = 0, rsxgl_texture_staging_count = 0;
+
+// Allocated, but not yet committed:
+static rsx_size_t rsxgl_texture_staging_pending_start = 0, rsxgl_texture_staging_pending_end = 0;
+
+static inline void
+rsxgl_texture_staging_retire(rsxgl_context_t * ctx)
+{
+  rsxgl_assert(rsxgl_texture_staging_count > 0);
+
+  rsxgl_timestamp_wait(ctx,rsxgl_texture_staging_uploads[rsxgl_texture_staging_first].timestamp);
+
+  rsxgl_texture_staging_first = (rsxgl_texture_staging_first + 1) % RSXGL_MAX_TEXTURE_STAGING_UPLOADS;
+  --rsxgl_texture_staging_count;
+}
+
+void *
+rsxgl_texture_staging_allocate(rsxgl_context_t * ctx,const rsx_size_t _size,memory_t * memory)
+{
+  const rsx_size_t size = (_size + rsxgl_texture_staging_align - 1) & ~(rsxgl_texture_staging_align - 1);
+
+  if(size == 0 || size >= RSXGL_TEXTURE_STAGING_RING_SIZE) {
+    return 0;
+  }
+
+  if(rsxgl_texture_staging_ring == 0) {
+    rsxgl_texture_staging_ring = (uint8_t *)rsxgl_texture_migrate_memalign(rsxgl_texture_staging_align,RSXGL_TEXTURE_STAGING_RING_SIZE);
+    if(rsxgl_texture_staging_ring == 0) {
+      return 0;
+    }
+  }
+
+  if(rsxgl_texture_staging_count == RSXGL_MAX_TEXTURE_STAGING_UPLOADS) {
+    rsxgl_texture_staging_retire(ctx);
+  }
+
+  // The ring is in use from the start of the oldest upload up to the head. A head equal to that
+  // start would be ambiguous, so the head never catches up to it:
+  rsx_size_t start = 0;
+  while(true) {
+    if(rsxgl_texture_staging_count == 0) {
+      start = 0;
+      break;
+    }
+
+    const rsx_size_t tail = rsxgl_texture_staging_uploads[rsxgl_texture_staging_first].start;
+
+    if(rsxgl_texture_staging_head >= tail) {
+      if((rsxgl_texture_staging_head + size) <= RSXGL_TEXTURE_STAGING_RING_SIZE) {
+	start = rsxgl_texture_staging_head;
+	break;
+      }
+      else if(size < tail) {
+	start = 0;
+	break;
+      }
+    }
+    else if((rsxgl_texture_staging_head + size) < tail) {
+      start = rsxgl_texture_staging_head;
+      break;
+    }
+
+    rsxgl_texture_staging_retire(ctx);
+  }
+
+  rsxgl_texture_staging_pending_start = start;
+  rsxgl_texture_staging_pending_end = start + size;
+
+  RSXGL_PERF_COUNT(ctx,migrate_bytes,size);
+
+  void * address = rsxgl_texture_staging_ring + start;
+  *memory = memory_t(RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION,rsxgl_texture_migrate_offset(address));
+
+  return address;
+}
+
+void
+rsxgl_texture_staging_commit(const uint32_t timestamp)
+{
+  rsxgl_assert(rsxgl_texture_staging_count < RSXGL_MAX_TEXTURE_STAGING_UPLOADS);
+  rsxgl_assert(rsxgl_texture_staging_pending_end > rsxgl_texture_staging_pending_start);
+
+  const uint32_t i = (rsxgl_texture_staging_first + rsxgl_texture_staging_count) % RSXGL_MAX_TEXTURE_STAGING_UPLOADS;
+  rsxgl_texture_staging_uploads[i].start = rsxgl_texture_staging_pending_start;
+  rsxgl_texture_staging_uploads[i].timestamp = timestamp;
+  ++rsxgl_texture_staging_count;
+
+  rsxgl_texture_staging_head = rsxgl_texture_staging_pending_end;
+  rsxgl_texture_staging_pending_start = rsxgl_texture_staging_pending_end = 0;
+}
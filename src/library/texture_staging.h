@@ -0,0 +1,31 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// texture_staging.h - Ring of GPU-visible memory that texture updates are written into, while the
+// texture itself is still in use by the GPU.
+//
+// Rather than wait for the GPU to finish with a texture, glTexSubImage*() writes the new texels
+// into the ring, and the GPU copies them into the texture with a DMA transfer that follows the
+// commands that use the old ones. The CPU only waits when the ring is full, for the oldest
+// upload to be copied.
+
+#ifndef rsxgl_texture_staging_H
+#define rsxgl_texture_staging_H
+
+#include <stdint.h>
+
+#include "mem.h"
+#include "arena.h"
+
+struct rsxgl_context_t;
+
+// Returns space for an upload of size bytes, waiting for earlier uploads to finish if the ring
+// is full; returns 0 if the upload won't fit in the ring at all. *memory is set to its location:
+void * rsxgl_texture_staging_allocate(rsxgl_context_t *,const rsx_size_t,memory_t *);
+
+// The last allocation is in use until the GPU reaches timestamp:
+void rsxgl_texture_staging_commit(const uint32_t);
+
+#endif
@@ -10,6 +10,9 @@
 #include "gl_constants.h"
 #include "textures.h"
 #include "texture_migrate.h"
+#include "texture_staging.h"
+#include "texture_compression.h"
+#include "perf_counters.h"
 
 #include <GL3/gl3.h>
 #include "GL3/gl3ext.h"
@@ -70,6 +73,36 @@ sampler_t::storage_type & sampler_t::storage()
   return current_object_ctx() -> sampler_storage();
 }
 
+// The hardware's LOD values are 4.8 fixed point:
+static inline int32_t
+rsxgl_sampler_lod_fixed(float lod,float min,float max)
+{
+  return (int32_t)(std::min(std::max(lod,min),max) * 256.0f);
+}
+
+static inline void
+rsxgl_sampler_pack(sampler_t & sampler)
+{
+  sampler.hw_wrap =
+    ((uint32_t)(sampler.wrap_s + 1) << NV30_3D_TEX_WRAP_S__SHIFT) |
+    ((uint32_t)(sampler.wrap_t + 1) << NV30_3D_TEX_WRAP_T__SHIFT) |
+    ((uint32_t)(sampler.wrap_r + 1) << NV30_3D_TEX_WRAP_R__SHIFT) |
+    ((uint32_t)sampler.compare_func << NV30_3D_TEX_WRAP_RCOMP__SHIFT)
+    ;
+
+  sampler.hw_filter =
+    ((uint32_t)(sampler.filter_min + 1) << NV30_3D_TEX_FILTER_MIN__SHIFT) |
+    ((uint32_t)(sampler.filter_mag + 1) << NV30_3D_TEX_FILTER_MAG__SHIFT) |
+    // "convolution":
+    ((uint32_t)1 << 13) |
+    // signed bias:
+    ((uint32_t)rsxgl_sampler_lod_fixed(sampler.lodBias,-16.0f,15.0f + (255.0f / 256.0f)) & 0x1fff)
+    ;
+
+  sampler.hw_min_lod = rsxgl_sampler_lod_fixed(sampler.minLod,0.0f,15.0f + (255.0f / 256.0f));
+  sampler.hw_max_lod = rsxgl_sampler_lod_fixed(sampler.maxLod,0.0f,15.0f + (255.0f / 256.0f));
+}
+
 sampler_t::sampler_t()
 {
   wrap_s = RSXGL_REPEAT;
@@ -85,11 +118,15 @@ sampler_t::sampler_t()
   lodBias = 0.0f;
   minLod = 0.0f;
   maxLod = 12.0f;
+
+  rsxgl_sampler_pack(*this);
 }
 
 GLAPI void APIENTRY
 glGenSamplers (GLsizei count, GLuint *samplers)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   GLsizei n = sampler_t::storage().create_names(count,samplers);
 
   if(count != n) {
@@ -102,6 +139,8 @@ glGenSamplers (GLsizei count, GLuint *samplers)
 GLAPI void APIENTRY
 glDeleteSamplers (GLsizei count, const GLuint *samplers)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   struct rsxgl_context_t * ctx = current_ctx();
 
   for(GLsizei i = 0;i < count;++i,++samplers) {
@@ -136,12 +175,16 @@ glDeleteSamplers (GLsizei count, const GLuint *samplers)
 GLAPI GLboolean APIENTRY
 glIsSampler (GLuint sampler)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   return sampler_t::storage().is_object(sampler);
 }
 
 GLAPI void APIENTRY
 glBindSampler (GLuint unit, GLuint sampler_name)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(unit > RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
@@ -273,6 +316,8 @@ _rsxgl_set_sampler_parameteri(rsxgl_context_t * ctx,sampler_t & sampler,GLenum p
       break;
     }
   }
+
+  rsxgl_sampler_pack(sampler);
 }
 
 static inline void
@@ -401,7 +446,10 @@ _rsxgl_set_sampler_parameterf(rsxgl_context_t * ctx,sampler_t & sampler,GLenum p
   }
   else {
     _rsxgl_set_sampler_parameteri(ctx,sampler,pname,param);
+    return;
   }
+
+  rsxgl_sampler_pack(sampler);
 }
 
 static inline void
@@ -567,30 +615,40 @@ rsxgl_get_sampler_parameterf(rsxgl_context_t * ctx,sampler_t::name_type sampler_
 GLAPI void APIENTRY
 glSamplerParameteri (GLuint sampler_name, GLenum pname, GLint param)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   rsxgl_sampler_parameteri(current_ctx(),sampler_name,pname,param);
 }
 
 GLAPI void APIENTRY
 glSamplerParameteriv (GLuint sampler_name, GLenum pname, const GLint *param)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   rsxgl_sampler_parameteri(current_ctx(),sampler_name,pname,*param);
 }
 
 GLAPI void APIENTRY
 glSamplerParameterf (GLuint sampler_name, GLenum pname, GLfloat param)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   rsxgl_sampler_parameterf(current_ctx(),sampler_name,pname,param);
 }
 
 GLAPI void APIENTRY
 glSamplerParameterfv (GLuint sampler_name, GLenum pname, const GLfloat *param)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   rsxgl_sampler_parameterf(current_ctx(),sampler_name,pname,*param);
 }
 
 GLAPI void APIENTRY
 glGetSamplerParameteriv (GLuint sampler_name, GLenum pname, GLint *params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   uint32_t value = 0;
   rsxgl_get_sampler_parameteri(current_ctx(),sampler_name,pname,&value);
   *params = value;
@@ -599,6 +657,8 @@ glGetSamplerParameteriv (GLuint sampler_name, GLenum pname, GLint *params)
 GLAPI void APIENTRY
 glGetSamplerParameterfv (GLuint sampler_name, GLenum pname, GLfloat *params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   float value = 0;
   rsxgl_get_sampler_parameterf(current_ctx(),sampler_name,pname,&value);
   *params = value;
@@ -613,7 +673,8 @@ texture_t::texture_t()
   : deleted(0), timestamp(0), ref_count(0),
     invalid(0), invalid_complete(0),
     complete(0), immutable(0),
-    cube(0), rect(0), num_levels(0), dims(0), pformat(PIPE_FORMAT_NONE), format(0), pitch(0), remap(0)
+    cube(0), rect(0), num_levels(0), dims(0), pformat(PIPE_FORMAT_NONE), format(0), pitch(0), remap(0),
+    npot_size(0), size1(0), max_lod_limit(0)
 {
   swizzle.r = RSXGL_TEXTURE_SWIZZLE_FROM_R;
   swizzle.g = RSXGL_TEXTURE_SWIZZLE_FROM_G;
@@ -653,6 +714,8 @@ texture_t::level_t::~level_t()
 GLAPI void APIENTRY
 glGenTextures (GLsizei n, GLuint *textures)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   GLsizei count = texture_t::storage().create_names(n,textures);
 
   if(count != n) {
@@ -665,6 +728,8 @@ glGenTextures (GLsizei n, GLuint *textures)
 GLAPI void APIENTRY
 glDeleteTextures (GLsizei n, const GLuint *textures)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   struct rsxgl_context_t * ctx = current_ctx();
 
   for(GLsizei i = 0;i < n;++i,++textures) {
@@ -696,6 +761,8 @@ glDeleteTextures (GLsizei n, const GLuint *textures)
 GLAPI GLboolean APIENTRY
 glIsTexture (GLuint texture)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   return texture_t::storage().is_object(texture);
 }
 
@@ -703,7 +770,7 @@ GLAPI void APIENTRY
 glActiveTexture (GLenum texture)
 {
   texture_t::binding_type::size_type unit = (uint32_t)texture - (uint32_t)GL_TEXTURE0;
-  if(unit > RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
+  if(RSXGL_CHECK_ERRORS() && unit > RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
@@ -729,8 +796,11 @@ rsxgl_texture_target_dims(GLenum target)
   }
 }
 
+// Levels are laid out one after another with the same pitch; compressed formats store a row of
+// blocks per pitch:
 static inline uint32_t
-rsxgl_get_tex_level_offset_size(const texture_t::dimension_size_type _size[3],
+rsxgl_get_tex_level_offset_size(const pipe_format pformat,
+				const texture_t::dimension_size_type _size[3],
 				const uint32_t pitch,
 				const texture_t::level_size_type level,
 				texture_t::dimension_size_type * outsize)
@@ -739,7 +809,7 @@ rsxgl_get_tex_level_offset_size(const texture_t::dimension_size_type _size[3],
   uint32_t offset = 0;
 
   for(texture_t::level_size_type i = 1;i <= level;++i) {
-    offset += pitch * size[1] * size[2];
+    offset += pitch * util_format_get_nblocksy(pformat,size[1]) * size[2];
 
     for(int j = 0;j < 3;++j) {
       size[j] = std::max(size[j] >> 1,1);
@@ -769,6 +839,8 @@ rsxgl_util_format_translate_dma(rsxgl_context_t * ctx,
   const struct util_format_description *dst_format_desc = util_format_description(dst_format);
   const struct util_format_description *src_format_desc = util_format_description(src_format);
 
+  RSXGL_PERF_COUNT(ctx,texture_conversions,(dst_format != src_format) ? 1 : 0);
+
   util_format_translate(dst_format,dstaddress,dst_stride,dst_x,dst_y,
 			src_format,srcaddress,src_stride,src_x,src_y,
 			width,height);
@@ -824,6 +896,73 @@ rsxgl_util_format_translate_dma(rsxgl_context_t * ctx,
 #endif
 }
 
+// util_format_translate, except that compressed images can be decoded into uncompressed ones. x & y
+// are in texels, and the source starts at its first block:
+static inline void
+rsxgl_texture_translate(enum pipe_format dst_format,void * dstaddress,unsigned dst_stride,unsigned dst_x,unsigned dst_y,
+			enum pipe_format src_format,const void * srcaddress,unsigned src_stride,
+			unsigned width,unsigned height)
+{
+  RSXGL_PERF_COUNT(current_ctx(),texture_conversions,(dst_format != src_format) ? 1 : 0);
+
+  if(util_format_is_compressed(src_format) && !util_format_is_compressed(dst_format)) {
+    rsxgl_texture_decode(dst_format,dstaddress,dst_stride,dst_x,dst_y,
+			 src_format,srcaddress,src_stride,width,height);
+  }
+  else {
+    util_format_translate(dst_format,dstaddress,dst_stride,dst_x,dst_y,
+			  src_format,srcaddress,src_stride,0,0,
+			  width,height);
+  }
+}
+
+// Format of images given to glCompressedTexImage*():
+static inline pipe_format
+rsxgl_compressed_source_format(GLenum glinternalformat)
+{
+  switch(glinternalformat) {
+  case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    return PIPE_FORMAT_DXT1_RGB;
+  case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    return PIPE_FORMAT_DXT1_RGBA;
+  case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    return PIPE_FORMAT_DXT3_RGBA;
+  case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    return PIPE_FORMAT_DXT5_RGBA;
+  case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+    return PIPE_FORMAT_DXT1_SRGB;
+  case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+    return PIPE_FORMAT_DXT1_SRGBA;
+  case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+    return PIPE_FORMAT_DXT3_SRGBA;
+  case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+    return PIPE_FORMAT_DXT5_SRGBA;
+  case GL_COMPRESSED_RED_RGTC1:
+    return PIPE_FORMAT_RGTC1_UNORM;
+  case GL_COMPRESSED_RG_RGTC2:
+    return PIPE_FORMAT_RGTC2_UNORM;
+  default:
+    return PIPE_FORMAT_NONE;
+  }
+}
+
+// Uncompressed format that a compressed one is decoded into, when the GPU can't sample it:
+static inline pipe_format
+rsxgl_texture_decoded_format(rsxgl_context_t * ctx,pipe_format pformat)
+{
+  const GLenum glinternalformat =
+    (pformat == PIPE_FORMAT_RGTC1_UNORM) ? GL_R8 :
+    (pformat == PIPE_FORMAT_RGTC2_UNORM) ? GL_RG8 :
+    util_format_is_srgb(pformat) ? GL_SRGB8_ALPHA8 :
+    GL_RGBA8;
+
+  return rsxgl_choose_format(ctx -> screen(),
+			     glinternalformat,GL_NONE,GL_NONE,
+			     PIPE_TEXTURE_2D,
+			     1,
+			     PIPE_BIND_SAMPLER_VIEW);
+}
+
 bool
 rsxgl_texture_validate_complete(rsxgl_context_t * ctx,texture_t & texture)
 {
@@ -888,13 +1027,15 @@ rsxgl_texture_validate_complete(rsxgl_context_t * ctx,texture_t & texture)
 GLAPI void APIENTRY
 glBindTexture (GLenum target, GLuint texture_name)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   const uint8_t dims = rsxgl_texture_target_dims(target);
 
-  if(dims == 0) {
+  if(RSXGL_CHECK_ERRORS() && dims == 0) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  if(!(texture_name == 0 || texture_t::storage().is_name(texture_name))) {
+  if(RSXGL_CHECK_ERRORS() && !(texture_name == 0 || texture_t::storage().is_name(texture_name))) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
@@ -903,7 +1044,7 @@ glBindTexture (GLenum target, GLuint texture_name)
       texture_t::storage().create_object(texture_name);
       texture_t::storage().at(texture_name).dims = dims;
     }
-    else if(texture_t::storage().at(texture_name).dims != dims) {
+    else if(RSXGL_CHECK_ERRORS() && texture_t::storage().at(texture_name).dims != dims) {
       RSXGL_ERROR_(GL_INVALID_OPERATION);
     }
   }
@@ -1203,7 +1344,7 @@ void rsxgl_get_tex_level_parameter(GLenum target,GLint level,GLenum pname,T * pa
        pname == GL_TEXTURE_HEIGHT ||
        pname == GL_TEXTURE_DEPTH) {
       texture_t::dimension_size_type size[3] = { 1, 1, 1 };
-      rsxgl_get_tex_level_offset_size(texture.size,texture.pitch,level,size);
+      rsxgl_get_tex_level_offset_size(texture.pformat,texture.size,texture.pitch,level,size);
       
       if(pname == GL_TEXTURE_WIDTH) {
 	*params = size[0];
@@ -1241,10 +1382,17 @@ void rsxgl_get_tex_level_parameter(GLenum target,GLint level,GLenum pname,T * pa
       *params = rsxgl_get_format_depth_bit_depth(texture.pformat,0);
     }
     else if(pname == GL_TEXTURE_COMPRESSED) {
-      *params = 0;
+      *params = util_format_is_compressed(texture.pformat) ? GL_TRUE : GL_FALSE;
     }
     else if(pname == GL_TEXTURE_COMPRESSED_IMAGE_SIZE) {
-      *params = 0;
+      if(util_format_is_compressed(texture.pformat)) {
+	texture_t::dimension_size_type size[3] = { 1, 1, 1 };
+	rsxgl_get_tex_level_offset_size(texture.pformat,texture.size,texture.pitch,level,size);
+	*params = util_format_get_2d_size(texture.pformat,util_format_get_stride(texture.pformat,size[0]),size[1]) * size[2];
+      }
+      else {
+	RSXGL_ERROR_(GL_INVALID_OPERATION);
+      }
     }
   }
   else {
@@ -1257,6 +1405,8 @@ void rsxgl_get_tex_level_parameter(GLenum target,GLint level,GLenum pname,T * pa
 GLAPI void APIENTRY
 glTexParameterf (GLenum target, GLenum pname, GLfloat param)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_1D ||
        target == GL_TEXTURE_2D ||
        target == GL_TEXTURE_3D ||
@@ -1272,6 +1422,8 @@ glTexParameterf (GLenum target, GLenum pname, GLfloat param)
 GLAPI void APIENTRY
 glTexParameterfv (GLenum target, GLenum pname, const GLfloat *params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_1D ||
        target == GL_TEXTURE_2D ||
        target == GL_TEXTURE_3D ||
@@ -1287,6 +1439,8 @@ glTexParameterfv (GLenum target, GLenum pname, const GLfloat *params)
 GLAPI void APIENTRY
 glTexParameteri (GLenum target, GLenum pname, GLint param)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_1D ||
        target == GL_TEXTURE_2D ||
        target == GL_TEXTURE_3D ||
@@ -1302,6 +1456,8 @@ glTexParameteri (GLenum target, GLenum pname, GLint param)
 GLAPI void APIENTRY
 glTexParameteriv (GLenum target, GLenum pname, const GLint *params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_1D ||
        target == GL_TEXTURE_2D ||
        target == GL_TEXTURE_3D ||
@@ -1314,6 +1470,22 @@ glTexParameteriv (GLenum target, GLenum pname, const GLint *params)
   rsxgl_tex_parameteri(ctx,ctx -> texture_binding.names[ctx -> active_texture],pname,*params);
 }
 
+static inline uint32_t
+rsxgl_texture_storage_size(const texture_t & texture,const uint32_t pitch)
+{
+  uint32_t nbytes = 0;
+  texture_t::dimension_size_type size[3] = { texture.size[0], texture.size[1], texture.size[2] };
+  for(texture_t::level_size_type i = 0,n = texture.num_levels;i < n;++i) {
+    nbytes += pitch * util_format_get_nblocksy(texture.pformat,size[1]) * size[2];
+
+    for(int j = 0;j < 3;++j) {
+      size[j] = std::max(size[j] >> 1,1);
+    }
+  }
+
+  return nbytes;
+}
+
 static inline void
 rsxgl_texture_validate_storage(rsxgl_context_t * ctx,texture_t & texture)
 {
@@ -1326,17 +1498,12 @@ rsxgl_texture_validate_storage(rsxgl_context_t * ctx,texture_t & texture)
   const uint32_t pitch_tmp = util_format_get_stride(texture.pformat,texture.size[0]);
   const uint32_t pitch = texture.dims > 1 ? align_pot< uint32_t, 64 >(pitch_tmp) : pitch_tmp;
 
-  uint32_t nbytes = 0;
-  texture_t::dimension_size_type size[3] = { texture.size[0], texture.size[1], texture.size[2] };
-  for(texture_t::level_size_type i = 0,n = texture.num_levels;i < n;++i) {
-    nbytes += pitch * size[1] * size[2];
-
-    for(int j = 0;j < 3;++j) {
-      size[j] = std::max(size[j] >> 1,1);
-    }
-  }
+  const uint32_t nbytes = rsxgl_texture_storage_size(texture,pitch);
 
   texture.memory = rsxgl_arena_allocate(memory_arena_t::storage().at(texture.arena),128,nbytes,0);
+  if(!texture.memory && rsxgl_deferred_free_reclaim(ctx)) {
+    texture.memory = rsxgl_arena_allocate(memory_arena_t::storage().at(texture.arena),128,nbytes,0);
+  }
   texture.memory.owner = true;
 
   if(texture.memory) {
@@ -1369,19 +1536,28 @@ rsxgl_texture_validate_storage(rsxgl_context_t * ctx,texture_t & texture)
     
     texture.remap = nvfx_get_texture_remap(pfmt,
 					   texture.swizzle.r,texture.swizzle.g,texture.swizzle.b,texture.swizzle.a);
+
+    texture.npot_size = ((uint32_t)texture.size[0] << NV30_3D_TEX_NPOT_SIZE_W__SHIFT) | (uint32_t)texture.size[1];
+    texture.size1 = ((uint32_t)texture.size[2] << NV40_3D_TEX_SIZE1_DEPTH__SHIFT) | pitch;
+    texture.max_lod_limit = (uint16_t)((texture.num_levels - 1) * 256);
   }
 }
 
+// Storage is freed through the deferred free queue, in case another thread is writing to it with
+// the object context unlocked; otherwise it's freed right away:
 static inline void
-rsxgl_texture_reset_storage(texture_t & texture)
+rsxgl_texture_reset_storage(rsxgl_context_t * ctx,texture_t & texture)
 {
   if(texture.memory && texture.memory.owner) {
-    rsxgl_arena_free(memory_arena_t::storage().at(texture.arena),texture.memory);
+    rsxgl_deferred_free_arena(ctx,0,texture.arena,texture.memory,rsxgl_texture_storage_size(texture,texture.pitch));
   }
   
   texture.format = 0;
   texture.pitch = 0;
   texture.remap = 0;
+  texture.npot_size = 0;
+  texture.size1 = 0;
+  texture.max_lod_limit = 0;
   texture.memory = memory_t();
 }
 
@@ -1397,40 +1573,65 @@ rsxgl_texture_level_format(texture_t::level_t & level,uint8_t dims,pipe_format p
   level.pitch = util_format_get_stride(pformat,width);
 }
 
-static inline void
-rsxgl_texture_level_validate_storage(texture_t::level_t & level)
+static inline size_t
+rsxgl_texture_level_storage_size(const texture_t::level_t & level)
 {
-  rsxgl_assert(!level.memory);
-  rsxgl_assert(level.dims != 0);
-  rsxgl_assert(level.pformat != PIPE_FORMAT_NONE);
-
-  const size_t nbytes = util_format_get_2d_size(level.pformat,level.pitch,level.size[1]) * level.size[2];
+  return util_format_get_2d_size(level.pformat,level.pitch,level.size[1]) * level.size[2];
+}
 
+// Allocate memory for a level's image. memory_ptr is set if a separate migration buffer had to be
+// allocated for it. Returns the memory's address:
+static inline void *
+rsxgl_texture_level_allocate_storage(rsxgl_context_t * ctx,const size_t nbytes,memory_t & memory,void *& memory_ptr)
+{
   void * ptr = rsxgl_texture_migrate_memalign(16,nbytes);
+  if (ptr == 0 && rsxgl_deferred_free_reclaim(ctx))
+    ptr = rsxgl_texture_migrate_memalign(16,nbytes);
 
   if (ptr) {
-    level.memory.location = RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION;
-    level.memory.offset = rsxgl_texture_migrate_offset(ptr);
-    level.memory.owner = 1;
+    memory.location = RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION;
+    memory.offset = rsxgl_texture_migrate_offset(ptr);
+    memory.owner = 1;
+    memory_ptr = NULL;
   } else {
     uint32_t offset;
-    void * ptr = rsxgl_texture_migrate_buffer_new(RSXGL_TEXTURE_MIGRATE_BUFFER_ALIGN, nbytes, &offset);
+    ptr = rsxgl_texture_migrate_buffer_new(RSXGL_TEXTURE_MIGRATE_BUFFER_ALIGN, nbytes, &offset);
 
-    level.memory.location = RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION;
-    level.memory_ptr = ptr;
-    level.memory.offset = offset;
-    level.memory.owner = 1;
+    memory.location = RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION;
+    memory_ptr = ptr;
+    memory.offset = offset;
+    memory.owner = 1;
   }
+
+  return ptr;
+}
+
+// Free memory allocated by rsxgl_texture_level_allocate_storage() once the GPU passes timestamp:
+static inline void
+rsxgl_texture_level_free_storage(rsxgl_context_t * ctx,const memory_t & memory,void * memory_ptr,const size_t nbytes,const uint32_t timestamp)
+{
+  if (memory_ptr)
+    rsxgl_deferred_free_migrate_buffer(ctx,timestamp,memory_ptr,nbytes);
+  else
+    rsxgl_deferred_free_migrate(ctx,timestamp,rsxgl_texture_migrate_address(memory.offset),nbytes);
+}
+
+static inline void
+rsxgl_texture_level_validate_storage(rsxgl_context_t * ctx,texture_t::level_t & level)
+{
+  rsxgl_assert(!level.memory);
+  rsxgl_assert(level.dims != 0);
+  rsxgl_assert(level.pformat != PIPE_FORMAT_NONE);
+
+  rsxgl_texture_level_allocate_storage(ctx,rsxgl_texture_level_storage_size(level),level.memory,level.memory_ptr);
 }
 
+// As with the texture's storage, a level's memory goes through the deferred free queue:
 static inline void
-rsxgl_texture_level_reset_storage(texture_t::level_t & level)
+rsxgl_texture_level_reset_storage(rsxgl_context_t * ctx,texture_t::level_t & level)
 {
   if(level.memory.owner && level.memory) {
-    if (level.memory_ptr)
-      rsxgl_texture_migrate_buffer_free(level.memory_ptr);
-    else
-      rsxgl_texture_migrate_free(rsxgl_texture_migrate_address(level.memory.offset));
+    rsxgl_texture_level_free_storage(ctx,level.memory,level.memory_ptr,rsxgl_texture_level_storage_size(level),0);
   }
   
   level.pformat = PIPE_FORMAT_NONE;
@@ -1442,6 +1643,52 @@ rsxgl_texture_level_reset_storage(texture_t::level_t & level)
   level.memory_ptr = NULL;
 }
 
+// Once a level has been migrated into the texture's storage, its own memory is freed after the
+// GPU passes timestamp. The level keeps its format & size:
+static inline void
+rsxgl_texture_level_retire_storage(rsxgl_context_t * ctx,texture_t::level_t & level,const uint32_t timestamp)
+{
+  rsxgl_assert(level.memory.owner && level.memory);
+
+  rsxgl_texture_level_free_storage(ctx,level.memory,level.memory_ptr,rsxgl_texture_level_storage_size(level),timestamp);
+
+  level.memory = memory_t();
+  level.memory_ptr = NULL;
+}
+
+// Copy levels whose memory was retired back out of the texture's storage, before the texture is
+// respecified and migrated again. skip_level is the level being respecified, whose contents are
+// about to be replaced. The GPU must be done writing to the texture:
+static inline void
+rsxgl_texture_levels_restore_storage(rsxgl_context_t * ctx,texture_t & texture,const GLint skip_level)
+{
+  if(!texture.memory || texture.invalid) return;
+
+  const uint8_t * srcaddress = (const uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(texture.arena),texture.memory);
+
+  texture_t::level_t * plevel = texture.levels;
+  for(texture_t::level_size_type i = 0,n = texture.num_levels;i < n;++i,++plevel) {
+    if((GLint)i == skip_level || plevel -> memory || plevel -> pformat == PIPE_FORMAT_NONE) continue;
+
+    texture_t::dimension_size_type size[3] = { 0,0,0 };
+    const uint32_t srcoffset = rsxgl_get_tex_level_offset_size(texture.pformat,texture.size,texture.pitch,i,size);
+
+    rsxgl_texture_level_validate_storage(ctx,*plevel);
+
+    uint8_t * dstaddress = (uint8_t *)((plevel -> memory_ptr != NULL) ? plevel -> memory_ptr : rsxgl_texture_migrate_address(plevel -> memory.offset));
+
+    const uint32_t
+      width = std::min(size[0],plevel -> size[0]), height = std::min(size[1],plevel -> size[1]), depth = std::min(size[2],plevel -> size[2]),
+      srcslice = texture.pitch * util_format_get_nblocksy(texture.pformat,size[1]), dstslice = util_format_get_2d_size(plevel -> pformat,plevel -> pitch,plevel -> size[1]);
+
+    for(uint32_t z = 0;z < depth;++z) {
+      util_format_translate(plevel -> pformat,dstaddress + (z * dstslice),plevel -> pitch,0,0,
+			    texture.pformat,srcaddress + srcoffset + (z * srcslice),texture.pitch,0,0,
+			    width,height);
+    }
+  }
+}
+
 static inline void
 rsxgl_tex_storage(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cube,bool rect,GLsizei levels,GLint glinternalformat,GLsizei width,GLsizei height,GLsizei depth)
 {
@@ -1469,7 +1716,7 @@ rsxgl_tex_storage(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cu
 
 #if 0
   // TODO: Orphan the texture
-  if(texture.timestamp != 0 && (!rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,texture.timestamp))) {
+  if(texture.timestamp != 0 && (!rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,ctx -> next_timestamp,texture.timestamp))) {
   }
 #else
   if(texture.timestamp > 0) {
@@ -1478,9 +1725,9 @@ rsxgl_tex_storage(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cu
   }
 #endif
 
-  rsxgl_texture_reset_storage(texture);
+  rsxgl_texture_reset_storage(ctx,texture);
   for(size_t i = 0;i < texture_t::max_levels;++i) {
-    rsxgl_texture_level_reset_storage(texture.levels[i]);
+    rsxgl_texture_level_reset_storage(ctx,texture.levels[i]);
   }
 
   texture.invalid = 0;
@@ -1489,14 +1736,19 @@ rsxgl_tex_storage(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cu
 
   ctx -> invalid_textures |= texture.binding_bitfield;
 
-  const pipe_format pformat = rsxgl_choose_format(ctx -> screen(),
-						  glinternalformat,GL_NONE,GL_NONE,
-						  (dims == 1) ? PIPE_TEXTURE_1D :
-						  (dims == 2) ? (cube ? PIPE_TEXTURE_CUBE : (rect ? PIPE_TEXTURE_RECT : PIPE_TEXTURE_2D)) :
-						  (dims == 3) ? PIPE_TEXTURE_2D :
-						  PIPE_MAX_TEXTURE_TYPES,
-						  1,
-						  PIPE_BIND_SAMPLER_VIEW);
+  pipe_format pformat = rsxgl_choose_format(ctx -> screen(),
+					    glinternalformat,GL_NONE,GL_NONE,
+					    (dims == 1) ? PIPE_TEXTURE_1D :
+					    (dims == 2) ? (cube ? PIPE_TEXTURE_CUBE : (rect ? PIPE_TEXTURE_RECT : PIPE_TEXTURE_2D)) :
+					    (dims == 3) ? PIPE_TEXTURE_2D :
+					    PIPE_MAX_TEXTURE_TYPES,
+					    1,
+					    PIPE_BIND_SAMPLER_VIEW);
+
+  // 3D textures can't be sampled compressed; compressed images will be decoded instead:
+  if(dims == 3 && util_format_is_compressed(pformat)) {
+    pformat = rsxgl_texture_decoded_format(ctx,pformat);
+  }
 
   if(pformat == PIPE_FORMAT_NONE) {
     texture.complete = 0;
@@ -1530,9 +1782,58 @@ rsxgl_tex_storage(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cu
   }
 }
 
+// A texture is referenced while the object context is unlocked, in case another thread deletes it
+// meanwhile; the default texture can't be. rsxgl_texture_unref() returns false if the texture is
+// gone:
+static inline void
+rsxgl_texture_ref(const texture_t::name_type texture_name)
+{
+  if(texture_name != 0) texture_t::gl_object_type::ref(texture_name);
+}
+
+static inline bool
+rsxgl_texture_unref(const texture_t::name_type texture_name)
+{
+  if(texture_name == 0) return true;
+
+  const texture_t & texture = texture_t::storage().at(texture_name);
+  const bool destroyed = texture.deleted && texture.ref_count == 1;
+
+  texture_t::gl_object_type::unref_and_maybe_delete(texture_name);
+
+  return !destroyed;
+}
+
+// Wait for the GPU to finish with a texture before the CPU writes to it, letting other threads
+// use the shared objects meanwhile. Returns false if the texture was deleted in the meantime:
+static inline bool
+rsxgl_texture_wait(rsxgl_context_t * ctx,rsxgl_object_context_lock_t & lock,const texture_t::name_type texture_name)
+{
+  const uint32_t timestamp = texture_t::storage().at(texture_name).timestamp;
+  if(timestamp == 0) return true;
+
+  rsxgl_texture_ref(texture_name);
+  rsxgl_timestamp_wait(ctx,lock,timestamp);
+
+  texture_t & texture = texture_t::storage().at(texture_name);
+  if(texture.timestamp == timestamp) {
+    texture.timestamp = 0;
+  }
+
+  return rsxgl_texture_unref(texture_name);
+}
+
+// psrcformat is the format of a compressed image that will be uploaded to the level, or
+// PIPE_FORMAT_NONE. If in_place is given, and the level keeps the format & size that it was
+// migrated with, the texture's storage is kept and *in_place is set - the caller writes the
+// image over the level's part of the storage, as glTexSubImage* would. Returns false without an
+// error if the texture was deleted while this waited for the GPU:
 static inline bool
-rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cube,bool rect,GLint _level,GLint glinternalformat,GLsizei width,GLsizei height,GLsizei depth)
+rsxgl_tex_image_format(rsxgl_context_t * ctx,rsxgl_object_context_lock_t & lock,const texture_t::name_type texture_name,uint8_t dims,bool cube,bool rect,GLint _level,GLint glinternalformat,GLsizei width,GLsizei height,GLsizei depth,
+		       pipe_format psrcformat,bool * in_place = 0)
 {
+  texture_t & texture = texture_t::storage().at(texture_name);
+
   rsxgl_assert(dims > 0);
   rsxgl_assert(width > 0);
   rsxgl_assert(height > 0);
@@ -1547,16 +1848,38 @@ rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bo
     RSXGL_ERROR(GL_INVALID_VALUE,false);
   }
 
-  const pipe_format pdstformat = (texture.levels[0].pformat != PIPE_FORMAT_NONE) ?
-    texture.levels[0].pformat :
-    rsxgl_choose_format(ctx -> screen(),
-			glinternalformat,GL_NONE,GL_NONE,
-			(dims == 1) ? PIPE_TEXTURE_1D :
-			(dims == 2) ? (cube ? PIPE_TEXTURE_CUBE : (rect ? PIPE_TEXTURE_RECT : PIPE_TEXTURE_2D)) :
-			(dims == 3) ? PIPE_TEXTURE_2D :
-			PIPE_MAX_TEXTURE_TYPES,
-			1,
-			PIPE_BIND_SAMPLER_VIEW);
+  const enum pipe_texture_target ptarget =
+    (dims == 1) ? PIPE_TEXTURE_1D :
+    (dims == 2) ? (cube ? PIPE_TEXTURE_CUBE : (rect ? PIPE_TEXTURE_RECT : PIPE_TEXTURE_2D)) :
+    (dims == 3) ? PIPE_TEXTURE_2D :
+    PIPE_MAX_TEXTURE_TYPES;
+
+  pipe_format pdstformat = texture.levels[0].pformat;
+
+  if(pdstformat != PIPE_FORMAT_NONE) {
+    // Compressed levels can only be given images in the same format:
+    if(util_format_is_compressed(pdstformat) && psrcformat != pdstformat) {
+      RSXGL_ERROR(GL_INVALID_OPERATION,false);
+    }
+  }
+  else if(psrcformat != PIPE_FORMAT_NONE) {
+    // Compressed images are stored as they are, if the GPU can sample them; 3D textures can't be:
+    pdstformat = (dims < 3 && ctx -> screen() -> is_format_supported(ctx -> screen(),psrcformat,ptarget,1,PIPE_BIND_SAMPLER_VIEW)) ?
+      psrcformat :
+      rsxgl_texture_decoded_format(ctx,psrcformat);
+  }
+  else {
+    pdstformat = rsxgl_choose_format(ctx -> screen(),
+				     glinternalformat,GL_NONE,GL_NONE,
+				     ptarget,
+				     1,
+				     PIPE_BIND_SAMPLER_VIEW);
+
+    // There's no compressor, so uncompressed images are stored uncompressed:
+    if(util_format_is_compressed(pdstformat)) {
+      pdstformat = rsxgl_texture_decoded_format(ctx,pdstformat);
+    }
+  }
 
   if(pdstformat == PIPE_FORMAT_NONE) {
     RSXGL_ERROR(GL_INVALID_VALUE,false);
@@ -1567,18 +1890,32 @@ rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bo
     RSXGL_ERROR(GL_INVALID_VALUE,false);
   }
 
+  texture_t::level_t & level = texture.levels[_level];
+
+  // The storage's layout doesn't change, so neither the texture nor its other levels need to be
+  // touched:
+  if(in_place != 0 && texture.memory && !texture.invalid && (texture_t::level_size_type)_level < texture.num_levels &&
+     level.dims == dims && level.pformat == pdstformat && level.size[0] == width && level.size[1] == height && level.size[2] == depth) {
+    *in_place = true;
+    RSXGL_NOERROR(true);
+  }
+
 #if 0
   // TODO: Orphan the texture
-  if(texture.timestamp != 0 && (!rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,texture.timestamp))) {
+  if(texture.timestamp != 0 && (!rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,ctx -> next_timestamp,texture.timestamp))) {
     texture.timestamp = 0;
   }
 #else
+  // Another thread may change the texture during the wait, so it's looked at afresh afterwards:
   if(texture.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,texture.timestamp);
-    texture.timestamp = 0;
+    if(!rsxgl_texture_wait(ctx,lock,texture_name)) RSXGL_NOERROR(false);
+    return rsxgl_tex_image_format(ctx,lock,texture_name,dims,cube,rect,_level,glinternalformat,width,height,depth,psrcformat,in_place);
   }
 #endif
 
+  // The texture will be migrated again, from its levels:
+  rsxgl_texture_levels_restore_storage(ctx,texture,_level);
+
   // set the texture's invalid & allocated bits:
   texture.invalid = 1;
   texture.invalid_complete = 1;
@@ -1586,10 +1923,8 @@ rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bo
   texture.arena = ctx -> arena_binding.names[RSXGL_TEXTURE_ARENA];
 
   // set the mipmap level data:
-  texture_t::level_t & level = texture.levels[_level];
-
   if(level.pformat != pdstformat || level.size[0] != width || level.size[1] != height || level.size[2] != depth) {
-    rsxgl_texture_level_reset_storage(level);
+    rsxgl_texture_level_reset_storage(ctx,level);
     rsxgl_texture_level_format(level,dims,pdstformat,width,height,depth);
   }
 
@@ -1615,19 +1950,13 @@ rsxgl_tex_subimage_init(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
     RSXGL_ERROR(GL_INVALID_VALUE,false);
   }
 
-  // TODO: Asynchronous updating:
-  if(texture.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,texture.timestamp);
-    texture.timestamp = 0;
-  }
-
   texture_t::dimension_size_type size[3] = { 0,0,0 };
   *pdstformat = PIPE_FORMAT_NONE;
   *dstpitch = 0;
 
   // the texture's storage is allocated (either by rsxgl_tex_storage, or by having previously validated a texture specified with rsxgl_tex_image)
   if(texture.memory) {
-    const uint32_t offset = rsxgl_get_tex_level_offset_size(texture.size,texture.pitch,_level,size);
+    const uint32_t offset = rsxgl_get_tex_level_offset_size(texture.pformat,texture.size,texture.pitch,_level,size);
 
     *pdstformat = texture.pformat;
     *dstpitch = texture.pitch;
@@ -1640,7 +1969,7 @@ rsxgl_tex_subimage_init(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
     texture_t::level_t & level = texture.levels[_level];
 
     if(!level.memory) {
-      rsxgl_texture_level_validate_storage(level);
+      rsxgl_texture_level_validate_storage(ctx,level);
     }
 
     size[0] = level.size[0];
@@ -1671,78 +2000,93 @@ rsxgl_tex_subimage_init(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
   RSXGL_NOERROR(true);
 }
 
-static inline uint32_t
-rsxgl_pixel_store_aligned(const pixel_store_t & store,uint32_t value)
+// Wait for the GPU to finish with a texture before the CPU writes to it:
+static inline void
+rsxgl_tex_subimage_wait(rsxgl_context_t * ctx,texture_t & texture)
 {
-  switch(store.alignment) {
-  case RSXGL_PIXEL_STORE_ALIGNMENT_1:
-    return value;
-  case RSXGL_PIXEL_STORE_ALIGNMENT_2:
-    return align_pot< uint32_t, 2 >(value);
-  case RSXGL_PIXEL_STORE_ALIGNMENT_4:
-    return align_pot< uint32_t, 4 >(value);
-  case RSXGL_PIXEL_STORE_ALIGNMENT_8:
-    return align_pot< uint32_t, 8 >(value);
-  default:
-    return value;
+  if(texture.timestamp > 0) {
+    rsxgl_timestamp_wait(ctx,texture.timestamp);
+    texture.timestamp = 0;
   }
 }
 
-static inline void
-rsxgl_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cube,bool rect,GLint _level,GLint glinternalformat,GLsizei width,GLsizei height,GLsizei depth,
-		GLenum format,GLenum type,const GLvoid * data)
+// Write texels into the staging ring, and have the GPU copy them into a texture that it's still
+// using once it's done with it. Returns false if the update can't be staged:
+static inline bool
+rsxgl_tex_subimage_staged(rsxgl_context_t * ctx,texture_t & texture,GLint x,GLint y,GLsizei width,GLsizei height,
+			  pipe_format pdstformat,uint32_t dstpitch,const memory_t & dstmem,
+			  pipe_format psrcformat,const void * data,uint32_t srcpitch)
 {
-  const bool result = rsxgl_tex_image_format(ctx,texture,dims,cube,rect,_level,glinternalformat,width,height,depth);
+  // Commands recorded into a command list execute later, if ever:
+  if(!ctx -> can_emit() || ctx -> command_list_recorder != 0) return false;
 
-  if(result) {
-    const pipe_format psrcformat = rsxgl_choose_source_format(format,type);
+  const struct util_format_description * desc = util_format_description(pdstformat);
+  if((x % desc -> block.width) != 0 || (y % desc -> block.height) != 0) return false;
 
-    if(psrcformat == PIPE_FORMAT_NONE) {
-      RSXGL_ERROR_(GL_INVALID_VALUE);
-    }
+  // Limits of the memory-to-memory transfer:
+  const uint32_t stagingpitch = util_format_get_stride(pdstformat,width);
+  if(stagingpitch > 0x7fff || dstpitch > 0x7fff) return false;
 
-    const pixel_store_t unpack = ctx -> state.pixelstore_unpack;
-    const uint32_t srcpitch = rsxgl_pixel_store_aligned(unpack,util_format_get_stride(psrcformat,unpack.row_length ? unpack.row_length : width));
-    const uint32_t srcoffset = (srcpitch * unpack.skip_rows) + (util_format_get_stride(psrcformat,1) * unpack.skip_pixels);
+  const uint32_t nrows = util_format_get_nblocksy(pdstformat,height);
 
-    texture_t::level_t & level = texture.levels[_level];
+  memory_t stagingmem;
+  void * stagingaddress = rsxgl_texture_staging_allocate(ctx,stagingpitch * nrows,&stagingmem);
+  if(stagingaddress == 0) return false;
 
-    if(!level.memory) {
-      rsxgl_texture_level_validate_storage(level);
-    }
-    void *memory_ptr = level.memory_ptr;
-    if (memory_ptr == NULL)
-      memory_ptr = rsxgl_texture_migrate_address(level.memory.offset);
+  rsxgl_texture_translate(pdstformat,stagingaddress,stagingpitch,0,0,
+			  psrcformat,data,srcpitch,width,height);
 
-    if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0 ||
-       data != 0) {
-      rsxgl_assert(level.memory);
+  const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+  gcmContextData * context = ctx -> gcm_context();
 
-      if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0) {
-	const buffer_t & srcbuffer = ctx -> buffer_binding[RSXGL_PIXEL_UNPACK_BUFFER];
-	const memory_t & srcmem = srcbuffer.memory + rsxgl_pointer_to_offset(data);
+  // Let draws that read the old texels finish first:
+  {
+    uint32_t * buffer = gcm_reserve(context,2);
+    gcm_emit_wait_for_idle_at(buffer,0,1);
+    gcm_emit_at(buffer,1,0);
+    gcm_finish_n_commands(context,2);
+  }
 
-	rsxgl_util_format_translate_dma(ctx,
-					level.pformat,
-					memory_ptr,level.memory,level.pitch,0,0,
-					psrcformat,
-					rsxgl_arena_address(memory_arena_t::storage().at(srcbuffer.arena),srcmem),srcmem,srcpitch,0,0,
-					width,height);
-      }
-      else if(data != 0) {
-        data = (const uint8_t *)data + srcoffset;
-	util_format_translate(level.pformat,memory_ptr,level.pitch,0,0,
-			      psrcformat,data,srcpitch,0,0,width,height);
-      }
-    }
+  const memory_t dst = dstmem + ((y / desc -> block.height) * dstpitch) + ((x / desc -> block.width) * util_format_get_blocksize(pdstformat));
+  for(uint32_t row = 0;row < nrows;row += 2047) {
+    const uint32_t n = std::min(nrows - row,(uint32_t)2047);
+    rsxgl_memory_transfer(context,
+			  dst + (row * dstpitch),dstpitch,1,
+			  stagingmem + (row * stagingpitch),stagingpitch,1,
+			  stagingpitch,n);
+  }
+
+  rsxgl_timestamp_post(ctx,timestamp);
+  rsxgl_texture_staging_commit(timestamp);
 
+  texture.timestamp = timestamp;
+
+  return true;
+}
+
+static inline uint32_t
+rsxgl_pixel_store_aligned(const pixel_store_t & store,uint32_t value)
+{
+  switch(store.alignment) {
+  case RSXGL_PIXEL_STORE_ALIGNMENT_1:
+    return value;
+  case RSXGL_PIXEL_STORE_ALIGNMENT_2:
+    return align_pot< uint32_t, 2 >(value);
+  case RSXGL_PIXEL_STORE_ALIGNMENT_4:
+    return align_pot< uint32_t, 4 >(value);
+  case RSXGL_PIXEL_STORE_ALIGNMENT_8:
+    return align_pot< uint32_t, 8 >(value);
+  default:
+    return value;
   }
 }
 
 static inline void
-rsxgl_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint x,GLint y,GLint z,GLsizei width,GLsizei height,GLsizei depth,
+rsxgl_tex_subimage(rsxgl_context_t * ctx,rsxgl_object_context_lock_t & lock,const texture_t::name_type texture_name,GLint _level,GLint x,GLint y,GLint z,GLsizei width,GLsizei height,GLsizei depth,
 		   GLenum format,GLenum type,const GLvoid * data)
 {
+  texture_t & texture = texture_t::storage().at(texture_name);
+
   pipe_format pdstformat = PIPE_FORMAT_NONE;
   uint32_t dstpitch = 0;
   void * dstaddress = 0;
@@ -1757,6 +2101,11 @@ rsxgl_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint
       RSXGL_ERROR_(GL_INVALID_ENUM);
     }
 
+    // There's no compressor:
+    if(util_format_is_compressed(pdstformat)) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
     rsxgl_assert(dstaddress != 0);
     rsxgl_assert(dstmem);
     
@@ -1765,6 +2114,21 @@ rsxgl_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint
     const uint32_t srcpitch = rsxgl_pixel_store_aligned(unpack,util_format_get_stride(psrcformat,unpack.row_length ? unpack.row_length : width));
     const uint32_t srcoffset = (srcpitch * unpack.skip_rows) + (util_format_get_stride(psrcformat,1) * unpack.skip_pixels);
 
+    // The GPU is still using the texture - rather than wait, stage the update. Only the texture's
+    // own storage is written this way, since levels are migrated into it by the CPU:
+    if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] == 0 && data != 0 && depth == 1 && z == 0 && texture.memory &&
+       texture.timestamp > 0 && !rsxgl_timestamp_passed(ctx,texture.timestamp) &&
+       rsxgl_tex_subimage_staged(ctx,texture,x,y,width,height,pdstformat,dstpitch,dstmem,psrcformat,(const uint8_t *)data + srcoffset,srcpitch)) {
+      RSXGL_NOERROR_();
+    }
+
+    // Another thread may move the texture's storage during the wait, so start over afterwards:
+    if(texture.timestamp > 0) {
+      if(!rsxgl_texture_wait(ctx,lock,texture_name)) RSXGL_NOERROR_();
+      rsxgl_tex_subimage(ctx,lock,texture_name,_level,x,y,z,width,height,depth,format,type,data);
+      return;
+    }
+
     if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0) {
       const buffer_t & srcbuffer = ctx -> buffer_binding[RSXGL_PIXEL_UNPACK_BUFFER];
       const memory_t & srcmem = srcbuffer.memory + rsxgl_pointer_to_offset(data);
@@ -1779,8 +2143,20 @@ rsxgl_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint
     else if(data) {
       rsxgl_assert(dstaddress != 0);
       data = (const uint8_t *)data + srcoffset;
+      RSXGL_PERF_COUNT(ctx,texture_conversions,(pdstformat != psrcformat) ? 1 : 0);
+
+      // Convert without the lock. The storage isn't freed in the meantime, even if another thread
+      // respecifies the texture or migrates its levels:
+      rsxgl_texture_ref(texture_name);
+      rsxgl_deferred_free_hold(ctx);
+      lock.unlock();
+
       util_format_translate(pdstformat,dstaddress,dstpitch,x,y,
 			    psrcformat,data,srcpitch,0,0,width,height);
+
+      lock.relock(ctx);
+      rsxgl_deferred_free_unhold(ctx);
+      rsxgl_texture_unref(texture_name);
     }
 
     RSXGL_NOERROR_();
@@ -1788,24 +2164,139 @@ rsxgl_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint
 }
 
 static inline void
-rsxgl_copy_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cube,bool rect,GLint _level,GLint glinternalformat,GLint x,GLint y,GLsizei width,GLsizei height)
+rsxgl_tex_image(rsxgl_context_t * ctx,rsxgl_object_context_lock_t & lock,const texture_t::name_type texture_name,uint8_t dims,bool cube,bool rect,GLint _level,GLint glinternalformat,GLsizei width,GLsizei height,GLsizei depth,
+		GLenum format,GLenum type,const GLvoid * data)
 {
-  const bool result = rsxgl_tex_image_format(ctx,texture,dims,cube,rect,_level,glinternalformat,width,height,1);
+  bool in_place = false;
+  const bool result = rsxgl_tex_image_format(ctx,lock,texture_name,dims,cube,rect,_level,glinternalformat,width,height,depth,PIPE_FORMAT_NONE,&in_place);
 
-  if(result) {
-    const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
-    
-    framebuffer_t & framebuffer = ctx -> framebuffer_binding[RSXGL_READ_FRAMEBUFFER];
-    rsxgl_framebuffer_validate(ctx,framebuffer,timestamp);
+  if(result && in_place) {
+    // Without an image, the level's contents are undefined - what was there will do:
+    if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0 || data != 0) {
+      rsxgl_tex_subimage(ctx,lock,texture_name,_level,0,0,0,width,height,depth,format,type,data);
+    }
+    else {
+      RSXGL_NOERROR_();
+    }
+  }
+  else if(result) {
+    const pipe_format psrcformat = rsxgl_choose_source_format(format,type);
 
-    if(framebuffer.color_pformat != PIPE_FORMAT_NONE && framebuffer.read_surface.memory) {
-      texture_t::level_t & level = texture.levels[_level];
-      if(!level.memory) {
-	rsxgl_texture_level_validate_storage(level);
-      }
-      void *memory_ptr = level.memory_ptr;
-      if (memory_ptr == NULL)
-        memory_ptr = rsxgl_texture_migrate_address(level.memory.offset);
+    if(psrcformat == PIPE_FORMAT_NONE) {
+      RSXGL_ERROR_(GL_INVALID_VALUE);
+    }
+
+    const pixel_store_t unpack = ctx -> state.pixelstore_unpack;
+    const uint32_t srcpitch = rsxgl_pixel_store_aligned(unpack,util_format_get_stride(psrcformat,unpack.row_length ? unpack.row_length : width));
+    const uint32_t srcoffset = (srcpitch * unpack.skip_rows) + (util_format_get_stride(psrcformat,1) * unpack.skip_pixels);
+
+    // Convert the image into new memory without the lock, then give the memory to the level:
+    if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] == 0 && data != 0) {
+      const texture_t::level_t & image = texture_t::storage().at(texture_name).levels[_level];
+      const pipe_format pdstformat = image.pformat;
+      const uint32_t dstpitch = image.pitch;
+      const texture_t::dimension_size_type size[3] = { image.size[0], image.size[1], image.size[2] };
+      const size_t nbytes = rsxgl_texture_level_storage_size(image);
+
+      memory_t memory;
+      void * memory_ptr = NULL;
+      void * address = rsxgl_texture_level_allocate_storage(ctx,nbytes,memory,memory_ptr);
+
+      data = (const uint8_t *)data + srcoffset;
+      RSXGL_PERF_COUNT(ctx,texture_conversions,(pdstformat != psrcformat) ? 1 : 0);
+
+      rsxgl_texture_ref(texture_name);
+      lock.unlock();
+
+      util_format_translate(pdstformat,address,dstpitch,0,0,
+			    psrcformat,data,srcpitch,0,0,width,height);
+
+      lock.relock(ctx);
+
+      if(!rsxgl_texture_unref(texture_name)) {
+	rsxgl_texture_level_free_storage(ctx,memory,memory_ptr,nbytes,0);
+	RSXGL_NOERROR_();
+      }
+
+      texture_t & texture = texture_t::storage().at(texture_name);
+      texture_t::level_t & level = texture.levels[_level];
+
+      // Another thread respecified the level in the meantime:
+      if(level.pformat != pdstformat || level.size[0] != size[0] || level.size[1] != size[1] || level.size[2] != size[2]) {
+	rsxgl_texture_level_free_storage(ctx,memory,memory_ptr,nbytes,0);
+	RSXGL_NOERROR_();
+      }
+
+      // Or drew with the texture, migrating its levels into its storage; undo that as
+      // rsxgl_tex_image_format() did:
+      if(texture.memory && !texture.invalid) {
+	rsxgl_tex_subimage_wait(ctx,texture);
+	rsxgl_texture_levels_restore_storage(ctx,texture,_level);
+
+	texture.invalid = 1;
+	texture.invalid_complete = 1;
+	texture.complete = 0;
+	ctx -> invalid_textures |= texture.binding_bitfield;
+      }
+
+      if(level.memory.owner && level.memory) {
+	rsxgl_texture_level_free_storage(ctx,level.memory,level.memory_ptr,nbytes,0);
+      }
+      level.memory = memory;
+      level.memory_ptr = memory_ptr;
+
+      RSXGL_NOERROR_();
+    }
+
+    texture_t::level_t & level = texture_t::storage().at(texture_name).levels[_level];
+
+    if(!level.memory) {
+      rsxgl_texture_level_validate_storage(ctx,level);
+    }
+    void *memory_ptr = level.memory_ptr;
+    if (memory_ptr == NULL)
+      memory_ptr = rsxgl_texture_migrate_address(level.memory.offset);
+
+    if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0) {
+      rsxgl_assert(level.memory);
+
+      const buffer_t & srcbuffer = ctx -> buffer_binding[RSXGL_PIXEL_UNPACK_BUFFER];
+      const memory_t & srcmem = srcbuffer.memory + rsxgl_pointer_to_offset(data);
+
+      rsxgl_util_format_translate_dma(ctx,
+				      level.pformat,
+				      memory_ptr,level.memory,level.pitch,0,0,
+				      psrcformat,
+				      rsxgl_arena_address(memory_arena_t::storage().at(srcbuffer.arena),srcmem),srcmem,srcpitch,0,0,
+				      width,height);
+    }
+  }
+}
+
+static inline void
+rsxgl_copy_tex_image(rsxgl_context_t * ctx,rsxgl_object_context_lock_t & lock,const texture_t::name_type texture_name,uint8_t dims,bool cube,bool rect,GLint _level,GLint glinternalformat,GLint x,GLint y,GLsizei width,GLsizei height)
+{
+  // There's no read framebuffer without a surface, nor can the copy be timestamped:
+  if(!ctx -> can_emit()) {
+    RSXGL_ERROR_(GL_INVALID_FRAMEBUFFER_OPERATION);
+  }
+
+  const bool result = rsxgl_tex_image_format(ctx,lock,texture_name,dims,cube,rect,_level,glinternalformat,width,height,1,PIPE_FORMAT_NONE);
+
+  if(result) {
+    const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+    
+    framebuffer_t & framebuffer = ctx -> framebuffer_binding[RSXGL_READ_FRAMEBUFFER];
+    rsxgl_framebuffer_validate(ctx,framebuffer,timestamp);
+
+    if(framebuffer.color_pformat != PIPE_FORMAT_NONE && framebuffer.read_surface.memory) {
+      texture_t::level_t & level = texture_t::storage().at(texture_name).levels[_level];
+      if(!level.memory) {
+	rsxgl_texture_level_validate_storage(ctx,level);
+      }
+      void *memory_ptr = level.memory_ptr;
+      if (memory_ptr == NULL)
+        memory_ptr = rsxgl_texture_migrate_address(level.memory.offset);
 
       rsxgl_assert(level.memory);
 
@@ -1825,6 +2316,11 @@ rsxgl_copy_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool
 static inline void
 rsxgl_copy_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint xoffset,GLint yoffset,GLint zoffset,GLint x,GLint y,GLsizei width,GLsizei height)
 {
+  // There's no read framebuffer without a surface, nor can the copy be timestamped:
+  if(!ctx -> can_emit()) {
+    RSXGL_ERROR_(GL_INVALID_FRAMEBUFFER_OPERATION);
+  }
+
   pipe_format pdstformat = PIPE_FORMAT_NONE;
   uint32_t dstpitch = 0;
   void * dstaddress = 0;
@@ -1832,6 +2328,12 @@ rsxgl_copy_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
   const bool result = rsxgl_tex_subimage_init(ctx,texture,_level,xoffset,yoffset,zoffset,width,height,1,&pdstformat,&dstpitch,&dstaddress,&dstmem);
 
   if(result) {
+    if(util_format_is_compressed(pdstformat)) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    rsxgl_tex_subimage_wait(ctx,texture);
+
     const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
     
     framebuffer_t & framebuffer = ctx -> framebuffer_binding[RSXGL_READ_FRAMEBUFFER];
@@ -1854,22 +2356,149 @@ rsxgl_copy_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
   }
 }
 
+// Address of a compressed image, which may be in the pixel unpack buffer:
+static inline const uint8_t *
+rsxgl_compressed_image_address(rsxgl_context_t * ctx,const GLvoid * data)
+{
+  if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] != 0) {
+    const buffer_t & srcbuffer = ctx -> buffer_binding[RSXGL_PIXEL_UNPACK_BUFFER];
+    return (const uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(srcbuffer.arena),srcbuffer.memory + rsxgl_pointer_to_offset(data));
+  }
+  else {
+    return (const uint8_t *)data;
+  }
+}
+
+// Compressed images are copied block-for-block into levels that have the same format, and
+// decoded into levels that the GPU can't sample compressed. Pixel store state doesn't apply:
+static inline void
+rsxgl_compressed_tex_image(rsxgl_context_t * ctx,rsxgl_object_context_lock_t & lock,const texture_t::name_type texture_name,uint8_t dims,bool cube,bool rect,GLint _level,GLenum glinternalformat,GLsizei width,GLsizei height,GLsizei depth,
+			   GLsizei imageSize,const GLvoid * data)
+{
+  const pipe_format psrcformat = rsxgl_compressed_source_format(glinternalformat);
+
+  if(psrcformat == PIPE_FORMAT_NONE) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  const uint32_t srcpitch = util_format_get_stride(psrcformat,width);
+  const uint32_t srcslice = util_format_get_2d_size(psrcformat,srcpitch,height);
+
+  if(imageSize < 0 || (uint32_t)imageSize != (srcslice * depth)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  const bool result = rsxgl_tex_image_format(ctx,lock,texture_name,dims,cube,rect,_level,glinternalformat,width,height,depth,psrcformat);
+
+  if(result) {
+    texture_t::level_t & level = texture_t::storage().at(texture_name).levels[_level];
+
+    if(!level.memory) {
+      rsxgl_texture_level_validate_storage(ctx,level);
+    }
+    uint8_t * memory_ptr = (uint8_t *)level.memory_ptr;
+    if (memory_ptr == NULL)
+      memory_ptr = (uint8_t *)rsxgl_texture_migrate_address(level.memory.offset);
+
+    const uint8_t * srcaddress = rsxgl_compressed_image_address(ctx,data);
+
+    if(srcaddress != 0) {
+      const uint32_t dstslice = util_format_get_2d_size(level.pformat,level.pitch,level.size[1]);
+
+      for(GLsizei z = 0;z < depth;++z) {
+	rsxgl_texture_translate(level.pformat,memory_ptr + (z * dstslice),level.pitch,0,0,
+				psrcformat,srcaddress + (z * srcslice),srcpitch,width,height);
+      }
+    }
+  }
+}
+
+static inline void
+rsxgl_compressed_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,GLint x,GLint y,GLint z,GLsizei width,GLsizei height,GLsizei depth,
+			      GLenum format,GLsizei imageSize,const GLvoid * data)
+{
+  const pipe_format psrcformat = rsxgl_compressed_source_format(format);
+
+  if(psrcformat == PIPE_FORMAT_NONE) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  pipe_format pdstformat = PIPE_FORMAT_NONE;
+  uint32_t dstpitch = 0;
+  void * dstaddress = 0;
+  memory_t dstmem;
+  const bool result = rsxgl_tex_subimage_init(ctx,texture,_level,x,y,z,width,height,depth,&pdstformat,&dstpitch,&dstaddress,&dstmem);
+
+  if(result) {
+    if(util_format_is_compressed(pdstformat) && pdstformat != psrcformat) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    texture_t::dimension_size_type size[3] = { texture.levels[_level].size[0], texture.levels[_level].size[1], texture.levels[_level].size[2] };
+    if(texture.memory) {
+      rsxgl_get_tex_level_offset_size(texture.pformat,texture.size,texture.pitch,_level,size);
+    }
+
+    // Whole blocks are replaced; only those along the level's right & bottom edges may be partial:
+    if((x % 4) != 0 || (y % 4) != 0 ||
+       ((width % 4) != 0 && (x + width) != size[0]) ||
+       ((height % 4) != 0 && (y + height) != size[1])) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    const uint32_t srcpitch = util_format_get_stride(psrcformat,width);
+    const uint32_t srcslice = util_format_get_2d_size(psrcformat,srcpitch,height);
+
+    if(imageSize < 0 || (uint32_t)imageSize != (srcslice * depth)) {
+      RSXGL_ERROR_(GL_INVALID_VALUE);
+    }
+
+    rsxgl_assert(dstaddress != 0);
+    rsxgl_assert(dstmem);
+
+    // As with uncompressed sub-images, stage the update if the GPU is still using the texture:
+    if(ctx -> buffer_binding.names[RSXGL_PIXEL_UNPACK_BUFFER] == 0 && data != 0 && depth == 1 && z == 0 && texture.memory &&
+       texture.timestamp > 0 && !rsxgl_timestamp_passed(ctx,texture.timestamp) &&
+       rsxgl_tex_subimage_staged(ctx,texture,x,y,width,height,pdstformat,dstpitch,dstmem,psrcformat,data,srcpitch)) {
+      RSXGL_NOERROR_();
+    }
+
+    rsxgl_tex_subimage_wait(ctx,texture);
+
+    const uint8_t * srcaddress = rsxgl_compressed_image_address(ctx,data);
+
+    if(srcaddress != 0) {
+      const uint32_t dstslice = dstpitch * util_format_get_nblocksy(pdstformat,size[1]);
+
+      for(GLsizei i = 0;i < depth;++i) {
+	rsxgl_texture_translate(pdstformat,(uint8_t *)dstaddress + ((z + i) * dstslice),dstpitch,x,y,
+				psrcformat,srcaddress + (i * srcslice),srcpitch,width,height);
+      }
+    }
+
+    RSXGL_NOERROR_();
+  }
+}
+
 GLAPI void APIENTRY
 glTexImage1D (GLenum target, GLint level, GLint internalformat, GLsizei width, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
   if(!(target == GL_TEXTURE_1D)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
-
-  rsxgl_tex_image(ctx,texture,1,false,false,level,internalformat,std::max(width,1),1,1,format,type,pixels);
+  rsxgl_tex_image(ctx,lock,ctx -> texture_binding.names[ctx -> active_texture],1,false,false,level,internalformat,std::max(width,1),1,1,format,type,pixels);
 }
 
 GLAPI void APIENTRY
 glTexImage2D (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
   if(!(target == GL_TEXTURE_2D ||
        target == GL_TEXTURE_CUBE_MAP ||
        target == GL_TEXTURE_RECTANGLE ||
@@ -1877,29 +2506,28 @@ glTexImage2D (GLenum target, GLint level, GLint internalformat, GLsizei width, G
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
-
-  rsxgl_tex_image(ctx,texture,2,target == GL_TEXTURE_CUBE_MAP, target == GL_TEXTURE_RECTANGLE,level,internalformat,std::max(width,1),std::max(height,1),1,format,type,pixels);
+  rsxgl_tex_image(ctx,lock,ctx -> texture_binding.names[ctx -> active_texture],2,target == GL_TEXTURE_CUBE_MAP, target == GL_TEXTURE_RECTANGLE,level,internalformat,std::max(width,1),std::max(height,1),1,format,type,pixels);
 }
 
 GLAPI void APIENTRY
 glTexImage3D (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
   if(!(target == GL_TEXTURE_3D ||
        target == GL_TEXTURE_2D_ARRAY)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
-
-  rsxgl_tex_image(ctx,texture,3,false,false,level,internalformat,std::max(width,1),std::max(height,1),std::max(depth,1),format,type,pixels);
+  rsxgl_tex_image(ctx,lock,ctx -> texture_binding.names[ctx -> active_texture],3,false,false,level,internalformat,std::max(width,1),std::max(height,1),std::max(depth,1),format,type,pixels);
 }
 
 GLAPI void APIENTRY
 glTexStorage1D(GLenum target, GLsizei levels,GLenum internalformat,GLsizei width)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_1D)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
@@ -1913,6 +2541,8 @@ glTexStorage1D(GLenum target, GLsizei levels,GLenum internalformat,GLsizei width
 GLAPI void APIENTRY
 glTexStorage2D(GLenum target, GLsizei levels,GLenum internalformat,GLsizei width, GLsizei height)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_2D ||
        target == GL_TEXTURE_CUBE_MAP ||
        target == GL_TEXTURE_RECTANGLE ||
@@ -1929,6 +2559,8 @@ glTexStorage2D(GLenum target, GLsizei levels,GLenum internalformat,GLsizei width
 GLAPI void APIENTRY
 glTexStorage3D(GLenum target, GLsizei levels,GLenum internalformat,GLsizei width, GLsizei height, GLsizei depth)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_3D ||
        target == GL_TEXTURE_2D_ARRAY)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -1943,26 +2575,36 @@ glTexStorage3D(GLenum target, GLsizei levels,GLenum internalformat,GLsizei width
 GLAPI void APIENTRY
 glTextureStorage1DEXT(GLuint texture, GLenum target, GLsizei levels,GLenum internalformat,GLsizei width)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
 }
 
 GLAPI void APIENTRY
 glTextureStorage2DEXT(GLuint texture, GLenum target, GLsizei levels,GLenum internalformat,GLsizei width, GLsizei height)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
 }
 
 GLAPI void APIENTRY
 glTextureStorage3DEXT(GLuint texture, GLenum target, GLsizei levels,GLenum internalformat,GLsizei width, GLsizei height, GLsizei depth)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
 }
 
 GLAPI void APIENTRY
 glGetTexImage (GLenum target, GLint level, GLenum format, GLenum type, GLvoid *pixels)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
 }
 
 GLAPI void APIENTRY
 glGetTexParameterfv (GLenum target, GLenum pname, GLfloat *params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_1D ||
        target == GL_TEXTURE_2D ||
        target == GL_TEXTURE_3D ||
@@ -1978,6 +2620,8 @@ glGetTexParameterfv (GLenum target, GLenum pname, GLfloat *params)
 GLAPI void APIENTRY
 glGetTexParameteriv (GLenum target, GLenum pname, GLint *params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_1D ||
        target == GL_TEXTURE_2D ||
        target == GL_TEXTURE_3D ||
@@ -1995,44 +2639,50 @@ glGetTexParameteriv (GLenum target, GLenum pname, GLint *params)
 GLAPI void APIENTRY
 glGetTexLevelParameterfv (GLenum target, GLint level, GLenum pname, GLfloat *params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   rsxgl_get_tex_level_parameter(target,level,pname,params);
 }
 
 GLAPI void APIENTRY
 glGetTexLevelParameteriv (GLenum target, GLint level, GLenum pname, GLint *params)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   rsxgl_get_tex_level_parameter(target,level,pname,params);
 }
 
 GLAPI void APIENTRY
 glCopyTexImage1D (GLenum target, GLint level, GLenum internalformat, GLint x, GLint y, GLsizei width, GLint border)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
   if(!(target == GL_TEXTURE_1D)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
-
-  rsxgl_copy_tex_image(ctx,texture,1,false,false,level,internalformat,x,y,width,1);
+  rsxgl_copy_tex_image(ctx,lock,ctx -> texture_binding.names[ctx -> active_texture],1,false,false,level,internalformat,x,y,width,1);
 }
 
 GLAPI void APIENTRY
 glCopyTexImage2D (GLenum target, GLint level, GLenum internalformat, GLint x, GLint y, GLsizei width, GLsizei height, GLint border)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
   if(!(target == GL_TEXTURE_2D)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
-
-  rsxgl_copy_tex_image(ctx,texture,2,false,false,level,internalformat,x,y,width,height);
+  rsxgl_copy_tex_image(ctx,lock,ctx -> texture_binding.names[ctx -> active_texture],2,false,false,level,internalformat,x,y,width,height);
 }
 
 GLAPI void APIENTRY
 glCopyTexSubImage1D (GLenum target, GLint level, GLint xoffset, GLint x, GLint y, GLsizei width)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_1D)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
@@ -2046,6 +2696,8 @@ glCopyTexSubImage1D (GLenum target, GLint level, GLint xoffset, GLint x, GLint y
 GLAPI void APIENTRY
 glCopyTexSubImage2D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width, GLsizei height)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_2D)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
@@ -2059,6 +2711,8 @@ glCopyTexSubImage2D (GLenum target, GLint level, GLint xoffset, GLint yoffset, G
 GLAPI void APIENTRY
 glCopyTexSubImage3D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLint x, GLint y, GLsizei width, GLsizei height)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
   if(!(target == GL_TEXTURE_3D)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
@@ -2072,92 +2726,203 @@ glCopyTexSubImage3D (GLenum target, GLint level, GLint xoffset, GLint yoffset, G
 GLAPI void APIENTRY
 glTexSubImage1D (GLenum target, GLint level, GLint xoffset, GLsizei width, GLenum format, GLenum type, const GLvoid *pixels)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
   if(!(target == GL_TEXTURE_1D)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
-
-  rsxgl_tex_subimage(ctx,texture,level,xoffset,0,0,width,1,1,format,type,pixels);
+  rsxgl_tex_subimage(ctx,lock,ctx -> texture_binding.names[ctx -> active_texture],level,xoffset,0,0,width,1,1,format,type,pixels);
 }
 
 GLAPI void APIENTRY
 glTexSubImage2D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
   if(!(target == GL_TEXTURE_2D ||
        target == GL_TEXTURE_CUBE_MAP ||
        target == GL_TEXTURE_RECTANGLE)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
-
-  rsxgl_tex_subimage(ctx,texture,level,xoffset,yoffset,0,width,height,1,format,type,pixels);
+  rsxgl_tex_subimage(ctx,lock,ctx -> texture_binding.names[ctx -> active_texture],level,xoffset,yoffset,0,width,height,1,format,type,pixels);
 }
 
 GLAPI void APIENTRY
 glTexSubImage3D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
   if(!(target == GL_TEXTURE_3D)) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  rsxgl_context_t * ctx = current_ctx();
-  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
-
-  rsxgl_tex_subimage(ctx,texture,level,xoffset,yoffset,zoffset,width,height,depth,format,type,pixels);
+  rsxgl_tex_subimage(ctx,lock,ctx -> texture_binding.names[ctx -> active_texture],level,xoffset,yoffset,zoffset,width,height,depth,format,type,pixels);
 }
 
 GLAPI void APIENTRY
 glCompressedTexImage3D (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLsizei imageSize, const GLvoid *data)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
+  if(!(target == GL_TEXTURE_3D ||
+       target == GL_TEXTURE_2D_ARRAY)) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  rsxgl_compressed_tex_image(ctx,lock,ctx -> texture_binding.names[ctx -> active_texture],3,false,false,level,internalformat,std::max(width,1),std::max(height,1),std::max(depth,1),imageSize,data);
 }
 
 GLAPI void APIENTRY
 glCompressedTexImage2D (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid *data)
 {
+  rsxgl_context_t * ctx = current_ctx();
+  rsxgl_object_context_lock_t lock(ctx);
+
+  if(!(target == GL_TEXTURE_2D ||
+       target == GL_TEXTURE_CUBE_MAP ||
+       target == GL_TEXTURE_RECTANGLE)) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  rsxgl_compressed_tex_image(ctx,lock,ctx -> texture_binding.names[ctx -> active_texture],2,target == GL_TEXTURE_CUBE_MAP,target == GL_TEXTURE_RECTANGLE,level,internalformat,std::max(width,1),std::max(height,1),1,imageSize,data);
 }
 
 GLAPI void APIENTRY
 glCompressedTexImage1D (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLint border, GLsizei imageSize, const GLvoid *data)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
+  // None of the supported formats have 1D blocks:
+  RSXGL_ERROR_(GL_INVALID_ENUM);
 }
 
 GLAPI void APIENTRY
 glCompressedTexSubImage3D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLsizei imageSize, const GLvoid *data)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
+  if(!(target == GL_TEXTURE_3D ||
+       target == GL_TEXTURE_2D_ARRAY)) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  rsxgl_context_t * ctx = current_ctx();
+  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
+
+  rsxgl_compressed_tex_subimage(ctx,texture,level,xoffset,yoffset,zoffset,width,height,depth,format,imageSize,data);
 }
 
 GLAPI void APIENTRY
 glCompressedTexSubImage2D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const GLvoid *data)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
+  if(!(target == GL_TEXTURE_2D ||
+       target == GL_TEXTURE_CUBE_MAP_POSITIVE_X ||
+       target == GL_TEXTURE_CUBE_MAP_POSITIVE_Y ||
+       target == GL_TEXTURE_CUBE_MAP_POSITIVE_Z ||
+       target == GL_TEXTURE_CUBE_MAP_NEGATIVE_X ||
+       target == GL_TEXTURE_CUBE_MAP_NEGATIVE_Y ||
+       target == GL_TEXTURE_CUBE_MAP_NEGATIVE_Z ||
+       target == GL_TEXTURE_RECTANGLE)) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  rsxgl_context_t * ctx = current_ctx();
+  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
+
+  rsxgl_compressed_tex_subimage(ctx,texture,level,xoffset,yoffset,0,width,height,1,format,imageSize,data);
 }
 
 GLAPI void APIENTRY
 glCompressedTexSubImage1D (GLenum target, GLint level, GLint xoffset, GLsizei width, GLenum format, GLsizei imageSize, const GLvoid *data)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
+  RSXGL_ERROR_(GL_INVALID_ENUM);
 }
 
 GLAPI void APIENTRY
 glGetCompressedTexImage (GLenum target, GLint level, GLvoid *img)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
+  if(!(target == GL_TEXTURE_2D ||
+       target == GL_TEXTURE_3D ||
+       target == GL_TEXTURE_2D_ARRAY ||
+       target == GL_TEXTURE_CUBE_MAP_POSITIVE_X ||
+       target == GL_TEXTURE_CUBE_MAP_POSITIVE_Y ||
+       target == GL_TEXTURE_CUBE_MAP_POSITIVE_Z ||
+       target == GL_TEXTURE_CUBE_MAP_NEGATIVE_X ||
+       target == GL_TEXTURE_CUBE_MAP_NEGATIVE_Y ||
+       target == GL_TEXTURE_CUBE_MAP_NEGATIVE_Z ||
+       target == GL_TEXTURE_RECTANGLE)) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  if(level < 0 || (boost::static_log2_argument_type)level >= texture_t::max_levels) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  rsxgl_context_t * ctx = current_ctx();
+  texture_t & texture = ctx -> texture_binding[ctx -> active_texture];
+  texture_t::level_t & _level = texture.levels[level];
+
+  uint8_t * dstaddress = (uint8_t *)img;
+  if(ctx -> buffer_binding.names[RSXGL_PIXEL_PACK_BUFFER] != 0) {
+    const buffer_t & dstbuffer = ctx -> buffer_binding[RSXGL_PIXEL_PACK_BUFFER];
+    dstaddress = (uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(dstbuffer.arena),dstbuffer.memory + rsxgl_pointer_to_offset(img));
+  }
+
+  // The level's own memory holds the most recent image, until it's migrated into the texture:
+  if(_level.memory && util_format_is_compressed(_level.pformat)) {
+    const void * srcaddress = (_level.memory_ptr != NULL) ? _level.memory_ptr : rsxgl_texture_migrate_address(_level.memory.offset);
+    memcpy(dstaddress,srcaddress,rsxgl_texture_level_storage_size(_level));
+  }
+  else if(texture.memory && !texture.invalid && level < texture.num_levels && util_format_is_compressed(texture.pformat)) {
+    rsxgl_tex_subimage_wait(ctx,texture);
+
+    texture_t::dimension_size_type size[3] = { 0,0,0 };
+    const uint32_t offset = rsxgl_get_tex_level_offset_size(texture.pformat,texture.size,texture.pitch,level,size);
+    const uint8_t * srcaddress = (const uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(texture.arena),texture.memory + offset);
+
+    const uint32_t
+      dstpitch = util_format_get_stride(texture.pformat,size[0]),
+      srcslice = texture.pitch * util_format_get_nblocksy(texture.pformat,size[1]), dstslice = util_format_get_2d_size(texture.pformat,dstpitch,size[1]);
+
+    for(uint32_t z = 0;z < size[2];++z) {
+      util_format_translate(texture.pformat,dstaddress + (z * dstslice),dstpitch,0,0,
+			    texture.pformat,srcaddress + (z * srcslice),texture.pitch,0,0,
+			    size[0],size[1]);
+    }
+  }
+  else {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  RSXGL_NOERROR_();
 }
 
 GLAPI void APIENTRY
 glTexBuffer (GLenum target, GLenum internalformat, GLuint buffer)
 {
+  RSXGL_LOCK_SHARED_OBJECTS(current_ctx());
+
 }
 
 void
 rsxgl_texture_validate(rsxgl_context_t * ctx,texture_t & texture,uint32_t timestamp)
 {
-  rsxgl_assert(timestamp >= texture.timestamp);
   texture.timestamp = timestamp;
 
   if(texture.invalid) {
-    rsxgl_texture_reset_storage(texture);
+    rsxgl_texture_reset_storage(ctx,texture);
     if(rsxgl_texture_validate_complete(ctx,texture)) {
       rsxgl_texture_validate_storage(ctx,texture);
 
@@ -2209,19 +2974,19 @@ rsxgl_texture_validate(rsxgl_context_t * ctx,texture_t & texture,uint32_t timest
 	      }
 	    }
 	    
-	    dstoffset += dstpitch * size[1] * size[2];
+	    dstoffset += dstpitch * util_format_get_nblocksy(pdstformat,size[1]) * size[2];
 	    for(int j = 0;j < 3;++j) {
 	      size[j] = std::max(size[j] >> 1,1);
 	    }
 	  }
 	}
 
-	// TODO: wait for transfers to complete, then delete memory:
+	// Free the levels' memory once the transfers are complete:
 	if(ndelete) {
 	  texture_t::level_t * plevel = texture.levels;
 	  for(texture_t::level_size_type i = 0,n = texture.num_levels;i < n;++i,++plevel) {
-	    if(plevel -> memory.owner) {
-	      // rsxgl_texture_level_reset_storage(*plevel);
+	    if(plevel -> memory.owner && plevel -> memory) {
+	      rsxgl_texture_level_retire_storage(ctx,*plevel,timestamp);
 	    }
 	  }
 	}
@@ -2280,7 +3045,6 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
 
     if(ctx -> texture_binding.names[api_index] != 0) {
       texture_t & texture = ctx -> texture_binding[api_index];
-      rsxgl_assert(timestamp >= texture.timestamp);
       texture.timestamp = timestamp;
     }
 
@@ -2347,51 +3111,19 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
 
     if(ctx -> texture_binding.names[api_index] != 0) {
       texture_t & texture = ctx -> texture_binding[api_index];
-      rsxgl_assert(timestamp >= texture.timestamp);
       texture.timestamp = timestamp;
     }
 
-    if(invalid_it.test() || invalid_samplers.test(api_index)) {
-      const sampler_t & sampler = (ctx -> sampler_binding.names[api_index] != 0) ? ctx -> sampler_binding[api_index] : ctx -> texture_binding[api_index].sampler;
-      
-      const uint32_t wrap = 
-	((uint32_t)(sampler.wrap_s + 1) << NV30_3D_TEX_WRAP_S__SHIFT) |
-	((uint32_t)(sampler.wrap_t + 1) << NV30_3D_TEX_WRAP_T__SHIFT) |
-	((uint32_t)(sampler.wrap_r + 1) << NV30_3D_TEX_WRAP_R__SHIFT)
-	;
-      
-      const uint32_t compare =
-	(uint32_t)sampler.compare_func << NV30_3D_TEX_WRAP_RCOMP__SHIFT
-	;
-      
-      const uint32_t filter =
-	((uint32_t)(sampler.filter_min + 1) << NV30_3D_TEX_FILTER_MIN__SHIFT) |
-	((uint32_t)(sampler.filter_mag + 1) << NV30_3D_TEX_FILTER_MAG__SHIFT) |
-	// "convolution":
-	((uint32_t)1 << 13)
-	;
-      
-      //
-      uint32_t * buffer = gcm_reserve(context,4);
-      
-      gcm_emit_method(&buffer,NV30_3D_TEX_FILTER(index),1);
-      gcm_emit(&buffer,filter);
-      
-      gcm_emit_method(&buffer,NV30_3D_TEX_WRAP(index),1);
-      gcm_emit(&buffer,wrap | compare);
-
-      // TODO: Set LOD min, max, bias:
-      
-      gcm_finish_commands(context,&buffer);
-
-      validated.set(api_index);
-    }
-    if(invalid_it.test() || invalid_textures.test(api_index)) {
+    if(invalid_it.test() || invalid_samplers.test(api_index) || invalid_textures.test(api_index)) {
       texture_t & texture = ctx -> texture_binding[api_index];
 
-      rsxgl_texture_validate(ctx,texture,timestamp);
-      
+      if(invalid_it.test() || invalid_textures.test(api_index)) {
+	rsxgl_texture_validate(ctx,texture,timestamp);
+      }
+
       if(texture.memory) {
+	const sampler_t & sampler = (ctx -> sampler_binding.names[api_index] != 0) ? ctx -> sampler_binding[api_index] : texture.sampler;
+
 #if 0
 	rsxgl_debug_printf("texture: %u (%u) %lx memory: %u %u pformat: %u format:%x size:%ux%u pitch:%u remap:%x\n",
 			   index,api_index,
@@ -2403,26 +3135,41 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
 			   (uint32_t)texture.pitch,(uint32_t)texture.remap);
 #endif
 
-	// activate the texture:
-	uint32_t * buffer = gcm_reserve(context,11);
-	
-	gcm_emit_method(&buffer,NV30_3D_TEX_OFFSET(index),2);
-	gcm_emit(&buffer,texture.memory.offset);
-	gcm_emit(&buffer,texture.format);
-	
-	gcm_emit_method(&buffer,NV30_3D_TEX_ENABLE(index),1);
-	gcm_emit(&buffer,NV40_3D_TEX_ENABLE_ENABLE);
-	
-	gcm_emit_method(&buffer,NV30_3D_TEX_NPOT_SIZE(index),1);
-	gcm_emit(&buffer,((uint32_t)texture.size[0] << NV30_3D_TEX_NPOT_SIZE_W__SHIFT) | (uint32_t)texture.size[1]);
-	
-	gcm_emit_method(&buffer,NV40_3D_TEX_SIZE1(index),1);
-	gcm_emit(&buffer,((uint32_t)texture.size[2] << NV40_3D_TEX_SIZE1_DEPTH__SHIFT) | (uint32_t)texture.pitch);
+	// The sampler's LOD clamps can't reach past the texture's last level:
+	const uint32_t
+	  max_lod = std::min(sampler.hw_max_lod,texture.max_lod_limit),
+	  min_lod = std::min((uint32_t)sampler.hw_min_lod,max_lod);
+
+	rsxgl_texture_unit_registers_t registers;
+	registers.words[rsxgl_texture_unit_registers_t::offset] = texture.memory.offset;
+	registers.words[rsxgl_texture_unit_registers_t::format] = texture.format;
+	registers.words[rsxgl_texture_unit_registers_t::wrap] = sampler.hw_wrap;
+	registers.words[rsxgl_texture_unit_registers_t::enable] = NV40_3D_TEX_ENABLE_ENABLE | (min_lod << 19) | (max_lod << 7);
+	registers.words[rsxgl_texture_unit_registers_t::swizzle] = texture.remap;
+	registers.words[rsxgl_texture_unit_registers_t::filter] = sampler.hw_filter;
+	registers.words[rsxgl_texture_unit_registers_t::npot_size] = texture.npot_size;
+	registers.words[rsxgl_texture_unit_registers_t::border_color] = 0;
+	registers.size1 = texture.size1;
+
+	rsxgl_texture_unit_registers_t & current = ctx -> texture_unit_registers[index];
+
+	if(!ctx -> texture_unit_registers_valid.test(index) || memcmp(&current,&registers,sizeof(registers)) != 0) {
+	  // activate the texture:
+	  uint32_t * buffer = gcm_reserve(context,rsxgl_texture_unit_registers_t::count + 3);
 
-	gcm_emit_method(&buffer,NV30_3D_TEX_SWIZZLE(index),1);
-	gcm_emit(&buffer,texture.remap);
-	
-	gcm_finish_commands(context,&buffer);
+	  gcm_emit_method(&buffer,NV30_3D_TEX_OFFSET(index),rsxgl_texture_unit_registers_t::count);
+	  for(unsigned int i = 0;i < rsxgl_texture_unit_registers_t::count;++i) {
+	    gcm_emit(&buffer,registers.words[i]);
+	  }
+
+	  gcm_emit_method(&buffer,NV40_3D_TEX_SIZE1(index),1);
+	  gcm_emit(&buffer,registers.size1);
+
+	  gcm_finish_commands(context,&buffer);
+
+	  current = registers;
+	  ctx -> texture_unit_registers_valid.set(index);
+	}
       }
 
       validated.set(api_index);
@@ -63,6 +63,11 @@ struct sampler_t {
 
   float lodBias, minLod, maxLod;
 
+  // NV40 register words, re-packed whenever the parameters above change.
+  // The LOD clamps are 4.8 fixed point, and are limited by the texture's levels when bound:
+  uint32_t hw_wrap, hw_filter;
+  uint16_t hw_min_lod, hw_max_lod;
+
   sampler_t();
   void destroy() {}
 };
@@ -130,16 +135,46 @@ struct texture_t {
   uint32_t pitch;
   uint32_t remap;
 
+  // Pre-packed NV30_3D_TEX_NPOT_SIZE & NV40_3D_TEX_SIZE1 words, and the largest LOD that the
+  // texture's levels allow (4.8 fixed point); set when its storage is validated:
+  uint32_t npot_size, size1;
+  uint16_t max_lod_limit;
+
   memory_t memory;
   memory_arena_t::name_type arena;
 
   sampler_t sampler;
 };
 
+// Words last sent to a fragment texture unit. NV30_3D_TEX_OFFSET through NV30_3D_TEX_BORDER_COLOR
+// are consecutive methods, so the first eight are sent in one burst:
+struct rsxgl_texture_unit_registers_t {
+  enum {
+    offset = 0, format, wrap, enable, swizzle, filter, npot_size, border_color,
+    count
+  };
+
+  uint32_t words[count];
+  uint32_t size1;
+};
+
 struct rsxgl_context_t;
 
 bool rsxgl_texture_validate_complete(rsxgl_context_t *,texture_t &);
 void rsxgl_texture_validate(rsxgl_context_t *,texture_t &,uint32_t);
 void rsxgl_textures_validate(rsxgl_context_t *,program_t &,uint32_t);
 
+// CPU decoding of compressed textures; see texture_compression.cc. Lets gallium read S3TC texels,
+// which also lets S3TC formats be chosen for textures:
+void rsxgl_texture_compression_init();
+
+// Whether rsxgl_texture_decode() can decode a format:
+bool rsxgl_texture_decode_supported(const pipe_format);
+
+// Decode width x height texels, starting at the beginning of a row of blocks, into an
+// uncompressed format:
+void rsxgl_texture_decode(const pipe_format,void *,const uint32_t,const uint32_t,const uint32_t,
+			  const pipe_format,const void *,const uint32_t,
+			  const uint32_t,const uint32_t);
+
 #endif
@@ -17,22 +17,57 @@
 #define rsxgl_timestamp_H
 
 #include "sync.h"
+#include "rsxgl_limits.h"
 
-// max_timestamp + 1 should be a power-of-two value.
-// Should not return 0, because this is reserved for indicating that an object is not waiting
-// on a GPU operation.
+// Timestamps count up from 1 to RSXGL_MAX_TIMESTAMP, then start over at 1; 0 is reserved for
+// indicating that an object is not waiting on a GPU operation. Because RSXGL_MAX_TIMESTAMP + 1 is
+// a power of two, they are compared using serial-number arithmetic - a timestamp is pending if
+// it was given out after the last one that the GPU reached. Objects' timestamps never need to be
+// reset when the count starts over: a timestamp so old that it aliases a pending one at most
+// causes a wait for a timestamp that the GPU is about to reach anyway.
+
+// Number of timestamps from b up to a:
+static inline uint32_t
+rsxgl_timestamp_distance(const uint32_t a,const uint32_t b)
+{
+  return (a - b) & RSXGL_MAX_TIMESTAMP;
+}
+
+static inline uint32_t
+rsxgl_timestamp_next(const uint32_t timestamp)
+{
+  const uint32_t next = (timestamp + 1) & RSXGL_MAX_TIMESTAMP;
+  return (next == 0) ? 1 : next;
+}
+
+// Whether compare is still pending, given the last timestamp that the GPU reached, and the next
+// timestamp to be given out:
+static inline bool
+rsxgl_timestamp_pending(const uint32_t reached,const uint32_t next,const uint32_t compare)
+{
+  return (compare != 0) && (rsxgl_timestamp_distance(next,compare) < rsxgl_timestamp_distance(next,reached));
+}
+
+// Whether the GPU, having reached the timestamp reached, has also reached compare. Unlike
+// rsxgl_timestamp_pending, this doesn't need the next timestamp to be given out, so it stays
+// correct while other threads go on giving them out - provided that the GPU is never more
+// than half of the timestamp range behind:
+static inline bool
+rsxgl_timestamp_reached(const uint32_t reached,const uint32_t compare)
+{
+  return (compare == 0) || (rsxgl_timestamp_distance(reached,compare) < ((RSXGL_MAX_TIMESTAMP >> 1) + 1));
+}
 
-// Add the previously allocated timestamp to the command stream.
 // See if a timestamp has been passed by the GPU:
 static inline bool
-rsxgl_timestamp_passed(uint32_t & cached_timestamp,const uint8_t index,const uint32_t compare)
+rsxgl_timestamp_passed(uint32_t & cached_timestamp,const uint8_t index,const uint32_t next,const uint32_t compare)
 {
   rsxgl_assert(index != 0);
 
-  if(cached_timestamp < compare) {
+  if(rsxgl_timestamp_pending(cached_timestamp,next,compare)) {
     const uint32_t timestamp = rsxgl_sync_value(index);
     cached_timestamp = timestamp;
-    return timestamp >= compare;
+    return !rsxgl_timestamp_pending(timestamp,next,compare);
   }
   else {
     return true;
@@ -41,29 +76,29 @@ rsxgl_timestamp_passed(uint32_t & cached_timestamp,const uint8_t index,const uin
 
 // Conservative timestamp checking - only checks the "cached" timestamp, does not consult the GPU:
 static inline bool
-rsxgl_timestamp_passed_conservative(const uint32_t cached_timestamp,const uint32_t compare)
+rsxgl_timestamp_passed_conservative(const uint32_t cached_timestamp,const uint32_t next,const uint32_t compare)
 {
-  return (cached_timestamp >= compare);
+  return !rsxgl_timestamp_pending(cached_timestamp,next,compare);
 }
 
 // Wait for the GPU to reach some timestamp. Returns true if the function did indeed need to wait,
 // false otherwise.
 static inline bool
-rsxgl_timestamp_wait(uint32_t & cached_timestamp,const uint8_t index,const uint32_t compare,const useconds_t timeout_interval)
+rsxgl_timestamp_wait(uint32_t & cached_timestamp,const uint8_t index,const uint32_t next,const uint32_t compare,const useconds_t timeout_interval)
 {
-  if(cached_timestamp < compare) {
+  if(rsxgl_timestamp_pending(cached_timestamp,next,compare)) {
     volatile uint32_t * object = gcmGetLabelAddress(index);
     rsxgl_assert(object != 0);
     
     uint32_t timestamp = *object;
 
     if(timeout_interval) {
-      for(;timestamp < compare;timestamp = *object) {
+      for(;rsxgl_timestamp_pending(timestamp,next,compare);timestamp = *object) {
 	usleep(timeout_interval);
       }
     }
     else {
-      while(timestamp < compare) {
+      while(rsxgl_timestamp_pending(timestamp,next,compare)) {
 	timestamp = *object;
       }
     }
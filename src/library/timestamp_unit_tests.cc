@@ -0,0 +1,184 @@
+// "Unit testing" for the serial-number comparisons performed by timestamp.h. Meant to be built &
+// run on the host, e.g.:
+//
+// g++ -std=c++11 timestamp_unit_tests.cc -o timestamp_unit_tests
+//
+// Timestamps are given out the way that rsxgl_timestamp_create() does, across a
+// wraparound, and posted to a simulated GPU label that lags behind. Each timestamp is also
+// numbered on a 64-bit timeline that never wraps; rsxgl_timestamp_passed() needs to agree with
+// that timeline for every timestamp that's in flight, and for objects whose timestamps were set
+// long ago it may only report them as pending if they alias a timestamp that is.
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <deque>
+
+#include <stdint.h>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+#define rsxgl_assert assert
+
+// Stand-ins for the parts of sync.h that timestamp.h uses; the real header depends upon PSL1GHT:
+#define rsxgl_sync_H
+
+typedef uint32_t useconds_t;
+
+static uint32_t gpu_label = 0;
+
+static inline volatile uint32_t *
+gcmGetLabelAddress(const uint8_t)
+{
+  return &gpu_label;
+}
+
+static inline uint32_t
+rsxgl_sync_value(const uint8_t)
+{
+  return gpu_label;
+}
+
+static inline void
+usleep(useconds_t)
+{
+}
+
+#include "timestamp.h"
+
+struct issued_timestamp {
+  uint32_t timestamp;
+  uint64_t serial;
+};
+
+struct timeline {
+  uint32_t next, cached;
+  uint64_t serial;
+  std::deque< issued_timestamp > in_flight;
+
+  timeline() : next(1), cached(0), serial(0) {
+  }
+
+  // Mirrors rsxgl_timestamp_create() & rsxgl_timestamp_post():
+  uint32_t create(const uint32_t count) {
+    uint32_t current = next;
+    if(count > (RSXGL_MAX_TIMESTAMP - current + 1)) current = 1;
+    next = rsxgl_timestamp_next(current + count - 1);
+
+    if(rsxgl_timestamp_distance(next,cached) > (RSXGL_MAX_TIMESTAMP >> 2)) cached = gpu_label;
+
+    for(uint32_t i = 0;i < count;++i) {
+      issued_timestamp t = { current + i, ++serial };
+      in_flight.push_back(t);
+    }
+    return current;
+  }
+
+  // The GPU reaches the oldest in-flight timestamp:
+  void retire() {
+    gpu_label = in_flight.front().timestamp;
+    in_flight.pop_front();
+  }
+};
+
+static uint32_t seed = 1;
+
+static uint32_t
+random_uint32()
+{
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+int
+main(int argc,char ** argv)
+{
+  try {
+    // Basic arithmetic:
+    assert(rsxgl_timestamp_next(1) == 2);
+    assert(rsxgl_timestamp_next(RSXGL_MAX_TIMESTAMP) == 1);
+    assert(rsxgl_timestamp_distance(1,RSXGL_MAX_TIMESTAMP) == 2);
+    assert(!rsxgl_timestamp_pending(0,1,0));
+    assert(!rsxgl_timestamp_pending(5,10,5));
+    assert(rsxgl_timestamp_pending(5,10,6));
+    assert(rsxgl_timestamp_pending(RSXGL_MAX_TIMESTAMP - 1,3,1));
+    assert(!rsxgl_timestamp_pending(2,3,RSXGL_MAX_TIMESTAMP));
+    assert(rsxgl_timestamp_reached(5,0));
+    assert(rsxgl_timestamp_reached(5,5));
+    assert(!rsxgl_timestamp_reached(5,6));
+    assert(rsxgl_timestamp_reached(2,RSXGL_MAX_TIMESTAMP));
+    assert(!rsxgl_timestamp_reached(RSXGL_MAX_TIMESTAMP,2));
+
+    // A copy of next that was taken before the GPU went past it makes the timestamp that was
+    // waited upon look pending again; rsxgl_timestamp_reached doesn't depend upon next:
+    assert(rsxgl_timestamp_pending(20,10,8));
+    assert(rsxgl_timestamp_reached(20,8));
+
+    timeline t;
+
+    // Start close to the end, so that the count starts over in a short while:
+    const uint32_t start = RSXGL_MAX_TIMESTAMP - 100000;
+    t.next = start;
+    gpu_label = start - 1;
+    t.cached = start - 1;
+
+    // An object that was last used a whole count ago; it will be given out again after the
+    // count starts over:
+    const uint32_t stale = 500;
+
+    uint32_t wraps = 0, in_flight_checks = 0, aliased_checks = 0;
+    for(uint32_t i = 0;i < 1000000;++i) {
+      const uint32_t before = t.next;
+      t.create(1 + (random_uint32() % 64));
+      if(t.next < before) ++wraps;
+
+      // Let the GPU fall up to a few thousand timestamps behind:
+      while(t.in_flight.size() > 4096 || (!t.in_flight.empty() && (random_uint32() % 3) != 0)) {
+	t.retire();
+      }
+
+      // Every in-flight timestamp is pending; the last one reached isn't:
+      for(size_t j = 0;j < t.in_flight.size();j += 97) {
+	const issued_timestamp & x = t.in_flight[j];
+	assert(!rsxgl_timestamp_passed(t.cached,1,t.next,x.timestamp));
+	assert(!rsxgl_timestamp_reached(gpu_label,x.timestamp));
+	++in_flight_checks;
+      }
+      assert(rsxgl_timestamp_passed(t.cached,1,t.next,gpu_label));
+      assert(rsxgl_timestamp_reached(gpu_label,gpu_label));
+
+      // A stale timestamp only appears to be pending while it aliases an in-flight one:
+      if(!rsxgl_timestamp_passed(t.cached,1,t.next,stale)) {
+	bool aliased = false;
+	for(const issued_timestamp & x : t.in_flight) {
+	  if(x.timestamp == stale) aliased = true;
+	}
+	assert(aliased);
+	++aliased_checks;
+      }
+
+      // Waiting on anything terminates once the GPU has drained what's in flight:
+      if((i % 100000) == 0) {
+	while(!t.in_flight.empty()) t.retire();
+	rsxgl_timestamp_wait(t.cached,1,t.next,stale,0);
+	assert(rsxgl_timestamp_passed(t.cached,1,t.next,stale));
+      }
+    }
+
+    assert(wraps > 0);
+
+    std::cout << "passed: " << wraps << " wraparounds, " << in_flight_checks << " in-flight checks, " << aliased_checks << " aliased" << std::endl;
+  }
+  catch(const assertion & a) {
+    std::cerr << "failed: " << a.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
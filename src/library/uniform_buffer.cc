@@ -0,0 +1,271 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// uniform_buffer.cc - Buffer objects used as the source of uniform block values.
+
+#include "rsxgl_context.h"
+#include "uniform_buffer.h"
+#include "command_list.h"
+#include "deferred_free.h"
+
+#include <rsx/gcm_sys.h>
+#include "nv40.h"
+#include "gl_fifo.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+// Each NV30_3D_VP_UPLOAD_CONST_ID method loads at most this many vec4's:
+static const uint16_t rsxgl_uniform_buffer_stream_columns = 8;
+
+// Generations are numbered across all buffers, so that a program can tell them apart even if a
+// buffer's name is reused:
+static uint32_t rsxgl_uniform_buffer_generation = 0;
+
+uniform_buffer_t::uniform_buffer_t()
+  : size(0), generation(0), uses(0), stale(1), num_streams(0)
+{
+}
+
+uniform_buffer_t::~uniform_buffer_t()
+{
+  // glDeleteBuffers() hands the streams to the deferred free queue, since the GPU may still call
+  // them; any that are left belong to an object context that's being destroyed:
+  for(uint8_t i = 0;i < num_streams;++i) {
+    rsxgl_command_buffer_free(streams[i].address);
+    if(streams[i].retired != 0) rsxgl_command_buffer_free(streams[i].retired);
+  }
+}
+
+static inline uint32_t
+rsxgl_uniform_buffer_stream_length(const uint16_t num_columns)
+{
+  const uint32_t nchunks = (num_columns + rsxgl_uniform_buffer_stream_columns - 1) / rsxgl_uniform_buffer_stream_columns;
+  return (nchunks * 2) + (num_columns * 4) + 1;
+}
+
+void
+rsxgl_uniform_buffer_release(rsxgl_context_t * ctx,buffer_t & buffer)
+{
+  if(buffer.uniforms == 0) return;
+
+  uniform_buffer_t & uniform_buffer = *buffer.uniforms;
+
+  for(uint8_t i = 0;i < uniform_buffer.num_streams;++i) {
+    uniform_buffer_t::stream_t & stream = uniform_buffer.streams[i];
+    const rsx_size_t nbytes = rsxgl_uniform_buffer_stream_length(stream.num_columns) * sizeof(uint32_t);
+
+    rsxgl_deferred_free_command_buffer(ctx,stream.timestamp,stream.address,nbytes);
+    if(stream.retired != 0) {
+      rsxgl_deferred_free_command_buffer(ctx,stream.retired_timestamp,stream.retired,nbytes);
+    }
+  }
+  uniform_buffer.num_streams = 0;
+}
+
+static void
+rsxgl_uniform_buffer_stream_format(const uniform_buffer_t & uniform_buffer,uniform_buffer_t::stream_t & stream)
+{
+  uint32_t * buffer = stream.address;
+
+  const ieee32_t * values = uniform_buffer.values.get();
+  const rsx_size_t nvalues = uniform_buffer.size / sizeof(ieee32_t);
+  rsx_size_t ivalue = stream.buffer_offset / sizeof(ieee32_t);
+
+  for(uint16_t column = 0;column < stream.num_columns;column += rsxgl_uniform_buffer_stream_columns) {
+    const uint16_t n = std::min((uint16_t)(stream.num_columns - column),rsxgl_uniform_buffer_stream_columns);
+
+    gcm_emit_method(&buffer,NV30_3D_VP_UPLOAD_CONST_ID,1 + (n * 4));
+    gcm_emit(&buffer,stream.vp_index + column);
+
+    // Whatever lies past the end of the buffer reads as 0:
+    for(uint16_t i = 0,m = n * 4;i < m;++i,++ivalue) {
+      gcm_emit(&buffer,(ivalue < nvalues) ? values[ivalue].u : 0);
+    }
+  }
+
+  gcm_emit(&buffer,gcm_return_cmd());
+
+  stream.generation = uniform_buffer.generation;
+}
+
+uniform_buffer_t &
+rsxgl_uniform_buffer(rsxgl_context_t * ctx,buffer_t & buffer)
+{
+  if(buffer.uniforms == 0) {
+    buffer.uniforms = new uniform_buffer_t();
+  }
+
+  uniform_buffer_t & uniform_buffer = *buffer.uniforms;
+
+  if(uniform_buffer.stale) {
+    // The GPU may still be writing to the buffer:
+    if(buffer.timestamp > 0) {
+      rsxgl_timestamp_wait(ctx,buffer.timestamp);
+      buffer.timestamp = 0;
+    }
+
+    if(uniform_buffer.size != buffer.size) {
+      uniform_buffer.values.reset(new ieee32_t[(buffer.size + sizeof(ieee32_t) - 1) / sizeof(ieee32_t)]);
+      uniform_buffer.size = buffer.size;
+    }
+
+    const void * address = (buffer.size > 0) ? rsxgl_arena_address(memory_arena_t::storage().at(buffer.arena),buffer.memory) : 0;
+    if(address != 0) {
+      memcpy(uniform_buffer.values.get(),address,buffer.size);
+    }
+
+    uniform_buffer.stale = 0;
+    uniform_buffer.generation = ++rsxgl_uniform_buffer_generation;
+  }
+
+  return uniform_buffer;
+}
+
+void
+rsxgl_uniform_buffer_data(buffer_t & buffer,const rsx_size_t offset,const rsx_size_t size,const void * data)
+{
+  if(buffer.uniforms == 0) return;
+
+  uniform_buffer_t & uniform_buffer = *buffer.uniforms;
+
+  // Reallocated by glBufferData():
+  if(uniform_buffer.size != buffer.size && offset == 0 && size == buffer.size) {
+    uniform_buffer.values.reset(new ieee32_t[(buffer.size + sizeof(ieee32_t) - 1) / sizeof(ieee32_t)]);
+    uniform_buffer.size = buffer.size;
+    uniform_buffer.stale = 0;
+  }
+
+  if(uniform_buffer.stale || uniform_buffer.size != buffer.size || data == 0) {
+    uniform_buffer.stale = 1;
+  }
+  else {
+    memcpy((uint8_t *)uniform_buffer.values.get() + offset,data,size);
+  }
+
+  uniform_buffer.generation = ++rsxgl_uniform_buffer_generation;
+}
+
+void
+rsxgl_uniform_buffer_invalidate(buffer_t & buffer)
+{
+  if(buffer.uniforms == 0) return;
+
+  buffer.uniforms -> stale = 1;
+  buffer.uniforms -> generation = ++rsxgl_uniform_buffer_generation;
+}
+
+// Free a stream's previous contents once the GPU is done with them, or right away if wait is set:
+static inline void
+rsxgl_uniform_buffer_stream_free_retired(rsxgl_context_t * ctx,uniform_buffer_t::stream_t & stream,const bool wait)
+{
+  if(stream.retired == 0) return;
+
+  if(wait) {
+    rsxgl_timestamp_wait(ctx,stream.retired_timestamp);
+  }
+  else if(!rsxgl_timestamp_passed(ctx,stream.retired_timestamp)) {
+    return;
+  }
+
+  rsxgl_command_buffer_free(stream.retired);
+  stream.retired = 0;
+}
+
+const uniform_buffer_t::stream_t *
+rsxgl_uniform_buffer_stream(rsxgl_context_t * ctx,uniform_buffer_t & uniform_buffer,const rsx_size_t buffer_offset,const uint16_t vp_index,const uint16_t num_columns,const uint32_t timestamp)
+{
+  uniform_buffer_t::stream_t * stream = 0;
+
+  for(uint8_t i = 0;i < uniform_buffer.num_streams;++i) {
+    uniform_buffer_t::stream_t & s = uniform_buffer.streams[i];
+    if(s.buffer_offset == buffer_offset && s.vp_index == vp_index && s.num_columns == num_columns) {
+      stream = &s;
+      break;
+    }
+  }
+
+  if(stream == 0) {
+    // Make a new one, or replace the one that was used longest ago:
+    if(uniform_buffer.num_streams < RSXGL_MAX_UNIFORM_BUFFER_STREAMS) {
+      stream = uniform_buffer.streams + uniform_buffer.num_streams;
+      stream -> address = 0;
+      stream -> timestamp = 0;
+      stream -> retired = 0;
+    }
+    else {
+      stream = uniform_buffer.streams;
+      for(uint8_t i = 1;i < uniform_buffer.num_streams;++i) {
+	if((uniform_buffer.uses - uniform_buffer.streams[i].last_used) > (uniform_buffer.uses - stream -> last_used)) {
+	  stream = uniform_buffer.streams + i;
+	}
+      }
+
+      if(stream -> timestamp > 0) {
+	rsxgl_timestamp_wait(ctx,stream -> timestamp);
+	stream -> timestamp = 0;
+      }
+      rsxgl_uniform_buffer_stream_free_retired(ctx,*stream,true);
+
+      if(rsxgl_uniform_buffer_stream_length(stream -> num_columns) != rsxgl_uniform_buffer_stream_length(num_columns)) {
+	rsxgl_command_buffer_free(stream -> address);
+	stream -> address = 0;
+      }
+    }
+
+    if(stream -> address == 0) {
+      stream -> address = rsxgl_command_buffer_allocate(rsxgl_uniform_buffer_stream_length(num_columns));
+      if(stream -> address == 0) {
+	// Drop a replaced stream entirely:
+	if(stream != uniform_buffer.streams + uniform_buffer.num_streams) {
+	  *stream = uniform_buffer.streams[--uniform_buffer.num_streams];
+	}
+	return 0;
+      }
+
+      int32_t s = gcmAddressToOffset(stream -> address,&stream -> offset);
+      rsxgl_assert(s == 0);
+    }
+
+    if(stream == uniform_buffer.streams + uniform_buffer.num_streams) {
+      ++uniform_buffer.num_streams;
+    }
+
+    stream -> buffer_offset = buffer_offset;
+    stream -> vp_index = vp_index;
+    stream -> num_columns = num_columns;
+    rsxgl_uniform_buffer_stream_format(uniform_buffer,*stream);
+  }
+  else if(stream -> generation != uniform_buffer.generation) {
+    rsxgl_uniform_buffer_stream_free_retired(ctx,*stream,false);
+
+    // If the GPU may still call the stream, format the new contents into another block of memory
+    // rather than wait, and keep the old one until the GPU is done with it:
+    if(stream -> timestamp > 0 && !rsxgl_timestamp_passed(ctx,stream -> timestamp)) {
+      rsxgl_uniform_buffer_stream_free_retired(ctx,*stream,true);
+
+      uint32_t * address = rsxgl_command_buffer_allocate(rsxgl_uniform_buffer_stream_length(stream -> num_columns));
+      if(address != 0) {
+	stream -> retired = stream -> address;
+	stream -> retired_timestamp = stream -> timestamp;
+	stream -> address = address;
+
+	int32_t s = gcmAddressToOffset(stream -> address,&stream -> offset);
+	rsxgl_assert(s == 0);
+      }
+      else {
+	rsxgl_timestamp_wait(ctx,stream -> timestamp);
+      }
+    }
+    stream -> timestamp = 0;
+
+    rsxgl_uniform_buffer_stream_format(uniform_buffer,*stream);
+  }
+
+  stream -> timestamp = timestamp;
+  stream -> last_used = ++uniform_buffer.uses;
+
+  return stream;
+}
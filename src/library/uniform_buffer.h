@@ -0,0 +1,83 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// uniform_buffer.h - Buffer objects used as the source of uniform block values.
+//
+// A buffer that's bound to a GL_UNIFORM_BUFFER binding point, and read by a program's uniform
+// block, keeps a copy of its contents in main memory, and a handful of "streams" - the
+// NV30_3D_VP_UPLOAD_CONST_ID methods that load a range of the buffer into vertex program
+// constants, pre-formatted in GPU-visible memory & ending in a "return" command. Sending such a
+// block to the vertex program then costs a single FIFO "call" command.
+
+#ifndef rsxgl_uniform_buffer_H
+#define rsxgl_uniform_buffer_H
+
+#include "gl_constants.h"
+#include "rsxgl_limits.h"
+#include "buffer.h"
+#include "ieee32_t.h"
+
+#include <memory>
+
+struct rsxgl_context_t;
+
+struct uniform_buffer_t {
+  struct stream_t {
+    uint32_t * address;
+    uint32_t offset;
+
+    /// \brief What the stream uploads - columns starting at buffer_offset, to the vertex program constants starting at vp_index:
+    rsx_size_t buffer_offset;
+    uint16_t vp_index, num_columns;
+
+    /// \brief The uniform buffer's generation when the stream was formatted:
+    uint32_t generation;
+
+    /// \brief Last draw that called the stream, and when it was last looked up:
+    uint32_t timestamp, last_used;
+
+    /// \brief Previous contents, kept until the GPU is done calling them:
+    uint32_t * retired;
+    uint32_t retired_timestamp;
+  };
+
+  /// \brief Copy of the buffer's contents:
+  std::unique_ptr< ieee32_t[] > values;
+  rsx_size_t size;
+
+  /// \brief Changes each time the buffer's contents do; numbered across all buffers:
+  uint32_t generation;
+
+  /// \brief Counts lookups, to find the least-recently used stream:
+  uint32_t uses;
+
+  /// \brief The copy needs to be re-read from the buffer (written by glMapBuffer() or glCopyBufferSubData()):
+  uint8_t stale:1;
+
+  uint8_t num_streams;
+  stream_t streams[RSXGL_MAX_UNIFORM_BUFFER_STREAMS];
+
+  uniform_buffer_t();
+  ~uniform_buffer_t();
+};
+
+// Returns the buffer's uniform_buffer_t, creating it if this is the first time the buffer is
+// used by a uniform block. The copy is re-read from the buffer if it's stale:
+uniform_buffer_t & rsxgl_uniform_buffer(rsxgl_context_t *,buffer_t &);
+
+// Called by glBufferData() & glBufferSubData() once the buffer's memory has been written:
+void rsxgl_uniform_buffer_data(buffer_t &,const rsx_size_t,const rsx_size_t,const void *);
+
+// Called when the buffer's memory is written by something other than the CPU:
+void rsxgl_uniform_buffer_invalidate(buffer_t &);
+
+// Called by glDeleteBuffers(); frees the buffer's streams once the GPU is done calling them:
+void rsxgl_uniform_buffer_release(rsxgl_context_t *,buffer_t &);
+
+// Returns a stream that loads num_columns vec4's, starting at buffer_offset, into the vertex
+// program constants starting at vp_index; returns 0 if there's no room for it:
+const uniform_buffer_t::stream_t * rsxgl_uniform_buffer_stream(rsxgl_context_t *,uniform_buffer_t &,const rsx_size_t,const uint16_t,const uint16_t,const uint32_t);
+
+#endif
@@ -9,6 +9,7 @@
 #include "rsxgl_context.h"
 #include "gl_constants.h"
 #include "uniforms.h"
+#include "uniform_buffer.h"
 
 #include <GL3/gl3.h>
 #include "error.h"
@@ -18,6 +19,8 @@
 #include "gl_fifo.h"
 #include "ieee32_t.h"
 
+#include <string.h>
+
 #if defined(GLAPI)
 #undef GLAPI
 #endif
@@ -96,6 +99,33 @@ get_gpu_data(const ieee32_t & lhs,float & rhs) {
   rhs = lhs.f;
 }
 
+// Store rhs in lhs, returning true if that changed lhs. Values are compared bitwise, as the GPU
+// would see them:
+template< typename Type >
+static inline bool
+update_gpu_data(ieee32_t & lhs,const Type rhs) {
+  ieee32_t tmp;
+  set_gpu_data(tmp,rhs);
+  const bool changed = (tmp.u != lhs.u);
+  lhs.u = tmp.u;
+  return changed;
+}
+
+// Called once a glUniform*() call's values have been stored; skips the upload if none of them
+// changed:
+static inline void
+rsxgl_uniform_update(rsxgl_context_t * ctx,program_t & program,const program_t::uniform_size_type location,const bool changed)
+{
+  if(!changed) {
+    ++ctx -> uniform_statistics.redundant_updates;
+    return;
+  }
+
+  ++ctx -> uniform_statistics.updates;
+  rsxgl_uniform_invalidate(program,location,RSXGL_VERTEX_SHADER);
+  rsxgl_uniform_invalidate(program,location,RSXGL_FRAGMENT_SHADER);
+}
+
 template< typename Type, size_t Width, rsxgl_data_types RSXGLType >
 static inline void
 rsxgl_uniform(rsxgl_context_t * ctx,
@@ -103,7 +133,7 @@ rsxgl_uniform(rsxgl_context_t * ctx,
 	      GLint location,
 	      const Type & v0 = 0,const Type & v1 = 0,const Type & v2 = 0,const Type & v3 = 0)
 {
-  if(program_name == 0 || !program_t::storage().is_object(program_name)) {
+  if(RSXGL_CHECK_ERRORS() && (program_name == 0 || !program_t::storage().is_object(program_name))) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -113,24 +143,23 @@ rsxgl_uniform(rsxgl_context_t * ctx,
 
   program_t & program = program_t::storage().at(program_name);
 
-  if(location >= program.uniforms.size()) {
+  if(RSXGL_CHECK_ERRORS() && location >= program.uniforms.size()) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
   program_t::uniform_t & uniform = program.uniforms[location].second;
 
-  if(uniform.type != RSXGLType) {
+  if(RSXGL_CHECK_ERRORS() && uniform.type != RSXGLType) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
-  program.invalid_uniforms = 1;
-  uniform.invalid = uniform.enabled;
-
   ieee32_t * values = program.uniform_values.get() + uniform.values_index;
-  set_gpu_data(values[0],v0);
-  if(Width > 1) set_gpu_data(values[1],v1);
-  if(Width > 2) set_gpu_data(values[2],v2);
-  if(Width > 3) set_gpu_data(values[3],v3);
+  bool changed = update_gpu_data(values[0],v0);
+  if(Width > 1) changed |= update_gpu_data(values[1],v1);
+  if(Width > 2) changed |= update_gpu_data(values[2],v2);
+  if(Width > 3) changed |= update_gpu_data(values[3],v3);
+
+  rsxgl_uniform_update(ctx,program,location,changed);
 
   RSXGL_NOERROR_();
 }
@@ -142,7 +171,7 @@ rsxgl_uniform(rsxgl_context_t * ctx,
 	      GLint location,GLsizei count,GLboolean transpose,
 	      const Type * v)
 {
-  if(program_name == 0 || !program_t::storage().is_object(program_name)) {
+  if(RSXGL_CHECK_ERRORS() && (program_name == 0 || !program_t::storage().is_object(program_name))) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -152,24 +181,22 @@ rsxgl_uniform(rsxgl_context_t * ctx,
 
   program_t & program = program_t::storage().at(program_name);
 
-  if(location >= program.uniforms.size()) {
+  if(RSXGL_CHECK_ERRORS() && location >= program.uniforms.size()) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
   program_t::uniform_t & uniform = program.uniforms[location].second;
 
-  if(uniform.type != RSXGLType) {
+  if(RSXGL_CHECK_ERRORS() && uniform.type != RSXGLType) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
-  if((Height * count) > uniform.count) {
+  if(RSXGL_CHECK_ERRORS() && (Height * count) > uniform.count) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
-  program.invalid_uniforms = 1;
-  uniform.invalid = uniform.enabled;
-
   ieee32_t * values = program.uniform_values.get() + uniform.values_index;
+  bool changed = false;
 
   //rsxgl_debug_printf("%s: %u: ",__PRETTY_FUNCTION__,uniform.values_index);
 
@@ -177,7 +204,7 @@ rsxgl_uniform(rsxgl_context_t * ctx,
     for(program_t::uniform_size_type n = count;n > 0;--n) {
       for(size_t i = 0;i < Width;++i) {
 	for(size_t j = 0;j < Height;++j,++values) {
-	  set_gpu_data(*values,v[(j * Width) + i]);
+	  changed |= update_gpu_data(*values,v[(j * Width) + i]);
 	}
       }
       v += Width * Height;
@@ -186,12 +213,14 @@ rsxgl_uniform(rsxgl_context_t * ctx,
   else {
     for(program_t::uniform_size_type n = Width * Height * count;n > 0;--n,++values,++v) {
       //rsxgl_debug_printf("%f ",*v);
-      set_gpu_data(*values,*v);
+      changed |= update_gpu_data(*values,*v);
     }
   }
 
   //rsxgl_debug_printf("\n");
 
+  rsxgl_uniform_update(ctx,program,location,changed);
+
   RSXGL_NOERROR_();
 }
 
@@ -201,7 +230,7 @@ rsxgl_sampler_uniform(rsxgl_context_t * ctx,
 		      GLint location,
 		      const GLint & v0 = 0)
 {
-  if(program_name == 0 || !program_t::storage().is_object(program_name)) {
+  if(RSXGL_CHECK_ERRORS() && (program_name == 0 || !program_t::storage().is_object(program_name))) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -213,7 +242,7 @@ rsxgl_sampler_uniform(rsxgl_context_t * ctx,
 
   const GLint texture_location = location - program.uniforms.size();
 
-  if(texture_location < 0 || texture_location >= program.sampler_uniforms.size()) {
+  if(RSXGL_CHECK_ERRORS() && (texture_location < 0 || texture_location >= program.sampler_uniforms.size())) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -547,57 +576,134 @@ rsxgl_inline_transfer(gcmContextData * context,const uint32_t offset,const uint3
   gcm_finish_commands(context,&buffer);
 }
 
+// Give the members of each uniform block that has a buffer bound to it the buffer's values.
+// Vertex program constants are sent by calling the buffer's pre-formatted upload stream if the
+// block's members occupy consecutive constants; otherwise they're added to the dirty list, as
+// are the members used by the fragment program, whose microcode gets patched:
+static void
+rsxgl_uniform_blocks_validate(rsxgl_context_t * ctx,program_t & program,const uint32_t timestamp)
+{
+  gcmContextData * context = ctx -> base.gcm_context;
+  ieee32_t * values = program.uniform_values.get();
+
+  for(auto & name_block : program.uniform_blocks) {
+    program_t::uniform_block_t & block = name_block.second;
+
+    // Without a buffer, the members keep whatever values glUniform*() gave them:
+    const buffer_t::name_type buffer_name = ctx -> buffer_binding.names[RSXGL_UNIFORM_BUFFER0 + block.binding];
+    if(buffer_name == 0) {
+      block.buffer = 0;
+      continue;
+    }
+
+    buffer_t & buffer = ctx -> buffer_binding[RSXGL_UNIFORM_BUFFER0 + block.binding];
+    const rsx_size_t buffer_offset = ctx -> buffer_binding_offset_size[RSXGL_UNIFORM_BUFFER_RANGE0 + block.binding].first;
+    uniform_buffer_t & uniform_buffer = rsxgl_uniform_buffer(ctx,buffer);
+
+    const bool changed = !(block.buffer == buffer_name && block.buffer_offset == buffer_offset && block.generation == uniform_buffer.generation);
+    if(!changed && !block.invalid) continue;
+
+    block.buffer = buffer_name;
+    block.buffer_offset = buffer_offset;
+    block.generation = uniform_buffer.generation;
+
+    const program_t::uniform_size_type * members = program.uniform_block_members.get() + block.members_index;
+    const ieee32_t * buffer_values = uniform_buffer.values.get();
+    const rsx_size_t num_buffer_values = uniform_buffer.size / sizeof(ieee32_t);
+
+    if(changed) {
+      for(program_t::uniform_size_type i = 0;i < block.num_members;++i) {
+	program_t::uniform_t & uniform = program.uniforms[members[i]].second;
+	const program_t::uniform_size_type width = rsxgl_uniform_width(uniform.type);
+
+	ieee32_t * pvalues = values + uniform.values_index;
+	rsx_size_t ivalue = (buffer_offset / sizeof(ieee32_t)) + (uniform.block_column * 4);
+	bool member_changed = false;
+
+	for(program_t::uniform_size_type j = 0;j < uniform.count;++j,ivalue += 4) {
+	  for(program_t::uniform_size_type k = 0;k < width;++k,++pvalues) {
+	    const uint32_t value = ((ivalue + k) < num_buffer_values) ? buffer_values[ivalue + k].u : 0;
+	    member_changed = member_changed || (pvalues -> u != value);
+	    pvalues -> u = value;
+	  }
+	}
+
+	if(member_changed) {
+	  rsxgl_uniform_invalidate(program,members[i],RSXGL_FRAGMENT_SHADER);
+	  if(!block.vp_contiguous) {
+	    rsxgl_uniform_invalidate(program,members[i],RSXGL_VERTEX_SHADER);
+	  }
+	}
+      }
+    }
+
+    if(block.vp_contiguous) {
+      // A command list that's being recorded mustn't call memory that may be reformatted or freed
+      // before the list is replayed:
+      const uniform_buffer_t::stream_t * stream = (ctx -> command_list_recorder == 0) ?
+	rsxgl_uniform_buffer_stream(ctx,uniform_buffer,buffer_offset,block.vp_index,block.num_columns,timestamp) :
+	0;
+
+      if(stream != 0) {
+	uint32_t * buffer = gcm_reserve(context,1);
+	gcm_emit_at(buffer,0,gcm_call_cmd(stream -> offset));
+	gcm_finish_n_commands(context,1);
+
+	for(program_t::uniform_size_type i = 0;i < block.num_members;++i) {
+	  rsxgl_uniform_sent(program,members[i],RSXGL_VERTEX_SHADER);
+	}
+
+	++ctx -> uniform_statistics.block_calls;
+      }
+      else {
+	for(program_t::uniform_size_type i = 0;i < block.num_members;++i) {
+	  rsxgl_uniform_invalidate(program,members[i],RSXGL_VERTEX_SHADER);
+	}
+      }
+    }
+
+    block.invalid = 0;
+  }
+}
+
 void
-rsxgl_uniforms_validate(rsxgl_context_t * ctx,program_t & program)
+rsxgl_uniforms_validate(rsxgl_context_t * ctx,program_t & program,const uint32_t timestamp)
 {
+  if(!program.uniform_blocks.empty()) {
+    rsxgl_uniform_blocks_validate(ctx,program,timestamp);
+  }
+
+  // Changes are tracked from the first time specialization is enabled, so that the images stay in
+  // sync if it's disabled again:
+  bool fp_invalid = false;
+  if(ctx -> state.enable.program_specialization || program.fp_uniform_history) {
+    fp_invalid = rsxgl_program_specialize(ctx,program,timestamp);
+  }
+
   if(program.invalid_uniforms) {
     gcmContextData * context = ctx -> base.gcm_context;
 
     //rsxgl_debug_printf("invalid uniforms:\n");
     
-    auto puniform = program.uniforms.begin();
-    //const char * names = program.names_data;
-
     const ieee32_t * values = program.uniform_values.get();
 
-    program_t::uniform_size_type n_validated_fp_uniforms = 0;
-
-    for(program_t::uniform_size_type i = 0,n = program.uniforms.size();i < n;++i,++puniform) {
-      program_t::uniform_t & uniform = puniform -> second;
-
-      program_t::uniform_size_type width = 0;
-      switch(uniform.type) {
-      case RSXGL_DATA_TYPE_FLOAT:
-	width = 1;
-	break;
-      case RSXGL_DATA_TYPE_FLOAT2:
-	width = 2;
-	break;
-      case RSXGL_DATA_TYPE_FLOAT3:
-	width = 3;
-	break;
-      case RSXGL_DATA_TYPE_FLOAT4:
-	width = 4;
-	break;
-      case RSXGL_DATA_TYPE_FLOAT4x4:
-	width = 4;
-	break;
-      case RSXGL_DATA_TYPE_SAMPLER1D:
-      case RSXGL_DATA_TYPE_SAMPLER2D:
-      case RSXGL_DATA_TYPE_SAMPLER3D:
-      case RSXGL_DATA_TYPE_SAMPLERCUBE:
-      case RSXGL_DATA_TYPE_SAMPLERRECT:
-	width = 1;
-      default:
-	width = 0;
-	break;
-      }
+    // Offsets into the microcode that draws use:
+    const program_t::instruction_size_type * program_offsets = (program.fp_active_variant < 0) ?
+      program.program_offsets.get() :
+      program.fp_variants[program.fp_active_variant].program_offsets.data();
+
+    for(program_t::uniform_size_type i = 0,n = program.num_dirty_uniforms;i < n;++i) {
+      program_t::uniform_t & uniform = program.uniforms[program.dirty_uniforms[i]].second;
+
+      const program_t::uniform_size_type width = rsxgl_uniform_width(uniform.type);
 
       const program_t::uniform_size_type count = uniform.count;
 
       if(uniform.invalid.any()) {
 	//rsxgl_debug_printf("\t%u invalid\n",i);
 
+	++ctx -> uniform_statistics.uploads;
+
 	if(uniform.invalid.test(RSXGL_VERTEX_SHADER)) {
 	  const ieee32_t * pvalues = values + uniform.values_index;
 
@@ -637,32 +743,53 @@ rsxgl_uniforms_validate(rsxgl_context_t * ctx,program_t & program)
 	  //rsxgl_debug_printf("fp ");
 
 	  const ieee32_t * pvalues = values + uniform.values_index;
-	  const program_t::instruction_size_type * pfp_offsets = program.program_offsets.get() + uniform.program_offsets_index;
+	  const program_t::instruction_size_type * pfp_offsets = program_offsets + uniform.program_offsets_index;
 
+	  // Columns that a variant has folded, or optimized away, have no offset:
 	  for(program_t::uniform_size_type j = 0;j < count;++j,pvalues += width) {
 	    for(program_t::instruction_size_type offsets_count = *pfp_offsets++;offsets_count > 0;--offsets_count,++pfp_offsets) {
-	      rsxgl_inline_transfer(context,rsxgl_rsx_ucode_offset(program.fp_ucode_offset + *pfp_offsets++),width,pvalues);
+	      if(*pfp_offsets == (program_t::instruction_size_type)~0) continue;
+	      rsxgl_inline_transfer(context,rsxgl_rsx_ucode_offset(program.fp_active_ucode_offset + *pfp_offsets),width,pvalues);
 	    }
 	  }
 
-	  ++n_validated_fp_uniforms;
+	  fp_invalid = true;
 	}
 
 	//rsxgl_debug_printf("\n");
 
 	uniform.invalid.reset();
       }
+
+      uniform.listed = 0;
     }
 
-    if(n_validated_fp_uniforms > 0) {
-      uint32_t * buffer = gcm_reserve(context,2);
+    program.num_dirty_uniforms = 0;
+    program.invalid_uniforms = 0;
+  }
 
-      gcm_emit_method(&buffer,NV30_3D_FP_ACTIVE_PROGRAM,1);
-      gcm_emit(&buffer,rsxgl_rsx_ucode_offset(program.fp_ucode_offset) | NV30_3D_FP_ACTIVE_PROGRAM_DMA0);
+  // Patched microcode is only read again once it's made active again:
+  if(fp_invalid) {
+    gcmContextData * context = ctx -> base.gcm_context;
+    uint32_t * buffer = gcm_reserve(context,2);
 
-      gcm_finish_commands(context,&buffer);
-    }
+    gcm_emit_method(&buffer,NV30_3D_FP_ACTIVE_PROGRAM,1);
+    gcm_emit(&buffer,rsxgl_rsx_ucode_offset(program.fp_active_ucode_offset) | NV30_3D_FP_ACTIVE_PROGRAM_DMA0);
 
-    program.invalid_uniforms = 0;
+    gcm_finish_commands(context,&buffer);
+  }
+}
+
+extern "C" void
+rsxglGetUniformStatistics(struct rsxgl_uniform_statistics_t * statistics,int reset)
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(statistics != 0) {
+    *statistics = ctx -> uniform_statistics;
+  }
+
+  if(reset) {
+    memset(&ctx -> uniform_statistics,0,sizeof(ctx -> uniform_statistics));
   }
 }
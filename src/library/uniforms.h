@@ -14,6 +14,52 @@
 
 struct rsxgl_context_t;
 
-void rsxgl_uniforms_validate(rsxgl_context_t *,program_t &);
+// Number of components in each column of a uniform:
+static inline program_t::uniform_size_type
+rsxgl_uniform_width(const uint8_t type)
+{
+  switch(type) {
+  case RSXGL_DATA_TYPE_FLOAT:
+    return 1;
+  case RSXGL_DATA_TYPE_FLOAT2:
+    return 2;
+  case RSXGL_DATA_TYPE_FLOAT3:
+    return 3;
+  case RSXGL_DATA_TYPE_FLOAT4:
+  case RSXGL_DATA_TYPE_FLOAT4x4:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+// Mark a uniform as needing to be sent to one of the program's shaders (if that shader uses it),
+// adding it to the program's list of dirty uniforms. The list is sized for one entry per
+// uniform, so a uniform is only added if it isn't listed already - it stays listed until the
+// list is emptied, even if something else sends its values in the meantime:
+static inline void
+rsxgl_uniform_invalidate(program_t & program,const program_t::uniform_size_type location,const size_t shader)
+{
+  program_t::uniform_t & uniform = program.uniforms[location].second;
+
+  if(!uniform.enabled.test(shader) || uniform.invalid.test(shader)) return;
+
+  if(!uniform.listed) {
+    program.dirty_uniforms[program.num_dirty_uniforms++] = location;
+    uniform.listed = 1;
+  }
+  uniform.invalid.set(shader);
+  program.invalid_uniforms = 1;
+}
+
+// Mark a uniform as having been sent to one of the program's shaders by other means (such as a
+// uniform buffer's stream); it stays listed:
+static inline void
+rsxgl_uniform_sent(program_t & program,const program_t::uniform_size_type location,const size_t shader)
+{
+  program.uniforms[location].second.invalid.reset(shader);
+}
+
+void rsxgl_uniforms_validate(rsxgl_context_t *,program_t &,const uint32_t);
 
 #endif
@@ -0,0 +1,177 @@
+// "Unit testing" for the program's list of dirty uniforms, kept by rsxgl_uniform_invalidate()
+// and rsxgl_uniform_sent(). Meant to be built & run on the host, e.g.:
+//
+// g++ -std=c++11 -I. uniforms_unit_tests.cc -o uniforms_unit_tests
+//
+// The list is sized for one entry per uniform; each uniform needs to be listed at most once,
+// and listed whenever one of its shaders needs its values, whatever order the program is
+// bound, its uniform blocks are sent by calling a stream, and its fragment program variant is
+// switched in.
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <memory>
+#include <vector>
+#include <utility>
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+
+#include "bit_set.h"
+
+// Stand-in for the parts of program.h that uniforms.h uses; the real header depends upon Mesa:
+#define rsxgl_program_H
+
+#define RSXGL_VERTEX_SHADER 0
+#define RSXGL_FRAGMENT_SHADER 1
+#define RSXGL_MAX_SHADER_TYPES 2
+
+#define RSXGL_DATA_TYPE_FLOAT 0
+#define RSXGL_DATA_TYPE_FLOAT2 1
+#define RSXGL_DATA_TYPE_FLOAT3 2
+#define RSXGL_DATA_TYPE_FLOAT4 3
+#define RSXGL_DATA_TYPE_FLOAT4x4 4
+
+struct program_t {
+  typedef uint16_t uniform_size_type;
+
+  struct uniform_t {
+    uint8_t type;
+    bit_set< RSXGL_MAX_SHADER_TYPES > invalid, enabled;
+    uint8_t listed;
+  };
+
+  std::vector< std::pair< uint32_t, uniform_t > > uniforms;
+  std::unique_ptr< uniform_size_type[] > dirty_uniforms;
+  uniform_size_type num_dirty_uniforms;
+  uint8_t invalid_uniforms;
+};
+
+#define rsxgl_gl_constants_H
+#define rsxgl_limits_H
+
+#include "uniforms.h"
+
+// What rsxgl_uniforms_validate() does with the list, minus sending the values:
+static void
+validate(program_t & program)
+{
+  for(program_t::uniform_size_type i = 0;i < program.num_dirty_uniforms;++i) {
+    program_t::uniform_t & uniform = program.uniforms[program.dirty_uniforms[i]].second;
+    uniform.invalid.reset();
+    uniform.listed = 0;
+  }
+  program.num_dirty_uniforms = 0;
+  program.invalid_uniforms = 0;
+}
+
+// Each uniform is listed at most once, and listed if it's invalid:
+static void
+check(const program_t & program)
+{
+  const size_t n = program.uniforms.size();
+  assert(program.num_dirty_uniforms <= n);
+
+  std::vector< int > times_listed(n,0);
+  for(program_t::uniform_size_type i = 0;i < program.num_dirty_uniforms;++i) {
+    assert(program.dirty_uniforms[i] < n);
+    ++times_listed[program.dirty_uniforms[i]];
+  }
+
+  for(size_t i = 0;i < n;++i) {
+    const program_t::uniform_t & uniform = program.uniforms[i].second;
+    assert(times_listed[i] <= 1);
+    assert(times_listed[i] == (uniform.listed ? 1 : 0));
+    if(uniform.invalid.any()) {
+      assert(uniform.listed);
+    }
+  }
+}
+
+int
+main(int argc,char ** argv)
+{
+  try {
+    // Uniforms that both shaders use, as the members of a uniform block do:
+    const program_t::uniform_size_type num_uniforms = 8;
+
+    program_t program;
+    program.uniforms.resize(num_uniforms);
+    for(program_t::uniform_size_type i = 0;i < num_uniforms;++i) {
+      program_t::uniform_t & uniform = program.uniforms[i].second;
+      program.uniforms[i].first = i;
+      uniform.type = RSXGL_DATA_TYPE_FLOAT4;
+      uniform.enabled.set(RSXGL_VERTEX_SHADER);
+      uniform.enabled.set(RSXGL_FRAGMENT_SHADER);
+      uniform.listed = 0;
+    }
+    // One more entry than the library allocates, so that an overflow is caught by check():
+    program.dirty_uniforms.reset(new program_t::uniform_size_type[num_uniforms + 1]);
+    program.num_dirty_uniforms = 0;
+    program.invalid_uniforms = 0;
+
+    // Binding the program lists every vertex program uniform:
+    for(program_t::uniform_size_type i = 0;i < num_uniforms;++i) {
+      rsxgl_uniform_invalidate(program,i,RSXGL_VERTEX_SHADER);
+    }
+    check(program);
+    assert(program.num_dirty_uniforms == num_uniforms);
+
+    // The uniform block is sent by calling a stream, so the vertex program doesn't need them:
+    for(program_t::uniform_size_type i = 0;i < num_uniforms;++i) {
+      rsxgl_uniform_sent(program,i,RSXGL_VERTEX_SHADER);
+    }
+    check(program);
+    assert(program.num_dirty_uniforms == num_uniforms);
+
+    // Switching fragment program variants sends the new image every uniform again:
+    for(program_t::uniform_size_type i = 0;i < num_uniforms;++i) {
+      rsxgl_uniform_invalidate(program,i,RSXGL_FRAGMENT_SHADER);
+      check(program);
+    }
+    assert(program.num_dirty_uniforms == num_uniforms);
+    for(program_t::uniform_size_type i = 0;i < num_uniforms;++i) {
+      assert(program.uniforms[i].second.invalid.test(RSXGL_FRAGMENT_SHADER));
+    }
+
+    validate(program);
+    check(program);
+    assert(program.num_dirty_uniforms == 0);
+
+    // Any interleaving of the three, over a few draws:
+    uint32_t seed = 1;
+    for(uint32_t draw = 0;draw < 10000;++draw) {
+      for(uint32_t j = 0;j < 32;++j) {
+	seed = seed * 1664525u + 1013904223u;
+	const program_t::uniform_size_type location = (seed >> 8) % num_uniforms;
+	const size_t shader = (seed >> 16) & 1;
+	if((seed >> 20) & 1) {
+	  rsxgl_uniform_invalidate(program,location,shader);
+	}
+	else {
+	  rsxgl_uniform_sent(program,location,shader);
+	}
+	check(program);
+      }
+      validate(program);
+    }
+
+    std::cout << "passed" << std::endl;
+  }
+  catch(const assertion & a) {
+    std::cerr << "failed: " << a.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
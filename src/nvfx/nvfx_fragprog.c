@@ -14,6 +14,7 @@
 #include "nvfx_context.h"
 #include "nvfx_shader.h"
 #include "nvfx_resource.h"
+#include "nvfx_optimize.h"
 
 struct nvfx_fpc {
 	struct nvfx_pipe_fragment_program* pfp;
@@ -22,6 +23,7 @@ struct nvfx_fpc {
 	unsigned max_temps;
 	unsigned long long r_temps;
 	unsigned long long r_temps_discard;
+	unsigned long long r_outputs;
 	struct nvfx_reg r_result[PIPE_MAX_SHADER_OUTPUTS];
 	struct nvfx_reg *r_temp;
 	unsigned sprite_coord_temp;
@@ -962,6 +964,7 @@ nvfx_fragprog_parse_decl_output(struct nvfx_context* nvfx, struct nvfx_fpc *fpc,
 
 	fpc->r_result[idx] = nvfx_reg(NVFXSR_OUTPUT, hw);
 	fpc->r_temps |= (1ULL << hw);
+	fpc->r_outputs |= (1ULL << hw);
 	return TRUE;
 }
 
@@ -1044,7 +1047,102 @@ out_err:
 	return FALSE;
 }
 
+/* Packs the temporaries into fewer registers; see nvfx_fp_allocate_temps().
+ * Outputs, and the sprite coordinate temporary that slot relocations refer
+ * to, stay where they are. */
+static void
+nvfx_fragprog_allocate_temps(struct nvfx_context *nvfx, struct nvfx_fpc *fpc)
+{
+	struct nvfx_fragment_program *fp = fpc->fp;
+	struct nvfx_fp_ra ra;
+
+	memset(&ra, 0, sizeof(ra));
+	ra.insn = fp->insn;
+	ra.insn_len = fp->insn_len;
+	ra.reserved = fpc->r_outputs | (1ULL << fpc->sprite_coord_temp);
+	ra.max_temps = fpc->max_temps;
+	ra.max_half = nvfx->use_nv4x ? 64 : 32;
+	ra.num_regs = fpc->num_regs;
+
+	if (nvfx_fp_allocate_temps(&ra))
+		fpc->num_regs = ra.num_regs;
+}
+
+/* Runs nvfx_optimize over the program, and moves the constant & slot
+ * relocations along with the words they refer to. */
+static void
+nvfx_fragprog_optimize(struct nvfx_fpc *fpc)
+{
+	struct nvfx_fragment_program *fp = fpc->fp;
+	struct nvfx_fp_opt opt;
+	struct util_dynarray fixed;
+	unsigned *patched, *remap;
+	unsigned i, j;
+
+	if (!fp->insn_len)
+		return;
+
+	patched = MALLOC(sizeof(unsigned) * (fp->nr_consts + 1));
+	remap = MALLOC(sizeof(unsigned) * fp->insn_len);
+	util_dynarray_init(&fixed);
+	if (!patched || !remap)
+		goto out;
+
+	for (i = 0; i < fp->nr_consts; ++i)
+		patched[i] = fp->consts[i].offset;
+	for (i = 0; i < Elements(fp->slot_relocations); ++i) {
+		unsigned *begin = (unsigned *)fp->slot_relocations[i].data;
+		unsigned *end = (unsigned *)util_dynarray_end(&fp->slot_relocations[i]);
+
+		for (; begin != end; ++begin)
+			util_dynarray_append(&fixed, unsigned, *begin);
+	}
+
+	memset(&opt, 0, sizeof(opt));
+	opt.insn = fp->insn;
+	opt.insn_len = fp->insn_len;
+	opt.live_out = fpc->r_outputs;
+	opt.patched = patched;
+	opt.nr_patched = fp->nr_consts;
+	opt.fixed = (const unsigned *)fixed.data;
+	opt.nr_fixed = fixed.size / sizeof(unsigned);
+	opt.remap = remap;
+
+	if (!nvfx_fp_optimize(&opt, NVFX_OPT_ALL))
+		goto out;
+
+	for (i = 0, j = 0; i < fp->nr_consts; ++i) {
+		if (remap[fp->consts[i].offset] == NVFX_OPT_REMOVED)
+			continue;
+		fp->consts[j].offset = remap[fp->consts[i].offset];
+		fp->consts[j++].index = fp->consts[i].index;
+	}
+	fp->nr_consts = j;
+
+	for (i = 0; i < Elements(fp->slot_relocations); ++i) {
+		unsigned *begin = (unsigned *)fp->slot_relocations[i].data;
+		unsigned *end = (unsigned *)util_dynarray_end(&fp->slot_relocations[i]);
+		unsigned *out = begin;
+
+		for (; begin != end; ++begin) {
+			if (remap[*begin] != NVFX_OPT_REMOVED)
+				*out++ = remap[*begin];
+		}
+		fp->slot_relocations[i].size = (char *)out - (char *)fp->slot_relocations[i].data;
+	}
+
+	fp->insn_len = opt.insn_len;
+	fpc->inst_offset = opt.last;
+
+out:
+	util_dynarray_fini(&fixed);
+	FREE(remap);
+	FREE(patched);
+}
+
 DEBUG_GET_ONCE_BOOL_OPTION(nvfx_dump_fp, "NVFX_DUMP_FP", FALSE)
+DEBUG_GET_ONCE_BOOL_OPTION(nvfx_fp_regalloc, "NVFX_FP_REGALLOC", TRUE)
+DEBUG_GET_ONCE_BOOL_OPTION(nvfx_optimize, "NVFX_OPTIMIZE", TRUE)
 
 struct nvfx_fragment_program*
 nvfx_fragprog_translate(struct nvfx_context *nvfx,
@@ -1124,6 +1222,15 @@ nvfx_fragprog_translate(struct nvfx_context *nvfx,
 	}
 	util_dynarray_fini(&insns);
 
+	/* before register allocation, which then has fewer live ranges to pack */
+	if(nvfx->is_nv4x && debug_get_option_nvfx_optimize())
+		nvfx_fragprog_optimize(fpc);
+
+	if(debug_get_option_nvfx_fp_regalloc())
+		nvfx_fragprog_allocate_temps(nvfx, fpc);
+
+	fp->r_outputs = fpc->r_outputs;
+
 	if(!nvfx->is_nv4x)
 		fp->fp_control |= (fpc->num_regs-1)/2;
 	else
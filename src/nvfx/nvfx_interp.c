@@ -0,0 +1,1772 @@
+/* Host side disassembler, interpreter and cost model for NV40 program
+ * microcode.
+ *
+ * The interpreter is meant for checking the shader compilers - that an
+ * optimization didn't change what a program computes - so it's exact where
+ * the hardware's behaviour is known, and simple where it isn't:
+ *
+ * - every operation is carried out in IEEE single precision, and rounded
+ *   to single precision before the next one; MAD and the dot products
+ *   round their products before adding them
+ * - fragment program results are then rounded to the instruction's
+ *   precision: FP16 rounds to nearest even half precision, FX12 clamps to
+ *   [-2, 2) and rounds to 1/1024ths. H registers hold half precision bits,
+ *   two to an R register (see nvfx_interp.h)
+ * - the special functions (RCP excepted) are libm's, not the hardware's
+ *   approximations; DDX & DDY are 0, as there are no neighbouring
+ *   fragments
+ *
+ * The cost model is static, and only an estimate; see nvfx_interp.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "nvfx_interp.h"
+#include "nv40_vertprog.h"
+
+#define NVFX_INTERP_STACK 32
+
+/* Cycles per instruction: */
+#define NVFX_INTERP_COST_ALU     1
+#define NVFX_INTERP_COST_SPECIAL 2
+#define NVFX_INTERP_COST_TEX     4
+
+enum {
+	NVFX_INTERP_ALU,
+	NVFX_INTERP_SPECIAL,
+	NVFX_INTERP_TEX
+};
+
+struct nvfx_interp_op {
+	const char *name;
+	unsigned srcs;		/* source positions read */
+	unsigned kind;
+};
+
+static const struct nvfx_interp_op nvfx_fp_ops[64] = {
+	[NVFX_FP_OP_OPCODE_NOP] = { "NOP", 0, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_MOV] = { "MOV", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_MUL] = { "MUL", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_ADD] = { "ADD", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_MAD] = { "MAD", 7, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_DP3] = { "DP3", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_DP4] = { "DP4", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_DST] = { "DST", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_MIN] = { "MIN", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_MAX] = { "MAX", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_SLT] = { "SLT", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_SGE] = { "SGE", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_SLE] = { "SLE", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_SGT] = { "SGT", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_SNE] = { "SNE", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_SEQ] = { "SEQ", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_FRC] = { "FRC", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_FLR] = { "FLR", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_KIL] = { "KIL", 0, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_PK4B] = { "PK4B", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_UP4B] = { "UP4B", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_DDX] = { "DDX", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_DDY] = { "DDY", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_TEX] = { "TEX", 1, NVFX_INTERP_TEX },
+	[NVFX_FP_OP_OPCODE_TXP] = { "TXP", 1, NVFX_INTERP_TEX },
+	[NVFX_FP_OP_OPCODE_TXD] = { "TXD", 7, NVFX_INTERP_TEX },
+	[NVFX_FP_OP_OPCODE_RCP] = { "RCP", 1, NVFX_INTERP_SPECIAL },
+	[NVFX_FP_OP_OPCODE_RSQ_NV30] = { "RSQ", 1, NVFX_INTERP_SPECIAL },
+	[NVFX_FP_OP_OPCODE_EX2] = { "EX2", 1, NVFX_INTERP_SPECIAL },
+	[NVFX_FP_OP_OPCODE_LG2] = { "LG2", 1, NVFX_INTERP_SPECIAL },
+	[NVFX_FP_OP_OPCODE_LIT_NV30] = { "LIT", 1, NVFX_INTERP_SPECIAL },
+	[NVFX_FP_OP_OPCODE_LRP_NV30] = { "LRP", 7, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_STR] = { "STR", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_SFL] = { "SFL", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_COS] = { "COS", 1, NVFX_INTERP_SPECIAL },
+	[NVFX_FP_OP_OPCODE_SIN] = { "SIN", 1, NVFX_INTERP_SPECIAL },
+	[NVFX_FP_OP_OPCODE_PK2H] = { "PK2H", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_UP2H] = { "UP2H", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_POW_NV30] = { "POW", 3, NVFX_INTERP_SPECIAL },
+	[NVFX_FP_OP_OPCODE_PK4UB] = { "PK4UB", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_UP4UB] = { "UP4UB", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_PK2US] = { "PK2US", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_UP2US] = { "UP2US", 1, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_DP2A] = { "DP2A", 7, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_TXL_NV40] = { "TXL", 1, NVFX_INTERP_TEX },
+	[NVFX_FP_OP_OPCODE_TXB] = { "TXB", 1, NVFX_INTERP_TEX },
+	[NVFX_FP_OP_OPCODE_RFL_NV30] = { "RFL", 3, NVFX_INTERP_ALU },
+	[NVFX_FP_OP_OPCODE_DIV] = { "DIV", 3, NVFX_INTERP_SPECIAL },
+	[NVFX_FP_OP_OPCODE_LITEX2_NV40] = { "LITEX2", 1, NVFX_INTERP_SPECIAL },
+};
+
+static const char *nvfx_fp_bra_ops[8] = {
+	[NV40_FP_OP_BRA_OPCODE_BRK] = "BRK",
+	[NV40_FP_OP_BRA_OPCODE_CAL] = "CAL",
+	[NV40_FP_OP_BRA_OPCODE_IF] = "IF",
+	[NV40_FP_OP_BRA_OPCODE_LOOP] = "LOOP",
+	[NV40_FP_OP_BRA_OPCODE_REP] = "REP",
+	[NV40_FP_OP_BRA_OPCODE_RET] = "RET",
+};
+
+static const struct nvfx_interp_op nvfx_vp_vec_ops[32] = {
+	[NVFX_VP_INST_VEC_OP_NOP] = { "NOP", 0, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_MOV] = { "MOV", 1, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_MUL] = { "MUL", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_ADD] = { "ADD", 5, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_MAD] = { "MAD", 7, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_DP3] = { "DP3", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_DPH] = { "DPH", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_DP4] = { "DP4", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_DST] = { "DST", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_MIN] = { "MIN", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_MAX] = { "MAX", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_SLT] = { "SLT", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_SGE] = { "SGE", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_ARL] = { "ARL", 1, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_FRC] = { "FRC", 1, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_FLR] = { "FLR", 1, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_SEQ] = { "SEQ", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_SFL] = { "SFL", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_SGT] = { "SGT", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_SLE] = { "SLE", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_SNE] = { "SNE", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_STR] = { "STR", 3, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_SSG] = { "SSG", 1, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_ARR] = { "ARR", 1, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_ARA] = { "ARA", 1, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_VEC_OP_TXL] = { "TXL", 1, NVFX_INTERP_TEX },
+};
+
+/* Scalar ops read source 2: */
+static const struct nvfx_interp_op nvfx_vp_sca_ops[32] = {
+	[NVFX_VP_INST_SCA_OP_NOP] = { "NOP", 0, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_SCA_OP_MOV] = { "MOV", 4, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_SCA_OP_RCP] = { "RCP", 4, NVFX_INTERP_SPECIAL },
+	[NVFX_VP_INST_SCA_OP_RCC] = { "RCC", 4, NVFX_INTERP_SPECIAL },
+	[NVFX_VP_INST_SCA_OP_RSQ] = { "RSQ", 4, NVFX_INTERP_SPECIAL },
+	[NVFX_VP_INST_SCA_OP_EXP] = { "EXP", 4, NVFX_INTERP_SPECIAL },
+	[NVFX_VP_INST_SCA_OP_LOG] = { "LOG", 4, NVFX_INTERP_SPECIAL },
+	[NVFX_VP_INST_SCA_OP_LIT] = { "LIT", 4, NVFX_INTERP_SPECIAL },
+	[NVFX_VP_INST_SCA_OP_BRA] = { "BRA", 0, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_SCA_OP_CAL] = { "CAL", 0, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_SCA_OP_RET] = { "RET", 0, NVFX_INTERP_ALU },
+	[NVFX_VP_INST_SCA_OP_LG2] = { "LG2", 4, NVFX_INTERP_SPECIAL },
+	[NVFX_VP_INST_SCA_OP_EX2] = { "EX2", 4, NVFX_INTERP_SPECIAL },
+	[NVFX_VP_INST_SCA_OP_SIN] = { "SIN", 4, NVFX_INTERP_SPECIAL },
+	[NVFX_VP_INST_SCA_OP_COS] = { "COS", 4, NVFX_INTERP_SPECIAL },
+	[NV40_VP_INST_SCA_OP_PUSHA] = { "PUSHA", 4, NVFX_INTERP_ALU },
+	[NV40_VP_INST_SCA_OP_POPA] = { "POPA", 0, NVFX_INTERP_ALU },
+};
+
+static const char *nvfx_interp_conds[8] = { "FL", "LT", "EQ", "LE", "GT", "NE", "GE", "TR" };
+static const char nvfx_interp_comps[4] = { 'x', 'y', 'z', 'w' };
+
+static unsigned
+nvfx_interp_cost_of(unsigned kind)
+{
+	switch (kind) {
+	case NVFX_INTERP_SPECIAL:
+		return NVFX_INTERP_COST_SPECIAL;
+	case NVFX_INTERP_TEX:
+		return NVFX_INTERP_COST_TEX;
+	default:
+		return NVFX_INTERP_COST_ALU;
+	}
+}
+
+/* Arithmetic. The results go through memory, so that the compiler can
+ * neither fuse a multiply with an add, nor keep extra precision: */
+static float
+nvfx_interp_mul(float a, float b)
+{
+	volatile float r = a * b;
+	return r;
+}
+
+static float
+nvfx_interp_add(float a, float b)
+{
+	volatile float r = a + b;
+	return r;
+}
+
+static float
+nvfx_interp_div(float a, float b)
+{
+	volatile float r = a / b;
+	return r;
+}
+
+static float
+nvfx_interp_float(uint32_t u)
+{
+	union { uint32_t u; float f; } v;
+
+	v.u = u;
+	return v.f;
+}
+
+static uint32_t
+nvfx_interp_bits(float f)
+{
+	union { uint32_t u; float f; } v;
+
+	v.f = f;
+	return v.u;
+}
+
+static float
+nvfx_interp_dot(const float *a, const float *b, unsigned n)
+{
+	float r = nvfx_interp_mul(a[0], b[0]);
+	unsigned i;
+
+	for (i = 1; i < n; ++i)
+		r = nvfx_interp_add(r, nvfx_interp_mul(a[i], b[i]));
+	return r;
+}
+
+static float
+nvfx_interp_min(float a, float b)
+{
+	return (a < b) ? a : b;
+}
+
+static float
+nvfx_interp_max(float a, float b)
+{
+	return (a > b) ? a : b;
+}
+
+static float
+nvfx_interp_clamp(float a, float lo, float hi)
+{
+	return nvfx_interp_min(nvfx_interp_max(a, lo), hi);
+}
+
+uint16_t
+nvfx_float_to_half(float f)
+{
+	uint32_t u = nvfx_interp_bits(f);
+	uint32_t sign = (u >> 16) & 0x8000;
+	uint32_t mantissa = u & 0x7fffff;
+	int exponent = (int)((u >> 23) & 0xff) - 127 + 15;
+	uint32_t h, rest, half;
+	unsigned shift;
+
+	if (((u >> 23) & 0xff) == 0xff)
+		return sign | 0x7c00 | (mantissa ? (0x200 | (mantissa >> 13)) : 0);
+	if (exponent >= 31)
+		return sign | 0x7c00;
+
+	if (exponent <= 0) {
+		/* denormal, or zero */
+		shift = 14 - exponent;
+		if (shift > 24)
+			return sign;
+		mantissa |= 0x800000;
+		h = mantissa >> shift;
+		rest = mantissa & ((1u << shift) - 1);
+		half = 1u << (shift - 1);
+	} else {
+		h = ((uint32_t)exponent << 10) | (mantissa >> 13);
+		rest = mantissa & 0x1fff;
+		half = 0x1000;
+	}
+
+	/* round to nearest even; a carry out of the mantissa is right, even
+	 * into infinity */
+	if (rest > half || (rest == half && (h & 1)))
+		++h;
+	return sign | h;
+}
+
+float
+nvfx_half_to_float(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+
+	if (exponent == 0x1f)
+		return nvfx_interp_float(sign | 0x7f800000 | (mantissa << 13));
+	if (exponent == 0) {
+		if (!mantissa)
+			return nvfx_interp_float(sign);
+		/* denormal; normalize it */
+		exponent = 1;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			--exponent;
+		}
+		mantissa &= 0x3ff;
+	}
+	return nvfx_interp_float(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+static float
+nvfx_interp_round(float f, unsigned precision)
+{
+	switch (precision) {
+	case NVFX_FP_PRECISION_FP16:
+		return nvfx_half_to_float(nvfx_float_to_half(f));
+	case NVFX_FP_PRECISION_FX12:
+		if (f != f)
+			return 0.0f;
+		f = nvfx_interp_clamp(f, -2.0f, 2047.0f / 1024.0f);
+		return rintf(f * 1024.0f) / 1024.0f;
+	default:
+		return f;
+	}
+}
+
+static int
+nvfx_interp_test(unsigned cond, float f)
+{
+	switch (cond) {
+	case NVFX_COND_FL: return 0;
+	case NVFX_COND_LT: return f < 0.0f;
+	case NVFX_COND_EQ: return f == 0.0f;
+	case NVFX_COND_LE: return f <= 0.0f;
+	case NVFX_COND_GT: return f > 0.0f;
+	case NVFX_COND_NE: return f != 0.0f;
+	case NVFX_COND_GE: return f >= 0.0f;
+	default: return 1;
+	}
+}
+
+/* Results for LIT, from its source's x, y & w: */
+static void
+nvfx_interp_lit(const float *a, float *r)
+{
+	float power = nvfx_interp_clamp(a[3], -128.0f, 128.0f);
+
+	r[0] = 1.0f;
+	r[1] = nvfx_interp_max(a[0], 0.0f);
+	r[2] = (a[0] > 0.0f) ? powf(nvfx_interp_max(a[1], 0.0f), power) : 0.0f;
+	r[3] = 1.0f;
+}
+
+static void
+nvfx_interp_swizzle(const float *v, unsigned swz, int negate, int absolute, float *r)
+{
+	unsigned c;
+
+	for (c = 0; c < 4; ++c) {
+		r[c] = v[(swz >> (2 * c)) & 3];
+		if (absolute)
+			r[c] = fabsf(r[c]);
+		if (negate)
+			r[c] = -r[c];
+	}
+}
+
+static void
+nvfx_interp_sample(nvfx_interp_sample_func sample, void *data, unsigned unit, unsigned op,
+		   const float *coord, float lod, float *texel)
+{
+	if (sample)
+		sample(data, unit, op, coord, lod, texel);
+	else
+		memcpy(texel, coord, sizeof(float) * 4);
+}
+
+/*
+ * Fragment programs
+ */
+
+static int
+nvfx_fp_is_branch(const uint32_t *hw)
+{
+	return (hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH) != 0;
+}
+
+static unsigned
+nvfx_fp_op(const uint32_t *hw)
+{
+	return (hw[0] & NVFX_FP_OP_OPCODE_MASK) >> NVFX_FP_OP_OPCODE_SHIFT;
+}
+
+static unsigned
+nvfx_fp_src_type(const uint32_t *hw, unsigned pos)
+{
+	return (hw[pos + 1] & NVFX_FP_REG_TYPE_MASK) >> NVFX_FP_REG_TYPE_SHIFT;
+}
+
+/* Words taken up by an instruction, with its inline constant: */
+static unsigned
+nvfx_fp_insn_words(const uint32_t *hw)
+{
+	unsigned pos;
+
+	if (nvfx_fp_is_branch(hw))
+		return 4;
+	for (pos = 0; pos < 3; ++pos) {
+		if (nvfx_fp_src_type(hw, pos) == NVFX_FP_REG_TYPE_CONST)
+			return 8;
+	}
+	return 4;
+}
+
+static unsigned
+nvfx_fp_srcs(unsigned op)
+{
+	return nvfx_fp_ops[op].name ? nvfx_fp_ops[op].srcs : 7;
+}
+
+static unsigned
+nvfx_fp_cycles(const uint32_t *hw)
+{
+	unsigned op = nvfx_fp_op(hw);
+
+	if (nvfx_fp_is_branch(hw) || !nvfx_fp_ops[op].name)
+		return NVFX_INTERP_COST_ALU;
+	return nvfx_interp_cost_of(nvfx_fp_ops[op].kind);
+}
+
+void
+nvfx_fp_read_reg(const struct nvfx_fp_machine *m, unsigned index, int half, float v[4])
+{
+	unsigned c;
+
+	if (!half) {
+		for (c = 0; c < 4; ++c)
+			v[c] = nvfx_interp_float(m->regs[index % NVFX_INTERP_FP_REGS][c]);
+		return;
+	}
+
+	for (c = 0; c < 4; ++c) {
+		uint32_t word = m->regs[(index >> 1) % NVFX_INTERP_FP_REGS][(index & 1) * 2 + (c >> 1)];
+
+		v[c] = nvfx_half_to_float((word >> ((c & 1) * 16)) & 0xffff);
+	}
+}
+
+static void
+nvfx_fp_write_reg(struct nvfx_fp_machine *m, unsigned index, int half, unsigned c, float f)
+{
+	uint32_t *word;
+	unsigned shift;
+
+	if (!half) {
+		m->regs[index % NVFX_INTERP_FP_REGS][c] = nvfx_interp_bits(f);
+		return;
+	}
+
+	word = &m->regs[(index >> 1) % NVFX_INTERP_FP_REGS][(index & 1) * 2 + (c >> 1)];
+	shift = (c & 1) * 16;
+	*word = (*word & ~(0xffffu << shift)) | ((uint32_t)nvfx_float_to_half(f) << shift);
+}
+
+/* Open IF arms, loops and subroutine calls: */
+struct nvfx_interp_frame {
+	unsigned kind;
+	unsigned stop;		/* leaving the block here... */
+	unsigned target;	/* ...goes here */
+	unsigned start;
+	unsigned count;
+	int index, incr;
+};
+
+enum {
+	NVFX_INTERP_FRAME_IF,
+	NVFX_INTERP_FRAME_LOOP,
+	NVFX_INTERP_FRAME_CAL
+};
+
+/* The innermost loop's index, for relative addressing of inputs: */
+static int
+nvfx_fp_loop_index(const struct nvfx_interp_frame *stack, unsigned sp)
+{
+	while (sp--) {
+		if (stack[sp].kind == NVFX_INTERP_FRAME_LOOP)
+			return stack[sp].index;
+	}
+	return 0;
+}
+
+static void
+nvfx_fp_src(const struct nvfx_fp_machine *m, const uint32_t *hw, unsigned pos, int loop_index, float *v)
+{
+	uint32_t sr = hw[pos + 1];
+	float r[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	unsigned c, index;
+
+	switch (nvfx_fp_src_type(hw, pos)) {
+	case NVFX_FP_REG_TYPE_TEMP:
+		nvfx_fp_read_reg(m, (sr & NV40_FP_REG_SRC_MASK) >> NVFX_FP_REG_SRC_SHIFT,
+				 (sr & NVFX_FP_REG_SRC_HALF) != 0, r);
+		break;
+	case NVFX_FP_REG_TYPE_INPUT:
+		index = (hw[0] & NVFX_FP_OP_INPUT_SRC_MASK) >> NVFX_FP_OP_INPUT_SRC_SHIFT;
+		if (hw[3] & NVFX_FP_OP_INDEX_INPUT)
+			index += loop_index;
+		if (index < NVFX_INTERP_FP_INPUTS)
+			memcpy(r, m->inputs[index], sizeof(r));
+		break;
+	case NVFX_FP_REG_TYPE_CONST:
+		for (c = 0; c < 4; ++c)
+			r[c] = nvfx_interp_float(hw[4 + c]);
+		break;
+	}
+
+	nvfx_interp_swizzle(r, (sr & NVFX_FP_REG_SWZ_ALL_MASK) >> NVFX_FP_REG_SWZ_ALL_SHIFT,
+			    (sr & NVFX_FP_REG_NEGATE) != 0, (hw[1] & (1 << (29 + pos))) != 0, v);
+}
+
+/* Which components pass the instruction's condition test: */
+static unsigned
+nvfx_fp_cond(const float *cc, const uint32_t *hw)
+{
+	unsigned cond = (hw[1] & NVFX_FP_OP_COND_MASK) >> NVFX_FP_OP_COND_SHIFT;
+	unsigned swz = (hw[1] & NVFX_FP_OP_COND_SWZ_ALL_MASK) >> NVFX_FP_OP_COND_SWZ_ALL_SHIFT;
+	unsigned c, pass = 0;
+
+	for (c = 0; c < 4; ++c) {
+		if (nvfx_interp_test(cond, cc[(swz >> (2 * c)) & 3]))
+			pass |= 1 << c;
+	}
+	return pass;
+}
+
+static uint32_t
+nvfx_interp_pack(const float *a, float scale, float lo, float hi, float bias, unsigned bits, unsigned n)
+{
+	uint32_t r = 0;
+	unsigned c;
+
+	for (c = 0; c < n; ++c) {
+		float f = rintf(nvfx_interp_clamp(a[c], lo, hi) * scale) + bias;
+
+		r |= ((uint32_t)f & ((1u << bits) - 1)) << (c * bits);
+	}
+	return r;
+}
+
+static void
+nvfx_interp_unpack(uint32_t word, float scale, float bias, unsigned bits, unsigned n, float *r)
+{
+	unsigned c;
+
+	for (c = 0; c < 4; ++c)
+		r[c] = (((word >> ((c % n) * bits)) & ((1u << bits) - 1)) - bias) / scale;
+}
+
+static int
+nvfx_fp_alu(struct nvfx_fp_machine *m, const uint32_t *hw, int loop_index, float *r)
+{
+	unsigned op = nvfx_fp_op(hw);
+	unsigned unit = (hw[0] & NVFX_FP_OP_TEX_UNIT_MASK) >> NVFX_FP_OP_TEX_UNIT_SHIFT;
+	float a[4], b[4], c[4], t[4];
+	unsigned i;
+
+	nvfx_fp_src(m, hw, 0, loop_index, a);
+	nvfx_fp_src(m, hw, 1, loop_index, b);
+	nvfx_fp_src(m, hw, 2, loop_index, c);
+
+	switch (op) {
+	case NVFX_FP_OP_OPCODE_NOP:
+	case NVFX_FP_OP_OPCODE_KIL:
+		memset(r, 0, sizeof(float) * 4);
+		break;
+	case NVFX_FP_OP_OPCODE_MOV:
+		memcpy(r, a, sizeof(a));
+		break;
+	case NVFX_FP_OP_OPCODE_MUL:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_mul(a[i], b[i]);
+		break;
+	case NVFX_FP_OP_OPCODE_ADD:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_add(a[i], b[i]);
+		break;
+	case NVFX_FP_OP_OPCODE_MAD:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_add(nvfx_interp_mul(a[i], b[i]), c[i]);
+		break;
+	case NVFX_FP_OP_OPCODE_DP3:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_dot(a, b, 3);
+		break;
+	case NVFX_FP_OP_OPCODE_DP4:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_dot(a, b, 4);
+		break;
+	case NVFX_FP_OP_OPCODE_DP2A:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_add(nvfx_interp_dot(a, b, 2), c[0]);
+		break;
+	case NVFX_FP_OP_OPCODE_DST:
+		r[0] = 1.0f;
+		r[1] = nvfx_interp_mul(a[1], b[1]);
+		r[2] = a[2];
+		r[3] = b[3];
+		break;
+	case NVFX_FP_OP_OPCODE_MIN:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_min(a[i], b[i]);
+		break;
+	case NVFX_FP_OP_OPCODE_MAX:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_max(a[i], b[i]);
+		break;
+	case NVFX_FP_OP_OPCODE_SLT:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] < b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_FP_OP_OPCODE_SGE:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] >= b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_FP_OP_OPCODE_SLE:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] <= b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_FP_OP_OPCODE_SGT:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] > b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_FP_OP_OPCODE_SNE:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] != b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_FP_OP_OPCODE_SEQ:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] == b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_FP_OP_OPCODE_STR:
+		r[0] = r[1] = r[2] = r[3] = 1.0f;
+		break;
+	case NVFX_FP_OP_OPCODE_SFL:
+		r[0] = r[1] = r[2] = r[3] = 0.0f;
+		break;
+	case NVFX_FP_OP_OPCODE_FRC:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_add(a[i], -floorf(a[i]));
+		break;
+	case NVFX_FP_OP_OPCODE_FLR:
+		for (i = 0; i < 4; ++i)
+			r[i] = floorf(a[i]);
+		break;
+	case NVFX_FP_OP_OPCODE_DDX:
+	case NVFX_FP_OP_OPCODE_DDY:
+		r[0] = r[1] = r[2] = r[3] = 0.0f;
+		break;
+	case NVFX_FP_OP_OPCODE_RCP:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_div(1.0f, a[0]);
+		break;
+	case NVFX_FP_OP_OPCODE_RSQ_NV30:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_div(1.0f, sqrtf(fabsf(a[0])));
+		break;
+	case NVFX_FP_OP_OPCODE_EX2:
+		r[0] = r[1] = r[2] = r[3] = exp2f(a[0]);
+		break;
+	case NVFX_FP_OP_OPCODE_LG2:
+		r[0] = r[1] = r[2] = r[3] = log2f(a[0]);
+		break;
+	case NVFX_FP_OP_OPCODE_COS:
+		r[0] = r[1] = r[2] = r[3] = cosf(a[0]);
+		break;
+	case NVFX_FP_OP_OPCODE_SIN:
+		r[0] = r[1] = r[2] = r[3] = sinf(a[0]);
+		break;
+	case NVFX_FP_OP_OPCODE_POW_NV30:
+		r[0] = r[1] = r[2] = r[3] = powf(a[0], b[0]);
+		break;
+	case NVFX_FP_OP_OPCODE_DIV:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_div(a[i], b[0]);
+		break;
+	case NVFX_FP_OP_OPCODE_LIT_NV30:
+		nvfx_interp_lit(a, r);
+		break;
+	case NVFX_FP_OP_OPCODE_LRP_NV30:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_add(nvfx_interp_mul(a[i], b[i]),
+					       nvfx_interp_mul(nvfx_interp_add(1.0f, -a[i]), c[i]));
+		break;
+	case NVFX_FP_OP_OPCODE_RFL_NV30:
+	{
+		float k = nvfx_interp_div(nvfx_interp_mul(2.0f, nvfx_interp_dot(a, b, 3)), nvfx_interp_dot(a, a, 3));
+
+		for (i = 0; i < 3; ++i)
+			r[i] = nvfx_interp_add(nvfx_interp_mul(k, a[i]), -b[i]);
+		r[3] = b[3];
+		break;
+	}
+	case NVFX_FP_OP_OPCODE_PK2H:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_float(nvfx_float_to_half(a[0]) |
+							      ((uint32_t)nvfx_float_to_half(a[1]) << 16));
+		break;
+	case NVFX_FP_OP_OPCODE_UP2H:
+		r[0] = r[2] = nvfx_half_to_float(nvfx_interp_bits(a[0]) & 0xffff);
+		r[1] = r[3] = nvfx_half_to_float(nvfx_interp_bits(a[0]) >> 16);
+		break;
+	case NVFX_FP_OP_OPCODE_PK4B:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_float(nvfx_interp_pack(a, 127.0f, -1.0f, 1.0f, 128.0f, 8, 4));
+		break;
+	case NVFX_FP_OP_OPCODE_UP4B:
+		nvfx_interp_unpack(nvfx_interp_bits(a[0]), 127.0f, 128.0f, 8, 4, r);
+		break;
+	case NVFX_FP_OP_OPCODE_PK4UB:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_float(nvfx_interp_pack(a, 255.0f, 0.0f, 1.0f, 0.0f, 8, 4));
+		break;
+	case NVFX_FP_OP_OPCODE_UP4UB:
+		nvfx_interp_unpack(nvfx_interp_bits(a[0]), 255.0f, 0.0f, 8, 4, r);
+		break;
+	case NVFX_FP_OP_OPCODE_PK2US:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_float(nvfx_interp_pack(a, 65535.0f, 0.0f, 1.0f, 0.0f, 16, 2));
+		break;
+	case NVFX_FP_OP_OPCODE_UP2US:
+		nvfx_interp_unpack(nvfx_interp_bits(a[0]), 65535.0f, 0.0f, 16, 2, r);
+		break;
+	case NVFX_FP_OP_OPCODE_TEX:
+	case NVFX_FP_OP_OPCODE_TXD:
+		nvfx_interp_sample(m->sample, m->sample_data, unit, op, a, 0.0f, r);
+		break;
+	case NVFX_FP_OP_OPCODE_TXP:
+		for (i = 0; i < 3; ++i)
+			t[i] = nvfx_interp_div(a[i], a[3]);
+		t[3] = 1.0f;
+		nvfx_interp_sample(m->sample, m->sample_data, unit, op, t, 0.0f, r);
+		break;
+	case NVFX_FP_OP_OPCODE_TXB:
+	case NVFX_FP_OP_OPCODE_TXL_NV40:
+		nvfx_interp_sample(m->sample, m->sample_data, unit, op, a, a[3], r);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static void
+nvfx_fp_write(struct nvfx_fp_machine *m, const uint32_t *hw, float *r)
+{
+	unsigned mask = (hw[0] & NVFX_FP_OP_OUTMASK_MASK) >> NVFX_FP_OP_OUTMASK_SHIFT;
+	unsigned precision = (hw[0] & NVFX_FP_OP_PRECISION_MASK) >> NVFX_FP_OP_PRECISION_SHIFT;
+	unsigned index = (hw[0] & NV40_FP_OP_OUT_REG_MASK) >> NVFX_FP_OP_OUT_REG_SHIFT;
+	int half = (hw[0] & NVFX_FP_OP_OUT_REG_HALF) != 0;
+	unsigned c;
+
+	mask &= nvfx_fp_cond(m->cc, hw);
+
+	for (c = 0; c < 4; ++c) {
+		switch ((hw[2] >> NVFX_FP_OP_DST_SCALE_SHIFT) & 7) {
+		case NVFX_FP_OP_DST_SCALE_2X: r[c] = nvfx_interp_mul(r[c], 2.0f); break;
+		case NVFX_FP_OP_DST_SCALE_4X: r[c] = nvfx_interp_mul(r[c], 4.0f); break;
+		case NVFX_FP_OP_DST_SCALE_8X: r[c] = nvfx_interp_mul(r[c], 8.0f); break;
+		case NVFX_FP_OP_DST_SCALE_INV_2X: r[c] = nvfx_interp_mul(r[c], 0.5f); break;
+		case NVFX_FP_OP_DST_SCALE_INV_4X: r[c] = nvfx_interp_mul(r[c], 0.25f); break;
+		case NVFX_FP_OP_DST_SCALE_INV_8X: r[c] = nvfx_interp_mul(r[c], 0.125f); break;
+		}
+		if (hw[0] & NVFX_FP_OP_OUT_SAT)
+			r[c] = (r[c] != r[c]) ? 0.0f : nvfx_interp_clamp(r[c], 0.0f, 1.0f);
+		r[c] = nvfx_interp_round(r[c], precision);
+	}
+
+	for (c = 0; c < 4; ++c) {
+		if (!(mask & (1 << c)))
+			continue;
+		if (hw[0] & NVFX_FP_OP_COND_WRITE_ENABLE)
+			m->cc[c] = r[c];
+		if (!(hw[0] & NV40_FP_OP_OUT_NONE))
+			nvfx_fp_write_reg(m, index, half, c, r[c]);
+	}
+}
+
+/* The innermost frame of a kind, or -1: */
+static int
+nvfx_interp_find_frame(const struct nvfx_interp_frame *stack, unsigned sp, unsigned kind)
+{
+	while (sp--) {
+		if (stack[sp].kind == kind)
+			return sp;
+	}
+	return -1;
+}
+
+int
+nvfx_fp_execute(struct nvfx_fp_machine *m, const uint32_t *insn, unsigned insn_len)
+{
+	struct nvfx_interp_frame stack[NVFX_INTERP_STACK];
+	unsigned sp = 0, pc = 0;
+
+	memset(m->regs, 0, sizeof(m->regs));
+	memset(m->cc, 0, sizeof(m->cc));
+	m->killed = 0;
+	m->executed = m->cycles = 0;
+
+	for (;;) {
+		const uint32_t *hw;
+		unsigned op;
+		float r[4];
+
+		/* the end of an IF's arm, or of a loop: */
+		while (sp && pc == stack[sp - 1].stop) {
+			struct nvfx_interp_frame *f = &stack[sp - 1];
+
+			if (f->kind == NVFX_INTERP_FRAME_LOOP && --f->count) {
+				f->index += f->incr;
+				pc = f->start;
+				break;
+			}
+			pc = f->target;
+			--sp;
+		}
+
+		if (pc + 4 > insn_len)
+			return 0;
+		if (m->executed == NVFX_INTERP_MAX_STEPS)
+			return -1;
+
+		hw = insn + pc;
+		op = nvfx_fp_op(hw);
+		++m->executed;
+		m->cycles += nvfx_fp_cycles(hw);
+
+		if (nvfx_fp_is_branch(hw)) {
+			int pass = nvfx_fp_cond(m->cc, hw) != 0;
+			unsigned end = (hw[3] & NV40_FP_OP_END_OFFSET_MASK) >> NV40_FP_OP_END_OFFSET_SHIFT;
+			int f;
+
+			switch (op) {
+			case NV40_FP_OP_BRA_OPCODE_IF:
+			{
+				unsigned else_offset = (hw[2] & NV40_FP_OP_ELSE_OFFSET_MASK) >> NV40_FP_OP_ELSE_OFFSET_SHIFT;
+
+				if (sp == NVFX_INTERP_STACK)
+					return -1;
+				stack[sp].kind = NVFX_INTERP_FRAME_IF;
+				stack[sp].stop = pass ? else_offset : end;
+				stack[sp].target = end;
+				++sp;
+				pc = pass ? (pc + 4) : else_offset;
+				break;
+			}
+			case NV40_FP_OP_BRA_OPCODE_REP:
+			case NV40_FP_OP_BRA_OPCODE_LOOP:
+			{
+				unsigned count = (hw[2] & NV40_FP_OP_LOOP_COUNT_MASK) >> NV40_FP_OP_LOOP_COUNT_SHIFT;
+
+				if (!count || end == pc + 4) {
+					pc = end;
+					break;
+				}
+				if (sp == NVFX_INTERP_STACK)
+					return -1;
+				stack[sp].kind = NVFX_INTERP_FRAME_LOOP;
+				stack[sp].stop = stack[sp].target = end;
+				stack[sp].start = pc + 4;
+				stack[sp].count = count;
+				stack[sp].index = (op == NV40_FP_OP_BRA_OPCODE_LOOP) ?
+					(int)((hw[2] & NV40_FP_OP_LOOP_INDEX_MASK) >> NV40_FP_OP_LOOP_INDEX_SHIFT) : 0;
+				stack[sp].incr = (op == NV40_FP_OP_BRA_OPCODE_LOOP) ?
+					(int)((hw[2] & NV40_FP_OP_LOOP_INCR_MASK) >> NV40_FP_OP_LOOP_INCR_SHIFT) : 0;
+				++sp;
+				pc += 4;
+				break;
+			}
+			case NV40_FP_OP_BRA_OPCODE_BRK:
+				if (!pass) {
+					pc += 4;
+					break;
+				}
+				f = nvfx_interp_find_frame(stack, sp, NVFX_INTERP_FRAME_LOOP);
+				if (f < 0)
+					return -1;
+				pc = stack[f].target;
+				sp = f;
+				break;
+			case NV40_FP_OP_BRA_OPCODE_CAL:
+				if (!pass) {
+					pc += 4;
+					break;
+				}
+				if (sp == NVFX_INTERP_STACK)
+					return -1;
+				stack[sp].kind = NVFX_INTERP_FRAME_CAL;
+				stack[sp].stop = ~0u;
+				stack[sp].target = pc + 4;
+				++sp;
+				pc = (hw[2] & NV40_FP_OP_SUB_OFFSET_MASK) >> NV40_FP_OP_SUB_OFFSET_SHIFT;
+				break;
+			case NV40_FP_OP_BRA_OPCODE_RET:
+				if (!pass) {
+					pc += 4;
+					break;
+				}
+				f = nvfx_interp_find_frame(stack, sp, NVFX_INTERP_FRAME_CAL);
+				if (f < 0)
+					return 0;
+				pc = stack[f].target;
+				sp = f;
+				break;
+			default:
+				return -1;
+			}
+			continue;
+		}
+
+		if (nvfx_fp_alu(m, hw, nvfx_fp_loop_index(stack, sp), r))
+			return -1;
+
+		if (op == NVFX_FP_OP_OPCODE_KIL) {
+			if (nvfx_fp_cond(m->cc, hw)) {
+				m->killed = 1;
+				return 0;
+			}
+		} else {
+			nvfx_fp_write(m, hw, r);
+		}
+
+		if (hw[0] & NVFX_FP_OP_PROGRAM_END)
+			return 0;
+		pc += nvfx_fp_insn_words(hw);
+	}
+}
+
+/* R registers touched by an instruction: */
+static void
+nvfx_fp_regs(const uint32_t *hw, uint64_t *regs)
+{
+	unsigned op = nvfx_fp_op(hw), srcs = nvfx_fp_srcs(op), pos;
+
+	if (!(hw[0] & NV40_FP_OP_OUT_NONE) && op != NVFX_FP_OP_OPCODE_KIL) {
+		unsigned index = (hw[0] & NV40_FP_OP_OUT_REG_MASK) >> NVFX_FP_OP_OUT_REG_SHIFT;
+
+		*regs |= 1ULL << ((hw[0] & NVFX_FP_OP_OUT_REG_HALF) ? (index >> 1) : index);
+	}
+
+	for (pos = 0; pos < 3; ++pos) {
+		uint32_t sr = hw[pos + 1];
+		unsigned index = (sr & NV40_FP_REG_SRC_MASK) >> NVFX_FP_REG_SRC_SHIFT;
+
+		if ((srcs & (1 << pos)) && nvfx_fp_src_type(hw, pos) == NVFX_FP_REG_TYPE_TEMP)
+			*regs |= 1ULL << ((sr & NVFX_FP_REG_SRC_HALF) ? (index >> 1) : index);
+	}
+}
+
+void
+nvfx_fp_cost(const uint32_t *insn, unsigned insn_len, struct nvfx_fp_cost *cost)
+{
+	uint64_t regs = 0;
+	unsigned pc;
+
+	memset(cost, 0, sizeof(*cost));
+
+	for (pc = 0; pc + 4 <= insn_len; pc += nvfx_fp_insn_words(insn + pc)) {
+		const uint32_t *hw = insn + pc;
+		unsigned op = nvfx_fp_op(hw);
+
+		++cost->insns;
+		cost->cycles += nvfx_fp_cycles(hw);
+
+		if (nvfx_fp_is_branch(hw)) {
+			++cost->branches;
+			continue;
+		}
+
+		if (nvfx_fp_insn_words(hw) == 8) {
+			++cost->consts;
+			cost->cycles += NVFX_INTERP_COST_ALU;
+		}
+		if (nvfx_fp_ops[op].name && nvfx_fp_ops[op].kind == NVFX_INTERP_TEX)
+			++cost->tex;
+		if (nvfx_fp_ops[op].name && nvfx_fp_ops[op].kind == NVFX_INTERP_SPECIAL)
+			++cost->special;
+		if ((hw[0] & NVFX_FP_OP_PRECISION_MASK) ||
+		    ((hw[0] & NVFX_FP_OP_OUT_REG_HALF) && !(hw[0] & NV40_FP_OP_OUT_NONE)))
+			++cost->half;
+
+		nvfx_fp_regs(hw, &regs);
+	}
+
+	while (regs) {
+		++cost->regs;
+		regs &= regs - 1;
+	}
+}
+
+static const char *nvfx_fp_inputs[16] = {
+	"WPOS", "COL0", "COL1", "FOGC", "TEX0", "TEX1", "TEX2", "TEX3",
+	"TEX4", "TEX5", "TEX6", "TEX7", "TEX8", "TEX9", "FACE", "15"
+};
+
+static void
+nvfx_interp_print_swizzle(FILE *f, unsigned swz)
+{
+	unsigned c;
+
+	if (swz == NVFX_SWZ_IDENTITY)
+		return;
+	fputc('.', f);
+	for (c = 0; c < 4; ++c)
+		fputc(nvfx_interp_comps[(swz >> (2 * c)) & 3], f);
+}
+
+static void
+nvfx_interp_print_mask(FILE *f, unsigned mask)
+{
+	unsigned c;
+
+	if (mask == 0xf)
+		return;
+	fputc('.', f);
+	for (c = 0; c < 4; ++c) {
+		if (mask & (1 << c))
+			fputc(nvfx_interp_comps[c], f);
+	}
+}
+
+static void
+nvfx_fp_print_cond(FILE *f, uint32_t hw1)
+{
+	fprintf(f, "(%s", nvfx_interp_conds[(hw1 & NVFX_FP_OP_COND_MASK) >> NVFX_FP_OP_COND_SHIFT]);
+	nvfx_interp_print_swizzle(f, (hw1 & NVFX_FP_OP_COND_SWZ_ALL_MASK) >> NVFX_FP_OP_COND_SWZ_ALL_SHIFT);
+	fputc(')', f);
+}
+
+static void
+nvfx_fp_print_src(FILE *f, const uint32_t *hw, unsigned pos)
+{
+	uint32_t sr = hw[pos + 1];
+	int absolute = (hw[1] & (1 << (29 + pos))) != 0;
+	unsigned index;
+
+	if (sr & NVFX_FP_REG_NEGATE)
+		fputc('-', f);
+	if (absolute)
+		fputc('|', f);
+
+	switch (nvfx_fp_src_type(hw, pos)) {
+	case NVFX_FP_REG_TYPE_TEMP:
+		fprintf(f, "%c%u", (sr & NVFX_FP_REG_SRC_HALF) ? 'H' : 'R',
+			(sr & NV40_FP_REG_SRC_MASK) >> NVFX_FP_REG_SRC_SHIFT);
+		break;
+	case NVFX_FP_REG_TYPE_INPUT:
+		index = (hw[0] & NVFX_FP_OP_INPUT_SRC_MASK) >> NVFX_FP_OP_INPUT_SRC_SHIFT;
+		fprintf(f, "f[%s%s]", (hw[3] & NVFX_FP_OP_INDEX_INPUT) ? "aL+" : "", nvfx_fp_inputs[index]);
+		break;
+	case NVFX_FP_REG_TYPE_CONST:
+		fprintf(f, "{%g, %g, %g, %g}", nvfx_interp_float(hw[4]), nvfx_interp_float(hw[5]),
+			nvfx_interp_float(hw[6]), nvfx_interp_float(hw[7]));
+		break;
+	default:
+		fputc('?', f);
+		break;
+	}
+
+	nvfx_interp_print_swizzle(f, (sr & NVFX_FP_REG_SWZ_ALL_MASK) >> NVFX_FP_REG_SWZ_ALL_SHIFT);
+	if (absolute)
+		fputc('|', f);
+}
+
+void
+nvfx_fp_disassemble(FILE *f, const uint32_t *insn, unsigned insn_len)
+{
+	static const char *scales[8] = { "", "_x2", "_x4", "_x8", "", "_d2", "_d4", "_d8" };
+	static const char precisions[4] = { 'R', 'H', 'X', '?' };
+	unsigned pc;
+
+	for (pc = 0; pc + 4 <= insn_len; pc += nvfx_fp_insn_words(insn + pc)) {
+		const uint32_t *hw = insn + pc;
+		unsigned op = nvfx_fp_op(hw);
+
+		fprintf(f, "%4u: ", pc / 4);
+
+		if (nvfx_fp_is_branch(hw)) {
+			const char *name = (op < 8) ? nvfx_fp_bra_ops[op] : 0;
+			unsigned end = (hw[3] & NV40_FP_OP_END_OFFSET_MASK) >> NV40_FP_OP_END_OFFSET_SHIFT;
+
+			if (name)
+				fprintf(f, "%s ", name);
+			else
+				fprintf(f, "BRA%02x ", op);
+			nvfx_fp_print_cond(f, hw[1]);
+
+			switch (op) {
+			case NV40_FP_OP_BRA_OPCODE_IF:
+				fprintf(f, " ELSE @%u ENDIF @%u",
+					((hw[2] & NV40_FP_OP_ELSE_OFFSET_MASK) >> NV40_FP_OP_ELSE_OFFSET_SHIFT) / 4, end / 4);
+				break;
+			case NV40_FP_OP_BRA_OPCODE_REP:
+				fprintf(f, " %u END @%u", (hw[2] & NV40_FP_OP_REP_COUNT1_MASK) >> NV40_FP_OP_REP_COUNT1_SHIFT, end / 4);
+				break;
+			case NV40_FP_OP_BRA_OPCODE_LOOP:
+				fprintf(f, " {%u, %u, %u} END @%u",
+					(hw[2] & NV40_FP_OP_LOOP_COUNT_MASK) >> NV40_FP_OP_LOOP_COUNT_SHIFT,
+					(hw[2] & NV40_FP_OP_LOOP_INDEX_MASK) >> NV40_FP_OP_LOOP_INDEX_SHIFT,
+					(hw[2] & NV40_FP_OP_LOOP_INCR_MASK) >> NV40_FP_OP_LOOP_INCR_SHIFT, end / 4);
+				break;
+			case NV40_FP_OP_BRA_OPCODE_CAL:
+				fprintf(f, " @%u", ((hw[2] & NV40_FP_OP_SUB_OFFSET_MASK) >> NV40_FP_OP_SUB_OFFSET_SHIFT) / 4);
+				break;
+			}
+		} else {
+			unsigned srcs = nvfx_fp_srcs(op), pos, first = 1;
+			unsigned mask = (hw[0] & NVFX_FP_OP_OUTMASK_MASK) >> NVFX_FP_OP_OUTMASK_SHIFT;
+
+			if (nvfx_fp_ops[op].name)
+				fputs(nvfx_fp_ops[op].name, f);
+			else
+				fprintf(f, "OP%02x", op);
+			fprintf(f, "%c%s%s%s ", precisions[(hw[0] & NVFX_FP_OP_PRECISION_MASK) >> NVFX_FP_OP_PRECISION_SHIFT],
+				(hw[0] & NVFX_FP_OP_COND_WRITE_ENABLE) ? "C" : "",
+				(hw[0] & NVFX_FP_OP_OUT_SAT) ? "_SAT" : "",
+				scales[(hw[2] >> NVFX_FP_OP_DST_SCALE_SHIFT) & 7]);
+
+			if (op == NVFX_FP_OP_OPCODE_KIL) {
+				nvfx_fp_print_cond(f, hw[1]);
+			} else {
+				if (hw[0] & NV40_FP_OP_OUT_NONE)
+					fputs((hw[0] & NVFX_FP_OP_OUT_REG_HALF) ? "HC" : "RC", f);
+				else
+					fprintf(f, "%c%u", (hw[0] & NVFX_FP_OP_OUT_REG_HALF) ? 'H' : 'R',
+						(hw[0] & NV40_FP_OP_OUT_REG_MASK) >> NVFX_FP_OP_OUT_REG_SHIFT);
+				nvfx_interp_print_mask(f, mask);
+				if (((hw[1] & NVFX_FP_OP_COND_MASK) >> NVFX_FP_OP_COND_SHIFT) != NVFX_COND_TR ||
+				    ((hw[1] & NVFX_FP_OP_COND_SWZ_ALL_MASK) >> NVFX_FP_OP_COND_SWZ_ALL_SHIFT) != NVFX_SWZ_IDENTITY)
+					nvfx_fp_print_cond(f, hw[1]);
+				first = 0;
+			}
+
+			for (pos = 0; pos < 3; ++pos) {
+				if (!(srcs & (1 << pos)))
+					continue;
+				fputs(first ? "" : ", ", f);
+				nvfx_fp_print_src(f, hw, pos);
+				first = 0;
+			}
+
+			if (nvfx_fp_ops[op].name && nvfx_fp_ops[op].kind == NVFX_INTERP_TEX)
+				fprintf(f, ", TEX%u", (hw[0] & NVFX_FP_OP_TEX_UNIT_MASK) >> NVFX_FP_OP_TEX_UNIT_SHIFT);
+		}
+
+		fprintf(f, ";%s\n", (hw[0] & NVFX_FP_OP_PROGRAM_END) ? " # END" : "");
+	}
+}
+
+/*
+ * Vertex programs
+ */
+
+static unsigned
+nvfx_vp_vec_op(const uint32_t *hw)
+{
+	return (hw[1] & NV40_VP_INST_VEC_OPCODE_MASK) >> NV40_VP_INST_VEC_OPCODE_SHIFT;
+}
+
+static unsigned
+nvfx_vp_sca_op(const uint32_t *hw)
+{
+	return (hw[1] & NV40_VP_INST_SCA_OPCODE_MASK) >> NV40_VP_INST_SCA_OPCODE_SHIFT;
+}
+
+static uint32_t
+nvfx_vp_src_bits(const uint32_t *hw, unsigned pos)
+{
+	switch (pos) {
+	case 0:
+		return (((hw[1] & NV40_VP_INST_SRC0H_MASK) >> NV40_VP_INST_SRC0H_SHIFT) << NV40_VP_SRC0_HIGH_SHIFT) |
+			((hw[2] & NV40_VP_INST_SRC0L_MASK) >> NV40_VP_INST_SRC0L_SHIFT);
+	case 1:
+		return (hw[2] & NV40_VP_INST_SRC1_MASK) >> NV40_VP_INST_SRC1_SHIFT;
+	default:
+		return (((hw[2] & NV40_VP_INST_SRC2H_MASK) >> NV40_VP_INST_SRC2H_SHIFT) << NV40_VP_SRC2_HIGH_SHIFT) |
+			((hw[3] & NV40_VP_INST_SRC2L_MASK) >> NV40_VP_INST_SRC2L_SHIFT);
+	}
+}
+
+/* The source swizzle has x in the high bits; make it x in the low bits,
+ * like the fragment programs': */
+static unsigned
+nvfx_vp_swizzle(uint32_t sr)
+{
+	return (((sr & NV40_VP_SRC_SWZ_X_MASK) >> NV40_VP_SRC_SWZ_X_SHIFT) << 0) |
+		(((sr & NV40_VP_SRC_SWZ_Y_MASK) >> NV40_VP_SRC_SWZ_Y_SHIFT) << 2) |
+		(((sr & NV40_VP_SRC_SWZ_Z_MASK) >> NV40_VP_SRC_SWZ_Z_SHIFT) << 4) |
+		(((sr & NV40_VP_SRC_SWZ_W_MASK) >> NV40_VP_SRC_SWZ_W_SHIFT) << 6);
+}
+
+static unsigned
+nvfx_vp_cond_swizzle(const uint32_t *hw)
+{
+	return (((hw[0] & NV40_VP_INST_COND_SWZ_X_MASK) >> NV40_VP_INST_COND_SWZ_X_SHIFT) << 0) |
+		(((hw[0] & NV40_VP_INST_COND_SWZ_Y_MASK) >> NV40_VP_INST_COND_SWZ_Y_SHIFT) << 2) |
+		(((hw[0] & NV40_VP_INST_COND_SWZ_Z_MASK) >> NV40_VP_INST_COND_SWZ_Z_SHIFT) << 4) |
+		(((hw[0] & NV40_VP_INST_COND_SWZ_W_MASK) >> NV40_VP_INST_COND_SWZ_W_SHIFT) << 6);
+}
+
+/* Write masks have x in the high bit: */
+static unsigned
+nvfx_vp_mask(unsigned mask)
+{
+	return ((mask >> 3) & 1) | ((mask >> 1) & 2) | ((mask << 1) & 4) | ((mask << 3) & 8);
+}
+
+static unsigned
+nvfx_vp_target(const uint32_t *hw)
+{
+	return (((hw[2] & NV40_VP_INST_IADDRH_MASK) >> NV40_VP_INST_IADDRH_SHIFT) << 3) |
+		((hw[3] & NV40_VP_INST_IADDRL_MASK) >> NV40_VP_INST_IADDRL_SHIFT);
+}
+
+static unsigned
+nvfx_vp_srcs(const uint32_t *hw)
+{
+	unsigned vec = nvfx_vp_vec_op(hw), sca = nvfx_vp_sca_op(hw);
+
+	return (nvfx_vp_vec_ops[vec].name ? nvfx_vp_vec_ops[vec].srcs : 7) |
+		(nvfx_vp_sca_ops[sca].name ? nvfx_vp_sca_ops[sca].srcs : 4);
+}
+
+static unsigned
+nvfx_vp_cycles(const uint32_t *hw)
+{
+	unsigned vec = nvfx_vp_vec_op(hw), sca = nvfx_vp_sca_op(hw);
+	unsigned cycles = NVFX_INTERP_COST_ALU;
+
+	/* the scalar unit works alongside the vector unit */
+	if (vec == NVFX_VP_INST_VEC_OP_TXL)
+		cycles = NVFX_INTERP_COST_TEX;
+	if (sca != NVFX_VP_INST_SCA_OP_NOP && nvfx_vp_sca_ops[sca].name &&
+	    nvfx_interp_cost_of(nvfx_vp_sca_ops[sca].kind) > cycles)
+		cycles = nvfx_interp_cost_of(nvfx_vp_sca_ops[sca].kind);
+	return cycles;
+}
+
+static int
+nvfx_vp_addr(const struct nvfx_vp_machine *m, const uint32_t *hw)
+{
+	return m->addr[(hw[0] & NV40_VP_INST_ADDR_REG_SELECT_1) ? 1 : 0]
+		[(hw[0] & NV40_VP_INST_ADDR_SWZ_MASK) >> NV40_VP_INST_ADDR_SWZ_SHIFT];
+}
+
+static void
+nvfx_vp_src(const struct nvfx_vp_machine *m, const uint32_t *hw, unsigned pos, float *v)
+{
+	uint32_t sr = nvfx_vp_src_bits(hw, pos);
+	float r[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	int index;
+
+	switch ((sr & NV40_VP_SRC_REG_TYPE_MASK) >> NV40_VP_SRC_REG_TYPE_SHIFT) {
+	case NV40_VP_SRC_REG_TYPE_TEMP:
+		memcpy(r, m->temps[(sr & NV40_VP_SRC_TEMP_SRC_MASK) >> NV40_VP_SRC_TEMP_SRC_SHIFT], sizeof(r));
+		break;
+	case NV40_VP_SRC_REG_TYPE_INPUT:
+		index = (hw[1] & NV40_VP_INST_INPUT_SRC_MASK) >> NV40_VP_INST_INPUT_SRC_SHIFT;
+		if (hw[0] & NV40_VP_INST_INDEX_INPUT)
+			index += nvfx_vp_addr(m, hw);
+		if (index >= 0 && index < NVFX_INTERP_VP_INPUTS)
+			memcpy(r, m->inputs[index], sizeof(r));
+		break;
+	case NV40_VP_SRC_REG_TYPE_CONST:
+		index = (hw[1] & NV40_VP_INST_CONST_SRC_MASK) >> NV40_VP_INST_CONST_SRC_SHIFT;
+		if (hw[3] & NV40_VP_INST_INDEX_CONST)
+			index += nvfx_vp_addr(m, hw);
+		if (index >= 0 && index < NVFX_INTERP_VP_CONSTS)
+			memcpy(r, m->consts[index], sizeof(r));
+		break;
+	}
+
+	nvfx_interp_swizzle(r, nvfx_vp_swizzle(sr), (sr & NV40_VP_SRC_NEGATE) != 0,
+			    (hw[0] & (1 << (21 + pos))) != 0, v);
+}
+
+static int
+nvfx_vp_vec(struct nvfx_vp_machine *m, const uint32_t *hw, float src[3][4], float *r)
+{
+	const float *a = src[0], *b = src[1], *c = src[2];
+	unsigned i;
+
+	switch (nvfx_vp_vec_op(hw)) {
+	case NVFX_VP_INST_VEC_OP_NOP:
+		break;
+	case NVFX_VP_INST_VEC_OP_MOV:
+		memcpy(r, a, sizeof(float) * 4);
+		break;
+	case NVFX_VP_INST_VEC_OP_MUL:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_mul(a[i], b[i]);
+		break;
+	case NVFX_VP_INST_VEC_OP_ADD:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_add(a[i], c[i]);
+		break;
+	case NVFX_VP_INST_VEC_OP_MAD:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_add(nvfx_interp_mul(a[i], b[i]), c[i]);
+		break;
+	case NVFX_VP_INST_VEC_OP_DP3:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_dot(a, b, 3);
+		break;
+	case NVFX_VP_INST_VEC_OP_DPH:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_add(nvfx_interp_dot(a, b, 3), b[3]);
+		break;
+	case NVFX_VP_INST_VEC_OP_DP4:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_dot(a, b, 4);
+		break;
+	case NVFX_VP_INST_VEC_OP_DST:
+		r[0] = 1.0f;
+		r[1] = nvfx_interp_mul(a[1], b[1]);
+		r[2] = a[2];
+		r[3] = b[3];
+		break;
+	case NVFX_VP_INST_VEC_OP_MIN:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_min(a[i], b[i]);
+		break;
+	case NVFX_VP_INST_VEC_OP_MAX:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_max(a[i], b[i]);
+		break;
+	case NVFX_VP_INST_VEC_OP_SLT:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] < b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_VP_INST_VEC_OP_SGE:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] >= b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_VP_INST_VEC_OP_SEQ:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] == b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_VP_INST_VEC_OP_SGT:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] > b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_VP_INST_VEC_OP_SLE:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] <= b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_VP_INST_VEC_OP_SNE:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] != b[i]) ? 1.0f : 0.0f;
+		break;
+	case NVFX_VP_INST_VEC_OP_SFL:
+		r[0] = r[1] = r[2] = r[3] = 0.0f;
+		break;
+	case NVFX_VP_INST_VEC_OP_STR:
+		r[0] = r[1] = r[2] = r[3] = 1.0f;
+		break;
+	case NVFX_VP_INST_VEC_OP_SSG:
+		for (i = 0; i < 4; ++i)
+			r[i] = (a[i] > 0.0f) ? 1.0f : ((a[i] < 0.0f) ? -1.0f : 0.0f);
+		break;
+	case NVFX_VP_INST_VEC_OP_FRC:
+		for (i = 0; i < 4; ++i)
+			r[i] = nvfx_interp_add(a[i], -floorf(a[i]));
+		break;
+	case NVFX_VP_INST_VEC_OP_FLR:
+	case NVFX_VP_INST_VEC_OP_ARL:
+		for (i = 0; i < 4; ++i)
+			r[i] = floorf(a[i]);
+		break;
+	case NVFX_VP_INST_VEC_OP_ARR:
+		for (i = 0; i < 4; ++i)
+			r[i] = rintf(a[i]);
+		break;
+	case NVFX_VP_INST_VEC_OP_TXL:
+		nvfx_interp_sample(m->sample, m->sample_data,
+				   (nvfx_vp_src_bits(hw, 1) & NV40_VP_SRC_TEMP_SRC_MASK) >> NV40_VP_SRC_TEMP_SRC_SHIFT,
+				   NVFX_FP_OP_OPCODE_TXL_NV40, a, a[3], r);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static int
+nvfx_vp_sca(const uint32_t *hw, const float *a, float *r)
+{
+	float s = a[0];
+
+	switch (nvfx_vp_sca_op(hw)) {
+	case NVFX_VP_INST_SCA_OP_NOP:
+	case NVFX_VP_INST_SCA_OP_BRA:
+	case NVFX_VP_INST_SCA_OP_CAL:
+	case NVFX_VP_INST_SCA_OP_RET:
+		break;
+	case NVFX_VP_INST_SCA_OP_MOV:
+		memcpy(r, a, sizeof(float) * 4);
+		break;
+	case NVFX_VP_INST_SCA_OP_RCP:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_div(1.0f, s);
+		break;
+	case NVFX_VP_INST_SCA_OP_RCC:
+		s = nvfx_interp_div(1.0f, s);
+		if (fabsf(s) < nvfx_interp_float(0x1f800000))
+			s = copysignf(nvfx_interp_float(0x1f800000), s);
+		else if (fabsf(s) > nvfx_interp_float(0x5f800000))
+			s = copysignf(nvfx_interp_float(0x5f800000), s);
+		r[0] = r[1] = r[2] = r[3] = s;
+		break;
+	case NVFX_VP_INST_SCA_OP_RSQ:
+		r[0] = r[1] = r[2] = r[3] = nvfx_interp_div(1.0f, sqrtf(fabsf(s)));
+		break;
+	case NVFX_VP_INST_SCA_OP_EXP:
+		r[0] = exp2f(floorf(s));
+		r[1] = nvfx_interp_add(s, -floorf(s));
+		r[2] = exp2f(s);
+		r[3] = 1.0f;
+		break;
+	case NVFX_VP_INST_SCA_OP_LOG:
+		s = fabsf(s);
+		r[2] = log2f(s);
+		r[0] = floorf(r[2]);
+		r[1] = nvfx_interp_div(s, exp2f(r[0]));
+		r[3] = 1.0f;
+		break;
+	case NVFX_VP_INST_SCA_OP_LIT:
+		nvfx_interp_lit(a, r);
+		break;
+	case NVFX_VP_INST_SCA_OP_LG2:
+		r[0] = r[1] = r[2] = r[3] = log2f(s);
+		break;
+	case NVFX_VP_INST_SCA_OP_EX2:
+		r[0] = r[1] = r[2] = r[3] = exp2f(s);
+		break;
+	case NVFX_VP_INST_SCA_OP_SIN:
+		r[0] = r[1] = r[2] = r[3] = sinf(s);
+		break;
+	case NVFX_VP_INST_SCA_OP_COS:
+		r[0] = r[1] = r[2] = r[3] = cosf(s);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static void
+nvfx_vp_write(struct nvfx_vp_machine *m, const uint32_t *hw, unsigned mask, int result, unsigned temp, float *r)
+{
+	unsigned dest = (hw[3] & NV40_VP_INST_DEST_MASK) >> NV40_VP_INST_DEST_SHIFT;
+	unsigned c;
+
+	for (c = 0; c < 4; ++c) {
+		if (!(mask & (1 << c)))
+			continue;
+		if (hw[0] & NV40_VP_INST_SATURATE)
+			r[c] = (r[c] != r[c]) ? 0.0f : nvfx_interp_clamp(r[c], 0.0f, 1.0f);
+		if (hw[0] & NV40_VP_INST_COND_UPDATE_ENABLE)
+			m->cc[(hw[0] & NV40_VP_INST_COND_REG_SELECT_1) ? 1 : 0][c] = r[c];
+		if (result) {
+			m->outputs[dest][c] = r[c];
+			m->written |= 1u << dest;
+		}
+		if (temp < NVFX_INTERP_VP_TEMPS)
+			m->temps[temp][c] = r[c];
+	}
+}
+
+int
+nvfx_vp_execute(struct nvfx_vp_machine *m, const uint32_t *insn, unsigned nr_insns)
+{
+	unsigned stack[NVFX_INTERP_STACK];
+	unsigned sp = 0, pc = 0;
+
+	memset(m->outputs, 0, sizeof(m->outputs));
+	memset(m->temps, 0, sizeof(m->temps));
+	memset(m->addr, 0, sizeof(m->addr));
+	memset(m->cc, 0, sizeof(m->cc));
+	m->written = 0;
+	m->executed = m->cycles = 0;
+
+	while (pc < nr_insns) {
+		const uint32_t *hw = insn + pc * 4;
+		unsigned vec = nvfx_vp_vec_op(hw), sca = nvfx_vp_sca_op(hw);
+		unsigned cond = (hw[0] & NV40_VP_INST_COND_MASK) >> NV40_VP_INST_COND_SHIFT;
+		unsigned swz = nvfx_vp_cond_swizzle(hw), pass = 0, c;
+		const float *cc = m->cc[(hw[0] & NV40_VP_INST_COND_REG_SELECT_1) ? 1 : 0];
+		float src[3][4], vr[4], sr[4];
+
+		if (m->executed == NVFX_INTERP_MAX_STEPS)
+			return -1;
+		++m->executed;
+		m->cycles += nvfx_vp_cycles(hw);
+
+		for (c = 0; c < 4; ++c) {
+			if (nvfx_interp_test(cond, cc[(swz >> (2 * c)) & 3]))
+				pass |= 1 << c;
+		}
+
+		/* both slots read their sources before either writes */
+		for (c = 0; c < 3; ++c)
+			nvfx_vp_src(m, hw, c, src[c]);
+		if (nvfx_vp_vec(m, hw, src, vr) || nvfx_vp_sca(hw, src[2], sr))
+			return -1;
+
+		if (vec == NVFX_VP_INST_VEC_OP_ARL || vec == NVFX_VP_INST_VEC_OP_ARR) {
+			unsigned mask = nvfx_vp_mask((hw[3] & NV40_VP_INST_VEC_WRITEMASK_MASK) >> NV40_VP_INST_VEC_WRITEMASK_SHIFT);
+
+			for (c = 0; c < 4; ++c) {
+				if (mask & pass & (1 << c))
+					m->addr[(hw[0] & NV40_VP_INST_ADDR_REG_SELECT_1) ? 1 : 0][c] = (int)vr[c];
+			}
+		} else if (vec != NVFX_VP_INST_VEC_OP_NOP) {
+			nvfx_vp_write(m, hw, pass & nvfx_vp_mask((hw[3] & NV40_VP_INST_VEC_WRITEMASK_MASK) >> NV40_VP_INST_VEC_WRITEMASK_SHIFT),
+				      (hw[0] & NV40_VP_INST_VEC_RESULT) != 0,
+				      (hw[0] & NV40_VP_INST_VEC_DEST_TEMP_MASK) >> NV40_VP_INST_VEC_DEST_TEMP_SHIFT, vr);
+		}
+
+		switch (sca) {
+		case NVFX_VP_INST_SCA_OP_NOP:
+			break;
+		case NVFX_VP_INST_SCA_OP_BRA:
+		case NVFX_VP_INST_SCA_OP_CAL:
+			if (!pass)
+				break;
+			if (sca == NVFX_VP_INST_SCA_OP_CAL) {
+				if (sp == NVFX_INTERP_STACK)
+					return -1;
+				stack[sp++] = pc + 1;
+			}
+			if (nvfx_vp_target(hw) < m->base)
+				return -1;
+			pc = nvfx_vp_target(hw) - m->base;
+			continue;
+		case NVFX_VP_INST_SCA_OP_RET:
+			if (!pass)
+				break;
+			if (!sp)
+				return 0;
+			pc = stack[--sp];
+			continue;
+		default:
+		{
+			unsigned temp = (hw[3] & NV40_VP_INST_SCA_DEST_TEMP_MASK) >> NV40_VP_INST_SCA_DEST_TEMP_SHIFT;
+
+			nvfx_vp_write(m, hw, pass & nvfx_vp_mask((hw[3] & NV40_VP_INST_SCA_WRITEMASK_MASK) >> NV40_VP_INST_SCA_WRITEMASK_SHIFT),
+				      (hw[3] & NV40_VP_INST_SCA_RESULT) != 0,
+				      (temp == 0x1f) ? NVFX_INTERP_VP_TEMPS : temp, sr);
+			break;
+		}
+		}
+
+		if (hw[3] & NVFX_VP_INST_LAST)
+			return 0;
+		++pc;
+	}
+	return 0;
+}
+
+void
+nvfx_vp_cost(const uint32_t *insn, unsigned nr_insns, struct nvfx_vp_cost *cost)
+{
+	unsigned i, pos;
+
+	memset(cost, 0, sizeof(*cost));
+
+	for (i = 0; i < nr_insns; ++i) {
+		const uint32_t *hw = insn + i * 4;
+		unsigned vec = nvfx_vp_vec_op(hw), sca = nvfx_vp_sca_op(hw), srcs = nvfx_vp_srcs(hw);
+		unsigned temp;
+
+		++cost->insns;
+		cost->cycles += nvfx_vp_cycles(hw);
+
+		if (vec != NVFX_VP_INST_VEC_OP_NOP)
+			++cost->vec;
+		if (sca != NVFX_VP_INST_SCA_OP_NOP)
+			++cost->sca;
+		if (vec != NVFX_VP_INST_VEC_OP_NOP && sca != NVFX_VP_INST_SCA_OP_NOP)
+			++cost->coissued;
+		if (vec == NVFX_VP_INST_VEC_OP_TXL)
+			++cost->tex;
+		if (sca == NVFX_VP_INST_SCA_OP_BRA || sca == NVFX_VP_INST_SCA_OP_CAL || sca == NVFX_VP_INST_SCA_OP_RET)
+			++cost->branches;
+		else if (nvfx_vp_sca_ops[sca].name && nvfx_vp_sca_ops[sca].kind == NVFX_INTERP_SPECIAL)
+			++cost->special;
+
+		temp = (hw[0] & NV40_VP_INST_VEC_DEST_TEMP_MASK) >> NV40_VP_INST_VEC_DEST_TEMP_SHIFT;
+		if (vec != NVFX_VP_INST_VEC_OP_NOP && temp < NVFX_INTERP_VP_TEMPS && temp >= cost->temps)
+			cost->temps = temp + 1;
+		temp = (hw[3] & NV40_VP_INST_SCA_DEST_TEMP_MASK) >> NV40_VP_INST_SCA_DEST_TEMP_SHIFT;
+		if (sca != NVFX_VP_INST_SCA_OP_NOP && temp != 0x1f && temp >= cost->temps)
+			cost->temps = temp + 1;
+
+		for (pos = 0; pos < 3; ++pos) {
+			uint32_t sr = nvfx_vp_src_bits(hw, pos);
+
+			if (!(srcs & (1 << pos)))
+				continue;
+			if (((sr & NV40_VP_SRC_REG_TYPE_MASK) >> NV40_VP_SRC_REG_TYPE_SHIFT) == NV40_VP_SRC_REG_TYPE_TEMP) {
+				temp = (sr & NV40_VP_SRC_TEMP_SRC_MASK) >> NV40_VP_SRC_TEMP_SRC_SHIFT;
+				if (temp >= cost->temps)
+					cost->temps = temp + 1;
+			}
+		}
+
+		for (pos = 0; pos < 3; ++pos) {
+			uint32_t sr = nvfx_vp_src_bits(hw, pos);
+
+			if ((srcs & (1 << pos)) &&
+			    ((sr & NV40_VP_SRC_REG_TYPE_MASK) >> NV40_VP_SRC_REG_TYPE_SHIFT) == NV40_VP_SRC_REG_TYPE_CONST) {
+				++cost->consts;
+				break;
+			}
+		}
+	}
+}
+
+static const char *nvfx_vp_outputs[16] = {
+	"HPOS", "COL0", "COL1", "BFC0", "BFC1", "FOGC", "PSZ", "TEX0",
+	"TEX1", "TEX2", "TEX3", "TEX4", "TEX5", "TEX6", "TEX7", "TEX8"
+};
+
+static void
+nvfx_vp_print_src(FILE *f, const uint32_t *hw, unsigned pos)
+{
+	uint32_t sr = nvfx_vp_src_bits(hw, pos);
+	int absolute = (hw[0] & (1 << (21 + pos))) != 0;
+	char addr[16] = "";
+
+	if ((hw[0] & NV40_VP_INST_INDEX_INPUT) || (hw[3] & NV40_VP_INST_INDEX_CONST))
+		snprintf(addr, sizeof(addr), "A%u.%c+", (hw[0] & NV40_VP_INST_ADDR_REG_SELECT_1) ? 1 : 0,
+			 nvfx_interp_comps[(hw[0] & NV40_VP_INST_ADDR_SWZ_MASK) >> NV40_VP_INST_ADDR_SWZ_SHIFT]);
+
+	if (sr & NV40_VP_SRC_NEGATE)
+		fputc('-', f);
+	if (absolute)
+		fputc('|', f);
+
+	switch ((sr & NV40_VP_SRC_REG_TYPE_MASK) >> NV40_VP_SRC_REG_TYPE_SHIFT) {
+	case NV40_VP_SRC_REG_TYPE_TEMP:
+		fprintf(f, "R%u", (sr & NV40_VP_SRC_TEMP_SRC_MASK) >> NV40_VP_SRC_TEMP_SRC_SHIFT);
+		break;
+	case NV40_VP_SRC_REG_TYPE_INPUT:
+		fprintf(f, "v[%s%u]", (hw[0] & NV40_VP_INST_INDEX_INPUT) ? addr : "",
+			(hw[1] & NV40_VP_INST_INPUT_SRC_MASK) >> NV40_VP_INST_INPUT_SRC_SHIFT);
+		break;
+	case NV40_VP_SRC_REG_TYPE_CONST:
+		fprintf(f, "c[%s%u]", (hw[3] & NV40_VP_INST_INDEX_CONST) ? addr : "",
+			(hw[1] & NV40_VP_INST_CONST_SRC_MASK) >> NV40_VP_INST_CONST_SRC_SHIFT);
+		break;
+	default:
+		fputc('?', f);
+		break;
+	}
+
+	nvfx_interp_print_swizzle(f, nvfx_vp_swizzle(sr));
+	if (absolute)
+		fputc('|', f);
+}
+
+static void
+nvfx_vp_print_dst(FILE *f, const uint32_t *hw, int result, unsigned temp, unsigned none, unsigned mask)
+{
+	unsigned dest = (hw[3] & NV40_VP_INST_DEST_MASK) >> NV40_VP_INST_DEST_SHIFT;
+
+	if (result) {
+		if (dest < 16)
+			fprintf(f, "o[%s]", nvfx_vp_outputs[dest]);
+		else
+			fprintf(f, "o[%u]", dest);
+		if (temp != none)
+			fprintf(f, "+R%u", temp);
+	} else if (temp != none) {
+		fprintf(f, "R%u", temp);
+	} else {
+		fprintf(f, "RC");
+	}
+	nvfx_interp_print_mask(f, nvfx_vp_mask(mask));
+}
+
+static void
+nvfx_vp_print_suffix(FILE *f, const uint32_t *hw)
+{
+	fprintf(f, "%s%s ", (hw[0] & NV40_VP_INST_COND_UPDATE_ENABLE) ? "C" : "",
+		(hw[0] & NV40_VP_INST_SATURATE) ? "_SAT" : "");
+}
+
+static void
+nvfx_vp_print_cond(FILE *f, const uint32_t *hw, int always)
+{
+	unsigned cond = (hw[0] & NV40_VP_INST_COND_MASK) >> NV40_VP_INST_COND_SHIFT;
+	unsigned swz = nvfx_vp_cond_swizzle(hw);
+
+	if (!always && cond == NVFX_COND_TR && swz == NVFX_SWZ_IDENTITY)
+		return;
+	fprintf(f, "(%s%u", nvfx_interp_conds[cond], (hw[0] & NV40_VP_INST_COND_REG_SELECT_1) ? 1 : 0);
+	nvfx_interp_print_swizzle(f, swz);
+	fputc(')', f);
+}
+
+void
+nvfx_vp_disassemble(FILE *f, const uint32_t *insn, unsigned nr_insns)
+{
+	unsigned i, pos;
+
+	for (i = 0; i < nr_insns; ++i) {
+		const uint32_t *hw = insn + i * 4;
+		unsigned vec = nvfx_vp_vec_op(hw), sca = nvfx_vp_sca_op(hw);
+
+		fprintf(f, "%4u: ", i);
+
+		if (vec != NVFX_VP_INST_VEC_OP_NOP || sca == NVFX_VP_INST_SCA_OP_NOP) {
+			unsigned srcs = nvfx_vp_vec_ops[vec].name ? nvfx_vp_vec_ops[vec].srcs : 7;
+			unsigned mask = (hw[3] & NV40_VP_INST_VEC_WRITEMASK_MASK) >> NV40_VP_INST_VEC_WRITEMASK_SHIFT;
+
+			if (nvfx_vp_vec_ops[vec].name)
+				fputs(nvfx_vp_vec_ops[vec].name, f);
+			else
+				fprintf(f, "VEC%02x", vec);
+
+			if (vec != NVFX_VP_INST_VEC_OP_NOP) {
+				nvfx_vp_print_suffix(f, hw);
+				if (vec == NVFX_VP_INST_VEC_OP_ARL || vec == NVFX_VP_INST_VEC_OP_ARR ||
+				    vec == NVFX_VP_INST_VEC_OP_ARA) {
+					fprintf(f, "A%u", (hw[0] & NV40_VP_INST_ADDR_REG_SELECT_1) ? 1 : 0);
+					nvfx_interp_print_mask(f, nvfx_vp_mask(mask));
+				} else {
+					nvfx_vp_print_dst(f, hw, (hw[0] & NV40_VP_INST_VEC_RESULT) != 0,
+							  (hw[0] & NV40_VP_INST_VEC_DEST_TEMP_MASK) >> NV40_VP_INST_VEC_DEST_TEMP_SHIFT,
+							  0x3f, mask);
+				}
+				nvfx_vp_print_cond(f, hw, 0);
+				for (pos = 0; pos < 3; ++pos) {
+					if (!(srcs & (1 << pos)))
+						continue;
+					fputs(", ", f);
+					nvfx_vp_print_src(f, hw, pos);
+				}
+				if (vec == NVFX_VP_INST_VEC_OP_TXL)
+					fprintf(f, ", TEX%u", (nvfx_vp_src_bits(hw, 1) & NV40_VP_SRC_TEMP_SRC_MASK) >> NV40_VP_SRC_TEMP_SRC_SHIFT);
+			}
+		}
+
+		if (sca != NVFX_VP_INST_SCA_OP_NOP) {
+			unsigned mask = (hw[3] & NV40_VP_INST_SCA_WRITEMASK_MASK) >> NV40_VP_INST_SCA_WRITEMASK_SHIFT;
+
+			if (vec != NVFX_VP_INST_VEC_OP_NOP)
+				fputs(" + ", f);
+
+			if (nvfx_vp_sca_ops[sca].name)
+				fputs(nvfx_vp_sca_ops[sca].name, f);
+			else
+				fprintf(f, "SCA%02x", sca);
+
+			switch (sca) {
+			case NVFX_VP_INST_SCA_OP_BRA:
+			case NVFX_VP_INST_SCA_OP_CAL:
+				fprintf(f, " @%u ", nvfx_vp_target(hw));
+				nvfx_vp_print_cond(f, hw, 1);
+				break;
+			case NVFX_VP_INST_SCA_OP_RET:
+				fputc(' ', f);
+				nvfx_vp_print_cond(f, hw, 1);
+				break;
+			default:
+				nvfx_vp_print_suffix(f, hw);
+				nvfx_vp_print_dst(f, hw, (hw[3] & NV40_VP_INST_SCA_RESULT) != 0,
+						  (hw[3] & NV40_VP_INST_SCA_DEST_TEMP_MASK) >> NV40_VP_INST_SCA_DEST_TEMP_SHIFT,
+						  0x1f, mask);
+				nvfx_vp_print_cond(f, hw, 0);
+				fputs(", ", f);
+				nvfx_vp_print_src(f, hw, 2);
+				break;
+			}
+		}
+
+		fprintf(f, ";%s\n", (hw[3] & NVFX_VP_INST_LAST) ? " # LAST" : "");
+	}
+}
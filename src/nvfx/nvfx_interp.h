@@ -0,0 +1,128 @@
+#ifndef __NVFX_INTERP_H__
+#define __NVFX_INTERP_H__
+
+/* Disassembly, execution and static cost estimation of NV40 vertex and
+ * fragment program microcode, on the host. This is shared by the driver's
+ * TGSI translators and by cgcomp, so it only depends upon the microcode
+ * definitions.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVFX_INTERP_VP_INPUTS  16
+#define NVFX_INTERP_VP_OUTPUTS 32
+#define NVFX_INTERP_VP_TEMPS   32
+#define NVFX_INTERP_VP_CONSTS  512
+#define NVFX_INTERP_FP_INPUTS  16
+#define NVFX_INTERP_FP_REGS    64
+
+/* Executions give up after this many instructions: */
+#define NVFX_INTERP_MAX_STEPS  (1 << 20)
+
+/* Texture lookups are made through this. op is the fragment program opcode
+ * (NVFX_FP_OP_OPCODE_TEX, _TXP, _TXB, _TXD or _TXL_NV40; vertex program TXL
+ * is passed as _TXL_NV40); coord has been divided through by w for TXP,
+ * and lod is the bias (TXB) or level (TXL), 0 otherwise. Without one, the
+ * texel returned is the coordinate. */
+typedef void (*nvfx_interp_sample_func)(void *data, unsigned unit, unsigned op,
+					const float coord[4], float lod, float texel[4]);
+
+struct nvfx_vp_machine {
+	/* In: */
+	float inputs[NVFX_INTERP_VP_INPUTS][4];
+	float consts[NVFX_INTERP_VP_CONSTS][4];
+	unsigned base;		/* where the program was loaded; branch targets are absolute */
+	nvfx_interp_sample_func sample;
+	void *sample_data;
+
+	/* Out, by NV40_VP_INST_DEST_*: */
+	float outputs[NVFX_INTERP_VP_OUTPUTS][4];
+	unsigned written;	/* outputs written to, a bit each */
+
+	/* State; zeroed by nvfx_vp_execute(): */
+	float temps[NVFX_INTERP_VP_TEMPS][4];
+	int addr[2][4];
+	float cc[2][4];
+
+	/* Out: instructions executed, and their cost as nvfx_vp_cost() counts it: */
+	unsigned executed;
+	unsigned cycles;
+};
+
+struct nvfx_fp_machine {
+	/* In, by NVFX_FP_OP_INPUT_SRC_*: */
+	float inputs[NVFX_INTERP_FP_INPUTS][4];
+	nvfx_interp_sample_func sample;
+	void *sample_data;
+
+	/* R registers, as IEEE single precision bits. H(2n) and H(2n+1) are
+	 * the low & high halves of R(n): H(2n).xy are packed into R(n).x, and
+	 * H(2n).zw into R(n).y, x in the low 16 bits. Zeroed by
+	 * nvfx_fp_execute(): */
+	uint32_t regs[NVFX_INTERP_FP_REGS][4];
+	float cc[4];
+	int killed;
+
+	unsigned executed;
+	unsigned cycles;
+};
+
+/* Static cost of a program, as if every instruction were executed once.
+ * Cycles are a throughput estimate: an issue slot per instruction (both
+ * halves of a co-issued vertex program instruction share one), more for
+ * special functions and texture fetches, and a slot for each fragment
+ * program inline constant. */
+struct nvfx_fp_cost {
+	unsigned insns;		/* excluding inline constants */
+	unsigned consts;	/* inline constant slots */
+	unsigned tex;
+	unsigned special;	/* RCP, RSQ, EX2, LG2, SIN, COS, POW, DIV, ... */
+	unsigned half;		/* at FP16 or FX12 precision, or writing an H register */
+	unsigned branches;
+	unsigned cycles;
+	unsigned regs;		/* R registers touched, counting each H register as half of one */
+};
+
+struct nvfx_vp_cost {
+	unsigned insns;
+	unsigned vec;
+	unsigned sca;
+	unsigned coissued;	/* instructions using both slots */
+	unsigned tex;
+	unsigned special;
+	unsigned branches;
+	unsigned cycles;
+	unsigned temps;		/* highest temporary touched, plus one */
+	unsigned consts;	/* instructions reading a constant */
+};
+
+/* Programs are as the driver keeps them: host order words, fragment
+ * program lengths in words, vertex program lengths in instructions. */
+void nvfx_fp_disassemble(FILE *f, const uint32_t *insn, unsigned insn_len);
+void nvfx_vp_disassemble(FILE *f, const uint32_t *insn, unsigned nr_insns);
+
+void nvfx_fp_cost(const uint32_t *insn, unsigned insn_len, struct nvfx_fp_cost *cost);
+void nvfx_vp_cost(const uint32_t *insn, unsigned nr_insns, struct nvfx_vp_cost *cost);
+
+/* Both return 0, or -1 for an instruction that isn't understood, a runaway
+ * program, or control flow that can't be followed. */
+int nvfx_fp_execute(struct nvfx_fp_machine *m, const uint32_t *insn, unsigned insn_len);
+int nvfx_vp_execute(struct nvfx_vp_machine *m, const uint32_t *insn, unsigned nr_insns);
+
+/* Fetch an R (half = 0) or H register of a fragment program machine: */
+void nvfx_fp_read_reg(const struct nvfx_fp_machine *m, unsigned index, int half, float v[4]);
+
+/* IEEE half precision, rounding to nearest even: */
+uint16_t nvfx_float_to_half(float f);
+float nvfx_half_to_float(uint16_t h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1195 @@
+// "Unit testing" for nvfx_interp.c. Hand assembled programs are run, disassembled and costed, and
+// the results compared with what they ought to be; and then run again once they've been optimized or
+// had their registers allocated (nvfx_optimize.c), to show that they still mean the same thing.
+// Meant to be built & run on the host, e.g.:
+//
+// gcc -std=c99 -c nvfx_interp.c nvfx_optimize.c -I../../extsrc/mesa/src/gallium/include
+// g++ -std=c++11 -ffp-contract=off nvfx_interp_unit_tests.cc nvfx_interp.o nvfx_optimize.o -o nvfx_interp_unit_tests
+//
+// The fields the programs are assembled with are copied from nvfx_shader.h & nv40_vertprog.h, which
+// can't be compiled as C++; it's the semantics being tested here, not the encoding.
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+
+#include "nvfx_interp.h"
+#include "nvfx_optimize.h"
+
+#define NV40_FP_OP_BRA_OPCODE_BRK 0x0
+#define NV40_FP_OP_BRA_OPCODE_CAL 0x1
+#define NV40_FP_OP_BRA_OPCODE_IF 0x2
+#define NV40_FP_OP_BRA_OPCODE_REP 0x4
+#define NV40_FP_OP_BRA_OPCODE_RET 0x5
+#define NV40_FP_OP_OPCODE_IS_BRANCH (1<<31)
+#define NV40_FP_OP_OUT_NONE (1 << 30)
+#define NV40_FP_OP_REP_COUNT1_SHIFT 2
+#define NV40_FP_OP_REP_COUNT2_SHIFT 10
+#define NV40_FP_OP_REP_COUNT3_SHIFT 19
+#define NV40_VP_INST_COND_MASK (0x7 << 10)
+#define NV40_VP_INST_COND_SHIFT 10
+#define NV40_VP_INST_COND_SWZ_ALL_MASK (0xFF << 2)
+#define NV40_VP_INST_COND_SWZ_ALL_SHIFT 2
+#define NV40_VP_INST_COND_UPDATE_ENABLE ((1 << 14)|1<<29)
+#define NV40_VP_INST_CONST_SRC_SHIFT 12
+#define NV40_VP_INST_DEST_COL0 1
+#define NV40_VP_INST_DEST_COL1 2
+#define NV40_VP_INST_DEST_MASK (31 << 2)
+#define NV40_VP_INST_DEST_POS 0
+#define NV40_VP_INST_DEST_SHIFT 2
+#define NV40_VP_INST_DEST_TC(n) (7+n)
+#define NV40_VP_INST_IADDRH_SHIFT 0
+#define NV40_VP_INST_IADDRL_SHIFT 29
+#define NV40_VP_INST_INDEX_CONST (1 << 1)
+#define NV40_VP_INST_INPUT_SRC_SHIFT 8
+#define NV40_VP_INST_SCA_DEST_TEMP_MASK (0x1F << 7)
+#define NV40_VP_INST_SCA_DEST_TEMP_SHIFT 7
+#define NV40_VP_INST_SCA_OPCODE_SHIFT 27
+#define NV40_VP_INST_SCA_RESULT (1 << 12)
+#define NV40_VP_INST_SCA_WRITEMASK_SHIFT 17
+#define NV40_VP_INST_SRC0H_SHIFT 0
+#define NV40_VP_INST_SRC0L_SHIFT 23
+#define NV40_VP_INST_SRC1_SHIFT 6
+#define NV40_VP_INST_SRC2H_SHIFT 0
+#define NV40_VP_INST_SRC2L_SHIFT 21
+#define NV40_VP_INST_VEC_DEST_TEMP_MASK (0x3F << 15)
+#define NV40_VP_INST_VEC_DEST_TEMP_SHIFT 15
+#define NV40_VP_INST_VEC_OPCODE_SHIFT 22
+#define NV40_VP_INST_VEC_RESULT (1 << 30)
+#define NV40_VP_INST_VEC_WRITEMASK_SHIFT 13
+#define NV40_VP_SRC0_HIGH_MASK 0x0001FE00
+#define NV40_VP_SRC0_HIGH_SHIFT 9
+#define NV40_VP_SRC0_LOW_MASK 0x000001FF
+#define NV40_VP_SRC2_HIGH_MASK 0x0001F800
+#define NV40_VP_SRC2_HIGH_SHIFT 11
+#define NV40_VP_SRC2_LOW_MASK 0x000007FF
+#define NV40_VP_SRC_REG_TYPE_CONST 3
+#define NV40_VP_SRC_REG_TYPE_INPUT 2
+#define NV40_VP_SRC_REG_TYPE_TEMP 1
+#define NV40_VP_SRC_SWZ_ALL_MASK (0xFF << 8)
+#define NV40_VP_SRC_SWZ_W_SHIFT 8
+#define NV40_VP_SRC_SWZ_X_SHIFT 14
+#define NV40_VP_SRC_SWZ_Y_SHIFT 12
+#define NV40_VP_SRC_SWZ_Z_SHIFT 10
+#define NV40_VP_SRC_TEMP_SRC_SHIFT 2
+#define NVFX_COND_EQ 2
+#define NVFX_COND_FL 0
+#define NVFX_COND_GE 6
+#define NVFX_COND_GT 4
+#define NVFX_COND_LT 1
+#define NVFX_COND_NE 5
+#define NVFX_COND_TR 7
+#define NVFX_FP_OP_COND_SHIFT 18
+#define NVFX_FP_OP_COND_SWZ_ALL_SHIFT 21
+#define NVFX_FP_OP_COND_WRITE_ENABLE (1 << 8)
+#define NVFX_FP_OP_DST_SCALE_2X 1
+#define NVFX_FP_OP_DST_SCALE_SHIFT 28
+#define NVFX_FP_OP_INPUT_SRC_COL0 0x1
+#define NVFX_FP_OP_INPUT_SRC_SHIFT 13
+#define NVFX_FP_OP_INPUT_SRC_TC(n) (0x4 + n)
+#define NVFX_FP_OP_OPCODE_ADD 0x03
+#define NVFX_FP_OP_OPCODE_KIL 0x12
+#define NVFX_FP_OP_OPCODE_MAD 0x04
+#define NVFX_FP_OP_OPCODE_MOV 0x01
+#define NVFX_FP_OP_OPCODE_MUL 0x02
+#define NVFX_FP_OP_OPCODE_SHIFT 24
+#define NVFX_FP_OP_OPCODE_TEX 0x17
+#define NVFX_FP_OP_OPCODE_TXB 0x31
+#define NVFX_FP_OP_OPCODE_TXP 0x18
+#define NVFX_FP_OP_OUTMASK_SHIFT 9
+#define NVFX_FP_OP_OUT_REG_HALF (1 << 7)
+#define NVFX_FP_OP_OUT_REG_SHIFT 1
+#define NVFX_FP_OP_OUT_SAT (1 << 31)
+#define NVFX_FP_OP_PRECISION_SHIFT 22
+#define NVFX_FP_OP_PROGRAM_END (1 << 0)
+#define NVFX_FP_OP_TEX_UNIT_SHIFT 17
+#define NVFX_FP_PRECISION_FP16 1
+#define NVFX_FP_PRECISION_FX12 2
+#define NVFX_FP_REG_SRC_HALF (1 << 8)
+#define NVFX_FP_REG_SRC_SHIFT 2
+#define NVFX_FP_REG_SWZ_ALL_MASK (255 << 9)
+#define NVFX_FP_REG_SWZ_ALL_SHIFT 9
+#define NVFX_FP_REG_TYPE_CONST 2
+#define NVFX_FP_REG_TYPE_INPUT 1
+#define NVFX_FP_REG_TYPE_TEMP 0
+#define NVFX_SWZ_IDENTITY ((3 << 6) | (2 << 4) | (1 << 2) | (0 << 0))
+#define NVFX_VP_INST_LAST (1 << 0)
+#define NVFX_VP_INST_SCA_OP_BRA 0x09
+#define NVFX_VP_INST_SCA_OP_CAL 0x0B
+#define NVFX_VP_INST_SCA_OP_EXP 0x05
+#define NVFX_VP_INST_SCA_OP_LOG 0x06
+#define NVFX_VP_INST_SCA_OP_MOV 0x01
+#define NVFX_VP_INST_SCA_OP_RCP 0x02
+#define NVFX_VP_INST_SCA_OP_RET 0x0C
+#define NVFX_VP_INST_VEC_OP_ARL 0x0D
+#define NVFX_VP_INST_VEC_OP_DP4 0x07
+#define NVFX_VP_INST_VEC_OP_MOV 0x01
+#define NVFX_VP_INST_VEC_OP_NOP 0x00
+
+static uint32_t
+bits(float f)
+{
+  uint32_t u;
+  memcpy(&u,&f,4);
+  return u;
+}
+
+static float
+value(uint32_t u)
+{
+  float f;
+  memcpy(&f,&u,4);
+  return f;
+}
+
+static bool
+same(const float * a,const float * b,unsigned n)
+{
+  for(unsigned i = 0;i < n;++i) {
+    if(isnan(a[i]) ? !isnan(b[i]) : (bits(a[i]) != bits(b[i]))) return false;
+  }
+  return true;
+}
+
+static bool
+same4(const float * a,float x,float y,float z,float w)
+{
+  const float b[4] = { x, y, z, w };
+  return same(a,b,4);
+}
+
+// Run a disassembler into a string:
+template< typename Function >
+static std::string
+disassemble(Function function,const std::vector< uint32_t > & insn,unsigned length)
+{
+  FILE * f = tmpfile();
+  function(f,&insn[0],length);
+  std::string result((size_t)ftell(f),'\0');
+  rewind(f);
+  if(!result.empty()) assert(fread(&result[0],1,result.size(),f) == result.size());
+  fclose(f);
+  return result;
+}
+
+// Half precision, done the slow way:
+static float
+reference_half(float f)
+{
+  double a = fabs((double)f);
+  if(a >= 65520.0) return copysignf(INFINITY,f);
+  int e = 0;
+  frexp(a,&e);
+  if(e - 1 < -14) e = -13;
+  const double ulp = ldexp(1.0,e - 1 - 10);
+  return copysignf((float)(nearbyint(a / ulp) * ulp),f);
+}
+
+static void
+test_half()
+{
+  // Every half survives a round trip:
+  for(uint32_t h = 0;h < 0x10000;++h) {
+    const float f = nvfx_half_to_float(h);
+    if(((h >> 10) & 0x1f) == 0x1f && (h & 0x3ff)) {
+      assert(isnan(f));
+      assert((nvfx_float_to_half(f) & 0x7c00) == 0x7c00 && (nvfx_float_to_half(f) & 0x3ff));
+    }
+    else {
+      assert(nvfx_float_to_half(f) == h);
+    }
+  }
+
+  // Rounding:
+  assert(nvfx_float_to_half(65504.0f) == 0x7bff);
+  assert(nvfx_float_to_half(65519.0f) == 0x7bff);
+  assert(nvfx_float_to_half(65520.0f) == 0x7c00);
+  assert(nvfx_float_to_half(-1e10f) == 0xfc00);
+  assert(nvfx_float_to_half(ldexpf(1.0f,-24)) == 0x0001);
+  assert(nvfx_float_to_half(ldexpf(1.0f,-25)) == 0x0000);
+  assert(nvfx_float_to_half(ldexpf(3.0f,-26)) == 0x0001);
+  assert(nvfx_float_to_half(ldexpf(3.0f,-25)) == 0x0002);
+  assert(nvfx_float_to_half(-0.0f) == 0x8000);
+  assert(nvfx_float_to_half(1.0f + ldexpf(1.0f,-11)) == 0x3c00);
+  assert(nvfx_float_to_half(1.0f + ldexpf(3.0f,-11)) == 0x3c02);
+
+  uint32_t seed = 1;
+  for(unsigned i = 0;i < 1000000;++i) {
+    seed = seed * 1664525 + 1013904223;
+    // Mostly within half's range:
+    const float f = value((seed & 0x8fffffff) | ((seed & 1) ? 0x30000000 : 0));
+    if(isnan(f)) continue;
+    const float r = nvfx_half_to_float(nvfx_float_to_half(f)), e = reference_half(f);
+    assert(same(&r,&e,1));
+  }
+}
+
+namespace fp {
+
+struct program_t {
+  std::vector< uint32_t > insn;
+  unsigned last;
+
+  program_t() : last(0) {
+  }
+
+  // Returns the instruction's word offset. Instructions that aren't branches are unconditional
+  // unless their hw[1] says otherwise:
+  unsigned emit(uint32_t hw0,uint32_t hw1,uint32_t hw2,uint32_t hw3,const float * imm = 0) {
+    if(!(hw2 & NV40_FP_OP_OPCODE_IS_BRANCH) && !(hw1 & (7 << NVFX_FP_OP_COND_SHIFT))) {
+      hw1 |= (NVFX_COND_TR << NVFX_FP_OP_COND_SHIFT) | (NVFX_SWZ_IDENTITY << NVFX_FP_OP_COND_SWZ_ALL_SHIFT);
+    }
+    last = insn.size();
+    insn.push_back(hw0);
+    insn.push_back(hw1);
+    insn.push_back(hw2);
+    insn.push_back(hw3);
+    if(imm != 0) {
+      for(unsigned i = 0;i < 4;++i) insn.push_back(bits(imm[i]));
+    }
+    return last;
+  }
+
+  unsigned here() const {
+    return insn.size();
+  }
+
+  void end() {
+    insn[last] |= NVFX_FP_OP_PROGRAM_END;
+  }
+};
+
+static uint32_t
+op(unsigned o,unsigned mask = 0xf)
+{
+  return (o << NVFX_FP_OP_OPCODE_SHIFT) | (mask << NVFX_FP_OP_OUTMASK_SHIFT);
+}
+
+static uint32_t
+r(unsigned index)
+{
+  return index << NVFX_FP_OP_OUT_REG_SHIFT;
+}
+
+static uint32_t
+h(unsigned index)
+{
+  return (index << NVFX_FP_OP_OUT_REG_SHIFT) | NVFX_FP_OP_OUT_REG_HALF;
+}
+
+static uint32_t
+in(unsigned index)
+{
+  return index << NVFX_FP_OP_INPUT_SRC_SHIFT;
+}
+
+static const uint32_t identity = NVFX_SWZ_IDENTITY << NVFX_FP_REG_SWZ_ALL_SHIFT;
+static const uint32_t src_none = NVFX_FP_REG_TYPE_INPUT | identity;
+static const uint32_t src_in = NVFX_FP_REG_TYPE_INPUT | identity;
+static const uint32_t src_c = NVFX_FP_REG_TYPE_CONST | identity;
+
+static uint32_t
+src_r(unsigned index)
+{
+  return NVFX_FP_REG_TYPE_TEMP | (index << NVFX_FP_REG_SRC_SHIFT) | identity;
+}
+
+static uint32_t
+src_h(unsigned index)
+{
+  return src_r(index) | NVFX_FP_REG_SRC_HALF;
+}
+
+static uint32_t
+xxxx(uint32_t src)
+{
+  return src & ~NVFX_FP_REG_SWZ_ALL_MASK;
+}
+
+// hw[1] condition:
+static uint32_t
+cond(unsigned c,unsigned swz = 0)
+{
+  return (c << NVFX_FP_OP_COND_SHIFT) | (swz << NVFX_FP_OP_COND_SWZ_ALL_SHIFT);
+}
+
+static uint32_t
+branch(unsigned o)
+{
+  return o << NVFX_FP_OP_OPCODE_SHIFT;
+}
+
+static int
+run(const program_t & p,nvfx_fp_machine & m)
+{
+  return nvfx_fp_execute(&m,&p.insn[0],p.insn.size());
+}
+
+static void
+read(const nvfx_fp_machine & m,unsigned index,bool half,float v[4])
+{
+  nvfx_fp_read_reg(&m,index,half,v);
+}
+
+struct sample_log {
+  unsigned unit, op;
+  float coord[4], lod;
+};
+
+static void
+sample(void * data,unsigned unit,unsigned op,const float coord[4],float lod,float texel[4])
+{
+  sample_log * log = (sample_log *)data;
+  log -> unit = unit;
+  log -> op = op;
+  memcpy(log -> coord,coord,sizeof(float) * 4);
+  log -> lod = lod;
+  for(unsigned i = 0;i < 4;++i) texel[i] = coord[i] * 2.0f;
+}
+
+} // namespace fp
+
+static void
+test_fp_arithmetic()
+{
+  using namespace fp;
+  const float k[4] = { 2.0f, 3.0f, 4.0f, 5.0f };
+  float v[4];
+
+  // MOVR R1, f[COL0]; MADR R0, f[TEX0], {2, 3, 4, 5}, R1:
+  {
+    program_t p;
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(1) | in(NVFX_FP_OP_INPUT_SRC_COL0),src_in,src_none,src_none);
+    p.emit(op(NVFX_FP_OP_OPCODE_MAD) | r(0) | in(NVFX_FP_OP_INPUT_SRC_TC(0)),src_in,src_c,src_r(1),k);
+    p.end();
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    const float tex[4] = { 0.1f, 0.2f, 0.3f, 0.4f }, col[4] = { 1.0f / 3.0f, -1.0f, 1e-8f, 7.0f };
+    memcpy(m.inputs[NVFX_FP_OP_INPUT_SRC_TC(0)],tex,sizeof(tex));
+    memcpy(m.inputs[NVFX_FP_OP_INPUT_SRC_COL0],col,sizeof(col));
+    assert(run(p,m) == 0);
+    assert(m.executed == 2);
+
+    read(m,0,false,v);
+    for(unsigned i = 0;i < 4;++i) {
+      volatile float product = tex[i] * k[i];
+      const float expected = product + col[i];
+      assert(same(&v[i],&expected,1));
+    }
+
+    assert(disassemble(nvfx_fp_disassemble,p.insn,p.insn.size()) ==
+	   "   0: MOVR R1, f[COL0];\n"
+	   "   1: MADR R0, f[TEX0], {2, 3, 4, 5}, R1; # END\n");
+
+    struct nvfx_fp_cost cost;
+    nvfx_fp_cost(&p.insn[0],p.insn.size(),&cost);
+    assert(cost.insns == 2 && cost.consts == 1 && cost.tex == 0 && cost.regs == 2 && cost.cycles == 3);
+  }
+
+  // H registers hold halves, two to an R register; precision, saturation and scaling:
+  {
+    const float third[4] = { 1.0f / 3.0f, 2.0f / 3.0f, 0.3f, 5.0f };
+    const float half[4] = { 0.75f, 0.25f, -0.5f, 1.0f };
+    program_t p;
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | h(0),src_c,src_none,src_none,third);
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV,0x3) | h(1),src_c,src_none,src_none,half);
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(1) | (NVFX_FP_PRECISION_FX12 << NVFX_FP_OP_PRECISION_SHIFT),src_c,src_none,src_none,third);
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(2) | (NVFX_FP_PRECISION_FP16 << NVFX_FP_OP_PRECISION_SHIFT),src_c,src_none,src_none,third);
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(3) | NVFX_FP_OP_OUT_SAT,src_c,(NVFX_FP_OP_DST_SCALE_2X << NVFX_FP_OP_DST_SCALE_SHIFT) | src_none,src_none,half);
+    p.emit(op(NVFX_FP_OP_OPCODE_ADD) | r(4),src_h(0),src_h(1),src_none);
+    p.end();
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    assert(run(p,m) == 0);
+
+    read(m,0,true,v);
+    assert(same4(v,0.333251953125f,0.66650390625f,0.300048828125f,5.0f));
+    read(m,1,true,v);
+    assert(same4(v,0.75f,0.25f,0.0f,0.0f));
+    assert(m.regs[0][0] == (0x3555u | (0x3955u << 16)));
+    assert(m.regs[0][2] == (0x3a00u | (0x3400u << 16)));
+
+    read(m,1,false,v);
+    assert(same4(v,341.0f / 1024.0f,683.0f / 1024.0f,307.0f / 1024.0f,2047.0f / 1024.0f));
+    read(m,2,false,v);
+    assert(same4(v,0.333251953125f,0.66650390625f,0.300048828125f,5.0f));
+    read(m,3,false,v);
+    assert(same4(v,1.0f,0.5f,0.0f,1.0f));
+    read(m,4,false,v);
+    assert(same4(v,0.333251953125f + 0.75f,0.66650390625f + 0.25f,0.300048828125f,5.0f));
+
+    struct nvfx_fp_cost cost;
+    nvfx_fp_cost(&p.insn[0],p.insn.size(),&cost);
+    assert(cost.insns == 6 && cost.consts == 5 && cost.half == 4 && cost.regs == 5);
+  }
+
+  // Condition codes, and writes that depend upon them:
+  {
+    const float one[4] = { 1, 1, 1, 1 }, five[4] = { 5, 5, 5, 5 };
+    program_t p;
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV,0x1) | NV40_FP_OP_OUT_NONE | NVFX_FP_OP_COND_WRITE_ENABLE | in(NVFX_FP_OP_INPUT_SRC_COL0),src_in,src_none,src_none);
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV,0x5) | r(0),cond(NVFX_COND_LT) | src_c,src_none,src_none,one);
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV,0x2) | r(0),cond(NVFX_COND_GE) | src_c,src_none,src_none,five);
+    p.end();
+
+    assert(disassemble(nvfx_fp_disassemble,p.insn,p.insn.size()) ==
+	   "   0: MOVRC RC.x, f[COL0];\n"
+	   "   1: MOVR R0.xz(LT.xxxx), {1, 1, 1, 1};\n"
+	   "   3: MOVR R0.y(GE.xxxx), {5, 5, 5, 5}; # END\n");
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    m.inputs[NVFX_FP_OP_INPUT_SRC_COL0][0] = -2.0f;
+    assert(run(p,m) == 0);
+    read(m,0,false,v);
+    assert(same4(v,1,0,1,0));
+
+    m.inputs[NVFX_FP_OP_INPUT_SRC_COL0][0] = 0.0f;
+    assert(run(p,m) == 0);
+    read(m,0,false,v);
+    assert(same4(v,0,5,0,0));
+  }
+
+  // Texture lookups:
+  {
+    program_t p;
+    p.emit(op(NVFX_FP_OP_OPCODE_TEX) | r(0) | in(NVFX_FP_OP_INPUT_SRC_TC(1)) | (3 << NVFX_FP_OP_TEX_UNIT_SHIFT),src_in,src_none,src_none);
+    p.emit(op(NVFX_FP_OP_OPCODE_TXP) | r(1) | in(NVFX_FP_OP_INPUT_SRC_TC(1)) | (5 << NVFX_FP_OP_TEX_UNIT_SHIFT),src_in,src_none,src_none);
+    p.emit(op(NVFX_FP_OP_OPCODE_TXB) | r(2) | in(NVFX_FP_OP_INPUT_SRC_TC(1)),src_in,src_none,src_none);
+    p.end();
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    const float tc[4] = { 1.0f, 2.0f, 3.0f, 4.0f };
+    memcpy(m.inputs[NVFX_FP_OP_INPUT_SRC_TC(1)],tc,sizeof(tc));
+    assert(run(p,m) == 0);
+    // Without a sampler, the texel is the coordinate:
+    read(m,0,false,v);
+    assert(same4(v,1,2,3,4));
+
+    sample_log log;
+    m.sample = sample;
+    m.sample_data = &log;
+    p.insn.resize(8);
+    p.last = 4;
+    p.end();
+    assert(run(p,m) == 0);
+    assert(log.unit == 5 && log.op == NVFX_FP_OP_OPCODE_TXP);
+    assert(same4(log.coord,0.25f,0.5f,0.75f,1.0f));
+    read(m,0,false,v);
+    assert(same4(v,2,4,6,8));
+
+    struct nvfx_fp_cost cost;
+    nvfx_fp_cost(&p.insn[0],p.insn.size(),&cost);
+    assert(cost.tex == 2 && cost.cycles == 8);
+  }
+}
+
+static void
+test_fp_flow()
+{
+  using namespace fp;
+  const float one[4] = { 1, 1, 1, 1 }, two[4] = { 2, 2, 2, 2 }, three[4] = { 3, 3, 3, 3 }, limit[4] = { -3.5f, -3.5f, -3.5f, -3.5f };
+  float v[4];
+
+  // IF f[COL0].x != 0 R0 = 1 ELSE R0 = 2 ENDIF; R1 = R0 * 3:
+  {
+    program_t p;
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV,0x1) | NV40_FP_OP_OUT_NONE | NVFX_FP_OP_COND_WRITE_ENABLE | in(NVFX_FP_OP_INPUT_SRC_COL0),src_in,src_none,src_none);
+    const unsigned if_offset = p.emit(branch(NV40_FP_OP_BRA_OPCODE_IF) | NV40_FP_OP_OUT_NONE,cond(NVFX_COND_NE,0),NV40_FP_OP_OPCODE_IS_BRANCH,0);
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(0),src_c,src_none,src_none,one);
+    const unsigned else_offset = p.here();
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(0),src_c,src_none,src_none,two);
+    const unsigned endif_offset = p.here();
+    p.emit(op(NVFX_FP_OP_OPCODE_MUL) | r(1),src_r(0),src_c,src_none,three);
+    p.end();
+    p.insn[if_offset + 2] = NV40_FP_OP_OPCODE_IS_BRANCH | else_offset;
+    p.insn[if_offset + 3] = endif_offset;
+
+    assert(disassemble(nvfx_fp_disassemble,p.insn,p.insn.size()) ==
+	   "   0: MOVRC RC.x, f[COL0];\n"
+	   "   1: IF (NE.xxxx) ELSE @4 ENDIF @6;\n"
+	   "   2: MOVR R0, {1, 1, 1, 1};\n"
+	   "   4: MOVR R0, {2, 2, 2, 2};\n"
+	   "   6: MULR R1, R0, {3, 3, 3, 3}; # END\n");
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    m.inputs[NVFX_FP_OP_INPUT_SRC_COL0][0] = 0.5f;
+    assert(run(p,m) == 0);
+    read(m,1,false,v);
+    assert(same4(v,3,3,3,3));
+    assert(m.executed == 4);
+
+    m.inputs[NVFX_FP_OP_INPUT_SRC_COL0][0] = 0.0f;
+    assert(run(p,m) == 0);
+    read(m,1,false,v);
+    assert(same4(v,6,6,6,6));
+    assert(m.executed == 4);
+
+    // Without an ELSE, the else offset is the endif's:
+    p.insn[if_offset + 2] = NV40_FP_OP_OPCODE_IS_BRANCH | endif_offset;
+    m.inputs[NVFX_FP_OP_INPUT_SRC_COL0][0] = 1.0f;
+    assert(run(p,m) == 0);
+    read(m,1,false,v);
+    assert(same4(v,6,6,6,6));
+  }
+
+  // REP 10 { R0 += 1; BRK if R0.x > 3.5 }; nested inside an IF that's taken:
+  for(unsigned brk = 0;brk < 2;++brk) {
+    program_t p;
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV,0x1) | NV40_FP_OP_OUT_NONE | NVFX_FP_OP_COND_WRITE_ENABLE,src_c,src_none,src_none,one);
+    const unsigned if_offset = p.emit(branch(NV40_FP_OP_BRA_OPCODE_IF) | NV40_FP_OP_OUT_NONE,cond(NVFX_COND_NE,0),NV40_FP_OP_OPCODE_IS_BRANCH,0);
+    const unsigned rep_offset = p.emit(branch(NV40_FP_OP_BRA_OPCODE_REP) | NV40_FP_OP_OUT_NONE,cond(NVFX_COND_TR,NVFX_SWZ_IDENTITY),
+				       NV40_FP_OP_OPCODE_IS_BRANCH | (10 << NV40_FP_OP_REP_COUNT1_SHIFT) | (10 << NV40_FP_OP_REP_COUNT2_SHIFT) | (10 << NV40_FP_OP_REP_COUNT3_SHIFT),0);
+    p.emit(op(NVFX_FP_OP_OPCODE_ADD) | r(0),src_r(0),src_c,src_none,one);
+    p.emit(op(NVFX_FP_OP_OPCODE_ADD,0x1) | NV40_FP_OP_OUT_NONE | NVFX_FP_OP_COND_WRITE_ENABLE,src_r(0),src_c,src_none,limit);
+    p.emit(branch(NV40_FP_OP_BRA_OPCODE_BRK) | NV40_FP_OP_OUT_NONE,cond(brk ? NVFX_COND_GT : NVFX_COND_FL,0),NV40_FP_OP_OPCODE_IS_BRANCH,0);
+    const unsigned end_offset = p.here();
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(1),src_r(0),src_none,src_none);
+    p.end();
+    p.insn[if_offset + 2] = NV40_FP_OP_OPCODE_IS_BRANCH | end_offset;
+    p.insn[if_offset + 3] = end_offset;
+    p.insn[rep_offset + 3] = end_offset;
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    assert(run(p,m) == 0);
+    read(m,1,false,v);
+    assert(v[0] == (brk ? 4.0f : 10.0f));
+  }
+
+  // CAL sub; R1 = R0 * 2 (END); sub: R0 = 3; RET:
+  {
+    program_t p;
+    const unsigned cal_offset = p.emit(branch(NV40_FP_OP_BRA_OPCODE_CAL),cond(NVFX_COND_TR,NVFX_SWZ_IDENTITY),NV40_FP_OP_OPCODE_IS_BRANCH,0);
+    p.emit(op(NVFX_FP_OP_OPCODE_MUL) | r(1) | NVFX_FP_OP_PROGRAM_END,src_r(0),src_c,src_none,two);
+    const unsigned sub_offset = p.here();
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(0),src_c,src_none,src_none,three);
+    p.emit(branch(NV40_FP_OP_BRA_OPCODE_RET),cond(NVFX_COND_TR,NVFX_SWZ_IDENTITY),NV40_FP_OP_OPCODE_IS_BRANCH,0);
+    p.insn[cal_offset + 2] |= sub_offset;
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    assert(run(p,m) == 0);
+    read(m,1,false,v);
+    assert(same4(v,6,6,6,6));
+    assert(m.executed == 4);
+
+    assert(disassemble(nvfx_fp_disassemble,p.insn,p.insn.size()) ==
+	   "   0: CAL (TR) @3;\n"
+	   "   1: MULR R1, R0, {2, 2, 2, 2}; # END\n"
+	   "   3: MOVR R0, {3, 3, 3, 3};\n"
+	   "   5: RET (TR);\n");
+  }
+
+  // KIL if f[COL0].x < 0:
+  {
+    program_t p;
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | NV40_FP_OP_OUT_NONE | NVFX_FP_OP_COND_WRITE_ENABLE | in(NVFX_FP_OP_INPUT_SRC_COL0),xxxx(src_in),src_none,src_none);
+    p.emit(op(NVFX_FP_OP_OPCODE_KIL,0) | NV40_FP_OP_OUT_NONE,cond(NVFX_COND_LT,NVFX_SWZ_IDENTITY) | src_none,src_none,src_none);
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(0),src_c,src_none,src_none,one);
+    p.end();
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    m.inputs[NVFX_FP_OP_INPUT_SRC_COL0][0] = -1.0f;
+    assert(run(p,m) == 0);
+    assert(m.killed);
+    m.inputs[NVFX_FP_OP_INPUT_SRC_COL0][0] = 1.0f;
+    assert(run(p,m) == 0);
+    assert(!m.killed);
+  }
+
+  // Loops that never end are caught, as are opcodes that aren't known:
+  {
+    program_t p;
+    const unsigned if_offset = p.emit(branch(NV40_FP_OP_BRA_OPCODE_CAL),cond(NVFX_COND_TR,NVFX_SWZ_IDENTITY),NV40_FP_OP_OPCODE_IS_BRANCH,0);
+    p.insn[if_offset + 2] |= if_offset;
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    assert(run(p,m) == -1);
+
+    program_t q;
+    q.emit(op(0x3f) | r(0),src_none,src_none,src_none);
+    q.end();
+    assert(run(q,m) == -1);
+  }
+}
+
+// A program means the same, before and after it's optimized:
+static void
+test_fp_optimized()
+{
+  using namespace fp;
+  const float k[4] = { 0.5f, -2.0f, 3.0f, 0.125f };
+  program_t p;
+
+  // MOV R2, f[TEX0]; MUL R3, R2, k; ADD R0, R3, f[TEX0]; MOV R5, R0 (dead):
+  p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(2) | in(NVFX_FP_OP_INPUT_SRC_TC(0)),src_in,src_none,src_none);
+  p.emit(op(NVFX_FP_OP_OPCODE_MUL) | r(3),src_r(2),src_c,src_none,k);
+  p.emit(op(NVFX_FP_OP_OPCODE_ADD) | r(0) | in(NVFX_FP_OP_INPUT_SRC_TC(0)),src_r(3),src_in,src_none);
+  p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(5),src_r(0),src_none,src_none);
+  p.end();
+
+  program_t q = p;
+  std::vector< unsigned > remap(q.insn.size());
+  nvfx_fp_opt opt;
+  memset(&opt,0,sizeof(opt));
+  opt.insn = &q.insn[0];
+  opt.insn_len = q.insn.size();
+  opt.live_out = 1;
+  opt.remap = &remap[0];
+  assert(nvfx_fp_optimize(&opt,NVFX_OPT_ALL));
+  q.insn.resize(opt.insn_len);
+
+  struct nvfx_fp_cost before, after;
+  nvfx_fp_cost(&p.insn[0],p.insn.size(),&before);
+  nvfx_fp_cost(&q.insn[0],q.insn.size(),&after);
+  assert(after.cycles < before.cycles);
+
+  nvfx_fp_machine m, n;
+  memset(&m,0,sizeof(m));
+  const float tc[4] = { 1.5f, 1e-3f, -7.25f, 1.0f / 3.0f };
+  memcpy(m.inputs[NVFX_FP_OP_INPUT_SRC_TC(0)],tc,sizeof(tc));
+  n = m;
+  assert(run(p,m) == 0);
+  assert(run(q,n) == 0);
+  assert(n.executed < m.executed);
+
+  float a[4], b[4];
+  read(m,0,false,a);
+  read(n,0,false,b);
+  assert(same(a,b,4));
+}
+
+// Registers are allocated without changing what a program means. A full precision output comes out
+// exactly the same; H registers are only used for values that end up in half precision outputs, which
+// can change by the rounding of the halves they're computed from:
+namespace fp {
+
+static unsigned
+regs_used(const program_t & p)
+{
+  struct nvfx_fp_cost cost;
+  nvfx_fp_cost(&p.insn[0],p.insn.size(),&cost);
+  return cost.regs;
+}
+
+// Returns what nvfx_fp_allocate_temps() does, leaving the allocated program in q:
+static int
+allocate(const program_t & p,program_t & q,unsigned & num_regs,uint64_t reserved = 1)
+{
+  q = p;
+  nvfx_fp_ra ra;
+  memset(&ra,0,sizeof(ra));
+  ra.insn = &q.insn[0];
+  ra.insn_len = q.insn.size();
+  ra.reserved = reserved;
+  ra.max_temps = 48;
+  ra.max_half = 64;
+  ra.num_regs = num_regs;
+  const int result = nvfx_fp_allocate_temps(&ra);
+  num_regs = ra.num_regs;
+  return result;
+}
+
+static void
+compare_allocated(const program_t & p,const program_t & q,const nvfx_fp_machine & in,bool half_output)
+{
+  nvfx_fp_machine m = in, n = in;
+  assert(run(p,m) == 0);
+  assert(run(q,n) == 0);
+  assert(m.executed == n.executed);
+
+  float a[4], b[4];
+  read(m,0,half_output,a);
+  read(n,0,half_output,b);
+  if(half_output) {
+    for(unsigned i = 0;i < 4;++i) {
+      assert(fabsf(a[i] - b[i]) <= fabsf(a[i]) / 256.0f + 1.0f / 4096.0f);
+    }
+  }
+  else {
+    assert(same(a,b,4));
+  }
+}
+
+} // namespace fp
+
+static void
+test_fp_allocated()
+{
+  using namespace fp;
+  const float k[4] = { 0.5f, -2.0f, 3.0f, 0.125f };
+
+  // R5 = sat(f[TEX0] * k); R9 = sat(f[COL0]); H0 = R5 * R9 - both temporaries fit in the R register
+  // that H0 doesn't use, as H registers:
+  {
+    program_t p;
+    p.emit(op(NVFX_FP_OP_OPCODE_MUL) | r(5) | NVFX_FP_OP_OUT_SAT | in(NVFX_FP_OP_INPUT_SRC_TC(0)),src_in,src_c,src_none,k);
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV) | r(9) | NVFX_FP_OP_OUT_SAT | in(NVFX_FP_OP_INPUT_SRC_COL0),src_in,src_none,src_none);
+    p.emit(op(NVFX_FP_OP_OPCODE_MUL) | h(0),src_r(5),src_r(9),src_none);
+    p.end();
+
+    program_t q;
+    unsigned num_regs = 10;
+    assert(allocate(p,q,num_regs));
+    assert(num_regs == 2);
+    assert(regs_used(q) == 2 && regs_used(p) == 3);
+    assert(disassemble(nvfx_fp_disassemble,q.insn,q.insn.size()) ==
+	   "   0: MULR_SAT H2, f[TEX0], {0.5, -2, 3, 0.125};\n"
+	   "   2: MOVR_SAT H3, f[COL0];\n"
+	   "   3: MULR H0, H2, H3; # END\n");
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    const float tc[4] = { 0.7f, -0.3f, 0.1f, 5.0f }, col[4] = { 0.9f, 0.6f, 1.0f / 3.0f, 0.5f };
+    memcpy(m.inputs[NVFX_FP_OP_INPUT_SRC_TC(0)],tc,sizeof(tc));
+    memcpy(m.inputs[NVFX_FP_OP_INPUT_SRC_COL0],col,sizeof(col));
+    compare_allocated(p,q,m,true);
+
+    // Read by a texture lookup, R5 has to keep full precision:
+    program_t t = p;
+    t.insn.resize(t.insn.size() - 4);
+    t.emit(op(NVFX_FP_OP_OPCODE_TEX) | r(7),src_r(5),src_none,src_none);
+    t.emit(op(NVFX_FP_OP_OPCODE_MUL) | h(0),src_r(7),src_r(9),src_none);
+    t.end();
+    num_regs = 10;
+    assert(allocate(t,q,num_regs));
+    assert(num_regs == 3);
+    assert(!(q.insn[0] & NVFX_FP_OP_OUT_REG_HALF));
+    compare_allocated(t,q,m,true);
+  }
+
+  // Temporaries that are only live in one arm of an IF each can share a register; the loops and
+  // subroutines of test_fp_flow() aren't allocated at all:
+  {
+    const float one[4] = { 1, 1, 1, 1 }, two[4] = { 2, 2, 2, 2 };
+    program_t p;
+    p.emit(op(NVFX_FP_OP_OPCODE_MOV,0x1) | NV40_FP_OP_OUT_NONE | NVFX_FP_OP_COND_WRITE_ENABLE | in(NVFX_FP_OP_INPUT_SRC_COL0),src_in,src_none,src_none);
+    const unsigned if_offset = p.emit(branch(NV40_FP_OP_BRA_OPCODE_IF) | NV40_FP_OP_OUT_NONE,cond(NVFX_COND_NE,0),NV40_FP_OP_OPCODE_IS_BRANCH,0);
+    p.emit(op(NVFX_FP_OP_OPCODE_ADD) | r(6) | in(NVFX_FP_OP_INPUT_SRC_TC(0)),src_in,src_c,src_none,one);
+    p.emit(op(NVFX_FP_OP_OPCODE_MUL) | r(0),src_r(6),src_r(6),src_none);
+    const unsigned else_offset = p.here();
+    p.emit(op(NVFX_FP_OP_OPCODE_MUL) | r(11) | in(NVFX_FP_OP_INPUT_SRC_TC(0)),src_in,src_c,src_none,two);
+    p.emit(op(NVFX_FP_OP_OPCODE_ADD) | r(0),src_r(11),src_r(11),src_none);
+    const unsigned endif_offset = p.here();
+    p.emit(op(NVFX_FP_OP_OPCODE_MUL) | r(0),src_r(0),src_c,src_none,k);
+    p.end();
+    p.insn[if_offset + 2] = NV40_FP_OP_OPCODE_IS_BRANCH | else_offset;
+    p.insn[if_offset + 3] = endif_offset;
+
+    program_t q;
+    unsigned num_regs = 12;
+    assert(allocate(p,q,num_regs));
+    assert(num_regs == 2);
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    const float tc[4] = { 0.25f, -1.5f, 3.0f, 1e-3f };
+    memcpy(m.inputs[NVFX_FP_OP_INPUT_SRC_TC(0)],tc,sizeof(tc));
+    for(unsigned taken = 0;taken < 2;++taken) {
+      m.inputs[NVFX_FP_OP_INPUT_SRC_COL0][0] = (float)taken;
+      compare_allocated(p,q,m,false);
+    }
+
+    // With a loop in it, the program is left as it is:
+    program_t l = p;
+    l.insn[if_offset] = branch(NV40_FP_OP_BRA_OPCODE_REP) | NV40_FP_OP_OUT_NONE;
+    num_regs = 12;
+    assert(!allocate(l,q,num_regs));
+    assert(num_regs == 12 && q.insn == l.insn);
+  }
+
+  // Random straight-line programs, with outputs in R0 or H0:
+  uint32_t seed = 12345;
+  auto random = [&seed](unsigned n) -> unsigned {
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) % n;
+  };
+  auto random_float = [&random]() -> float {
+    return ((float)random(4097) / 1024.0f) - 2.0f;
+  };
+
+  unsigned allocated = 0;
+  for(unsigned trial = 0;trial < 2000;++trial) {
+    const bool half_output = random(2);
+    program_t p;
+    std::vector< unsigned > written;
+    unsigned num_regs = 2;
+
+    const unsigned length = 4 + random(16);
+    for(unsigned i = 0;i < length;++i) {
+      static const unsigned ops[] = { NVFX_FP_OP_OPCODE_MOV, NVFX_FP_OP_OPCODE_ADD, NVFX_FP_OP_OPCODE_MUL, NVFX_FP_OP_OPCODE_MAD, NVFX_FP_OP_OPCODE_TEX };
+      static const unsigned nsrc[] = { 1, 2, 2, 3, 1 };
+      const unsigned which = random(5);
+      const unsigned dst = 1 + random(20);
+
+      // Each source is an earlier result, an input, or the (one) inline constant:
+      uint32_t hw0 = op(ops[which]) | r(dst) | (random(2) ? NVFX_FP_OP_OUT_SAT : 0);
+      uint32_t src[3] = { src_none, src_none, src_none };
+      bool imm = false;
+      for(unsigned s = 0;s < nsrc[which];++s) {
+	const unsigned kind = written.empty() ? 1 + random(2) : random(3);
+	if(kind == 0) {
+	  src[s] = src_r(written[random(written.size())]);
+	}
+	else if(kind == 1) {
+	  src[s] = src_in;
+	}
+	else {
+	  src[s] = src_c;
+	  imm = true;
+	}
+      }
+      hw0 |= in(random(2) ? NVFX_FP_OP_INPUT_SRC_COL0 : NVFX_FP_OP_INPUT_SRC_TC(0));
+
+      const float c[4] = { random_float(), random_float(), random_float(), random_float() };
+      p.emit(hw0,src[0],src[1],src[2],imm ? c : 0);
+
+      written.push_back(dst);
+      num_regs = std::max(num_regs,dst + 1);
+    }
+
+    p.emit(op(NVFX_FP_OP_OPCODE_MAD) | (half_output ? h(0) : r(0)),src_r(written.back()),src_r(written[random(written.size())]),src_r(written[random(written.size())]));
+    p.end();
+
+    program_t q;
+    const unsigned before = num_regs;
+    if(!allocate(p,q,num_regs)) {
+      assert(num_regs == before && q.insn == p.insn);
+      continue;
+    }
+    ++allocated;
+    assert(num_regs < before);
+    assert(regs_used(q) <= num_regs);
+
+    nvfx_fp_machine m;
+    memset(&m,0,sizeof(m));
+    for(unsigned i = 0;i < 4;++i) {
+      m.inputs[NVFX_FP_OP_INPUT_SRC_COL0][i] = random_float();
+      m.inputs[NVFX_FP_OP_INPUT_SRC_TC(0)][i] = random_float();
+    }
+    compare_allocated(p,q,m,half_output);
+  }
+  assert(allocated > 1000);
+}
+
+namespace vp {
+
+struct program_t {
+  std::vector< uint32_t > insn;
+
+  unsigned size() const {
+    return insn.size() / 4;
+  }
+
+  uint32_t * emit() {
+    for(unsigned i = 0;i < 4;++i) insn.push_back(0);
+    uint32_t * hw = &insn[insn.size() - 4];
+    hw[0] = (NVFX_COND_TR << NV40_VP_INST_COND_SHIFT) | (0x1b << NV40_VP_INST_COND_SWZ_ALL_SHIFT);
+    return hw;
+  }
+
+  void last() {
+    insn[insn.size() - 1] |= NVFX_VP_INST_LAST;
+  }
+};
+
+// Sources, with an identity swizzle:
+static const uint32_t identity = (0 << NV40_VP_SRC_SWZ_X_SHIFT) | (1 << NV40_VP_SRC_SWZ_Y_SHIFT) | (2 << NV40_VP_SRC_SWZ_Z_SHIFT) | (3 << NV40_VP_SRC_SWZ_W_SHIFT);
+static const uint32_t src_none = NV40_VP_SRC_REG_TYPE_INPUT | identity;
+static const uint32_t src_v = NV40_VP_SRC_REG_TYPE_INPUT | identity;
+static const uint32_t src_c = NV40_VP_SRC_REG_TYPE_CONST | identity;
+
+static uint32_t
+src_r(unsigned index)
+{
+  return NV40_VP_SRC_REG_TYPE_TEMP | (index << NV40_VP_SRC_TEMP_SRC_SHIFT) | identity;
+}
+
+static uint32_t
+xxxx(uint32_t src)
+{
+  return src & ~NV40_VP_SRC_SWZ_ALL_MASK;
+}
+
+static void
+sources(uint32_t * hw,uint32_t s0,uint32_t s1,uint32_t s2)
+{
+  hw[1] |= ((s0 & NV40_VP_SRC0_HIGH_MASK) >> NV40_VP_SRC0_HIGH_SHIFT) << NV40_VP_INST_SRC0H_SHIFT;
+  hw[2] |= (s0 & NV40_VP_SRC0_LOW_MASK) << NV40_VP_INST_SRC0L_SHIFT;
+  hw[2] |= s1 << NV40_VP_INST_SRC1_SHIFT;
+  hw[2] |= ((s2 & NV40_VP_SRC2_HIGH_MASK) >> NV40_VP_SRC2_HIGH_SHIFT) << NV40_VP_INST_SRC2H_SHIFT;
+  hw[3] |= (s2 & NV40_VP_SRC2_LOW_MASK) << NV40_VP_INST_SRC2L_SHIFT;
+}
+
+// dst is a temporary, or ~output:
+static uint32_t *
+vec(program_t & p,unsigned op,int dst,unsigned mask,uint32_t s0,uint32_t s1 = src_none,uint32_t s2 = src_none)
+{
+  uint32_t * hw = p.emit();
+  hw[1] |= op << NV40_VP_INST_VEC_OPCODE_SHIFT;
+  hw[3] |= NV40_VP_INST_SCA_DEST_TEMP_MASK | (mask << NV40_VP_INST_VEC_WRITEMASK_SHIFT);
+  if(dst < 0) {
+    hw[0] |= NV40_VP_INST_VEC_RESULT | NV40_VP_INST_VEC_DEST_TEMP_MASK;
+    hw[3] |= (~dst) << NV40_VP_INST_DEST_SHIFT;
+  }
+  else {
+    hw[0] |= dst << NV40_VP_INST_VEC_DEST_TEMP_SHIFT;
+    hw[3] |= NV40_VP_INST_DEST_MASK;
+  }
+  sources(hw,s0,s1,s2);
+  return hw;
+}
+
+static uint32_t *
+sca(program_t & p,unsigned op,int dst,unsigned mask,uint32_t s2)
+{
+  uint32_t * hw = p.emit();
+  hw[1] |= op << NV40_VP_INST_SCA_OPCODE_SHIFT;
+  hw[0] |= NV40_VP_INST_VEC_DEST_TEMP_MASK;
+  hw[3] |= mask << NV40_VP_INST_SCA_WRITEMASK_SHIFT;
+  if(dst < 0) {
+    hw[3] |= NV40_VP_INST_SCA_RESULT | NV40_VP_INST_SCA_DEST_TEMP_MASK | ((~dst) << NV40_VP_INST_DEST_SHIFT);
+  }
+  else {
+    hw[3] |= (dst << NV40_VP_INST_SCA_DEST_TEMP_SHIFT) | NV40_VP_INST_DEST_MASK;
+  }
+  sources(hw,src_none,src_none,s2);
+  return hw;
+}
+
+// The target's high bits are where src2's would be, so there's no src2:
+static uint32_t *
+bra(program_t & p,unsigned op,unsigned target,unsigned cond,unsigned swz)
+{
+  uint32_t * hw = sca(p,op,0x1f,0,0);
+  hw[0] &= ~(NV40_VP_INST_COND_MASK | NV40_VP_INST_COND_SWZ_ALL_MASK);
+  hw[0] |= (cond << NV40_VP_INST_COND_SHIFT) | (swz << NV40_VP_INST_COND_SWZ_ALL_SHIFT);
+  hw[2] |= (target >> 3) << NV40_VP_INST_IADDRH_SHIFT;
+  hw[3] |= (target & 7) << NV40_VP_INST_IADDRL_SHIFT;
+  return hw;
+}
+
+static void
+constant(uint32_t * hw,unsigned index)
+{
+  hw[1] |= index << NV40_VP_INST_CONST_SRC_SHIFT;
+}
+
+static void
+input(uint32_t * hw,unsigned index)
+{
+  hw[1] |= index << NV40_VP_INST_INPUT_SRC_SHIFT;
+}
+
+static int
+run(const program_t & p,nvfx_vp_machine & m)
+{
+  return nvfx_vp_execute(&m,&p.insn[0],p.size());
+}
+
+} // namespace vp
+
+static void
+test_vp()
+{
+  using namespace vp;
+
+  // A transform; DP4 o[HPOS].x/y/z/w, v[0], c[4 + i]:
+  {
+    program_t p;
+    for(unsigned i = 0;i < 4;++i) {
+      constant(vec(p,NVFX_VP_INST_VEC_OP_DP4,~NV40_VP_INST_DEST_POS,8 >> i,src_v,src_c),4 + i);
+    }
+    p.last();
+
+    nvfx_vp_machine * m = new nvfx_vp_machine;
+    memset(m,0,sizeof(*m));
+    const float pos[4] = { 0.1f, -2.5f, 3.0f, 1.0f };
+    memcpy(m -> inputs[0],pos,sizeof(pos));
+    for(unsigned i = 0;i < 4;++i) {
+      for(unsigned j = 0;j < 4;++j) m -> consts[4 + i][j] = 1.0f / (float)(1 + i + 3 * j);
+    }
+    assert(nvfx_vp_execute(m,&p.insn[0],p.size()) == 0);
+    assert(m -> written == (1u << NV40_VP_INST_DEST_POS));
+    for(unsigned i = 0;i < 4;++i) {
+      volatile float dp = pos[0] * m -> consts[4 + i][0];
+      for(unsigned j = 1;j < 4;++j) {
+	volatile float product = pos[j] * m -> consts[4 + i][j];
+	dp = dp + product;
+      }
+      const float expected = dp;
+      assert(same(&m -> outputs[NV40_VP_INST_DEST_POS][i],&expected,1));
+    }
+
+    assert(disassemble(nvfx_vp_disassemble,p.insn,p.size()) ==
+	   "   0: DP4 o[HPOS].x, v[0], c[4];\n"
+	   "   1: DP4 o[HPOS].y, v[0], c[5];\n"
+	   "   2: DP4 o[HPOS].z, v[0], c[6];\n"
+	   "   3: DP4 o[HPOS].w, v[0], c[7]; # LAST\n");
+
+    struct nvfx_vp_cost cost;
+    nvfx_vp_cost(&p.insn[0],p.size(),&cost);
+    assert(cost.insns == 4 && cost.vec == 4 && cost.sca == 0 && cost.consts == 4 && cost.temps == 0 && cost.cycles == 4);
+    delete m;
+  }
+
+  // Co-issued halves read their sources before either writes; R0 & R1 are swapped:
+  {
+    program_t p;
+    constant(vec(p,NVFX_VP_INST_VEC_OP_MOV,0,0xf,src_c),0);
+    constant(vec(p,NVFX_VP_INST_VEC_OP_MOV,1,0xf,src_c),1);
+    uint32_t * hw = vec(p,NVFX_VP_INST_VEC_OP_MOV,0,0xf,src_r(1),src_none,src_r(0));
+    hw[1] |= NVFX_VP_INST_SCA_OP_MOV << NV40_VP_INST_SCA_OPCODE_SHIFT;
+    hw[3] &= ~NV40_VP_INST_SCA_DEST_TEMP_MASK;
+    hw[3] |= (1 << NV40_VP_INST_SCA_DEST_TEMP_SHIFT) | (0xf << NV40_VP_INST_SCA_WRITEMASK_SHIFT);
+    vec(p,NVFX_VP_INST_VEC_OP_MOV,~NV40_VP_INST_DEST_COL0,0xf,src_r(0));
+    vec(p,NVFX_VP_INST_VEC_OP_MOV,~NV40_VP_INST_DEST_COL1,0xf,src_r(1));
+    p.last();
+
+    nvfx_vp_machine * m = new nvfx_vp_machine;
+    memset(m,0,sizeof(*m));
+    m -> consts[0][0] = 1.0f;
+    m -> consts[1][0] = 2.0f;
+    assert(run(p,*m) == 0);
+    assert(m -> outputs[NV40_VP_INST_DEST_COL0][0] == 2.0f);
+    assert(m -> outputs[NV40_VP_INST_DEST_COL1][0] == 1.0f);
+
+    assert(disassemble(nvfx_vp_disassemble,p.insn,p.size()).find("   2: MOV R0, R1 + MOV R1, R0;\n") != std::string::npos);
+
+    struct nvfx_vp_cost cost;
+    nvfx_vp_cost(&p.insn[0],p.size(),&cost);
+    assert(cost.insns == 5 && cost.coissued == 1 && cost.temps == 2);
+    delete m;
+  }
+
+  // ARL A0, v[1]; MOV o[COL0], c[A0.x + 5]; scalar RCP, EXP, LOG:
+  {
+    program_t p;
+    input(vec(p,NVFX_VP_INST_VEC_OP_ARL,0,0x8,src_v),1);
+    uint32_t * hw = vec(p,NVFX_VP_INST_VEC_OP_MOV,~NV40_VP_INST_DEST_COL0,0xf,src_c);
+    constant(hw,5);
+    hw[3] |= NV40_VP_INST_INDEX_CONST;
+    input(sca(p,NVFX_VP_INST_SCA_OP_RCP,~NV40_VP_INST_DEST_TC(0),0x8,xxxx(src_v)),1);
+    input(sca(p,NVFX_VP_INST_SCA_OP_EXP,~NV40_VP_INST_DEST_TC(1),0xf,xxxx(src_v)),1);
+    input(sca(p,NVFX_VP_INST_SCA_OP_LOG,~NV40_VP_INST_DEST_TC(2),0xf,xxxx(src_v)),1);
+    p.last();
+
+    assert(disassemble(nvfx_vp_disassemble,p.insn,p.size()) ==
+	   "   0: ARL A0.x, v[1];\n"
+	   "   1: MOV o[COL0], c[A0.x+5];\n"
+	   "   2: RCP o[TEX0].x, v[1].xxxx;\n"
+	   "   3: EXP o[TEX1], v[1].xxxx;\n"
+	   "   4: LOG o[TEX2], v[1].xxxx; # LAST\n");
+
+    nvfx_vp_machine * m = new nvfx_vp_machine;
+    memset(m,0,sizeof(*m));
+    m -> inputs[1][0] = 2.75f;
+    m -> consts[7][2] = 42.0f;
+    assert(run(p,*m) == 0);
+    assert(m -> addr[0][0] == 2);
+    assert(m -> outputs[NV40_VP_INST_DEST_COL0][2] == 42.0f);
+    assert(m -> outputs[NV40_VP_INST_DEST_TC(0)][0] == 1.0f / 2.75f);
+    assert(same4(m -> outputs[NV40_VP_INST_DEST_TC(1)],4.0f,0.75f,exp2f(2.75f),1.0f));
+    assert(same4(m -> outputs[NV40_VP_INST_DEST_TC(2)],1.0f,1.375f,log2f(2.75f),1.0f));
+    delete m;
+  }
+
+  // Branches and subroutines, loaded somewhere other than 0:
+  for(unsigned base = 0;base < 200;base += 100) {
+    program_t p;
+    // 0: MOVC RC.x, v[1].x; 1: BRA 3 if EQ; 2: MOV o[COL0], c[0]; 3: CAL 6; 4: MOV o[COL1], R0 (LAST)
+    // 5: NOP; 6: MOV R0, c[1]; 7: RET
+    uint32_t * hw = vec(p,NVFX_VP_INST_VEC_OP_MOV,0x3f,0x8,src_v);
+    input(hw,1);
+    hw[0] |= NV40_VP_INST_COND_UPDATE_ENABLE;
+    bra(p,NVFX_VP_INST_SCA_OP_BRA,base + 3,NVFX_COND_EQ,0);
+    constant(vec(p,NVFX_VP_INST_VEC_OP_MOV,~NV40_VP_INST_DEST_COL0,0xf,src_c),0);
+    bra(p,NVFX_VP_INST_SCA_OP_CAL,base + 6,NVFX_COND_TR,0x1b);
+    vec(p,NVFX_VP_INST_VEC_OP_MOV,~NV40_VP_INST_DEST_COL1,0xf,src_r(0));
+    p.last();
+    vec(p,NVFX_VP_INST_VEC_OP_NOP,0x3f,0,src_none);
+    constant(vec(p,NVFX_VP_INST_VEC_OP_MOV,0,0xf,src_c),1);
+    bra(p,NVFX_VP_INST_SCA_OP_RET,0,NVFX_COND_TR,0x1b);
+
+    nvfx_vp_machine * m = new nvfx_vp_machine;
+    memset(m,0,sizeof(*m));
+    m -> base = base;
+    m -> consts[0][0] = 5.0f;
+    m -> consts[1][0] = 6.0f;
+
+    m -> inputs[1][0] = 0.0f;
+    assert(run(p,*m) == 0);
+    assert(m -> written == (1u << NV40_VP_INST_DEST_COL1));
+    assert(m -> outputs[NV40_VP_INST_DEST_COL1][0] == 6.0f);
+    assert(m -> executed == 6);
+
+    m -> inputs[1][0] = 1.0f;
+    assert(run(p,*m) == 0);
+    assert(m -> written == ((1u << NV40_VP_INST_DEST_COL0) | (1u << NV40_VP_INST_DEST_COL1)));
+    assert(m -> executed == 7);
+
+    if(base == 0) {
+      const std::string text = disassemble(nvfx_vp_disassemble,p.insn,p.size());
+      assert(text.find("   0: MOVC RC.x, v[1];\n") != std::string::npos);
+      assert(text.find("   1: BRA @3 (EQ0.xxxx);\n") != std::string::npos);
+      assert(text.find("   3: CAL @6 (TR0);\n") != std::string::npos);
+      assert(text.find("   5: NOP;\n") != std::string::npos);
+      assert(text.find("   7: RET (TR0);\n") != std::string::npos);
+
+      struct nvfx_vp_cost cost;
+      nvfx_vp_cost(&p.insn[0],p.size(),&cost);
+      assert(cost.branches == 3 && cost.temps == 1);
+    }
+    else {
+      // A target before the program:
+      m -> base = base + 4;
+      assert(run(p,*m) == -1);
+    }
+    delete m;
+  }
+}
+
+int
+main()
+{
+  try {
+    test_half();
+    test_fp_arithmetic();
+    test_fp_flow();
+    test_fp_optimized();
+    test_fp_allocated();
+    test_vp();
+
+    std::cout << "passed" << std::endl;
+  }
+  catch(const assertion & a) {
+    std::cerr << "failed: " << a.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,2355 @@
+/* Peephole & dataflow optimization of NV40 program microcode.
+ *
+ * The TGSI translators (and cgcomp) map one source instruction to one or a
+ * few hardware instructions, without looking at their neighbours. That
+ * leaves MOVs between temporaries, results nobody reads, MUL+ADD pairs, and
+ * vertex program vector & scalar instructions that could share a slot. This
+ * works on the finished microcode, before relocations are applied:
+ *
+ * - copy propagation: a MOV of a temporary, an input or a constant is
+ *   folded into every instruction that reads its result, and goes away
+ * - dead code elimination, per register and component
+ * - MUL+ADD is fused into MAD when the product isn't needed elsewhere
+ * - fragment program instructions whose sources are all the same inline
+ *   immediate are evaluated, and become a MOV of the result
+ * - adjacent, independent vertex program vector and scalar instructions
+ *   are co-issued
+ * - fragment program IFs whose conditions are known, from the immediates
+ *   that reach them, are resolved; the arm that can't run goes away
+ * - optionally, x * 0, x * 1 and x + 0 where 0 or 1 is an immediate
+ *
+ * Fragment program temporaries are also packed into as few registers as
+ * possible, separately, by nvfx_fp_allocate_temps().
+ *
+ * Only straight-line programs are optimized; a vertex program with a branch
+ * is left alone, as is a fragment program with branches that can't be
+ * resolved. Instructions whose opcodes aren't understood are assumed to
+ * read every source, and are never rewritten.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "nvfx_optimize.h"
+#include "nv40_vertprog.h"
+
+#define NVFX_OPT_FP_SRC_MASK 0x3ffff
+#define NVFX_OPT_FP_NO_PERSPECTIVE (1u << 31)
+
+/* Fields of hw[0] that must match for two vertex program instructions to
+ * be co-issued: */
+#define NVFX_OPT_VP_COND_MASK (NV40_VP_INST_COND_MASK | NV40_VP_INST_COND_SWZ_ALL_MASK | \
+			       NV40_VP_INST_COND_TEST_ENABLE | NV40_VP_INST_COND_REG_SELECT_1 | \
+			       NV40_VP_INST_SATURATE)
+
+enum {
+	NVFX_OPT_FILE_NONE,
+	NVFX_OPT_FILE_TEMP,
+	NVFX_OPT_FILE_HALF,	/* FP H register; index is the R register it's part of */
+	NVFX_OPT_FILE_INPUT,
+	NVFX_OPT_FILE_CONST,
+	NVFX_OPT_FILE_OTHER
+};
+
+struct nvfx_opt_src {
+	unsigned file;
+	unsigned index;
+	unsigned swz[4];
+	int negate;
+	int abs;
+};
+
+struct nvfx_opt_insn {
+	uint32_t hw[4];
+
+	/* FP: the inline constant after the instruction, if any: */
+	int has_imm;
+	uint32_t imm[4];
+	int patched;
+	unsigned imm_origin;
+
+	/* VP: constant read, or -1: */
+	int cst;
+
+	unsigned origin;
+	int fixed;
+	int dead;
+	int merged;	/* VP: index of the instruction this was co-issued with */
+};
+
+struct nvfx_opt_info {
+	unsigned op;
+	int sca;		/* VP: scalar slot */
+	unsigned used;		/* source positions read */
+	int known;		/* sources can be rewritten */
+	int componentwise;	/* result component c only reads component c of the sources */
+	int side_effects;	/* outputs, H registers, condition codes, KIL, address registers */
+	int dst;		/* R register written, or -1 */
+	unsigned mask;		/* components of dst written, x = bit 0 */
+	uint64_t clobbers;	/* R registers modified in any way */
+	int partial;		/* conditional; the old value may survive */
+	int plain;		/* no saturation, scaling, reduced precision or condition codes */
+};
+
+struct nvfx_opt {
+	int vp;
+	struct nvfx_opt_insn *insns;
+	unsigned nr;
+	uint64_t live_out;
+
+	/* Scratch space for copy propagation: */
+	struct nvfx_opt_insn *rewritten;
+	unsigned *readers;
+};
+
+static unsigned
+nvfx_opt_vp_mask(unsigned mask)
+{
+	/* VP write masks have x in the high bit */
+	return ((mask >> 3) & 1) | ((mask >> 1) & 2) | ((mask << 1) & 4) | ((mask << 3) & 8);
+}
+
+static unsigned
+nvfx_opt_first(unsigned positions)
+{
+	unsigned pos = 0;
+
+	while (!(positions & (1 << pos)))
+		++pos;
+	return pos;
+}
+
+static void
+nvfx_opt_fp_info(const struct nvfx_opt_insn *insn, struct nvfx_opt_info *info)
+{
+	const uint32_t *hw = insn->hw;
+
+	memset(info, 0, sizeof(*info));
+	info->op = (hw[0] & NVFX_FP_OP_OPCODE_MASK) >> NVFX_FP_OP_OPCODE_SHIFT;
+	info->dst = -1;
+	info->known = 1;
+
+	switch (info->op) {
+	case NVFX_FP_OP_OPCODE_NOP:
+		break;
+	case NVFX_FP_OP_OPCODE_MOV:
+	case NVFX_FP_OP_OPCODE_FRC:
+	case NVFX_FP_OP_OPCODE_FLR:
+		info->used = 1;
+		info->componentwise = 1;
+		break;
+	case NVFX_FP_OP_OPCODE_MUL:
+	case NVFX_FP_OP_OPCODE_ADD:
+	case NVFX_FP_OP_OPCODE_MIN:
+	case NVFX_FP_OP_OPCODE_MAX:
+	case NVFX_FP_OP_OPCODE_SLT:
+	case NVFX_FP_OP_OPCODE_SGE:
+	case NVFX_FP_OP_OPCODE_SLE:
+	case NVFX_FP_OP_OPCODE_SGT:
+	case NVFX_FP_OP_OPCODE_SNE:
+	case NVFX_FP_OP_OPCODE_SEQ:
+		info->used = 3;
+		info->componentwise = 1;
+		break;
+	case NVFX_FP_OP_OPCODE_MAD:
+		info->used = 7;
+		info->componentwise = 1;
+		break;
+	case NVFX_FP_OP_OPCODE_DP3:
+	case NVFX_FP_OP_OPCODE_DP4:
+	case NVFX_FP_OP_OPCODE_DST:
+		info->used = 3;
+		break;
+	case NVFX_FP_OP_OPCODE_RCP:
+	case NVFX_FP_OP_OPCODE_EX2:
+	case NVFX_FP_OP_OPCODE_LG2:
+	case NVFX_FP_OP_OPCODE_COS:
+	case NVFX_FP_OP_OPCODE_SIN:
+		info->used = 1;
+		break;
+	case NVFX_FP_OP_OPCODE_KIL:
+		info->side_effects = 1;
+		break;
+	default:
+		info->used = 7;
+		info->known = 0;
+		break;
+	}
+
+	if (hw[3] & NVFX_FP_OP_INDEX_INPUT)
+		info->known = 0;
+
+	/* Even without a temporary destination, this is what's read: */
+	info->mask = (hw[0] & NVFX_FP_OP_OUTMASK_MASK) >> NVFX_FP_OP_OUTMASK_SHIFT;
+
+	if (!(hw[0] & NV40_FP_OP_OUT_NONE)) {
+		unsigned index = (hw[0] & NV40_FP_OP_OUT_REG_MASK) >> NVFX_FP_OP_OUT_REG_SHIFT;
+
+		if (hw[0] & NVFX_FP_OP_OUT_REG_HALF) {
+			/* outputs, and H registers that share an R register */
+			info->side_effects = 1;
+			info->clobbers = 1ULL << (index >> 1);
+		} else {
+			info->dst = index;
+			info->clobbers = 1ULL << index;
+		}
+	}
+
+	if (hw[0] & NVFX_FP_OP_COND_WRITE_ENABLE)
+		info->side_effects = 1;
+
+	info->partial = ((hw[1] & NVFX_FP_OP_COND_MASK) >> NVFX_FP_OP_COND_SHIFT) != NVFX_FP_OP_COND_TR;
+	info->plain = !info->partial &&
+		!(hw[0] & (NVFX_FP_OP_OUT_SAT | NVFX_FP_OP_COND_WRITE_ENABLE | NVFX_FP_OP_PRECISION_MASK)) &&
+		!(hw[2] & NVFX_FP_OP_DST_SCALE_MASK);
+}
+
+static void
+nvfx_opt_vp_info(const struct nvfx_opt_insn *insn, struct nvfx_opt_info *info)
+{
+	const uint32_t *hw = insn->hw;
+	unsigned vec = (hw[1] & NV40_VP_INST_VEC_OPCODE_MASK) >> NV40_VP_INST_VEC_OPCODE_SHIFT;
+	unsigned sca = (hw[1] & NV40_VP_INST_SCA_OPCODE_MASK) >> NV40_VP_INST_SCA_OPCODE_SHIFT;
+
+	memset(info, 0, sizeof(*info));
+	info->dst = -1;
+	info->known = 1;
+
+	if (vec != NVFX_VP_INST_VEC_OP_NOP && sca != NVFX_VP_INST_SCA_OP_NOP) {
+		/* already co-issued; left as it is */
+		unsigned vtemp = (hw[0] & NV40_VP_INST_VEC_DEST_TEMP_MASK) >> NV40_VP_INST_VEC_DEST_TEMP_SHIFT;
+		unsigned stemp = (hw[3] & NV40_VP_INST_SCA_DEST_TEMP_MASK) >> NV40_VP_INST_SCA_DEST_TEMP_SHIFT;
+
+		info->used = 7;
+		info->known = 0;
+		info->side_effects = 1;
+		info->partial = 1;
+		if (vtemp != 0x3f)
+			info->clobbers |= 1ULL << vtemp;
+		if (stemp != 0x1f)
+			info->clobbers |= 1ULL << stemp;
+		return;
+	}
+
+	if (sca != NVFX_VP_INST_SCA_OP_NOP) {
+		unsigned temp = (hw[3] & NV40_VP_INST_SCA_DEST_TEMP_MASK) >> NV40_VP_INST_SCA_DEST_TEMP_SHIFT;
+
+		info->op = sca;
+		info->sca = 1;
+		info->used = 4;
+
+		switch (sca) {
+		case NVFX_VP_INST_SCA_OP_MOV:
+		case NVFX_VP_INST_SCA_OP_RCP:
+		case NVFX_VP_INST_SCA_OP_RCC:
+		case NVFX_VP_INST_SCA_OP_RSQ:
+		case NVFX_VP_INST_SCA_OP_EXP:
+		case NVFX_VP_INST_SCA_OP_LOG:
+		case NVFX_VP_INST_SCA_OP_LIT:
+		case NVFX_VP_INST_SCA_OP_LG2:
+		case NVFX_VP_INST_SCA_OP_EX2:
+		case NVFX_VP_INST_SCA_OP_SIN:
+		case NVFX_VP_INST_SCA_OP_COS:
+			break;
+		default:
+			info->used = 7;
+			info->known = 0;
+			info->side_effects = 1;
+			break;
+		}
+
+		info->mask = nvfx_opt_vp_mask((hw[3] & NV40_VP_INST_SCA_WRITEMASK_MASK) >> NV40_VP_INST_SCA_WRITEMASK_SHIFT);
+		if (temp != 0x1f)
+			info->dst = temp;
+		if (hw[3] & NV40_VP_INST_SCA_RESULT)
+			info->side_effects = 1;
+	} else {
+		unsigned temp = (hw[0] & NV40_VP_INST_VEC_DEST_TEMP_MASK) >> NV40_VP_INST_VEC_DEST_TEMP_SHIFT;
+
+		info->op = vec;
+
+		switch (vec) {
+		case NVFX_VP_INST_VEC_OP_NOP:
+			break;
+		case NVFX_VP_INST_VEC_OP_MOV:
+		case NVFX_VP_INST_VEC_OP_FRC:
+		case NVFX_VP_INST_VEC_OP_FLR:
+			info->used = 1;
+			info->componentwise = 1;
+			break;
+		case NVFX_VP_INST_VEC_OP_ADD:
+			info->used = 5;
+			info->componentwise = 1;
+			break;
+		case NVFX_VP_INST_VEC_OP_MAD:
+			info->used = 7;
+			info->componentwise = 1;
+			break;
+		case NVFX_VP_INST_VEC_OP_MUL:
+		case NVFX_VP_INST_VEC_OP_MIN:
+		case NVFX_VP_INST_VEC_OP_MAX:
+		case NVFX_VP_INST_VEC_OP_SLT:
+		case NVFX_VP_INST_VEC_OP_SGE:
+		case NVFX_VP_INST_VEC_OP_SEQ:
+		case NVFX_VP_INST_VEC_OP_SGT:
+		case NVFX_VP_INST_VEC_OP_SLE:
+		case NVFX_VP_INST_VEC_OP_SNE:
+			info->used = 3;
+			info->componentwise = 1;
+			break;
+		case NVFX_VP_INST_VEC_OP_DP3:
+		case NVFX_VP_INST_VEC_OP_DPH:
+		case NVFX_VP_INST_VEC_OP_DP4:
+		case NVFX_VP_INST_VEC_OP_DST:
+		case NVFX_VP_INST_VEC_OP_SFL:
+		case NVFX_VP_INST_VEC_OP_STR:
+			info->used = 3;
+			break;
+		case NVFX_VP_INST_VEC_OP_ARL:
+		case NVFX_VP_INST_VEC_OP_ARR:
+		case NVFX_VP_INST_VEC_OP_ARA:
+			info->used = 1;
+			info->known = 0;
+			info->side_effects = 1;
+			break;
+		default:
+			info->used = 7;
+			info->known = 0;
+			break;
+		}
+
+		info->mask = nvfx_opt_vp_mask((hw[3] & NV40_VP_INST_VEC_WRITEMASK_MASK) >> NV40_VP_INST_VEC_WRITEMASK_SHIFT);
+		if (temp != 0x3f)
+			info->dst = temp;
+		if (hw[0] & NV40_VP_INST_VEC_RESULT)
+			info->side_effects = 1;
+	}
+
+	if (info->dst >= 0)
+		info->clobbers = 1ULL << info->dst;
+
+	if ((hw[0] & NV40_VP_INST_INDEX_INPUT) || (hw[3] & NV40_VP_INST_INDEX_CONST))
+		info->known = 0;
+
+	if (hw[0] & NV40_VP_INST_COND_UPDATE_ENABLE)
+		info->side_effects = 1;
+
+	info->partial = ((hw[0] & NV40_VP_INST_COND_MASK) >> NV40_VP_INST_COND_SHIFT) != NVFX_COND_TR;
+	info->plain = !info->partial && !(hw[0] & (NV40_VP_INST_SATURATE | NV40_VP_INST_COND_UPDATE_ENABLE));
+}
+
+static void
+nvfx_opt_info(const struct nvfx_opt *opt, const struct nvfx_opt_insn *insn, struct nvfx_opt_info *info)
+{
+	if (opt->vp)
+		nvfx_opt_vp_info(insn, info);
+	else
+		nvfx_opt_fp_info(insn, info);
+}
+
+static uint32_t
+nvfx_opt_vp_src_bits(const uint32_t *hw, unsigned pos)
+{
+	switch (pos) {
+	case 0:
+		return (((hw[1] & NV40_VP_INST_SRC0H_MASK) >> NV40_VP_INST_SRC0H_SHIFT) << NV40_VP_SRC0_HIGH_SHIFT) |
+			((hw[2] & NV40_VP_INST_SRC0L_MASK) >> NV40_VP_INST_SRC0L_SHIFT);
+	case 1:
+		return (hw[2] & NV40_VP_INST_SRC1_MASK) >> NV40_VP_INST_SRC1_SHIFT;
+	default:
+		return (((hw[2] & NV40_VP_INST_SRC2H_MASK) >> NV40_VP_INST_SRC2H_SHIFT) << NV40_VP_SRC2_HIGH_SHIFT) |
+			((hw[3] & NV40_VP_INST_SRC2L_MASK) >> NV40_VP_INST_SRC2L_SHIFT);
+	}
+}
+
+static void
+nvfx_opt_vp_set_src_bits(uint32_t *hw, unsigned pos, uint32_t sr)
+{
+	switch (pos) {
+	case 0:
+		hw[1] = (hw[1] & ~NV40_VP_INST_SRC0H_MASK) |
+			(((sr & NV40_VP_SRC0_HIGH_MASK) >> NV40_VP_SRC0_HIGH_SHIFT) << NV40_VP_INST_SRC0H_SHIFT);
+		hw[2] = (hw[2] & ~NV40_VP_INST_SRC0L_MASK) |
+			((sr & NV40_VP_SRC0_LOW_MASK) << NV40_VP_INST_SRC0L_SHIFT);
+		break;
+	case 1:
+		hw[2] = (hw[2] & ~NV40_VP_INST_SRC1_MASK) | (sr << NV40_VP_INST_SRC1_SHIFT);
+		break;
+	default:
+		hw[2] = (hw[2] & ~NV40_VP_INST_SRC2H_MASK) |
+			(((sr & NV40_VP_SRC2_HIGH_MASK) >> NV40_VP_SRC2_HIGH_SHIFT) << NV40_VP_INST_SRC2H_SHIFT);
+		hw[3] = (hw[3] & ~NV40_VP_INST_SRC2L_MASK) |
+			((sr & NV40_VP_SRC2_LOW_MASK) << NV40_VP_INST_SRC2L_SHIFT);
+		break;
+	}
+}
+
+static void
+nvfx_opt_get_src(const struct nvfx_opt *opt, const struct nvfx_opt_insn *insn, unsigned pos, struct nvfx_opt_src *src)
+{
+	unsigned c;
+
+	memset(src, 0, sizeof(*src));
+
+	if (opt->vp) {
+		uint32_t sr = nvfx_opt_vp_src_bits(insn->hw, pos);
+
+		switch ((sr & NV40_VP_SRC_REG_TYPE_MASK) >> NV40_VP_SRC_REG_TYPE_SHIFT) {
+		case NV40_VP_SRC_REG_TYPE_TEMP:
+			src->file = NVFX_OPT_FILE_TEMP;
+			src->index = (sr & NV40_VP_SRC_TEMP_SRC_MASK) >> NV40_VP_SRC_TEMP_SRC_SHIFT;
+			break;
+		case NV40_VP_SRC_REG_TYPE_INPUT:
+			src->file = NVFX_OPT_FILE_INPUT;
+			src->index = (insn->hw[1] & NV40_VP_INST_INPUT_SRC_MASK) >> NV40_VP_INST_INPUT_SRC_SHIFT;
+			break;
+		case NV40_VP_SRC_REG_TYPE_CONST:
+			src->file = NVFX_OPT_FILE_CONST;
+			src->index = insn->cst;
+			break;
+		default:
+			src->file = NVFX_OPT_FILE_OTHER;
+			break;
+		}
+
+		for (c = 0; c < 4; ++c)
+			src->swz[c] = (sr >> (NV40_VP_SRC_SWZ_X_SHIFT - 2 * c)) & 3;
+		src->negate = !!(sr & NV40_VP_SRC_NEGATE);
+		src->abs = !!(insn->hw[0] & (NV40_VP_INST_SRC0_ABS << pos));
+	} else {
+		uint32_t sr = insn->hw[pos + 1];
+
+		switch ((sr & NVFX_FP_REG_TYPE_MASK) >> NVFX_FP_REG_TYPE_SHIFT) {
+		case NVFX_FP_REG_TYPE_TEMP:
+			src->index = (sr & NV40_FP_REG_SRC_MASK) >> NVFX_FP_REG_SRC_SHIFT;
+			if (sr & NVFX_FP_REG_SRC_HALF) {
+				src->file = NVFX_OPT_FILE_HALF;
+				src->index >>= 1;
+			} else {
+				src->file = NVFX_OPT_FILE_TEMP;
+			}
+			break;
+		case NVFX_FP_REG_TYPE_INPUT:
+			src->file = NVFX_OPT_FILE_INPUT;
+			src->index = (insn->hw[0] & NVFX_FP_OP_INPUT_SRC_MASK) >> NVFX_FP_OP_INPUT_SRC_SHIFT;
+			break;
+		case NVFX_FP_REG_TYPE_CONST:
+			src->file = NVFX_OPT_FILE_CONST;
+			break;
+		default:
+			src->file = NVFX_OPT_FILE_OTHER;
+			break;
+		}
+
+		for (c = 0; c < 4; ++c)
+			src->swz[c] = (sr >> (NVFX_FP_REG_SWZ_X_SHIFT + 2 * c)) & 3;
+		src->negate = !!(sr & NVFX_FP_REG_NEGATE);
+		src->abs = !!(insn->hw[1] & (NVFX_FP_OP_SRC0_ABS << pos));
+	}
+}
+
+/* Constants are handled by nvfx_opt_take_const(), since their payload
+ * (inline words, or a relocation) lives outside of the source field. */
+static void
+nvfx_opt_set_src(const struct nvfx_opt *opt, struct nvfx_opt_insn *insn, unsigned pos, const struct nvfx_opt_src *src)
+{
+	uint32_t sr = 0;
+	unsigned c;
+
+	if (opt->vp) {
+		switch (src->file) {
+		case NVFX_OPT_FILE_TEMP:
+			sr |= NV40_VP_SRC_REG_TYPE_TEMP << NV40_VP_SRC_REG_TYPE_SHIFT;
+			sr |= src->index << NV40_VP_SRC_TEMP_SRC_SHIFT;
+			break;
+		case NVFX_OPT_FILE_INPUT:
+			sr |= NV40_VP_SRC_REG_TYPE_INPUT << NV40_VP_SRC_REG_TYPE_SHIFT;
+			insn->hw[1] = (insn->hw[1] & ~NV40_VP_INST_INPUT_SRC_MASK) | (src->index << NV40_VP_INST_INPUT_SRC_SHIFT);
+			break;
+		case NVFX_OPT_FILE_CONST:
+			sr |= NV40_VP_SRC_REG_TYPE_CONST << NV40_VP_SRC_REG_TYPE_SHIFT;
+			break;
+		}
+
+		for (c = 0; c < 4; ++c)
+			sr |= src->swz[c] << (NV40_VP_SRC_SWZ_X_SHIFT - 2 * c);
+		if (src->negate)
+			sr |= NV40_VP_SRC_NEGATE;
+
+		nvfx_opt_vp_set_src_bits(insn->hw, pos, sr);
+		insn->hw[0] &= ~(NV40_VP_INST_SRC0_ABS << pos);
+		if (src->abs)
+			insn->hw[0] |= NV40_VP_INST_SRC0_ABS << pos;
+	} else {
+		switch (src->file) {
+		case NVFX_OPT_FILE_TEMP:
+			sr |= NVFX_FP_REG_TYPE_TEMP << NVFX_FP_REG_TYPE_SHIFT;
+			sr |= src->index << NVFX_FP_REG_SRC_SHIFT;
+			break;
+		case NVFX_OPT_FILE_INPUT:
+			sr |= NVFX_FP_REG_TYPE_INPUT << NVFX_FP_REG_TYPE_SHIFT;
+			insn->hw[0] = (insn->hw[0] & ~NVFX_FP_OP_INPUT_SRC_MASK) | (src->index << NVFX_FP_OP_INPUT_SRC_SHIFT);
+			break;
+		case NVFX_OPT_FILE_CONST:
+			sr |= NVFX_FP_REG_TYPE_CONST << NVFX_FP_REG_TYPE_SHIFT;
+			break;
+		}
+
+		for (c = 0; c < 4; ++c)
+			sr |= src->swz[c] << (NVFX_FP_REG_SWZ_X_SHIFT + 2 * c);
+		if (src->negate)
+			sr |= NVFX_FP_REG_NEGATE;
+
+		insn->hw[pos + 1] = (insn->hw[pos + 1] & ~NVFX_OPT_FP_SRC_MASK) | sr;
+		insn->hw[1] &= ~(NVFX_FP_OP_SRC0_ABS << pos);
+		if (src->abs)
+			insn->hw[1] |= NVFX_FP_OP_SRC0_ABS << pos;
+	}
+}
+
+static void
+nvfx_opt_take_const(const struct nvfx_opt *opt, struct nvfx_opt_insn *insn, const struct nvfx_opt_insn *from)
+{
+	if (opt->vp) {
+		insn->cst = from->cst;
+		insn->hw[1] = (insn->hw[1] & ~NV40_VP_INST_CONST_SRC_MASK) | (from->hw[1] & NV40_VP_INST_CONST_SRC_MASK);
+	} else {
+		insn->has_imm = 1;
+		memcpy(insn->imm, from->imm, sizeof(insn->imm));
+		insn->patched = from->patched;
+		insn->imm_origin = from->imm_origin;
+	}
+}
+
+/* Can insn read the same constant as from? */
+static int
+nvfx_opt_const_compatible(const struct nvfx_opt *opt, const struct nvfx_opt_insn *insn, const struct nvfx_opt_insn *from)
+{
+	if (opt->vp)
+		return insn->cst < 0 || insn->cst == from->cst;
+	if (!insn->has_imm)
+		return 1;
+	return !insn->patched && !from->patched && !memcmp(insn->imm, from->imm, sizeof(insn->imm));
+}
+
+static void
+nvfx_opt_set_opcode(const struct nvfx_opt *opt, struct nvfx_opt_insn *insn, unsigned op)
+{
+	if (opt->vp)
+		insn->hw[1] = (insn->hw[1] & ~NV40_VP_INST_VEC_OPCODE_MASK) | (op << NV40_VP_INST_VEC_OPCODE_SHIFT);
+	else
+		insn->hw[0] = (insn->hw[0] & ~NVFX_FP_OP_OPCODE_MASK) | (op << NVFX_FP_OP_OPCODE_SHIFT);
+}
+
+static int
+nvfx_opt_is(const struct nvfx_opt *opt, const struct nvfx_opt_info *info, unsigned fp_op, unsigned vp_op)
+{
+	return opt->vp ? (!info->sca && info->op == vp_op) : (info->op == fp_op);
+}
+
+/* Source positions that read R register reg; -1 if it's read as an H
+ * register, which can't be rewritten: */
+static int
+nvfx_opt_reads_at(const struct nvfx_opt *opt, const struct nvfx_opt_insn *insn, const struct nvfx_opt_info *info, unsigned reg)
+{
+	unsigned pos;
+	int positions = 0;
+
+	for (pos = 0; pos < 3; ++pos) {
+		struct nvfx_opt_src src;
+
+		if (!(info->used & (1 << pos)))
+			continue;
+		nvfx_opt_get_src(opt, insn, pos, &src);
+		if (src.index != reg)
+			continue;
+		if (src.file == NVFX_OPT_FILE_HALF)
+			return -1;
+		if (src.file == NVFX_OPT_FILE_TEMP)
+			positions |= 1 << pos;
+	}
+	return positions;
+}
+
+/* Components of R register reg read by insn: */
+static unsigned
+nvfx_opt_reads(const struct nvfx_opt *opt, const struct nvfx_opt_insn *insn, const struct nvfx_opt_info *info, unsigned reg)
+{
+	unsigned pos, c, mask = 0;
+
+	for (pos = 0; pos < 3; ++pos) {
+		struct nvfx_opt_src src;
+
+		if (!(info->used & (1 << pos)))
+			continue;
+		nvfx_opt_get_src(opt, insn, pos, &src);
+		if (src.index != reg)
+			continue;
+		if (src.file == NVFX_OPT_FILE_HALF) {
+			mask |= 0xf;
+		} else if (src.file == NVFX_OPT_FILE_TEMP) {
+			for (c = 0; c < 4; ++c) {
+				if (!info->componentwise || (info->mask & (1 << c)))
+					mask |= 1 << src.swz[c];
+			}
+		}
+	}
+	return mask;
+}
+
+/* Components of R register reg whose values after instruction i are read: */
+static unsigned
+nvfx_opt_live_after(const struct nvfx_opt *opt, unsigned i, unsigned reg)
+{
+	unsigned live = 0, unknown = 0xf, j;
+
+	for (j = i + 1; j < opt->nr && unknown; ++j) {
+		const struct nvfx_opt_insn *insn = &opt->insns[j];
+		struct nvfx_opt_info info;
+
+		if (insn->dead)
+			continue;
+		nvfx_opt_info(opt, insn, &info);
+		live |= nvfx_opt_reads(opt, insn, &info, reg) & unknown;
+		if (info.dst == (int)reg && !info.partial)
+			unknown &= ~info.mask;
+	}
+
+	if (opt->live_out & (1ULL << reg))
+		live |= unknown;
+	return live;
+}
+
+/* Source src, as read through a temporary that a MOV of it was written to,
+ * with swizzle swz and modifiers negate & abs: */
+static struct nvfx_opt_src
+nvfx_opt_compose(const struct nvfx_opt_src *src, const struct nvfx_opt_src *through)
+{
+	struct nvfx_opt_src result = *src;
+	unsigned c;
+
+	for (c = 0; c < 4; ++c)
+		result.swz[c] = src->swz[through->swz[c]];
+	if (through->abs) {
+		result.abs = 1;
+		result.negate = through->negate;
+	} else {
+		result.negate = src->negate ^ through->negate;
+	}
+	return result;
+}
+
+/* Rewrites the sources of insn at positions that read the temporary written
+ * by mov, into result. Fails if insn can't read mov's source as well as
+ * its others. */
+static int
+nvfx_opt_substitute(const struct nvfx_opt *opt, const struct nvfx_opt_insn *mov, const struct nvfx_opt_src *src,
+		    const struct nvfx_opt_insn *insn, const struct nvfx_opt_info *info, unsigned positions,
+		    struct nvfx_opt_insn *result)
+{
+	unsigned pos;
+
+	if (insn->fixed || !info->known)
+		return 0;
+
+	if (src->file == NVFX_OPT_FILE_INPUT) {
+		for (pos = 0; pos < 3; ++pos) {
+			struct nvfx_opt_src other;
+
+			if (!(info->used & (1 << pos)) || (positions & (1 << pos)))
+				continue;
+			nvfx_opt_get_src(opt, insn, pos, &other);
+			if (other.file == NVFX_OPT_FILE_INPUT && other.index != src->index)
+				return 0;
+		}
+		if (!opt->vp && ((insn->hw[3] ^ mov->hw[3]) & NVFX_OPT_FP_NO_PERSPECTIVE))
+			return 0;
+	}
+
+	if (src->file == NVFX_OPT_FILE_CONST && !nvfx_opt_const_compatible(opt, insn, mov))
+		return 0;
+
+	*result = *insn;
+	for (pos = 0; pos < 3; ++pos) {
+		struct nvfx_opt_src through, composed;
+
+		if (!(positions & (1 << pos)))
+			continue;
+		nvfx_opt_get_src(opt, insn, pos, &through);
+		composed = nvfx_opt_compose(src, &through);
+		nvfx_opt_set_src(opt, result, pos, &composed);
+	}
+	if (src->file == NVFX_OPT_FILE_CONST && !(opt->vp ? insn->cst >= 0 : insn->has_imm))
+		nvfx_opt_take_const(opt, result, mov);
+	return 1;
+}
+
+/* Replaces every read of the result of MOV i with its source. All or
+ * nothing: the MOV is removed, so a fragment program only grows if more
+ * than one reader has to be given its own copy of an immediate. */
+static int
+nvfx_opt_propagate_mov(struct nvfx_opt *opt, unsigned i, const struct nvfx_opt_info *mov_info)
+{
+	const struct nvfx_opt_insn *mov = &opt->insns[i];
+	const unsigned t = mov_info->dst;
+	struct nvfx_opt_src src;
+	unsigned j, n = 0, new_imms = 0, k;
+	int overwritten = 0;
+
+	nvfx_opt_get_src(opt, mov, 0, &src);
+	switch (src.file) {
+	case NVFX_OPT_FILE_TEMP:
+		if (src.index == t)
+			return 0;
+		break;
+	case NVFX_OPT_FILE_INPUT:
+		break;
+	case NVFX_OPT_FILE_CONST:
+		if (!opt->vp && mov->patched)
+			return 0;
+		break;
+	default:
+		return 0;
+	}
+
+	for (j = i + 1; j < opt->nr; ++j) {
+		const struct nvfx_opt_insn *insn = &opt->insns[j];
+		struct nvfx_opt_info info;
+		int positions;
+
+		if (insn->dead)
+			continue;
+		nvfx_opt_info(opt, insn, &info);
+
+		positions = nvfx_opt_reads_at(opt, insn, &info, t);
+		if (positions < 0)
+			return 0;
+		if (positions) {
+			if (!nvfx_opt_substitute(opt, mov, &src, insn, &info, positions, &opt->rewritten[n]))
+				return 0;
+			if (!opt->vp && src.file == NVFX_OPT_FILE_CONST && !insn->has_imm)
+				++new_imms;
+			opt->readers[n++] = j;
+		}
+
+		if (info.clobbers & (1ULL << t)) {
+			unsigned killed = (info.dst == (int)t && !info.partial) ? info.mask : 0;
+
+			if (nvfx_opt_live_after(opt, j, t) & ~killed)
+				return 0;
+			overwritten = 1;
+			break;
+		}
+		if (src.file == NVFX_OPT_FILE_TEMP && (info.clobbers & (1ULL << src.index))) {
+			if (nvfx_opt_live_after(opt, j, t))
+				return 0;
+			overwritten = 1;
+			break;
+		}
+	}
+
+	if (!overwritten && (opt->live_out & (1ULL << t)))
+		return 0;
+	if (new_imms > 1)
+		return 0;
+
+	for (k = 0; k < n; ++k)
+		opt->insns[opt->readers[k]] = opt->rewritten[k];
+	opt->insns[i].dead = 1;
+	return 1;
+}
+
+static int
+nvfx_opt_copy_propagate(struct nvfx_opt *opt)
+{
+	unsigned i;
+	int progress = 0;
+
+	for (i = 0; i < opt->nr; ++i) {
+		const struct nvfx_opt_insn *insn = &opt->insns[i];
+		struct nvfx_opt_info info;
+
+		if (insn->dead || insn->fixed)
+			continue;
+		nvfx_opt_info(opt, insn, &info);
+		if (!info.known || !info.plain || info.side_effects || info.dst < 0 || info.mask != 0xf)
+			continue;
+		if (!nvfx_opt_is(opt, &info, NVFX_FP_OP_OPCODE_MOV, NVFX_VP_INST_VEC_OP_MOV))
+			continue;
+		if (nvfx_opt_propagate_mov(opt, i, &info))
+			progress = 1;
+	}
+	return progress;
+}
+
+static int
+nvfx_opt_dead_code(struct nvfx_opt *opt)
+{
+	unsigned i = opt->nr;
+	int progress = 0;
+
+	/* Backwards, so that chains of dead instructions go in one pass: */
+	while (i--) {
+		struct nvfx_opt_insn *insn = &opt->insns[i];
+		struct nvfx_opt_info info;
+
+		if (insn->dead)
+			continue;
+		nvfx_opt_info(opt, insn, &info);
+		if (info.side_effects)
+			continue;
+		if (info.dst >= 0 && (nvfx_opt_live_after(opt, i, info.dst) & info.mask))
+			continue;
+		insn->dead = 1;
+		progress = 1;
+	}
+	return progress;
+}
+
+/* MUL t, a, b; ... ADD d, t, y -> MAD d, a, b, y, where the ADD is the only
+ * thing that reads t. The MAD goes where the ADD was. */
+static int
+nvfx_opt_fuse_mad(struct nvfx_opt *opt)
+{
+	const unsigned add_positions = opt->vp ? 5 : 3;
+	unsigned i;
+	int progress = 0;
+
+	for (i = 0; i < opt->nr; ++i) {
+		struct nvfx_opt_insn *mul = &opt->insns[i], *add = NULL, mad;
+		struct nvfx_opt_info mul_info, add_info;
+		struct nvfx_opt_src a, b, y, through;
+		unsigned t, j, c, p, q, killed, input = ~0u;
+		uint64_t regs;
+		int positions, mul_const, add_const;
+
+		if (mul->dead || mul->fixed)
+			continue;
+		nvfx_opt_info(opt, mul, &mul_info);
+		if (!mul_info.known || !mul_info.plain || mul_info.side_effects || mul_info.dst < 0)
+			continue;
+		if (!nvfx_opt_is(opt, &mul_info, NVFX_FP_OP_OPCODE_MUL, NVFX_VP_INST_VEC_OP_MUL))
+			continue;
+
+		t = mul_info.dst;
+		nvfx_opt_get_src(opt, mul, 0, &a);
+		nvfx_opt_get_src(opt, mul, 1, &b);
+		if (a.file == NVFX_OPT_FILE_HALF || a.file == NVFX_OPT_FILE_OTHER ||
+		    b.file == NVFX_OPT_FILE_HALF || b.file == NVFX_OPT_FILE_OTHER)
+			continue;
+		if ((a.file == NVFX_OPT_FILE_TEMP && a.index == t) || (b.file == NVFX_OPT_FILE_TEMP && b.index == t))
+			continue;
+
+		/* The first instruction to read t; nothing in between may
+		 * change t, a or b: */
+		regs = 1ULL << t;
+		if (a.file == NVFX_OPT_FILE_TEMP)
+			regs |= 1ULL << a.index;
+		if (b.file == NVFX_OPT_FILE_TEMP)
+			regs |= 1ULL << b.index;
+		for (j = i + 1; j < opt->nr; ++j) {
+			struct nvfx_opt_insn *insn = &opt->insns[j];
+
+			if (insn->dead)
+				continue;
+			nvfx_opt_info(opt, insn, &add_info);
+			if (nvfx_opt_reads(opt, insn, &add_info, t)) {
+				add = insn;
+				break;
+			}
+			if (add_info.clobbers & regs)
+				break;
+		}
+		if (!add || add->fixed || !add_info.known)
+			continue;
+		if (!nvfx_opt_is(opt, &add_info, NVFX_FP_OP_OPCODE_ADD, NVFX_VP_INST_VEC_OP_ADD))
+			continue;
+		if (!opt->vp && ((mul->hw[0] ^ add->hw[0]) & NVFX_FP_OP_PRECISION_MASK))
+			continue;
+
+		positions = nvfx_opt_reads_at(opt, add, &add_info, t);
+		if (positions <= 0 || (positions & (positions - 1)))
+			continue;
+		p = nvfx_opt_first(positions);
+		q = nvfx_opt_first(add_positions & ~positions);
+		nvfx_opt_get_src(opt, add, p, &through);
+		nvfx_opt_get_src(opt, add, q, &y);
+		if (through.abs || y.file == NVFX_OPT_FILE_HALF || y.file == NVFX_OPT_FILE_OTHER)
+			continue;
+
+		/* The ADD only reads components of t that the MUL wrote, and
+		 * the product isn't needed afterwards: */
+		for (c = 0; c < 4; ++c) {
+			if ((add_info.mask & (1 << c)) && !(mul_info.mask & (1 << through.swz[c])))
+				break;
+		}
+		if (c < 4)
+			continue;
+		killed = (add_info.dst == (int)t && !add_info.partial) ? add_info.mask : 0;
+		if (nvfx_opt_live_after(opt, j, t) & mul_info.mask & ~killed)
+			continue;
+
+		/* One input, and one constant, per instruction: */
+		if (a.file == NVFX_OPT_FILE_INPUT)
+			input = a.index;
+		if (b.file == NVFX_OPT_FILE_INPUT && input != ~0u && b.index != input)
+			continue;
+		if (b.file == NVFX_OPT_FILE_INPUT)
+			input = b.index;
+		if (y.file == NVFX_OPT_FILE_INPUT && input != ~0u && y.index != input)
+			continue;
+		if (!opt->vp && (a.file == NVFX_OPT_FILE_INPUT || b.file == NVFX_OPT_FILE_INPUT) &&
+		    ((mul->hw[3] ^ add->hw[3]) & NVFX_OPT_FP_NO_PERSPECTIVE))
+			continue;
+
+		mul_const = a.file == NVFX_OPT_FILE_CONST || b.file == NVFX_OPT_FILE_CONST;
+		add_const = y.file == NVFX_OPT_FILE_CONST;
+		if (mul_const && add_const && !nvfx_opt_const_compatible(opt, add, mul))
+			continue;
+
+		mad = *add;
+		nvfx_opt_set_opcode(opt, &mad, opt->vp ? NVFX_VP_INST_VEC_OP_MAD : NVFX_FP_OP_OPCODE_MAD);
+		through.abs = 0;
+		a = nvfx_opt_compose(&a, &through);
+		through.negate = 0;
+		b = nvfx_opt_compose(&b, &through);
+		nvfx_opt_set_src(opt, &mad, 0, &a);
+		nvfx_opt_set_src(opt, &mad, 1, &b);
+		nvfx_opt_set_src(opt, &mad, 2, &y);
+		if (mul_const && !add_const)
+			nvfx_opt_take_const(opt, &mad, mul);
+
+		*add = mad;
+		mul->dead = 1;
+		progress = 1;
+	}
+	return progress;
+}
+
+static float
+nvfx_opt_imm(const struct nvfx_opt_insn *insn, const struct nvfx_opt_src *src, unsigned c)
+{
+	union { uint32_t u; float f; } v;
+
+	v.u = insn->imm[src->swz[c]];
+	if (src->abs)
+		v.f = fabsf(v.f);
+	if (src->negate)
+		v.f = -v.f;
+	return v.f;
+}
+
+static float
+nvfx_opt_saturate(float r)
+{
+	return (r < 0.0f) ? 0.0f : ((r > 1.0f) ? 1.0f : r);
+}
+
+/* The result of an FP instruction, from the values of its sources (with
+ * swizzles & modifiers applied; 0 for those it doesn't read). Fails for
+ * opcodes that aren't evaluated here: */
+static int
+nvfx_opt_fp_evaluate(unsigned op, const float s[3][4], float *r)
+{
+	float dp = 0;
+	unsigned c;
+
+	switch (op) {
+	case NVFX_FP_OP_OPCODE_DP3:
+	case NVFX_FP_OP_OPCODE_DP4:
+		for (c = 0; c < (op == NVFX_FP_OP_OPCODE_DP3 ? 3 : 4); ++c)
+			dp += s[0][c] * s[1][c];
+		break;
+	}
+
+	for (c = 0; c < 4; ++c) {
+		const float x = s[0][c], y = s[1][c], z = s[2][c];
+
+		switch (op) {
+		case NVFX_FP_OP_OPCODE_MOV: r[c] = x; break;
+		case NVFX_FP_OP_OPCODE_MUL: r[c] = x * y; break;
+		case NVFX_FP_OP_OPCODE_ADD: r[c] = x + y; break;
+		case NVFX_FP_OP_OPCODE_MAD: r[c] = x * y + z; break;
+		case NVFX_FP_OP_OPCODE_MIN: r[c] = (x < y) ? x : y; break;
+		case NVFX_FP_OP_OPCODE_MAX: r[c] = (x > y) ? x : y; break;
+		case NVFX_FP_OP_OPCODE_SLT: r[c] = (x < y) ? 1.0f : 0.0f; break;
+		case NVFX_FP_OP_OPCODE_SGE: r[c] = (x >= y) ? 1.0f : 0.0f; break;
+		case NVFX_FP_OP_OPCODE_SLE: r[c] = (x <= y) ? 1.0f : 0.0f; break;
+		case NVFX_FP_OP_OPCODE_SGT: r[c] = (x > y) ? 1.0f : 0.0f; break;
+		case NVFX_FP_OP_OPCODE_SNE: r[c] = (x != y) ? 1.0f : 0.0f; break;
+		case NVFX_FP_OP_OPCODE_SEQ: r[c] = (x == y) ? 1.0f : 0.0f; break;
+		case NVFX_FP_OP_OPCODE_FRC: r[c] = x - floorf(x); break;
+		case NVFX_FP_OP_OPCODE_FLR: r[c] = floorf(x); break;
+		case NVFX_FP_OP_OPCODE_DP3:
+		case NVFX_FP_OP_OPCODE_DP4: r[c] = dp; break;
+		default: return 0;
+		}
+	}
+	return 1;
+}
+
+/* FP instructions that only read their inline immediate become a MOV of
+ * the result: */
+static int
+nvfx_opt_fold_constants(struct nvfx_opt *opt)
+{
+	unsigned i;
+	int progress = 0;
+
+	for (i = 0; i < opt->nr; ++i) {
+		struct nvfx_opt_insn *insn = &opt->insns[i];
+		struct nvfx_opt_info info;
+		struct nvfx_opt_src src[3];
+		union { uint32_t u; float f; } v[4];
+		float s[3][4], r[4];
+		unsigned pos, c;
+
+		if (insn->dead || insn->fixed || !insn->has_imm || insn->patched)
+			continue;
+		nvfx_opt_info(opt, insn, &info);
+		if (!info.known || info.op == NVFX_FP_OP_OPCODE_MOV || !info.used)
+			continue;
+		if ((insn->hw[0] & NVFX_FP_OP_PRECISION_MASK) || (insn->hw[2] & NVFX_FP_OP_DST_SCALE_MASK))
+			continue;
+
+		memset(s, 0, sizeof(s));
+		for (pos = 0; pos < 3; ++pos) {
+			if (!(info.used & (1 << pos)))
+				continue;
+			nvfx_opt_get_src(opt, insn, pos, &src[pos]);
+			if (src[pos].file != NVFX_OPT_FILE_CONST)
+				break;
+			for (c = 0; c < 4; ++c)
+				s[pos][c] = nvfx_opt_imm(insn, &src[pos], c);
+		}
+		if (pos < 3 || !nvfx_opt_fp_evaluate(info.op, s, r))
+			continue;
+
+		for (c = 0; c < 4; ++c) {
+			if (insn->hw[0] & NVFX_FP_OP_OUT_SAT)
+				r[c] = nvfx_opt_saturate(r[c]);
+			v[c].f = (info.mask & (1 << c)) ? r[c] : 0.0f;
+		}
+
+		for (c = 0; c < 4; ++c)
+			insn->imm[c] = v[c].u;
+		insn->imm_origin = NVFX_OPT_REMOVED;
+		insn->hw[0] &= ~NVFX_FP_OP_OUT_SAT;
+		nvfx_opt_set_opcode(opt, insn, NVFX_FP_OP_OPCODE_MOV);
+		src[0].swz[0] = 0;
+		src[0].swz[1] = 1;
+		src[0].swz[2] = 2;
+		src[0].swz[3] = 3;
+		src[0].negate = src[0].abs = 0;
+		nvfx_opt_set_src(opt, insn, 0, &src[0]);
+		progress = 1;
+	}
+	return progress;
+}
+
+/* Moves FP source from to position to, bits and all; the input it reads,
+ * if any, is in hw[0] and stays put: */
+static void
+nvfx_opt_fp_move_src(struct nvfx_opt_insn *insn, unsigned to, unsigned from)
+{
+	const uint32_t sr = insn->hw[from + 1] & NVFX_OPT_FP_SRC_MASK;
+	const int abs = !!(insn->hw[1] & (NVFX_FP_OP_SRC0_ABS << from));
+
+	insn->hw[to + 1] = (insn->hw[to + 1] & ~NVFX_OPT_FP_SRC_MASK) | sr;
+	insn->hw[1] &= ~(NVFX_FP_OP_SRC0_ABS << to);
+	if (abs)
+		insn->hw[1] |= NVFX_FP_OP_SRC0_ABS << to;
+}
+
+/* Unused FP sources are encoded as inputs: */
+static void
+nvfx_opt_fp_clear_src(struct nvfx_opt_insn *insn, unsigned pos)
+{
+	insn->hw[pos + 1] = (insn->hw[pos + 1] & ~NVFX_OPT_FP_SRC_MASK) |
+		(NVFX_FP_REG_TYPE_INPUT << NVFX_FP_REG_TYPE_SHIFT);
+	insn->hw[1] &= ~(NVFX_FP_OP_SRC0_ABS << pos);
+}
+
+/* Makes insn a MOV of 0, to what it writes: */
+static void
+nvfx_opt_fp_zero(const struct nvfx_opt *opt, struct nvfx_opt_insn *insn)
+{
+	struct nvfx_opt_src src;
+	unsigned c;
+
+	memset(&src, 0, sizeof(src));
+	src.file = NVFX_OPT_FILE_CONST;
+	for (c = 0; c < 4; ++c) {
+		src.swz[c] = c;
+		insn->imm[c] = 0;
+	}
+	insn->imm_origin = NVFX_OPT_REMOVED;
+	nvfx_opt_set_src(opt, insn, 0, &src);
+	nvfx_opt_fp_clear_src(insn, 1);
+	nvfx_opt_fp_clear_src(insn, 2);
+	nvfx_opt_set_opcode(opt, insn, NVFX_FP_OP_OPCODE_MOV);
+}
+
+/* The value of the components of an immediate source that are read, if
+ * they're all the same: */
+static int
+nvfx_opt_imm_splat(const struct nvfx_opt_insn *insn, const struct nvfx_opt_src *src, unsigned comps, float *v)
+{
+	unsigned c;
+	int first = 1;
+
+	for (c = 0; c < 4; ++c) {
+		float x;
+
+		if (!(comps & (1 << c)))
+			continue;
+		x = nvfx_opt_imm(insn, src, c);
+		if (first)
+			*v = x;
+		else if (x != *v)
+			return 0;
+		first = 0;
+	}
+	return !first;
+}
+
+/* x * 0 = 0, x * 1 = x and x + 0 = x, where the 0 or 1 is an immediate
+ * that isn't patched; what's left behind once uniforms have been folded
+ * into a program. Not for infinite or NaN x, or -0, hence not part of
+ * NVFX_OPT_ALL: */
+static int
+nvfx_opt_simplify(struct nvfx_opt *opt)
+{
+	unsigned i;
+	int progress = 0;
+
+	for (i = 0; i < opt->nr; ++i) {
+		struct nvfx_opt_insn *insn = &opt->insns[i];
+		struct nvfx_opt_info info;
+		unsigned pos, comps, zeros = 0, ones = 0, p;
+		int all_const = 1;
+
+		if (insn->dead || insn->fixed || !insn->has_imm || insn->patched)
+			continue;
+		nvfx_opt_info(opt, insn, &info);
+		if (!info.known)
+			continue;
+
+		switch (info.op) {
+		case NVFX_FP_OP_OPCODE_MUL:
+		case NVFX_FP_OP_OPCODE_ADD:
+		case NVFX_FP_OP_OPCODE_MAD:
+			comps = info.mask;
+			break;
+		case NVFX_FP_OP_OPCODE_DP3:
+			comps = 0x7;
+			break;
+		case NVFX_FP_OP_OPCODE_DP4:
+			comps = 0xf;
+			break;
+		default:
+			continue;
+		}
+
+		for (pos = 0; pos < 3; ++pos) {
+			struct nvfx_opt_src src;
+			float v;
+
+			if (!(info.used & (1 << pos)))
+				continue;
+			nvfx_opt_get_src(opt, insn, pos, &src);
+			if (src.file != NVFX_OPT_FILE_CONST) {
+				all_const = 0;
+				continue;
+			}
+			if (!nvfx_opt_imm_splat(insn, &src, comps, &v))
+				continue;
+			if (v == 0.0f)
+				zeros |= 1 << pos;
+			else if (v == 1.0f)
+				ones |= 1 << pos;
+		}
+		/* folded instead: */
+		if (all_const)
+			continue;
+
+		switch (info.op) {
+		case NVFX_FP_OP_OPCODE_MUL:
+			if (zeros) {
+				nvfx_opt_fp_zero(opt, insn);
+				break;
+			}
+			if (!ones)
+				continue;
+			nvfx_opt_fp_move_src(insn, 0, 1 - nvfx_opt_first(ones));
+			nvfx_opt_fp_clear_src(insn, 1);
+			nvfx_opt_set_opcode(opt, insn, NVFX_FP_OP_OPCODE_MOV);
+			break;
+		case NVFX_FP_OP_OPCODE_ADD:
+			if (!zeros)
+				continue;
+			nvfx_opt_fp_move_src(insn, 0, 1 - nvfx_opt_first(zeros));
+			nvfx_opt_fp_clear_src(insn, 1);
+			nvfx_opt_set_opcode(opt, insn, NVFX_FP_OP_OPCODE_MOV);
+			break;
+		case NVFX_FP_OP_OPCODE_MAD:
+			if (zeros & 3) {
+				nvfx_opt_fp_move_src(insn, 0, 2);
+				nvfx_opt_fp_clear_src(insn, 1);
+				nvfx_opt_fp_clear_src(insn, 2);
+				nvfx_opt_set_opcode(opt, insn, NVFX_FP_OP_OPCODE_MOV);
+			} else if (ones & 3) {
+				p = nvfx_opt_first(ones & 3);
+				if (p == 0)
+					nvfx_opt_fp_move_src(insn, 0, 1);
+				nvfx_opt_fp_move_src(insn, 1, 2);
+				nvfx_opt_fp_clear_src(insn, 2);
+				nvfx_opt_set_opcode(opt, insn, NVFX_FP_OP_OPCODE_ADD);
+			} else if (zeros & 4) {
+				nvfx_opt_fp_clear_src(insn, 2);
+				nvfx_opt_set_opcode(opt, insn, NVFX_FP_OP_OPCODE_MUL);
+			} else {
+				continue;
+			}
+			break;
+		default:
+			if (!zeros)
+				continue;
+			nvfx_opt_fp_zero(opt, insn);
+			break;
+		}
+
+		/* The immediate goes if nothing's left that reads it: */
+		insn->has_imm = 0;
+		for (pos = 0; pos < 3; ++pos) {
+			if (((insn->hw[pos + 1] & NVFX_FP_REG_TYPE_MASK) >> NVFX_FP_REG_TYPE_SHIFT) == NVFX_FP_REG_TYPE_CONST)
+				insn->has_imm = 1;
+		}
+		if (!insn->has_imm)
+			insn->imm_origin = NVFX_OPT_REMOVED;
+		progress = 1;
+	}
+	return progress;
+}
+
+/* Merges a vector instruction and a scalar instruction into one, if
+ * neither depends upon the other: */
+static int
+nvfx_opt_coissue_pair(struct nvfx_opt *opt, struct nvfx_opt_insn *first, struct nvfx_opt_insn *second)
+{
+	struct nvfx_opt_insn *vec, *sca, merged;
+	struct nvfx_opt_info first_info, second_info, *vec_info, *sca_info;
+	struct nvfx_opt_src src;
+	unsigned pos;
+	const uint32_t sca_fields = NV40_VP_INST_SCA_WRITEMASK_MASK | NV40_VP_INST_SCA_RESULT | NV40_VP_INST_SCA_DEST_TEMP_MASK;
+
+	nvfx_opt_info(opt, first, &first_info);
+	nvfx_opt_info(opt, second, &second_info);
+	if (first->fixed || second->fixed || !first_info.known || !second_info.known)
+		return 0;
+	if (first_info.sca == second_info.sca)
+		return 0;
+	if (first_info.sca) {
+		vec = second; vec_info = &second_info;
+		sca = first; sca_info = &first_info;
+	} else {
+		vec = first; vec_info = &first_info;
+		sca = second; sca_info = &second_info;
+	}
+	if (vec_info->op == NVFX_VP_INST_VEC_OP_NOP || (vec_info->used & 4))
+		return 0;
+
+	if ((vec->hw[0] ^ sca->hw[0]) & NVFX_OPT_VP_COND_MASK)
+		return 0;
+	if ((vec->hw[0] | sca->hw[0]) & NV40_VP_INST_COND_UPDATE_ENABLE)
+		return 0;
+	if ((vec->hw[0] & NV40_VP_INST_VEC_RESULT) && (sca->hw[3] & NV40_VP_INST_SCA_RESULT))
+		return 0;
+
+	if (vec_info->dst >= 0 && sca_info->dst == vec_info->dst)
+		return 0;
+	if (sca_info->dst >= 0 && nvfx_opt_reads(opt, vec, vec_info, sca_info->dst))
+		return 0;
+	if (vec_info->dst >= 0 && nvfx_opt_reads(opt, sca, sca_info, vec_info->dst))
+		return 0;
+
+	nvfx_opt_get_src(opt, sca, 2, &src);
+	if (src.file == NVFX_OPT_FILE_INPUT) {
+		for (pos = 0; pos < 2; ++pos) {
+			struct nvfx_opt_src other;
+
+			if (!(vec_info->used & (1 << pos)))
+				continue;
+			nvfx_opt_get_src(opt, vec, pos, &other);
+			if (other.file == NVFX_OPT_FILE_INPUT && other.index != src.index)
+				return 0;
+		}
+	}
+	if (vec->cst >= 0 && sca->cst >= 0 && vec->cst != sca->cst)
+		return 0;
+
+	merged = *vec;
+	merged.hw[1] |= sca->hw[1] & NV40_VP_INST_SCA_OPCODE_MASK;
+	merged.hw[3] = (merged.hw[3] & ~sca_fields) | (sca->hw[3] & sca_fields);
+	if (sca->hw[3] & NV40_VP_INST_SCA_RESULT)
+		merged.hw[3] = (merged.hw[3] & ~NV40_VP_INST_DEST_MASK) | (sca->hw[3] & NV40_VP_INST_DEST_MASK);
+	nvfx_opt_set_src(opt, &merged, 2, &src);
+	if (sca->cst >= 0)
+		nvfx_opt_take_const(opt, &merged, sca);
+
+	*first = merged;
+	second->dead = 1;
+	second->merged = first - opt->insns;
+	return 1;
+}
+
+static int
+nvfx_opt_coissue(struct nvfx_opt *opt)
+{
+	unsigned i = 0, j;
+	int progress = 0;
+
+	for (;;) {
+		while (i < opt->nr && opt->insns[i].dead)
+			++i;
+		for (j = i + 1; j < opt->nr && opt->insns[j].dead; ++j)
+			;
+		if (j >= opt->nr)
+			break;
+
+		if (nvfx_opt_coissue_pair(opt, &opt->insns[i], &opt->insns[j])) {
+			progress = 1;
+			i = j + 1;
+		} else {
+			i = j;
+		}
+	}
+	return progress;
+}
+
+static int
+nvfx_opt_run(struct nvfx_opt *opt, unsigned flags)
+{
+	unsigned rounds = 0;
+	int progress, changed = 0;
+
+	opt->rewritten = malloc(opt->nr * sizeof(*opt->rewritten));
+	opt->readers = malloc(opt->nr * sizeof(*opt->readers));
+	if (!opt->rewritten || !opt->readers) {
+		free(opt->rewritten);
+		free(opt->readers);
+		return 0;
+	}
+
+	do {
+		progress = 0;
+		if (!opt->vp && (flags & NVFX_OPT_ALGEBRAIC))
+			progress |= nvfx_opt_simplify(opt);
+		if (!opt->vp && (flags & NVFX_OPT_FOLD_CONSTANTS))
+			progress |= nvfx_opt_fold_constants(opt);
+		if (flags & NVFX_OPT_COPY_PROPAGATE)
+			progress |= nvfx_opt_copy_propagate(opt);
+		if (flags & NVFX_OPT_FUSE_MAD)
+			progress |= nvfx_opt_fuse_mad(opt);
+		if (flags & NVFX_OPT_DEAD_CODE)
+			progress |= nvfx_opt_dead_code(opt);
+		changed |= progress;
+	} while (progress && ++rounds < 16);
+
+	if (opt->vp && (flags & NVFX_OPT_COISSUE))
+		changed |= nvfx_opt_coissue(opt);
+
+	free(opt->rewritten);
+	free(opt->readers);
+	return changed;
+}
+
+static int
+nvfx_opt_contains(const unsigned *offsets, unsigned nr, unsigned begin, unsigned end)
+{
+	unsigned i;
+
+	for (i = 0; i < nr; ++i) {
+		if (offsets[i] >= begin && offsets[i] < end)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Fragment program branches
+ */
+
+/* What's known of the R registers and condition codes at some point in a
+ * fragment program, from the immediates that reach it: */
+struct nvfx_opt_fp_state {
+	float regs[64][4];
+	unsigned known[64];	/* components of regs, x = bit 0 */
+	float cc[4];
+	unsigned cc_known;
+};
+
+static int
+nvfx_opt_fp_is_branch(const uint32_t *hw)
+{
+	return (hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH) != 0;
+}
+
+static unsigned
+nvfx_opt_fp_op(const uint32_t *hw)
+{
+	return (hw[0] & NVFX_FP_OP_OPCODE_MASK) >> NVFX_FP_OP_OPCODE_SHIFT;
+}
+
+/* Words taken up by an instruction, with its inline immediate: */
+static unsigned
+nvfx_opt_fp_words(const uint32_t *hw)
+{
+	unsigned pos;
+
+	if (nvfx_opt_fp_is_branch(hw))
+		return 4;
+	for (pos = 0; pos < 3; ++pos) {
+		if (((hw[pos + 1] & NVFX_FP_REG_TYPE_MASK) >> NVFX_FP_REG_TYPE_SHIFT) == NVFX_FP_REG_TYPE_CONST)
+			return 8;
+	}
+	return 4;
+}
+
+static int
+nvfx_opt_fp_has_branches(const uint32_t *insn, unsigned len)
+{
+	unsigned pc;
+
+	for (pc = 0; pc + 4 <= len; pc += nvfx_opt_fp_words(&insn[pc])) {
+		if (nvfx_opt_fp_is_branch(&insn[pc]))
+			return 1;
+	}
+	return 0;
+}
+
+/* Where the branch at pc goes, other than to the next instruction; returns
+ * how many places, or -1 for a branch that isn't understood: */
+static int
+nvfx_opt_fp_targets(const uint32_t *hw, unsigned pc, unsigned *targets)
+{
+	switch (nvfx_opt_fp_op(hw)) {
+	case NV40_FP_OP_BRA_OPCODE_IF:
+		targets[0] = (hw[2] & NV40_FP_OP_ELSE_OFFSET_MASK) >> NV40_FP_OP_ELSE_OFFSET_SHIFT;
+		targets[1] = (hw[3] & NV40_FP_OP_END_OFFSET_MASK) >> NV40_FP_OP_END_OFFSET_SHIFT;
+		return 2;
+	case NV40_FP_OP_BRA_OPCODE_LOOP:
+	case NV40_FP_OP_BRA_OPCODE_REP:
+		/* the body is started again from its end */
+		targets[0] = pc + 4;
+		targets[1] = (hw[3] & NV40_FP_OP_END_OFFSET_MASK) >> NV40_FP_OP_END_OFFSET_SHIFT;
+		return 2;
+	case NV40_FP_OP_BRA_OPCODE_CAL:
+		targets[0] = (hw[2] & NV40_FP_OP_SUB_OFFSET_MASK) >> NV40_FP_OP_SUB_OFFSET_SHIFT;
+		return 1;
+	case NV40_FP_OP_BRA_OPCODE_BRK:
+	case NV40_FP_OP_BRA_OPCODE_RET:
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+/* Points a branch's offsets at where what they pointed at went: */
+static void
+nvfx_opt_fp_retarget(uint32_t *hw, const unsigned *newpos)
+{
+	unsigned offset;
+
+	switch (nvfx_opt_fp_op(hw)) {
+	case NV40_FP_OP_BRA_OPCODE_IF:
+		offset = (hw[2] & NV40_FP_OP_ELSE_OFFSET_MASK) >> NV40_FP_OP_ELSE_OFFSET_SHIFT;
+		hw[2] = (hw[2] & ~NV40_FP_OP_ELSE_OFFSET_MASK) | (newpos[offset] << NV40_FP_OP_ELSE_OFFSET_SHIFT);
+		/* fall through */
+	case NV40_FP_OP_BRA_OPCODE_LOOP:
+	case NV40_FP_OP_BRA_OPCODE_REP:
+		offset = (hw[3] & NV40_FP_OP_END_OFFSET_MASK) >> NV40_FP_OP_END_OFFSET_SHIFT;
+		hw[3] = (hw[3] & ~NV40_FP_OP_END_OFFSET_MASK) | (newpos[offset] << NV40_FP_OP_END_OFFSET_SHIFT);
+		break;
+	case NV40_FP_OP_BRA_OPCODE_CAL:
+		offset = (hw[2] & NV40_FP_OP_SUB_OFFSET_MASK) >> NV40_FP_OP_SUB_OFFSET_SHIFT;
+		hw[2] = (hw[2] & ~NV40_FP_OP_SUB_OFFSET_MASK) | (newpos[offset] << NV40_FP_OP_SUB_OFFSET_SHIFT);
+		break;
+	}
+}
+
+static int
+nvfx_opt_test(unsigned cond, float f)
+{
+	switch (cond) {
+	case NVFX_FP_OP_COND_FL: return 0;
+	case NVFX_FP_OP_COND_LT: return f < 0.0f;
+	case NVFX_FP_OP_COND_EQ: return f == 0.0f;
+	case NVFX_FP_OP_COND_LE: return f <= 0.0f;
+	case NVFX_FP_OP_COND_GT: return f > 0.0f;
+	case NVFX_FP_OP_COND_NE: return f != 0.0f;
+	case NVFX_FP_OP_COND_GE: return f >= 0.0f;
+	default: return 1;
+	}
+}
+
+/* Components of an instruction's condition that are known to pass, and
+ * those that aren't known either way: */
+static void
+nvfx_opt_fp_cond(const struct nvfx_opt_fp_state *st, const uint32_t *hw, unsigned *pass, unsigned *unknown)
+{
+	const unsigned cond = (hw[1] & NVFX_FP_OP_COND_MASK) >> NVFX_FP_OP_COND_SHIFT;
+	const unsigned swz = (hw[1] & NVFX_FP_OP_COND_SWZ_ALL_MASK) >> NVFX_FP_OP_COND_SWZ_ALL_SHIFT;
+	unsigned c;
+
+	*pass = *unknown = 0;
+	for (c = 0; c < 4; ++c) {
+		const unsigned comp = (swz >> (2 * c)) & 3;
+
+		if (cond != NVFX_FP_OP_COND_TR && cond != NVFX_FP_OP_COND_FL && !(st->cc_known & (1 << comp)))
+			*unknown |= 1 << c;
+		else if (nvfx_opt_test(cond, st->cc[comp]))
+			*pass |= 1 << c;
+	}
+}
+
+/* The value of source pos of insn, if it's known: */
+static int
+nvfx_opt_fp_known_src(const struct nvfx_opt *opt, const struct nvfx_opt_fp_state *st,
+		      const struct nvfx_opt_insn *insn, unsigned pos, float *v)
+{
+	struct nvfx_opt_src src;
+	unsigned c;
+
+	nvfx_opt_get_src(opt, insn, pos, &src);
+	for (c = 0; c < 4; ++c) {
+		switch (src.file) {
+		case NVFX_OPT_FILE_TEMP:
+			if (!(st->known[src.index] & (1 << src.swz[c])))
+				return 0;
+			v[c] = st->regs[src.index][src.swz[c]];
+			if (src.abs)
+				v[c] = fabsf(v[c]);
+			if (src.negate)
+				v[c] = -v[c];
+			break;
+		case NVFX_OPT_FILE_CONST:
+			if (insn->patched)
+				return 0;
+			v[c] = nvfx_opt_imm(insn, &src, c);
+			break;
+		default:
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Carries what's known over an ALU instruction: */
+static void
+nvfx_opt_fp_step(const struct nvfx_opt *opt, struct nvfx_opt_fp_state *st, const struct nvfx_opt_insn *insn)
+{
+	const uint32_t *hw = insn->hw;
+	struct nvfx_opt_info info;
+	float s[3][4], r[4];
+	unsigned pass, unknown, pos, c;
+	int known;
+
+	nvfx_opt_fp_info(insn, &info);
+	if (info.op == NVFX_FP_OP_OPCODE_NOP || info.op == NVFX_FP_OP_OPCODE_KIL)
+		return;
+	nvfx_opt_fp_cond(st, hw, &pass, &unknown);
+
+	/* Reduced precision and scaling aren't modelled: */
+	known = info.known && !(hw[0] & NVFX_FP_OP_PRECISION_MASK) &&
+		!((hw[2] >> NVFX_FP_OP_DST_SCALE_SHIFT) & 7);
+	memset(s, 0, sizeof(s));
+	for (pos = 0; known && pos < 3; ++pos) {
+		if ((info.used & (1 << pos)) && !nvfx_opt_fp_known_src(opt, st, insn, pos, s[pos]))
+			known = 0;
+	}
+	if (known)
+		known = nvfx_opt_fp_evaluate(info.op, s, r);
+
+	for (c = 0; c < 4; ++c) {
+		const unsigned bit = 1 << c;
+		const int value = known && (pass & bit);
+
+		if (!(info.mask & (pass | unknown) & bit))
+			continue;
+		if (value && (hw[0] & NVFX_FP_OP_OUT_SAT))
+			r[c] = nvfx_opt_saturate(r[c]);
+
+		if (hw[0] & NVFX_FP_OP_COND_WRITE_ENABLE) {
+			st->cc_known &= ~bit;
+			if (value) {
+				st->cc[c] = r[c];
+				st->cc_known |= bit;
+			}
+		}
+		if (info.dst >= 0) {
+			st->known[info.dst] &= ~bit;
+			if (value) {
+				st->regs[info.dst][c] = r[c];
+				st->known[info.dst] |= bit;
+			}
+		}
+	}
+	if (!(hw[0] & NV40_FP_OP_OUT_NONE) && (hw[0] & NVFX_FP_OP_OUT_REG_HALF))
+		st->known[((hw[0] & NV40_FP_OP_OUT_REG_MASK) >> NVFX_FP_OP_OUT_REG_SHIFT) >> 1] = 0;
+}
+
+/* Removes the IF at pc, and the arm of it that doesn't run. Fails if
+ * anything else branches into the middle of what would go. newpos is set
+ * to where each word went, or NVFX_OPT_REMOVED: */
+static int
+nvfx_opt_fp_remove_arm(uint32_t *insn, unsigned *len, unsigned pc, int taken, unsigned *newpos)
+{
+	const unsigned n = *len;
+	unsigned targets[2], range[2][2], k, q, words, last = 0, new_last = 0, out = 0;
+	int nr, end_removed = 0;
+
+	nvfx_opt_fp_targets(&insn[pc], pc, targets);
+	if (targets[0] < pc + 4 || targets[1] < targets[0])
+		return 0;
+
+	range[0][0] = pc;
+	if (taken) {
+		range[0][1] = pc + 4;
+		range[1][0] = targets[0];
+		range[1][1] = targets[1];
+	} else {
+		range[0][1] = targets[0];
+		range[1][0] = range[1][1] = targets[0];
+	}
+
+	for (q = 0; q < n; q += nvfx_opt_fp_words(&insn[q])) {
+		int removed = (q >= range[0][0] && q < range[0][1]) || (q >= range[1][0] && q < range[1][1]);
+
+		last = q;
+		if (removed || !nvfx_opt_fp_is_branch(&insn[q]))
+			continue;
+		nr = nvfx_opt_fp_targets(&insn[q], q, targets);
+		while (nr-- > 0) {
+			for (k = 0; k < 2; ++k) {
+				if (targets[nr] > range[k][0] && targets[nr] < range[k][1])
+					return 0;
+			}
+		}
+	}
+	if (range[0][1] - range[0][0] + range[1][1] - range[1][0] >= n)
+		return 0;
+
+	/* A branch to the start of what goes ends up at whatever's next: */
+	for (k = 0; k < n; ++k) {
+		newpos[k] = out;
+		if (!((k >= range[0][0] && k < range[0][1]) || (k >= range[1][0] && k < range[1][1])))
+			++out;
+	}
+	newpos[n] = out;
+	end_removed = (insn[last] & NVFX_FP_OP_PROGRAM_END) && newpos[last] == newpos[last + 1];
+
+	for (q = 0; q < n; q += words) {
+		words = nvfx_opt_fp_words(&insn[q]);
+		if (newpos[q] == newpos[q + 1])
+			continue;
+		if (nvfx_opt_fp_is_branch(&insn[q]))
+			nvfx_opt_fp_retarget(&insn[q], newpos);
+		new_last = newpos[q];
+		memmove(&insn[newpos[q]], &insn[q], words * sizeof(*insn));
+	}
+	if (end_removed)
+		insn[new_last] |= NVFX_FP_OP_PROGRAM_END;
+
+	for (k = 0; k < n; ++k) {
+		if (newpos[k] == newpos[k + 1])
+			newpos[k] = NVFX_OPT_REMOVED;
+	}
+	*len = out;
+	return 1;
+}
+
+/* Finds the first IF whose condition is known, from the immediates that
+ * are moved into the condition codes in the straight-line code before it,
+ * and removes the arm that doesn't run: */
+static int
+nvfx_opt_fp_resolve_if(uint32_t *insn, unsigned *len, const unsigned *patched, unsigned nr_patched, unsigned *newpos)
+{
+	const unsigned n = *len;
+	struct nvfx_opt opt;
+	struct nvfx_opt_fp_state *st;
+	unsigned char *start, *target;
+	unsigned pc, words, targets[2], k;
+	int nr, flush = 1, resolved = 0;
+
+	memset(&opt, 0, sizeof(opt));
+	st = malloc(sizeof(*st));
+	start = calloc(n + 1, 1);
+	target = calloc(n + 1, 1);
+	if (!st || !start || !target)
+		goto out;
+
+	/* Where instructions start, and which of them are branched to: */
+	for (pc = 0; pc < n; pc += words) {
+		words = nvfx_opt_fp_words(&insn[pc]);
+		if (pc + words > n)
+			goto out;
+		start[pc] = 1;
+		if (!nvfx_opt_fp_is_branch(&insn[pc]))
+			continue;
+		nr = nvfx_opt_fp_targets(&insn[pc], pc, targets);
+		if (nr < 0)
+			goto out;
+		while (nr-- > 0) {
+			if (targets[nr] > n)
+				goto out;
+			target[targets[nr]] = 1;
+		}
+	}
+	start[n] = 1;
+	for (k = 0; k <= n; ++k) {
+		if (target[k] && !start[k])
+			goto out;
+	}
+
+	for (pc = 0; pc < n && !resolved; pc += words) {
+		const uint32_t *hw = &insn[pc];
+		struct nvfx_opt_insn oi;
+
+		words = nvfx_opt_fp_words(hw);
+		/* Nothing's known where control flow meets: */
+		if (flush || target[pc])
+			memset(st, 0, sizeof(*st));
+		flush = 0;
+
+		if (nvfx_opt_fp_is_branch(hw)) {
+			unsigned pass, unknown;
+
+			if (nvfx_opt_fp_op(hw) != NV40_FP_OP_BRA_OPCODE_IF) {
+				flush = 1;
+				continue;
+			}
+			/* Taken if any component passes: */
+			nvfx_opt_fp_cond(st, hw, &pass, &unknown);
+			if (pass || !unknown)
+				resolved = nvfx_opt_fp_remove_arm(insn, len, pc, pass != 0, newpos);
+			continue;
+		}
+
+		memset(&oi, 0, sizeof(oi));
+		memcpy(oi.hw, hw, sizeof(oi.hw));
+		if (words == 8) {
+			oi.has_imm = 1;
+			memcpy(oi.imm, hw + 4, sizeof(oi.imm));
+			oi.patched = nvfx_opt_contains(patched, nr_patched, pc + 4, pc + 5);
+		}
+		nvfx_opt_fp_step(&opt, st, &oi);
+		if (hw[0] & NVFX_FP_OP_PROGRAM_END)
+			flush = 1;
+	}
+
+out:
+	free(st);
+	free(start);
+	free(target);
+	return resolved;
+}
+
+/* Drops the offsets that were removed, and moves the rest: */
+static unsigned
+nvfx_opt_translate(unsigned *offsets, unsigned nr, const unsigned *newpos)
+{
+	unsigned i, j;
+
+	for (i = 0, j = 0; i < nr; ++i) {
+		if (newpos[offsets[i]] != NVFX_OPT_REMOVED)
+			offsets[j++] = newpos[offsets[i]];
+	}
+	return j;
+}
+
+static int
+nvfx_fp_optimize_straight(struct nvfx_fp_opt *fp, unsigned flags)
+{
+	struct nvfx_opt opt;
+	uint32_t *insn = NULL;
+	unsigned pc, i, len = 0, last = 0;
+	int has_end = 0, changed = 0;
+
+	memset(&opt, 0, sizeof(opt));
+	opt.live_out = fp->live_out;
+	opt.insns = malloc((fp->insn_len / 4 + 1) * sizeof(*opt.insns));
+	if (!opt.insns)
+		return 0;
+
+	for (pc = 0; pc < fp->insn_len; ) {
+		const uint32_t *hw = &fp->insn[pc];
+		struct nvfx_opt_insn *oi = &opt.insns[opt.nr++];
+		unsigned s;
+
+		if (pc + 4 > fp->insn_len || (hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH))
+			goto out;
+
+		memset(oi, 0, sizeof(*oi));
+		memcpy(oi->hw, hw, sizeof(oi->hw));
+		oi->origin = pc;
+		oi->imm_origin = NVFX_OPT_REMOVED;
+		oi->cst = -1;
+		oi->merged = -1;
+		if (oi->hw[0] & NVFX_FP_OP_PROGRAM_END) {
+			oi->hw[0] &= ~NVFX_FP_OP_PROGRAM_END;
+			has_end = 1;
+		}
+
+		for (s = 0; s < 3; ++s) {
+			if (((hw[s + 1] & NVFX_FP_REG_TYPE_MASK) >> NVFX_FP_REG_TYPE_SHIFT) == NVFX_FP_REG_TYPE_CONST)
+				oi->has_imm = 1;
+		}
+		if (oi->has_imm) {
+			if (pc + 8 > fp->insn_len)
+				goto out;
+			memcpy(oi->imm, hw + 4, sizeof(oi->imm));
+			oi->imm_origin = pc + 4;
+			oi->patched = nvfx_opt_contains(fp->patched, fp->nr_patched, pc + 4, pc + 5);
+		}
+		oi->fixed = nvfx_opt_contains(fp->fixed, fp->nr_fixed, pc, pc + 4);
+
+		pc += oi->has_imm ? 8 : 4;
+	}
+
+	/* Condition codes that nothing tests (what's left of a resolved IF)
+	 * aren't worth keeping an instruction alive for. A NOP's condition
+	 * field is meaningless: */
+	if (flags & NVFX_OPT_DEAD_CODE) {
+		for (i = 0; i < opt.nr; ++i) {
+			if (((opt.insns[i].hw[0] & NVFX_FP_OP_OPCODE_MASK) >> NVFX_FP_OP_OPCODE_SHIFT) == NVFX_FP_OP_OPCODE_NOP)
+				continue;
+			if (((opt.insns[i].hw[1] & NVFX_FP_OP_COND_MASK) >> NVFX_FP_OP_COND_SHIFT) != NVFX_FP_OP_COND_TR)
+				break;
+		}
+		if (i == opt.nr) {
+			for (i = 0; i < opt.nr; ++i)
+				opt.insns[i].hw[0] &= ~NVFX_FP_OP_COND_WRITE_ENABLE;
+		}
+	}
+
+	if (!nvfx_opt_run(&opt, flags))
+		goto out;
+
+	for (i = 0; i < opt.nr; ++i) {
+		if (!opt.insns[i].dead)
+			len += opt.insns[i].has_imm ? 8 : 4;
+	}
+	if (!len || len > fp->insn_len)
+		goto out;
+
+	insn = malloc(len * sizeof(*insn));
+	if (!insn)
+		goto out;
+
+	for (i = 0; i < fp->insn_len; ++i)
+		fp->remap[i] = NVFX_OPT_REMOVED;
+
+	for (i = 0, pc = 0; i < opt.nr; ++i) {
+		const struct nvfx_opt_insn *oi = &opt.insns[i];
+		unsigned k;
+
+		if (oi->dead)
+			continue;
+
+		memcpy(&insn[pc], oi->hw, sizeof(oi->hw));
+		for (k = 0; k < 4; ++k)
+			fp->remap[oi->origin + k] = pc + k;
+		if (oi->has_imm) {
+			memcpy(&insn[pc + 4], oi->imm, sizeof(oi->imm));
+			if (oi->imm_origin != NVFX_OPT_REMOVED) {
+				for (k = 0; k < 4; ++k)
+					fp->remap[oi->imm_origin + k] = pc + 4 + k;
+			}
+		}
+		last = pc;
+		pc += oi->has_imm ? 8 : 4;
+	}
+	if (has_end)
+		insn[last] |= NVFX_FP_OP_PROGRAM_END;
+
+	memcpy(fp->insn, insn, len * sizeof(*insn));
+	fp->insn_len = len;
+	fp->last = last;
+	changed = 1;
+
+out:
+	free(insn);
+	free(opt.insns);
+	return changed;
+}
+
+int
+nvfx_fp_optimize(struct nvfx_fp_opt *fp, unsigned flags)
+{
+	struct nvfx_fp_opt straight;
+	unsigned *patched, *fixed, *newpos, *remap;
+	unsigned i, pc, len = fp->insn_len, nr_patched = fp->nr_patched, nr_fixed = fp->nr_fixed;
+	int resolved = 0;
+
+	if (!nvfx_opt_fp_has_branches(fp->insn, fp->insn_len))
+		return nvfx_fp_optimize_straight(fp, flags);
+	if (!(flags & NVFX_OPT_RESOLVE_BRANCHES))
+		return 0;
+
+	patched = malloc((nr_patched + 1) * sizeof(*patched));
+	fixed = malloc((nr_fixed + 1) * sizeof(*fixed));
+	newpos = malloc((len + 1) * sizeof(*newpos));
+	remap = malloc((len + 1) * sizeof(*remap));
+	if (!patched || !fixed || !newpos || !remap)
+		goto out;
+	if (nr_patched)
+		memcpy(patched, fp->patched, nr_patched * sizeof(*patched));
+	if (nr_fixed)
+		memcpy(fixed, fp->fixed, nr_fixed * sizeof(*fixed));
+
+	for (i = 0; i < fp->insn_len; ++i)
+		fp->remap[i] = i;
+
+	/* One IF at a time, since resolving one can make others known: */
+	while (nvfx_opt_fp_resolve_if(fp->insn, &len, patched, nr_patched, newpos)) {
+		for (i = 0; i < fp->insn_len; ++i) {
+			if (fp->remap[i] != NVFX_OPT_REMOVED)
+				fp->remap[i] = newpos[fp->remap[i]];
+		}
+		nr_patched = nvfx_opt_translate(patched, nr_patched, newpos);
+		nr_fixed = nvfx_opt_translate(fixed, nr_fixed, newpos);
+		resolved = 1;
+	}
+	if (!resolved)
+		goto out;
+
+	for (pc = 0; pc < len; pc += nvfx_opt_fp_words(&fp->insn[pc]))
+		fp->last = pc;
+
+	/* What's left may be straight-line code: */
+	if (!nvfx_opt_fp_has_branches(fp->insn, len)) {
+		straight = *fp;
+		straight.insn_len = len;
+		straight.patched = patched;
+		straight.nr_patched = nr_patched;
+		straight.fixed = fixed;
+		straight.nr_fixed = nr_fixed;
+		straight.remap = remap;
+		if (nvfx_fp_optimize_straight(&straight, flags)) {
+			for (i = 0; i < fp->insn_len; ++i) {
+				if (fp->remap[i] != NVFX_OPT_REMOVED)
+					fp->remap[i] = remap[fp->remap[i]];
+			}
+			len = straight.insn_len;
+			fp->last = straight.last;
+		}
+	}
+	fp->insn_len = len;
+
+out:
+	free(patched);
+	free(fixed);
+	free(newpos);
+	free(remap);
+	return resolved;
+}
+
+int
+nvfx_vp_optimize(struct nvfx_vp_opt *vp, unsigned flags)
+{
+	struct nvfx_opt opt;
+	unsigned i, n, end = vp->nr_insns;
+	int has_last = 0, changed = 0;
+
+	memset(&opt, 0, sizeof(opt));
+	opt.vp = 1;
+
+	/* Anything after the first LAST is never executed; it's left as it is: */
+	for (i = 0; i < vp->nr_insns; ++i) {
+		const uint32_t *hw = &vp->insn[i * 4];
+		unsigned sca = (hw[1] & NV40_VP_INST_SCA_OPCODE_MASK) >> NV40_VP_INST_SCA_OPCODE_SHIFT;
+
+		switch (sca) {
+		case NVFX_VP_INST_SCA_OP_BRA:
+		case NVFX_VP_INST_SCA_OP_CAL:
+		case NVFX_VP_INST_SCA_OP_RET:
+		case NV40_VP_INST_SCA_OP_PUSHA:
+		case NV40_VP_INST_SCA_OP_POPA:
+			return 0;
+		}
+		if (hw[3] & NVFX_VP_INST_LAST) {
+			end = i + 1;
+			has_last = 1;
+			break;
+		}
+	}
+
+	opt.insns = malloc((end + 1) * sizeof(*opt.insns));
+	if (!opt.insns)
+		return 0;
+
+	for (i = 0; i < end; ++i) {
+		struct nvfx_opt_insn *oi = &opt.insns[opt.nr++];
+
+		memset(oi, 0, sizeof(*oi));
+		memcpy(oi->hw, &vp->insn[i * 4], sizeof(oi->hw));
+		oi->hw[3] &= ~NVFX_VP_INST_LAST;
+		oi->origin = i;
+		oi->imm_origin = NVFX_OPT_REMOVED;
+		oi->cst = vp->consts[i];
+		oi->merged = -1;
+	}
+
+	if (!nvfx_opt_run(&opt, flags))
+		goto out;
+
+	for (i = 0, n = 0; i < opt.nr; ++i) {
+		if (!opt.insns[i].dead)
+			++n;
+	}
+	if (!n)
+		goto out;
+
+	for (i = 0, n = 0; i < opt.nr; ++i) {
+		const struct nvfx_opt_insn *oi = &opt.insns[i];
+
+		if (oi->dead) {
+			vp->remap[oi->origin] = NVFX_OPT_REMOVED;
+			continue;
+		}
+		memcpy(&vp->insn[n * 4], oi->hw, sizeof(oi->hw));
+		vp->consts[n] = oi->cst;
+		vp->remap[oi->origin] = n++;
+	}
+	for (i = 0; i < opt.nr; ++i) {
+		const struct nvfx_opt_insn *oi = &opt.insns[i];
+
+		if (oi->merged >= 0)
+			vp->remap[oi->origin] = vp->remap[opt.insns[oi->merged].origin];
+	}
+	if (has_last)
+		vp->insn[(n - 1) * 4 + 3] |= NVFX_VP_INST_LAST;
+
+	for (i = end; i < vp->nr_insns; ++i, ++n) {
+		memmove(&vp->insn[n * 4], &vp->insn[i * 4], 4 * sizeof(*vp->insn));
+		vp->consts[n] = vp->consts[i];
+		vp->remap[i] = n;
+	}
+	vp->nr_insns = n;
+	changed = 1;
+
+out:
+	free(opt.insns);
+	return changed;
+}
+
+/* Register allocation
+ *
+ * Translation gives every TGSI temporary a register of its own for the whole
+ * program, so fp_control usually reports many more registers than are ever
+ * live at once - and the fewer it reports, the more fragments the hardware
+ * keeps in flight. Once the program is translated, the temporaries are packed
+ * into as few registers as possible. A register's live range is taken to be
+ * the span from its first to its last mention, which is safe as long as control
+ * only flows forwards; programs with loops or subroutines are left alone.
+ *
+ * Temporaries whose every write is saturated, and whose every read is by
+ * arithmetic that only feeds other such temporaries or the colour outputs
+ * (which are half precision already), only ever hold values in [0, 1] that
+ * end up as fp16 anyway. They're given half precision (H) registers instead,
+ * two of which share each full precision (R) register. Reserved registers
+ * are never moved.
+ */
+#define NVFX_FP_RA_REGS 64
+
+struct nvfx_fp_ra_temp {
+	int first, last;
+	int written;
+	int half;
+	unsigned reg;
+};
+
+static inline unsigned
+nvfx_fp_ra_opcode(const uint32_t *hw)
+{
+	return (hw[0] & NVFX_FP_OP_OPCODE_MASK) >> NVFX_FP_OP_OPCODE_SHIFT;
+}
+
+static inline int
+nvfx_fp_ra_src_is_temp(uint32_t sr)
+{
+	return ((sr & NVFX_FP_REG_TYPE_MASK) >> NVFX_FP_REG_TYPE_SHIFT) == NVFX_FP_REG_TYPE_TEMP;
+}
+
+static inline unsigned
+nvfx_fp_ra_src_index(uint32_t sr)
+{
+	return (sr & NV40_FP_REG_SRC_MASK) >> NVFX_FP_REG_SRC_SHIFT;
+}
+
+static inline unsigned
+nvfx_fp_ra_dst_index(const uint32_t *hw)
+{
+	return (hw[0] & NV40_FP_OP_OUT_REG_MASK) >> NVFX_FP_OP_OUT_REG_SHIFT;
+}
+
+/* Does the instruction write a full precision temporary? */
+static inline int
+nvfx_fp_ra_dst_is_temp(const uint32_t *hw)
+{
+	return !(hw[0] & (NV40_FP_OP_OUT_NONE | NVFX_FP_OP_OUT_REG_HALF));
+}
+
+/* Offset of the instruction following the one at pc, skipping its constant */
+static unsigned
+nvfx_fp_ra_next(const uint32_t *insn, unsigned pc)
+{
+	const uint32_t *hw = &insn[pc];
+
+	if (!(hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH)) {
+		for (unsigned s = 0; s < 3; ++s) {
+			if (((hw[s + 1] & NVFX_FP_REG_TYPE_MASK) >> NVFX_FP_REG_TYPE_SHIFT) == NVFX_FP_REG_TYPE_CONST)
+				return pc + 8;
+		}
+	}
+	return pc + 4;
+}
+
+static inline void
+nvfx_fp_ra_mention(struct nvfx_fp_ra_temp *t, unsigned pc)
+{
+	if (t->first < 0)
+		t->first = pc;
+	t->last = pc;
+}
+
+/* Can the result be kept in a half precision register? */
+static int
+nvfx_fp_ra_half_write(const uint32_t *hw)
+{
+	if (!(hw[0] & NVFX_FP_OP_OUT_SAT) || (hw[0] & NVFX_FP_OP_COND_WRITE_ENABLE))
+		return 0;
+
+	switch (nvfx_fp_ra_opcode(hw)) {
+	case NVFX_FP_OP_OPCODE_PK4B:
+	case NVFX_FP_OP_OPCODE_UP4B:
+	case NVFX_FP_OP_OPCODE_PK2H:
+	case NVFX_FP_OP_OPCODE_UP2H:
+	case NVFX_FP_OP_OPCODE_PK4UB:
+	case NVFX_FP_OP_OPCODE_UP4UB:
+	case NVFX_FP_OP_OPCODE_PK2US:
+	case NVFX_FP_OP_OPCODE_UP2US:
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+/* Can the instruction read its sources from half precision registers? */
+static int
+nvfx_fp_ra_half_read(const uint32_t *hw, const struct nvfx_fp_ra_temp *t)
+{
+	if (hw[0] & (NV40_FP_OP_OUT_NONE | NVFX_FP_OP_COND_WRITE_ENABLE))
+		return 0;
+
+	switch (nvfx_fp_ra_opcode(hw)) {
+	case NVFX_FP_OP_OPCODE_MOV:
+	case NVFX_FP_OP_OPCODE_MUL:
+	case NVFX_FP_OP_OPCODE_ADD:
+	case NVFX_FP_OP_OPCODE_MAD:
+	case NVFX_FP_OP_OPCODE_MIN:
+	case NVFX_FP_OP_OPCODE_MAX:
+	case NVFX_FP_OP_OPCODE_DP3:
+	case NVFX_FP_OP_OPCODE_DP4:
+		break;
+	default:
+		return 0;
+	}
+
+	/* a colour output, or another half precision temporary */
+	return (hw[0] & NVFX_FP_OP_OUT_REG_HALF) || t[nvfx_fp_ra_dst_index(hw)].half;
+}
+
+int
+nvfx_fp_allocate_temps(struct nvfx_fp_ra *ra)
+{
+	struct nvfx_fp_ra_temp t[NVFX_FP_RA_REGS];
+	unsigned order[NVFX_FP_RA_REGS];
+	int busy[NVFX_FP_RA_REGS][2];
+	uint64_t reserved = ra->reserved;
+	unsigned pc, i, n = 0;
+	int num_regs = 2;
+	int changed;
+
+	for (i = 0; i < NVFX_FP_RA_REGS; ++i) {
+		t[i].first = t[i].last = -1;
+		t[i].written = t[i].half = 0;
+		t[i].reg = i;
+	}
+
+	/* live ranges */
+	for (pc = 0; pc < ra->insn_len; pc = nvfx_fp_ra_next(ra->insn, pc)) {
+		const uint32_t *hw = &ra->insn[pc];
+
+		if (hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH) {
+			if (nvfx_fp_ra_opcode(hw) != NV40_FP_OP_BRA_OPCODE_IF)
+				return 0;
+			continue;
+		}
+
+		if (!(hw[0] & NV40_FP_OP_OUT_NONE)) {
+			unsigned index = nvfx_fp_ra_dst_index(hw);
+
+			if (hw[0] & NVFX_FP_OP_OUT_REG_HALF) {
+				reserved |= 1ULL << (index >> 1);
+			} else {
+				nvfx_fp_ra_mention(&t[index], pc);
+				t[index].written = 1;
+			}
+		}
+
+		for (unsigned s = 0; s < 3; ++s) {
+			uint32_t sr = hw[s + 1];
+			unsigned index = nvfx_fp_ra_src_index(sr);
+
+			if (!nvfx_fp_ra_src_is_temp(sr))
+				continue;
+			if (sr & NVFX_FP_REG_SRC_HALF)
+				reserved |= 1ULL << (index >> 1);
+			else
+				nvfx_fp_ra_mention(&t[index], pc);
+		}
+	}
+
+	/* half precision: start optimistic, then rule out temporaries until
+	 * nothing changes */
+	for (i = 0; i < NVFX_FP_RA_REGS; ++i)
+		t[i].half = t[i].written && !(reserved & (1ULL << i));
+
+	for (pc = 0; pc < ra->insn_len; pc = nvfx_fp_ra_next(ra->insn, pc)) {
+		const uint32_t *hw = &ra->insn[pc];
+
+		if (!(hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH) && nvfx_fp_ra_dst_is_temp(hw) && !nvfx_fp_ra_half_write(hw))
+			t[nvfx_fp_ra_dst_index(hw)].half = 0;
+	}
+
+	do {
+		changed = 0;
+		for (pc = 0; pc < ra->insn_len; pc = nvfx_fp_ra_next(ra->insn, pc)) {
+			const uint32_t *hw = &ra->insn[pc];
+
+			if (hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH)
+				continue;
+
+			for (unsigned s = 0; s < 3; ++s) {
+				uint32_t sr = hw[s + 1];
+				unsigned index = nvfx_fp_ra_src_index(sr);
+
+				if (!nvfx_fp_ra_src_is_temp(sr) || (sr & NVFX_FP_REG_SRC_HALF) || !t[index].half)
+					continue;
+				if (!nvfx_fp_ra_half_read(hw, t)) {
+					t[index].half = 0;
+					changed = 1;
+				}
+			}
+		}
+	} while (changed);
+
+	/* linear scan, in order of first mention */
+	for (i = 0; i < NVFX_FP_RA_REGS; ++i) {
+		unsigned j;
+
+		if (t[i].first < 0)
+			continue;
+		if (reserved & (1ULL << i)) {
+			if (num_regs < (int)(i + 1))
+				num_regs = i + 1;
+			continue;
+		}
+
+		for (j = n++; j > 0 && t[order[j - 1]].first > t[i].first; --j)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	for (i = 0; i < NVFX_FP_RA_REGS; ++i)
+		busy[i][0] = busy[i][1] = (reserved & (1ULL << i)) ? (int)ra->insn_len : -1;
+
+	for (i = 0; i < n; ++i) {
+		struct nvfx_fp_ra_temp *temp = &t[order[i]];
+		unsigned r, found = ~0u;
+
+		if (temp->half) {
+			/* prefer sharing a register with another half */
+			for (r = 0; r < ra->max_temps && (2 * r + 1) < ra->max_half; ++r) {
+				int free0 = busy[r][0] <= temp->first, free1 = busy[r][1] <= temp->first;
+
+				if (free0 != free1) {
+					found = 2 * r + (free0 ? 0 : 1);
+					break;
+				}
+				if (free0 && found == ~0u)
+					found = 2 * r;
+			}
+			if (found == ~0u)
+				return 0;
+			busy[found >> 1][found & 1] = temp->last;
+			r = found >> 1;
+		} else {
+			for (r = 0; r < ra->max_temps; ++r) {
+				if (busy[r][0] <= temp->first && busy[r][1] <= temp->first)
+					break;
+			}
+			if (r == ra->max_temps)
+				return 0;
+			busy[r][0] = busy[r][1] = temp->last;
+			found = r;
+		}
+
+		temp->reg = found;
+		if (num_regs < (int)(r + 1))
+			num_regs = r + 1;
+	}
+
+	if (num_regs >= (int)ra->num_regs)
+		return 0;
+
+	/* rewrite the program */
+	for (pc = 0; pc < ra->insn_len; pc = nvfx_fp_ra_next(ra->insn, pc)) {
+		uint32_t *hw = &ra->insn[pc];
+
+		if (hw[2] & NV40_FP_OP_OPCODE_IS_BRANCH)
+			continue;
+
+		if (nvfx_fp_ra_dst_is_temp(hw)) {
+			const struct nvfx_fp_ra_temp *temp = &t[nvfx_fp_ra_dst_index(hw)];
+
+			if (!(reserved & (1ULL << nvfx_fp_ra_dst_index(hw)))) {
+				hw[0] &= ~(NV40_FP_OP_OUT_REG_MASK | NVFX_FP_OP_OUT_REG_HALF);
+				hw[0] |= (temp->reg << NVFX_FP_OP_OUT_REG_SHIFT);
+				if (temp->half)
+					hw[0] |= NVFX_FP_OP_OUT_REG_HALF;
+			}
+		}
+
+		for (unsigned s = 0; s < 3; ++s) {
+			uint32_t sr = hw[s + 1];
+			unsigned index = nvfx_fp_ra_src_index(sr);
+			const struct nvfx_fp_ra_temp *temp = &t[index];
+
+			if (!nvfx_fp_ra_src_is_temp(sr) || (sr & NVFX_FP_REG_SRC_HALF) || (reserved & (1ULL << index)))
+				continue;
+
+			sr &= ~(NV40_FP_REG_SRC_MASK | NVFX_FP_REG_SRC_HALF);
+			sr |= (temp->reg << NVFX_FP_REG_SRC_SHIFT);
+			if (temp->half)
+				sr |= NVFX_FP_REG_SRC_HALF;
+			hw[s + 1] = sr;
+		}
+	}
+
+	ra->num_regs = num_regs;
+	return 1;
+}
@@ -0,0 +1,105 @@
+#ifndef __NVFX_OPTIMIZE_H__
+#define __NVFX_OPTIMIZE_H__
+
+/* Peephole & dataflow optimization of NV40 vertex and fragment program
+ * microcode. This is shared by the driver's TGSI translators and by cgcomp,
+ * so it only depends upon the microcode definitions.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Passes, for the flags arguments below: */
+#define NVFX_OPT_COPY_PROPAGATE (1 << 0)
+#define NVFX_OPT_DEAD_CODE      (1 << 1)
+#define NVFX_OPT_FUSE_MAD       (1 << 2)
+#define NVFX_OPT_FOLD_CONSTANTS (1 << 3) /* fragment programs only */
+#define NVFX_OPT_COISSUE        (1 << 4) /* vertex programs only */
+#define NVFX_OPT_RESOLVE_BRANCHES (1 << 5) /* fragment programs only */
+#define NVFX_OPT_ALL            0x3f
+
+/* x * 0 = 0, x * 1 = x and x + 0 = x, with immediates that aren't patched.
+ * Not exact for infinite or NaN x, so it's asked for separately; meant for
+ * programs that have had uniforms folded into them: */
+#define NVFX_OPT_ALGEBRAIC      (1 << 6) /* fragment programs only */
+
+/* remap[] entry for a word or instruction that was removed: */
+#define NVFX_OPT_REMOVED (~0u)
+
+struct nvfx_fp_opt {
+	/* The program, rewritten in place; insn_len is in words: */
+	uint32_t *insn;
+	unsigned insn_len;
+
+	/* R registers still read after the program ends (depth): */
+	uint64_t live_out;
+
+	/* Word offsets of inline constants that are filled in later, from
+	 * uniforms. These are never folded, and stay with one instruction: */
+	const unsigned *patched;
+	unsigned nr_patched;
+
+	/* Word offsets of source words that are rewritten later (varyings
+	 * relocated to a temporary or an input). Their instructions are left
+	 * alone, unless they turn out to be dead: */
+	const unsigned *fixed;
+	unsigned nr_fixed;
+
+	/* Out: new word offset for each old one (insn_len entries), or
+	 * NVFX_OPT_REMOVED; and the offset of the last instruction: */
+	unsigned *remap;
+	unsigned last;
+};
+
+struct nvfx_vp_opt {
+	/* The program, rewritten in place; 4 words per instruction: */
+	uint32_t *insn;
+	unsigned nr_insns;
+
+	/* Constant read by each instruction (what the relocations patch into
+	 * CONST_SRC), or -1; updated along with the instructions: */
+	int *consts;
+
+	/* Out: new index for each old one (nr_insns entries), or
+	 * NVFX_OPT_REMOVED: */
+	unsigned *remap;
+};
+
+struct nvfx_fp_ra {
+	/* The program, rewritten in place; insn_len is in words: */
+	uint32_t *insn;
+	unsigned insn_len;
+
+	/* R registers that keep their indices (outputs, and temporaries that
+	 * relocations refer to): */
+	uint64_t reserved;
+
+	/* R and H registers that may be used: */
+	unsigned max_temps;
+	unsigned max_half;
+
+	/* In: R registers the program uses now; out: after allocation: */
+	unsigned num_regs;
+};
+
+/* Both return non-zero if the program was changed. Vertex programs that
+ * branch aren't optimized. Fragment program IFs whose conditions are known
+ * are resolved (NVFX_OPT_RESOLVE_BRANCHES), and the other passes only run
+ * if no branches are left. */
+int nvfx_fp_optimize(struct nvfx_fp_opt *opt, unsigned flags);
+int nvfx_vp_optimize(struct nvfx_vp_opt *opt, unsigned flags);
+
+/* Packs a fragment program's temporaries into as few registers as it can,
+ * keeping values that stay in [0, 1] in H registers. Returns non-zero, and
+ * lowers num_regs, if the program was rewritten; programs with loops or
+ * subroutines are left alone. Run after nvfx_fp_optimize(): */
+int nvfx_fp_allocate_temps(struct nvfx_fp_ra *ra);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
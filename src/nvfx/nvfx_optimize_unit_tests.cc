@@ -0,0 +1,1005 @@
+// "Unit testing" for nvfx_optimize.c. Random straight-line programs are run through a small
+// reference interpreter before and after they're optimized, and their outputs compared. Meant to
+// be built & run on the host, e.g.:
+//
+// gcc -std=c99 -c nvfx_optimize.c -I../../extsrc/mesa/src/gallium/include
+// g++ -std=c++11 -ffp-contract=off nvfx_optimize_unit_tests.cc nvfx_optimize.o -o nvfx_optimize_unit_tests
+//
+// The interpreter decodes the microcode itself, with its own definitions of the fields, so that it
+// doesn't share any mistakes with the optimizer.
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+
+#include "nvfx_optimize.h"
+
+// Deterministic, so that failures can be reproduced:
+static uint32_t seed = 1;
+
+static uint32_t
+rand_u32()
+{
+  seed = seed * 1664525 + 1013904223;
+  return seed >> 8;
+}
+
+static unsigned
+rand_n(unsigned n)
+{
+  return rand_u32() % n;
+}
+
+static bool
+rand_chance(unsigned percent)
+{
+  return rand_n(100) < percent;
+}
+
+static float
+rand_value()
+{
+  static const float values[] = { 0.0f, 0.5f, 1.0f, -1.0f, 2.0f, -0.25f, 3.0f, 0.75f };
+  return rand_chance(50) ? values[rand_n(8)] : ((float)rand_n(2000) - 1000.0f) / 250.0f;
+}
+
+static uint32_t
+bits(float f)
+{
+  uint32_t u;
+  memcpy(&u,&f,4);
+  return u;
+}
+
+static float
+value(uint32_t u)
+{
+  float f;
+  memcpy(&f,&u,4);
+  return f;
+}
+
+// Bit-for-bit, except that a NaN is a NaN (the host picks which operand's NaN to propagate):
+static bool
+same(const float * a,const float * b,unsigned n)
+{
+  for(unsigned i = 0;i < n;++i) {
+    if(isnan(a[i]) ? !isnan(b[i]) : (bits(a[i]) != bits(b[i]))) return false;
+  }
+  return true;
+}
+
+enum { FILE_TEMP, FILE_INPUT, FILE_CONST };
+
+struct src_t {
+  unsigned file, index, swz[4];
+  bool negate, abs;
+};
+
+static src_t
+rand_swizzled(unsigned file,unsigned index)
+{
+  src_t s;
+  s.file = file;
+  s.index = index;
+  for(unsigned c = 0;c < 4;++c) s.swz[c] = c;
+  if(rand_chance(30)) {
+    for(unsigned c = 0;c < 4;++c) s.swz[c] = rand_n(4);
+  }
+  s.negate = rand_chance(20);
+  s.abs = rand_chance(10);
+  return s;
+}
+
+// Common arithmetic, shared by both interpreters:
+enum {
+  OP_MOV, OP_MUL, OP_ADD, OP_MAD, OP_DP3, OP_DP4, OP_MIN, OP_MAX, OP_SLT, OP_SGE, OP_FRC, OP_FLR, OP_RCP
+};
+
+static const unsigned op_sources[] = { 1, 2, 2, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1 };
+
+static void
+execute(unsigned op,const float a[4],const float b[4],const float c[4],float r[4])
+{
+  float dp = 0;
+
+  switch(op) {
+  case OP_DP3:
+    for(unsigned i = 0;i < 3;++i) dp += a[i] * b[i];
+    break;
+  case OP_DP4:
+    for(unsigned i = 0;i < 4;++i) dp += a[i] * b[i];
+    break;
+  }
+
+  for(unsigned i = 0;i < 4;++i) {
+    switch(op) {
+    case OP_MOV: r[i] = a[i]; break;
+    case OP_MUL: r[i] = a[i] * b[i]; break;
+    case OP_ADD: r[i] = a[i] + b[i]; break;
+    case OP_MAD: { const float p = a[i] * b[i]; r[i] = p + c[i]; } break;
+    case OP_DP3: case OP_DP4: r[i] = dp; break;
+    case OP_MIN: r[i] = (a[i] < b[i]) ? a[i] : b[i]; break;
+    case OP_MAX: r[i] = (a[i] > b[i]) ? a[i] : b[i]; break;
+    case OP_SLT: r[i] = (a[i] < b[i]) ? 1.0f : 0.0f; break;
+    case OP_SGE: r[i] = (a[i] >= b[i]) ? 1.0f : 0.0f; break;
+    case OP_FRC: r[i] = a[i] - floorf(a[i]); break;
+    case OP_FLR: r[i] = floorf(a[i]); break;
+    case OP_RCP: r[i] = 1.0f / a[0]; break;
+    }
+  }
+}
+
+static void
+modify(const float v[4],const unsigned swz[4],bool negate,bool abs,float r[4])
+{
+  for(unsigned c = 0;c < 4;++c) {
+    float x = v[swz[c]];
+    if(abs) x = fabsf(x);
+    if(negate) x = -x;
+    r[c] = x;
+  }
+}
+
+//
+// Fragment programs:
+namespace fp {
+
+  static const unsigned opcodes[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x08, 0x09, 0x0A, 0x0B, 0x10, 0x11, 0x1A };
+
+  static const unsigned TEMPS = 8, INPUTS = 16, SPRITE_TEMP = 7, SPRITE_INPUT = 9;
+
+  struct program_t {
+    std::vector< uint32_t > insn;
+    std::vector< unsigned > patched, fixed;
+    std::vector< unsigned > uniforms; // for each patched offset
+  };
+
+  static uint32_t
+  encode_src(const src_t & s)
+  {
+    uint32_t sr = (s.file == FILE_TEMP) ? 0 : ((s.file == FILE_INPUT) ? 1 : 2);
+    if(s.file == FILE_TEMP) sr |= s.index << 2;
+    for(unsigned c = 0;c < 4;++c) sr |= s.swz[c] << (9 + 2 * c);
+    if(s.negate) sr |= 1 << 17;
+    return sr;
+  }
+
+  static void
+  emit(program_t & p,unsigned op,int dst,unsigned mask,bool sat,const src_t * srcs,unsigned nsrcs,const float * imm,int uniform)
+  {
+    uint32_t hw[4] = { 0, 7 << 18, 0, 0 };
+    bool has_const = false;
+
+    hw[0] = (opcodes[op] << 24) | (mask << 9) | (sat ? (1u << 31) : 0);
+    if(dst < 0) hw[0] |= 1 << 30;
+    else hw[0] |= dst << 1;
+
+    for(unsigned pos = 0;pos < 3;++pos) {
+      if(pos < nsrcs) {
+	hw[pos + 1] |= encode_src(srcs[pos]);
+	if(srcs[pos].file == FILE_INPUT) hw[0] |= srcs[pos].index << 13;
+	if(srcs[pos].file == FILE_CONST) has_const = true;
+	if(srcs[pos].abs) hw[1] |= 1 << (29 + pos);
+      }
+      else {
+	hw[pos + 1] |= 1; // unused sources are encoded as inputs
+      }
+    }
+
+    p.insn.insert(p.insn.end(),hw,hw + 4);
+    if(has_const) {
+      if(uniform >= 0) {
+	p.patched.push_back(p.insn.size());
+	p.uniforms.push_back(uniform);
+	p.insn.insert(p.insn.end(),4,0);
+      }
+      else {
+	for(unsigned c = 0;c < 4;++c) p.insn.push_back(bits(imm[c]));
+      }
+    }
+  }
+
+  // What the driver does to relocated varyings, once it knows where they come from:
+  static void
+  relocate(std::vector< uint32_t > & insn,const std::vector< unsigned > & fixed)
+  {
+    for(unsigned i = 0;i < fixed.size();++i) {
+      insn[fixed[i]] = (insn[fixed[i]] & ~3) | 1;
+      insn[fixed[i] & ~3] = (insn[fixed[i] & ~3] & ~(15 << 13)) | (SPRITE_INPUT << 13);
+    }
+  }
+
+  static void
+  run(const std::vector< uint32_t > & insn,const float inputs[][4],float regs[][4])
+  {
+    for(unsigned i = 0;i < TEMPS;++i) {
+      for(unsigned c = 0;c < 4;++c) regs[i][c] = 0;
+    }
+
+    for(unsigned pc = 0;pc < insn.size();) {
+      const uint32_t * hw = &insn[pc];
+      const unsigned opcode = (hw[0] >> 24) & 0x3f;
+      unsigned op = 0;
+      while(opcodes[op] != opcode) ++op;
+
+      float s[3][4];
+      bool has_const = false;
+      for(unsigned pos = 0;pos < 3;++pos) {
+	const uint32_t sr = hw[pos + 1];
+	const float * v = 0;
+	unsigned swz[4];
+
+	switch(sr & 3) {
+	case 0: v = regs[(sr >> 2) & 63]; break;
+	case 1: v = inputs[(hw[0] >> 13) & 15]; break;
+	case 2: {
+	  static float imm[4];
+	  for(unsigned c = 0;c < 4;++c) imm[c] = value(hw[4 + c]);
+	  v = imm;
+	  has_const = true;
+	} break;
+	}
+	for(unsigned c = 0;c < 4;++c) swz[c] = (sr >> (9 + 2 * c)) & 3;
+	modify(v,swz,(sr >> 17) & 1,(hw[1] >> (29 + pos)) & 1,s[pos]);
+      }
+
+      float r[4];
+      execute(op,s[0],s[1],s[2],r);
+      if(hw[0] >> 31) {
+	for(unsigned c = 0;c < 4;++c) r[c] = (r[c] < 0.0f) ? 0.0f : ((r[c] > 1.0f) ? 1.0f : r[c]);
+      }
+      if(!(hw[0] & (1 << 30))) {
+	const unsigned dst = (hw[0] >> 1) & 63, mask = (hw[0] >> 9) & 15;
+	for(unsigned c = 0;c < 4;++c) {
+	  if(mask & (1 << c)) regs[dst][c] = r[c];
+	}
+      }
+
+      const bool end = hw[0] & 1;
+      pc += has_const ? 8 : 4;
+      if(end) break;
+    }
+  }
+
+  static program_t
+  generate(unsigned n)
+  {
+    program_t p;
+
+    // Like the driver's sprite coordinate flipping:
+    if(rand_chance(30)) {
+      src_t s[3] = { rand_swizzled(FILE_TEMP,SPRITE_TEMP), rand_swizzled(FILE_CONST,0), rand_swizzled(FILE_CONST,0) };
+      const float imm[4] = { 1, -1, 0, 0 };
+      p.fixed.push_back(p.insn.size() + 1);
+      emit(p,OP_MAD,SPRITE_TEMP,15,false,s,3,imm,-1);
+    }
+
+    for(unsigned i = 0;i < n;++i) {
+      unsigned op;
+      const unsigned choice = rand_n(100);
+      if(choice < 30) op = OP_MOV;
+      else if(choice < 45) op = OP_MUL;
+      else if(choice < 60) op = OP_ADD;
+      else op = rand_n(12);
+
+      const unsigned input = rand_n(INPUTS - 1);
+      const bool all_const = rand_chance(8);
+      const bool relocated = !all_const && rand_chance(8);
+      float imm[4];
+      for(unsigned c = 0;c < 4;++c) imm[c] = rand_value();
+
+      src_t s[3];
+      for(unsigned pos = 0;pos < op_sources[op];++pos) {
+	const unsigned what = all_const ? 2 : rand_n(10);
+	if(what < 6) s[pos] = rand_swizzled(FILE_TEMP,rand_n(TEMPS - 1));
+	else if(what < 8 && !relocated) s[pos] = rand_swizzled(FILE_INPUT,input);
+	else if(what < 8) s[pos] = rand_swizzled(FILE_TEMP,SPRITE_TEMP);
+	else s[pos] = rand_swizzled(FILE_CONST,0);
+      }
+      if(relocated) s[0] = rand_swizzled(FILE_TEMP,SPRITE_TEMP);
+
+      unsigned mask = (op == OP_MOV && rand_chance(70)) ? 15 : (1 + rand_n(15));
+      const int dst = rand_n(TEMPS - 1);
+      const bool sat = rand_chance(10);
+      const int uniform = (!all_const && rand_chance(25)) ? (int)rand_n(4) : -1;
+
+      const unsigned at = p.insn.size();
+      emit(p,op,dst,mask,sat,s,op_sources[op],imm,uniform);
+      if(relocated) p.fixed.push_back(at + 1);
+    }
+
+    // Something always reaches the outputs:
+    const src_t s[2] = { rand_swizzled(FILE_TEMP,rand_n(TEMPS)), rand_swizzled(FILE_TEMP,2) };
+    emit(p,OP_ADD,0,15,false,s,2,0,-1);
+    p.insn[p.insn.size() - 4] |= 1;
+    return p;
+  }
+
+  static unsigned
+  count(const std::vector< uint32_t > & insn)
+  {
+    unsigned n = 0;
+    for(unsigned pc = 0;pc < insn.size();++n) {
+      bool has_const = false;
+      for(unsigned pos = 0;pos < 3;++pos) has_const |= (insn[pc + 1 + pos] & 3) == 2;
+      pc += has_const ? 8 : 4;
+    }
+    return n;
+  }
+
+  // Optimizes a program, and checks that it computes the same outputs:
+  static unsigned
+  check(const program_t & p,unsigned flags)
+  {
+    std::vector< uint32_t > insn(p.insn);
+    std::vector< unsigned > remap(insn.size());
+
+    nvfx_fp_opt opt;
+    memset(&opt,0,sizeof(opt));
+    opt.insn = &insn[0];
+    opt.insn_len = insn.size();
+    opt.live_out = (1 << 0) | (1 << 1);
+    opt.patched = p.patched.empty() ? 0 : &p.patched[0];
+    opt.nr_patched = p.patched.size();
+    opt.fixed = p.fixed.empty() ? 0 : &p.fixed[0];
+    opt.nr_fixed = p.fixed.size();
+    opt.remap = &remap[0];
+
+    std::vector< unsigned > patched(p.patched), fixed;
+    if(nvfx_fp_optimize(&opt,flags)) {
+      assert(opt.insn_len <= p.insn.size());
+      insn.resize(opt.insn_len);
+      assert(insn[opt.last] & 1);
+
+      for(unsigned i = 0;i < patched.size();++i) {
+	patched[i] = remap[patched[i]];
+      }
+      for(unsigned i = 0;i < p.fixed.size();++i) {
+	if(remap[p.fixed[i]] != NVFX_OPT_REMOVED) fixed.push_back(remap[p.fixed[i]]);
+      }
+    }
+    else {
+      fixed = p.fixed;
+    }
+
+    for(unsigned trial = 0;trial < 8;++trial) {
+      float inputs[INPUTS][4], uniforms[4][4];
+      for(unsigned i = 0;i < INPUTS;++i) {
+	for(unsigned c = 0;c < 4;++c) inputs[i][c] = rand_value();
+      }
+      for(unsigned i = 0;i < 4;++i) {
+	for(unsigned c = 0;c < 4;++c) uniforms[i][c] = rand_value();
+      }
+
+      std::vector< uint32_t > a(p.insn), b(insn);
+      for(unsigned i = 0;i < p.patched.size();++i) {
+	for(unsigned c = 0;c < 4;++c) a[p.patched[i] + c] = bits(uniforms[p.uniforms[i]][c]);
+	if(patched[i] != NVFX_OPT_REMOVED) {
+	  for(unsigned c = 0;c < 4;++c) b[patched[i] + c] = bits(uniforms[p.uniforms[i]][c]);
+	}
+      }
+      if(trial & 1) {
+	relocate(a,p.fixed);
+	relocate(b,fixed);
+      }
+
+      float ra[TEMPS][4], rb[TEMPS][4];
+      run(a,inputs,ra);
+      run(b,inputs,rb);
+      assert(same(ra[0],rb[0],4));
+      assert(same(ra[1],rb[1],4));
+    }
+
+    return count(insn);
+  }
+
+  static bool
+  has_branches(const std::vector< uint32_t > & insn)
+  {
+    for(unsigned pc = 0;pc < insn.size();) {
+      if(insn[pc + 2] >> 31) return true;
+      bool has_const = false;
+      for(unsigned pos = 0;pos < 3;++pos) has_const |= (insn[pc + 1 + pos] & 3) == 2;
+      pc += has_const ? 8 : 4;
+    }
+    return false;
+  }
+
+  // MOVC of an immediate's x, or of uniform; IF NE.xxxx; MOV R0, f[1]; ELSE; MOV R0, f[2]; ENDIF;
+  // MOV R1, R0:
+  static program_t
+  if_program(float condition,int uniform)
+  {
+    program_t p;
+    const float imm[4] = { condition, 0, 0, 0 };
+    src_t movc = { FILE_CONST, 0, { 0, 1, 2, 3 }, false, false };
+    src_t a = { FILE_INPUT, 1, { 0, 1, 2, 3 }, false, false };
+    src_t b = { FILE_INPUT, 2, { 0, 1, 2, 3 }, false, false };
+    src_t r0 = { FILE_TEMP, 0, { 0, 1, 2, 3 }, false, false };
+
+    emit(p,OP_MOV,-1,1,false,&movc,1,imm,uniform);
+    p.insn[p.insn.size() - 8] |= 1 << 8; // writes the condition codes
+
+    const unsigned at = p.insn.size();
+    const uint32_t hw[4] = { (2u << 24) | (1u << 30), 5u << 18, 0, 0 };
+    p.insn.insert(p.insn.end(),hw,hw + 4);
+    emit(p,OP_MOV,0,15,false,&a,1,0,-1);
+    p.insn[at + 2] = (1u << 31) | p.insn.size();
+    emit(p,OP_MOV,0,15,false,&b,1,0,-1);
+    p.insn[at + 3] = p.insn.size();
+    emit(p,OP_MOV,1,15,false,&r0,1,0,-1);
+    p.insn[p.insn.size() - 4] |= 1;
+    return p;
+  }
+
+  static bool
+  optimize(program_t & p,unsigned flags,std::vector< unsigned > & remap)
+  {
+    remap.resize(p.insn.size());
+
+    nvfx_fp_opt opt;
+    memset(&opt,0,sizeof(opt));
+    opt.insn = &p.insn[0];
+    opt.insn_len = p.insn.size();
+    opt.live_out = (1 << 0) | (1 << 1);
+    opt.patched = p.patched.empty() ? 0 : &p.patched[0];
+    opt.nr_patched = p.patched.size();
+    opt.remap = &remap[0];
+
+    if(!nvfx_fp_optimize(&opt,flags)) return false;
+    p.insn.resize(opt.insn_len);
+    assert(p.insn[opt.last] & 1);
+    return true;
+  }
+
+}
+
+//
+// Vertex programs:
+namespace vp {
+
+  static const unsigned vec_opcodes[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x07, 0x09, 0x0A, 0x0B, 0x0C, 0x0E, 0x0F };
+  static const unsigned sca_mov = 0x01, sca_rcp = 0x02;
+
+  static const unsigned TEMPS = 6, INPUTS = 16, CONSTS = 8, OUTPUTS = 4;
+
+  struct program_t {
+    std::vector< uint32_t > insn;
+    std::vector< int > consts;
+  };
+
+  static uint32_t
+  encode_src(const src_t & s)
+  {
+    uint32_t sr = (s.file == FILE_TEMP) ? 1 : ((s.file == FILE_INPUT) ? 2 : 3);
+    if(s.file == FILE_TEMP) sr |= s.index << 2;
+    for(unsigned c = 0;c < 4;++c) sr |= s.swz[c] << (14 - 2 * c);
+    if(s.negate) sr |= 1 << 16;
+    return sr;
+  }
+
+  static void
+  set_src(uint32_t * hw,unsigned pos,uint32_t sr)
+  {
+    switch(pos) {
+    case 0: hw[1] |= sr >> 9; hw[2] |= (sr & 0x1ff) << 23; break;
+    case 1: hw[2] |= sr << 6; break;
+    case 2: hw[2] |= sr >> 11; hw[3] |= (sr & 0x7ff) << 21; break;
+    }
+  }
+
+  static uint32_t
+  get_src(const uint32_t * hw,unsigned pos)
+  {
+    switch(pos) {
+    case 0: return ((hw[1] & 0xff) << 9) | (hw[2] >> 23);
+    case 1: return (hw[2] >> 6) & 0x1ffff;
+    default: return ((hw[2] & 0x3f) << 11) | (hw[3] >> 21);
+    }
+  }
+
+  static unsigned
+  reverse(unsigned mask)
+  {
+    return ((mask >> 3) & 1) | ((mask >> 1) & 2) | ((mask << 1) & 4) | ((mask << 3) & 8);
+  }
+
+  // op is OP_*; output >= 0 writes output registers, otherwise temporary dst:
+  static void
+  emit(program_t & p,unsigned op,bool scalar,int dst,int output,unsigned mask,const src_t * srcs,unsigned nsrcs,int cst)
+  {
+    uint32_t hw[4] = { 7 << 10, 0, 0, 0 };
+
+    if(!scalar) {
+      hw[1] |= vec_opcodes[op] << 22;
+      hw[3] |= 0x1f << 7;
+      hw[3] |= reverse(mask) << 13;
+      if(output >= 0) {
+	hw[0] |= (1 << 30) | (0x3f << 15);
+	hw[3] |= output << 2;
+      }
+      else {
+	hw[0] |= dst << 15;
+	hw[3] |= 0x1f << 2;
+      }
+    }
+    else {
+      hw[1] |= ((op == OP_RCP) ? sca_rcp : sca_mov) << 27;
+      hw[0] |= 0x3f << 15;
+      hw[3] |= reverse(mask) << 17;
+      if(output >= 0) {
+	hw[3] |= (1 << 12) | (0x1f << 7);
+	hw[3] |= output << 2;
+      }
+      else {
+	hw[3] |= dst << 7;
+	hw[3] |= 0x1f << 2;
+      }
+    }
+
+    // Vector ADD reads sources 0 and 2, and scalar instructions read source 2:
+    static const unsigned add_positions[] = { 0, 2 }, sca_positions[] = { 2 };
+    for(unsigned i = 0;i < 3;++i) {
+      unsigned pos = i;
+      if(scalar) pos = (i < 1) ? sca_positions[i] : 3;
+      else if(op == OP_ADD) pos = (i < 2) ? add_positions[i] : 3;
+      if(i < nsrcs && pos < 3) {
+	set_src(hw,pos,encode_src(srcs[i]));
+	if(srcs[i].file == FILE_INPUT) hw[1] |= srcs[i].index << 8;
+	if(srcs[i].abs) hw[0] |= 1 << (21 + pos);
+      }
+    }
+    for(unsigned pos = 0;pos < 3;++pos) {
+      if(!(get_src(hw,pos) & 3)) set_src(hw,pos,2); // unused sources are encoded as inputs
+    }
+
+    p.insn.insert(p.insn.end(),hw,hw + 4);
+    p.consts.push_back(cst);
+  }
+
+  static void
+  run(const std::vector< uint32_t > & insn,const std::vector< int > & consts,const float inputs[][4],const float constants[][4],float outputs[][4])
+  {
+    float regs[32][4];
+    memset(regs,0,sizeof(regs));
+    memset(outputs,0,sizeof(float) * 4 * OUTPUTS);
+
+    for(unsigned i = 0;i < insn.size() / 4;++i) {
+      const uint32_t * hw = &insn[i * 4];
+      const unsigned vec = (hw[1] >> 22) & 0x1f, sca = (hw[1] >> 27) & 0x1f;
+
+      float s[3][4];
+      for(unsigned pos = 0;pos < 3;++pos) {
+	const uint32_t sr = get_src(hw,pos);
+	const float * v = 0;
+	unsigned swz[4];
+
+	switch(sr & 3) {
+	case 1: v = regs[(sr >> 2) & 31]; break;
+	case 2: v = inputs[(hw[1] >> 8) & 15]; break;
+	case 3: v = constants[consts[i]]; break;
+	default: assert(0);
+	}
+	for(unsigned c = 0;c < 4;++c) swz[c] = (sr >> (14 - 2 * c)) & 3;
+	modify(v,swz,(sr >> 16) & 1,(hw[0] >> (21 + pos)) & 1,s[pos]);
+      }
+
+      // Both halves read their sources before either writes:
+      float vr[4], sr[4];
+      if(vec) {
+	unsigned op = 0;
+	while(vec_opcodes[op] != vec) ++op;
+	execute(op,s[0],(op == OP_ADD) ? s[2] : s[1],s[2],vr);
+      }
+      if(sca) {
+	execute((sca == sca_rcp) ? OP_RCP : OP_MOV,s[2],s[2],s[2],sr);
+	if(sca == sca_mov) {
+	  for(unsigned c = 0;c < 4;++c) sr[c] = s[2][0];
+	}
+      }
+
+      if(vec) {
+	const unsigned mask = reverse((hw[3] >> 13) & 15);
+	float * d = (hw[0] & (1 << 30)) ? outputs[(hw[3] >> 2) & 31] : regs[(hw[0] >> 15) & 0x3f];
+	for(unsigned c = 0;c < 4;++c) {
+	  if(mask & (1 << c)) d[c] = vr[c];
+	}
+      }
+      if(sca) {
+	const unsigned mask = reverse((hw[3] >> 17) & 15);
+	float * d = (hw[3] & (1 << 12)) ? outputs[(hw[3] >> 2) & 31] : regs[(hw[3] >> 7) & 0x1f];
+	for(unsigned c = 0;c < 4;++c) {
+	  if(mask & (1 << c)) d[c] = sr[c];
+	}
+      }
+
+      if(hw[3] & 1) break;
+    }
+  }
+
+  static program_t
+  generate(unsigned n)
+  {
+    program_t p;
+
+    for(unsigned i = 0;i < n;++i) {
+      unsigned op;
+      const unsigned choice = rand_n(100);
+      if(choice < 25) op = OP_MOV;
+      else if(choice < 40) op = OP_MUL;
+      else if(choice < 55) op = OP_ADD;
+      else if(choice < 70) op = OP_RCP;
+      else op = rand_n(12);
+
+      const bool scalar = (op == OP_RCP) || (op == OP_MOV && rand_chance(20));
+      const unsigned input = rand_n(INPUTS);
+      const int cst = rand_n(CONSTS);
+      bool uses_const = false;
+
+      src_t s[3];
+      for(unsigned pos = 0;pos < op_sources[op];++pos) {
+	const unsigned what = rand_n(10);
+	if(what < 6) s[pos] = rand_swizzled(FILE_TEMP,rand_n(TEMPS));
+	else if(what < 8) s[pos] = rand_swizzled(FILE_INPUT,input);
+	else {
+	  s[pos] = rand_swizzled(FILE_CONST,cst);
+	  uses_const = true;
+	}
+      }
+
+      const unsigned mask = (op == OP_MOV && rand_chance(70)) ? 15 : (1 + rand_n(15));
+      const int output = rand_chance(15) ? (int)rand_n(OUTPUTS) : -1;
+      emit(p,op,scalar,rand_n(TEMPS),output,mask,s,op_sources[op],uses_const ? cst : -1);
+    }
+
+    for(unsigned i = 0;i < OUTPUTS;++i) {
+      src_t s = rand_swizzled(FILE_TEMP,rand_n(TEMPS));
+      emit(p,OP_MOV,false,0,i,15,&s,1,-1);
+    }
+    p.insn[p.insn.size() - 1] |= 1;
+    return p;
+  }
+
+  static unsigned
+  check(const program_t & p,unsigned flags)
+  {
+    std::vector< uint32_t > insn(p.insn);
+    std::vector< int > consts(p.consts);
+    std::vector< unsigned > remap(p.consts.size());
+
+    nvfx_vp_opt opt;
+    memset(&opt,0,sizeof(opt));
+    opt.insn = &insn[0];
+    opt.nr_insns = p.consts.size();
+    opt.consts = &consts[0];
+    opt.remap = &remap[0];
+
+    if(nvfx_vp_optimize(&opt,flags)) {
+      assert(opt.nr_insns <= p.consts.size());
+      insn.resize(opt.nr_insns * 4);
+      consts.resize(opt.nr_insns);
+      assert(insn[insn.size() - 1] & 1);
+      assert(remap[p.consts.size() - 1] == opt.nr_insns - 1);
+    }
+
+    for(unsigned trial = 0;trial < 8;++trial) {
+      float inputs[INPUTS][4], constants[CONSTS][4], a[OUTPUTS][4], b[OUTPUTS][4];
+      for(unsigned i = 0;i < INPUTS;++i) {
+	for(unsigned c = 0;c < 4;++c) inputs[i][c] = rand_value();
+      }
+      for(unsigned i = 0;i < CONSTS;++i) {
+	for(unsigned c = 0;c < 4;++c) constants[i][c] = rand_value();
+      }
+
+      run(p.insn,p.consts,inputs,constants,a);
+      run(insn,consts,inputs,constants,b);
+      assert(same(a[0],b[0],4 * OUTPUTS));
+    }
+
+    return insn.size() / 4;
+  }
+
+}
+
+static src_t
+plain(unsigned file,unsigned index)
+{
+  src_t s;
+  s.file = file;
+  s.index = index;
+  for(unsigned c = 0;c < 4;++c) s.swz[c] = c;
+  s.negate = s.abs = false;
+  return s;
+}
+
+static void
+test_fp_passes()
+{
+  const float imm[4] = { 2, 3, 4, 5 };
+
+  // MOV R2, f[1]; MUL R3, R2, imm; ADD R0, R3, R2 -> MAD R0, f[1], imm, f[1]:
+  {
+    fp::program_t p;
+    src_t mov[1] = { plain(FILE_INPUT,1) };
+    src_t mul[2] = { plain(FILE_TEMP,2), plain(FILE_CONST,0) };
+    src_t add[2] = { plain(FILE_TEMP,3), plain(FILE_TEMP,2) };
+    fp::emit(p,OP_MOV,2,15,false,mov,1,0,-1);
+    fp::emit(p,OP_MUL,3,15,false,mul,2,imm,-1);
+    fp::emit(p,OP_ADD,0,15,false,add,2,0,-1);
+    p.insn[p.insn.size() - 4] |= 1;
+    assert(fp::check(p,NVFX_OPT_ALL) == 1);
+    assert(fp::check(p,NVFX_OPT_ALL & ~NVFX_OPT_FUSE_MAD) == 2);
+    assert(fp::check(p,0) == 3);
+  }
+
+  // A uniform moves along with the MUL that reads it:
+  {
+    fp::program_t p;
+    src_t mul[2] = { plain(FILE_INPUT,1), plain(FILE_CONST,0) };
+    src_t add[2] = { plain(FILE_TEMP,3), plain(FILE_INPUT,1) };
+    src_t mov[1] = { plain(FILE_TEMP,4) };
+    fp::emit(p,OP_MOV,4,15,false,add,1,0,-1);
+    fp::emit(p,OP_MUL,3,15,false,mul,2,0,2);
+    fp::emit(p,OP_ADD,0,15,false,add,2,0,-1);
+    fp::emit(p,OP_MOV,1,15,false,mov,1,0,-1);
+    p.insn[p.insn.size() - 4] |= 1;
+    assert(fp::check(p,NVFX_OPT_ALL) == 2);
+  }
+
+  // Immediates are folded, and the result propagated:
+  {
+    fp::program_t p;
+    src_t mul[2] = { plain(FILE_CONST,0), plain(FILE_CONST,0) };
+    src_t add[2] = { plain(FILE_TEMP,2), plain(FILE_INPUT,3) };
+    mul[1].swz[0] = 3;
+    fp::emit(p,OP_MUL,2,15,false,mul,2,imm,-1);
+    fp::emit(p,OP_ADD,0,15,false,add,2,0,-1);
+    p.insn[p.insn.size() - 4] |= 1;
+    assert(fp::check(p,NVFX_OPT_COPY_PROPAGATE | NVFX_OPT_DEAD_CODE | NVFX_OPT_FOLD_CONSTANTS) == 1);
+    assert(fp::check(p,NVFX_OPT_COPY_PROPAGATE | NVFX_OPT_DEAD_CODE) == 2);
+  }
+
+  // Relocated sources aren't rewritten, but the instructions that read them can still go:
+  {
+    fp::program_t p;
+    src_t mov[1] = { plain(FILE_TEMP,fp::SPRITE_TEMP) };
+    src_t add[2] = { plain(FILE_TEMP,2), plain(FILE_INPUT,3) };
+    p.fixed.push_back(1);
+    fp::emit(p,OP_MOV,2,15,false,mov,1,0,-1);
+    p.fixed.push_back(p.insn.size() + 1);
+    fp::emit(p,OP_MOV,4,15,false,mov,1,0,-1);
+    fp::emit(p,OP_ADD,0,15,false,add,2,0,-1);
+    p.insn[p.insn.size() - 4] |= 1;
+    assert(fp::check(p,NVFX_OPT_ALL) == 2);
+  }
+
+  // Branches aren't optimized:
+  {
+    fp::program_t p;
+    src_t mov[1] = { plain(FILE_INPUT,1) };
+    fp::emit(p,OP_MOV,2,15,false,mov,1,0,-1);
+    fp::emit(p,OP_MOV,0,15,false,mov,1,0,-1);
+    p.insn[p.insn.size() - 2] |= 1u << 31;
+    std::vector< unsigned > remap(p.insn.size());
+    nvfx_fp_opt opt;
+    memset(&opt,0,sizeof(opt));
+    opt.insn = &p.insn[0];
+    opt.insn_len = p.insn.size();
+    opt.remap = &remap[0];
+    assert(!nvfx_fp_optimize(&opt,NVFX_OPT_ALL));
+  }
+}
+
+static void
+test_fp_branches()
+{
+  // IFs on immediates are resolved; the IF and the arm that can't run go:
+  for(unsigned taken = 0;taken < 2;++taken) {
+    fp::program_t p = fp::if_program(taken ? 2.0f : 0.0f,-1);
+    std::vector< unsigned > remap;
+    assert(fp::optimize(p,NVFX_OPT_RESOLVE_BRANCHES,remap));
+    assert(!fp::has_branches(p.insn));
+    assert(fp::count(p.insn) == 3);
+    assert(remap[4] == 4 && remap[8] == NVFX_OPT_REMOVED);
+
+    float inputs[fp::INPUTS][4], regs[fp::TEMPS][4];
+    for(unsigned i = 0;i < fp::INPUTS;++i) {
+      for(unsigned c = 0;c < 4;++c) inputs[i][c] = rand_value();
+    }
+    fp::run(p.insn,inputs,regs);
+    assert(same(regs[0],inputs[taken ? 1 : 2],4));
+    assert(same(regs[1],inputs[taken ? 1 : 2],4));
+
+    // Then the condition codes aren't tested any more, and the MOVC is dead:
+    p = fp::if_program(taken ? 2.0f : 0.0f,-1);
+    assert(fp::optimize(p,NVFX_OPT_ALL,remap));
+    assert(fp::count(p.insn) == 2);
+
+    // Also with the NOP that the driver ends programs with, for branches to the end:
+    p = fp::if_program(taken ? 2.0f : 0.0f,-1);
+    const uint32_t nop[4] = { 1, 0, 0, 0 };
+    p.insn.insert(p.insn.end(),nop,nop + 4);
+    assert(fp::optimize(p,NVFX_OPT_ALL,remap));
+    assert(fp::count(p.insn) == 2);
+    fp::run(p.insn,inputs,regs);
+    assert(same(regs[1],inputs[taken ? 1 : 2],4));
+  }
+
+  // Not when the condition comes from a uniform:
+  {
+    fp::program_t p = fp::if_program(0.0f,0);
+    std::vector< unsigned > remap;
+    assert(!fp::optimize(p,NVFX_OPT_ALL,remap));
+  }
+
+  // ... or when something else branches into the arm that would go:
+  {
+    fp::program_t p = fp::if_program(0.0f,-1);
+    const uint32_t cal[4] = { 1u << 24, 7u << 18, (1u << 31) | 12, 0 };
+    p.insn.insert(p.insn.end(),cal,cal + 4);
+    std::vector< unsigned > remap;
+    assert(!fp::optimize(p,NVFX_OPT_ALL,remap));
+  }
+}
+
+static void
+test_fp_algebraic()
+{
+  const float zero[4] = { 0, 0, 0, 0 }, one[4] = { 1, 1, 1, 1 };
+
+  // MUL R2, f[1], 1; ADD R3, R2, 0; MAD R0, R3, 1, f[1]; DP4 R1, f[3], 0 -> ADD R0, f[1], f[1];
+  // MOV R1, 0:
+  fp::program_t p;
+  src_t mul[2] = { plain(FILE_INPUT,1), plain(FILE_CONST,0) };
+  src_t add[2] = { plain(FILE_TEMP,2), plain(FILE_CONST,0) };
+  src_t mad[3] = { plain(FILE_TEMP,3), plain(FILE_CONST,0), plain(FILE_INPUT,1) };
+  src_t dp4[2] = { plain(FILE_INPUT,3), plain(FILE_CONST,0) };
+  fp::emit(p,OP_MUL,2,15,false,mul,2,one,-1);
+  fp::emit(p,OP_ADD,3,15,false,add,2,zero,-1);
+  fp::emit(p,OP_MAD,0,15,false,mad,3,one,-1);
+  fp::emit(p,OP_DP4,1,15,false,dp4,2,zero,-1);
+  p.insn[p.insn.size() - 8] |= 1;
+  assert(fp::check(p,NVFX_OPT_ALL | NVFX_OPT_ALGEBRAIC) == 2);
+  assert(fp::check(p,NVFX_OPT_ALL) == 4);
+
+  // Patched immediates are left alone:
+  fp::program_t q;
+  fp::emit(q,OP_MUL,0,15,false,mul,2,0,1);
+  fp::emit(q,OP_DP4,1,15,false,dp4,2,0,2);
+  q.insn[q.insn.size() - 8] |= 1;
+  assert(fp::check(q,NVFX_OPT_ALL | NVFX_OPT_ALGEBRAIC) == 2);
+}
+
+static void
+test_vp_passes()
+{
+  // MUL R1, v[0], c[2]; ADD o[0], R1, c[2] -> MAD:
+  {
+    vp::program_t p;
+    src_t mul[2] = { plain(FILE_INPUT,0), plain(FILE_CONST,2) };
+    src_t add[2] = { plain(FILE_TEMP,1), plain(FILE_CONST,2) };
+    vp::emit(p,OP_MUL,false,1,-1,15,mul,2,2);
+    vp::emit(p,OP_ADD,false,0,0,15,add,2,2);
+    p.insn[p.insn.size() - 1] |= 1;
+    assert(vp::check(p,NVFX_OPT_ALL) == 1);
+  }
+
+  // MUL R1, v[0], c[2]; ADD o[0], R1, c[3] can't be, since only one constant can be read:
+  {
+    vp::program_t p;
+    src_t mul[2] = { plain(FILE_INPUT,0), plain(FILE_CONST,2) };
+    src_t add[2] = { plain(FILE_TEMP,1), plain(FILE_CONST,3) };
+    vp::emit(p,OP_MUL,false,1,-1,15,mul,2,2);
+    vp::emit(p,OP_ADD,false,0,0,15,add,2,3);
+    p.insn[p.insn.size() - 1] |= 1;
+    assert(vp::check(p,NVFX_OPT_ALL & ~NVFX_OPT_COISSUE) == 2);
+  }
+
+  // DP4 o[0], v[0], c[0]; RCP R2, v[0] are co-issued; the MOVs go away:
+  {
+    vp::program_t p;
+    src_t dp4[2] = { plain(FILE_TEMP,1), plain(FILE_CONST,0) };
+    src_t mov[1] = { plain(FILE_INPUT,0) };
+    src_t rcp[1] = { plain(FILE_TEMP,1) };
+    src_t out[1] = { plain(FILE_TEMP,2) };
+    vp::emit(p,OP_MOV,false,1,-1,15,mov,1,-1);
+    vp::emit(p,OP_DP4,false,0,0,15,dp4,2,0);
+    vp::emit(p,OP_RCP,true,2,-1,15,rcp,1,-1);
+    vp::emit(p,OP_MOV,false,0,1,15,out,1,-1);
+    p.insn[p.insn.size() - 1] |= 1;
+    assert(vp::check(p,NVFX_OPT_ALL) == 2);
+    assert(vp::check(p,NVFX_OPT_ALL & ~NVFX_OPT_COISSUE) == 3);
+  }
+
+  // Instructions after LAST stay where they are:
+  {
+    vp::program_t p;
+    src_t mov[1] = { plain(FILE_INPUT,0) };
+    src_t out[1] = { plain(FILE_TEMP,1) };
+    vp::emit(p,OP_MOV,false,1,-1,15,mov,1,-1);
+    vp::emit(p,OP_MOV,false,0,0,15,out,1,-1);
+    p.insn[p.insn.size() - 1] |= 1;
+    vp::emit(p,OP_MOV,false,0,1,15,out,1,-1);
+    p.insn[p.insn.size() - 1] |= 1;
+
+    std::vector< unsigned > remap(3);
+    nvfx_vp_opt opt;
+    memset(&opt,0,sizeof(opt));
+    opt.insn = &p.insn[0];
+    opt.nr_insns = 3;
+    opt.consts = &p.consts[0];
+    opt.remap = &remap[0];
+    assert(nvfx_vp_optimize(&opt,NVFX_OPT_ALL));
+    assert(opt.nr_insns == 2);
+    assert(remap[0] == NVFX_OPT_REMOVED && remap[1] == 0 && remap[2] == 1);
+    assert((p.insn[3] & 1) && (p.insn[7] & 1));
+  }
+}
+
+static void
+test_random()
+{
+  unsigned fp_before = 0, fp_after = 0, vp_before = 0, vp_after = 0;
+
+  for(unsigned i = 0;i < 2000;++i) {
+    const fp::program_t f = fp::generate(4 + rand_n(24));
+    fp_before += fp::count(f.insn);
+    fp_after += fp::check(f,NVFX_OPT_ALL);
+
+    // Each pass on its own:
+    for(unsigned pass = 1;pass < NVFX_OPT_ALL;pass <<= 1) {
+      fp::check(f,pass);
+    }
+
+    const vp::program_t v = vp::generate(4 + rand_n(24));
+    vp_before += v.consts.size();
+    vp_after += vp::check(v,NVFX_OPT_ALL);
+    for(unsigned pass = 1;pass < NVFX_OPT_ALL;pass <<= 1) {
+      vp::check(v,pass);
+    }
+  }
+
+  std::cout << "fragment programs: " << fp_before << " -> " << fp_after << " instructions" << std::endl;
+  std::cout << "vertex programs: " << vp_before << " -> " << vp_after << " instructions" << std::endl;
+  assert(fp_after < fp_before);
+  assert(vp_after < vp_before);
+}
+
+int
+main(int argc,char ** argv)
+{
+  // Another seed may be given, to run different programs:
+  if(argc > 1) seed = strtoul(argv[1],0,10);
+
+  try {
+    test_fp_passes();
+    test_fp_branches();
+    test_fp_algebraic();
+    test_vp_passes();
+    test_random();
+
+    std::cout << "passed" << std::endl;
+  }
+  catch(const assertion & a) {
+    std::cerr << "failed: " << a.what() << " (seed " << seed << ")" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
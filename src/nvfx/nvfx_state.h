@@ -105,6 +105,10 @@ struct nvfx_fragment_program {
 
 	uint32_t fp_control;
 
+	/* R registers that hold the program's results (depth), which a
+	 * re-optimized copy of the program has to keep: */
+	unsigned long long r_outputs;
+
 	unsigned bo_prog_idx;
 	unsigned prog_size;
 	unsigned progs_per_bo;
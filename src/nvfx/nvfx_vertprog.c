@@ -15,6 +15,7 @@
 #include "nvfx_context.h"
 #include "nvfx_state.h"
 #include "nvfx_resource.h"
+#include "nvfx_optimize.h"
 
 /* TODO (at least...):
  *  1. Indexed consts  + ARL
@@ -986,7 +987,63 @@ nvfx_vertprog_prepare(struct nvfx_context* nvfx, struct nvfx_vpc *vpc)
 	return TRUE;
 }
 
+/* Runs nvfx_optimize over a program that doesn't branch, then rebuilds the
+ * constant relocations from what each instruction reads. The clip plane DP4s
+ * have to stay at the end, where nvfx_state_emit.c expects them, so they're
+ * not co-issued with anything. */
+static void
+nvfx_vertprog_optimize(struct nvfx_context *nvfx, struct nvfx_vertex_program *vp)
+{
+	struct nvfx_vp_opt opt;
+	int *consts;
+	unsigned *remap;
+	unsigned i;
+
+	if (!vp->nr_insns || vp->branch_relocs.size)
+		return;
+
+	consts = MALLOC(sizeof(int) * vp->nr_insns);
+	remap = MALLOC(sizeof(unsigned) * vp->nr_insns);
+	if (!consts || !remap)
+		goto out;
+
+	/* only one constant can be read per instruction */
+	for (i = 0; i < vp->nr_insns; ++i)
+		consts[i] = -1;
+	for (i = 0; i < vp->const_relocs.size; i += sizeof(struct nvfx_relocation)) {
+		struct nvfx_relocation *reloc = (struct nvfx_relocation *)((char *)vp->const_relocs.data + i);
+
+		consts[reloc->location] = reloc->target;
+	}
+
+	memset(&opt, 0, sizeof(opt));
+	opt.insn = vp->insns[0].data;
+	opt.nr_insns = vp->nr_insns;
+	opt.consts = consts;
+	opt.remap = remap;
+
+	if (!nvfx_vp_optimize(&opt, nvfx->use_vp_clipping ? (NVFX_OPT_ALL & ~NVFX_OPT_COISSUE) : NVFX_OPT_ALL))
+		goto out;
+
+	vp->nr_insns = opt.nr_insns;
+	vp->const_relocs.size = 0;
+	for (i = 0; i < vp->nr_insns; ++i) {
+		struct nvfx_relocation reloc;
+
+		if (consts[i] < 0)
+			continue;
+		reloc.location = i;
+		reloc.target = consts[i];
+		util_dynarray_append(&vp->const_relocs, struct nvfx_relocation, reloc);
+	}
+
+out:
+	FREE(remap);
+	FREE(consts);
+}
+
 DEBUG_GET_ONCE_BOOL_OPTION(nvfx_dump_vp, "NVFX_DUMP_VP", FALSE)
+DEBUG_GET_ONCE_BOOL_OPTION(nvfx_optimize, "NVFX_OPTIMIZE", TRUE)
 
 struct nvfx_vertex_program*
 nvfx_vertprog_translate(struct nvfx_context *nvfx, const struct pipe_shader_state* vps, struct tgsi_shader_info* info)
@@ -1131,6 +1188,9 @@ nvfx_vertprog_translate(struct nvfx_context *nvfx, const struct pipe_shader_stat
 		}
 	}
 
+	if(nvfx->is_nv4x && debug_get_option_nvfx_optimize())
+		nvfx_vertprog_optimize(nvfx, vp);
+
 	if(debug_get_option_nvfx_dump_vp())
 	{
 		debug_printf("\n");
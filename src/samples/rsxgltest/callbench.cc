@@ -0,0 +1,242 @@
+/*
+ * rsxgltest - callbench
+ *
+ * Times frequently-called entry points (setting uniforms, binding objects, drawing), to measure
+ * the cost of GL error checking. Compare the figures reported by a default build with those
+ * reported when the context is created with EGL_CONTEXT_OPENGL_NO_ERROR_KHR (define
+ * RSXGLTEST_NO_ERROR), or when the library is configured with --disable-error-checking.
+ *
+ * The same uniform values are set every time, so nearly all glUniform*() calls should be
+ * reported as redundant.
+ */
+
+#define GL3_PROTOTYPES
+#include <GL3/gl3.h>
+#include <GL3/gl3ext.h>
+#include <GL3/rsxgl.h>
+
+#include "rsxgltest.h"
+#include "math3d.h"
+
+#include <stddef.h>
+#include "cube_vert.h"
+#include "cube_frag.h"
+
+#include <io/pad.h>
+
+#include <sys/time.h>
+#include <Eigen/Geometry>
+
+const char * rsxgltest_name = "callbench";
+
+GLuint buffers[2] = { 0,0 };
+GLuint texture = 0;
+
+GLuint shaders[2] = { 0,0 };
+GLuint program = 0;
+
+GLint ProjMatrix_location = -1, TransMatrix_location = -1, ncubes_location = -1;
+
+// Number of times each function is called per frame:
+const unsigned int ncalls = 10000;
+
+// Frames over which the timings are averaged before being reported:
+const unsigned int nframes = 60;
+unsigned int frame = 0;
+
+enum bench_functions {
+  BENCH_UNIFORM1F = 0,
+  BENCH_UNIFORM_MATRIX4FV,
+  BENCH_BIND_BUFFER,
+  BENCH_BIND_TEXTURE,
+  BENCH_DRAW_ELEMENTS,
+  BENCH_MAX
+};
+
+const char * bench_names[BENCH_MAX] = {
+  "glUniform1f",
+  "glUniformMatrix4fv",
+  "glBindBuffer",
+  "glBindTexture",
+  "glDrawElements"
+};
+
+double bench_elapsed[BENCH_MAX] = { 0 };
+
+static inline double
+bench_now()
+{
+  struct timeval t;
+  gettimeofday(&t,0);
+  return (double)t.tv_sec + ((double)t.tv_usec / 1.0e6);
+}
+
+extern "C"
+void
+rsxgltest_pad(unsigned int,const padData * paddata)
+{
+}
+
+extern "C"
+void
+rsxgltest_init(int argc,const char ** argv)
+{
+  tcp_printf("%s\n",__PRETTY_FUNCTION__);
+
+  shaders[0] = glCreateShader(GL_VERTEX_SHADER);
+  shaders[1] = glCreateShader(GL_FRAGMENT_SHADER);
+
+  program = glCreateProgram();
+
+  glAttachShader(program,shaders[0]);
+  glAttachShader(program,shaders[1]);
+
+  const GLchar * shader_srcs[] = { (const GLchar *)cube_vert, (const GLchar *)cube_frag };
+  GLint shader_srcs_lengths[] = { cube_vert_len, cube_frag_len };
+
+  glShaderSource(shaders[0],1,shader_srcs,shader_srcs_lengths);
+  glCompileShader(shaders[0]);
+
+  glShaderSource(shaders[1],1,shader_srcs + 1,shader_srcs_lengths + 1);
+  glCompileShader(shaders[1]);
+
+  glLinkProgram(program);
+  glValidateProgram(program);
+
+  summarize_program("callbench",program);
+
+  GLint
+    vertex_location = glGetAttribLocation(program,"position"),
+    color_location = glGetAttribLocation(program,"color");
+
+  ProjMatrix_location = glGetUniformLocation(program,"ProjMatrix");
+  TransMatrix_location = glGetUniformLocation(program,"TransMatrix");
+  ncubes_location = glGetUniformLocation(program,"ncubes");
+
+  glUseProgram(program);
+
+  glUniformMatrix4fv(ProjMatrix_location,1,GL_FALSE,Eigen::Affine3f::Identity().data());
+  glUniform1f(ncubes_location,1.0f);
+  glUniform1i(glGetUniformLocation(program,"texture"),0);
+
+  // A single triangle:
+  const float geometry[] = {
+    -0.5,-0.5,0,
+    1,0,0,
+
+    0.5,-0.5,0,
+    0,1,0,
+
+    0,0.5,0,
+    0,0,1
+  };
+
+  const GLuint indices[] = {
+    0, 1, 2
+  };
+
+  glGenBuffers(2,buffers);
+
+  glBindBuffer(GL_ARRAY_BUFFER,buffers[0]);
+  glBufferData(GL_ARRAY_BUFFER,sizeof(geometry),geometry,GL_STATIC_DRAW);
+  glEnableVertexAttribArray(vertex_location);
+  glEnableVertexAttribArray(color_location);
+  glVertexAttribPointer(vertex_location,3,GL_FLOAT,GL_FALSE,sizeof(float) * 6,0);
+  glVertexAttribPointer(color_location,3,GL_FLOAT,GL_FALSE,sizeof(float) * 6,(const GLvoid *)(sizeof(float) * 3));
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,buffers[1]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(indices),indices,GL_STATIC_DRAW);
+
+  // The vertex program fetches transformations from a texture:
+  const float identity[16] = {
+    1,0,0,0,
+    0,1,0,0,
+    0,0,1,0,
+    0,0,0,1
+  };
+
+  glGenTextures(1,&texture);
+  glBindTexture(GL_TEXTURE_1D,texture);
+  glTexStorage1D(GL_TEXTURE_1D,1,GL_RGBA32F,4);
+  glTexSubImage1D(GL_TEXTURE_1D,0,0,4,GL_RGBA,GL_FLOAT,identity);
+  glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_1D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+
+  report_glerror("init");
+}
+
+extern "C"
+int
+rsxgltest_draw()
+{
+  glClearColor(0,0,0,1);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  const Eigen::Affine3f modelview = Eigen::Affine3f::Identity();
+  double t0, t1;
+
+  t0 = bench_now();
+  for(unsigned int i = 0;i < ncalls;++i) {
+    glUniform1f(ncubes_location,1.0f);
+  }
+  t1 = bench_now();
+  bench_elapsed[BENCH_UNIFORM1F] += t1 - t0;
+
+  t0 = t1;
+  for(unsigned int i = 0;i < ncalls;++i) {
+    glUniformMatrix4fv(TransMatrix_location,1,GL_FALSE,modelview.data());
+  }
+  t1 = bench_now();
+  bench_elapsed[BENCH_UNIFORM_MATRIX4FV] += t1 - t0;
+
+  t0 = t1;
+  for(unsigned int i = 0;i < ncalls;++i) {
+    glBindBuffer(GL_ARRAY_BUFFER,buffers[i & 1]);
+  }
+  t1 = bench_now();
+  bench_elapsed[BENCH_BIND_BUFFER] += t1 - t0;
+
+  t0 = t1;
+  for(unsigned int i = 0;i < ncalls;++i) {
+    glBindTexture(GL_TEXTURE_1D,texture);
+  }
+  t1 = bench_now();
+  bench_elapsed[BENCH_BIND_TEXTURE] += t1 - t0;
+
+  t0 = t1;
+  for(unsigned int i = 0;i < ncalls;++i) {
+    glDrawElements(GL_TRIANGLES,3,GL_UNSIGNED_INT,0);
+  }
+  t1 = bench_now();
+  bench_elapsed[BENCH_DRAW_ELEMENTS] += t1 - t0;
+
+  if(++frame == nframes) {
+    for(unsigned int i = 0;i < BENCH_MAX;++i) {
+      tcp_printf("%s: %.1f ns/call\n",bench_names[i],(bench_elapsed[i] / (double)(nframes * ncalls)) * 1.0e9);
+      bench_elapsed[i] = 0;
+    }
+
+    struct rsxgl_uniform_statistics_t uniform_statistics;
+    rsxglGetUniformStatistics(&uniform_statistics,1);
+    tcp_printf("uniforms: %u updates, %u redundant, %u uploads, %u block calls\n",
+	       uniform_statistics.updates,uniform_statistics.redundant_updates,uniform_statistics.uploads,uniform_statistics.block_calls);
+
+    frame = 0;
+  }
+
+  return 1;
+}
+
+extern "C"
+void
+rsxgltest_exit()
+{
+  tcp_printf("%s\n",__PRETTY_FUNCTION__);
+
+  glDeleteTextures(1,&texture);
+  glDeleteBuffers(2,buffers);
+
+  glDeleteShader(shaders[0]);
+  glDeleteProgram(program);
+  glDeleteShader(shaders[1]);
+}
@@ -5,6 +5,7 @@
  */
 
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #define GL3_PROTOTYPES
 #include <GL3/gl3.h>
 #include <GL3/rsxgl.h>
@@ -372,7 +373,16 @@ main(int argc, const char ** argv)
 
 	  tcp_printf("eglCreateWindowSurface: %ix%i\n",rsxgltest_width,rsxgltest_height);
 	  
-	  EGLContext ctx = eglCreateContext(dpy,config,0,0);
+	  // Define RSXGLTEST_NO_ERROR to skip GL error checking (e.g., to compare callbench's timings):
+#if defined(RSXGLTEST_NO_ERROR)
+	  const EGLint ctx_attribs[] = {
+	    EGL_CONTEXT_OPENGL_NO_ERROR_KHR,EGL_TRUE,
+	    EGL_NONE
+	  };
+#else
+	  const EGLint * ctx_attribs = 0;
+#endif
+	  EGLContext ctx = eglCreateContext(dpy,config,0,ctx_attribs);
 	  tcp_printf("eglCreateContext: %lu\n",(unsigned long)ctx);
 	  
 	  if(ctx != EGL_NO_CONTEXT) {
@@ -60,7 +60,27 @@ GLuint buffers[2] = { 0,0 };
 GLuint shaders[2] = { 0,0 };
 GLuint program = 0;
 
-GLuint queries[2] = { 0,0 };
+// queries[0] - did the red quad pass?
+// queries[1] - time spent on the conditionally-rendered blue quad
+// queries[2] - samples that the blue quad wrote
+GLuint queries[3] = { 0,0,0 };
+
+// Conditional rendering modes, one per frame:
+const GLenum conditional_modes[4] = {
+  GL_QUERY_WAIT,
+  GL_QUERY_NO_WAIT,
+  GL_QUERY_BY_REGION_WAIT,
+  GL_QUERY_BY_REGION_NO_WAIT
+};
+
+const char * conditional_mode_names[4] = {
+  "GL_QUERY_WAIT",
+  "GL_QUERY_NO_WAIT",
+  "GL_QUERY_BY_REGION_WAIT",
+  "GL_QUERY_BY_REGION_NO_WAIT"
+};
+
+unsigned int frame = 0, conditional_failures = 0;
 
 GLint ProjMatrix_location = -1, TransMatrix_location = -1, color_location = -1;
 
@@ -154,7 +174,31 @@ rsxgltest_init(int argc,const char ** argv)
     glBindBuffer(GL_ARRAY_BUFFER,0);
   }
 
-  glGenQueries(2,queries);
+  glGenQueries(3,queries);
+}
+
+// Check the previous frame's conditional rendering. The blue quad shouldn't have written any
+// samples if the red one didn't; the *_NO_WAIT modes may draw it anyway, so they're only reported:
+static void
+check_conditional_render()
+{
+  if(frame == 0) return;
+
+  const unsigned int mode = (frame - 1) % 4;
+
+  GLuint passed = 0, samples = 0;
+  glGetQueryObjectuiv(queries[0],GL_QUERY_RESULT,&passed);
+  glGetQueryObjectuiv(queries[2],GL_QUERY_RESULT,&samples);
+
+  const bool wait = (conditional_modes[mode] == GL_QUERY_WAIT || conditional_modes[mode] == GL_QUERY_BY_REGION_WAIT);
+  const bool failed = wait && !passed && samples != 0;
+
+  if(failed) {
+    ++conditional_failures;
+  }
+
+  tcp_printf("%s: red passed: %u blue samples: %u%s (%u failures)\n",
+	     conditional_mode_names[mode],passed,samples,failed ? " FAILED" : "",conditional_failures);
 }
 
 extern "C"
@@ -167,6 +211,8 @@ rsxgltest_draw()
     compute_sine_wave(rgb_waves + 2,rsxgltest_elapsed_time)
   };
 
+  check_conditional_render();
+
   glClearColor(rgb[0],rgb[1],rgb[2],1.0);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -208,8 +254,10 @@ rsxgltest_draw()
 
   {
     glBeginQuery(GL_TIME_ELAPSED,queries[1]);
+    glBeginQuery(GL_SAMPLES_PASSED,queries[2]);
 
-    glBeginConditionalRender(queries[0],GL_QUERY_NO_WAIT);
+    // The red quad's result isn't known yet, so the GPU decides; this shouldn't block:
+    glBeginConditionalRender(queries[0],conditional_modes[frame % 4]);
 
     glUniform3f(color_location,0,0,1);
 
@@ -225,6 +273,7 @@ rsxgltest_draw()
     glEndConditionalRender();
     //glQueryCounter(queries[1],GL_TIMESTAMP);
 
+    glEndQuery(GL_SAMPLES_PASSED);
     glEndQuery(GL_TIME_ELAPSED);
 
     GLuint64 elapsed_time = 0;
@@ -245,6 +294,8 @@ rsxgltest_draw()
     glDrawArrays(GL_TRIANGLES,0,6);
   }
 
+  ++frame;
+
   return 1;
 }
 
@@ -254,6 +305,9 @@ rsxgltest_exit()
 {
   tcp_printf("%s\n",__PRETTY_FUNCTION__);
 
+  tcp_printf("conditional rendering failures: %u\n",conditional_failures);
+
+  glDeleteQueries(3,queries);
   glDeleteShader(shaders[0]);
   glDeleteProgram(program);
   glDeleteShader(shaders[1]);